@@ -0,0 +1,1123 @@
+/* vfmetal-bench: throughput, latency and bandwidth of the Metal elements
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Runs a matrix of formats, resolutions, pad counts and filter settings
+ * twice: against the renderers directly (no GStreamer scheduling, the
+ * cost of one frame through the GPU and back) and as
+ * appsrc ! element ! appsink pipelines (what an application sees).
+ * Results go to stdout, or --output, as one JSON document:
+ *
+ *   vfmetal-bench --quick --filter=compositor --output=results.json
+ *
+ * Per case: fps, CPU-side latency percentiles, upload/encode/readback CPU
+ * time and GPU execution time per frame (from the vfmetaltrace spans) and
+ * the bytes copied between system memory and the GPU.
+ *
+ * The plugin is registered from the library the tool is linked against,
+ * so the build tree is measured rather than an installed copy.
+ */
+
+#import <Foundation/Foundation.h>
+#import <Metal/Metal.h>
+#import <CoreGraphics/CoreGraphics.h>
+#import <ImageIO/ImageIO.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+
+#import "vfmetaldevice.h"
+#import "vfmetalstats.h"
+#import "vfmetaltrace.h"
+#import "metalconvertscalerenderer.h"
+#import "metalvideofilterrenderer.h"
+#import "metaltransformrenderer.h"
+#import "metalcomprenderer.h"
+
+/* Defined by GST_PLUGIN_DEFINE in plugin.m */
+const GstPluginDesc *gst_plugin_vfmetal_get_desc (void);
+
+/* Distinct input buffers cycled per input, so no frame repeats the last */
+#define BENCH_RING      4
+
+#define BENCH_FPS_N     30
+#define BENCH_FPS_D     1
+
+#define BENCH_DEFAULT_FRAMES    200
+#define BENCH_DEFAULT_WARMUP    20
+
+typedef struct
+{
+  gint frames;
+  gint warmup;
+  gchar *mode;                  /* renderer, pipeline or all */
+  gchar *filter;
+  gchar *output;
+  gboolean quick;
+  gchar *overlay_image;         /* generated PNG for overlay cases */
+} BenchOptions;
+
+static BenchOptions opts = {
+  BENCH_DEFAULT_FRAMES, BENCH_DEFAULT_WARMUP, NULL, NULL, NULL, FALSE, NULL
+};
+
+typedef struct
+{
+  gchar *name;
+  const gchar *mode;            /* "renderer" or "pipeline" */
+  const gchar *element;
+  gchar *settings;
+  GstVideoInfo in_info;
+  GstVideoInfo out_info;
+  guint pads;
+
+  guint frames;                 /* measured, warmup excluded */
+  guint failed;
+  GstClockTime elapsed;
+  GArray *latency;              /* gdouble ms per measured frame */
+  gdouble stage_ms[VF_METAL_STATS_N_STAGES];        /* per frame */
+  gdouble gpu_p99;              /* per command buffer */
+  gboolean error;
+} BenchResult;
+
+/* --- Stage times, collected through the vfmetaltrace hook --- */
+
+typedef struct
+{
+  GMutex lock;
+  gboolean active;
+  gdouble total[VF_METAL_STATS_N_STAGES];   /* ms */
+  GArray *gpu;                  /* gdouble ms per command buffer */
+} BenchStages;
+
+static BenchStages stages;
+
+static void
+bench_trace_hook (const gchar * owner_name, VfMetalStatsStage stage,
+    GstClockTime start, GstClockTime duration, gpointer user_data)
+{
+  BenchStages *s = user_data;
+  gdouble ms = (gdouble) duration / GST_MSECOND;
+
+  g_mutex_lock (&s->lock);
+  if (s->active) {
+    s->total[stage] += ms;
+    if (stage == VF_METAL_STATS_GPU)
+      g_array_append_val (s->gpu, ms);
+  }
+  g_mutex_unlock (&s->lock);
+}
+
+static void
+bench_stages_start (void)
+{
+  g_mutex_lock (&stages.lock);
+  memset (stages.total, 0, sizeof (stages.total));
+  g_array_set_size (stages.gpu, 0);
+  stages.active = TRUE;
+  g_mutex_unlock (&stages.lock);
+}
+
+static gint
+bench_compare_double (gconstpointer a, gconstpointer b)
+{
+  gdouble da = *(const gdouble *) a, db = *(const gdouble *) b;
+
+  return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+/* @samples is sorted in place */
+static gdouble
+bench_percentile (GArray * samples, gdouble q)
+{
+  if (samples->len == 0)
+    return 0.0;
+
+  g_array_sort (samples, bench_compare_double);
+  return g_array_index (samples, gdouble,
+      MIN (samples->len - 1, (guint) (q * (samples->len - 1) + 0.5)));
+}
+
+static void
+bench_stages_stop (BenchResult * res)
+{
+  g_mutex_lock (&stages.lock);
+  stages.active = FALSE;
+  for (guint i = 0; i < VF_METAL_STATS_N_STAGES; i++)
+    res->stage_ms[i] = res->frames ? stages.total[i] / res->frames : 0.0;
+  res->gpu_p99 = bench_percentile (stages.gpu, 0.99);
+  g_mutex_unlock (&stages.lock);
+}
+
+/* --- Cases and results --- */
+
+static void
+bench_info (GstVideoInfo * info, GstVideoFormat format, gint width,
+    gint height)
+{
+  gst_video_info_set_format (info, format, width, height);
+  GST_VIDEO_INFO_FPS_N (info) = BENCH_FPS_N;
+  GST_VIDEO_INFO_FPS_D (info) = BENCH_FPS_D;
+}
+
+static gboolean
+bench_selected (const gchar * name)
+{
+  return !opts.filter || strstr (name, opts.filter) != NULL;
+}
+
+static BenchResult *
+bench_result_new (GPtrArray * results, const gchar * mode,
+    const gchar * element, const gchar * settings,
+    const GstVideoInfo * in_info, const GstVideoInfo * out_info, guint pads)
+{
+  BenchResult *res;
+  GString *str;
+  gchar *name;
+
+  str = g_string_new (NULL);
+  g_string_printf (str, "%s/%s/%s-%dx%d/%s-%dx%d", mode, element,
+      gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (in_info)),
+      GST_VIDEO_INFO_WIDTH (in_info), GST_VIDEO_INFO_HEIGHT (in_info),
+      gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (out_info)),
+      GST_VIDEO_INFO_WIDTH (out_info), GST_VIDEO_INFO_HEIGHT (out_info));
+  if (pads)
+    g_string_append_printf (str, "/pads=%u", pads);
+  if (settings[0])
+    g_string_append_printf (str, "/%s", settings);
+  name = g_string_free (str, FALSE);
+  if (!bench_selected (name)) {
+    g_free (name);
+    return NULL;
+  }
+
+  res = g_new0 (BenchResult, 1);
+  res->name = name;
+  res->mode = mode;
+  res->element = element;
+  res->settings = g_strdup (settings);
+  res->in_info = *in_info;
+  res->out_info = *out_info;
+  res->pads = pads;
+  res->latency = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  g_ptr_array_add (results, res);
+
+  g_printerr ("%s\n", name);
+  return res;
+}
+
+static void
+bench_result_free (BenchResult * res)
+{
+  g_free (res->name);
+  g_free (res->settings);
+  g_array_unref (res->latency);
+  g_free (res);
+}
+
+/* --- Input and output frames --- */
+
+typedef struct
+{
+  GstBuffer *buffers[BENCH_RING];
+  GstVideoFrame frames[BENCH_RING];
+  gboolean mapped;
+} BenchFrames;
+
+/* Every ring entry gets its own pattern, so no two consecutive frames
+ * have the same content. Renderer cases keep the frames mapped; pipeline
+ * cases push the buffers, whose memory must not stay mapped writable. */
+static void
+bench_frames_init (BenchFrames * f, const GstVideoInfo * info,
+    gboolean mapped)
+{
+  f->mapped = mapped;
+
+  for (guint i = 0; i < BENCH_RING; i++) {
+    f->buffers[i] = gst_buffer_new_allocate (NULL, info->size, NULL);
+    gst_video_frame_map (&f->frames[i], (GstVideoInfo *) info,
+        f->buffers[i], GST_MAP_READWRITE);
+
+    for (guint p = 0; p < GST_VIDEO_FRAME_N_PLANES (&f->frames[i]); p++) {
+      guint8 *data = GST_VIDEO_FRAME_PLANE_DATA (&f->frames[i], p);
+      gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (&f->frames[i], p);
+      gint rows = GST_VIDEO_FRAME_COMP_HEIGHT (&f->frames[i], p);
+
+      for (gint y = 0; y < rows; y++)
+        memset (data + y * stride, (y + 61 * i + 17 * p) & 0xff, stride);
+    }
+    if (!mapped)
+      gst_video_frame_unmap (&f->frames[i]);
+  }
+}
+
+static void
+bench_frames_clear (BenchFrames * f)
+{
+  for (guint i = 0; i < BENCH_RING; i++) {
+    if (f->mapped)
+      gst_video_frame_unmap (&f->frames[i]);
+    gst_buffer_unref (f->buffers[i]);
+  }
+}
+
+/* --- Renderer cases --- */
+
+typedef BOOL (^BenchFrameFunc) (guint index);
+
+static void
+bench_run_frames (BenchResult * res, BenchFrameFunc func)
+{
+  GstClockTime start = 0;
+  guint total = opts.warmup + opts.frames;
+
+  for (guint i = 0; i < total; i++) {
+    GstClockTime t0, t1;
+    BOOL ok;
+
+    if (i == (guint) opts.warmup) {
+      bench_stages_start ();
+      start = gst_util_get_timestamp ();
+    }
+
+    t0 = gst_util_get_timestamp ();
+    ok = func (i);
+    t1 = gst_util_get_timestamp ();
+
+    if (i < (guint) opts.warmup)
+      continue;
+    if (!ok)
+      res->failed++;
+
+    gdouble ms = (gdouble) (t1 - t0) / GST_MSECOND;
+    g_array_append_val (res->latency, ms);
+  }
+
+  res->elapsed = gst_util_get_timestamp () - start;
+  res->frames = opts.frames;
+  bench_stages_stop (res);
+}
+
+static const GstVideoFormat all_formats[] = {
+  GST_VIDEO_FORMAT_BGRA, GST_VIDEO_FORMAT_RGBA, GST_VIDEO_FORMAT_NV12,
+  GST_VIDEO_FORMAT_I420, GST_VIDEO_FORMAT_UYVY, GST_VIDEO_FORMAT_YUY2,
+};
+
+/* Formats accepted by every element; UYVY and YUY2 are convertscale and
+ * scaleladder only */
+#define BENCH_N_COMMON_FORMATS 4
+
+static const gint sizes[][2] = {
+  {1280, 720}, {1920, 1080}, {3840, 2160},
+};
+
+static guint
+bench_n_sizes (void)
+{
+  return opts.quick ? 1 : G_N_ELEMENTS (sizes);
+}
+
+/* 1080p first, so --quick keeps only it */
+static const gint *
+bench_size (guint i)
+{
+  static const guint order[] = { 1, 0, 2 };
+
+  return sizes[order[i]];
+}
+
+static void
+bench_renderer_convertscale (GPtrArray * results)
+{
+  static const struct
+  {
+    VfMetalScaleMethod method;
+    const gchar *name;
+  } methods[] = {
+    {VF_METAL_SCALE_BILINEAR, "bilinear"},
+    {VF_METAL_SCALE_BICUBIC, "bicubic"},
+    {VF_METAL_SCALE_LANCZOS, "lanczos"},
+  };
+
+  for (guint f = 0; f < G_N_ELEMENTS (all_formats); f++) {
+    for (guint s = 0; s < bench_n_sizes (); s++) {
+      for (guint m = 0; m < (opts.quick ? 1 : G_N_ELEMENTS (methods)); m++) {
+        /* Scale down one step and convert to BGRA */
+        GstVideoFormat out_formats[] = { all_formats[f],
+          GST_VIDEO_FORMAT_BGRA
+        };
+
+        for (guint o = 0; o < G_N_ELEMENTS (out_formats); o++) {
+          GstVideoInfo in_info, out_info;
+          const gint *size = bench_size (s);
+          BenchResult *res;
+
+          if (o > 0 && out_formats[o] == all_formats[f])
+            continue;
+
+          bench_info (&in_info, all_formats[f], size[0], size[1]);
+          bench_info (&out_info, out_formats[o], size[0] * 2 / 3,
+              size[1] * 2 / 3);
+
+          res = bench_result_new (results, "renderer", "convertscale",
+              methods[m].name, &in_info, &out_info, 0);
+          if (!res)
+            continue;
+
+          MetalConvertScaleRenderer *renderer =
+              [[MetalConvertScaleRenderer alloc] init];
+          if (!renderer || ![renderer configureWithInputInfo:&in_info
+                                                  outputInfo:&out_info
+                                                      method:methods[m].method
+                                                  addBorders:NO
+                                                 borderColor:0xFF000000]) {
+            res->error = TRUE;
+            continue;
+          }
+
+          __block BenchFrames in, out;
+          bench_frames_init (&in, &in_info, TRUE);
+          bench_frames_init (&out, &out_info, TRUE);
+
+          bench_run_frames (res, ^BOOL (guint i) {
+            return [renderer processFrame:&in.frames[i % BENCH_RING]
+                                   output:&out.frames[i % BENCH_RING]];
+          });
+
+          [renderer cleanup];
+          bench_frames_clear (&in);
+          bench_frames_clear (&out);
+        }
+      }
+    }
+  }
+}
+
+static void
+bench_renderer_videofilter (GPtrArray * results)
+{
+  VideoFilterParams identity = {
+    .brightness = 0.0f, .contrast = 1.0f, .saturation = 1.0f,
+    .hue = 0.0f, .gamma = 1.0f,
+  };
+  VideoFilterParams color = identity;
+  VideoFilterParams all = identity;
+
+  color.brightness = 0.1f;
+  color.contrast = 1.2f;
+  color.saturation = 1.3f;
+  color.hue = 0.3f;
+  color.gamma = 1.1f;
+
+  all = color;
+  all.sharpness = 0.5f;
+  all.sepia = 0.3f;
+  all.noise = 0.1f;
+  all.vignette = 0.4f;
+
+  const struct
+  {
+    const VideoFilterParams *params;
+    const gchar *name;
+  } settings[] = {
+    {&identity, "identity"},
+    {&color, "color"},
+    {&all, "all"},
+  };
+
+  for (guint f = 0; f < BENCH_N_COMMON_FORMATS; f++) {
+    for (guint s = 0; s < bench_n_sizes (); s++) {
+      for (guint k = 0; k < G_N_ELEMENTS (settings); k++) {
+        GstVideoInfo info;
+        const gint *size = bench_size (s);
+        BenchResult *res;
+
+        bench_info (&info, all_formats[f], size[0], size[1]);
+        res = bench_result_new (results, "renderer", "videofilter",
+            settings[k].name, &info, &info, 0);
+        if (!res)
+          continue;
+
+        MetalVideoFilterRenderer *renderer =
+            [[MetalVideoFilterRenderer alloc] init];
+        if (!renderer || ![renderer configureWithInputInfo:&info
+                                                outputInfo:&info]) {
+          res->error = TRUE;
+          continue;
+        }
+
+        __block BenchFrames in, out;
+        bench_frames_init (&in, &info, TRUE);
+        bench_frames_init (&out, &info, TRUE);
+
+        __block VideoFilterParams params = *settings[k].params;
+        bench_run_frames (res, ^BOOL (guint i) {
+          params.frameIndex = i;
+          return [renderer processFrame:&in.frames[i % BENCH_RING]
+                                 output:&out.frames[i % BENCH_RING]
+                                 params:&params];
+        });
+
+        [renderer cleanup];
+        bench_frames_clear (&in);
+        bench_frames_clear (&out);
+      }
+    }
+  }
+}
+
+static void
+bench_renderer_transform (GPtrArray * results)
+{
+  static const struct
+  {
+    VfMetalTransformMethod method;
+    const gchar *name;
+  } methods[] = {
+    {VF_METAL_TRANSFORM_HORIZ, "horizontal-flip"},
+    {VF_METAL_TRANSFORM_90R, "clockwise"},
+  };
+
+  for (guint f = 0; f < BENCH_N_COMMON_FORMATS; f++) {
+    for (guint s = 0; s < bench_n_sizes (); s++) {
+      for (guint m = 0; m < G_N_ELEMENTS (methods); m++) {
+        GstVideoInfo in_info, out_info;
+        const gint *size = bench_size (s);
+        gboolean rotated = methods[m].method == VF_METAL_TRANSFORM_90R;
+        BenchResult *res;
+
+        bench_info (&in_info, all_formats[f], size[0], size[1]);
+        bench_info (&out_info, all_formats[f], size[rotated ? 1 : 0],
+            size[rotated ? 0 : 1]);
+        res = bench_result_new (results, "renderer", "transform",
+            methods[m].name, &in_info, &out_info, 0);
+        if (!res)
+          continue;
+
+        MetalTransformRenderer *renderer =
+            [[MetalTransformRenderer alloc] init];
+        if (!renderer || ![renderer configureWithInputInfo:&in_info
+                                                outputInfo:&out_info]) {
+          res->error = TRUE;
+          continue;
+        }
+
+        __block BenchFrames in, out;
+        bench_frames_init (&in, &in_info, TRUE);
+        bench_frames_init (&out, &out_info, TRUE);
+
+        TransformParams params = { .method = methods[m].method };
+        bench_run_frames (res, ^BOOL (guint i) {
+          return [renderer processFrame:&in.frames[i % BENCH_RING]
+                                 output:&out.frames[i % BENCH_RING]
+                                 params:&params];
+        });
+
+        [renderer cleanup];
+        bench_frames_clear (&in);
+        bench_frames_clear (&out);
+      }
+    }
+  }
+}
+
+/* Tile @n pads over a width x height canvas in a near-square grid */
+static void
+bench_grid (guint n, guint index, gint width, gint height, gint * x,
+    gint * y, gint * w, gint * h)
+{
+  guint cols = (guint) ceil (sqrt ((gdouble) n));
+  guint rows = (n + cols - 1) / cols;
+
+  *w = width / cols;
+  *h = height / rows;
+  *x = (index % cols) * *w;
+  *y = (index / cols) * *h;
+}
+
+static const guint pad_counts[] = { 1, 2, 4, 8, 16 };
+
+static void
+bench_renderer_compositor (GPtrArray * results)
+{
+  for (guint f = 0; f < BENCH_N_COMMON_FORMATS; f++) {
+    for (guint c = 0; c < G_N_ELEMENTS (pad_counts); c++) {
+      guint n = pad_counts[c];
+      GstVideoInfo in_info, out_info;
+      BenchResult *res;
+
+      if (opts.quick && all_formats[f] != GST_VIDEO_FORMAT_BGRA &&
+          all_formats[f] != GST_VIDEO_FORMAT_NV12)
+        continue;
+
+      bench_info (&in_info, all_formats[f], 1280, 720);
+      bench_info (&out_info, all_formats[f], 1920, 1080);
+      res = bench_result_new (results, "renderer", "compositor", "",
+          &in_info, &out_info, n);
+      if (!res)
+        continue;
+
+      MetalCompositorRenderer *renderer =
+          [[MetalCompositorRenderer alloc] init];
+      if (!renderer || ![renderer configureWithWidth:1920
+                                              height:1080
+                                              format:all_formats[f]]) {
+        res->error = TRUE;
+        continue;
+      }
+
+      BenchFrames *in = g_new0 (BenchFrames, n);
+      __block BenchFrames out;
+      MetalPadInput *inputs = g_new0 (MetalPadInput, n);
+
+      for (guint p = 0; p < n; p++) {
+        bench_frames_init (&in[p], &in_info, TRUE);
+        bench_grid (n, p, 1920, 1080, &inputs[p].xpos, &inputs[p].ypos,
+            &inputs[p].width, &inputs[p].height);
+        inputs[p].alpha = 1.0;
+        inputs[p].blend_mode = METAL_BLEND_OVER;
+        inputs[p].quality = METAL_QUALITY_LINEAR;
+        inputs[p].key = &in[p];
+      }
+      bench_frames_init (&out, &out_info, TRUE);
+
+      bench_run_frames (res, ^BOOL (guint i) {
+        for (guint p = 0; p < n; p++)
+          inputs[p].frame = &in[p].frames[i % BENCH_RING];
+        return [renderer compositeWithInputs:inputs
+                                       count:n
+                                  background:METAL_BG_BLACK
+                                    outFrame:&out.frames[i % BENCH_RING]];
+      });
+
+      [renderer cleanup];
+      for (guint p = 0; p < n; p++)
+        bench_frames_clear (&in[p]);
+      bench_frames_clear (&out);
+      g_free (in);
+      g_free (inputs);
+    }
+  }
+}
+
+/* --- Pipeline cases --- */
+
+typedef struct
+{
+  guint warmup;
+  guint total;
+  GstClockTime *pushed;         /* push time of each frame */
+  GstClockTime first;           /* arrival of the last warmup frame */
+  GstClockTime last;
+  guint received;
+  BenchResult *res;
+} BenchSink;
+
+static GstFlowReturn
+bench_new_sample (GstAppSink * appsink, gpointer user_data)
+{
+  BenchSink *s = user_data;
+  GstSample *sample = gst_app_sink_pull_sample (appsink);
+  GstClockTime now = gst_util_get_timestamp ();
+  GstBuffer *buffer;
+  guint64 index;
+
+  if (!sample)
+    return GST_FLOW_OK;
+
+  buffer = gst_sample_get_buffer (sample);
+  index = gst_util_uint64_scale_round (GST_BUFFER_PTS (buffer),
+      BENCH_FPS_N, GST_SECOND * BENCH_FPS_D);
+
+  if (s->received >= s->warmup && index < s->total && s->pushed[index]) {
+    gdouble ms = (gdouble) (now - s->pushed[index]) / GST_MSECOND;
+    g_array_append_val (s->res->latency, ms);
+  }
+
+  s->received++;
+  s->last = now;
+  if (s->received == s->warmup) {
+    s->first = now;
+    bench_stages_start ();
+  }
+
+  gst_sample_unref (sample);
+  return GST_FLOW_OK;
+}
+
+/* @element_desc is the launch description between the appsrcs and the
+ * appsink; with @pads it must contain a compositor named "mix" */
+static void
+bench_pipeline_case (GPtrArray * results, const gchar * element,
+    const gchar * settings, const gchar * element_desc,
+    const GstVideoInfo * in_info, const GstVideoInfo * out_info, guint pads)
+{
+  BenchResult *res;
+  GString *desc;
+  GstElement *pipeline;
+  GstElement **srcs;
+  GstElement *sink;
+  GstCaps *in_caps, *out_caps;
+  gchar *out_caps_str;
+  GError *error = NULL;
+  BenchSink s = { 0, };
+  BenchFrames *in;
+  guint n_srcs = MAX (pads, 1);
+
+  res = bench_result_new (results, "pipeline", element, settings, in_info,
+      out_info, pads);
+  if (!res)
+    return;
+
+  out_caps = gst_video_info_to_caps (out_info);
+  out_caps_str = gst_caps_to_string (out_caps);
+  gst_caps_unref (out_caps);
+
+  desc = g_string_new (NULL);
+  if (pads) {
+    g_string_append_printf (desc, "%s ! %s ! appsink name=sink sync=false",
+        element_desc, out_caps_str);
+    for (guint p = 0; p < pads; p++)
+      g_string_append_printf (desc, " appsrc name=src%u ! mix.sink_%u", p, p);
+  } else {
+    g_string_append_printf (desc,
+        "appsrc name=src0 ! %s ! %s ! appsink name=sink sync=false",
+        element_desc, out_caps_str);
+  }
+  g_free (out_caps_str);
+
+  pipeline = gst_parse_launch (desc->str, &error);
+  g_string_free (desc, TRUE);
+  if (!pipeline) {
+    g_printerr ("  %s\n", error ? error->message : "parse failed");
+    g_clear_error (&error);
+    res->error = TRUE;
+    return;
+  }
+  g_clear_error (&error);
+
+  in_caps = gst_video_info_to_caps (in_info);
+
+  srcs = g_new0 (GstElement *, n_srcs);
+  in = g_new0 (BenchFrames, n_srcs);
+  for (guint p = 0; p < n_srcs; p++) {
+    gchar *name = g_strdup_printf ("src%u", p);
+
+    srcs[p] = gst_bin_get_by_name (GST_BIN (pipeline), name);
+    g_object_set (srcs[p], "caps", in_caps, "format", GST_FORMAT_TIME,
+        "block", TRUE, "max-bytes", (guint64) (in_info->size * BENCH_RING),
+        NULL);
+    bench_frames_init (&in[p], in_info, FALSE);
+    g_free (name);
+  }
+  gst_caps_unref (in_caps);
+
+  s.warmup = MAX (opts.warmup, 1);
+  s.total = s.warmup + opts.frames;
+  s.pushed = g_new0 (GstClockTime, s.total);
+  s.res = res;
+
+  GstAppSinkCallbacks callbacks = { NULL, NULL, bench_new_sample, };
+  sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  gst_app_sink_set_callbacks (GST_APP_SINK (sink), &callbacks, &s, NULL);
+
+  if (gst_element_set_state (pipeline, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE) {
+    res->error = TRUE;
+  } else {
+    GstClockTime duration = gst_util_uint64_scale_int (GST_SECOND,
+        BENCH_FPS_D, BENCH_FPS_N);
+    GstBus *bus = gst_element_get_bus (pipeline);
+    GstMessage *msg;
+
+    for (guint i = 0; i < s.total; i++) {
+      for (guint p = 0; p < n_srcs; p++) {
+        /* A new buffer around the ring entry's memory: never the buffer
+         * or the memory of the previous frame */
+        GstBuffer *buffer = gst_buffer_new ();
+
+        gst_buffer_copy_into (buffer, in[p].buffers[i % BENCH_RING],
+            GST_BUFFER_COPY_MEMORY, 0, -1);
+        GST_BUFFER_PTS (buffer) = i * duration;
+        GST_BUFFER_DURATION (buffer) = duration;
+        if (p == n_srcs - 1)
+          s.pushed[i] = gst_util_get_timestamp ();
+        if (gst_app_src_push_buffer (GST_APP_SRC (srcs[p]), buffer) !=
+            GST_FLOW_OK)
+          res->error = TRUE;
+      }
+      if (res->error)
+        break;
+    }
+    for (guint p = 0; p < n_srcs; p++)
+      gst_app_src_end_of_stream (GST_APP_SRC (srcs[p]));
+
+    msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+        GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+    if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+      gst_message_parse_error (msg, &error, NULL);
+      g_printerr ("  %s\n", error->message);
+      g_clear_error (&error);
+      res->error = TRUE;
+    }
+    gst_message_unref (msg);
+    gst_object_unref (bus);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  res->frames = s.received > s.warmup ? s.received - s.warmup : 0;
+  res->failed = opts.frames > (gint) res->frames ?
+      opts.frames - res->frames : 0;
+  res->elapsed = s.first ? s.last - s.first : 0;
+  bench_stages_stop (res);
+
+  for (guint p = 0; p < n_srcs; p++) {
+    gst_object_unref (srcs[p]);
+    bench_frames_clear (&in[p]);
+  }
+  gst_object_unref (sink);
+  gst_object_unref (pipeline);
+  g_free (srcs);
+  g_free (in);
+  g_free (s.pushed);
+}
+
+static void
+bench_pipelines (GPtrArray * results)
+{
+  gchar *overlay, *chain;
+
+  overlay = g_strdup_printf ("vfmetaloverlay location=\"%s\" x=64 y=64 "
+      "alpha=0.8", opts.overlay_image);
+  chain = g_strdup_printf ("vfmetalchain contrast=1.2 saturation=1.3 "
+      "transform=horizontal-flip overlay-location=\"%s\" overlay-x=64 "
+      "overlay-y=64", opts.overlay_image);
+
+  for (guint f = 0; f < G_N_ELEMENTS (all_formats); f++) {
+    GstVideoFormat format = all_formats[f];
+    gboolean common = f < BENCH_N_COMMON_FORMATS;
+
+    for (guint s = 0; s < bench_n_sizes (); s++) {
+      const gint *size = bench_size (s);
+      GstVideoInfo info, scaled, rotated, interlaced;
+
+      bench_info (&info, format, size[0], size[1]);
+      bench_info (&scaled, format, size[0] * 2 / 3, size[1] * 2 / 3);
+      bench_info (&rotated, format, size[1], size[0]);
+      interlaced = info;
+      GST_VIDEO_INFO_INTERLACE_MODE (&interlaced) =
+          GST_VIDEO_INTERLACE_MODE_INTERLEAVED;
+
+      bench_pipeline_case (results, "vfmetalconvertscale", "bilinear",
+          "vfmetalconvertscale", &info, &scaled, 0);
+      bench_pipeline_case (results, "vfmetalscaleladder", "bilinear",
+          "vfmetalscaleladder", &info, &scaled, 0);
+      if (!common)
+        continue;
+
+      bench_pipeline_case (results, "vfmetalvideofilter", "color",
+          "vfmetalvideofilter brightness=0.1 contrast=1.2 saturation=1.3 "
+          "gamma=1.1", &info, &info, 0);
+      bench_pipeline_case (results, "vfmetaltransform", "clockwise",
+          "vfmetaltransform method=clockwise", &info, &rotated, 0);
+      bench_pipeline_case (results, "vfmetaldeinterlace", "linear",
+          "vfmetaldeinterlace method=linear", &interlaced, &info, 0);
+      bench_pipeline_case (results, "vfmetaloverlay", "image",
+          overlay, &info, &info, 0);
+      bench_pipeline_case (results, "vfmetalchain", "all-stages",
+          chain, &info, &info, 0);
+    }
+
+    if (!common)
+      continue;
+
+    for (guint c = 0; c < G_N_ELEMENTS (pad_counts); c++) {
+      guint n = pad_counts[c];
+      GstVideoInfo in_info, out_info;
+      GString *mix = g_string_new ("vfmetalcompositor name=mix "
+          "background=black");
+
+      if (opts.quick && format != GST_VIDEO_FORMAT_BGRA &&
+          format != GST_VIDEO_FORMAT_NV12) {
+        g_string_free (mix, TRUE);
+        continue;
+      }
+
+      for (guint p = 0; p < n; p++) {
+        gint x, y, w, h;
+
+        bench_grid (n, p, 1920, 1080, &x, &y, &w, &h);
+        g_string_append_printf (mix, " sink_%u::xpos=%d sink_%u::ypos=%d "
+            "sink_%u::width=%d sink_%u::height=%d", p, x, p, y, p, w, p, h);
+      }
+
+      bench_info (&in_info, format, 1280, 720);
+      bench_info (&out_info, format, 1920, 1080);
+      bench_pipeline_case (results, "vfmetalcompositor", "", mix->str,
+          &in_info, &out_info, n);
+      g_string_free (mix, TRUE);
+    }
+  }
+
+  g_free (overlay);
+  g_free (chain);
+}
+
+/* A 256x256 semi-transparent PNG for the overlay cases */
+static gchar *
+bench_write_overlay_image (void)
+{
+  gchar *path = g_build_filename (g_get_tmp_dir (), "vfmetal-bench.png",
+      NULL);
+  CGColorSpaceRef space = CGColorSpaceCreateDeviceRGB ();
+  CGContextRef ctx = CGBitmapContextCreate (NULL, 256, 256, 8, 0, space,
+      kCGImageAlphaPremultipliedLast);
+  gboolean ok = FALSE;
+
+  CGContextSetRGBFillColor (ctx, 1.0, 0.5, 0.0, 0.6);
+  CGContextFillRect (ctx, CGRectMake (0, 0, 256, 256));
+  CGContextSetRGBFillColor (ctx, 0.0, 0.3, 1.0, 1.0);
+  CGContextFillEllipseInRect (ctx, CGRectMake (32, 32, 192, 192));
+
+  CGImageRef image = CGBitmapContextCreateImage (ctx);
+  NSURL *url = [NSURL fileURLWithPath:[NSString stringWithUTF8String:path]];
+  CGImageDestinationRef dest = CGImageDestinationCreateWithURL (
+      (__bridge CFURLRef) url, CFSTR ("public.png"), 1, NULL);
+
+  if (dest) {
+    CGImageDestinationAddImage (dest, image, NULL);
+    ok = CGImageDestinationFinalize (dest);
+    CFRelease (dest);
+  }
+  CGImageRelease (image);
+  CGContextRelease (ctx);
+  CGColorSpaceRelease (space);
+
+  if (!ok) {
+    g_free (path);
+    return NULL;
+  }
+  return path;
+}
+
+/* --- JSON output --- */
+
+static void
+bench_json_string (GString * json, const gchar * str)
+{
+  g_string_append_c (json, '"');
+  for (const gchar * c = str; *c; c++) {
+    if (*c == '"' || *c == '\\')
+      g_string_append_c (json, '\\');
+    g_string_append_c (json, *c);
+  }
+  g_string_append_c (json, '"');
+}
+
+static void
+bench_json_video (GString * json, const gchar * key, const GstVideoInfo * info)
+{
+  g_string_append_printf (json, "\"%s\": {\"format\": \"%s\", "
+      "\"width\": %d, \"height\": %d, \"size\": %" G_GSIZE_FORMAT "}",
+      key, gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (info)),
+      GST_VIDEO_INFO_WIDTH (info), GST_VIDEO_INFO_HEIGHT (info), info->size);
+}
+
+static void
+bench_json_result (GString * json, BenchResult * res)
+{
+  static const gchar *stage_keys[VF_METAL_STATS_N_STAGES] = {
+    "upload_ms", "encode_ms", "gpu_ms", "readback_ms"
+  };
+  gdouble seconds = (gdouble) res->elapsed / GST_SECOND;
+  gdouble fps = seconds > 0 ? res->frames / seconds : 0.0;
+  gdouble mean = 0.0;
+  guint64 bytes;
+
+  /* System-memory frames: each input is uploaded, the output read back */
+  bytes = (guint64) res->in_info.size * MAX (res->pads, 1) +
+      res->out_info.size;
+
+  for (guint i = 0; i < res->latency->len; i++)
+    mean += g_array_index (res->latency, gdouble, i);
+  if (res->latency->len)
+    mean /= res->latency->len;
+
+  g_string_append (json, "    {\"name\": ");
+  bench_json_string (json, res->name);
+  g_string_append_printf (json, ", \"mode\": \"%s\", \"element\": \"%s\", "
+      "\"settings\": ", res->mode, res->element);
+  bench_json_string (json, res->settings);
+  g_string_append (json, ",\n      ");
+  bench_json_video (json, "input", &res->in_info);
+  g_string_append (json, ", ");
+  bench_json_video (json, "output", &res->out_info);
+  g_string_append_printf (json, ", \"pads\": %u,\n", MAX (res->pads, 1));
+
+  g_string_append_printf (json, "      \"ok\": %s, \"frames\": %u, "
+      "\"failed\": %u, \"seconds\": %.4f, \"fps\": %.2f,\n",
+      res->error ? "false" : "true", res->frames, res->failed, seconds, fps);
+
+  g_string_append_printf (json, "      \"latency_ms\": {\"mean\": %.3f, "
+      "\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n",
+      mean, bench_percentile (res->latency, 0.50),
+      bench_percentile (res->latency, 0.90),
+      bench_percentile (res->latency, 0.99),
+      bench_percentile (res->latency, 1.0));
+
+  g_string_append (json, "      ");
+  for (guint i = 0; i < VF_METAL_STATS_N_STAGES; i++)
+    g_string_append_printf (json, "\"%s\": %.3f, ", stage_keys[i],
+        res->stage_ms[i]);
+  g_string_append_printf (json, "\"gpu_p99_ms\": %.3f,\n", res->gpu_p99);
+
+  g_string_append_printf (json, "      \"bytes_per_frame\": %" G_GUINT64_FORMAT
+      ", \"bandwidth_mb_s\": %.1f}", bytes, bytes * fps / 1e6);
+}
+
+int
+main (int argc, char *argv[])
+{
+  GOptionEntry entries[] = {
+    {"frames", 'n', 0, G_OPTION_ARG_INT, &opts.frames,
+        "Measured frames per case (default 200)", "N"},
+    {"warmup", 'w', 0, G_OPTION_ARG_INT, &opts.warmup,
+        "Unmeasured frames before each case (default 20)", "N"},
+    {"mode", 'm', 0, G_OPTION_ARG_STRING, &opts.mode,
+        "renderer, pipeline or all (default)", "MODE"},
+    {"filter", 'f', 0, G_OPTION_ARG_STRING, &opts.filter,
+        "Only run cases whose name contains SUBSTRING", "SUBSTRING"},
+    {"quick", 'q', 0, G_OPTION_ARG_NONE, &opts.quick,
+        "1080p only, fewer methods and formats", NULL},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &opts.output,
+        "Write the JSON results to FILE instead of stdout", "FILE"},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *error = NULL;
+  GPtrArray *results;
+  GString *json;
+  gchar *version;
+  const GstPluginDesc *desc;
+  gboolean renderer, pipeline;
+
+  ctx = g_option_context_new ("- benchmark the vfmetal elements");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_clear_error (&error);
+    g_option_context_free (ctx);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  renderer = !opts.mode || g_str_equal (opts.mode, "all") ||
+      g_str_equal (opts.mode, "renderer");
+  pipeline = !opts.mode || g_str_equal (opts.mode, "all") ||
+      g_str_equal (opts.mode, "pipeline");
+  if ((!renderer && !pipeline) || opts.frames <= 0 || opts.warmup < 0) {
+    g_printerr ("Invalid --mode, --frames or --warmup\n");
+    return 1;
+  }
+
+  gst_init (NULL, NULL);
+
+  /* Registered features replace same-named ones of an installed plugin */
+  desc = gst_plugin_vfmetal_get_desc ();
+  if (!gst_plugin_register_static (desc->major_version, desc->minor_version,
+          desc->name, desc->description, desc->plugin_init, desc->version,
+          desc->license, desc->source, desc->package, desc->origin)) {
+    g_printerr ("Could not register the vfmetal plugin\n");
+    return 1;
+  }
+
+  id<MTLDevice> device = [VfMetalDevice sharedDevice].device;
+  if (!device) {
+    g_printerr ("No Metal device\n");
+    return 1;
+  }
+
+  g_mutex_init (&stages.lock);
+  stages.gpu = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  vf_metal_trace_set_hook (bench_trace_hook, &stages);
+
+  opts.overlay_image = bench_write_overlay_image ();
+  if (pipeline && !opts.overlay_image) {
+    g_printerr ("Could not write the overlay image\n");
+    return 1;
+  }
+
+  results = g_ptr_array_new_with_free_func ((GDestroyNotify)
+      bench_result_free);
+
+  @autoreleasepool {
+    if (renderer) {
+      bench_renderer_convertscale (results);
+      bench_renderer_videofilter (results);
+      bench_renderer_transform (results);
+      bench_renderer_compositor (results);
+    }
+    if (pipeline)
+      bench_pipelines (results);
+  }
+
+  vf_metal_trace_set_hook (NULL, NULL);
+
+  version = gst_version_string ();
+  json = g_string_new ("{\n");
+  g_string_append (json, "  \"tool\": \"vfmetal-bench\",\n  \"device\": ");
+  bench_json_string (json, device.name.UTF8String);
+  g_string_append_printf (json, ",\n  \"gstreamer\": \"%s\",\n"
+      "  \"frames\": %d,\n  \"warmup\": %d,\n  \"results\": [\n",
+      version, opts.frames, opts.warmup);
+  for (guint i = 0; i < results->len; i++) {
+    bench_json_result (json, g_ptr_array_index (results, i));
+    g_string_append (json, i + 1 < results->len ? ",\n" : "\n");
+  }
+  g_string_append (json, "  ]\n}\n");
+
+  if (opts.output) {
+    if (!g_file_set_contents (opts.output, json->str, json->len, &error)) {
+      g_printerr ("%s\n", error->message);
+      g_clear_error (&error);
+      return 1;
+    }
+  } else {
+    fputs (json->str, stdout);
+  }
+
+  if (opts.overlay_image)
+    g_unlink (opts.overlay_image);
+
+  g_free (version);
+  g_string_free (json, TRUE);
+  g_ptr_array_unref (results);
+  g_array_unref (stages.gpu);
+  g_mutex_clear (&stages.lock);
+  return 0;
+}
@@ -6,12 +6,14 @@ SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
 # Parse arguments
 BUILD_TYPE="Release"
 RUN_TESTS=0
+BUILD_BENCH=OFF
 PLATFORM="macos"
 GSTREAMER_ROOT_IOS=""
 
 for arg in "$@"; do
     case "$arg" in
         --test|-t) RUN_TESTS=1 ;;
+        --bench) BUILD_BENCH=ON ;;
         --platform=*) PLATFORM="${arg#--platform=}" ;;
         --gst-root=*) GSTREAMER_ROOT_IOS="${arg#--gst-root=}" ;;
         Debug|Release) BUILD_TYPE="$arg" ;;
@@ -159,7 +161,8 @@ else
     # Configure
     cmake -S "${SCRIPT_DIR}" -B "${BUILD_DIR}" \
         -DCMAKE_BUILD_TYPE="${BUILD_TYPE}" \
-        -DCMAKE_OSX_DEPLOYMENT_TARGET=13.0
+        -DCMAKE_OSX_DEPLOYMENT_TARGET=13.0 \
+        -DVF_METAL_BUILD_BENCH="${BUILD_BENCH}"
 
     # Build
     cmake --build "${BUILD_DIR}" --config "${BUILD_TYPE}" -j$(sysctl -n hw.ncpu)
@@ -167,6 +170,9 @@ else
     echo ""
     echo "=== Build complete ==="
     echo "Plugin: ${BUILD_DIR}/gstvfmetal.dylib"
+    if [ "${BUILD_BENCH}" = "ON" ]; then
+        echo "Benchmark: ${BUILD_DIR}/vfmetal-bench --quick"
+    fi
     echo ""
 
     # Determine gst-inspect path
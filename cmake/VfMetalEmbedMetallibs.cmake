@@ -0,0 +1,44 @@
+# Generate a C source embedding precompiled .metallib files as byte arrays,
+# looked up at runtime through vfmetalmetallib.h.
+#
+# Run in script mode:
+#   cmake -DOUTPUT=<file.c> -DNAMES=<a|b> -DLIBRARIES=<a.metallib|b.metallib>
+#         -P VfMetalEmbedMetallibs.cmake
+
+cmake_minimum_required(VERSION 3.20)
+
+if(NOT OUTPUT OR NOT NAMES OR NOT LIBRARIES)
+    message(FATAL_ERROR "VfMetalEmbedMetallibs: OUTPUT, NAMES and LIBRARIES are required")
+endif()
+
+string(REPLACE "|" ";" _names "${NAMES}")
+string(REPLACE "|" ";" _libraries "${LIBRARIES}")
+
+list(LENGTH _names _count)
+list(LENGTH _libraries _lib_count)
+if(NOT _count EQUAL _lib_count)
+    message(FATAL_ERROR "VfMetalEmbedMetallibs: NAMES and LIBRARIES differ in length")
+endif()
+
+set(_code "/* Generated by cmake/VfMetalEmbedMetallibs.cmake, do not edit */\n\n")
+string(APPEND _code "#include \"vfmetalmetallib.h\"\n\n")
+
+set(_table "")
+math(EXPR _last "${_count} - 1")
+foreach(_i RANGE ${_last})
+    list(GET _names ${_i} _name)
+    list(GET _libraries ${_i} _library)
+
+    file(READ "${_library}" _hex HEX)
+    # 16 bytes per line
+    string(REGEX REPLACE "(................................)" "\\1\n" _hex "${_hex}")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," _bytes "${_hex}")
+
+    string(APPEND _code "static const unsigned char vf_metal_metallib_${_name}[] = {\n${_bytes}\n};\n\n")
+    string(APPEND _table "  { \"${_name}\", vf_metal_metallib_${_name},\n    sizeof (vf_metal_metallib_${_name}) },\n")
+endforeach()
+
+string(APPEND _code "const VfMetalEmbeddedMetallib vf_metal_embedded_metallibs[] = {\n")
+string(APPEND _code "${_table}  { NULL, NULL, 0 }\n};\n")
+
+file(WRITE "${OUTPUT}" "${_code}")
@@ -0,0 +1,47 @@
+# Concatenate the @R"(...)" shader sources of INPUTS into one .metal file.
+#
+# Run in script mode:
+#   cmake -DOUTPUT=<file.metal> -DINPUTS=<a.m|b.h|...> -P VfMetalExtractShaders.cmake
+#
+# INPUTS is '|'-separated and must be in the order the renderer concatenates
+# the strings at runtime, so the precompiled library matches the fallback.
+
+cmake_minimum_required(VERSION 3.20)
+
+if(NOT OUTPUT OR NOT INPUTS)
+    message(FATAL_ERROR "VfMetalExtractShaders: OUTPUT and INPUTS are required")
+endif()
+
+string(REPLACE "|" ";" _inputs "${INPUTS}")
+
+set(_source "")
+foreach(_input IN LISTS _inputs)
+    file(READ "${_input}" _content)
+    set(_found FALSE)
+
+    while(TRUE)
+        string(FIND "${_content}" "@R\"(" _start)
+        if(_start EQUAL -1)
+            break()
+        endif()
+        math(EXPR _start "${_start} + 4")
+        string(SUBSTRING "${_content}" ${_start} -1 _content)
+
+        string(FIND "${_content}" ")\";" _end)
+        if(_end EQUAL -1)
+            message(FATAL_ERROR "VfMetalExtractShaders: unterminated raw string in ${_input}")
+        endif()
+        string(SUBSTRING "${_content}" 0 ${_end} _body)
+        string(APPEND _source "${_body}")
+
+        math(EXPR _end "${_end} + 3")
+        string(SUBSTRING "${_content}" ${_end} -1 _content)
+        set(_found TRUE)
+    endwhile()
+
+    if(NOT _found)
+        message(FATAL_ERROR "VfMetalExtractShaders: no shader source in ${_input}")
+    endif()
+endforeach()
+
+file(WRITE "${OUTPUT}" "${_source}")
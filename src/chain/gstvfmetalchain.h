@@ -0,0 +1,108 @@
+/* GStreamer Metal fused processing chain element
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_VF_METAL_CHAIN_H__
+#define __GST_VF_METAL_CHAIN_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/base/gstbasetransform.h>
+
+#include "vfmetalcontext.h"
+#include "vfmetalinflight.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_VF_METAL_CHAIN (gst_vf_metal_chain_get_type())
+G_DECLARE_FINAL_TYPE (GstVfMetalChain, gst_vf_metal_chain,
+    GST, VF_METAL_CHAIN, GstBaseTransform)
+
+/**
+ * GstVfMetalChain:
+ *
+ * Equivalent of vfmetalconvertscale ! vfmetalvideofilter !
+ * vfmetaltransform ! vfmetaloverlay rendered as one fragment pass into one
+ * command buffer, without the per-element queues and intermediates.
+ */
+struct _GstVfMetalChain
+{
+  GstBaseTransform basetransform;
+
+  /* convertscale stage */
+  gint scale_method;        /* 0=bilinear, 1=nearest */
+  gboolean add_borders;
+  guint32 border_color;     /* ARGB */
+
+  /* videofilter stage (same ranges as vfmetalvideofilter) */
+  gdouble brightness;
+  gdouble contrast;
+  gdouble saturation;
+  gdouble hue;
+  gdouble gamma;
+  gdouble sharpness;
+  gdouble sepia;
+  gboolean invert;
+  gdouble noise;
+  gdouble vignette;
+  gchar *lut_file;
+  gboolean lut_loaded;
+
+  /* transform stage */
+  gint transform;           /* VfMetalTransformMethod */
+  gint crop_top;
+  gint crop_bottom;
+  gint crop_left;
+  gint crop_right;
+
+  /* overlay stage */
+  gchar *overlay_location;
+  gboolean overlay_loaded;
+  gint overlay_x;
+  gint overlay_y;
+  gint overlay_width;
+  gint overlay_height;
+  gdouble overlay_alpha;
+
+  /* Negotiated video info */
+  GstVideoInfo in_info;
+  GstVideoInfo out_info;
+  gboolean negotiated;
+  gboolean same_caps;       /* format and size unchanged by negotiation */
+
+  /* Frame counter for noise randomization */
+  guint64 frame_count;
+
+  /* Pipelined submission: in-flight property, latched into inflight */
+  guint in_flight;
+  VfMetalInflight inflight;
+
+  /* GPU selection; the renderer is created on it at NULL_TO_READY */
+  VfMetalDeviceSelection device;
+
+  /* Metal rendering engine (opaque Obj-C object) */
+  void *renderer;
+};
+
+GST_ELEMENT_REGISTER_DECLARE (vfmetalchain);
+
+G_END_DECLS
+
+#endif /* __GST_VF_METAL_CHAIN_H__ */
@@ -0,0 +1,1245 @@
+/* GStreamer Metal fused processing chain element
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-vfmetalchain
+ * @title: vfmetalchain
+ *
+ * Runs the convertscale, videofilter, transform and overlay stages in
+ * that order as a single Metal fragment pass and a single command buffer.
+ * Produces the same picture as
+ * `vfmetalconvertscale ! vfmetalvideofilter ! vfmetaltransform ! vfmetaloverlay`
+ * without the three intermediate full-size frames, the extra command
+ * buffers and the per-element queues.
+ *
+ * Only a non-zero sharpness adds work: the blur then needs the filtered
+ * frame, so it runs as compute passes followed by an overlay pass, still
+ * within the same command buffer.
+ *
+ * When caps are unchanged and every stage is at its identity setting the
+ * element operates in passthrough mode.
+ *
+ * ## Sample pipelines
+ * |[
+ * gst-launch-1.0 videotestsrc ! video/x-raw,format=NV12,width=1920,height=1080 ! \
+ *   vfmetalchain brightness=0.1 transform=horizontal-flip \
+ *   overlay-location=logo.png overlay-x=20 overlay-y=20 ! \
+ *   video/x-raw,format=BGRA,width=1280,height=720 ! autovideosink
+ * ]|
+ */
+
+#import <Foundation/Foundation.h>
+#include "gstvfmetalchain.h"
+#include "metalchainrenderer.h"
+#include "gstvfmetalconvertscale.h"
+#include "gstvfmetaltransform.h"
+#import "vfmetalmemory.h"
+
+#include <math.h>
+
+GST_DEBUG_CATEGORY (gst_vf_metal_chain_debug);
+#define GST_CAT_DEFAULT gst_vf_metal_chain_debug
+
+#define VF_METAL_CHAIN_FORMATS "{ BGRA, RGBA, NV12, I420 }"
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_CHAIN_FORMATS))
+    );
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_CHAIN_FORMATS))
+    );
+
+enum
+{
+  PROP_0,
+  PROP_SCALE_METHOD,
+  PROP_ADD_BORDERS,
+  PROP_BORDER_COLOR,
+  PROP_BRIGHTNESS,
+  PROP_CONTRAST,
+  PROP_SATURATION,
+  PROP_HUE,
+  PROP_GAMMA,
+  PROP_SHARPNESS,
+  PROP_SEPIA,
+  PROP_INVERT,
+  PROP_NOISE,
+  PROP_VIGNETTE,
+  PROP_LUT_FILE,
+  PROP_TRANSFORM,
+  PROP_CROP_TOP,
+  PROP_CROP_BOTTOM,
+  PROP_CROP_LEFT,
+  PROP_CROP_RIGHT,
+  PROP_OVERLAY_LOCATION,
+  PROP_OVERLAY_X,
+  PROP_OVERLAY_Y,
+  PROP_OVERLAY_WIDTH,
+  PROP_OVERLAY_HEIGHT,
+  PROP_OVERLAY_ALPHA,
+  PROP_IN_FLIGHT,
+  PROP_DEVICE,
+};
+
+/* Defaults — identical to the standalone elements */
+#define DEFAULT_SCALE_METHOD    0   /* bilinear */
+#define DEFAULT_ADD_BORDERS     FALSE
+#define DEFAULT_BORDER_COLOR    0xFF000000  /* opaque black */
+#define DEFAULT_BRIGHTNESS      0.0
+#define DEFAULT_CONTRAST        1.0
+#define DEFAULT_SATURATION      1.0
+#define DEFAULT_HUE             0.0
+#define DEFAULT_GAMMA           1.0
+#define DEFAULT_SHARPNESS       0.0
+#define DEFAULT_SEPIA           0.0
+#define DEFAULT_INVERT          FALSE
+#define DEFAULT_NOISE           0.0
+#define DEFAULT_VIGNETTE        0.0
+#define DEFAULT_TRANSFORM       0   /* identity */
+#define DEFAULT_CROP            0
+#define DEFAULT_OVERLAY_POS     0
+#define DEFAULT_OVERLAY_SIZE    0
+#define DEFAULT_OVERLAY_ALPHA   1.0
+
+/* --- GType boilerplate --- */
+
+#define gst_vf_metal_chain_parent_class parent_class
+G_DEFINE_TYPE (GstVfMetalChain, gst_vf_metal_chain, GST_TYPE_BASE_TRANSFORM);
+
+GST_ELEMENT_REGISTER_DEFINE (vfmetalchain, "vfmetalchain",
+    GST_RANK_NONE, GST_TYPE_VF_METAL_CHAIN);
+
+/* --- Passthrough check --- */
+
+#define FLOAT_EQ(a, b) (fabs((a) - (b)) < 1e-6)
+
+static void
+gst_vf_metal_chain_update_passthrough (GstVfMetalChain * self)
+{
+  GST_OBJECT_LOCK (self);
+  gboolean identity =
+      FLOAT_EQ (self->brightness, DEFAULT_BRIGHTNESS) &&
+      FLOAT_EQ (self->contrast, DEFAULT_CONTRAST) &&
+      FLOAT_EQ (self->saturation, DEFAULT_SATURATION) &&
+      FLOAT_EQ (self->hue, DEFAULT_HUE) &&
+      FLOAT_EQ (self->gamma, DEFAULT_GAMMA) &&
+      FLOAT_EQ (self->sharpness, DEFAULT_SHARPNESS) &&
+      FLOAT_EQ (self->sepia, DEFAULT_SEPIA) &&
+      (self->invert == DEFAULT_INVERT) &&
+      FLOAT_EQ (self->noise, DEFAULT_NOISE) &&
+      FLOAT_EQ (self->vignette, DEFAULT_VIGNETTE) &&
+      !self->lut_loaded &&
+      (self->transform == DEFAULT_TRANSFORM) &&
+      (self->crop_top == 0) && (self->crop_bottom == 0) &&
+      (self->crop_left == 0) && (self->crop_right == 0) &&
+      !self->overlay_loaded;
+  gboolean passthrough = identity && self->same_caps;
+  GST_OBJECT_UNLOCK (self);
+
+  gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (self), passthrough);
+
+  GST_DEBUG_OBJECT (self, "passthrough = %s", passthrough ? "TRUE" : "FALSE");
+}
+
+/* --- Caps negotiation (as vfmetalconvertscale) --- */
+
+static GstCaps *
+gst_vf_metal_chain_transform_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * filter)
+{
+  GstCaps *result;
+  GstStructure *s;
+  gint i, n;
+
+  result = gst_caps_new_empty ();
+  n = gst_caps_get_size (caps);
+
+  for (i = 0; i < n; i++) {
+    s = gst_structure_copy (gst_caps_get_structure (caps, i));
+
+    /* The scale stage converts any supported format and size to any other */
+    gst_structure_remove_fields (s, "format", "width", "height",
+        "pixel-aspect-ratio", "colorimetry", "chroma-site", NULL);
+
+    GValue formats = G_VALUE_INIT;
+    GValue val = G_VALUE_INIT;
+    g_value_init (&formats, GST_TYPE_LIST);
+    g_value_init (&val, G_TYPE_STRING);
+
+    const char *fmt_list[] = { "BGRA", "RGBA", "NV12", "I420", NULL };
+    for (int f = 0; fmt_list[f]; f++) {
+      g_value_set_string (&val, fmt_list[f]);
+      gst_value_list_append_value (&formats, &val);
+    }
+    gst_structure_set_value (s, "format", &formats);
+    g_value_unset (&formats);
+    g_value_unset (&val);
+
+    gst_structure_set (s,
+        "width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+        "height", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+        NULL);
+
+    /* GPU memory first, then system memory */
+    gst_caps_append_structure_full (result, gst_structure_copy (s),
+        gst_caps_features_new (GST_CAPS_FEATURE_MEMORY_VF_METAL, NULL));
+    gst_caps_append_structure (result, s);
+  }
+
+  if (filter) {
+    GstCaps *intersection =
+        gst_caps_intersect_full (result, filter, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (result);
+    result = intersection;
+  }
+
+  return result;
+}
+
+static GstCaps *
+gst_vf_metal_chain_fixate_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * othercaps)
+{
+  GstStructure *ins, *outs;
+  const GValue *from_par, *to_par, *format;
+  gint from_w = 0, from_h = 0, from_par_n, from_par_d;
+  gint to_par_n, to_par_d;
+  gint from_dar_n, from_dar_d;
+  gint w = 0, h = 0;
+
+  othercaps = gst_caps_truncate (othercaps);
+  othercaps = gst_caps_make_writable (othercaps);
+
+  GST_DEBUG_OBJECT (trans, "fixating othercaps %" GST_PTR_FORMAT
+      " based on caps %" GST_PTR_FORMAT, othercaps, caps);
+
+  ins = gst_caps_get_structure (caps, 0);
+  outs = gst_caps_get_structure (othercaps, 0);
+
+  /* Keep the format so an unconstrained chain can pass through */
+  format = gst_structure_get_value (ins, "format");
+  if (format && G_VALUE_HOLDS_STRING (format))
+    gst_structure_fixate_field_string (outs, "format",
+        g_value_get_string (format));
+
+  gst_structure_get_int (ins, "width", &from_w);
+  gst_structure_get_int (ins, "height", &from_h);
+
+  from_par = gst_structure_get_value (ins, "pixel-aspect-ratio");
+  to_par = gst_structure_get_value (outs, "pixel-aspect-ratio");
+
+  if (from_par && GST_VALUE_HOLDS_FRACTION (from_par)) {
+    from_par_n = gst_value_get_fraction_numerator (from_par);
+    from_par_d = gst_value_get_fraction_denominator (from_par);
+  } else {
+    from_par_n = from_par_d = 1;
+  }
+
+  if (to_par && GST_VALUE_HOLDS_FRACTION (to_par)) {
+    to_par_n = gst_value_get_fraction_numerator (to_par);
+    to_par_d = gst_value_get_fraction_denominator (to_par);
+  } else {
+    to_par_n = to_par_d = 1;
+  }
+
+  if (!gst_util_fraction_multiply (from_w, from_h, from_par_n, from_par_d,
+          &from_dar_n, &from_dar_d)) {
+    from_dar_n = from_w;
+    from_dar_d = from_h;
+  }
+
+  /* Preserve the input display aspect ratio for any unfixed dimension */
+  {
+    gboolean w_fixed = gst_structure_get_int (outs, "width", &w);
+    gboolean h_fixed = gst_structure_get_int (outs, "height", &h);
+
+    if (!w_fixed && !h_fixed) {
+      gst_structure_fixate_field_nearest_int (outs, "width", from_w);
+      gst_structure_get_int (outs, "width", &w);
+      h = (gint) gst_util_uint64_scale_int (w, from_dar_d * to_par_n,
+          from_dar_n * to_par_d);
+      gst_structure_fixate_field_nearest_int (outs, "height", MAX (h, 1));
+    } else if (w_fixed && !h_fixed) {
+      h = (gint) gst_util_uint64_scale_int (w, from_dar_d * to_par_n,
+          from_dar_n * to_par_d);
+      gst_structure_fixate_field_nearest_int (outs, "height", MAX (h, 1));
+    } else if (!w_fixed && h_fixed) {
+      w = (gint) gst_util_uint64_scale_int (h, from_dar_n * to_par_d,
+          from_dar_d * to_par_n);
+      gst_structure_fixate_field_nearest_int (outs, "width", MAX (w, 1));
+    }
+  }
+
+  return gst_caps_fixate (othercaps);
+}
+
+static gboolean
+gst_vf_metal_chain_set_caps (GstBaseTransform * trans,
+    GstCaps * incaps, GstCaps * outcaps)
+{
+  GstVfMetalChain *self = GST_VF_METAL_CHAIN (trans);
+
+  GST_DEBUG_OBJECT (self, "set_caps: in=%" GST_PTR_FORMAT
+      " out=%" GST_PTR_FORMAT, incaps, outcaps);
+
+  if (!gst_video_info_from_caps (&self->in_info, incaps)) {
+    GST_ERROR_OBJECT (self, "Failed to parse input caps");
+    return FALSE;
+  }
+
+  if (!gst_video_info_from_caps (&self->out_info, outcaps)) {
+    GST_ERROR_OBJECT (self, "Failed to parse output caps");
+    return FALSE;
+  }
+
+  if (!self->renderer)
+    return FALSE;
+
+  /* Configure even when passthrough: a property change may leave it */
+  @autoreleasepool {
+    MetalChainRenderer *renderer =
+        (__bridge MetalChainRenderer *)self->renderer;
+    if (![renderer configureWithInputInfo:&self->in_info
+                               outputInfo:&self->out_info]) {
+      GST_ERROR_OBJECT (self, "Failed to configure Metal renderer");
+      return FALSE;
+    }
+  }
+
+  GST_OBJECT_LOCK (self);
+  self->same_caps =
+      GST_VIDEO_INFO_FORMAT (&self->in_info) ==
+      GST_VIDEO_INFO_FORMAT (&self->out_info) &&
+      GST_VIDEO_INFO_WIDTH (&self->in_info) ==
+      GST_VIDEO_INFO_WIDTH (&self->out_info) &&
+      GST_VIDEO_INFO_HEIGHT (&self->in_info) ==
+      GST_VIDEO_INFO_HEIGHT (&self->out_info);
+  GST_OBJECT_UNLOCK (self);
+
+  self->negotiated = TRUE;
+  gst_vf_metal_chain_update_passthrough (self);
+
+  return TRUE;
+}
+
+static gboolean
+gst_vf_metal_chain_get_unit_size (GstBaseTransform * trans,
+    GstCaps * caps, gsize * size)
+{
+  GstVideoInfo info;
+
+  if (!gst_video_info_from_caps (&info, caps)) {
+    GST_ERROR_OBJECT (trans, "Failed to parse caps for unit size");
+    return FALSE;
+  }
+
+  *size = GST_VIDEO_INFO_SIZE (&info);
+  return TRUE;
+}
+
+/* --- Allocation --- */
+
+static gboolean
+gst_vf_metal_chain_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  GstVfMetalChain *self = GST_VF_METAL_CHAIN (trans);
+
+  return vf_metal_propose_allocation (trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class),
+      ((__bridge MetalChainRenderer *)self->renderer).metalDevice,
+      decide_query, query);
+}
+
+static gboolean
+gst_vf_metal_chain_decide_allocation (GstBaseTransform * trans,
+    GstQuery * query)
+{
+  GstVfMetalChain *self = GST_VF_METAL_CHAIN (trans);
+
+  return vf_metal_decide_allocation (trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class),
+      ((__bridge MetalChainRenderer *)self->renderer).metalDevice,
+      &self->inflight, query);
+}
+
+/* --- transform --- */
+
+/* Build params struct — snapshot properties under lock */
+static void
+gst_vf_metal_chain_snapshot_params (GstVfMetalChain * self,
+    ChainParams * params)
+{
+  memset (params, 0, sizeof (*params));
+
+  GST_OBJECT_LOCK (self);
+  params->scaleMethod = (VfMetalScaleMethod) self->scale_method;
+  params->addBorders = self->add_borders;
+  params->borderColor = self->border_color;
+
+  params->filter.brightness = (float) self->brightness;
+  params->filter.contrast = (float) self->contrast;
+  params->filter.saturation = (float) self->saturation;
+  params->filter.hue = (float) (self->hue * M_PI);  /* map [-1,1] to [-pi,pi] */
+  params->filter.gamma = (float) self->gamma;
+  params->filter.sharpness = (float) self->sharpness;
+  params->filter.sepia = (float) self->sepia;
+  params->filter.noise = (float) self->noise;
+  params->filter.vignette = (float) self->vignette;
+  params->filter.invert = self->invert ? 1 : 0;
+
+  params->transform.method = (VfMetalTransformMethod) self->transform;
+  params->transform.cropTop = self->crop_top;
+  params->transform.cropBottom = self->crop_bottom;
+  params->transform.cropLeft = self->crop_left;
+  params->transform.cropRight = self->crop_right;
+
+  params->overlay.x = (float) self->overlay_x;
+  params->overlay.y = (float) self->overlay_y;
+  params->overlay.width = (float) self->overlay_width;
+  params->overlay.height = (float) self->overlay_height;
+  params->overlay.alpha = (float) self->overlay_alpha;
+  GST_OBJECT_UNLOCK (self);
+
+  params->filter.frameIndex = (uint32_t) (self->frame_count++);
+}
+
+static GstFlowReturn
+gst_vf_metal_chain_transform (GstBaseTransform * trans,
+    GstBuffer * inbuf, GstBuffer * outbuf)
+{
+  GstVfMetalChain *self = GST_VF_METAL_CHAIN (trans);
+  GstVideoFrame inframe, outframe;
+  ChainParams params;
+
+  if (!self->negotiated) {
+    GST_ERROR_OBJECT (self, "Not yet negotiated");
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  if (!self->renderer) {
+    GST_WARNING_OBJECT (self, "No Metal renderer available");
+    return GST_FLOW_ERROR;
+  }
+
+  if (!gst_video_frame_map (&inframe, &self->in_info, inbuf,
+          GST_MAP_READ | GST_MAP_VF_METAL)) {
+    GST_ERROR_OBJECT (self, "Failed to map input buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  if (!gst_video_frame_map (&outframe, &self->out_info, outbuf,
+          GST_MAP_WRITE | GST_MAP_VF_METAL)) {
+    gst_video_frame_unmap (&inframe);
+    GST_ERROR_OBJECT (self, "Failed to map output buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  MetalChainRenderer *renderer = (__bridge MetalChainRenderer *)self->renderer;
+
+  gst_vf_metal_chain_snapshot_params (self, &params);
+
+  @autoreleasepool {
+    if (![renderer processFrame:&inframe output:&outframe params:&params]) {
+      gst_video_frame_unmap (&outframe);
+      gst_video_frame_unmap (&inframe);
+      GST_WARNING_OBJECT (self, "Metal rendering failed");
+      return GST_FLOW_ERROR;
+    }
+  }
+
+  gst_video_frame_unmap (&outframe);
+  gst_video_frame_unmap (&inframe);
+
+  return GST_FLOW_OK;
+}
+
+/* --- Pipelined submission (in-flight > 1) --- */
+
+static gboolean
+gst_vf_metal_chain_submit (GstBaseTransform * trans,
+    VfMetalInflightJob * job, VfMetalCompletionHandler completion)
+{
+  GstVfMetalChain *self = GST_VF_METAL_CHAIN (trans);
+  ChainParams params;
+
+  if (!self->negotiated || !self->renderer)
+    return FALSE;
+
+  MetalChainRenderer *renderer = (__bridge MetalChainRenderer *)self->renderer;
+
+  gst_vf_metal_chain_snapshot_params (self, &params);
+
+  @autoreleasepool {
+    return [renderer submitFrame:&job->in_frame output:&job->out_frame
+                          params:&params slot:job->slot
+                      completion:completion];
+  }
+}
+
+static GstFlowReturn
+gst_vf_metal_chain_generate_output (GstBaseTransform * trans,
+    GstBuffer ** outbuf)
+{
+  GstVfMetalChain *self = GST_VF_METAL_CHAIN (trans);
+
+  return vf_metal_inflight_generate_output (&self->inflight, trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class), &self->in_info,
+      &self->out_info, gst_vf_metal_chain_submit, outbuf);
+}
+
+static gboolean
+gst_vf_metal_chain_sink_event (GstBaseTransform * trans, GstEvent * event)
+{
+  GstVfMetalChain *self = GST_VF_METAL_CHAIN (trans);
+
+  vf_metal_inflight_sink_event (&self->inflight, trans, event);
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event);
+}
+
+static gboolean
+gst_vf_metal_chain_query (GstBaseTransform * trans,
+    GstPadDirection direction, GstQuery * query)
+{
+  GstVfMetalChain *self = GST_VF_METAL_CHAIN (trans);
+
+  if (vf_metal_device_selection_handle_query (GST_ELEMENT (trans),
+          &self->device, query))
+    return TRUE;
+
+  if (!GST_BASE_TRANSFORM_CLASS (parent_class)->query (trans, direction,
+          query))
+    return FALSE;
+
+  if (direction == GST_PAD_SRC && GST_QUERY_TYPE (query) == GST_QUERY_LATENCY
+      && self->negotiated && !gst_base_transform_is_passthrough (trans)) {
+    vf_metal_inflight_add_latency (&self->inflight, query,
+        GST_VIDEO_INFO_FPS_N (&self->out_info),
+        GST_VIDEO_INFO_FPS_D (&self->out_info));
+  }
+
+  return TRUE;
+}
+
+/* --- Image assets (loaded outside the object lock) --- */
+
+static void
+gst_vf_metal_chain_load_lut (GstVfMetalChain * self)
+{
+  GstObject *ref;
+  gchar *path;
+
+  if (!self->renderer)
+    return;
+
+  /* Counted as loaded until the background decode says otherwise, so the
+   * element does not flip to passthrough while the file is decoded */
+  GST_OBJECT_LOCK (self);
+  path = g_strdup (self->lut_file);
+  self->lut_loaded = path && path[0] != '\0';
+  GST_OBJECT_UNLOCK (self);
+
+  ref = gst_object_ref (self);
+
+  @autoreleasepool {
+    MetalChainRenderer *renderer =
+        (__bridge MetalChainRenderer *)self->renderer;
+    [renderer requestLUTFromFile:path completion:^(BOOL loaded) {
+      GstVfMetalChain *chain = GST_VF_METAL_CHAIN (ref);
+
+      if (!loaded) {
+        GST_WARNING_OBJECT (chain, "Failed to load LUT: %s", path);
+        GST_OBJECT_LOCK (chain);
+        chain->lut_loaded = FALSE;
+        GST_OBJECT_UNLOCK (chain);
+        gst_vf_metal_chain_update_passthrough (chain);
+      }
+      g_free (path);
+      gst_object_unref (ref);
+    }];
+  }
+}
+
+static void
+gst_vf_metal_chain_load_overlay (GstVfMetalChain * self)
+{
+  gboolean loaded = FALSE;
+  gchar *path;
+
+  if (!self->renderer)
+    return;
+
+  GST_OBJECT_LOCK (self);
+  path = g_strdup (self->overlay_location);
+  GST_OBJECT_UNLOCK (self);
+
+  @autoreleasepool {
+    MetalChainRenderer *renderer =
+        (__bridge MetalChainRenderer *)self->renderer;
+    if (path && path[0] != '\0') {
+      loaded = [renderer loadOverlayFromFile:path];
+      if (loaded)
+        GST_INFO_OBJECT (self, "Loaded overlay image: %s", path);
+      else
+        GST_WARNING_OBJECT (self, "Failed to load overlay image: %s", path);
+    } else {
+      [renderer clearOverlay];
+    }
+  }
+
+  GST_OBJECT_LOCK (self);
+  self->overlay_loaded = loaded;
+  GST_OBJECT_UNLOCK (self);
+
+  g_free (path);
+}
+
+/* --- Properties --- */
+
+static void
+gst_vf_metal_chain_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstVfMetalChain *self = GST_VF_METAL_CHAIN (object);
+
+  /* Takes the object lock itself */
+  if (prop_id == PROP_DEVICE) {
+    vf_metal_device_selection_set_property (GST_ELEMENT (self),
+        &self->device, value);
+    return;
+  }
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_SCALE_METHOD:
+      self->scale_method = g_value_get_enum (value);
+      break;
+    case PROP_ADD_BORDERS:
+      self->add_borders = g_value_get_boolean (value);
+      break;
+    case PROP_BORDER_COLOR:
+      self->border_color = g_value_get_uint (value);
+      break;
+    case PROP_BRIGHTNESS:
+      self->brightness = g_value_get_double (value);
+      break;
+    case PROP_CONTRAST:
+      self->contrast = g_value_get_double (value);
+      break;
+    case PROP_SATURATION:
+      self->saturation = g_value_get_double (value);
+      break;
+    case PROP_HUE:
+      self->hue = g_value_get_double (value);
+      break;
+    case PROP_GAMMA:
+      self->gamma = g_value_get_double (value);
+      break;
+    case PROP_SHARPNESS:
+      self->sharpness = g_value_get_double (value);
+      break;
+    case PROP_SEPIA:
+      self->sepia = g_value_get_double (value);
+      break;
+    case PROP_INVERT:
+      self->invert = g_value_get_boolean (value);
+      break;
+    case PROP_NOISE:
+      self->noise = g_value_get_double (value);
+      break;
+    case PROP_VIGNETTE:
+      self->vignette = g_value_get_double (value);
+      break;
+    case PROP_LUT_FILE:
+      g_free (self->lut_file);
+      self->lut_file = g_value_dup_string (value);
+      break;
+    case PROP_TRANSFORM:
+      self->transform = g_value_get_enum (value);
+      break;
+    case PROP_CROP_TOP:
+      self->crop_top = g_value_get_int (value);
+      break;
+    case PROP_CROP_BOTTOM:
+      self->crop_bottom = g_value_get_int (value);
+      break;
+    case PROP_CROP_LEFT:
+      self->crop_left = g_value_get_int (value);
+      break;
+    case PROP_CROP_RIGHT:
+      self->crop_right = g_value_get_int (value);
+      break;
+    case PROP_OVERLAY_LOCATION:
+      g_free (self->overlay_location);
+      self->overlay_location = g_value_dup_string (value);
+      break;
+    case PROP_OVERLAY_X:
+      self->overlay_x = g_value_get_int (value);
+      break;
+    case PROP_OVERLAY_Y:
+      self->overlay_y = g_value_get_int (value);
+      break;
+    case PROP_OVERLAY_WIDTH:
+      self->overlay_width = g_value_get_int (value);
+      break;
+    case PROP_OVERLAY_HEIGHT:
+      self->overlay_height = g_value_get_int (value);
+      break;
+    case PROP_OVERLAY_ALPHA:
+      self->overlay_alpha = g_value_get_double (value);
+      break;
+    case PROP_IN_FLIGHT:
+      /* Latched at READY_TO_PAUSED, nothing to reconfigure */
+      self->in_flight = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (self);
+      return;
+    default:
+      GST_OBJECT_UNLOCK (self);
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      return;
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  /* Asset loading outside lock (involves Metal GPU operations) */
+  if (prop_id == PROP_LUT_FILE)
+    gst_vf_metal_chain_load_lut (self);
+  else if (prop_id == PROP_OVERLAY_LOCATION)
+    gst_vf_metal_chain_load_overlay (self);
+
+  gst_vf_metal_chain_update_passthrough (self);
+}
+
+static void
+gst_vf_metal_chain_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstVfMetalChain *self = GST_VF_METAL_CHAIN (object);
+
+  if (prop_id == PROP_DEVICE) {
+    vf_metal_device_selection_get_property (GST_ELEMENT (self),
+        &self->device, value);
+    return;
+  }
+
+  GST_OBJECT_LOCK (self);
+  switch (prop_id) {
+    case PROP_SCALE_METHOD:
+      g_value_set_enum (value, self->scale_method);
+      break;
+    case PROP_ADD_BORDERS:
+      g_value_set_boolean (value, self->add_borders);
+      break;
+    case PROP_BORDER_COLOR:
+      g_value_set_uint (value, self->border_color);
+      break;
+    case PROP_BRIGHTNESS:
+      g_value_set_double (value, self->brightness);
+      break;
+    case PROP_CONTRAST:
+      g_value_set_double (value, self->contrast);
+      break;
+    case PROP_SATURATION:
+      g_value_set_double (value, self->saturation);
+      break;
+    case PROP_HUE:
+      g_value_set_double (value, self->hue);
+      break;
+    case PROP_GAMMA:
+      g_value_set_double (value, self->gamma);
+      break;
+    case PROP_SHARPNESS:
+      g_value_set_double (value, self->sharpness);
+      break;
+    case PROP_SEPIA:
+      g_value_set_double (value, self->sepia);
+      break;
+    case PROP_INVERT:
+      g_value_set_boolean (value, self->invert);
+      break;
+    case PROP_NOISE:
+      g_value_set_double (value, self->noise);
+      break;
+    case PROP_VIGNETTE:
+      g_value_set_double (value, self->vignette);
+      break;
+    case PROP_LUT_FILE:
+      g_value_set_string (value, self->lut_file);
+      break;
+    case PROP_TRANSFORM:
+      g_value_set_enum (value, self->transform);
+      break;
+    case PROP_CROP_TOP:
+      g_value_set_int (value, self->crop_top);
+      break;
+    case PROP_CROP_BOTTOM:
+      g_value_set_int (value, self->crop_bottom);
+      break;
+    case PROP_CROP_LEFT:
+      g_value_set_int (value, self->crop_left);
+      break;
+    case PROP_CROP_RIGHT:
+      g_value_set_int (value, self->crop_right);
+      break;
+    case PROP_OVERLAY_LOCATION:
+      g_value_set_string (value, self->overlay_location);
+      break;
+    case PROP_OVERLAY_X:
+      g_value_set_int (value, self->overlay_x);
+      break;
+    case PROP_OVERLAY_Y:
+      g_value_set_int (value, self->overlay_y);
+      break;
+    case PROP_OVERLAY_WIDTH:
+      g_value_set_int (value, self->overlay_width);
+      break;
+    case PROP_OVERLAY_HEIGHT:
+      g_value_set_int (value, self->overlay_height);
+      break;
+    case PROP_OVERLAY_ALPHA:
+      g_value_set_double (value, self->overlay_alpha);
+      break;
+    case PROP_IN_FLIGHT:
+      g_value_set_uint (value, self->in_flight);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+/* --- Device --- */
+
+static void
+gst_vf_metal_chain_set_context (GstElement * element, GstContext * context)
+{
+  GstVfMetalChain *self = GST_VF_METAL_CHAIN (element);
+
+  vf_metal_device_selection_set_context (element, &self->device, context);
+
+  GST_ELEMENT_CLASS (parent_class)->set_context (element, context);
+}
+
+/* Renderer on the selected GPU, replaced when the selection moved. A new
+ * renderer gets the LUT and overlay image set before it existed. */
+static gboolean
+gst_vf_metal_chain_ensure_renderer (GstVfMetalChain * self)
+{
+  VfMetalDevice *device;
+
+  device = vf_metal_device_selection_ensure (GST_ELEMENT (self),
+      &self->device);
+  if (!device)
+    return FALSE;
+
+  @autoreleasepool {
+    if (self->renderer) {
+      MetalChainRenderer *renderer =
+          (__bridge MetalChainRenderer *)self->renderer;
+      if (renderer.metalDevice == device)
+        return TRUE;
+
+      renderer = (__bridge_transfer MetalChainRenderer *)self->renderer;
+      self->renderer = NULL;
+      [renderer cleanup];
+    }
+
+    MetalChainRenderer *renderer =
+        [[MetalChainRenderer alloc] initWithDevice:device];
+    if (!renderer) {
+      GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+          ("Failed to create Metal renderer on '%s'",
+              device.device.name.UTF8String), (NULL));
+      return FALSE;
+    }
+    renderer.traceOwner = GST_OBJECT (self);
+    self->renderer = (__bridge_retained void *)renderer;
+  }
+
+  gst_vf_metal_chain_load_lut (self);
+  gst_vf_metal_chain_load_overlay (self);
+  gst_vf_metal_chain_update_passthrough (self);
+
+  return TRUE;
+}
+
+/* --- State change --- */
+
+static GstStateChangeReturn
+gst_vf_metal_chain_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstVfMetalChain *self = GST_VF_METAL_CHAIN (element);
+  GstStateChangeReturn ret;
+  guint in_flight;
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY &&
+      !gst_vf_metal_chain_ensure_renderer (self))
+    return GST_STATE_CHANGE_FAILURE;
+
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+    GST_OBJECT_LOCK (self);
+    in_flight = self->in_flight;
+    GST_OBJECT_UNLOCK (self);
+    vf_metal_inflight_start (&self->inflight, in_flight);
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      vf_metal_inflight_stop (&self->inflight);
+      if (self->renderer) {
+        @autoreleasepool {
+          MetalChainRenderer *renderer =
+              (__bridge MetalChainRenderer *)self->renderer;
+          [renderer cleanup];
+        }
+      }
+      self->negotiated = FALSE;
+      self->same_caps = FALSE;
+      self->frame_count = 0;
+      break;
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      vf_metal_device_selection_reset (element, &self->device);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+/* --- Finalize --- */
+
+static void
+gst_vf_metal_chain_finalize (GObject * object)
+{
+  GstVfMetalChain *self = GST_VF_METAL_CHAIN (object);
+
+  if (self->renderer) {
+    @autoreleasepool {
+      MetalChainRenderer *renderer =
+          (__bridge_transfer MetalChainRenderer *)self->renderer;
+      [renderer cleanup];
+      self->renderer = NULL;
+      (void)renderer;
+    }
+  }
+
+  g_free (self->lut_file);
+  self->lut_file = NULL;
+  g_free (self->overlay_location);
+  self->overlay_location = NULL;
+
+  vf_metal_inflight_clear (&self->inflight);
+  vf_metal_device_selection_clear (&self->device);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+/* --- class_init --- */
+
+static void
+gst_vf_metal_chain_class_init (GstVfMetalChainClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *gstelement_class = (GstElementClass *) klass;
+  GstBaseTransformClass *basetransform_class =
+      (GstBaseTransformClass *) klass;
+
+  gobject_class->set_property = gst_vf_metal_chain_set_property;
+  gobject_class->get_property = gst_vf_metal_chain_get_property;
+  gobject_class->finalize = gst_vf_metal_chain_finalize;
+
+  gstelement_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_chain_change_state);
+  gstelement_class->set_context =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_chain_set_context);
+
+  basetransform_class->transform_caps =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_chain_transform_caps);
+  basetransform_class->fixate_caps =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_chain_fixate_caps);
+  basetransform_class->set_caps =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_chain_set_caps);
+  basetransform_class->get_unit_size =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_chain_get_unit_size);
+  basetransform_class->transform =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_chain_transform);
+  basetransform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_chain_propose_allocation);
+  basetransform_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_chain_decide_allocation);
+  basetransform_class->generate_output =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_chain_generate_output);
+  basetransform_class->sink_event =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_chain_sink_event);
+  basetransform_class->query =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_chain_query);
+
+  /* We handle passthrough ourselves */
+  basetransform_class->passthrough_on_same_caps = FALSE;
+
+  /* --- Install properties: convertscale stage --- */
+
+  g_object_class_install_property (gobject_class, PROP_SCALE_METHOD,
+      g_param_spec_enum ("scale-method", "Scale Method",
+          "Scaling interpolation method",
+          GST_TYPE_VF_METAL_SCALE_METHOD, DEFAULT_SCALE_METHOD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADD_BORDERS,
+      g_param_spec_boolean ("add-borders", "Add Borders",
+          "Add letterbox/pillarbox borders to preserve aspect ratio",
+          DEFAULT_ADD_BORDERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BORDER_COLOR,
+      g_param_spec_uint ("border-color", "Border Color",
+          "Border color in ARGB format (default: opaque black 0xFF000000)",
+          0, G_MAXUINT32, DEFAULT_BORDER_COLOR,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /* --- videofilter stage --- */
+
+  g_object_class_install_property (gobject_class, PROP_BRIGHTNESS,
+      g_param_spec_double ("brightness", "Brightness",
+          "Brightness adjustment (-1.0 to 1.0)",
+          -1.0, 1.0, DEFAULT_BRIGHTNESS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_CONTROLLABLE));
+
+  g_object_class_install_property (gobject_class, PROP_CONTRAST,
+      g_param_spec_double ("contrast", "Contrast",
+          "Contrast adjustment (0.0 to 2.0, 1.0 = normal)",
+          0.0, 2.0, DEFAULT_CONTRAST,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_CONTROLLABLE));
+
+  g_object_class_install_property (gobject_class, PROP_SATURATION,
+      g_param_spec_double ("saturation", "Saturation",
+          "Color saturation (0.0 = grayscale, 1.0 = normal, 2.0 = oversaturated)",
+          0.0, 2.0, DEFAULT_SATURATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_CONTROLLABLE));
+
+  g_object_class_install_property (gobject_class, PROP_HUE,
+      g_param_spec_double ("hue", "Hue",
+          "Hue rotation (-1.0 to 1.0, mapped to -180 to +180 degrees)",
+          -1.0, 1.0, DEFAULT_HUE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_CONTROLLABLE));
+
+  g_object_class_install_property (gobject_class, PROP_GAMMA,
+      g_param_spec_double ("gamma", "Gamma",
+          "Gamma correction (0.01 to 10.0, 1.0 = normal)",
+          0.01, 10.0, DEFAULT_GAMMA,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_CONTROLLABLE));
+
+  g_object_class_install_property (gobject_class, PROP_SHARPNESS,
+      g_param_spec_double ("sharpness", "Sharpness",
+          "Sharpness adjustment (-1.0 = maximum blur, 0.0 = none, "
+          "1.0 = maximum sharpen); non-zero values add compute passes",
+          -1.0, 1.0, DEFAULT_SHARPNESS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_CONTROLLABLE));
+
+  g_object_class_install_property (gobject_class, PROP_SEPIA,
+      g_param_spec_double ("sepia", "Sepia",
+          "Sepia tone mix amount (0.0 = none, 1.0 = full sepia)",
+          0.0, 1.0, DEFAULT_SEPIA,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_CONTROLLABLE));
+
+  g_object_class_install_property (gobject_class, PROP_INVERT,
+      g_param_spec_boolean ("invert", "Invert",
+          "Invert all colors (negative image)",
+          DEFAULT_INVERT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_CONTROLLABLE));
+
+  g_object_class_install_property (gobject_class, PROP_NOISE,
+      g_param_spec_double ("noise", "Noise",
+          "Film grain / noise amount (0.0 = none, 1.0 = maximum)",
+          0.0, 1.0, DEFAULT_NOISE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_CONTROLLABLE));
+
+  g_object_class_install_property (gobject_class, PROP_VIGNETTE,
+      g_param_spec_double ("vignette", "Vignette",
+          "Vignette darkness (0.0 = none, 1.0 = maximum darkening at edges)",
+          0.0, 1.0, DEFAULT_VIGNETTE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_CONTROLLABLE));
+
+  g_object_class_install_property (gobject_class, PROP_LUT_FILE,
+      g_param_spec_string ("lut-file", "LUT File",
+          "Path to a .cube or .png 3D LUT file for color grading",
+          NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /* --- transform stage --- */
+
+  g_object_class_install_property (gobject_class, PROP_TRANSFORM,
+      g_param_spec_enum ("transform", "Transform",
+          "Video transform method (flip/rotate), applied after scaling",
+          GST_TYPE_VF_METAL_TRANSFORM_METHOD, DEFAULT_TRANSFORM,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CROP_TOP,
+      g_param_spec_int ("crop-top", "Crop Top",
+          "Pixels of the scaled frame to crop from the top edge",
+          0, G_MAXINT, DEFAULT_CROP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CROP_BOTTOM,
+      g_param_spec_int ("crop-bottom", "Crop Bottom",
+          "Pixels of the scaled frame to crop from the bottom edge",
+          0, G_MAXINT, DEFAULT_CROP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CROP_LEFT,
+      g_param_spec_int ("crop-left", "Crop Left",
+          "Pixels of the scaled frame to crop from the left edge",
+          0, G_MAXINT, DEFAULT_CROP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CROP_RIGHT,
+      g_param_spec_int ("crop-right", "Crop Right",
+          "Pixels of the scaled frame to crop from the right edge",
+          0, G_MAXINT, DEFAULT_CROP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /* --- overlay stage --- */
+
+  g_object_class_install_property (gobject_class, PROP_OVERLAY_LOCATION,
+      g_param_spec_string ("overlay-location", "Overlay Location",
+          "Path to overlay image file (PNG or JPEG)",
+          NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_OVERLAY_X,
+      g_param_spec_int ("overlay-x", "Overlay X Position",
+          "Overlay X position in output pixels",
+          0, G_MAXINT, DEFAULT_OVERLAY_POS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_OVERLAY_Y,
+      g_param_spec_int ("overlay-y", "Overlay Y Position",
+          "Overlay Y position in output pixels",
+          0, G_MAXINT, DEFAULT_OVERLAY_POS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_OVERLAY_WIDTH,
+      g_param_spec_int ("overlay-width", "Overlay Width",
+          "Overlay width in pixels (0 = original image width)",
+          0, G_MAXINT, DEFAULT_OVERLAY_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_OVERLAY_HEIGHT,
+      g_param_spec_int ("overlay-height", "Overlay Height",
+          "Overlay height in pixels (0 = original image height)",
+          0, G_MAXINT, DEFAULT_OVERLAY_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_OVERLAY_ALPHA,
+      g_param_spec_double ("overlay-alpha", "Overlay Alpha",
+          "Overlay opacity (0.0 = transparent, 1.0 = opaque)",
+          0.0, 1.0, DEFAULT_OVERLAY_ALPHA,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_IN_FLIGHT,
+      g_param_spec_uint ("in-flight", "In-flight frames",
+          "Frames queued on the GPU before the oldest is pushed downstream "
+          "(1 = wait for every frame; each extra frame adds one frame of "
+          "latency)",
+          1, VF_METAL_MAX_IN_FLIGHT, VF_METAL_DEFAULT_IN_FLIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_DEVICE,
+      vf_metal_device_selection_param_spec ());
+
+  /* Pad templates */
+  gst_element_class_add_static_pad_template (gstelement_class, &sink_template);
+  gst_element_class_add_static_pad_template (gstelement_class, &src_template);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "Metal Video Processing Chain",
+      "Filter/Converter/Video/Scaler",
+      "Metal-accelerated convert/scale, filter, transform and overlay "
+      "fused into a single GPU pass",
+      "VisioForge <support@visioforge.com>");
+
+  GST_DEBUG_CATEGORY_INIT (gst_vf_metal_chain_debug,
+      "vfmetalchain", 0, "Metal fused processing chain");
+}
+
+/* --- init --- */
+
+static void
+gst_vf_metal_chain_init (GstVfMetalChain * self)
+{
+  self->scale_method = DEFAULT_SCALE_METHOD;
+  self->add_borders = DEFAULT_ADD_BORDERS;
+  self->border_color = DEFAULT_BORDER_COLOR;
+  self->brightness = DEFAULT_BRIGHTNESS;
+  self->contrast = DEFAULT_CONTRAST;
+  self->saturation = DEFAULT_SATURATION;
+  self->hue = DEFAULT_HUE;
+  self->gamma = DEFAULT_GAMMA;
+  self->sharpness = DEFAULT_SHARPNESS;
+  self->sepia = DEFAULT_SEPIA;
+  self->invert = DEFAULT_INVERT;
+  self->noise = DEFAULT_NOISE;
+  self->vignette = DEFAULT_VIGNETTE;
+  self->lut_file = NULL;
+  self->lut_loaded = FALSE;
+  self->transform = DEFAULT_TRANSFORM;
+  self->crop_top = DEFAULT_CROP;
+  self->crop_bottom = DEFAULT_CROP;
+  self->crop_left = DEFAULT_CROP;
+  self->crop_right = DEFAULT_CROP;
+  self->overlay_location = NULL;
+  self->overlay_loaded = FALSE;
+  self->overlay_x = DEFAULT_OVERLAY_POS;
+  self->overlay_y = DEFAULT_OVERLAY_POS;
+  self->overlay_width = DEFAULT_OVERLAY_SIZE;
+  self->overlay_height = DEFAULT_OVERLAY_SIZE;
+  self->overlay_alpha = DEFAULT_OVERLAY_ALPHA;
+  self->negotiated = FALSE;
+  self->same_caps = FALSE;
+  self->frame_count = 0;
+
+  self->in_flight = VF_METAL_DEFAULT_IN_FLIGHT;
+  vf_metal_inflight_init (&self->inflight);
+
+  /* The renderer waits for NULL_TO_READY, when the GPU is known */
+  vf_metal_device_selection_init (&self->device);
+}
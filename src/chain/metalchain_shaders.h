@@ -0,0 +1,229 @@
+/* Metal shaders for the fused vfmetalchain element
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __METAL_CHAIN_SHADERS_H__
+#define __METAL_CHAIN_SHADERS_H__
+
+#import <Foundation/Foundation.h>
+
+/* Chain shader source — concatenated after kVfMetalCommonShaderSource and
+ * kVideoFilterShaderSource, whose FilterUniforms, applyColorAdjustments()
+ * and blur/unsharp kernels it reuses.
+ *
+ * One fragment evaluates convertscale -> videofilter -> transform ->
+ * overlay for an output pixel by walking the stages backwards: the
+ * transform maps the output position into the scaled frame, the letterbox
+ * maps that into the input, and the colour is then pushed forward through
+ * the filter and overlay without touching an intermediate texture. */
+
+static NSString *const kChainShaderSource = @R"(
+
+// --- Chain uniforms ---
+
+struct ChainUniforms {
+    float4 borderColor;     // letterbox colour, RGBA
+    float2x2 uvTransform;   // transform + crop: output uv -> scaled-frame uv
+    float2 uvOffset;
+    float2 contentScale;    // fraction of the scaled frame the picture covers
+    float2 outputSize;      // pixels
+    int colorMatrix;        // input colour word, VF_COLOR_*
+    int nearest;            // 1 = nearest-neighbour input sampling
+    float overlayX;         // overlay rectangle in output pixels
+    float overlayY;
+    float overlayWidth;
+    float overlayHeight;
+    float overlayAlpha;
+    int hasOverlay;
+    float2 padding;
+};
+
+struct ChainVertexOut {
+    float4 position [[position]];
+    float2 texcoord;        // scaled-frame uv (after the transform stage)
+    float2 outcoord;        // output uv
+};
+
+vertex ChainVertexOut chainVertex(uint vid [[vertex_id]],
+                                  constant ChainUniforms &u [[buffer(0)]]) {
+    float2 positions[4] = {
+        float2(-1, -1),
+        float2( 1, -1),
+        float2(-1,  1),
+        float2( 1,  1)
+    };
+
+    ChainVertexOut out;
+    out.position = float4(positions[vid], 0.0, 1.0);
+
+    float2 tc = (positions[vid] + 1.0) * 0.5;
+    tc.y = 1.0 - tc.y;
+    out.outcoord = tc;
+
+    // The transform is affine, so it can be interpolated like a texcoord
+    out.texcoord = u.uvTransform * (tc - 0.5) + 0.5 + u.uvOffset;
+    return out;
+}
+
+// --- Stage helpers ---
+
+static inline bool chainOutside(float2 uv) {
+    return uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0;
+}
+
+// Undo the letterbox: scaled-frame uv -> input uv
+static inline float2 chainInputCoord(float2 scaled,
+                                     constant ChainUniforms &u) {
+    return (scaled - 0.5) / u.contentScale + 0.5;
+}
+
+static inline float4 chainSample(texture2d<float> tex, float2 uv,
+                                 constant ChainUniforms &u) {
+    constexpr sampler linearSampler(filter::linear, address::clamp_to_edge);
+    constexpr sampler nearestSampler(filter::nearest, address::clamp_to_edge);
+    return u.nearest ? tex.sample(nearestSampler, uv)
+                     : tex.sample(linearSampler, uv);
+}
+
+static inline float4 chainApplyLUT(float4 color,
+                                   constant FilterUniforms &f,
+                                   texture3d<float> lutTex) {
+    if (!f.hasLUT)
+        return color;
+    constexpr sampler lutSampler(filter::linear, address::clamp_to_edge);
+    float scale = float(f.lutSize - 1) / float(f.lutSize);
+    float offset = 0.5 / float(f.lutSize);
+    color.rgb = lutTex.sample(lutSampler, color.rgb * scale + offset).rgb;
+    return color;
+}
+
+static inline float4 chainCompositeOverlay(float4 video, float2 outcoord,
+                                           constant ChainUniforms &u,
+                                           texture2d<float> overlayTex) {
+    if (!u.hasOverlay)
+        return video;
+
+    float2 p = outcoord * u.outputSize;
+    if (p.x >= u.overlayX && p.x < u.overlayX + u.overlayWidth &&
+        p.y >= u.overlayY && p.y < u.overlayY + u.overlayHeight) {
+        constexpr sampler s(filter::linear, address::clamp_to_edge);
+        float2 overlayUV = float2((p.x - u.overlayX) / u.overlayWidth,
+                                  (p.y - u.overlayY) / u.overlayHeight);
+        float4 overlay = overlayTex.sample(s, overlayUV);
+        video.rgb = mix(video.rgb, overlay.rgb, overlay.a * u.overlayAlpha);
+    }
+    return video;
+}
+
+// Filter + LUT in scaled-frame space, then the overlay in output space
+static inline float4 chainFinish(float4 color, ChainVertexOut in,
+                                 constant ChainUniforms &u,
+                                 constant FilterUniforms &f,
+                                 texture3d<float> lutTex,
+                                 texture2d<float> overlayTex) {
+    color = applyColorAdjustments(color, f, in.texcoord);
+    color = chainApplyLUT(color, f, lutTex);
+    return chainCompositeOverlay(color, in.outcoord, u, overlayTex);
+}
+
+// --- Fused fragments, one per input layout ---
+
+fragment float4 chainFragmentRGBA(
+    ChainVertexOut in [[stage_in]],
+    constant ChainUniforms &u [[buffer(0)]],
+    constant FilterUniforms &f [[buffer(1)]],
+    texture2d<float> tex [[texture(0)]],
+    texture3d<float> lutTex [[texture(3)]],
+    texture2d<float> overlayTex [[texture(4)]]
+) {
+    // Area the transform stage crops or rotates away stays black
+    if (chainOutside(in.texcoord))
+        return chainCompositeOverlay(float4(0, 0, 0, 1), in.outcoord, u,
+                                     overlayTex);
+
+    float2 src = chainInputCoord(in.texcoord, u);
+    float4 color = chainOutside(src) ? u.borderColor : chainSample(tex, src, u);
+    return chainFinish(color, in, u, f, lutTex, overlayTex);
+}
+
+fragment float4 chainFragmentNV12(
+    ChainVertexOut in [[stage_in]],
+    constant ChainUniforms &u [[buffer(0)]],
+    constant FilterUniforms &f [[buffer(1)]],
+    texture2d<float> yTex [[texture(0)]],
+    texture2d<float> uvTex [[texture(1)]],
+    texture3d<float> lutTex [[texture(3)]],
+    texture2d<float> overlayTex [[texture(4)]]
+) {
+    if (chainOutside(in.texcoord))
+        return chainCompositeOverlay(float4(0, 0, 0, 1), in.outcoord, u,
+                                     overlayTex);
+
+    float2 src = chainInputCoord(in.texcoord, u);
+    float4 color = u.borderColor;
+    if (!chainOutside(src)) {
+        float y = chainSample(yTex, src, u).r;
+        float2 uv = chainSample(uvTex, src, u).rg;
+        color = float4(yuvToRGB(y, uv.r, uv.g, u.colorMatrix), 1.0);
+    }
+    return chainFinish(color, in, u, f, lutTex, overlayTex);
+}
+
+fragment float4 chainFragmentI420(
+    ChainVertexOut in [[stage_in]],
+    constant ChainUniforms &u [[buffer(0)]],
+    constant FilterUniforms &f [[buffer(1)]],
+    texture2d<float> yTex [[texture(0)]],
+    texture2d<float> uTex [[texture(1)]],
+    texture2d<float> vTex [[texture(2)]],
+    texture3d<float> lutTex [[texture(3)]],
+    texture2d<float> overlayTex [[texture(4)]]
+) {
+    if (chainOutside(in.texcoord))
+        return chainCompositeOverlay(float4(0, 0, 0, 1), in.outcoord, u,
+                                     overlayTex);
+
+    float2 src = chainInputCoord(in.texcoord, u);
+    float4 color = u.borderColor;
+    if (!chainOutside(src)) {
+        float y = chainSample(yTex, src, u).r;
+        float cb = chainSample(uTex, src, u).r;
+        float cr = chainSample(vTex, src, u).r;
+        color = float4(yuvToRGB(y, cb, cr, u.colorMatrix), 1.0);
+    }
+    return chainFinish(color, in, u, f, lutTex, overlayTex);
+}
+
+// --- Overlay over an already filtered frame (after the sharpness passes) ---
+
+fragment float4 chainOverlayFragment(
+    ChainVertexOut in [[stage_in]],
+    constant ChainUniforms &u [[buffer(0)]],
+    texture2d<float> srcTex [[texture(0)]],
+    texture2d<float> overlayTex [[texture(4)]]
+) {
+    constexpr sampler s(filter::nearest, address::clamp_to_edge);
+    return chainCompositeOverlay(srcTex.sample(s, in.outcoord), in.outcoord,
+                                 u, overlayTex);
+}
+
+)";
+
+#endif /* __METAL_CHAIN_SHADERS_H__ */
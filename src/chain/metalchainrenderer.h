@@ -0,0 +1,96 @@
+/* Metal fused convertscale/filter/transform/overlay renderer
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __METAL_CHAIN_RENDERER_H__
+#define __METAL_CHAIN_RENDERER_H__
+
+#import <Foundation/Foundation.h>
+#import <Metal/Metal.h>
+#include <gst/video/video.h>
+
+#import "vfmetaldevice.h"
+#import "vfmetalinflight.h"
+#import "metalconvertscalerenderer.h"
+#import "metalvideofilterrenderer.h"
+#import "metaltransformrenderer.h"
+#import "metaloverlayrenderer.h"
+
+/* Per-frame parameters of every stage, in pipeline order. The filter's
+ * chroma key fields are ignored. */
+typedef struct {
+    /* convertscale */
+    VfMetalScaleMethod scaleMethod;
+    BOOL addBorders;
+    guint32 borderColor;        /* ARGB */
+
+    VideoFilterParams filter;
+
+    /* Crop is in pixels of the scaled (output-sized) frame */
+    TransformParams transform;
+
+    /* Position in output pixels; width/height 0 = image size */
+    OverlayParams overlay;
+} ChainParams;
+
+@interface MetalChainRenderer : NSObject
+
+/* Element this renderer's stages are traced for (see vfmetaltrace.h) */
+@property (nonatomic, assign) GstObject *traceOwner;
+
+/* GPU this renderer runs on, fixed at creation */
+@property (nonatomic, readonly) VfMetalDevice *metalDevice;
+
+/* -init uses the default device (+[VfMetalDevice sharedDevice]) */
+- (instancetype)init;
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice;
+
+- (BOOL)configureWithInputInfo:(GstVideoInfo *)inInfo
+                    outputInfo:(GstVideoInfo *)outInfo;
+
+/* Load/clear the filter stage's 3D LUT (.cube or .png); the background
+ * variant is safe while streaming (see VfMetalLUTSlot) */
+- (BOOL)loadLUTFromFile:(const char *)path;
+- (void)requestLUTFromFile:(const char *)path
+                completion:(void (^)(BOOL loaded))completion;
+- (void)clearLUT;
+
+/* Load/clear the overlay stage's image (PNG or JPEG) */
+- (BOOL)loadOverlayFromFile:(const char *)path;
+- (void)clearOverlay;
+
+- (BOOL)processFrame:(GstVideoFrame *)inFrame
+              output:(GstVideoFrame *)outFrame
+              params:(const ChainParams *)params;
+
+/* Pipelined variant: encode into ring @slot, commit without waiting and
+ * call @completion once outFrame has been read back. Returns NO (and
+ * never calls @completion) if nothing was committed. */
+- (BOOL)submitFrame:(GstVideoFrame *)inFrame
+             output:(GstVideoFrame *)outFrame
+             params:(const ChainParams *)params
+               slot:(NSUInteger)slot
+         completion:(VfMetalCompletionHandler)completion;
+
+- (void)cleanup;
+
+@end
+
+#endif /* __METAL_CHAIN_RENDERER_H__ */
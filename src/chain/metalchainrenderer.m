@@ -0,0 +1,651 @@
+/* Metal fused convertscale/filter/transform/overlay renderer
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#import "metalchainrenderer.h"
+#import "metalchain_shaders.h"
+#import "metalvideofilter_shaders.h"
+#import "vfmetaldevice.h"
+#import "vfmetaltextureutil.h"
+#import "vfmetalshaders.h"
+#import "vfmetalyuvoutput.h"
+#import "vfmetaltrace.h"
+
+#include <gst/gst.h>
+
+GST_DEBUG_CATEGORY_EXTERN (gst_vf_metal_chain_debug);
+#define GST_CAT_DEFAULT gst_vf_metal_chain_debug
+
+/* Fixed fragment texture slots, whatever the input layout */
+#define CHAIN_LUT_TEXTURE_INDEX      3
+#define CHAIN_OVERLAY_TEXTURE_INDEX  4
+
+/* Shader uniform — must match ChainUniforms in MSL */
+typedef struct {
+    float borderColor[4];
+    float uvTransform[4];   /* 2x2 matrix (column-major) */
+    float uvOffset[2];
+    float contentScale[2];
+    float outputSize[2];
+    int32_t colorMatrix;
+    int32_t nearest;
+    float overlayX;
+    float overlayY;
+    float overlayWidth;
+    float overlayHeight;
+    float overlayAlpha;
+    int32_t hasOverlay;
+    float padding[2];
+} ChainUniformsGPU;
+
+/* Shader uniform — must match FilterUniforms in kVideoFilterShaderSource */
+typedef struct {
+    float brightness;
+    float contrast;
+    float saturation;
+    float hue;
+    float gamma;
+    float sharpness;
+    float sepia;
+    float noise;
+    float vignette;
+    int32_t invert;
+    int32_t chromaKeyEnabled;
+    float chromaKeyR;
+    float chromaKeyG;
+    float chromaKeyB;
+    float chromaKeyTolerance;
+    float chromaKeySmoothness;
+    uint32_t width;
+    uint32_t height;
+    int32_t colorMatrix;
+    uint32_t frameIndex;
+    int32_t hasLUT;
+    int32_t lutSize;
+    float padding;
+} ChainFilterUniformsGPU;
+
+@implementation MetalChainRenderer {
+    id<MTLCommandQueue> _commandQueue;
+    id<MTLLibrary> _library;
+
+    /* Fused render pipeline states per input format */
+    id<MTLRenderPipelineState> _pipelines[VF_METAL_INPUT_COUNT];
+
+    /* Overlay-only pass, used after the sharpness compute passes */
+    id<MTLRenderPipelineState> _overlayPipeline;
+
+    /* Tiled blur/sharpen compute pipeline */
+    id<MTLComputePipelineState> _computeSharpen;
+
+    /* Output-sized intermediates; _blurTemp is only touched when
+     * sharpness is non-zero */
+    id<MTLTexture> _renderTarget;
+    id<MTLTexture> _blurTemp;
+
+    /* Shared YUV output helper */
+    VfMetalYUVOutput *_yuvOutput;
+
+    /* Filter stage 3D LUT, and its texture as of the frame being encoded */
+    VfMetalLUTSlot *_lut;
+    id<MTLTexture> _lutTexture;
+    int _lutSize;
+
+    /* Overlay stage image */
+    id<MTLTexture> _overlayTexture;
+
+    /* Configuration */
+    int _inWidth;
+    int _inHeight;
+    int _outWidth;
+    int _outHeight;
+    GstVideoFormat _inputFormat;
+    GstVideoFormat _outputFormat;
+    MTLPixelFormat _renderPixelFormat;
+
+    VfMetalTextureCache *_textureCache;
+}
+
+- (void)setTraceOwner:(GstObject *)traceOwner
+{
+    _traceOwner = traceOwner;
+    _textureCache.traceOwner = traceOwner;
+    _yuvOutput.traceOwner = traceOwner;
+}
+
+- (instancetype)init
+{
+    return [self initWithDevice:[VfMetalDevice sharedDevice]];
+}
+
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice
+{
+    self = [super init];
+    if (!self) return nil;
+
+    if (!metalDevice) {
+        GST_ERROR ("MetalChainRenderer: No Metal device available");
+        return nil;
+    }
+    _metalDevice = metalDevice;
+
+    _commandQueue = metalDevice.commandQueue;
+
+    /* Compile shaders: common + filter helpers/kernels + chain fragments */
+    NSString *fullSource = [[kVfMetalCommonShaderSource
+        stringByAppendingString:kVideoFilterShaderSource]
+        stringByAppendingString:kChainShaderSource];
+
+    NSError *error = nil;
+    _library = [metalDevice libraryNamed:@"chain"
+                                  source:fullSource
+                                   error:&error];
+    if (!_library) {
+        GST_ERROR ("MetalChainRenderer: Failed to compile shaders: %s",
+              error.localizedDescription.UTF8String);
+        return nil;
+    }
+
+    MTLFunctionConstantValues *sharpenConstants =
+        [[MTLFunctionConstantValues alloc] init];
+    int sharpenRadius = VF_METAL_SHARPEN_RADIUS;
+    [sharpenConstants setConstantValue:&sharpenRadius type:MTLDataTypeInt
+                               atIndex:0];
+    _computeSharpen = [metalDevice computePipelineWithFunctionName:@"sharpenTiled"
+        library:_library constants:sharpenConstants
+        variant:[NSString stringWithFormat:@"r%d", sharpenRadius] error:&error];
+
+    if (!_computeSharpen) {
+        GST_ERROR ("MetalChainRenderer: Failed to create blur pipeline: %s",
+              error.localizedDescription.UTF8String);
+        return nil;
+    }
+
+    _textureCache = [[VfMetalTextureCache alloc]
+        initWithDevice:metalDevice.device];
+    _yuvOutput = [[VfMetalYUVOutput alloc] init];
+    _lut = [[VfMetalLUTSlot alloc] initWithDevice:_metalDevice];
+    _lutSize = 0;
+
+    return self;
+}
+
+- (id<MTLRenderPipelineState>)_pipelineWithFragment:(NSString *)fragName
+{
+    VfMetalDevice *metalDevice = _metalDevice;
+
+    MTLRenderPipelineDescriptor *desc =
+        [[MTLRenderPipelineDescriptor alloc] init];
+    desc.vertexFunction = [_library newFunctionWithName:@"chainVertex"];
+    desc.fragmentFunction = [_library newFunctionWithName:fragName];
+    desc.colorAttachments[0].pixelFormat = _renderPixelFormat;
+    desc.colorAttachments[0].blendingEnabled = NO;
+
+    NSError *error = nil;
+    id<MTLRenderPipelineState> pipeline =
+        [metalDevice renderPipelineWithDescriptor:desc library:_library
+                                            error:&error];
+    if (!pipeline) {
+        GST_ERROR ("Failed to create chain pipeline %s: %s",
+                   fragName.UTF8String, error.localizedDescription.UTF8String);
+    }
+    return pipeline;
+}
+
+- (BOOL)configureWithInputInfo:(GstVideoInfo *)inInfo
+                    outputInfo:(GstVideoInfo *)outInfo
+{
+    int inW = GST_VIDEO_INFO_WIDTH (inInfo);
+    int inH = GST_VIDEO_INFO_HEIGHT (inInfo);
+    int outW = GST_VIDEO_INFO_WIDTH (outInfo);
+    int outH = GST_VIDEO_INFO_HEIGHT (outInfo);
+    GstVideoFormat inFmt = GST_VIDEO_INFO_FORMAT (inInfo);
+    GstVideoFormat outFmt = GST_VIDEO_INFO_FORMAT (outInfo);
+
+    if (_renderTarget && _inWidth == inW && _inHeight == inH &&
+        _outWidth == outW && _outHeight == outH &&
+        _inputFormat == inFmt && _outputFormat == outFmt) {
+        return YES;
+    }
+
+    id<MTLDevice> device = _metalDevice.device;
+
+    _inWidth = inW;
+    _inHeight = inH;
+    _outWidth = outW;
+    _outHeight = outH;
+    _inputFormat = inFmt;
+    _outputFormat = outFmt;
+
+    switch (outFmt) {
+        case GST_VIDEO_FORMAT_RGBA:
+            _renderPixelFormat = MTLPixelFormatRGBA8Unorm;
+            break;
+        default:
+            _renderPixelFormat = MTLPixelFormatBGRA8Unorm;
+            break;
+    }
+
+    NSString *fragNames[VF_METAL_INPUT_COUNT] = {
+        @"chainFragmentRGBA",
+        @"chainFragmentNV12",
+        @"chainFragmentI420"
+    };
+
+    for (int fmt = 0; fmt < VF_METAL_INPUT_COUNT; fmt++) {
+        _pipelines[fmt] = [self _pipelineWithFragment:fragNames[fmt]];
+        if (!_pipelines[fmt]) return NO;
+    }
+    _overlayPipeline = [self _pipelineWithFragment:@"chainOverlayFragment"];
+    if (!_overlayPipeline) return NO;
+
+    /* Everything after the input sampling happens at output size */
+    MTLTextureDescriptor *rtDesc = [MTLTextureDescriptor
+        texture2DDescriptorWithPixelFormat:_renderPixelFormat
+                                     width:outW
+                                    height:outH
+                                 mipmapped:NO];
+    rtDesc.usage = MTLTextureUsageRenderTarget | MTLTextureUsageShaderRead |
+                   MTLTextureUsageShaderWrite;
+    rtDesc.storageMode = _metalDevice.hostStorageMode;
+
+    _renderTarget = [device newTextureWithDescriptor:rtDesc];
+    if (!_renderTarget) return NO;
+
+    /* Sharpness is rare: allocate its texture on first use */
+    _blurTemp = nil;
+
+    if (![_yuvOutput configureWithDevice:_metalDevice library:_library
+                                   width:outW height:outH format:outFmt])
+        return NO;
+
+    return YES;
+}
+
+- (BOOL)_ensureBlurTexture
+{
+    if (_blurTemp) return YES;
+
+    MTLTextureDescriptor *blurDesc = [MTLTextureDescriptor
+        texture2DDescriptorWithPixelFormat:_renderPixelFormat
+                                     width:_outWidth
+                                    height:_outHeight
+                                 mipmapped:NO];
+    blurDesc.usage = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite;
+    blurDesc.storageMode = _metalDevice.hostStorageMode;
+
+    id<MTLDevice> device = _metalDevice.device;
+    _blurTemp = [device newTextureWithDescriptor:blurDesc];
+    return _blurTemp != nil;
+}
+
+- (BOOL)loadLUTFromFile:(const char *)path
+{
+    return [_lut loadFile:path];
+}
+
+- (void)requestLUTFromFile:(const char *)path
+                completion:(void (^)(BOOL loaded))completion
+{
+    [_lut requestFile:path completion:completion];
+}
+
+- (void)clearLUT
+{
+    [_lut loadFile:NULL];
+}
+
+- (BOOL)loadOverlayFromFile:(const char *)path
+{
+    if (!path || *path == '\0') {
+        [self clearOverlay];
+        return YES;
+    }
+
+    id<MTLTexture> tex = vf_metal_load_overlay_image (path,
+        _metalDevice.device);
+    if (!tex) return NO;
+
+    _overlayTexture = tex;
+    return YES;
+}
+
+- (void)clearOverlay
+{
+    _overlayTexture = nil;
+}
+
+- (void)_fillUniforms:(ChainUniformsGPU *)u
+        filterUniforms:(ChainFilterUniformsGPU *)f
+                params:(const ChainParams *)params
+               inFrame:(GstVideoFrame *)inFrame
+{
+    memset (u, 0, sizeof (*u));
+    memset (f, 0, sizeof (*f));
+
+    /* convertscale: picture fraction of the scaled frame, as the
+     * letterbox viewport in MetalConvertScaleRenderer */
+    u->contentScale[0] = 1.0f;
+    u->contentScale[1] = 1.0f;
+    if (params->addBorders && _inWidth > 0 && _inHeight > 0) {
+        float srcAspect = (float)_inWidth / (float)_inHeight;
+        float dstAspect = (float)_outWidth / (float)_outHeight;
+        if (srcAspect > dstAspect)
+            u->contentScale[1] = dstAspect / srcAspect;
+        else
+            u->contentScale[0] = srcAspect / dstAspect;
+
+        u->borderColor[0] = ((params->borderColor >> 16) & 0xFF) / 255.0f;
+        u->borderColor[1] = ((params->borderColor >> 8) & 0xFF) / 255.0f;
+        u->borderColor[2] = (params->borderColor & 0xFF) / 255.0f;
+        u->borderColor[3] = ((params->borderColor >> 24) & 0xFF) / 255.0f;
+    }
+    /* Bicubic/Lanczos need separable passes; the fused pass samples them
+     * bilinearly */
+    u->nearest = (params->scaleMethod == VF_METAL_SCALE_NEAREST) ? 1 : 0;
+    u->colorMatrix = vf_metal_color_matrix_for_frame (inFrame);
+
+    /* transform works on the scaled frame, which has the output size */
+    vf_metal_transform_build_uv (&params->transform, _outWidth, _outHeight,
+                                 u->uvTransform, u->uvOffset);
+
+    u->outputSize[0] = (float)_outWidth;
+    u->outputSize[1] = (float)_outHeight;
+
+    if (_overlayTexture) {
+        u->overlayX = params->overlay.x;
+        u->overlayY = params->overlay.y;
+        u->overlayWidth = (params->overlay.width > 0)
+            ? params->overlay.width : (float)_overlayTexture.width;
+        u->overlayHeight = (params->overlay.height > 0)
+            ? params->overlay.height : (float)_overlayTexture.height;
+        u->overlayAlpha = params->overlay.alpha;
+        u->hasOverlay = 1;
+    }
+
+    const VideoFilterParams *fp = &params->filter;
+    f->brightness = fp->brightness;
+    f->contrast = fp->contrast;
+    f->saturation = fp->saturation;
+    f->hue = fp->hue;
+    f->gamma = fp->gamma;
+    f->sharpness = fp->sharpness;
+    f->sepia = fp->sepia;
+    f->noise = fp->noise;
+    f->vignette = fp->vignette;
+    f->invert = fp->invert;
+    f->chromaKeyEnabled = 0;
+    f->width = (uint32_t)_outWidth;
+    f->height = (uint32_t)_outHeight;
+    f->colorMatrix = u->colorMatrix;
+    f->frameIndex = fp->frameIndex;
+    f->hasLUT = (_lutTexture != nil) ? 1 : 0;
+    f->lutSize = _lutSize;
+}
+
+- (BOOL)processFrame:(GstVideoFrame *)inFrame
+              output:(GstVideoFrame *)outFrame
+              params:(const ChainParams *)params
+{
+    return [self _renderFrame:inFrame output:outFrame params:params
+                         slot:0 completion:nil];
+}
+
+- (BOOL)submitFrame:(GstVideoFrame *)inFrame
+             output:(GstVideoFrame *)outFrame
+             params:(const ChainParams *)params
+               slot:(NSUInteger)slot
+         completion:(VfMetalCompletionHandler)completion
+{
+    return [self _renderFrame:inFrame output:outFrame params:params
+                         slot:slot completion:completion];
+}
+
+- (BOOL)_renderFrame:(GstVideoFrame *)inFrame
+              output:(GstVideoFrame *)outFrame
+              params:(const ChainParams *)params
+                slot:(NSUInteger)slot
+          completion:(VfMetalCompletionHandler)completion
+{
+    @autoreleasepool {
+        [_textureCache resetFrameIndexForSlot:slot];
+
+        [_lut acquire];
+        _lutTexture = _lut.texture;
+        _lutSize = _lut.size;
+
+        id<MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
+        if (!commandBuffer) {
+            GST_ERROR ("Failed to create Metal command buffer");
+            return NO;
+        }
+
+        VfMetalTraceSpan encodeSpan;
+        vf_metal_trace_begin (&encodeSpan, _traceOwner, VF_METAL_STATS_ENCODE);
+
+        GstVideoFormat inFmt = GST_VIDEO_FRAME_FORMAT (inFrame);
+        VfMetalInputFormat fmtIdx = vf_metal_input_format_index (inFmt);
+        int frameW = GST_VIDEO_FRAME_WIDTH (inFrame);
+        int frameH = GST_VIDEO_FRAME_HEIGHT (inFrame);
+
+        ChainUniformsGPU uniforms;
+        ChainFilterUniformsGPU filterUniforms;
+        [self _fillUniforms:&uniforms filterUniforms:&filterUniforms
+                     params:params inFrame:inFrame];
+
+        /* Sharpness needs neighbouring pixels of the filtered frame, so
+         * the overlay then moves behind the blur pass */
+        BOOL needsSharpness = (params->filter.sharpness < -0.001f ||
+                               params->filter.sharpness > 0.001f);
+        if (needsSharpness && ![self _ensureBlurTexture])
+            return NO;
+
+        ChainUniformsGPU fusedUniforms = uniforms;
+        if (needsSharpness)
+            fusedUniforms.hasOverlay = 0;
+
+        /* === Pass 1: scale + filter + transform (+ overlay) === */
+
+        MTLRenderPassDescriptor *rpDesc =
+            [MTLRenderPassDescriptor renderPassDescriptor];
+        rpDesc.colorAttachments[0].texture = _renderTarget;
+        rpDesc.colorAttachments[0].loadAction = MTLLoadActionDontCare;
+        rpDesc.colorAttachments[0].storeAction = MTLStoreActionStore;
+
+        id<MTLRenderCommandEncoder> encoder =
+            [commandBuffer renderCommandEncoderWithDescriptor:rpDesc];
+        if (!encoder) return NO;
+
+        MTLViewport viewport = {
+            0, 0, (double)_outWidth, (double)_outHeight, 0.0, 1.0
+        };
+        [encoder setViewport:viewport];
+        [encoder setRenderPipelineState:_pipelines[fmtIdx]];
+
+        [encoder setVertexBytes:&fusedUniforms length:sizeof(fusedUniforms)
+                        atIndex:0];
+        [encoder setFragmentBytes:&fusedUniforms length:sizeof(fusedUniforms)
+                          atIndex:0];
+        [encoder setFragmentBytes:&filterUniforms length:sizeof(filterUniforms)
+                          atIndex:1];
+
+        /* Upload input textures */
+        if (fmtIdx == VF_METAL_INPUT_NV12) {
+            id<MTLTexture> yTex =
+                [_textureCache uploadPlane:inFrame plane:0
+                          format:MTLPixelFormatR8Unorm
+                           width:frameW height:frameH];
+            id<MTLTexture> uvTex =
+                [_textureCache uploadPlane:inFrame plane:1
+                          format:MTLPixelFormatRG8Unorm
+                           width:(frameW + 1) / 2 height:(frameH + 1) / 2];
+            if (!yTex || !uvTex) { [encoder endEncoding]; return NO; }
+            [encoder setFragmentTexture:yTex atIndex:0];
+            [encoder setFragmentTexture:uvTex atIndex:1];
+        } else if (fmtIdx == VF_METAL_INPUT_I420) {
+            id<MTLTexture> yTex =
+                [_textureCache uploadPlane:inFrame plane:0
+                          format:MTLPixelFormatR8Unorm
+                           width:frameW height:frameH];
+            id<MTLTexture> uTex =
+                [_textureCache uploadPlane:inFrame plane:1
+                          format:MTLPixelFormatR8Unorm
+                           width:(frameW + 1) / 2 height:(frameH + 1) / 2];
+            id<MTLTexture> vTex =
+                [_textureCache uploadPlane:inFrame plane:2
+                          format:MTLPixelFormatR8Unorm
+                           width:(frameW + 1) / 2 height:(frameH + 1) / 2];
+            if (!yTex || !uTex || !vTex) { [encoder endEncoding]; return NO; }
+            [encoder setFragmentTexture:yTex atIndex:0];
+            [encoder setFragmentTexture:uTex atIndex:1];
+            [encoder setFragmentTexture:vTex atIndex:2];
+        } else {
+            MTLPixelFormat pixFmt = (inFmt == GST_VIDEO_FORMAT_BGRA)
+                ? MTLPixelFormatBGRA8Unorm : MTLPixelFormatRGBA8Unorm;
+            id<MTLTexture> tex =
+                [_textureCache uploadPlane:inFrame plane:0
+                          format:pixFmt width:frameW height:frameH];
+            if (!tex) { [encoder endEncoding]; return NO; }
+            [encoder setFragmentTexture:tex atIndex:0];
+        }
+
+        if (_lutTexture) {
+            [encoder setFragmentTexture:_lutTexture
+                                atIndex:CHAIN_LUT_TEXTURE_INDEX];
+        }
+        if (_overlayTexture) {
+            [encoder setFragmentTexture:_overlayTexture
+                                atIndex:CHAIN_OVERLAY_TEXTURE_INDEX];
+        }
+
+        [encoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                    vertexStart:0
+                    vertexCount:4];
+        [encoder endEncoding];
+
+        id<MTLTexture> finalTexture = _renderTarget;
+
+        /* === Pass 2: sharpness / blur (only if sharpness != 0) === */
+
+        if (needsSharpness) {
+            MTLSize threadGroupSize = MTLSizeMake(VF_METAL_SHARPEN_TILE,
+                                                  VF_METAL_SHARPEN_TILE, 1);
+            MTLSize gridSize = MTLSizeMake(
+                (_outWidth + VF_METAL_SHARPEN_TILE - 1) / VF_METAL_SHARPEN_TILE,
+                (_outHeight + VF_METAL_SHARPEN_TILE - 1) / VF_METAL_SHARPEN_TILE, 1);
+
+            /* renderTarget -> blurTemp, blurred per tile in threadgroup memory */
+            id<MTLComputeCommandEncoder> compute =
+                [commandBuffer computeCommandEncoder];
+            float amount = params->filter.sharpness;
+            [compute setComputePipelineState:_computeSharpen];
+            [compute setTexture:_renderTarget atIndex:0];
+            [compute setTexture:_blurTemp atIndex:1];
+            [compute setBytes:&amount length:sizeof(float) atIndex:0];
+            [compute dispatchThreadgroups:gridSize
+                    threadsPerThreadgroup:threadGroupSize];
+            [compute endEncoding];
+
+            finalTexture = _blurTemp;
+
+            /* === Pass 3: overlay on the sharpened frame === */
+
+            if (uniforms.hasOverlay) {
+                MTLRenderPassDescriptor *overlayDesc =
+                    [MTLRenderPassDescriptor renderPassDescriptor];
+                overlayDesc.colorAttachments[0].texture = _renderTarget;
+                overlayDesc.colorAttachments[0].loadAction =
+                    MTLLoadActionDontCare;
+                overlayDesc.colorAttachments[0].storeAction =
+                    MTLStoreActionStore;
+
+                id<MTLRenderCommandEncoder> overlayEncoder =
+                    [commandBuffer renderCommandEncoderWithDescriptor:overlayDesc];
+                if (!overlayEncoder) return NO;
+
+                [overlayEncoder setViewport:viewport];
+                [overlayEncoder setRenderPipelineState:_overlayPipeline];
+                [overlayEncoder setVertexBytes:&uniforms length:sizeof(uniforms)
+                                       atIndex:0];
+                [overlayEncoder setFragmentBytes:&uniforms
+                                          length:sizeof(uniforms)
+                                         atIndex:0];
+                [overlayEncoder setFragmentTexture:_blurTemp atIndex:0];
+                [overlayEncoder setFragmentTexture:_overlayTexture
+                                           atIndex:CHAIN_OVERLAY_TEXTURE_INDEX];
+                [overlayEncoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                                   vertexStart:0
+                                   vertexCount:4];
+                [overlayEncoder endEncoding];
+
+                finalTexture = _renderTarget;
+            }
+        }
+
+        /* === Output format conversion === */
+
+        [_yuvOutput dispatchConversion:commandBuffer
+                         sourceTexture:finalTexture
+                                 width:_outWidth height:_outHeight
+                              outFrame:outFrame slot:slot];
+
+        if (completion) {
+            vf_metal_trace_end (&encodeSpan);
+            vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
+            [_yuvOutput commitPipelined:commandBuffer
+                          sourceTexture:finalTexture
+                                  width:_outWidth height:_outHeight
+                               outFrame:outFrame slot:slot
+                             completion:completion];
+            return YES;
+        }
+
+        vf_metal_trace_end (&encodeSpan);
+        vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
+        [commandBuffer commit];
+        [commandBuffer waitUntilCompleted];
+
+        if (commandBuffer.status == MTLCommandBufferStatusError) {
+            GST_ERROR ("Metal command buffer failed: %s",
+                       commandBuffer.error.localizedDescription.UTF8String);
+            return NO;
+        }
+
+        [_yuvOutput readbackToFrame:outFrame sourceTexture:finalTexture
+                              width:_outWidth height:_outHeight];
+
+        return YES;
+    }
+}
+
+- (void)cleanup
+{
+    [_textureCache clear];
+    _renderTarget = nil;
+    _blurTemp = nil;
+    [_yuvOutput cleanup];
+    [_lut rewind];
+    _lutTexture = nil;
+    for (int f = 0; f < VF_METAL_INPUT_COUNT; f++)
+        _pipelines[f] = nil;
+    _overlayPipeline = nil;
+}
+
+@end
@@ -0,0 +1,86 @@
+/* Per-element Metal device selection and GstContext sharing
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __VF_METAL_CONTEXT_H__
+#define __VF_METAL_CONTEXT_H__
+
+#import <Foundation/Foundation.h>
+
+#include <gst/gst.h>
+
+#import "vfmetaldevice.h"
+
+G_BEGIN_DECLS
+
+/* GstContext type carrying the GPU chosen by an element. Its structure
+ * holds "registry-id" (guint64) and "name" (string, informational). */
+#define VF_METAL_DEVICE_CONTEXT_TYPE "gst.vfmetal.device"
+
+/**
+ * VfMetalDeviceSelection:
+ *
+ * Which GPU an element runs on, embedded in each element. An explicit
+ * "device" property wins; otherwise the element follows a neighbour's
+ * GstContext, and falls back to the default device. Fields are guarded
+ * by the element's object lock.
+ */
+typedef struct
+{
+  gchar *spec;                  /* "device" property, NULL = automatic */
+  guint64 context_id;           /* registry ID from a GstContext, or 0 */
+  guint64 registry_id;          /* GPU in use, 0 until ensured */
+} VfMetalDeviceSelection;
+
+void vf_metal_device_selection_init (VfMetalDeviceSelection * sel);
+void vf_metal_device_selection_clear (VfMetalDeviceSelection * sel);
+
+/* The "device" property every element installs */
+GParamSpec *vf_metal_device_selection_param_spec (void);
+
+void vf_metal_device_selection_set_property (GstElement * element,
+    VfMetalDeviceSelection * sel, const GValue * value);
+void vf_metal_device_selection_get_property (GstElement * element,
+    VfMetalDeviceSelection * sel, GValue * value);
+
+/* GstElementClass::set_context: remember a neighbour's device. The
+ * caller still chains up to its parent class. */
+void vf_metal_device_selection_set_context (GstElement * element,
+    VfMetalDeviceSelection * sel, GstContext * context);
+
+/* Answer a CONTEXT query for our type once the device is chosen */
+gboolean vf_metal_device_selection_handle_query (GstElement * element,
+    VfMetalDeviceSelection * sel, GstQuery * query);
+
+/* Forget the device and any context at READY_TO_NULL, so the next run
+ * asks the neighbours again */
+void vf_metal_device_selection_reset (GstElement * element,
+    VfMetalDeviceSelection * sel);
+
+G_END_DECLS
+
+/* Choose the device, at NULL_TO_READY: the property, else a context from
+ * the peers or the application (NEED_CONTEXT), else the default, which
+ * is then announced with HAVE_CONTEXT. Posts an error and returns nil
+ * when the property names no GPU. */
+VfMetalDevice *vf_metal_device_selection_ensure (GstElement * element,
+    VfMetalDeviceSelection * sel);
+
+#endif /* __VF_METAL_CONTEXT_H__ */
@@ -0,0 +1,274 @@
+/* Per-element Metal device selection and GstContext sharing
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#import "vfmetalcontext.h"
+
+#define GST_CAT_DEFAULT gst_vf_metal_debug
+
+void
+vf_metal_device_selection_init (VfMetalDeviceSelection * sel)
+{
+    sel->spec = NULL;
+    sel->context_id = 0;
+    sel->registry_id = 0;
+}
+
+void
+vf_metal_device_selection_clear (VfMetalDeviceSelection * sel)
+{
+    g_clear_pointer (&sel->spec, g_free);
+}
+
+GParamSpec *
+vf_metal_device_selection_param_spec (void)
+{
+    return g_param_spec_string ("device", "Device",
+        "GPU to run on: index, registry ID (0x...) or part of its name. "
+        "Empty follows the neighbouring Metal elements, else the default "
+        "GPU",
+        NULL,
+        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY);
+}
+
+void
+vf_metal_device_selection_set_property (GstElement * element,
+    VfMetalDeviceSelection * sel, const GValue * value)
+{
+    GST_OBJECT_LOCK (element);
+    g_free (sel->spec);
+    sel->spec = g_value_dup_string (value);
+    GST_OBJECT_UNLOCK (element);
+}
+
+void
+vf_metal_device_selection_get_property (GstElement * element,
+    VfMetalDeviceSelection * sel, GValue * value)
+{
+    GST_OBJECT_LOCK (element);
+    g_value_set_string (value, sel->spec);
+    GST_OBJECT_UNLOCK (element);
+}
+
+static gboolean
+vf_metal_context_get_registry_id (GstContext * context, guint64 * registry_id)
+{
+    const GstStructure *s;
+
+    if (!context ||
+        g_strcmp0 (gst_context_get_context_type (context),
+            VF_METAL_DEVICE_CONTEXT_TYPE) != 0)
+        return FALSE;
+
+    s = gst_context_get_structure (context);
+    return gst_structure_get_uint64 (s, "registry-id", registry_id) &&
+        *registry_id != 0;
+}
+
+static GstContext *
+vf_metal_context_new (VfMetalDevice * device)
+{
+    GstContext *context =
+        gst_context_new (VF_METAL_DEVICE_CONTEXT_TYPE, TRUE);
+
+    gst_structure_set (gst_context_writable_structure (context),
+        "registry-id", G_TYPE_UINT64, device.registryID,
+        "name", G_TYPE_STRING, device.device.name.UTF8String, NULL);
+    return context;
+}
+
+void
+vf_metal_device_selection_set_context (GstElement * element,
+    VfMetalDeviceSelection * sel, GstContext * context)
+{
+    guint64 registry_id;
+
+    if (!vf_metal_context_get_registry_id (context, &registry_id))
+        return;
+
+    GST_OBJECT_LOCK (element);
+    sel->context_id = registry_id;
+    GST_OBJECT_UNLOCK (element);
+
+    GST_DEBUG_OBJECT (element, "Neighbour runs on Metal device 0x%"
+        G_GINT64_MODIFIER "x", registry_id);
+}
+
+gboolean
+vf_metal_device_selection_handle_query (GstElement * element,
+    VfMetalDeviceSelection * sel, GstQuery * query)
+{
+    const gchar *context_type;
+    guint64 registry_id;
+    VfMetalDevice *device;
+
+    if (GST_QUERY_TYPE (query) != GST_QUERY_CONTEXT ||
+        !gst_query_parse_context_type (query, &context_type) ||
+        g_strcmp0 (context_type, VF_METAL_DEVICE_CONTEXT_TYPE) != 0)
+        return FALSE;
+
+    GST_OBJECT_LOCK (element);
+    registry_id = sel->registry_id;
+    GST_OBJECT_UNLOCK (element);
+
+    if (registry_id == 0)
+        return FALSE;
+
+    device = [VfMetalDevice deviceWithRegistryID:registry_id];
+    if (!device)
+        return FALSE;
+
+    GstContext *context = vf_metal_context_new (device);
+    gst_query_set_context (query, context);
+    gst_context_unref (context);
+    return TRUE;
+}
+
+void
+vf_metal_device_selection_reset (GstElement * element,
+    VfMetalDeviceSelection * sel)
+{
+    GST_OBJECT_LOCK (element);
+    sel->context_id = 0;
+    sel->registry_id = 0;
+    GST_OBJECT_UNLOCK (element);
+}
+
+/* Ask the peers of @pads, stopping at the first one that answers */
+static gboolean
+vf_metal_context_query_pads (GstElement * element, GList * pads)
+{
+    gboolean found = FALSE;
+
+    for (GList *l = pads; l && !found; l = l->next) {
+        GstQuery *query = gst_query_new_context (VF_METAL_DEVICE_CONTEXT_TYPE);
+        GstContext *context = NULL;
+
+        if (gst_pad_peer_query (GST_PAD (l->data), query)) {
+            gst_query_parse_context (query, &context);
+            if (context) {
+                GST_DEBUG_OBJECT (element, "Got Metal device context from "
+                    "the peer of %s:%s", GST_DEBUG_PAD_NAME (l->data));
+                gst_element_set_context (element, context);
+                found = TRUE;
+            }
+        }
+        gst_query_unref (query);
+    }
+
+    return found;
+}
+
+static gboolean
+vf_metal_context_query_peers (GstElement * element)
+{
+    GList *pads;
+    gboolean found;
+
+    /* Downstream first: it reaches READY before us */
+    GST_OBJECT_LOCK (element);
+    pads = g_list_copy_deep (element->srcpads, (GCopyFunc) gst_object_ref,
+        NULL);
+    GST_OBJECT_UNLOCK (element);
+    found = vf_metal_context_query_pads (element, pads);
+    g_list_free_full (pads, gst_object_unref);
+    if (found)
+        return TRUE;
+
+    GST_OBJECT_LOCK (element);
+    pads = g_list_copy_deep (element->sinkpads, (GCopyFunc) gst_object_ref,
+        NULL);
+    GST_OBJECT_UNLOCK (element);
+    found = vf_metal_context_query_pads (element, pads);
+    g_list_free_full (pads, gst_object_unref);
+    return found;
+}
+
+VfMetalDevice *
+vf_metal_device_selection_ensure (GstElement * element,
+    VfMetalDeviceSelection * sel)
+{
+    VfMetalDevice *device = nil;
+    gchar *spec;
+    guint64 context_id;
+
+    GST_OBJECT_LOCK (element);
+    spec = g_strdup (sel->spec);
+    context_id = sel->context_id;
+    GST_OBJECT_UNLOCK (element);
+
+    if (spec && spec[0]) {
+        device = [VfMetalDevice deviceForSpec:spec];
+        if (!device) {
+            GST_ELEMENT_ERROR (element, RESOURCE, NOT_FOUND,
+                ("No Metal device matches \"%s\"", spec),
+                ("%lu Metal device(s) present",
+                 (unsigned long) [VfMetalDevice allDevices].count));
+            g_free (spec);
+            return nil;
+        }
+        g_free (spec);
+    } else {
+        g_free (spec);
+
+        /* Linked neighbours take precedence over a context the bin handed
+         * us when we were added; the application or a parent bin may then
+         * answer NEED_CONTEXT synchronously */
+        if (!vf_metal_context_query_peers (element) && context_id == 0)
+            gst_element_post_message (element,
+                gst_message_new_need_context (GST_OBJECT (element),
+                    VF_METAL_DEVICE_CONTEXT_TYPE));
+
+        GST_OBJECT_LOCK (element);
+        context_id = sel->context_id;
+        GST_OBJECT_UNLOCK (element);
+
+        if (context_id != 0) {
+            device = [VfMetalDevice deviceWithRegistryID:context_id];
+            if (!device)
+                GST_WARNING_OBJECT (element, "Metal device 0x%"
+                    G_GINT64_MODIFIER "x from context is gone, using the "
+                    "default", context_id);
+        }
+
+        if (!device) {
+            device = [VfMetalDevice sharedDevice];
+            if (!device) {
+                GST_ELEMENT_ERROR (element, RESOURCE, NOT_FOUND,
+                    ("No Metal device available"), (NULL));
+                return nil;
+            }
+
+            /* Let the bin hand our choice to elements asking later */
+            GstContext *context = vf_metal_context_new (device);
+            gst_element_post_message (element,
+                gst_message_new_have_context (GST_OBJECT (element),
+                    context));
+        }
+    }
+
+    GST_OBJECT_LOCK (element);
+    sel->registry_id = device.registryID;
+    GST_OBJECT_UNLOCK (element);
+
+    GST_INFO_OBJECT (element, "Running on Metal device '%s'",
+        device.device.name.UTF8String);
+    return device;
+}
@@ -30,15 +30,102 @@
 /* Debug category for shared Metal infrastructure */
 GST_DEBUG_CATEGORY_EXTERN (gst_vf_metal_debug);
 
+/* One instance per GPU, created on first use and kept for the life of the
+ * process; all caches below are per device. */
 @interface VfMetalDevice : NSObject
 
+/* The default GPU: the first one that is not low-power */
 + (instancetype)sharedDevice;
 
+/* Every GPU Metal reports, in enumeration order (the "device" index) */
++ (NSArray<id<MTLDevice>> *)allDevices;
+
+/* GPU named by @spec, as accepted by the elements' "device" property:
+ * an index into +allDevices, a registry ID ("0x" for hex) or a
+ * case-insensitive substring of the device name. NULL or empty selects
+ * +sharedDevice. Returns nil when nothing matches. */
++ (instancetype)deviceForSpec:(const gchar *)spec;
+
+/* The instance for the GPU with @registryID, or nil if it is gone */
++ (instancetype)deviceWithRegistryID:(guint64)registryID;
+
 @property (nonatomic, readonly) id<MTLDevice> device;
 
+@property (nonatomic, readonly) guint64 registryID;
+
+/* Command queue shared by every renderer on this GPU */
+@property (nonatomic, readonly) id<MTLCommandQueue> commandQueue;
+
+/* Apple silicon (and iOS) GPUs share system memory with the CPU, so
+ * shared-storage textures cost nothing. Discrete GPUs keep their own
+ * VRAM: textures the CPU touches use managed storage there and GPU
+ * memory frames are private textures staged through a blit. */
+@property (nonatomic, readonly) BOOL hasUnifiedMemory;
+
+/* Storage mode for textures the CPU fills with replaceRegion: or reads
+ * with getBytes: -- shared with unified memory, managed otherwise */
+@property (nonatomic, readonly) MTLStorageMode hostStorageMode;
+
+/* Make the GPU's writes to @textures visible to getBytes:. Encodes a
+ * synchronize blit into @commandBuffer for managed textures; nothing to
+ * do with unified memory. */
+- (void)encodeSynchronizeTextures:(NSArray<id<MTLTexture>> *)textures
+                    commandBuffer:(id<MTLCommandBuffer>)commandBuffer;
+
+/* Same, for results whose command buffer has already completed: runs
+ * the blit on its own command buffer and waits for it */
+- (void)synchronizeTextures:(NSArray<id<MTLTexture>> *)textures;
+
+/* Compiles @source once per device; later calls with the same source
+ * return the cached library. */
 - (id<MTLLibrary>)compileShaderSource:(NSString *)source
                                 error:(NSError **)error;
 
+/* Returns the library precompiled at build time under @name, falling back
+ * to compileShaderSource: with @source when the plugin was built without
+ * it (VF_METAL_PRECOMPILE_SHADERS=OFF). */
+- (id<MTLLibrary>)libraryNamed:(NSString *)name
+                        source:(NSString *)source
+                         error:(NSError **)error;
+
+/* Cached pipeline states. @library must come from compileShaderSource:
+ * (cached libraries live for the whole process, so their identity is part
+ * of the key). Render pipelines are keyed by function names, pixel format
+ * and the blend state of colour attachment 0. */
+- (id<MTLRenderPipelineState>)renderPipelineWithDescriptor:(MTLRenderPipelineDescriptor *)desc
+                                                   library:(id<MTLLibrary>)library
+                                                     error:(NSError **)error;
+
+/* As above with the fragment function specialised by @constants, which
+ * only happens on a cache miss; @variant identifies the values in the
+ * key. */
+- (id<MTLRenderPipelineState>)renderPipelineWithDescriptor:(MTLRenderPipelineDescriptor *)desc
+                                                   library:(id<MTLLibrary>)library
+                                         fragmentConstants:(MTLFunctionConstantValues *)constants
+                                                   variant:(NSString *)variant
+                                                     error:(NSError **)error;
+
+- (id<MTLComputePipelineState>)computePipelineWithFunctionName:(NSString *)name
+                                                       library:(id<MTLLibrary>)library
+                                                         error:(NSError **)error;
+
+/* Specialises @name with @constants first. @variant must identify the
+ * constant values uniquely, as it stands in for them in the cache key. */
+- (id<MTLComputePipelineState>)computePipelineWithFunctionName:(NSString *)name
+                                                       library:(id<MTLLibrary>)library
+                                                     constants:(MTLFunctionConstantValues *)constants
+                                                       variant:(NSString *)variant
+                                                         error:(NSError **)error;
+
+/* Pipelines missing from the persistent MTLBinaryArchive are added to it
+ * and written out shortly afterwards and at exit; this forces the write.
+ * The archive lives in the user caches directory unless
+ * VF_METAL_PIPELINE_ARCHIVE names another path (empty = disabled). */
+- (void)flushPipelineArchive;
+
 @end
 
+/* -hostStorageMode for code that only holds the MTLDevice */
+MTLStorageMode vf_metal_host_storage_mode (id<MTLDevice> device);
+
 #endif /* __VF_METAL_DEVICE_H__ */
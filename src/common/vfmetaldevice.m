@@ -21,61 +21,382 @@
 
 #import "vfmetaldevice.h"
 
+#ifdef VF_METAL_HAVE_METALLIB
+#include "vfmetalmetallib.h"
+#endif
+
+#include <stdlib.h>
+
 GST_DEBUG_CATEGORY (gst_vf_metal_debug);
+#define GST_CAT_DEFAULT gst_vf_metal_debug
+
+/* Every element instance shares this queue, so allow more outstanding
+ * command buffers than the default 64 (many pads times in-flight depth) */
+#define VF_METAL_QUEUE_MAX_COMMAND_BUFFERS 256
+
+/* Overrides the binary archive location; an empty value disables it */
+#define VF_METAL_PIPELINE_ARCHIVE_ENV "VF_METAL_PIPELINE_ARCHIVE"
+
+/* New pipelines are written to the archive this long after the last one
+ * was added, so a burst of element setup costs a single write */
+#define VF_METAL_ARCHIVE_FLUSH_DELAY_NS (2 * NSEC_PER_SEC)
+
+@interface VfMetalDevice ()
+- (instancetype)initWithMTLDevice:(id<MTLDevice>)device
+                     archiveIndex:(NSUInteger)archiveIndex
+                       firstInUse:(BOOL)firstInUse;
+@end
+
+/* Instances by registry ID, guarded by vf_metal_registry_lock */
+static NSMutableDictionary<NSNumber *, VfMetalDevice *> *vf_metal_registry;
+static NSLock *vf_metal_registry_lock;
 
 @implementation VfMetalDevice {
     id<MTLDevice> _device;
+    id<MTLCommandQueue> _commandQueue;
+
+    /* Same-model GPUs seen before this one; keeps their archives apart */
+    NSUInteger _archiveIndex;
+    BOOL _firstInUse;
+
+    /* Per-device caches, guarded by _cacheLock */
+    NSLock *_cacheLock;
+    NSMutableDictionary<NSString *, id<MTLLibrary>> *_libraries;
+    NSMutableDictionary<NSString *, id<MTLLibrary>> *_namedLibraries;
+    NSMutableDictionary<NSString *, id<MTLRenderPipelineState>> *_renderPipelines;
+    NSMutableDictionary<NSString *, id<MTLComputePipelineState>> *_computePipelines;
+
+    /* Persistent pipeline binaries (nil when disabled or unsupported) */
+    id<MTLBinaryArchive> _archive;
+    NSURL *_archiveURL;
+    BOOL _archiveDirty;
+    BOOL _archiveFlushScheduled;
+
+    /* Pipeline creation statistics: warm = found in the archive */
+    guint _warmPipelines;
+    guint _coldPipelines;
+    gint64 _warmTime;
+    gint64 _coldTime;
 }
 
-+ (instancetype)sharedDevice
+MTLStorageMode
+vf_metal_host_storage_mode (id<MTLDevice> device)
 {
-    static VfMetalDevice *instance = nil;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        instance = [[VfMetalDevice alloc] initPrivate];
-    });
-    return instance;
+#if TARGET_OS_IOS
+    return MTLStorageModeShared;
+#else
+    return device.hasUnifiedMemory ? MTLStorageModeShared
+                                   : MTLStorageModeManaged;
+#endif
 }
 
-- (instancetype)initPrivate
+static void
+vf_metal_device_atexit (void)
 {
-    self = [super init];
-    if (!self) return nil;
+    NSArray<VfMetalDevice *> *devices;
+
+    [vf_metal_registry_lock lock];
+    devices = vf_metal_registry.allValues;
+    [vf_metal_registry_lock unlock];
+
+    for (VfMetalDevice *device in devices)
+        [device flushPipelineArchive];
+}
 
-    /* Initialize debug category on first use */
-    static dispatch_once_t catOnce;
-    dispatch_once(&catOnce, ^{
+static void
+vf_metal_device_init_once (void)
+{
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
         GST_DEBUG_CATEGORY_INIT (gst_vf_metal_debug,
             "vfmetal", 0, "VF Metal shared infrastructure");
+        vf_metal_registry = [NSMutableDictionary dictionary];
+        vf_metal_registry_lock = [[NSLock alloc] init];
+        atexit (vf_metal_device_atexit);
     });
+}
 
++ (NSArray<id<MTLDevice>> *)allDevices
+{
 #if TARGET_OS_IOS
-    _device = MTLCreateSystemDefaultDevice();
+    id<MTLDevice> device = MTLCreateSystemDefaultDevice();
+    return device ? @[device] : @[];
 #else
-    /* macOS: prefer discrete GPU if available */
-    NSArray<id<MTLDevice>> *devices = MTLCopyAllDevices();
-    _device = devices.firstObject;
-    for (id<MTLDevice> dev in devices) {
-        if (!dev.isLowPower) {
-            _device = dev;
-            break;
+    return MTLCopyAllDevices();
+#endif
+}
+
+/* Registered instance for @device, created on first use */
++ (instancetype)_deviceForMTLDevice:(id<MTLDevice>)device
+{
+    VfMetalDevice *instance;
+
+    if (!device)
+        return nil;
+
+    vf_metal_device_init_once ();
+
+    [vf_metal_registry_lock lock];
+    instance = vf_metal_registry[@(device.registryID)];
+    if (!instance) {
+        NSUInteger sameModel = 0;
+        for (VfMetalDevice *other in vf_metal_registry.allValues) {
+            if ([other.device.name isEqualToString:device.name])
+                sameModel++;
         }
+        instance = [[VfMetalDevice alloc] initWithMTLDevice:device
+                                               archiveIndex:sameModel
+                                                 firstInUse:
+                                                     vf_metal_registry.count == 0];
+        if (instance)
+            vf_metal_registry[@(device.registryID)] = instance;
     }
+    [vf_metal_registry_lock unlock];
+
+    return instance;
+}
+
++ (instancetype)sharedDevice
+{
+    static VfMetalDevice *instance = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSArray<id<MTLDevice>> *devices = [VfMetalDevice allDevices];
+        id<MTLDevice> device = devices.firstObject;
+
+#if !TARGET_OS_IOS
+        /* macOS: prefer discrete GPU if available */
+        for (id<MTLDevice> dev in devices) {
+            if (!dev.isLowPower) {
+                device = dev;
+                break;
+            }
+        }
 #endif
 
-    if (!_device) {
-        GST_ERROR ("VfMetalDevice: No Metal device available");
+        vf_metal_device_init_once ();
+        if (!device)
+            GST_ERROR ("VfMetalDevice: No Metal device available");
+        instance = [VfMetalDevice _deviceForMTLDevice:device];
+    });
+    return instance;
+}
+
++ (instancetype)deviceForSpec:(const gchar *)spec
+{
+    NSArray<id<MTLDevice>> *devices;
+    gboolean hex;
+    guint64 value;
+    gchar *end = NULL;
+
+    if (!spec || !spec[0])
+        return [VfMetalDevice sharedDevice];
+
+    devices = [VfMetalDevice allDevices];
+
+    /* Small decimal numbers are indices, anything else a registry ID */
+    hex = g_str_has_prefix (spec, "0x") || g_str_has_prefix (spec, "0X");
+    value = g_ascii_strtoull (hex ? spec + 2 : spec, &end, hex ? 16 : 10);
+    if (g_ascii_isxdigit (spec[hex ? 2 : 0]) && *end == '\0') {
+        if (!hex && value < devices.count)
+            return [VfMetalDevice _deviceForMTLDevice:devices[value]];
+        return [VfMetalDevice deviceWithRegistryID:value];
+    }
+
+    for (id<MTLDevice> device in devices) {
+        if ([device.name rangeOfString:@(spec)
+                               options:NSCaseInsensitiveSearch].location !=
+                NSNotFound)
+            return [VfMetalDevice _deviceForMTLDevice:device];
+    }
+
+    return nil;
+}
+
++ (instancetype)deviceWithRegistryID:(guint64)registryID
+{
+    for (id<MTLDevice> device in [VfMetalDevice allDevices]) {
+        if (device.registryID == registryID)
+            return [VfMetalDevice _deviceForMTLDevice:device];
+    }
+    return nil;
+}
+
+- (instancetype)initWithMTLDevice:(id<MTLDevice>)device
+                     archiveIndex:(NSUInteger)archiveIndex
+                       firstInUse:(BOOL)firstInUse
+{
+    self = [super init];
+    if (!self) return nil;
+
+    _device = device;
+    _archiveIndex = archiveIndex;
+    _firstInUse = firstInUse;
+
+    GST_INFO ("VfMetalDevice: Using device '%s' (registry ID 0x%" G_GINT64_MODIFIER
+              "x, %s memory)", _device.name.UTF8String,
+              (guint64) _device.registryID,
+              self.hasUnifiedMemory ? "unified" : "discrete");
+
+    _commandQueue = [_device newCommandQueueWithMaxCommandBufferCount:
+        VF_METAL_QUEUE_MAX_COMMAND_BUFFERS];
+    if (!_commandQueue) {
+        GST_ERROR ("VfMetalDevice: Failed to create command queue");
         return nil;
     }
 
-    GST_INFO ("VfMetalDevice: Using device '%s'", _device.name.UTF8String);
+    _cacheLock = [[NSLock alloc] init];
+    _libraries = [NSMutableDictionary dictionary];
+    _namedLibraries = [NSMutableDictionary dictionary];
+    _renderPipelines = [NSMutableDictionary dictionary];
+    _computePipelines = [NSMutableDictionary dictionary];
+
+    [self _openPipelineArchive];
 
     return self;
 }
 
+- (NSString *)_defaultPipelineArchivePath
+{
+    NSArray<NSString *> *dirs = NSSearchPathForDirectoriesInDomains(
+        NSCachesDirectory, NSUserDomainMask, YES);
+    if (dirs.count == 0)
+        return nil;
+
+    NSString *dir = [dirs.firstObject
+        stringByAppendingPathComponent:@"gst-vf-metal"];
+    if (![[NSFileManager defaultManager] createDirectoryAtPath:dir
+                                   withIntermediateDirectories:YES
+                                                    attributes:nil
+                                                         error:nil])
+        return nil;
+
+    /* Binaries are GPU-specific: one archive per device model */
+    NSCharacterSet *unsafe =
+        [[NSCharacterSet alphanumericCharacterSet] invertedSet];
+    NSString *deviceName = [[_device.name
+        componentsSeparatedByCharactersInSet:unsafe]
+        componentsJoinedByString:@"-"];
+
+    /* Identical GPUs in one machine would race on a shared file */
+    if (_archiveIndex > 0)
+        deviceName = [deviceName stringByAppendingFormat:@"-%lu",
+            (unsigned long) _archiveIndex];
+
+    return [dir stringByAppendingPathComponent:
+        [NSString stringWithFormat:@"pipelines-%@.metallib", deviceName]];
+}
+
+- (void)_openPipelineArchive
+{
+    NSString *path;
+    const gchar *env = g_getenv (VF_METAL_PIPELINE_ARCHIVE_ENV);
+
+    if (env) {
+        if (env[0] == '\0') {
+            GST_INFO ("Pipeline binary archive disabled by %s",
+                      VF_METAL_PIPELINE_ARCHIVE_ENV);
+            return;
+        }
+        path = @(env);
+        /* The first GPU in use gets the path itself, others a copy */
+        if (!_firstInUse)
+            path = [path stringByAppendingFormat:@".%" G_GINT64_MODIFIER "x",
+                (guint64) _device.registryID];
+    } else {
+        path = [self _defaultPipelineArchivePath];
+        if (!path)
+            return;
+    }
+
+    _archiveURL = [NSURL fileURLWithPath:path];
+
+    MTLBinaryArchiveDescriptor *desc =
+        [[MTLBinaryArchiveDescriptor alloc] init];
+    if ([[NSFileManager defaultManager] fileExistsAtPath:path])
+        desc.url = _archiveURL;
+
+    NSError *error = nil;
+    _archive = [_device newBinaryArchiveWithDescriptor:desc error:&error];
+    if (!_archive && desc.url) {
+        /* Stale or from another OS/driver: start a fresh one */
+        GST_WARNING ("Discarding unreadable pipeline archive %s: %s",
+                     path.UTF8String, error.localizedDescription.UTF8String);
+        desc.url = nil;
+        _archive = [_device newBinaryArchiveWithDescriptor:desc error:&error];
+    }
+
+    if (!_archive) {
+        GST_INFO ("Pipeline binary archive unavailable: %s",
+                  error.localizedDescription.UTF8String);
+        return;
+    }
+
+    GST_INFO ("Pipeline binary archive: %s (%s)", path.UTF8String,
+              desc.url ? "loaded" : "new");
+}
+
+/* Called with _cacheLock held */
+- (void)_schedulePipelineArchiveFlush
+{
+    _archiveDirty = YES;
+    if (_archiveFlushScheduled)
+        return;
+
+    _archiveFlushScheduled = YES;
+    dispatch_after (dispatch_time (DISPATCH_TIME_NOW,
+            VF_METAL_ARCHIVE_FLUSH_DELAY_NS),
+        dispatch_get_global_queue (QOS_CLASS_UTILITY, 0), ^{
+            [self flushPipelineArchive];
+        });
+}
+
+- (void)flushPipelineArchive
+{
+    [_cacheLock lock];
+
+    _archiveFlushScheduled = NO;
+    if (_archive && _archiveDirty) {
+        NSError *error = nil;
+        if ([_archive serializeToURL:_archiveURL error:&error]) {
+            _archiveDirty = NO;
+            GST_DEBUG ("Wrote pipeline archive %s",
+                       _archiveURL.path.UTF8String);
+        } else {
+            GST_WARNING ("Failed to write pipeline archive %s: %s",
+                         _archiveURL.path.UTF8String,
+                         error.localizedDescription.UTF8String);
+        }
+    }
+
+    [_cacheLock unlock];
+}
+
+/* Called with _cacheLock held */
+- (void)_recordPipeline:(NSString *)name
+                   warm:(BOOL)warm
+                  start:(gint64)start
+{
+    gint64 elapsed = g_get_monotonic_time () - start;
+
+    if (warm) {
+        _warmPipelines++;
+        _warmTime += elapsed;
+    } else {
+        _coldPipelines++;
+        _coldTime += elapsed;
+    }
+
+    GST_DEBUG ("Pipeline %s: %s in %.2f ms (so far %u warm in %.1f ms, "
+               "%u cold in %.1f ms)", name.UTF8String,
+               warm ? "warm" : "cold", elapsed / 1000.0,
+               _warmPipelines, _warmTime / 1000.0,
+               _coldPipelines, _coldTime / 1000.0);
+}
+
 - (instancetype)init
 {
-    /* Prevent direct init — use +sharedDevice */
+    /* Prevent direct init — use +sharedDevice or +deviceForSpec: */
     return nil;
 }
 
@@ -84,12 +405,313 @@ GST_DEBUG_CATEGORY (gst_vf_metal_debug);
     return _device;
 }
 
+- (guint64)registryID
+{
+    return _device.registryID;
+}
+
+- (id<MTLCommandQueue>)commandQueue
+{
+    return _commandQueue;
+}
+
+- (BOOL)hasUnifiedMemory
+{
+#if TARGET_OS_IOS
+    return YES;
+#else
+    return _device.hasUnifiedMemory;
+#endif
+}
+
+- (MTLStorageMode)hostStorageMode
+{
+    return vf_metal_host_storage_mode (_device);
+}
+
+- (void)encodeSynchronizeTextures:(NSArray<id<MTLTexture>> *)textures
+                    commandBuffer:(id<MTLCommandBuffer>)commandBuffer
+{
+#if !TARGET_OS_IOS
+    id<MTLBlitCommandEncoder> blit = nil;
+
+    for (id<MTLTexture> texture in textures) {
+        if (texture.storageMode != MTLStorageModeManaged)
+            continue;
+        if (!blit)
+            blit = [commandBuffer blitCommandEncoder];
+        [blit synchronizeResource:texture];
+    }
+    [blit endEncoding];
+#endif
+}
+
+- (void)synchronizeTextures:(NSArray<id<MTLTexture>> *)textures
+{
+#if !TARGET_OS_IOS
+    BOOL managed = NO;
+
+    for (id<MTLTexture> texture in textures)
+        managed |= (texture.storageMode == MTLStorageModeManaged);
+    if (!managed)
+        return;
+
+    id<MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
+    [self encodeSynchronizeTextures:textures commandBuffer:commandBuffer];
+    [commandBuffer commit];
+    [commandBuffer waitUntilCompleted];
+#endif
+}
+
 - (id<MTLLibrary>)compileShaderSource:(NSString *)source
                                 error:(NSError **)error
 {
-    return [_device newLibraryWithSource:source
-                                options:nil
-                                  error:error];
+    /* Held across the compile so concurrent instances of the same element
+     * wait for one compilation instead of each running their own */
+    [_cacheLock lock];
+
+    id<MTLLibrary> library = _libraries[source];
+    if (!library) {
+        gint64 start = g_get_monotonic_time ();
+        library = [_device newLibraryWithSource:source
+                                        options:nil
+                                          error:error];
+        if (library) {
+            _libraries[[source copy]] = library;
+            GST_DEBUG ("Compiled shader library (%lu bytes) in %" G_GINT64_FORMAT
+                       " us", (unsigned long) source.length,
+                       g_get_monotonic_time () - start);
+        }
+    }
+
+    [_cacheLock unlock];
+    return library;
+}
+
+#ifdef VF_METAL_HAVE_METALLIB
+/* Called with _cacheLock held */
+- (id<MTLLibrary>)_newEmbeddedLibraryNamed:(NSString *)name
+{
+    const VfMetalEmbeddedMetallib *lib;
+
+    for (lib = vf_metal_embedded_metallibs; lib->name; lib++) {
+        if (strcmp (lib->name, name.UTF8String) != 0)
+            continue;
+
+        gint64 start = g_get_monotonic_time ();
+        /* Static storage: wrap without copying */
+        dispatch_data_t data = dispatch_data_create (lib->data, lib->size,
+            NULL, ^{});
+        NSError *error = nil;
+        id<MTLLibrary> library = [_device newLibraryWithData:data
+                                                       error:&error];
+        if (!library) {
+            GST_WARNING ("Failed to load precompiled '%s' library: %s",
+                         lib->name, error.localizedDescription.UTF8String);
+            return nil;
+        }
+
+        GST_DEBUG ("Loaded precompiled '%s' library in %" G_GINT64_FORMAT
+                   " us", lib->name, g_get_monotonic_time () - start);
+        return library;
+    }
+
+    return nil;
+}
+#endif
+
+- (id<MTLLibrary>)libraryNamed:(NSString *)name
+                        source:(NSString *)source
+                         error:(NSError **)error
+{
+#ifdef VF_METAL_HAVE_METALLIB
+    [_cacheLock lock];
+
+    id<MTLLibrary> library = _namedLibraries[name];
+    if (!library) {
+        library = [self _newEmbeddedLibraryNamed:name];
+        if (library)
+            _namedLibraries[name] = library;
+    }
+
+    [_cacheLock unlock];
+
+    if (library)
+        return library;
+
+    GST_WARNING ("No precompiled '%s' library, compiling shader source",
+                 name.UTF8String);
+#endif
+
+    return [self compileShaderSource:source error:error];
+}
+
+static NSString *
+vf_metal_render_pipeline_key (MTLRenderPipelineDescriptor * desc,
+    id<MTLLibrary> library)
+{
+    MTLRenderPipelineColorAttachmentDescriptor *ca = desc.colorAttachments[0];
+
+    return [NSString stringWithFormat:@"%p|%@|%@|%lu|%d|%lu,%lu,%lu,%lu,%lu,%lu|%lu",
+        (__bridge void *) library,
+        desc.vertexFunction.name, desc.fragmentFunction.name,
+        (unsigned long) ca.pixelFormat, ca.blendingEnabled ? 1 : 0,
+        (unsigned long) ca.rgbBlendOperation,
+        (unsigned long) ca.alphaBlendOperation,
+        (unsigned long) ca.sourceRGBBlendFactor,
+        (unsigned long) ca.destinationRGBBlendFactor,
+        (unsigned long) ca.sourceAlphaBlendFactor,
+        (unsigned long) ca.destinationAlphaBlendFactor,
+        (unsigned long) ca.writeMask];
+}
+
+- (id<MTLRenderPipelineState>)renderPipelineWithDescriptor:(MTLRenderPipelineDescriptor *)desc
+                                                   library:(id<MTLLibrary>)library
+                                                     error:(NSError **)error
+{
+    return [self renderPipelineWithDescriptor:desc library:library
+                            fragmentConstants:nil variant:nil error:error];
+}
+
+- (id<MTLRenderPipelineState>)renderPipelineWithDescriptor:(MTLRenderPipelineDescriptor *)desc
+                                                   library:(id<MTLLibrary>)library
+                                         fragmentConstants:(MTLFunctionConstantValues *)constants
+                                                   variant:(NSString *)variant
+                                                     error:(NSError **)error
+{
+    NSString *key = vf_metal_render_pipeline_key (desc, library);
+    if (variant)
+        key = [key stringByAppendingFormat:@"|%@", variant];
+
+    [_cacheLock lock];
+
+    id<MTLRenderPipelineState> state = _renderPipelines[key];
+    if (!state && constants) {
+        /* Specialise only on a miss: that is where the compile happens */
+        id<MTLFunction> fragment =
+            [library newFunctionWithName:desc.fragmentFunction.name
+                          constantValues:constants error:error];
+        if (!fragment) {
+            GST_ERROR ("Failed to specialise fragment function '%s'",
+                       desc.fragmentFunction.name.UTF8String);
+            [_cacheLock unlock];
+            return nil;
+        }
+        desc = [desc copy];
+        desc.fragmentFunction = fragment;
+    }
+
+    if (!state) {
+        gint64 start = g_get_monotonic_time ();
+        BOOL warm = NO;
+
+        if (_archive) {
+            /* Copy: the caller's descriptor is left untouched */
+            desc = [desc copy];
+            desc.binaryArchives = @[_archive];
+            state = [_device newRenderPipelineStateWithDescriptor:desc
+                options:MTLPipelineOptionFailOnBinaryArchiveMiss
+                reflection:nil error:nil];
+            warm = (state != nil);
+        }
+
+        if (!state) {
+            state = [_device newRenderPipelineStateWithDescriptor:desc
+                                                            error:error];
+            NSError *archiveError = nil;
+            if (state && _archive) {
+                if ([_archive addRenderPipelineFunctionsWithDescriptor:desc
+                                                                 error:&archiveError])
+                    [self _schedulePipelineArchiveFlush];
+                else
+                    GST_WARNING ("Failed to archive render pipeline: %s",
+                                 archiveError.localizedDescription.UTF8String);
+            }
+        }
+
+        if (state) {
+            _renderPipelines[key] = state;
+            NSString *name = [NSString stringWithFormat:@"%@/%@",
+                desc.vertexFunction.name, desc.fragmentFunction.name];
+            if (variant)
+                name = [name stringByAppendingFormat:@"[%@]", variant];
+            [self _recordPipeline:name warm:warm start:start];
+        }
+    }
+
+    [_cacheLock unlock];
+    return state;
+}
+
+- (id<MTLComputePipelineState>)computePipelineWithFunctionName:(NSString *)name
+                                                       library:(id<MTLLibrary>)library
+                                                         error:(NSError **)error
+{
+    return [self computePipelineWithFunctionName:name library:library
+                                       constants:nil variant:nil error:error];
+}
+
+- (id<MTLComputePipelineState>)computePipelineWithFunctionName:(NSString *)name
+                                                       library:(id<MTLLibrary>)library
+                                                     constants:(MTLFunctionConstantValues *)constants
+                                                       variant:(NSString *)variant
+                                                         error:(NSError **)error
+{
+    NSString *key = [NSString stringWithFormat:@"%p|%@|%@",
+        (__bridge void *) library, name, variant ? variant : @""];
+
+    [_cacheLock lock];
+
+    id<MTLComputePipelineState> state = _computePipelines[key];
+    id<MTLFunction> func = nil;
+    if (!state && constants)
+        func = [library newFunctionWithName:name constantValues:constants
+                                      error:error];
+    else if (!state)
+        func = [library newFunctionWithName:name];
+
+    if (!state && !func) {
+        GST_ERROR ("Compute function '%s' not found", name.UTF8String);
+    } else if (!state) {
+        gint64 start = g_get_monotonic_time ();
+        BOOL warm = NO;
+
+        MTLComputePipelineDescriptor *desc =
+            [[MTLComputePipelineDescriptor alloc] init];
+        desc.computeFunction = func;
+
+        if (_archive) {
+            desc.binaryArchives = @[_archive];
+            state = [_device newComputePipelineStateWithDescriptor:desc
+                options:MTLPipelineOptionFailOnBinaryArchiveMiss
+                reflection:nil error:nil];
+            warm = (state != nil);
+        }
+
+        if (!state) {
+            state = [_device newComputePipelineStateWithDescriptor:desc
+                options:MTLPipelineOptionNone reflection:nil error:error];
+            NSError *archiveError = nil;
+            if (state && _archive) {
+                if ([_archive addComputePipelineFunctionsWithDescriptor:desc
+                                                                  error:&archiveError])
+                    [self _schedulePipelineArchiveFlush];
+                else
+                    GST_WARNING ("Failed to archive compute pipeline: %s",
+                                 archiveError.localizedDescription.UTF8String);
+            }
+        }
+
+        if (state) {
+            _computePipelines[key] = state;
+            [self _recordPipeline:variant ?
+                      [NSString stringWithFormat:@"%@[%@]", name, variant] : name
+                             warm:warm start:start];
+        }
+    }
+
+    [_cacheLock unlock];
+    return state;
 }
 
 @end
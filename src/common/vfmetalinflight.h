@@ -0,0 +1,149 @@
+/* Pipelined command-buffer submission for VisioForge Metal elements
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __VF_METAL_INFLIGHT_H__
+#define __VF_METAL_INFLIGHT_H__
+
+#import <Foundation/Foundation.h>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/base/gstbasetransform.h>
+
+G_BEGIN_DECLS
+
+/* Range and default of the "in-flight" property. 1 commits and waits per
+ * frame exactly like before; 2+ lets the CPU prepare frame N+1 while the
+ * GPU runs frame N, at the cost of (depth - 1) frames of latency. */
+#define VF_METAL_MAX_IN_FLIGHT      4
+#define VF_METAL_DEFAULT_IN_FLIGHT  1
+
+/**
+ * VfMetalInflightJob:
+ *
+ * One submitted frame. The mapped frames stay valid until the GPU has
+ * finished and the renderer has read the result back, after which the
+ * output buffer is handed downstream in submission order.
+ */
+typedef struct _VfMetalInflightJob
+{
+  /* Renderer ring slot owned by this frame while it is in flight */
+  guint slot;
+
+  GstBuffer *inbuf;             /* NULL for aggregators and in place */
+  GstVideoFrame in_frame;       /* unmapped in place: use out_frame */
+  gboolean in_mapped;
+
+  GstBuffer *outbuf;
+  GstVideoFrame out_frame;
+  gboolean out_mapped;
+
+  /* Released with the job: extra input buffers the GPU samples in place
+   * (compositor pads), or the renditions of a scale ladder frame */
+  GPtrArray *held;
+
+  /* Protected by VfMetalInflight.lock */
+  gboolean done;
+  gboolean ok;
+} VfMetalInflightJob;
+
+/**
+ * VfMetalInflight:
+ *
+ * FIFO of submitted frames, oldest first, embedded in each element.
+ * Only the streaming thread adds or removes jobs; Metal completion
+ * handlers just flip @done under the lock.
+ */
+typedef struct
+{
+  GMutex lock;
+  GCond cond;
+  GQueue jobs;
+  guint depth;          /* latched from the property at READY_TO_PAUSED */
+  guint serial;
+} VfMetalInflight;
+
+void vf_metal_inflight_init (VfMetalInflight * inflight);
+void vf_metal_inflight_clear (VfMetalInflight * inflight);
+
+/* Latch the depth for the next run / wait for and drop everything queued */
+void vf_metal_inflight_start (VfMetalInflight * inflight, guint depth);
+void vf_metal_inflight_stop (VfMetalInflight * inflight);
+
+gboolean vf_metal_inflight_is_pipelined (VfMetalInflight * inflight);
+
+/* Create a job with a free ring slot. When the queue is full the oldest
+ * job is waited for and returned in @ready, to be finished by the caller. */
+VfMetalInflightJob *vf_metal_inflight_job_new (VfMetalInflight * inflight,
+    VfMetalInflightJob ** ready);
+
+/* Append a submitted job */
+void vf_metal_inflight_queue (VfMetalInflight * inflight,
+    VfMetalInflightJob * job);
+
+/* Oldest job if it has completed (or after waiting when @wait), else NULL */
+VfMetalInflightJob *vf_metal_inflight_pop (VfMetalInflight * inflight,
+    gboolean wait);
+
+/* Unmap and free @job. Returns the output buffer, or NULL if the GPU
+ * reported an error for it. */
+GstBuffer *vf_metal_inflight_job_finish (VfMetalInflightJob * job);
+void vf_metal_inflight_job_free (VfMetalInflightJob * job);
+
+/* Add (depth - 1) frame durations to a LATENCY query answer */
+void vf_metal_inflight_add_latency (VfMetalInflight * inflight,
+    GstQuery * query, gint fps_n, gint fps_d);
+
+/* Reserve (depth - 1) extra output buffers in a decided ALLOCATION query */
+void vf_metal_inflight_adjust_allocation (VfMetalInflight * inflight,
+    GstQuery * query);
+
+/* --- GstBaseTransform glue --- */
+
+/* Push every queued frame downstream, in order */
+GstFlowReturn vf_metal_inflight_drain (VfMetalInflight * inflight,
+    GstBaseTransform * trans);
+
+/* Serialized events drain the queue first; FLUSH_STOP drops it */
+void vf_metal_inflight_sink_event (VfMetalInflight * inflight,
+    GstBaseTransform * trans, GstEvent * event);
+
+G_END_DECLS
+
+/* Called from a Metal completion handler once the frame is read back */
+typedef void (^VfMetalCompletionHandler) (BOOL ok);
+
+VfMetalCompletionHandler vf_metal_inflight_job_completion (
+    VfMetalInflight * inflight, VfMetalInflightJob * job);
+
+/* Encode @job's frames into its slot and commit without waiting. The
+ * renderer must invoke @completion exactly once when it returns TRUE. */
+typedef gboolean (*VfMetalInflightSubmitFunc) (GstBaseTransform * trans,
+    VfMetalInflightJob * job, VfMetalCompletionHandler completion);
+
+/* GstBaseTransformClass::generate_output replacement. Falls back to
+ * @parent_class when not pipelined or in passthrough. */
+GstFlowReturn vf_metal_inflight_generate_output (VfMetalInflight * inflight,
+    GstBaseTransform * trans, GstBaseTransformClass * parent_class,
+    GstVideoInfo * in_info, GstVideoInfo * out_info,
+    VfMetalInflightSubmitFunc submit, GstBuffer ** outbuf);
+
+#endif /* __VF_METAL_INFLIGHT_H__ */
@@ -0,0 +1,352 @@
+/* Pipelined command-buffer submission for VisioForge Metal elements
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#import "vfmetalinflight.h"
+#import "vfmetaldevice.h"
+#import "vfmetalmemory.h"
+
+#define GST_CAT_DEFAULT gst_vf_metal_debug
+
+void
+vf_metal_inflight_init (VfMetalInflight * inflight)
+{
+    g_mutex_init (&inflight->lock);
+    g_cond_init (&inflight->cond);
+    g_queue_init (&inflight->jobs);
+    inflight->depth = VF_METAL_DEFAULT_IN_FLIGHT;
+    inflight->serial = 0;
+}
+
+void
+vf_metal_inflight_clear (VfMetalInflight * inflight)
+{
+    vf_metal_inflight_stop (inflight);
+    g_cond_clear (&inflight->cond);
+    g_mutex_clear (&inflight->lock);
+}
+
+void
+vf_metal_inflight_start (VfMetalInflight * inflight, guint depth)
+{
+    vf_metal_inflight_stop (inflight);
+
+    g_mutex_lock (&inflight->lock);
+    inflight->depth = CLAMP (depth, 1, VF_METAL_MAX_IN_FLIGHT);
+    inflight->serial = 0;
+    g_mutex_unlock (&inflight->lock);
+}
+
+void
+vf_metal_inflight_stop (VfMetalInflight * inflight)
+{
+    VfMetalInflightJob *job;
+
+    /* The GPU may still reference the mapped frames: wait, then drop */
+    while ((job = vf_metal_inflight_pop (inflight, TRUE)))
+        vf_metal_inflight_job_free (job);
+}
+
+gboolean
+vf_metal_inflight_is_pipelined (VfMetalInflight * inflight)
+{
+    return inflight->depth > 1;
+}
+
+VfMetalInflightJob *
+vf_metal_inflight_job_new (VfMetalInflight * inflight,
+    VfMetalInflightJob ** ready)
+{
+    VfMetalInflightJob *job = g_new0 (VfMetalInflightJob, 1);
+
+    *ready = NULL;
+
+    g_mutex_lock (&inflight->lock);
+
+    /* Queue full: the oldest frame owns the slot we are about to reuse */
+    if (g_queue_get_length (&inflight->jobs) >= inflight->depth) {
+        VfMetalInflightJob *oldest = g_queue_peek_head (&inflight->jobs);
+        while (!oldest->done)
+            g_cond_wait (&inflight->cond, &inflight->lock);
+        *ready = g_queue_pop_head (&inflight->jobs);
+    }
+
+    job->slot = inflight->serial++ % inflight->depth;
+
+    g_mutex_unlock (&inflight->lock);
+
+    return job;
+}
+
+void
+vf_metal_inflight_queue (VfMetalInflight * inflight, VfMetalInflightJob * job)
+{
+    g_mutex_lock (&inflight->lock);
+    g_queue_push_tail (&inflight->jobs, job);
+    g_mutex_unlock (&inflight->lock);
+}
+
+VfMetalInflightJob *
+vf_metal_inflight_pop (VfMetalInflight * inflight, gboolean wait)
+{
+    VfMetalInflightJob *job = NULL;
+
+    g_mutex_lock (&inflight->lock);
+
+    VfMetalInflightJob *oldest = g_queue_peek_head (&inflight->jobs);
+    if (oldest && wait) {
+        while (!oldest->done)
+            g_cond_wait (&inflight->cond, &inflight->lock);
+    }
+    if (oldest && oldest->done)
+        job = g_queue_pop_head (&inflight->jobs);
+
+    g_mutex_unlock (&inflight->lock);
+
+    return job;
+}
+
+VfMetalCompletionHandler
+vf_metal_inflight_job_completion (VfMetalInflight * inflight,
+    VfMetalInflightJob * job)
+{
+    return ^(BOOL ok) {
+        g_mutex_lock (&inflight->lock);
+        job->ok = ok;
+        job->done = TRUE;
+        g_cond_broadcast (&inflight->cond);
+        g_mutex_unlock (&inflight->lock);
+    };
+}
+
+static void
+vf_metal_inflight_job_release (VfMetalInflightJob * job)
+{
+    if (job->in_mapped)
+        gst_video_frame_unmap (&job->in_frame);
+    if (job->out_mapped)
+        gst_video_frame_unmap (&job->out_frame);
+    if (job->held)
+        g_ptr_array_unref (job->held);
+    gst_clear_buffer (&job->inbuf);
+}
+
+GstBuffer *
+vf_metal_inflight_job_finish (VfMetalInflightJob * job)
+{
+    GstBuffer *outbuf = job->outbuf;
+
+    vf_metal_inflight_job_release (job);
+
+    if (!job->ok)
+        gst_clear_buffer (&outbuf);
+
+    g_free (job);
+    return outbuf;
+}
+
+void
+vf_metal_inflight_job_free (VfMetalInflightJob * job)
+{
+    vf_metal_inflight_job_release (job);
+    gst_clear_buffer (&job->outbuf);
+    g_free (job);
+}
+
+void
+vf_metal_inflight_add_latency (VfMetalInflight * inflight, GstQuery * query,
+    gint fps_n, gint fps_d)
+{
+    gboolean live;
+    GstClockTime min, max, extra;
+
+    if (inflight->depth <= 1 || fps_n <= 0 || fps_d <= 0)
+        return;
+
+    /* Worst case a frame leaves once (depth - 1) newer ones are queued */
+    extra = gst_util_uint64_scale_int (GST_SECOND * (inflight->depth - 1),
+        fps_d, fps_n);
+
+    gst_query_parse_latency (query, &live, &min, &max);
+    min += extra;
+    if (GST_CLOCK_TIME_IS_VALID (max))
+        max += extra;
+    gst_query_set_latency (query, live, min, max);
+
+    GST_DEBUG ("in-flight depth %u adds %" GST_TIME_FORMAT " latency",
+        inflight->depth, GST_TIME_ARGS (extra));
+}
+
+void
+vf_metal_inflight_adjust_allocation (VfMetalInflight * inflight,
+    GstQuery * query)
+{
+    GstBufferPool *pool = NULL;
+    guint size, min, max;
+
+    if (inflight->depth <= 1 || gst_query_get_n_allocation_pools (query) == 0)
+        return;
+
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+
+    /* Queued frames hold their output buffers until completion */
+    min += inflight->depth - 1;
+    if (max != 0 && max < min)
+        max = min;
+
+    gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+    if (pool)
+        gst_object_unref (pool);
+}
+
+/* --- GstBaseTransform glue --- */
+
+GstFlowReturn
+vf_metal_inflight_drain (VfMetalInflight * inflight, GstBaseTransform * trans)
+{
+    VfMetalInflightJob *job;
+    GstFlowReturn ret = GST_FLOW_OK;
+
+    while ((job = vf_metal_inflight_pop (inflight, TRUE))) {
+        GstBuffer *outbuf = vf_metal_inflight_job_finish (job);
+
+        if (ret != GST_FLOW_OK) {
+            gst_clear_buffer (&outbuf);
+            continue;
+        }
+
+        if (!outbuf) {
+            GST_WARNING_OBJECT (trans, "Metal rendering failed");
+            ret = GST_FLOW_ERROR;
+            continue;
+        }
+
+        ret = gst_pad_push (GST_BASE_TRANSFORM_SRC_PAD (trans), outbuf);
+    }
+
+    return ret;
+}
+
+void
+vf_metal_inflight_sink_event (VfMetalInflight * inflight,
+    GstBaseTransform * trans, GstEvent * event)
+{
+    if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP) {
+        vf_metal_inflight_stop (inflight);
+    } else if (GST_EVENT_IS_SERIALIZED (event)) {
+        /* Keep frames ahead of CAPS/SEGMENT/EOS they were produced under */
+        GstFlowReturn ret = vf_metal_inflight_drain (inflight, trans);
+        if (ret != GST_FLOW_OK) {
+            GST_DEBUG_OBJECT (trans, "drain before %s returned %s",
+                GST_EVENT_TYPE_NAME (event), gst_flow_get_name (ret));
+        }
+    }
+}
+
+GstFlowReturn
+vf_metal_inflight_generate_output (VfMetalInflight * inflight,
+    GstBaseTransform * trans, GstBaseTransformClass * parent_class,
+    GstVideoInfo * in_info, GstVideoInfo * out_info,
+    VfMetalInflightSubmitFunc submit, GstBuffer ** outbuf)
+{
+    GstBaseTransformClass *klass = GST_BASE_TRANSFORM_GET_CLASS (trans);
+    GstBuffer *inbuf = trans->queued_buf;
+    VfMetalInflightJob *job = NULL, *ready = NULL;
+    gboolean in_place;
+    GstFlowReturn ret;
+
+    *outbuf = NULL;
+
+    if (!vf_metal_inflight_is_pipelined (inflight) ||
+        gst_base_transform_is_passthrough (trans)) {
+        /* Anything still queued must go out before the synchronous path */
+        ret = vf_metal_inflight_drain (inflight, trans);
+        if (ret != GST_FLOW_OK)
+            return ret;
+        return parent_class->generate_output (trans, outbuf);
+    }
+
+    if (inbuf) {
+        trans->queued_buf = NULL;
+
+        if (klass->before_transform)
+            klass->before_transform (trans, inbuf);
+
+        job = vf_metal_inflight_job_new (inflight, &ready);
+        job->inbuf = inbuf;
+
+        ret = klass->prepare_output_buffer (trans, inbuf, &job->outbuf);
+        if (ret != GST_FLOW_OK || !job->outbuf)
+            goto failed;
+
+        /* In place: the (now writable) input is the output, only out_frame
+         * is mapped and the submit function works on it alone */
+        in_place = gst_base_transform_is_in_place (trans);
+        if (job->outbuf == inbuf)
+            job->inbuf = NULL;
+
+        if (!in_place) {
+            if (!gst_video_frame_map (&job->in_frame, in_info, inbuf,
+                    GST_MAP_READ | GST_MAP_VF_METAL)) {
+                GST_ERROR_OBJECT (trans, "Failed to map input buffer");
+                ret = GST_FLOW_ERROR;
+                goto failed;
+            }
+            job->in_mapped = TRUE;
+        }
+
+        if (!gst_video_frame_map (&job->out_frame, out_info, job->outbuf,
+                (in_place ? GST_MAP_READWRITE : GST_MAP_WRITE) |
+                GST_MAP_VF_METAL)) {
+            GST_ERROR_OBJECT (trans, "Failed to map output buffer");
+            ret = GST_FLOW_ERROR;
+            goto failed;
+        }
+        job->out_mapped = TRUE;
+
+        if (!submit (trans, job, vf_metal_inflight_job_completion (inflight,
+                    job))) {
+            GST_WARNING_OBJECT (trans, "Metal rendering failed");
+            ret = GST_FLOW_ERROR;
+            goto failed;
+        }
+
+        vf_metal_inflight_queue (inflight, job);
+    }
+
+    /* One buffer per call; GstBaseTransform calls again until we return none */
+    if (!ready)
+        ready = vf_metal_inflight_pop (inflight, FALSE);
+    if (ready) {
+        *outbuf = vf_metal_inflight_job_finish (ready);
+        if (!*outbuf) {
+            GST_WARNING_OBJECT (trans, "Metal rendering failed");
+            return GST_FLOW_ERROR;
+        }
+    }
+
+    return GST_FLOW_OK;
+
+failed:
+    vf_metal_inflight_job_free (job);
+    if (ready)
+        vf_metal_inflight_job_free (ready);
+    return ret;
+}
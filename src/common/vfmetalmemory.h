@@ -0,0 +1,155 @@
+/* GPU-resident video memory for VisioForge Metal elements
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __VF_METAL_MEMORY_H__
+#define __VF_METAL_MEMORY_H__
+
+#import <Foundation/Foundation.h>
+#import <Metal/Metal.h>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/base/gstbasetransform.h>
+
+#import "vfmetalinflight.h"
+
+@class VfMetalDevice;
+
+G_BEGIN_DECLS
+
+/* Caps feature advertised by elements that exchange VfMetalMemory */
+#define GST_CAPS_FEATURE_MEMORY_VF_METAL "memory:MetalTexture"
+
+/* Name the allocator is registered under (gst_allocator_find) */
+#define GST_VF_METAL_MEMORY_TYPE "VfMetalMemory"
+
+/* Map flag for callers that reach the frame through its plane textures
+ * (vf_metal_frame_peek_texture): staged memory then skips the copy to
+ * the CPU, which the caller only needs if the peek fails */
+#define GST_MAP_VF_METAL (GST_MAP_FLAG_LAST << 1)
+
+/* Pad template caps: GPU memory first so adjacent Metal elements prefer it */
+#define VF_METAL_VIDEO_CAPS_MAKE(formats)                                   \
+    GST_VIDEO_CAPS_MAKE_WITH_FEATURES (GST_CAPS_FEATURE_MEMORY_VF_METAL,    \
+        formats) "; " GST_VIDEO_CAPS_MAKE (formats)
+
+/**
+ * GstVfMetalMemory:
+ *
+ * One video frame held in a single shared-storage MTLBuffer, with one
+ * linear MTLTexture per plane aliasing the buffer. Because the storage is
+ * shared the memory is CPU-mappable without a copy; Metal elements read
+ * and write the plane textures directly instead of uploading/reading back.
+ *
+ * On a discrete GPU the plane textures are private (in VRAM) and the
+ * buffer is only a staging copy: mapping for reading blits the planes
+ * into it when the GPU wrote them last, and unmapping after a CPU write
+ * blits them back.
+ */
+typedef struct _GstVfMetalMemory
+{
+  GstMemory mem;
+
+  /* Layout (strides/offsets) the plane textures were created with */
+  GstVideoInfo info;
+
+  /* id<MTLBuffer> and id<MTLTexture> per plane, bridged retained */
+  void *buffer;
+  void *textures[GST_VIDEO_MAX_PLANES];
+  guint n_textures;
+
+  /* VfMetalDevice the textures belong to, bridged retained */
+  void *device;
+
+  /* Discrete GPU: @buffer is a staging copy of private textures.
+   * gpu_written: the GPU rendered into the textures while mapped.
+   * cpu_stale: the textures are newer than @buffer. */
+  gboolean staged;
+  gboolean gpu_written;
+  gboolean cpu_stale;
+} GstVfMetalMemory;
+
+#define GST_TYPE_VF_METAL_ALLOCATOR (gst_vf_metal_allocator_get_type())
+G_DECLARE_FINAL_TYPE (GstVfMetalAllocator, gst_vf_metal_allocator,
+    GST, VF_METAL_ALLOCATOR, GstAllocator)
+
+#define GST_TYPE_VF_METAL_BUFFER_POOL (gst_vf_metal_buffer_pool_get_type())
+G_DECLARE_FINAL_TYPE (GstVfMetalBufferPool, gst_vf_metal_buffer_pool,
+    GST, VF_METAL_BUFFER_POOL, GstBufferPool)
+
+/* Register the allocator; called once from plugin_init */
+void gst_vf_metal_memory_init_once (void);
+
+gboolean gst_is_vf_metal_memory (GstMemory * mem);
+
+/* Whether VfMetalMemory can represent @format (plane texture formats known) */
+gboolean gst_vf_metal_memory_supports_format (GstVideoFormat format);
+
+/* Allocate one frame on @device. @info is updated in place with the
+ * Metal-aligned strides/offsets/size the memory was laid out with. */
+GstMemory *gst_vf_metal_memory_alloc (GstVideoInfo * info,
+    VfMetalDevice * device);
+
+/* Pool of frames on @device (nil = the default device) */
+GstBufferPool *gst_vf_metal_buffer_pool_new (VfMetalDevice * device);
+
+/* Caps helpers */
+gboolean gst_vf_metal_caps_has_memory_feature (GstCaps * caps);
+
+/* Allocation query helpers shared by all elements, for pools on the
+ * element's @device.
+ * propose: answer an upstream ALLOCATION query with a VfMetal pool.
+ * decide: make sure our output pool is a VfMetal pool on @device when
+ * downstream negotiated the Metal caps feature. */
+gboolean gst_vf_metal_memory_propose_allocation (GstQuery * query,
+    VfMetalDevice * device);
+gboolean gst_vf_metal_memory_decide_allocation (GstQuery * query,
+    VfMetalDevice * device);
+
+/* GstBaseTransform propose_allocation / decide_allocation for the
+ * filters, with @parent_class the element's parent class: @device's pool
+ * where Metal memory was negotiated, else the parent's answer. decide
+ * also reserves @inflight's queued output buffers. */
+gboolean vf_metal_propose_allocation (GstBaseTransform * trans,
+    GstBaseTransformClass * parent_class, VfMetalDevice * device,
+    GstQuery * decide_query, GstQuery * query);
+gboolean vf_metal_decide_allocation (GstBaseTransform * trans,
+    GstBaseTransformClass * parent_class, VfMetalDevice * device,
+    VfMetalInflight * inflight, GstQuery * query);
+
+G_END_DECLS
+
+/* Borrow the plane texture backing a mapped frame, or nil when the frame
+ * is plain system memory or lives on a GPU other than @device (caller
+ * then falls back to upload/readback). */
+id<MTLTexture> vf_metal_frame_peek_texture (GstVideoFrame *frame, guint plane,
+    id<MTLDevice> device);
+
+/* Call once the GPU renders into the peeked textures of a frame mapped
+ * for writing; on a discrete GPU the unmap then keeps the result instead
+ * of uploading the (stale) staging copy over it */
+void vf_metal_frame_mark_gpu_written (GstVideoFrame *frame);
+
+/* Bring the bytes of a frame mapped with GST_MAP_VF_METAL up to date for
+ * a caller that peeked a texture it cannot use (format or size) */
+void vf_metal_frame_sync_to_cpu (GstVideoFrame *frame);
+
+#endif /* __VF_METAL_MEMORY_H__ */
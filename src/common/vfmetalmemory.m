@@ -0,0 +1,723 @@
+/* GPU-resident video memory for VisioForge Metal elements
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#import "vfmetalmemory.h"
+#import "vfmetaldevice.h"
+#import "vfmetaltextureutil.h"
+
+#define GST_CAT_DEFAULT gst_vf_metal_debug
+
+static GstAllocator *_vf_metal_allocator = NULL;
+
+/* --- Plane layout --- */
+
+/* Texture format and size used for each plane. Packed 4:2:2 formats are
+ * exposed as RGBA8 at half width, matching the convertscale kernels. */
+static gboolean
+vf_metal_plane_texture_format (const GstVideoInfo *info, guint plane,
+    MTLPixelFormat *pixelFormat, guint *width, guint *height)
+{
+    guint w = GST_VIDEO_INFO_WIDTH (info);
+    guint h = GST_VIDEO_INFO_HEIGHT (info);
+
+    switch (GST_VIDEO_INFO_FORMAT (info)) {
+        case GST_VIDEO_FORMAT_BGRA:
+            *pixelFormat = MTLPixelFormatBGRA8Unorm;
+            break;
+        case GST_VIDEO_FORMAT_RGBA:
+            *pixelFormat = MTLPixelFormatRGBA8Unorm;
+            break;
+        case GST_VIDEO_FORMAT_UYVY:
+        case GST_VIDEO_FORMAT_YUY2:
+            *pixelFormat = MTLPixelFormatRGBA8Unorm;
+            w = w / 2;
+            break;
+        case GST_VIDEO_FORMAT_NV12:
+        case GST_VIDEO_FORMAT_P010_10LE:
+        case GST_VIDEO_FORMAT_I420:
+        case GST_VIDEO_FORMAT_I420_10LE:
+            *pixelFormat = vf_metal_plane_pixel_format (
+                GST_VIDEO_INFO_FORMAT (info), plane);
+            break;
+        default:
+            return FALSE;
+    }
+
+    if (plane > 0) {
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+
+    *width = w;
+    *height = h;
+    return TRUE;
+}
+
+gboolean
+gst_vf_metal_memory_supports_format (GstVideoFormat format)
+{
+    switch (format) {
+        case GST_VIDEO_FORMAT_BGRA:
+        case GST_VIDEO_FORMAT_RGBA:
+        case GST_VIDEO_FORMAT_UYVY:
+        case GST_VIDEO_FORMAT_YUY2:
+        case GST_VIDEO_FORMAT_NV12:
+        case GST_VIDEO_FORMAT_I420:
+        case GST_VIDEO_FORMAT_P010_10LE:
+        case GST_VIDEO_FORMAT_I420_10LE:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+/* Linear textures need every row (and plane offset) aligned to the
+ * device's minimum linear texture alignment. */
+static gboolean
+vf_metal_align_video_info (GstVideoInfo *info, id<MTLDevice> device)
+{
+    GstVideoAlignment align;
+    NSUInteger alignment = 16;
+
+    for (guint i = 0; i < GST_VIDEO_INFO_N_PLANES (info); i++) {
+        MTLPixelFormat pixelFormat;
+        guint w, h;
+
+        if (!vf_metal_plane_texture_format (info, i, &pixelFormat, &w, &h))
+            return FALSE;
+        alignment = MAX (alignment,
+            [device minimumLinearTextureAlignmentForPixelFormat:pixelFormat]);
+    }
+
+    gst_video_alignment_reset (&align);
+    for (guint i = 0; i < GST_VIDEO_MAX_PLANES; i++)
+        align.stride_align[i] = (guint) alignment - 1;
+
+    return gst_video_info_align (info, &align);
+}
+
+/* --- GstMemory vfuncs --- */
+
+/* Discrete GPU: copy the private plane textures to or from the staging
+ * buffer and wait, so the CPU sees (or the GPU gets) the whole frame */
+static void
+vf_metal_mem_stage (GstVfMetalMemory *mmem, BOOL toBuffer)
+{
+    VfMetalDevice *metalDevice = (__bridge VfMetalDevice *) mmem->device;
+    id<MTLBuffer> buffer = (__bridge id<MTLBuffer>) mmem->buffer;
+
+    @autoreleasepool {
+        id<MTLCommandBuffer> commandBuffer =
+            [metalDevice.commandQueue commandBuffer];
+        id<MTLBlitCommandEncoder> blit = [commandBuffer blitCommandEncoder];
+
+        for (guint i = 0; i < mmem->n_textures; i++) {
+            id<MTLTexture> texture =
+                (__bridge id<MTLTexture>) mmem->textures[i];
+            MTLSize size = MTLSizeMake (texture.width, texture.height, 1);
+            NSUInteger offset = GST_VIDEO_INFO_PLANE_OFFSET (&mmem->info, i);
+            NSUInteger stride = GST_VIDEO_INFO_PLANE_STRIDE (&mmem->info, i);
+
+            if (toBuffer) {
+                [blit copyFromTexture:texture
+                          sourceSlice:0
+                          sourceLevel:0
+                         sourceOrigin:MTLOriginMake (0, 0, 0)
+                           sourceSize:size
+                             toBuffer:buffer
+                    destinationOffset:offset
+               destinationBytesPerRow:stride
+             destinationBytesPerImage:stride * texture.height];
+            } else {
+                [blit copyFromBuffer:buffer
+                        sourceOffset:offset
+                   sourceBytesPerRow:stride
+                 sourceBytesPerImage:stride * texture.height
+                          sourceSize:size
+                           toTexture:texture
+                    destinationSlice:0
+                    destinationLevel:0
+                   destinationOrigin:MTLOriginMake (0, 0, 0)];
+            }
+        }
+
+        [blit endEncoding];
+        [commandBuffer commit];
+        [commandBuffer waitUntilCompleted];
+
+        if (commandBuffer.status == MTLCommandBufferStatusError)
+            GST_ERROR ("VfMetalMemory: staging blit failed: %s",
+                       commandBuffer.error.localizedDescription.UTF8String);
+    }
+}
+
+/* Bring the staging buffer up to date before the CPU reads it */
+static void
+vf_metal_mem_sync_to_cpu (GstVfMetalMemory *mmem)
+{
+    if (!mmem->cpu_stale)
+        return;
+    vf_metal_mem_stage (mmem, YES);
+    mmem->cpu_stale = FALSE;
+}
+
+static gpointer
+vf_metal_mem_map (GstMemory *mem, GstMapInfo *info, gsize maxsize)
+{
+    GstVfMetalMemory *mmem = (GstVfMetalMemory *) mem;
+    id<MTLBuffer> buffer = (__bridge id<MTLBuffer>) mmem->buffer;
+
+    /* Shared storage: the CPU sees the same bytes the GPU wrote, as long as
+     * the producing command buffer has completed before the buffer is pushed */
+    if (mmem->staged && (info->flags & GST_MAP_READ) &&
+        !(info->flags & GST_MAP_VF_METAL))
+        vf_metal_mem_sync_to_cpu (mmem);
+
+    return buffer.contents;
+}
+
+static void
+vf_metal_mem_unmap (GstMemory *mem, GstMapInfo *info)
+{
+    GstVfMetalMemory *mmem = (GstVfMetalMemory *) mem;
+
+    if (!mmem->staged || !(info->flags & GST_MAP_WRITE))
+        return;
+
+    if (mmem->gpu_written) {
+        /* Rendered on the GPU: only the textures hold the frame now */
+        mmem->gpu_written = FALSE;
+        mmem->cpu_stale = TRUE;
+    } else {
+        vf_metal_mem_stage (mmem, NO);
+        mmem->cpu_stale = FALSE;
+    }
+}
+
+static GstMemory *
+vf_metal_mem_share (GstMemory *mem, gssize offset, gssize size)
+{
+    return NULL;
+}
+
+/* --- Allocator --- */
+
+struct _GstVfMetalAllocator
+{
+  GstAllocator parent;
+};
+
+G_DEFINE_TYPE (GstVfMetalAllocator, gst_vf_metal_allocator,
+    GST_TYPE_ALLOCATOR);
+
+static GstMemory *
+gst_vf_metal_allocator_alloc (GstAllocator *allocator, gsize size,
+    GstAllocationParams *params)
+{
+    g_warning ("Use gst_vf_metal_memory_alloc () to allocate from the "
+        GST_VF_METAL_MEMORY_TYPE " allocator");
+    return NULL;
+}
+
+static void
+gst_vf_metal_allocator_free (GstAllocator *allocator, GstMemory *mem)
+{
+    GstVfMetalMemory *mmem = (GstVfMetalMemory *) mem;
+
+    @autoreleasepool {
+        for (guint i = 0; i < mmem->n_textures; i++) {
+            id<MTLTexture> texture =
+                (__bridge_transfer id<MTLTexture>) mmem->textures[i];
+            mmem->textures[i] = NULL;
+            (void) texture;
+        }
+        id<MTLBuffer> buffer = (__bridge_transfer id<MTLBuffer>) mmem->buffer;
+        mmem->buffer = NULL;
+        (void) buffer;
+        VfMetalDevice *device =
+            (__bridge_transfer VfMetalDevice *) mmem->device;
+        mmem->device = NULL;
+        (void) device;
+    }
+
+    g_free (mmem);
+}
+
+static void
+gst_vf_metal_allocator_class_init (GstVfMetalAllocatorClass *klass)
+{
+    GstAllocatorClass *allocator_class = (GstAllocatorClass *) klass;
+
+    allocator_class->alloc = gst_vf_metal_allocator_alloc;
+    allocator_class->free = gst_vf_metal_allocator_free;
+}
+
+static void
+gst_vf_metal_allocator_init (GstVfMetalAllocator *self)
+{
+    GstAllocator *alloc = GST_ALLOCATOR_CAST (self);
+
+    alloc->mem_type = GST_VF_METAL_MEMORY_TYPE;
+    alloc->mem_map_full = vf_metal_mem_map;
+    alloc->mem_unmap_full = vf_metal_mem_unmap;
+    alloc->mem_share = vf_metal_mem_share;
+
+    GST_OBJECT_FLAG_SET (self, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+}
+
+void
+gst_vf_metal_memory_init_once (void)
+{
+    static gsize init = 0;
+
+    if (g_once_init_enter (&init)) {
+        /* Also initializes the shared debug category */
+        [VfMetalDevice sharedDevice];
+
+        _vf_metal_allocator = g_object_new (GST_TYPE_VF_METAL_ALLOCATOR, NULL);
+        gst_object_ref_sink (_vf_metal_allocator);
+        gst_allocator_register (GST_VF_METAL_MEMORY_TYPE,
+            gst_object_ref (_vf_metal_allocator));
+        g_once_init_leave (&init, 1);
+    }
+}
+
+gboolean
+gst_is_vf_metal_memory (GstMemory *mem)
+{
+    return mem != NULL && mem->allocator != NULL &&
+        g_type_is_a (G_OBJECT_TYPE (mem->allocator),
+            GST_TYPE_VF_METAL_ALLOCATOR);
+}
+
+GstMemory *
+gst_vf_metal_memory_alloc (GstVideoInfo *info, VfMetalDevice *device)
+{
+    GstVfMetalMemory *mmem;
+
+    gst_vf_metal_memory_init_once ();
+
+    VfMetalDevice *metalDevice = device ? device : [VfMetalDevice sharedDevice];
+    if (!metalDevice)
+        return NULL;
+
+    if (!vf_metal_align_video_info (info, metalDevice.device)) {
+        GST_ERROR ("VfMetalMemory: unsupported format %s",
+            gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (info)));
+        return NULL;
+    }
+
+    @autoreleasepool {
+        id<MTLBuffer> buffer =
+            [metalDevice.device newBufferWithLength:GST_VIDEO_INFO_SIZE (info)
+                                            options:MTLResourceStorageModeShared];
+        if (!buffer) {
+            GST_ERROR ("VfMetalMemory: failed to allocate %" G_GSIZE_FORMAT
+                " bytes", GST_VIDEO_INFO_SIZE (info));
+            return NULL;
+        }
+
+        mmem = g_new0 (GstVfMetalMemory, 1);
+        gst_memory_init (GST_MEMORY_CAST (mmem), GST_MEMORY_FLAG_NO_SHARE,
+            _vf_metal_allocator, NULL, GST_VIDEO_INFO_SIZE (info), 0, 0,
+            GST_VIDEO_INFO_SIZE (info));
+        mmem->info = *info;
+        mmem->device = (__bridge_retained void *) metalDevice;
+        mmem->staged = !metalDevice.hasUnifiedMemory;
+
+        for (guint i = 0; i < GST_VIDEO_INFO_N_PLANES (info); i++) {
+            MTLPixelFormat pixelFormat;
+            guint w, h;
+
+            vf_metal_plane_texture_format (info, i, &pixelFormat, &w, &h);
+
+            MTLTextureDescriptor *desc = [MTLTextureDescriptor
+                texture2DDescriptorWithPixelFormat:pixelFormat
+                                             width:w
+                                            height:h
+                                         mipmapped:NO];
+            desc.usage = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite |
+                         MTLTextureUsageRenderTarget;
+
+            id<MTLTexture> texture;
+            if (mmem->staged) {
+                /* VRAM copy; the buffer is reached through blits only */
+                desc.storageMode = MTLStorageModePrivate;
+                texture = [metalDevice.device newTextureWithDescriptor:desc];
+            } else {
+                desc.storageMode = MTLStorageModeShared;
+                texture = [buffer newTextureWithDescriptor:desc
+                                                    offset:GST_VIDEO_INFO_PLANE_OFFSET (info, i)
+                                               bytesPerRow:GST_VIDEO_INFO_PLANE_STRIDE (info, i)];
+            }
+            if (!texture) {
+                GST_ERROR ("VfMetalMemory: failed to create plane %u texture", i);
+                mmem->buffer = (__bridge_retained void *) buffer;
+                gst_memory_unref (GST_MEMORY_CAST (mmem));
+                return NULL;
+            }
+            mmem->textures[i] = (__bridge_retained void *) texture;
+            mmem->n_textures = i + 1;
+        }
+
+        mmem->buffer = (__bridge_retained void *) buffer;
+    }
+
+    return GST_MEMORY_CAST (mmem);
+}
+
+/* --- Buffer pool --- */
+
+struct _GstVfMetalBufferPool
+{
+  GstBufferPool parent;
+
+  GstVideoInfo info;
+
+  /* VfMetalDevice the frames are allocated on, bridged retained */
+  void *device;
+};
+
+G_DEFINE_TYPE (GstVfMetalBufferPool, gst_vf_metal_buffer_pool,
+    GST_TYPE_BUFFER_POOL);
+
+static const gchar **
+gst_vf_metal_buffer_pool_get_options (GstBufferPool *pool)
+{
+    static const gchar *options[] = { GST_BUFFER_POOL_OPTION_VIDEO_META,
+        NULL };
+    return options;
+}
+
+static gboolean
+gst_vf_metal_buffer_pool_set_config (GstBufferPool *pool,
+    GstStructure *config)
+{
+    GstVfMetalBufferPool *self = GST_VF_METAL_BUFFER_POOL (pool);
+    GstCaps *caps;
+    guint size, min_buffers, max_buffers;
+    GstVideoInfo info;
+
+    if (!gst_buffer_pool_config_get_params (config, &caps, &size,
+            &min_buffers, &max_buffers) || caps == NULL) {
+        GST_WARNING_OBJECT (pool, "invalid config");
+        return FALSE;
+    }
+
+    if (!gst_video_info_from_caps (&info, caps) ||
+        !gst_vf_metal_memory_supports_format (GST_VIDEO_INFO_FORMAT (&info)) ||
+        !vf_metal_align_video_info (&info,
+            ((__bridge VfMetalDevice *) self->device).device)) {
+        GST_WARNING_OBJECT (pool, "unsupported caps %" GST_PTR_FORMAT, caps);
+        return FALSE;
+    }
+
+    self->info = info;
+
+    /* Aligned strides make the frame larger than the packed default */
+    gst_buffer_pool_config_set_params (config, caps,
+        GST_VIDEO_INFO_SIZE (&info), min_buffers, max_buffers);
+
+    return GST_BUFFER_POOL_CLASS (gst_vf_metal_buffer_pool_parent_class)->
+        set_config (pool, config);
+}
+
+static GstFlowReturn
+gst_vf_metal_buffer_pool_alloc_buffer (GstBufferPool *pool,
+    GstBuffer **buffer, GstBufferPoolAcquireParams *params)
+{
+    GstVfMetalBufferPool *self = GST_VF_METAL_BUFFER_POOL (pool);
+    GstVideoInfo info = self->info;
+    GstMemory *mem;
+    GstBuffer *buf;
+
+    mem = gst_vf_metal_memory_alloc (&info,
+        (__bridge VfMetalDevice *) self->device);
+    if (!mem)
+        return GST_FLOW_ERROR;
+
+    buf = gst_buffer_new ();
+    gst_buffer_append_memory (buf, mem);
+
+    /* Strides differ from the GStreamer defaults, so always describe them */
+    gst_buffer_add_video_meta_full (buf, GST_VIDEO_FRAME_FLAG_NONE,
+        GST_VIDEO_INFO_FORMAT (&info), GST_VIDEO_INFO_WIDTH (&info),
+        GST_VIDEO_INFO_HEIGHT (&info), GST_VIDEO_INFO_N_PLANES (&info),
+        info.offset, info.stride);
+
+    *buffer = buf;
+    return GST_FLOW_OK;
+}
+
+static void
+gst_vf_metal_buffer_pool_finalize (GObject *object)
+{
+    GstVfMetalBufferPool *self = GST_VF_METAL_BUFFER_POOL (object);
+
+    if (self->device) {
+        VfMetalDevice *device = (__bridge_transfer VfMetalDevice *) self->device;
+        self->device = NULL;
+        (void) device;
+    }
+
+    G_OBJECT_CLASS (gst_vf_metal_buffer_pool_parent_class)->finalize (object);
+}
+
+static void
+gst_vf_metal_buffer_pool_class_init (GstVfMetalBufferPoolClass *klass)
+{
+    GObjectClass *gobject_class = (GObjectClass *) klass;
+    GstBufferPoolClass *pool_class = (GstBufferPoolClass *) klass;
+
+    gobject_class->finalize = gst_vf_metal_buffer_pool_finalize;
+
+    pool_class->get_options = gst_vf_metal_buffer_pool_get_options;
+    pool_class->set_config = gst_vf_metal_buffer_pool_set_config;
+    pool_class->alloc_buffer = gst_vf_metal_buffer_pool_alloc_buffer;
+}
+
+static void
+gst_vf_metal_buffer_pool_init (GstVfMetalBufferPool *self)
+{
+    gst_video_info_init (&self->info);
+}
+
+GstBufferPool *
+gst_vf_metal_buffer_pool_new (VfMetalDevice *device)
+{
+    gst_vf_metal_memory_init_once ();
+
+    GstVfMetalBufferPool *pool =
+        g_object_new (GST_TYPE_VF_METAL_BUFFER_POOL, NULL);
+    gst_object_ref_sink (pool);
+    pool->device = (__bridge_retained void *)
+        (device ? device : [VfMetalDevice sharedDevice]);
+    return GST_BUFFER_POOL_CAST (pool);
+}
+
+/* --- Caps / allocation query helpers --- */
+
+gboolean
+gst_vf_metal_caps_has_memory_feature (GstCaps *caps)
+{
+    if (caps == NULL || gst_caps_is_empty (caps))
+        return FALSE;
+
+    return gst_caps_features_contains (gst_caps_get_features (caps, 0),
+        GST_CAPS_FEATURE_MEMORY_VF_METAL);
+}
+
+/* Configure @pool for @caps and return the size the pool settled on */
+static gboolean
+vf_metal_configure_pool (GstBufferPool *pool, GstCaps *caps,
+    guint min_buffers, guint max_buffers, guint *size)
+{
+    GstVideoInfo info;
+    GstStructure *config;
+
+    if (!gst_video_info_from_caps (&info, caps))
+        return FALSE;
+
+    config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_set_params (config, caps,
+        GST_VIDEO_INFO_SIZE (&info), min_buffers, max_buffers);
+    gst_buffer_pool_config_add_option (config,
+        GST_BUFFER_POOL_OPTION_VIDEO_META);
+    if (!gst_buffer_pool_set_config (pool, config))
+        return FALSE;
+
+    config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_get_params (config, NULL, size, NULL, NULL);
+    gst_structure_free (config);
+    return TRUE;
+}
+
+gboolean
+gst_vf_metal_memory_propose_allocation (GstQuery *query, VfMetalDevice *device)
+{
+    GstCaps *caps;
+    gboolean need_pool;
+    GstBufferPool *pool;
+    guint size;
+
+    gst_query_parse_allocation (query, &caps, &need_pool);
+
+    if (caps == NULL)
+        return FALSE;
+
+    if (need_pool) {
+        pool = gst_vf_metal_buffer_pool_new (device);
+        if (!vf_metal_configure_pool (pool, caps, 0, 0, &size)) {
+            gst_object_unref (pool);
+            return FALSE;
+        }
+        gst_query_add_allocation_pool (query, pool, size, 0, 0);
+        gst_object_unref (pool);
+    }
+
+    gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+
+    return TRUE;
+}
+
+gboolean
+gst_vf_metal_memory_decide_allocation (GstQuery *query, VfMetalDevice *device)
+{
+    GstCaps *caps;
+    GstBufferPool *pool = NULL;
+    guint size, min_buffers = 0, max_buffers = 0;
+    gboolean update_pool;
+
+    gst_query_parse_allocation (query, &caps, NULL);
+
+    /* System memory output keeps whatever downstream proposed */
+    if (!gst_vf_metal_caps_has_memory_feature (caps))
+        return TRUE;
+
+    update_pool = gst_query_get_n_allocation_pools (query) > 0;
+    if (update_pool) {
+        gst_query_parse_nth_allocation_pool (query, 0, &pool, &size,
+            &min_buffers, &max_buffers);
+        /* A pool on another GPU would make every frame a cross-device copy */
+        if (pool && GST_IS_VF_METAL_BUFFER_POOL (pool) &&
+            (__bridge VfMetalDevice *) GST_VF_METAL_BUFFER_POOL (pool)->device ==
+                (device ? device : [VfMetalDevice sharedDevice])) {
+            gst_object_unref (pool);
+            return TRUE;
+        }
+        if (pool)
+            gst_object_unref (pool);
+    }
+
+    pool = gst_vf_metal_buffer_pool_new (device);
+    if (!vf_metal_configure_pool (pool, caps, min_buffers, max_buffers,
+            &size)) {
+        gst_object_unref (pool);
+        return FALSE;
+    }
+
+    if (update_pool)
+        gst_query_set_nth_allocation_pool (query, 0, pool, size,
+            min_buffers, max_buffers);
+    else
+        gst_query_add_allocation_pool (query, pool, size, min_buffers,
+            max_buffers);
+    gst_object_unref (pool);
+
+    if (!gst_query_find_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL))
+        gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+
+    return TRUE;
+}
+
+/* --- GstBaseTransform glue --- */
+
+gboolean
+vf_metal_propose_allocation (GstBaseTransform * trans,
+    GstBaseTransformClass * parent_class, VfMetalDevice * device,
+    GstQuery * decide_query, GstQuery * query)
+{
+    GstCaps *caps;
+
+    gst_query_parse_allocation (query, &caps, NULL);
+
+    /* Not in passthrough and upstream negotiated GPU memory: hand it our
+     * pool */
+    if (decide_query && gst_vf_metal_caps_has_memory_feature (caps))
+        return gst_vf_metal_memory_propose_allocation (query, device);
+
+    return parent_class->propose_allocation (trans, decide_query, query);
+}
+
+gboolean
+vf_metal_decide_allocation (GstBaseTransform * trans,
+    GstBaseTransformClass * parent_class, VfMetalDevice * device,
+    VfMetalInflight * inflight, GstQuery * query)
+{
+    if (!gst_vf_metal_memory_decide_allocation (query, device))
+        return FALSE;
+
+    vf_metal_inflight_adjust_allocation (inflight, query);
+
+    return parent_class->decide_allocation (trans, query);
+}
+
+/* --- Texture access --- */
+
+id<MTLTexture>
+vf_metal_frame_peek_texture (GstVideoFrame *frame, guint plane,
+    id<MTLDevice> device)
+{
+    GstVfMetalMemory *mmem;
+    GstMemory *mem;
+
+    if (!frame->buffer || gst_buffer_n_memory (frame->buffer) != 1)
+        return nil;
+
+    mem = gst_buffer_peek_memory (frame->buffer, 0);
+    if (!gst_is_vf_metal_memory (mem) || mem->offset != 0)
+        return nil;
+
+    mmem = (GstVfMetalMemory *) mem;
+
+    /* The mapped frame must describe the layout the textures alias */
+    if (plane >= mmem->n_textures ||
+        ((__bridge VfMetalDevice *) mmem->device).device != device ||
+        GST_VIDEO_FRAME_PLANE_STRIDE (frame, plane) !=
+            GST_VIDEO_INFO_PLANE_STRIDE (&mmem->info, plane) ||
+        GST_VIDEO_FRAME_WIDTH (frame) != GST_VIDEO_INFO_WIDTH (&mmem->info) ||
+        GST_VIDEO_FRAME_HEIGHT (frame) != GST_VIDEO_INFO_HEIGHT (&mmem->info)) {
+        /* The caller falls back to the mapped bytes, which a GPU-access
+         * mapping has not copied out yet */
+        if (mmem->staged && (frame->map[0].flags & GST_MAP_READ))
+            vf_metal_mem_sync_to_cpu (mmem);
+        return nil;
+    }
+
+    return (__bridge id<MTLTexture>) mmem->textures[plane];
+}
+
+void
+vf_metal_frame_mark_gpu_written (GstVideoFrame *frame)
+{
+    GstMemory *mem;
+
+    if (!frame->buffer || gst_buffer_n_memory (frame->buffer) != 1)
+        return;
+
+    mem = gst_buffer_peek_memory (frame->buffer, 0);
+    if (gst_is_vf_metal_memory (mem))
+        ((GstVfMetalMemory *) mem)->gpu_written = TRUE;
+}
+
+void
+vf_metal_frame_sync_to_cpu (GstVideoFrame *frame)
+{
+    GstMemory *mem;
+
+    if (!frame->buffer || gst_buffer_n_memory (frame->buffer) != 1 ||
+        !(frame->map[0].flags & GST_MAP_READ))
+        return;
+
+    mem = gst_buffer_peek_memory (frame->buffer, 0);
+    if (gst_is_vf_metal_memory (mem) && ((GstVfMetalMemory *) mem)->staged)
+        vf_metal_mem_sync_to_cpu ((GstVfMetalMemory *) mem);
+}
@@ -0,0 +1,40 @@
+/* Precompiled Metal shader libraries
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __VF_METAL_METALLIB_H__
+#define __VF_METAL_METALLIB_H__
+
+#include <stddef.h>
+
+/* One .metallib compiled at build time from the same *_shaders.h sources
+ * the renderers concatenate at runtime. The table is generated by
+ * cmake/VfMetalEmbedMetallibs.cmake and only exists when the build defines
+ * VF_METAL_HAVE_METALLIB. */
+typedef struct {
+    const char *name;
+    const unsigned char *data;
+    size_t size;
+} VfMetalEmbeddedMetallib;
+
+/* Terminated by an entry with name == NULL */
+extern const VfMetalEmbeddedMetallib vf_metal_embedded_metallibs[];
+
+#endif /* __VF_METAL_METALLIB_H__ */
@@ -27,18 +27,37 @@
 /* Shared shader source containing:
  * - VertexOut struct
  * - Uniforms / ComputeUniforms structs
- * - BT.601 / BT.709 YUV<->RGB matrices
- * - yuvToRGB() helper function
+ * - BT.601 / BT.709 / BT.2020 Y'CbCr<->R'G'B' matrices (half precision)
+ * - yuvToRGB() / rgbToYUV() helpers, range and bit depth aware
  * - rgbaToNV12 / rgbaToI420 compute kernels
  *
  * Element-specific shaders should be concatenated after this source
  * before compilation. */
 extern NSString *const kVfMetalCommonShaderSource;
 
+/* Colour word passed in the colorMatrix uniform fields: a matrix index,
+ * optionally ORed with the range and sample-storage flags. Must match the
+ * VF_COLOR_* constants in the shader source. */
+typedef enum {
+    VF_METAL_COLOR_MATRIX_BT601  = 0,
+    VF_METAL_COLOR_MATRIX_BT709  = 1,
+    VF_METAL_COLOR_MATRIX_BT2020 = 2,
+    VF_METAL_COLOR_MATRIX_MASK   = 3,
+
+    /* 0..255 (or 0..1023) instead of 16..235 / 16..240 */
+    VF_METAL_COLOR_RANGE_FULL    = 1 << 2,
+
+    /* 10-bit samples in 16-bit texels: in the high bits (P010_10LE) or
+     * the low bits (I420_10LE); neither = 8-bit */
+    VF_METAL_COLOR_SAMPLES_MSB10 = 1 << 3,
+    VF_METAL_COLOR_SAMPLES_LSB10 = 2 << 3,
+    VF_METAL_COLOR_SAMPLES_MASK  = 3 << 3,
+} VfMetalColorFlags;
+
 /* Uniform struct matching shader Uniforms — used by host code */
 typedef struct {
     float alpha;
-    int32_t colorMatrix;    /* 0=BT.601, 1=BT.709 */
+    int32_t colorMatrix;    /* VfMetalColorFlags */
     float padding[2];
 } VfMetalUniforms;
 
@@ -32,50 +32,94 @@ struct VertexOut {
 
 struct Uniforms {
     float alpha;
-    int colorMatrix;    // 0=BT.601, 1=BT.709
+    int colorMatrix;    // colour word, VF_COLOR_* below
     float2 padding;
 };
 
-/* BT.601 limited range YUV->RGB matrix */
-constant float3 bt601_offset = float3(16.0/255.0, 128.0/255.0, 128.0/255.0);
-constant float3x3 bt601_matrix = float3x3(
-    float3(1.164383,  1.164383, 1.164383),
-    float3(0.0,      -0.391762, 2.017232),
-    float3(1.596027, -0.812968, 0.0)
-);
-
-/* BT.709 limited range YUV->RGB matrix */
-constant float3 bt709_offset = float3(16.0/255.0, 128.0/255.0, 128.0/255.0);
-constant float3x3 bt709_matrix = float3x3(
-    float3(1.164383,  1.164383, 1.164383),
-    float3(0.0,      -0.213249, 2.112402),
-    float3(1.792741, -0.532909, 0.0)
-);
-
-/* BT.601 limited range RGB->YUV matrix (columns = R, G, B coefficient vectors) */
-constant float3 bt601_rgb_offset = float3(16.0/255.0, 128.0/255.0, 128.0/255.0);
-constant float3x3 bt601_rgb_matrix = float3x3(
-    float3( 0.256788, -0.148223,  0.439216),
-    float3( 0.504129, -0.290993, -0.367788),
-    float3( 0.097906,  0.439216, -0.071427)
-);
-
-/* BT.709 limited range RGB->YUV matrix (columns = R, G, B coefficient vectors) */
-constant float3 bt709_rgb_offset = float3(16.0/255.0, 128.0/255.0, 128.0/255.0);
-constant float3x3 bt709_rgb_matrix = float3x3(
-    float3( 0.182586, -0.100644,  0.439216),
-    float3( 0.614231, -0.338572, -0.398942),
-    float3( 0.062007,  0.439216, -0.040274)
-);
+/* Colour word carried in the colorMatrix uniforms (see VfMetalColorFlags):
+ * bits 0-1 matrix (0=BT.601, 1=BT.709, 2=BT.2020), bit 2 full range,
+ * bits 3-4 sample storage (0 = 8-bit, MSB10 = 10 bits in the high bits
+ * of 16 as in P010, LSB10 = 10 bits in the low bits as in I420_10LE) */
+constant int VF_COLOR_MATRIX_MASK   = 3;
+constant int VF_COLOR_RANGE_FULL    = 4;
+constant int VF_COLOR_SAMPLES_MSB10 = 8;
+constant int VF_COLOR_SAMPLES_LSB10 = 16;
+constant int VF_COLOR_SAMPLES_MASK  = 24;
+
+/* Y'CbCr -> R'G'B' for Y' in [0,1], Cb/Cr in [-0.5,0.5]
+ * (columns = Y, Cb, Cr coefficient vectors): BT.601, BT.709, BT.2020 */
+constant half3x3 vf_ycbcr_to_rgb[3] = {
+    half3x3(half3(1.0h, 1.0h, 1.0h),
+            half3(0.0h, -0.344136h, 1.772000h),
+            half3(1.402000h, -0.714136h, 0.0h)),
+    half3x3(half3(1.0h, 1.0h, 1.0h),
+            half3(0.0h, -0.187324h, 1.855600h),
+            half3(1.574800h, -0.468124h, 0.0h)),
+    half3x3(half3(1.0h, 1.0h, 1.0h),
+            half3(0.0h, -0.164553h, 1.881400h),
+            half3(1.474600h, -0.571353h, 0.0h)),
+};
+
+/* R'G'B' -> Y'CbCr (columns = R, G, B coefficient vectors) */
+constant half3x3 vf_rgb_to_ycbcr[3] = {
+    half3x3(half3(0.299000h, -0.168736h, 0.500000h),
+            half3(0.587000h, -0.331264h, -0.418688h),
+            half3(0.114000h, 0.500000h, -0.081312h)),
+    half3x3(half3(0.212600h, -0.114572h, 0.500000h),
+            half3(0.715200h, -0.385428h, -0.454153h),
+            half3(0.072200h, 0.500000h, -0.045847h)),
+    half3x3(half3(0.262700h, -0.139630h, 0.500000h),
+            half3(0.678000h, -0.360370h, -0.459786h),
+            half3(0.059300h, 0.500000h, -0.040214h)),
+};
+
+/* Normalised texel value -> integer code at the stored bit depth */
+static inline float vfSampleToCode(int colorMatrix) {
+    switch (colorMatrix & VF_COLOR_SAMPLES_MASK) {
+        case VF_COLOR_SAMPLES_MSB10: return 65535.0 / 64.0;
+        case VF_COLOR_SAMPLES_LSB10: return 65535.0;
+        default:                     return 255.0;
+    }
+}
+
+/* Code of black / neutral chroma, and the nominal code excursion */
+static inline void vfCodeRange(int colorMatrix, thread float3 &offset,
+                               thread float3 &excursion) {
+    float unit = (colorMatrix & VF_COLOR_SAMPLES_MASK) ? 4.0 : 1.0;
+    if (colorMatrix & VF_COLOR_RANGE_FULL) {
+        offset = float3(0.0, 128.0, 128.0) * unit;
+        excursion = float3(256.0 * unit - 1.0);
+    } else {
+        offset = float3(16.0, 128.0, 128.0) * unit;
+        excursion = float3(219.0, 224.0, 224.0) * unit;
+    }
+}
 
+/* Stored Y'CbCr samples -> R'G'B'. Range normalisation is one float fma
+ * (10-bit codes need it); the matrix runs in half. */
 static inline float3 yuvToRGB(float y, float cb, float cr, int colorMatrix) {
-    float3 yuv = (colorMatrix == 1)
-        ? float3(y, cb, cr) - bt709_offset
-        : float3(y, cb, cr) - bt601_offset;
-    float3 rgb = (colorMatrix == 1)
-        ? bt709_matrix * yuv
-        : bt601_matrix * yuv;
-    return clamp(rgb, 0.0, 1.0);
+    float3 offset, excursion;
+    vfCodeRange(colorMatrix, offset, excursion);
+    float3 gain = vfSampleToCode(colorMatrix) / excursion;
+    half3 ycc = half3(fma(float3(y, cb, cr), gain, -offset / excursion));
+    half3 rgb = vf_ycbcr_to_rgb[colorMatrix & VF_COLOR_MATRIX_MASK] * ycc;
+    return float3(clamp(rgb, 0.0h, 1.0h));
+}
+
+/* R'G'B' -> Y'CbCr samples ready to write to the plane textures */
+static inline float3 rgbToYUV(float3 rgb, int colorMatrix) {
+    float3 offset, excursion;
+    vfCodeRange(colorMatrix, offset, excursion);
+    half3 ycc = vf_rgb_to_ycbcr[colorMatrix & VF_COLOR_MATRIX_MASK] *
+        half3(rgb);
+    float3 code = fma(float3(ycc), excursion, offset);
+    if (colorMatrix & VF_COLOR_SAMPLES_MASK) {
+        /* Whole codes, so P010's low padding bits stay clear */
+        code = clamp(round(code), 0.0, 1023.0);
+    } else {
+        code = clamp(code, 0.0, 255.0);
+    }
+    return code / vfSampleToCode(colorMatrix);
 }
 
 // --- Compute shaders for RGB->YUV output conversion ---
@@ -83,7 +127,7 @@ static inline float3 yuvToRGB(float y, float cb, float cr, int colorMatrix) {
 struct ComputeUniforms {
     uint width;
     uint height;
-    int colorMatrix;    // 0=BT.601, 1=BT.709
+    int colorMatrix;    // colour word of the output, VF_COLOR_*
     uint padding;
 };
 
@@ -94,14 +138,10 @@ kernel void rgbaToNV12(
     constant ComputeUniforms &uniforms [[buffer(0)]],
     uint2 gid [[thread_position_in_grid]]
 ) {
-    float3x3 mat = (uniforms.colorMatrix == 1) ? bt709_rgb_matrix : bt601_rgb_matrix;
-    float3 off = (uniforms.colorMatrix == 1) ? bt709_rgb_offset : bt601_rgb_offset;
-
     // Write Y for every pixel
     if (gid.x < uniforms.width && gid.y < uniforms.height) {
-        float4 rgba = rgbaTex.read(gid);
-        float3 yuv = mat * rgba.rgb + off;
-        yTex.write(float4(clamp(yuv.r, 0.0, 1.0), 0, 0, 1), gid);
+        float3 yuv = rgbToYUV(rgbaTex.read(gid).rgb, uniforms.colorMatrix);
+        yTex.write(float4(yuv.r, 0, 0, 1), gid);
     }
 
     // Write UV at half resolution (one UV pair per 2x2 block)
@@ -119,10 +159,8 @@ kernel void rgbaToNV12(
                     sum += rgba.rgb;
                 }
             }
-            sum *= 0.25;
-            float3 yuv = mat * sum + off;
-            uvTex.write(float4(clamp(yuv.g, 0.0, 1.0),
-                               clamp(yuv.b, 0.0, 1.0), 0, 1), uvPos);
+            float3 yuv = rgbToYUV(sum * 0.25, uniforms.colorMatrix);
+            uvTex.write(float4(yuv.g, yuv.b, 0, 1), uvPos);
         }
     }
 }
@@ -135,14 +173,10 @@ kernel void rgbaToI420(
     constant ComputeUniforms &uniforms [[buffer(0)]],
     uint2 gid [[thread_position_in_grid]]
 ) {
-    float3x3 mat = (uniforms.colorMatrix == 1) ? bt709_rgb_matrix : bt601_rgb_matrix;
-    float3 off = (uniforms.colorMatrix == 1) ? bt709_rgb_offset : bt601_rgb_offset;
-
     // Write Y for every pixel
     if (gid.x < uniforms.width && gid.y < uniforms.height) {
-        float4 rgba = rgbaTex.read(gid);
-        float3 yuv = mat * rgba.rgb + off;
-        yTex.write(float4(clamp(yuv.r, 0.0, 1.0), 0, 0, 1), gid);
+        float3 yuv = rgbToYUV(rgbaTex.read(gid).rgb, uniforms.colorMatrix);
+        yTex.write(float4(yuv.r, 0, 0, 1), gid);
     }
 
     // Write U and V at half resolution
@@ -159,10 +193,9 @@ kernel void rgbaToI420(
                     sum += rgba.rgb;
                 }
             }
-            sum *= 0.25;
-            float3 yuv = mat * sum + off;
-            uTex.write(float4(clamp(yuv.g, 0.0, 1.0), 0, 0, 1), uvPos);
-            vTex.write(float4(clamp(yuv.b, 0.0, 1.0), 0, 0, 1), uvPos);
+            float3 yuv = rgbToYUV(sum * 0.25, uniforms.colorMatrix);
+            uTex.write(float4(yuv.g, 0, 0, 1), uvPos);
+            vTex.write(float4(yuv.b, 0, 0, 1), uvPos);
         }
     }
 }
@@ -0,0 +1,112 @@
+/* Rolling timing statistics for VisioForge Metal elements
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef __VF_METAL_STATS_H__
+#define __VF_METAL_STATS_H__
+
+#import <Foundation/Foundation.h>
+#import <Metal/Metal.h>
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Samples kept per stage; averages and p99 cover the last this many */
+#define VF_METAL_STATS_WINDOW   128
+
+/* Range and default of the "stats-interval" property, in milliseconds.
+ * 0 posts no messages; the "stats" property is always available. */
+#define VF_METAL_STATS_MAX_INTERVAL     60000
+#define VF_METAL_STATS_DEFAULT_INTERVAL 0
+
+typedef enum
+{
+  VF_METAL_STATS_UPLOAD = 0,    /* CPU copy of system-memory inputs */
+  VF_METAL_STATS_ENCODE,        /* CPU command encoding up to commit */
+  VF_METAL_STATS_GPU,           /* GPUStartTime to GPUEndTime */
+  VF_METAL_STATS_READBACK,      /* CPU copy of the result into the frame */
+  VF_METAL_STATS_N_STAGES
+} VfMetalStatsStage;
+
+/**
+ * VfMetalStats:
+ *
+ * Per-element ring of stage durations plus frame counters, embedded in
+ * the element. Renderers add samples from the streaming thread and from
+ * Metal completion handlers; readers take a snapshot structure.
+ */
+typedef struct
+{
+  GMutex lock;
+  gdouble samples[VF_METAL_STATS_N_STAGES][VF_METAL_STATS_WINDOW];  /* ms */
+  guint n_samples[VF_METAL_STATS_N_STAGES];
+  guint next[VF_METAL_STATS_N_STAGES];
+
+  guint64 frames;
+  guint64 dropped;
+  GstClockTime next_pts;    /* expected PTS of the next output frame */
+
+  gint64 last_post;         /* monotonic time of the last message, us */
+} VfMetalStats;
+
+void vf_metal_stats_init (VfMetalStats * stats);
+void vf_metal_stats_clear (VfMetalStats * stats);
+
+/* Forget all samples and counters, e.g. on start or flush */
+void vf_metal_stats_reset (VfMetalStats * stats);
+
+/* Monotonic timestamp for vf_metal_stats_add_since(), in microseconds */
+gint64 vf_metal_stats_now (void);
+
+void vf_metal_stats_add (VfMetalStats * stats, VfMetalStatsStage stage,
+    gdouble ms);
+void vf_metal_stats_add_since (VfMetalStats * stats, VfMetalStatsStage stage,
+    gint64 start);
+
+/* Count an output buffer. A PTS past the end of the previous one means
+ * frames were skipped in between (QoS, late inputs) and counts those as
+ * dropped; @failed counts this frame itself as dropped. */
+void vf_metal_stats_add_frame (VfMetalStats * stats, GstBuffer * buffer,
+    gboolean failed);
+
+/* Snapshot: "frames", "dropped", and per stage "<stage>-avg" and
+ * "<stage>-p99" in milliseconds. Free with gst_structure_free(). */
+GstStructure *vf_metal_stats_get_structure (VfMetalStats * stats);
+
+/* Post the snapshot as a "vfmetal-stats" element message once
+ * @interval_ms has passed since the last one; 0 disables */
+void vf_metal_stats_post (VfMetalStats * stats, GstElement * element,
+    guint interval_ms);
+
+G_END_DECLS
+
+/* Record the GPU execution time of a completed @commandBuffer */
+void vf_metal_stats_add_gpu_time (VfMetalStats * stats,
+    id<MTLCommandBuffer> commandBuffer);
+
+/* Same from a completed handler, for buffers committed without waiting.
+ * Call before adding the handler that finishes the frame, so the sample
+ * is in before the element can tear @stats down. */
+void vf_metal_stats_track_command_buffer (VfMetalStats * stats,
+    id<MTLCommandBuffer> commandBuffer);
+
+#endif /* __VF_METAL_STATS_H__ */
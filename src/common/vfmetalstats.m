@@ -0,0 +1,196 @@
+/* Rolling timing statistics for VisioForge Metal elements
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#import "vfmetalstats.h"
+
+#include <stdlib.h>
+
+static const gchar *stage_names[VF_METAL_STATS_N_STAGES] = {
+    "upload", "encode", "gpu", "readback"
+};
+
+void
+vf_metal_stats_init (VfMetalStats * stats)
+{
+    g_mutex_init (&stats->lock);
+    vf_metal_stats_reset (stats);
+}
+
+void
+vf_metal_stats_clear (VfMetalStats * stats)
+{
+    g_mutex_clear (&stats->lock);
+}
+
+void
+vf_metal_stats_reset (VfMetalStats * stats)
+{
+    g_mutex_lock (&stats->lock);
+    for (int s = 0; s < VF_METAL_STATS_N_STAGES; s++) {
+        stats->n_samples[s] = 0;
+        stats->next[s] = 0;
+    }
+    stats->frames = 0;
+    stats->dropped = 0;
+    stats->next_pts = GST_CLOCK_TIME_NONE;
+    stats->last_post = 0;
+    g_mutex_unlock (&stats->lock);
+}
+
+gint64
+vf_metal_stats_now (void)
+{
+    return g_get_monotonic_time ();
+}
+
+void
+vf_metal_stats_add (VfMetalStats * stats, VfMetalStatsStage stage, gdouble ms)
+{
+    g_mutex_lock (&stats->lock);
+    stats->samples[stage][stats->next[stage]] = ms;
+    stats->next[stage] = (stats->next[stage] + 1) % VF_METAL_STATS_WINDOW;
+    if (stats->n_samples[stage] < VF_METAL_STATS_WINDOW)
+        stats->n_samples[stage]++;
+    g_mutex_unlock (&stats->lock);
+}
+
+void
+vf_metal_stats_add_since (VfMetalStats * stats, VfMetalStatsStage stage,
+    gint64 start)
+{
+    vf_metal_stats_add (stats, stage,
+        (vf_metal_stats_now () - start) / 1000.0);
+}
+
+void
+vf_metal_stats_add_frame (VfMetalStats * stats, GstBuffer * buffer,
+    gboolean failed)
+{
+    GstClockTime pts = GST_BUFFER_PTS (buffer);
+    GstClockTime duration = GST_BUFFER_DURATION (buffer);
+
+    g_mutex_lock (&stats->lock);
+    stats->frames++;
+    if (failed)
+        stats->dropped++;
+
+    if (GST_CLOCK_TIME_IS_VALID (pts) && GST_CLOCK_TIME_IS_VALID (duration) &&
+        duration > 0) {
+        /* Half a frame of slack absorbs rounding of the timestamps */
+        if (GST_CLOCK_TIME_IS_VALID (stats->next_pts) &&
+            pts > stats->next_pts + duration / 2)
+            stats->dropped += (pts - stats->next_pts + duration / 2) / duration;
+        stats->next_pts = pts + duration;
+    } else {
+        stats->next_pts = GST_CLOCK_TIME_NONE;
+    }
+    g_mutex_unlock (&stats->lock);
+}
+
+static int
+compare_samples (const void *a, const void *b)
+{
+    gdouble da = *(const gdouble *) a, db = *(const gdouble *) b;
+    return (da > db) - (da < db);
+}
+
+GstStructure *
+vf_metal_stats_get_structure (VfMetalStats * stats)
+{
+    GstStructure *s = gst_structure_new_empty ("vfmetal-stats");
+    gdouble sorted[VF_METAL_STATS_WINDOW];
+
+    g_mutex_lock (&stats->lock);
+    gst_structure_set (s,
+        "frames", G_TYPE_UINT64, stats->frames,
+        "dropped", G_TYPE_UINT64, stats->dropped, NULL);
+
+    for (int stage = 0; stage < VF_METAL_STATS_N_STAGES; stage++) {
+        guint n = stats->n_samples[stage];
+        gdouble sum = 0.0, avg = 0.0, p99 = 0.0;
+
+        if (n > 0) {
+            memcpy (sorted, stats->samples[stage], n * sizeof (gdouble));
+            qsort (sorted, n, sizeof (gdouble), compare_samples);
+            for (guint i = 0; i < n; i++)
+                sum += sorted[i];
+            avg = sum / n;
+            /* Nearest rank */
+            p99 = sorted[MIN (n - 1, (n * 99 + 99) / 100 - 1)];
+        }
+
+        gchar *avg_name = g_strdup_printf ("%s-avg", stage_names[stage]);
+        gchar *p99_name = g_strdup_printf ("%s-p99", stage_names[stage]);
+        gst_structure_set (s,
+            avg_name, G_TYPE_DOUBLE, avg,
+            p99_name, G_TYPE_DOUBLE, p99, NULL);
+        g_free (avg_name);
+        g_free (p99_name);
+    }
+    g_mutex_unlock (&stats->lock);
+
+    return s;
+}
+
+void
+vf_metal_stats_post (VfMetalStats * stats, GstElement * element,
+    guint interval_ms)
+{
+    gint64 now;
+
+    if (interval_ms == 0)
+        return;
+
+    now = vf_metal_stats_now ();
+    g_mutex_lock (&stats->lock);
+    if (stats->last_post != 0 &&
+        now - stats->last_post < (gint64) interval_ms * 1000) {
+        g_mutex_unlock (&stats->lock);
+        return;
+    }
+    stats->last_post = now;
+    g_mutex_unlock (&stats->lock);
+
+    gst_element_post_message (element,
+        gst_message_new_element (GST_OBJECT (element),
+            vf_metal_stats_get_structure (stats)));
+}
+
+void
+vf_metal_stats_add_gpu_time (VfMetalStats * stats,
+    id<MTLCommandBuffer> commandBuffer)
+{
+    /* Both times are 0 when the GPU never ran the buffer */
+    if (commandBuffer.status == MTLCommandBufferStatusCompleted &&
+        commandBuffer.GPUEndTime > commandBuffer.GPUStartTime)
+        vf_metal_stats_add (stats, VF_METAL_STATS_GPU,
+            (commandBuffer.GPUEndTime - commandBuffer.GPUStartTime) * 1000.0);
+}
+
+void
+vf_metal_stats_track_command_buffer (VfMetalStats * stats,
+    id<MTLCommandBuffer> commandBuffer)
+{
+    [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> cb) {
+        vf_metal_stats_add_gpu_time (stats, cb);
+    }];
+}
@@ -24,9 +24,12 @@
 
 #import <Foundation/Foundation.h>
 #import <Metal/Metal.h>
+#import <CoreVideo/CoreVideo.h>
 #import <gst/video/video.h>
 
-/* Input format index for pipeline selection */
+/* Input format index for pipeline selection. P010_10LE and I420_10LE
+ * share the NV12 / I420 pipelines: their planes are bound as 16-bit
+ * textures and the colour word tells the shaders how to read them. */
 typedef enum {
     VF_METAL_INPUT_RGBA  = 0,
     VF_METAL_INPUT_NV12  = 1,
@@ -37,24 +40,69 @@ typedef enum {
 /* Classify a GstVideoFormat into input format index */
 VfMetalInputFormat vf_metal_input_format_index (GstVideoFormat format);
 
-/* Determine color matrix index (0=BT.601, 1=BT.709) from a GstVideoFrame */
+/* Colour word (VfMetalColorFlags) for the frame's matrix, range and
+ * sample storage: what the shaders' colorMatrix uniforms expect */
 int vf_metal_color_matrix_for_frame (GstVideoFrame *frame);
+int vf_metal_color_matrix_for_info (const GstVideoInfo *info);
 
-/* Texture cache — avoids per-frame allocation for input textures */
+/* Texture format of one plane of @format as the shaders sample it, or
+ * MTLPixelFormatInvalid when the format has no such plane */
+MTLPixelFormat vf_metal_plane_pixel_format (GstVideoFormat format,
+    guint plane);
+
+/* Planar 4:2:0 layouts the shared pipelines read and write: NV12 and
+ * I420, and their 10-bit counterparts */
+gboolean vf_metal_format_is_planar_yuv (GstVideoFormat format);
+
+/* Formats stored at more than 8 bits per sample */
+gboolean vf_metal_format_is_deep (GstVideoFormat format);
+
+/* IOSurface-backed CVPixelBuffer carried by a frame from vtdec/avfvideosrc
+ * (GstCoreVideoMeta / GstCoreMediaMeta), or NULL for plain system memory */
+CVPixelBufferRef vf_metal_frame_get_pixel_buffer (GstVideoFrame *frame);
+
+/* Copy one plane of a system-memory frame into @texture. Safe to call
+ * concurrently for distinct textures. */
+void vf_metal_texture_upload_plane (id<MTLTexture> texture,
+    GstVideoFrame *frame, int planeIndex);
+
+/* Texture cache — avoids per-frame allocation for input textures.
+ * CoreVideo-backed frames are wrapped through CVMetalTextureCache without
+ * a copy; only plain system memory goes through replaceRegion. */
 @interface VfMetalTextureCache : NSObject
 
+/* Element the plane copies are traced for (see vfmetaltrace.h) */
+@property (nonatomic, assign) GstObject *traceOwner;
+
 - (instancetype)initWithDevice:(id<MTLDevice>)device;
 
 /* Reset the frame index at the start of each frame */
 - (void)resetFrameIndex;
 
-/* Upload a plane from a GstVideoFrame into a cached Metal texture */
+/* Same, selecting the texture set of an in-flight ring slot so the CPU
+ * never overwrites a texture the GPU may still be reading. Slot 0 is the
+ * set used by -resetFrameIndex. */
+- (void)resetFrameIndexForSlot:(NSUInteger)slot;
+
+/* Upload a plane from a GstVideoFrame into a cached Metal texture.
+ * Frames backed by VfMetalMemory return their own plane texture instead. */
 - (id<MTLTexture>)uploadPlane:(GstVideoFrame *)frame
                         plane:(int)planeIndex
                        format:(MTLPixelFormat)pixelFormat
                         width:(int)planeWidth
                        height:(int)planeHeight;
 
+/* Same as -uploadPlane:..., but leaves the copy of system memory to the
+ * caller: *needsUpload is set when the returned texture still has to be
+ * filled from the plane (see vf_metal_texture_upload_plane), which lets
+ * the copies of several planes run concurrently. */
+- (id<MTLTexture>)texturePlane:(GstVideoFrame *)frame
+                         plane:(int)planeIndex
+                        format:(MTLPixelFormat)pixelFormat
+                         width:(int)planeWidth
+                        height:(int)planeHeight
+                   needsUpload:(BOOL *)needsUpload;
+
 /* Clear all cached textures */
 - (void)clear;
 
@@ -21,29 +21,196 @@
 
 #import "vfmetaltextureutil.h"
 #import "vfmetaldevice.h"
+#import "vfmetalmemory.h"
+#import "vfmetaltrace.h"
+#import "vfmetalshaders.h"
+
+#define GST_CAT_DEFAULT gst_vf_metal_debug
 
 VfMetalInputFormat
 vf_metal_input_format_index (GstVideoFormat format)
 {
     switch (format) {
-        case GST_VIDEO_FORMAT_NV12: return VF_METAL_INPUT_NV12;
-        case GST_VIDEO_FORMAT_I420: return VF_METAL_INPUT_I420;
-        default: return VF_METAL_INPUT_RGBA;
+        case GST_VIDEO_FORMAT_NV12:
+        case GST_VIDEO_FORMAT_P010_10LE:
+            return VF_METAL_INPUT_NV12;
+        case GST_VIDEO_FORMAT_I420:
+        case GST_VIDEO_FORMAT_I420_10LE:
+            return VF_METAL_INPUT_I420;
+        default:
+            return VF_METAL_INPUT_RGBA;
     }
 }
 
+int
+vf_metal_color_matrix_for_info (const GstVideoInfo *info)
+{
+    const GstVideoColorimetry *cinfo = &GST_VIDEO_INFO_COLORIMETRY (info);
+    int word;
+
+    switch (cinfo->matrix) {
+        case GST_VIDEO_COLOR_MATRIX_BT709:
+            word = VF_METAL_COLOR_MATRIX_BT709;
+            break;
+        case GST_VIDEO_COLOR_MATRIX_BT2020:
+            word = VF_METAL_COLOR_MATRIX_BT2020;
+            break;
+        default:
+            word = VF_METAL_COLOR_MATRIX_BT601;
+            break;
+    }
+
+    /* RGB frames never go through the matrix; keep their word plain */
+    if (!GST_VIDEO_INFO_IS_YUV (info))
+        return word;
+
+    if (cinfo->range == GST_VIDEO_COLOR_RANGE_0_255)
+        word |= VF_METAL_COLOR_RANGE_FULL;
+
+    switch (GST_VIDEO_INFO_FORMAT (info)) {
+        case GST_VIDEO_FORMAT_P010_10LE:
+            word |= VF_METAL_COLOR_SAMPLES_MSB10;
+            break;
+        case GST_VIDEO_FORMAT_I420_10LE:
+            word |= VF_METAL_COLOR_SAMPLES_LSB10;
+            break;
+        default:
+            break;
+    }
+
+    return word;
+}
+
 int
 vf_metal_color_matrix_for_frame (GstVideoFrame *frame)
 {
-    GstVideoColorMatrix matrix =
-        GST_VIDEO_INFO_COLORIMETRY (&frame->info).matrix;
-    return (matrix == GST_VIDEO_COLOR_MATRIX_BT709) ? 1 : 0;
+    return vf_metal_color_matrix_for_info (&frame->info);
+}
+
+MTLPixelFormat
+vf_metal_plane_pixel_format (GstVideoFormat format, guint plane)
+{
+    switch (format) {
+        case GST_VIDEO_FORMAT_BGRA:
+            return plane == 0 ? MTLPixelFormatBGRA8Unorm : MTLPixelFormatInvalid;
+        case GST_VIDEO_FORMAT_RGBA:
+            return plane == 0 ? MTLPixelFormatRGBA8Unorm : MTLPixelFormatInvalid;
+        case GST_VIDEO_FORMAT_NV12:
+            return plane == 0 ? MTLPixelFormatR8Unorm :
+                   plane == 1 ? MTLPixelFormatRG8Unorm : MTLPixelFormatInvalid;
+        case GST_VIDEO_FORMAT_P010_10LE:
+            return plane == 0 ? MTLPixelFormatR16Unorm :
+                   plane == 1 ? MTLPixelFormatRG16Unorm : MTLPixelFormatInvalid;
+        case GST_VIDEO_FORMAT_I420:
+            return plane < 3 ? MTLPixelFormatR8Unorm : MTLPixelFormatInvalid;
+        case GST_VIDEO_FORMAT_I420_10LE:
+            return plane < 3 ? MTLPixelFormatR16Unorm : MTLPixelFormatInvalid;
+        default:
+            return MTLPixelFormatInvalid;
+    }
+}
+
+gboolean
+vf_metal_format_is_planar_yuv (GstVideoFormat format)
+{
+    return vf_metal_input_format_index (format) != VF_METAL_INPUT_RGBA;
+}
+
+gboolean
+vf_metal_format_is_deep (GstVideoFormat format)
+{
+    return format == GST_VIDEO_FORMAT_P010_10LE ||
+        format == GST_VIDEO_FORMAT_I420_10LE;
+}
+
+/* --- CoreVideo-backed input --- */
+
+/* The applemedia metas are not installed as public headers; look them up by
+ * API name and mirror only the leading fields, which have been stable. */
+typedef struct {
+    GstMeta meta;
+    CVBufferRef cvbuf;
+    CVPixelBufferRef pixbuf;
+} VfCoreVideoMeta;
+
+typedef struct {
+    GstMeta meta;
+    void *sample_buf;
+    CVImageBufferRef image_buf;
+} VfCoreMediaMeta;
+
+static GType
+vf_metal_lookup_meta_api (const gchar *name, GType *cached)
+{
+    /* 0 until applemedia registers it; retry until then */
+    if (*cached == 0)
+        *cached = g_type_from_name (name);
+    return *cached;
+}
+
+CVPixelBufferRef
+vf_metal_frame_get_pixel_buffer (GstVideoFrame *frame)
+{
+    static GType coreVideoApi = 0;
+    static GType coreMediaApi = 0;
+    CVImageBufferRef image = NULL;
+    GType api;
+
+    if (!frame->buffer)
+        return NULL;
+
+    api = vf_metal_lookup_meta_api ("GstCoreVideoMetaAPI", &coreVideoApi);
+    if (api) {
+        VfCoreVideoMeta *meta =
+            (VfCoreVideoMeta *) gst_buffer_get_meta (frame->buffer, api);
+        if (meta)
+            image = meta->pixbuf ? meta->pixbuf : meta->cvbuf;
+    }
+
+    if (!image) {
+        api = vf_metal_lookup_meta_api ("GstCoreMediaMetaAPI", &coreMediaApi);
+        if (api) {
+            VfCoreMediaMeta *meta =
+                (VfCoreMediaMeta *) gst_buffer_get_meta (frame->buffer, api);
+            if (meta)
+                image = meta->image_buf;
+        }
+    }
+
+    if (!image || CFGetTypeID (image) != CVPixelBufferGetTypeID ())
+        return NULL;
+
+    /* Only IOSurface-backed buffers can be aliased by Metal */
+    if (!CVPixelBufferGetIOSurface ((CVPixelBufferRef) image))
+        return NULL;
+
+    return (CVPixelBufferRef) image;
+}
+
+void
+vf_metal_texture_upload_plane (id<MTLTexture> texture, GstVideoFrame *frame,
+    int planeIndex)
+{
+    [texture replaceRegion:MTLRegionMake2D(0, 0, texture.width, texture.height)
+               mipmapLevel:0
+                 withBytes:GST_VIDEO_FRAME_PLANE_DATA (frame, planeIndex)
+               bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (frame, planeIndex)];
 }
 
 @implementation VfMetalTextureCache {
     id<MTLDevice> _device;
     NSMutableArray<id<MTLTexture>> *_cache;
     int _cacheIndex;
+
+    /* Zero-copy wrappers for CoreVideo input; the CVMetalTexture objects
+     * must outlive the GPU work of the frame that uses them */
+    CVMetalTextureCacheRef _cvTextureCache;
+    NSMutableArray *_cvTextures;
+
+    /* One texture set per in-flight slot; _cache/_cvTextures point at the
+     * slot selected by the last reset */
+    NSMutableArray<NSMutableArray<id<MTLTexture>> *> *_slotCaches;
+    NSMutableArray<NSMutableArray *> *_slotCVTextures;
 }
 
 - (instancetype)initWithDevice:(id<MTLDevice>)device
@@ -53,12 +220,73 @@ vf_metal_color_matrix_for_frame (GstVideoFrame *frame)
     _device = device;
     _cache = [NSMutableArray array];
     _cacheIndex = 0;
+    _cvTextures = [NSMutableArray array];
+    _slotCaches = [NSMutableArray arrayWithObject:_cache];
+    _slotCVTextures = [NSMutableArray arrayWithObject:_cvTextures];
+
+    if (CVMetalTextureCacheCreate (kCFAllocatorDefault, NULL, device, NULL,
+            &_cvTextureCache) != kCVReturnSuccess) {
+        GST_WARNING ("VfMetalTextureCache: CVMetalTextureCache unavailable, "
+            "CoreVideo input will be copied");
+        _cvTextureCache = NULL;
+    }
     return self;
 }
 
+- (void)dealloc
+{
+    [_slotCVTextures removeAllObjects];
+    if (_cvTextureCache)
+        CFRelease (_cvTextureCache);
+}
+
 - (void)resetFrameIndex
 {
+    [self resetFrameIndexForSlot:0];
+}
+
+- (void)resetFrameIndexForSlot:(NSUInteger)slot
+{
+    while (_slotCaches.count <= slot) {
+        [_slotCaches addObject:[NSMutableArray array]];
+        [_slotCVTextures addObject:[NSMutableArray array]];
+    }
+
+    _cache = _slotCaches[slot];
+    _cvTextures = _slotCVTextures[slot];
     _cacheIndex = 0;
+
+    /* The frame that last used this slot has completed by now */
+    [_cvTextures removeAllObjects];
+    if (_cvTextureCache)
+        CVMetalTextureCacheFlush (_cvTextureCache, 0);
+}
+
+- (id<MTLTexture>)_wrapPixelBuffer:(CVPixelBufferRef)pixelBuffer
+                             plane:(int)planeIndex
+                            format:(MTLPixelFormat)pixelFormat
+                             width:(int)planeWidth
+                            height:(int)planeHeight
+{
+    CVMetalTextureRef cvTexture = NULL;
+    size_t planeCount = CVPixelBufferGetPlaneCount (pixelBuffer);
+
+    if (planeCount == 0 ? planeIndex != 0 : planeIndex >= (int)planeCount)
+        return nil;
+
+    CVReturn ret = CVMetalTextureCacheCreateTextureFromImage (
+        kCFAllocatorDefault, _cvTextureCache, pixelBuffer, NULL,
+        pixelFormat, planeWidth, planeHeight,
+        planeCount == 0 ? 0 : planeIndex, &cvTexture);
+    if (ret != kCVReturnSuccess || !cvTexture) {
+        GST_LOG ("VfMetalTextureCache: cannot wrap plane %d (CVReturn %d), "
+            "copying", planeIndex, ret);
+        return nil;
+    }
+
+    id<MTLTexture> texture = CVMetalTextureGetTexture (cvTexture);
+    [_cvTextures addObject:(__bridge_transfer id)cvTexture];
+    return texture;
 }
 
 - (id<MTLTexture>)uploadPlane:(GstVideoFrame *)frame
@@ -66,9 +294,56 @@ vf_metal_color_matrix_for_frame (GstVideoFrame *frame)
                        format:(MTLPixelFormat)pixelFormat
                         width:(int)planeWidth
                        height:(int)planeHeight
+{
+    BOOL needsUpload = NO;
+    id<MTLTexture> texture = [self texturePlane:frame plane:planeIndex
+                                         format:pixelFormat
+                                          width:planeWidth
+                                         height:planeHeight
+                                    needsUpload:&needsUpload];
+    if (texture && needsUpload) {
+        VfMetalTraceSpan span;
+        vf_metal_trace_begin (&span, _traceOwner, VF_METAL_STATS_UPLOAD);
+        vf_metal_texture_upload_plane (texture, frame, planeIndex);
+        vf_metal_trace_end (&span);
+    }
+    return texture;
+}
+
+- (id<MTLTexture>)texturePlane:(GstVideoFrame *)frame
+                         plane:(int)planeIndex
+                        format:(MTLPixelFormat)pixelFormat
+                         width:(int)planeWidth
+                        height:(int)planeHeight
+                   needsUpload:(BOOL *)needsUpload
 {
     id<MTLTexture> texture = nil;
 
+    *needsUpload = NO;
+
+    /* GPU-resident input: sample the plane texture in place, no copy */
+    id<MTLTexture> resident =
+        vf_metal_frame_peek_texture (frame, planeIndex, _device);
+    if (resident && resident.pixelFormat == pixelFormat &&
+        (int)resident.width == planeWidth &&
+        (int)resident.height == planeHeight) {
+        return resident;
+    }
+    if (resident)
+        vf_metal_frame_sync_to_cpu (frame);
+
+    /* IOSurface-backed CoreVideo input: alias the surface, no copy */
+    if (_cvTextureCache) {
+        CVPixelBufferRef pixelBuffer = vf_metal_frame_get_pixel_buffer (frame);
+        if (pixelBuffer) {
+            texture = [self _wrapPixelBuffer:pixelBuffer plane:planeIndex
+                                      format:pixelFormat
+                                       width:planeWidth height:planeHeight];
+            if (texture)
+                return texture;
+        }
+    }
+
     /* Check cache for a reusable texture at the current slot */
     if (_cacheIndex < (int)_cache.count) {
         id<MTLTexture> cached = _cache[_cacheIndex];
@@ -87,7 +362,9 @@ vf_metal_color_matrix_for_frame (GstVideoFrame *frame)
                                         height:planeHeight
                                      mipmapped:NO];
         desc.usage = MTLTextureUsageShaderRead;
-        desc.storageMode = MTLStorageModeShared;
+        /* Managed on a discrete GPU: replaceRegion: fills the CPU copy
+         * and Metal moves it to VRAM before the first use */
+        desc.storageMode = vf_metal_host_storage_mode (_device);
 
         texture = [_device newTextureWithDescriptor:desc];
         if (!texture) {
@@ -104,19 +381,20 @@ vf_metal_color_matrix_for_frame (GstVideoFrame *frame)
     }
 
     _cacheIndex++;
-
-    [texture replaceRegion:MTLRegionMake2D(0, 0, planeWidth, planeHeight)
-               mipmapLevel:0
-                 withBytes:GST_VIDEO_FRAME_PLANE_DATA (frame, planeIndex)
-               bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (frame, planeIndex)];
+    *needsUpload = YES;
 
     return texture;
 }
 
 - (void)clear
 {
-    [_cache removeAllObjects];
+    for (NSMutableArray *slotCache in _slotCaches)
+        [slotCache removeAllObjects];
+    for (NSMutableArray *slotTextures in _slotCVTextures)
+        [slotTextures removeAllObjects];
     _cacheIndex = 0;
+    if (_cvTextureCache)
+        CVMetalTextureCacheFlush (_cvTextureCache, 0);
 }
 
 @end
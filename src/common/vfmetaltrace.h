@@ -0,0 +1,89 @@
+/* Tracer hooks and os_signpost intervals for VisioForge Metal elements
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef __VF_METAL_TRACE_H__
+#define __VF_METAL_TRACE_H__
+
+#import <Foundation/Foundation.h>
+#import <Metal/Metal.h>
+#import <os/signpost.h>
+
+#include <gst/gst.h>
+
+#include "vfmetalstats.h"
+
+G_BEGIN_DECLS
+
+/* Attached "vfmetal" tracers (GST_TRACERS=vfmetal) */
+extern gint vf_metal_trace_tracers;
+
+os_log_t vf_metal_trace_log (void);
+
+/* Cheap enough to call per frame: without a vfmetal tracer or a tool
+ * recording the os_signpost log, every span below is a no-op */
+static inline gboolean
+vf_metal_trace_enabled (void)
+{
+  return g_atomic_int_get (&vf_metal_trace_tracers) > 0 ||
+      os_signpost_enabled (vf_metal_trace_log ());
+}
+
+/**
+ * VfMetalTraceSpan:
+ *
+ * One CPU interval of a stage on the calling thread, reported as an
+ * os_signpost interval and a "vfmetal-stage" tracer record on end.
+ */
+typedef struct
+{
+  GstObject *owner;
+  VfMetalStatsStage stage;
+  os_signpost_id_t id;
+  GstClockTime start;       /* gst_util_get_timestamp(), 0 when inactive */
+} VfMetalTraceSpan;
+
+void vf_metal_trace_begin (VfMetalTraceSpan * span, GstObject * owner,
+    VfMetalStatsStage stage);
+void vf_metal_trace_end (VfMetalTraceSpan * span);
+
+/* Receives every finished span in-process, e.g. for vfmetal-bench.
+ * @owner_name is only valid for the duration of the call, which may come
+ * from a Metal completion handler thread. */
+typedef void (*VfMetalTraceHook) (const gchar * owner_name,
+    VfMetalStatsStage stage, GstClockTime start, GstClockTime duration,
+    gpointer user_data);
+
+/* Install (or with NULL remove) the hook; enables the spans like an
+ * attached tracer does. Not for use while elements are streaming. */
+void vf_metal_trace_set_hook (VfMetalTraceHook hook, gpointer user_data);
+
+/* Register the "vfmetal" tracer */
+gboolean vf_metal_trace_register (GstPlugin * plugin);
+
+G_END_DECLS
+
+/* Report @commandBuffer's GPU execution as a "gpu" span of @owner once it
+ * completes. Call right before committing. */
+void vf_metal_trace_command_buffer (GstObject * owner,
+    id<MTLCommandBuffer> commandBuffer);
+
+#endif /* __VF_METAL_TRACE_H__ */
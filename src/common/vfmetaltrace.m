@@ -0,0 +1,228 @@
+/* Tracer hooks and os_signpost intervals for VisioForge Metal elements
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#import "vfmetaltrace.h"
+
+#import <QuartzCore/QuartzCore.h>
+
+gint vf_metal_trace_tracers = 0;
+
+static GstTracerRecord *stage_record;
+
+static VfMetalTraceHook trace_hook;
+static gpointer trace_hook_data;
+
+static const gchar *stage_names[VF_METAL_STATS_N_STAGES] = {
+    "upload", "encode", "gpu", "readback"
+};
+
+os_log_t
+vf_metal_trace_log (void)
+{
+    static os_log_t log;
+    static dispatch_once_t once;
+
+    /* Dynamic tracing: signposts cost nothing unless a tool is recording */
+    dispatch_once (&once, ^{
+        log = os_log_create ("com.visioforge.vfmetal",
+                             OS_LOG_CATEGORY_DYNAMIC_TRACING);
+    });
+    return log;
+}
+
+/* os_signpost names must be string literals */
+#define SIGNPOST_INTERVAL(func, log, id, stage, owner_name)                 \
+    switch (stage) {                                                        \
+        case VF_METAL_STATS_UPLOAD:                                         \
+            func (log, id, "upload", "%{public}s", owner_name); break;      \
+        case VF_METAL_STATS_ENCODE:                                         \
+            func (log, id, "encode", "%{public}s", owner_name); break;      \
+        case VF_METAL_STATS_GPU:                                            \
+            func (log, id, "gpu", "%{public}s", owner_name); break;         \
+        case VF_METAL_STATS_READBACK:                                       \
+            func (log, id, "readback", "%{public}s", owner_name); break;    \
+        default:                                                            \
+            break;                                                          \
+    }
+
+static void
+trace_record (const gchar *owner_name, VfMetalStatsStage stage,
+    GstClockTime start, GstClockTime duration)
+{
+    if (g_atomic_int_get (&vf_metal_trace_tracers) > 0 && stage_record)
+        gst_tracer_record_log (stage_record, owner_name, stage_names[stage],
+            (guint64) start, (guint64) duration);
+    if (trace_hook)
+        trace_hook (owner_name, stage, start, duration, trace_hook_data);
+}
+
+void
+vf_metal_trace_set_hook (VfMetalTraceHook hook, gpointer user_data)
+{
+    /* The hook counts as one more tracer while installed */
+    if (hook && !trace_hook)
+        g_atomic_int_add (&vf_metal_trace_tracers, 1);
+    else if (!hook && trace_hook)
+        g_atomic_int_add (&vf_metal_trace_tracers, -1);
+
+    trace_hook = hook;
+    trace_hook_data = user_data;
+}
+
+void
+vf_metal_trace_begin (VfMetalTraceSpan * span, GstObject * owner,
+    VfMetalStatsStage stage)
+{
+    span->start = 0;
+    if (!vf_metal_trace_enabled ())
+        return;
+
+    os_log_t log = vf_metal_trace_log ();
+    const gchar *name = owner ? GST_OBJECT_NAME (owner) : "vfmetal";
+
+    span->owner = owner;
+    span->stage = stage;
+    span->id = os_signpost_id_generate (log);
+    span->start = gst_util_get_timestamp ();
+    SIGNPOST_INTERVAL (os_signpost_interval_begin, log, span->id, stage, name);
+}
+
+void
+vf_metal_trace_end (VfMetalTraceSpan * span)
+{
+    if (span->start == 0)
+        return;
+
+    os_log_t log = vf_metal_trace_log ();
+    const gchar *name = span->owner ? GST_OBJECT_NAME (span->owner) : "vfmetal";
+
+    SIGNPOST_INTERVAL (os_signpost_interval_end, log, span->id, span->stage,
+        name);
+    trace_record (name, span->stage, span->start,
+        gst_util_get_timestamp () - span->start);
+    span->start = 0;
+}
+
+void
+vf_metal_trace_command_buffer (GstObject * owner,
+    id<MTLCommandBuffer> commandBuffer)
+{
+    if (!vf_metal_trace_enabled ())
+        return;
+
+    /* The handler may run after the owner is gone */
+    gchar *name = g_strdup (owner ? GST_OBJECT_NAME (owner) : "vfmetal");
+    os_log_t log = vf_metal_trace_log ();
+    os_signpost_id_t sid = os_signpost_id_generate (log);
+
+    /* The interval spans queueing and execution; the record holds the
+     * execution alone, from the command buffer's GPU times */
+    SIGNPOST_INTERVAL (os_signpost_interval_begin, log, sid,
+        VF_METAL_STATS_GPU, name);
+
+    [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> cb) {
+        SIGNPOST_INTERVAL (os_signpost_interval_end, log, sid,
+            VF_METAL_STATS_GPU, name);
+
+        if (cb.GPUEndTime > cb.GPUStartTime) {
+            /* Map the host-clock GPU times onto the tracer clock */
+            GstClockTime now = gst_util_get_timestamp ();
+            CFTimeInterval ago = CACurrentMediaTime () - cb.GPUStartTime;
+            GstClockTime start = now - MIN (now, (GstClockTime) (ago * GST_SECOND));
+
+            trace_record (name, VF_METAL_STATS_GPU, start,
+                (GstClockTime) ((cb.GPUEndTime - cb.GPUStartTime) * GST_SECOND));
+        }
+        g_free (name);
+    }];
+}
+
+/* --- "vfmetal" tracer --- */
+
+#define GST_TYPE_VF_METAL_TRACER (gst_vf_metal_tracer_get_type ())
+
+/* The elements report their spans themselves; the tracer only turns the
+ * reporting on and owns the record describing it */
+typedef struct
+{
+    GstTracer parent;
+} GstVfMetalTracer;
+
+typedef struct
+{
+    GstTracerClass parent_class;
+} GstVfMetalTracerClass;
+
+GType gst_vf_metal_tracer_get_type (void);
+
+G_DEFINE_TYPE (GstVfMetalTracer, gst_vf_metal_tracer, GST_TYPE_TRACER);
+
+static void
+gst_vf_metal_tracer_finalize (GObject * object)
+{
+    g_atomic_int_add (&vf_metal_trace_tracers, -1);
+
+    G_OBJECT_CLASS (gst_vf_metal_tracer_parent_class)->finalize (object);
+}
+
+static void
+gst_vf_metal_tracer_class_init (GstVfMetalTracerClass * klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+    gobject_class->finalize = gst_vf_metal_tracer_finalize;
+
+    stage_record = gst_tracer_record_new ("vfmetal-stage.class",
+        "element", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+            "type", G_TYPE_GTYPE, G_TYPE_STRING,
+            "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+            GST_TRACER_VALUE_SCOPE_ELEMENT, NULL),
+        "stage", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+            "type", G_TYPE_GTYPE, G_TYPE_STRING,
+            "description", G_TYPE_STRING,
+            "upload, encode, gpu or readback", NULL),
+        "ts", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+            "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+            "description", G_TYPE_STRING,
+            "start of the stage, tracer clock (ns)",
+            "min", G_TYPE_UINT64, G_GUINT64_CONSTANT (0),
+            "max", G_TYPE_UINT64, G_MAXUINT64, NULL),
+        "duration", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+            "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+            "description", G_TYPE_STRING, "length of the stage (ns)",
+            "min", G_TYPE_UINT64, G_GUINT64_CONSTANT (0),
+            "max", G_TYPE_UINT64, G_MAXUINT64, NULL),
+        NULL);
+    GST_OBJECT_FLAG_SET (stage_record, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+}
+
+static void
+gst_vf_metal_tracer_init (GstVfMetalTracer * self)
+{
+    g_atomic_int_add (&vf_metal_trace_tracers, 1);
+}
+
+gboolean
+vf_metal_trace_register (GstPlugin * plugin)
+{
+    return gst_tracer_register (plugin, "vfmetal", GST_TYPE_VF_METAL_TRACER);
+}
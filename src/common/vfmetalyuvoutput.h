@@ -26,33 +26,104 @@
 #import <Metal/Metal.h>
 #import <gst/video/video.h>
 
+#import "vfmetaldevice.h"
+#import "vfmetalinflight.h"
+#import "vfmetalstats.h"
+
 /* Encapsulates NV12/I420 output plane textures and compute pipeline states.
- * Provides configure, GPU dispatch, and CPU readback in one place. */
+ * Provides configure, GPU dispatch, and CPU readback in one place.
+ * P010_10LE and I420_10LE use the same kernels into 16-bit planes; feed
+ * them an RGBA16Float source to keep the extra bits. */
 @interface VfMetalYUVOutput : NSObject
 
+/* When set, each CPU readback is timed into its READBACK stage */
+@property (nonatomic) VfMetalStats *stats;
+
+/* Element the readbacks are traced for (see vfmetaltrace.h) */
+@property (nonatomic, assign) GstObject *traceOwner;
+
 /* (Re)create output plane textures and compute pipelines for the given format.
- * For BGRA/RGBA formats the internal resources are released (no-op output). */
-- (BOOL)configureWithDevice:(id<MTLDevice>)device
+ * For BGRA/RGBA formats the internal resources are released (no-op output).
+ * On a discrete GPU the planes are managed textures, synchronised by the
+ * readback below. */
+- (BOOL)configureWithDevice:(VfMetalDevice *)metalDevice
                     library:(id<MTLLibrary>)library
                       width:(NSUInteger)width
                      height:(NSUInteger)height
                      format:(GstVideoFormat)format;
 
 /* Encode an RGBA→NV12 or RGBA→I420 compute pass into commandBuffer.
- * No-op when the configured format is BGRA/RGBA. */
+ * When outFrame is backed by VfMetalMemory the pass writes its plane
+ * textures directly (RGBA output is blitted) and the readback is skipped. */
 - (void)dispatchConversion:(id<MTLCommandBuffer>)commandBuffer
              sourceTexture:(id<MTLTexture>)source
                      width:(NSUInteger)width
                     height:(NSUInteger)height
                   outFrame:(GstVideoFrame *)outFrame;
 
+/* Same as above, writing NV12/I420 planes owned by in-flight ring @slot
+ * (0 to VF_METAL_MAX_IN_FLIGHT - 1) so the result survives until the
+ * slot's readback even while later frames are encoded. */
+- (void)dispatchConversion:(id<MTLCommandBuffer>)commandBuffer
+             sourceTexture:(id<MTLTexture>)source
+                     width:(NSUInteger)width
+                    height:(NSUInteger)height
+                  outFrame:(GstVideoFrame *)outFrame
+                      slot:(NSUInteger)slot;
+
+/* For passes that produce NV12/I420 planes themselves instead of going
+ * through -dispatchConversion: the textures to write, in plane order.
+ * These are the frame's own VfMetalMemory planes when they match (the
+ * readback then becomes a no-op), else the slot's planes. Returns nil
+ * for BGRA/RGBA. Follow with the usual readback or pipelined commit. */
+- (NSArray<id<MTLTexture>> *)outputPlanesForFrame:(GstVideoFrame *)outFrame
+                                             slot:(NSUInteger)slot;
+
 /* Read back Metal textures to the appropriate GstVideoFrame planes.
- * Handles NV12 (2-plane), I420 (3-plane), and BGRA/RGBA (1-plane). */
+ * Handles NV12 (2-plane), I420 (3-plane), and BGRA/RGBA (1-plane).
+ * No-op when the last dispatch already wrote the frame's GPU memory.
+ * @rgbaSource must use the device's hostStorageMode. */
 - (void)readbackToFrame:(GstVideoFrame *)outFrame
           sourceTexture:(id<MTLTexture>)rgbaSource
                   width:(NSUInteger)width
                  height:(NSUInteger)height;
 
+/* Same as above for a frame dispatched into @slot */
+- (void)readbackToFrame:(GstVideoFrame *)outFrame
+          sourceTexture:(id<MTLTexture>)rgbaSource
+                  width:(NSUInteger)width
+                 height:(NSUInteger)height
+                   slot:(NSUInteger)slot;
+
+/* Pipelined alternative to commit + wait + readback: commits without
+ * blocking and reads @outFrame back from @slot in the command buffer's
+ * completion handler, then calls @completion. BGRA/RGBA results are first
+ * copied into the slot since @source is reused by the next frame. */
+- (void)commitPipelined:(id<MTLCommandBuffer>)commandBuffer
+          sourceTexture:(id<MTLTexture>)source
+                  width:(NSUInteger)width
+                 height:(NSUInteger)height
+               outFrame:(GstVideoFrame *)outFrame
+                   slot:(NSUInteger)slot
+             completion:(VfMetalCompletionHandler)completion;
+
+/* -commitPipelined: in two halves, for callers that encode several
+ * outputs into one command buffer and commit it themselves. The first
+ * prepares @outFrame's readback from @slot in @commandBuffer (NO if the
+ * slot copy could not be allocated); the second copies the result into
+ * @outFrame from the command buffer's completion handler. */
+- (BOOL)encodePipelinedReadback:(id<MTLCommandBuffer>)commandBuffer
+                  sourceTexture:(id<MTLTexture>)source
+                          width:(NSUInteger)width
+                         height:(NSUInteger)height
+                       outFrame:(GstVideoFrame *)outFrame
+                           slot:(NSUInteger)slot;
+
+- (void)finishPipelinedReadback:(GstVideoFrame *)outFrame
+                          width:(NSUInteger)width
+                         height:(NSUInteger)height
+                           slot:(NSUInteger)slot;
+
 /* Release all textures and pipeline states. */
 - (void)cleanup;
 
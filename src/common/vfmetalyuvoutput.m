@@ -22,74 +22,115 @@
 #import "vfmetalyuvoutput.h"
 #import "vfmetalshaders.h"
 #import "vfmetaltextureutil.h"
+#import "vfmetalmemory.h"
+#import "vfmetaltrace.h"
+
+#define GST_CAT_DEFAULT gst_vf_metal_debug
 
 @implementation VfMetalYUVOutput {
+    VfMetalDevice *_metalDevice;
+    id<MTLDevice> _device;
     id<MTLComputePipelineState> _computeNV12;
     id<MTLComputePipelineState> _computeI420;
-    id<MTLTexture> _outputY;
-    id<MTLTexture> _outputUV;
-    id<MTLTexture> _outputU;
-    id<MTLTexture> _outputV;
+    NSUInteger _width;
+    NSUInteger _height;
     GstVideoFormat _format;
+
+    /* Output planes per in-flight slot; slot 0 is created by configure,
+     * the others on first use */
+    id<MTLTexture> _outputY[VF_METAL_MAX_IN_FLIGHT];
+    id<MTLTexture> _outputUV[VF_METAL_MAX_IN_FLIGHT];
+    id<MTLTexture> _outputU[VF_METAL_MAX_IN_FLIGHT];
+    id<MTLTexture> _outputV[VF_METAL_MAX_IN_FLIGHT];
+
+    /* Pipelined BGRA/RGBA output: per-slot copy of the source texture */
+    id<MTLTexture> _outputRGBA[VF_METAL_MAX_IN_FLIGHT];
+
+    /* Last dispatch in the slot wrote straight into the frame's
+     * VfMetalMemory planes */
+    BOOL _wroteFrameTextures[VF_METAL_MAX_IN_FLIGHT];
 }
 
-- (BOOL)configureWithDevice:(id<MTLDevice>)device
+- (id<MTLTexture>)_newPlaneWithFormat:(MTLPixelFormat)pixelFormat
+                                width:(NSUInteger)width
+                               height:(NSUInteger)height
+{
+    MTLTextureDescriptor *desc = [MTLTextureDescriptor
+        texture2DDescriptorWithPixelFormat:pixelFormat
+                                     width:width height:height mipmapped:NO];
+    desc.usage = MTLTextureUsageShaderWrite | MTLTextureUsageShaderRead;
+    desc.storageMode = _metalDevice.hostStorageMode;
+    return [_device newTextureWithDescriptor:desc];
+}
+
+- (BOOL)_ensureSlot:(NSUInteger)slot
+{
+    NSUInteger cw = (_width + 1) / 2;
+    NSUInteger ch = (_height + 1) / 2;
+
+    if (!vf_metal_format_is_planar_yuv (_format))
+        return YES;
+    if (_outputY[slot])
+        return YES;
+
+    /* Y plane — full resolution; 16-bit texels for the 10-bit formats */
+    _outputY[slot] = [self
+        _newPlaneWithFormat:vf_metal_plane_pixel_format (_format, 0)
+                      width:_width height:_height];
+    if (!_outputY[slot]) return NO;
+
+    if (vf_metal_input_format_index (_format) == VF_METAL_INPUT_NV12) {
+        _outputUV[slot] = [self
+            _newPlaneWithFormat:vf_metal_plane_pixel_format (_format, 1)
+                          width:cw height:ch];
+        if (!_outputUV[slot]) return NO;
+    } else {
+        _outputU[slot] = [self
+            _newPlaneWithFormat:vf_metal_plane_pixel_format (_format, 1)
+                          width:cw height:ch];
+        _outputV[slot] = [self
+            _newPlaneWithFormat:vf_metal_plane_pixel_format (_format, 2)
+                          width:cw height:ch];
+        if (!_outputU[slot] || !_outputV[slot]) return NO;
+    }
+
+    return YES;
+}
+
+- (BOOL)configureWithDevice:(VfMetalDevice *)metalDevice
                     library:(id<MTLLibrary>)library
                       width:(NSUInteger)width
                      height:(NSUInteger)height
                      format:(GstVideoFormat)format
 {
     [self cleanup];
+    _metalDevice = metalDevice;
+    _device = metalDevice.device;
+    _width = width;
+    _height = height;
     _format = format;
 
-    if (format != GST_VIDEO_FORMAT_NV12 && format != GST_VIDEO_FORMAT_I420)
+    if (!vf_metal_format_is_planar_yuv (format))
         return YES;
 
-    /* Y plane — full resolution */
-    MTLTextureDescriptor *yDesc = [MTLTextureDescriptor
-        texture2DDescriptorWithPixelFormat:MTLPixelFormatR8Unorm
-                                     width:width height:height mipmapped:NO];
-    yDesc.usage = MTLTextureUsageShaderWrite | MTLTextureUsageShaderRead;
-    yDesc.storageMode = MTLStorageModeShared;
-    _outputY = [device newTextureWithDescriptor:yDesc];
-    if (!_outputY) return NO;
-
-    if (format == GST_VIDEO_FORMAT_NV12) {
-        MTLTextureDescriptor *uvDesc = [MTLTextureDescriptor
-            texture2DDescriptorWithPixelFormat:MTLPixelFormatRG8Unorm
-                                         width:(width + 1) / 2
-                                        height:(height + 1) / 2
-                                     mipmapped:NO];
-        uvDesc.usage = MTLTextureUsageShaderWrite | MTLTextureUsageShaderRead;
-        uvDesc.storageMode = MTLStorageModeShared;
-        _outputUV = [device newTextureWithDescriptor:uvDesc];
-        if (!_outputUV) return NO;
-
-        NSError *err = nil;
-        id<MTLFunction> func = [library newFunctionWithName:@"rgbaToNV12"];
-        _computeNV12 =
-            [device newComputePipelineStateWithFunction:func error:&err];
-        if (!_computeNV12) return NO;
-    } else {
-        MTLTextureDescriptor *cDesc = [MTLTextureDescriptor
-            texture2DDescriptorWithPixelFormat:MTLPixelFormatR8Unorm
-                                         width:(width + 1) / 2
-                                        height:(height + 1) / 2
-                                     mipmapped:NO];
-        cDesc.usage = MTLTextureUsageShaderWrite | MTLTextureUsageShaderRead;
-        cDesc.storageMode = MTLStorageModeShared;
-        _outputU = [device newTextureWithDescriptor:cDesc];
-        _outputV = [device newTextureWithDescriptor:cDesc];
-        if (!_outputU || !_outputV) return NO;
-
-        NSError *err = nil;
-        id<MTLFunction> func = [library newFunctionWithName:@"rgbaToI420"];
-        _computeI420 =
-            [device newComputePipelineStateWithFunction:func error:&err];
-        if (!_computeI420) return NO;
-    }
+    /* 10-bit output runs the same kernels; the colour word of the output
+     * frame selects how codes are stored in the 16-bit planes */
+    BOOL semiPlanar =
+        vf_metal_input_format_index (format) == VF_METAL_INPUT_NV12;
+    NSError *err = nil;
+    id<MTLComputePipelineState> pipeline = [_metalDevice
+        computePipelineWithFunctionName:
+            semiPlanar ? @"rgbaToNV12" : @"rgbaToI420"
+                                library:library
+                                  error:&err];
+    if (!pipeline) return NO;
 
-    return YES;
+    if (semiPlanar)
+        _computeNV12 = pipeline;
+    else
+        _computeI420 = pipeline;
+
+    return [self _ensureSlot:0];
 }
 
 - (void)dispatchConversion:(id<MTLCommandBuffer>)commandBuffer
@@ -97,29 +138,58 @@
                      width:(NSUInteger)width
                     height:(NSUInteger)height
                   outFrame:(GstVideoFrame *)outFrame
+{
+    [self dispatchConversion:commandBuffer sourceTexture:source
+                       width:width height:height outFrame:outFrame slot:0];
+}
+
+- (void)dispatchConversion:(id<MTLCommandBuffer>)commandBuffer
+             sourceTexture:(id<MTLTexture>)source
+                     width:(NSUInteger)width
+                    height:(NSUInteger)height
+                  outFrame:(GstVideoFrame *)outFrame
+                      slot:(NSUInteger)slot
 {
     id<MTLComputePipelineState> pipeline = nil;
 
-    if (_format == GST_VIDEO_FORMAT_NV12 && _computeNV12) {
+    _wroteFrameTextures[slot] = NO;
+
+    if (_computeNV12) {
         pipeline = _computeNV12;
-    } else if (_format == GST_VIDEO_FORMAT_I420 && _computeI420) {
+    } else if (_computeI420) {
         pipeline = _computeI420;
     } else {
+        /* RGBA output into GPU memory: a blit replaces the CPU readback */
+        id<MTLTexture> dst = vf_metal_frame_peek_texture (outFrame, 0, _device);
+        if (dst && dst.pixelFormat == source.pixelFormat &&
+            dst.width == width && dst.height == height) {
+            id<MTLBlitCommandEncoder> blit = [commandBuffer blitCommandEncoder];
+            [blit copyFromTexture:source
+                      sourceSlice:0
+                      sourceLevel:0
+                     sourceOrigin:MTLOriginMake(0, 0, 0)
+                       sourceSize:MTLSizeMake(width, height, 1)
+                        toTexture:dst
+                 destinationSlice:0
+                 destinationLevel:0
+                destinationOrigin:MTLOriginMake(0, 0, 0)];
+            [blit endEncoding];
+            vf_metal_frame_mark_gpu_written (outFrame);
+            _wroteFrameTextures[slot] = YES;
+        }
         return;
     }
 
+    NSArray<id<MTLTexture>> *planes =
+        [self outputPlanesForFrame:outFrame slot:slot];
+    if (!planes) return;
+
     id<MTLComputeCommandEncoder> compute =
         [commandBuffer computeCommandEncoder];
     [compute setComputePipelineState:pipeline];
     [compute setTexture:source atIndex:0];
-    [compute setTexture:_outputY atIndex:1];
-
-    if (_format == GST_VIDEO_FORMAT_NV12) {
-        [compute setTexture:_outputUV atIndex:2];
-    } else {
-        [compute setTexture:_outputU atIndex:2];
-        [compute setTexture:_outputV atIndex:3];
-    }
+    for (NSUInteger i = 0; i < planes.count; i++)
+        [compute setTexture:planes[i] atIndex:i + 1];
 
     VfMetalComputeUniforms cu = {
         .width = (uint32_t)width,
@@ -135,52 +205,242 @@
     [compute endEncoding];
 }
 
-- (void)readbackToFrame:(GstVideoFrame *)outFrame
-          sourceTexture:(id<MTLTexture>)rgbaSource
-                  width:(NSUInteger)width
-                 height:(NSUInteger)height
+- (NSArray<id<MTLTexture>> *)outputPlanesForFrame:(GstVideoFrame *)outFrame
+                                             slot:(NSUInteger)slot
 {
-    GstVideoFormat fmt = GST_VIDEO_FRAME_FORMAT (outFrame);
+    _wroteFrameTextures[slot] = NO;
+
+    if (!vf_metal_format_is_planar_yuv (_format))
+        return nil;
+
+    if (![self _ensureSlot:slot]) {
+        GST_ERROR ("VfMetalYUVOutput: failed to allocate slot %lu planes",
+                   (unsigned long)slot);
+        return nil;
+    }
+
+    NSArray<id<MTLTexture>> *planes = _outputUV[slot]
+        ? @[ _outputY[slot], _outputUV[slot] ]
+        : @[ _outputY[slot], _outputU[slot], _outputV[slot] ];
+
+    /* YUV output into GPU memory: write the frame's planes directly */
+    NSMutableArray<id<MTLTexture>> *resident =
+        [NSMutableArray arrayWithCapacity:planes.count];
+    for (NSUInteger i = 0; i < planes.count; i++) {
+        id<MTLTexture> tex =
+            vf_metal_frame_peek_texture (outFrame, (guint)i, _device);
+        if (!tex || tex.pixelFormat != planes[i].pixelFormat ||
+            tex.width != planes[i].width ||
+            tex.height != planes[i].height)
+            return planes;
+        [resident addObject:tex];
+    }
 
-    if (fmt == GST_VIDEO_FORMAT_NV12) {
-        [_outputY getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 0)
-               bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 0)
-                fromRegion:MTLRegionMake2D(0, 0, width, height)
-               mipmapLevel:0];
-        [_outputUV getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 1)
-                bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 1)
-                 fromRegion:MTLRegionMake2D(0, 0, (width + 1) / 2,
-                                            (height + 1) / 2)
-                mipmapLevel:0];
-    } else if (fmt == GST_VIDEO_FORMAT_I420) {
-        [_outputY getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 0)
-               bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 0)
-                fromRegion:MTLRegionMake2D(0, 0, width, height)
-               mipmapLevel:0];
-        [_outputU getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 1)
-               bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 1)
-                fromRegion:MTLRegionMake2D(0, 0, (width + 1) / 2,
-                                           (height + 1) / 2)
-               mipmapLevel:0];
-        [_outputV getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 2)
-               bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 2)
-                fromRegion:MTLRegionMake2D(0, 0, (width + 1) / 2,
-                                           (height + 1) / 2)
-               mipmapLevel:0];
+    vf_metal_frame_mark_gpu_written (outFrame);
+    _wroteFrameTextures[slot] = YES;
+    return resident;
+}
+
+/* Textures -readbackToFrame: copies from @outFrame's layout */
+- (NSArray<id<MTLTexture>> *)_readbackTextures:(GstVideoFrame *)outFrame
+                                 sourceTexture:(id<MTLTexture>)rgbaSource
+                                          slot:(NSUInteger)slot
+{
+    VfMetalInputFormat layout =
+        vf_metal_input_format_index (GST_VIDEO_FRAME_FORMAT (outFrame));
+
+    if (_wroteFrameTextures[slot])
+        return @[];
+    if (layout == VF_METAL_INPUT_NV12 && _outputY[slot] && _outputUV[slot])
+        return @[ _outputY[slot], _outputUV[slot] ];
+    if (layout == VF_METAL_INPUT_I420 && _outputY[slot] && _outputU[slot] &&
+        _outputV[slot])
+        return @[ _outputY[slot], _outputU[slot], _outputV[slot] ];
+    return rgbaSource ? @[ rgbaSource ] : @[];
+}
+
+- (void)_copyToFrame:(GstVideoFrame *)outFrame
+       sourceTexture:(id<MTLTexture>)rgbaSource
+               width:(NSUInteger)width
+              height:(NSUInteger)height
+                slot:(NSUInteger)slot
+{
+    VfMetalInputFormat layout =
+        vf_metal_input_format_index (GST_VIDEO_FRAME_FORMAT (outFrame));
+    NSUInteger cw = (width + 1) / 2;
+    NSUInteger ch = (height + 1) / 2;
+
+    /* Already in the frame's GPU memory — nothing to copy */
+    if (_wroteFrameTextures[slot])
+        return;
+
+    gint64 start = _stats ? vf_metal_stats_now () : 0;
+    VfMetalTraceSpan span;
+    vf_metal_trace_begin (&span, _traceOwner, VF_METAL_STATS_READBACK);
+
+    if (layout == VF_METAL_INPUT_NV12) {
+        [_outputY[slot] getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 0)
+                     bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 0)
+                      fromRegion:MTLRegionMake2D(0, 0, width, height)
+                     mipmapLevel:0];
+        [_outputUV[slot] getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 1)
+                      bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 1)
+                       fromRegion:MTLRegionMake2D(0, 0, cw, ch)
+                      mipmapLevel:0];
+    } else if (layout == VF_METAL_INPUT_I420) {
+        [_outputY[slot] getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 0)
+                     bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 0)
+                      fromRegion:MTLRegionMake2D(0, 0, width, height)
+                     mipmapLevel:0];
+        [_outputU[slot] getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 1)
+                     bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 1)
+                      fromRegion:MTLRegionMake2D(0, 0, cw, ch)
+                     mipmapLevel:0];
+        [_outputV[slot] getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 2)
+                     bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 2)
+                      fromRegion:MTLRegionMake2D(0, 0, cw, ch)
+                     mipmapLevel:0];
     } else {
         [rgbaSource getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 0)
                  bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 0)
                   fromRegion:MTLRegionMake2D(0, 0, width, height)
                  mipmapLevel:0];
     }
+
+    vf_metal_trace_end (&span);
+    if (_stats)
+        vf_metal_stats_add_since (_stats, VF_METAL_STATS_READBACK, start);
+}
+
+- (void)readbackToFrame:(GstVideoFrame *)outFrame
+          sourceTexture:(id<MTLTexture>)rgbaSource
+                  width:(NSUInteger)width
+                 height:(NSUInteger)height
+                   slot:(NSUInteger)slot
+{
+    /* The frame's command buffer has completed: synchronise on our own */
+    [_metalDevice synchronizeTextures:[self _readbackTextures:outFrame
+                                                 sourceTexture:rgbaSource
+                                                          slot:slot]];
+    [self _copyToFrame:outFrame sourceTexture:rgbaSource
+                 width:width height:height slot:slot];
+}
+
+- (void)readbackToFrame:(GstVideoFrame *)outFrame
+          sourceTexture:(id<MTLTexture>)rgbaSource
+                  width:(NSUInteger)width
+                 height:(NSUInteger)height
+{
+    [self readbackToFrame:outFrame sourceTexture:rgbaSource
+                    width:width height:height slot:0];
+}
+
+- (BOOL)encodePipelinedReadback:(id<MTLCommandBuffer>)commandBuffer
+                  sourceTexture:(id<MTLTexture>)source
+                          width:(NSUInteger)width
+                         height:(NSUInteger)height
+                       outFrame:(GstVideoFrame *)outFrame
+                           slot:(NSUInteger)slot
+{
+    GstVideoFormat fmt = GST_VIDEO_FRAME_FORMAT (outFrame);
+    id<MTLTexture> rgbaSource = nil;
+
+    /* The source is rendered into again by the next frame before this
+     * one's completion handler runs; keep a copy in the slot instead. */
+    if (!_wroteFrameTextures[slot] &&
+        (fmt == GST_VIDEO_FORMAT_BGRA || fmt == GST_VIDEO_FORMAT_RGBA)) {
+        id<MTLTexture> copy = _outputRGBA[slot];
+        if (!copy || copy.pixelFormat != source.pixelFormat ||
+            copy.width != width || copy.height != height) {
+            copy = [self _newPlaneWithFormat:source.pixelFormat
+                                       width:width height:height];
+            _outputRGBA[slot] = copy;
+        }
+
+        if (!copy) {
+            GST_ERROR ("VfMetalYUVOutput: failed to allocate slot %lu copy",
+                       (unsigned long)slot);
+            return NO;
+        }
+
+        id<MTLBlitCommandEncoder> blit = [commandBuffer blitCommandEncoder];
+        [blit copyFromTexture:source
+                  sourceSlice:0
+                  sourceLevel:0
+                 sourceOrigin:MTLOriginMake(0, 0, 0)
+                   sourceSize:MTLSizeMake(width, height, 1)
+                    toTexture:copy
+             destinationSlice:0
+             destinationLevel:0
+            destinationOrigin:MTLOriginMake(0, 0, 0)];
+        [blit endEncoding];
+        rgbaSource = copy;
+    }
+
+    /* Completion handlers must not wait on the GPU, so managed textures
+     * are synchronised by this command buffer already */
+    [_metalDevice encodeSynchronizeTextures:
+                      [self _readbackTextures:outFrame
+                                sourceTexture:rgbaSource slot:slot]
+                              commandBuffer:commandBuffer];
+    return YES;
+}
+
+- (void)finishPipelinedReadback:(GstVideoFrame *)outFrame
+                          width:(NSUInteger)width
+                         height:(NSUInteger)height
+                           slot:(NSUInteger)slot
+{
+    GstVideoFormat fmt = GST_VIDEO_FRAME_FORMAT (outFrame);
+    id<MTLTexture> rgbaSource =
+        (fmt == GST_VIDEO_FORMAT_BGRA || fmt == GST_VIDEO_FORMAT_RGBA)
+            ? _outputRGBA[slot] : nil;
+
+    [self _copyToFrame:outFrame sourceTexture:rgbaSource
+                 width:width height:height slot:slot];
+}
+
+- (void)commitPipelined:(id<MTLCommandBuffer>)commandBuffer
+          sourceTexture:(id<MTLTexture>)source
+                  width:(NSUInteger)width
+                 height:(NSUInteger)height
+               outFrame:(GstVideoFrame *)outFrame
+                   slot:(NSUInteger)slot
+             completion:(VfMetalCompletionHandler)completion
+{
+    BOOL prepared = [self encodePipelinedReadback:commandBuffer
+                                    sourceTexture:source
+                                            width:width height:height
+                                         outFrame:outFrame slot:slot];
+
+    [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> cb) {
+        BOOL ok = prepared && cb.status != MTLCommandBufferStatusError;
+        if (cb.status == MTLCommandBufferStatusError) {
+            GST_ERROR ("Metal command buffer failed: %s",
+                       cb.error.localizedDescription.UTF8String);
+        }
+        if (ok) {
+            @autoreleasepool {
+                [self finishPipelinedReadback:outFrame
+                                        width:width height:height slot:slot];
+            }
+        }
+        completion (ok);
+    }];
+
+    [commandBuffer commit];
 }
 
 - (void)cleanup
 {
-    _outputY = nil;
-    _outputUV = nil;
-    _outputU = nil;
-    _outputV = nil;
+    for (int i = 0; i < VF_METAL_MAX_IN_FLIGHT; i++) {
+        _outputY[i] = nil;
+        _outputUV[i] = nil;
+        _outputU[i] = nil;
+        _outputV[i] = nil;
+        _outputRGBA[i] = nil;
+        _wroteFrameTextures[i] = NO;
+    }
     _computeNV12 = nil;
     _computeI420 = nil;
     _format = GST_VIDEO_FORMAT_UNKNOWN;
@@ -26,6 +26,10 @@
 #include <gst/video/video.h>
 #include <gst/video/gstvideoaggregator.h>
 
+#include "vfmetalcontext.h"
+#include "vfmetalinflight.h"
+#include "vfmetalstats.h"
+
 G_BEGIN_DECLS
 
 /* --- Element type --- */
@@ -77,6 +81,23 @@ typedef enum
   VF_METAL_COMPOSITOR_SIZING_POLICY_KEEP_ASPECT_RATIO,
 } GstVfMetalCompositorSizingPolicy;
 
+/**
+ * GstVfMetalCompositorSizingQuality:
+ * @VF_METAL_COMPOSITOR_SIZING_QUALITY_NEAREST: Nearest-neighbour sampling
+ * @VF_METAL_COMPOSITOR_SIZING_QUALITY_LINEAR: Bilinear sampling
+ * @VF_METAL_COMPOSITOR_SIZING_QUALITY_MIPMAPPED: Downscale through a mip
+ *     chain into a cached tile-sized texture
+ * @VF_METAL_COMPOSITOR_SIZING_QUALITY_BOX: Area-average downscale into a
+ *     cached tile-sized texture
+ */
+typedef enum
+{
+  VF_METAL_COMPOSITOR_SIZING_QUALITY_NEAREST,
+  VF_METAL_COMPOSITOR_SIZING_QUALITY_LINEAR,
+  VF_METAL_COMPOSITOR_SIZING_QUALITY_MIPMAPPED,
+  VF_METAL_COMPOSITOR_SIZING_QUALITY_BOX,
+} GstVfMetalCompositorSizingQuality;
+
 /**
  * GstVfMetalCompositor:
  *
@@ -89,6 +110,22 @@ struct _GstVfMetalCompositor
   /* Properties */
   GstVfMetalCompositorBackground background;
   gboolean zero_size_is_unscaled;
+  guint upload_threads;     /* 0 = one per CPU core; object lock */
+  guint stats_interval;     /* ms between stats messages, 0 = none; object lock */
+
+  /* Stage timings and frame counters behind the "stats" property */
+  VfMetalStats stats;
+
+  /* Pipelined submission: in-flight property, latched into inflight at
+   * start. ready is the oldest job aggregate_frames waited for to free a
+   * slot, submitted the output buffer it queued (not owned). */
+  guint in_flight;
+  VfMetalInflight inflight;
+  VfMetalInflightJob *ready;
+  GstBuffer *submitted;
+
+  /* GPU selection; the renderer is created on it at NULL_TO_READY */
+  VfMetalDeviceSelection device;
 
   /* Metal rendering engine (opaque Obj-C object, cast to MetalCompositorRenderer* in .m) */
   void *renderer;
@@ -109,11 +146,16 @@ struct _GstVfMetalCompositorPad
   gdouble alpha;
   guint zorder;
   GstVfMetalCompositorSizingPolicy sizing_policy;
+  GstVfMetalCompositorSizingQuality sizing_quality;
   GstVfMetalCompositorOperator op;
 
   /* Computed offsets for keep-aspect-ratio */
   gint x_offset;
   gint y_offset;
+
+  /* Buffer drawn in the last output frame, held so that a repeat of it
+   * can be recognised and its uploaded textures reused */
+  GstBuffer *last_buffer;
 };
 
 GST_ELEMENT_REGISTER_DECLARE (vfmetalcompositor);
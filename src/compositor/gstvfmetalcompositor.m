@@ -58,6 +58,8 @@
 #import <Foundation/Foundation.h>
 #include "gstvfmetalcompositor.h"
 #include "metalcomprenderer.h"
+#import "vfmetalmemory.h"
+#import "vfmetaltextureutil.h"
 
 GST_DEBUG_CATEGORY (gst_vf_metal_compositor_debug);
 #define GST_CAT_DEFAULT gst_vf_metal_compositor_debug
@@ -68,13 +70,13 @@ GST_DEBUG_CATEGORY (gst_vf_metal_compositor_debug);
 static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (VF_METAL_COMPOSITOR_SRC_FORMATS))
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_COMPOSITOR_SRC_FORMATS))
     );
 
 static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink_%u",
     GST_PAD_SINK,
     GST_PAD_REQUEST,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (VF_METAL_COMPOSITOR_SINK_FORMATS))
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_COMPOSITOR_SINK_FORMATS))
     );
 
 static void gst_vf_metal_compositor_child_proxy_init (gpointer g_iface,
@@ -144,6 +146,30 @@ gst_vf_metal_compositor_sizing_policy_get_type (void)
   return type_value;
 }
 
+#define GST_TYPE_VF_METAL_COMPOSITOR_SIZING_QUALITY (gst_vf_metal_compositor_sizing_quality_get_type())
+GType
+gst_vf_metal_compositor_sizing_quality_get_type (void)
+{
+  static gsize type_value = 0;
+  static const GEnumValue values[] = {
+    {VF_METAL_COMPOSITOR_SIZING_QUALITY_NEAREST, "Nearest neighbour",
+        "nearest"},
+    {VF_METAL_COMPOSITOR_SIZING_QUALITY_LINEAR, "Bilinear", "linear"},
+    {VF_METAL_COMPOSITOR_SIZING_QUALITY_MIPMAPPED,
+        "Mipmapped: downscale through a mip chain into a cached tile",
+        "mipmapped"},
+    {VF_METAL_COMPOSITOR_SIZING_QUALITY_BOX,
+        "Box: area-average downscale into a cached tile", "box"},
+    {0, NULL, NULL},
+  };
+  if (g_once_init_enter (&type_value)) {
+    GType t =
+        g_enum_register_static ("GstVfMetalCompositorSizingQuality", values);
+    g_once_init_leave (&type_value, t);
+  }
+  return type_value;
+}
+
 /* --- Element property IDs --- */
 
 enum
@@ -152,18 +178,25 @@ enum
   PROP_BACKGROUND,
   PROP_ZERO_SIZE_IS_UNSCALED,
   PROP_IGNORE_INACTIVE_PADS,
+  PROP_IN_FLIGHT,
+  PROP_UPLOAD_THREADS,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_DEVICE,
 };
 
 #define DEFAULT_BACKGROUND VF_METAL_COMPOSITOR_BACKGROUND_CHECKER
 #define DEFAULT_ZERO_SIZE_IS_UNSCALED TRUE
+#define DEFAULT_UPLOAD_THREADS 0
+#define MAX_UPLOAD_THREADS 64
 
 /* --- Forward declarations --- */
 
 void gst_vf_metal_compositor_pad_get_output_size (GstVfMetalCompositor * comp,
     GstVfMetalCompositorPad * comp_pad, gint out_par_n, gint out_par_d,
     gint * width, gint * height, gint * x_offset, gint * y_offset);
-gboolean gst_vf_metal_compositor_pad_obscures_rectangle (GstVideoAggregator * vagg,
-    GstVideoAggregatorPad * pad, const GstVideoRectangle rect);
+gboolean gst_vf_metal_compositor_rectangle_is_obscured (GstVideoAggregator *
+    vagg, GList * pads, const GstVideoRectangle rect);
 static gboolean _should_draw_background (GstVideoAggregator * vagg);
 
 /* --- GType boilerplate --- */
@@ -188,17 +221,6 @@ is_point_contained (const GstVideoRectangle rect, const gint px, const gint py)
   return FALSE;
 }
 
-static gboolean
-is_rectangle_contained (const GstVideoRectangle rect1,
-    const GstVideoRectangle rect2)
-{
-  if ((rect2.x <= rect1.x) && (rect2.y <= rect1.y) &&
-      ((rect2.x + rect2.w) >= (rect1.x + rect1.w)) &&
-      ((rect2.y + rect2.h) >= (rect1.y + rect1.h)))
-    return TRUE;
-  return FALSE;
-}
-
 void
 gst_vf_metal_compositor_pad_get_output_size (GstVfMetalCompositor * comp,
     GstVfMetalCompositorPad * comp_pad, gint out_par_n, gint out_par_d,
@@ -324,44 +346,139 @@ gst_vf_metal_compositor_pad_get_output_size (GstVfMetalCompositor * comp,
   *height = pad_height;
 }
 
-/* Call this with the lock taken */
-gboolean
-gst_vf_metal_compositor_pad_obscures_rectangle (GstVideoAggregator * vagg,
-    GstVideoAggregatorPad * pad, const GstVideoRectangle rect)
+/* Whether @pad hides everything below it inside its rectangle: "source"
+ * replaces the destination whatever the alpha, "over" only when the pad
+ * and its frame are opaque, "add" never */
+static gboolean
+gst_vf_metal_compositor_pad_get_opaque_rect (GstVideoAggregator * vagg,
+    GstVideoAggregatorPad * pad, GstVideoRectangle * pad_rect)
 {
-  GstVideoRectangle pad_rect;
   GstVfMetalCompositorPad *cpad = GST_VF_METAL_COMPOSITOR_PAD (pad);
+  GstBuffer *buffer;
   gint x_offset, y_offset;
 
-  if (!gst_video_aggregator_pad_has_current_buffer (pad))
+  /* Not drawn at all, see prepare_frame_start */
+  if (cpad->alpha == 0.0 ||
+      gst_aggregator_pad_is_inactive (GST_AGGREGATOR_PAD (pad)))
     return FALSE;
 
-  if (cpad->alpha != 1.0 || GST_VIDEO_INFO_HAS_ALPHA (&pad->info))
+  buffer = gst_video_aggregator_pad_get_current_buffer (pad);
+  if (!buffer || (gst_buffer_get_size (buffer) == 0 &&
+          GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP)))
     return FALSE;
 
-  pad_rect.x = cpad->xpos;
-  pad_rect.y = cpad->ypos;
-  gst_vf_metal_compositor_pad_get_output_size (GST_VF_METAL_COMPOSITOR (vagg), cpad,
-      GST_VIDEO_INFO_PAR_N (&vagg->info), GST_VIDEO_INFO_PAR_D (&vagg->info),
-      &(pad_rect.w), &(pad_rect.h), &x_offset, &y_offset);
-  pad_rect.x += x_offset;
-  pad_rect.y += y_offset;
+  switch (cpad->op) {
+    case VF_METAL_COMPOSITOR_OPERATOR_SOURCE:
+      break;
+    case VF_METAL_COMPOSITOR_OPERATOR_OVER:
+      if (cpad->alpha != 1.0 || GST_VIDEO_INFO_HAS_ALPHA (&pad->info))
+        return FALSE;
+      break;
+    default:
+      return FALSE;
+  }
 
-  if (!is_rectangle_contained (rect, pad_rect))
-    return FALSE;
+  gst_vf_metal_compositor_pad_get_output_size (GST_VF_METAL_COMPOSITOR (vagg),
+      cpad, GST_VIDEO_INFO_PAR_N (&vagg->info),
+      GST_VIDEO_INFO_PAR_D (&vagg->info), &pad_rect->w, &pad_rect->h,
+      &x_offset, &y_offset);
+  pad_rect->x = cpad->xpos + x_offset;
+  pad_rect->y = cpad->ypos + y_offset;
 
-  GST_DEBUG_OBJECT (pad, "Pad %s %ix%i@(%i,%i) obscures rect %ix%i@(%i,%i)",
-      GST_PAD_NAME (pad), pad_rect.w, pad_rect.h, pad_rect.x, pad_rect.y,
-      rect.w, rect.h, rect.x, rect.y);
+  return pad_rect->w > 0 && pad_rect->h > 0;
+}
 
-  return TRUE;
+/* Subtract @cut from @rect, appending the up to four remaining pieces */
+static void
+subtract_rectangle (GArray * out, const GstVideoRectangle rect,
+    const GstVideoRectangle cut)
+{
+  gint x1 = MAX (rect.x, cut.x);
+  gint y1 = MAX (rect.y, cut.y);
+  gint x2 = MIN (rect.x + rect.w, cut.x + cut.w);
+  gint y2 = MIN (rect.y + rect.h, cut.y + cut.h);
+  GstVideoRectangle piece;
+
+  if (x1 >= x2 || y1 >= y2) {
+    g_array_append_val (out, rect);
+    return;
+  }
+
+  /* Full-width bands above and below, then the sides of the overlap */
+  if (y1 > rect.y) {
+    piece = (GstVideoRectangle) { rect.x, rect.y, rect.w, y1 - rect.y };
+    g_array_append_val (out, piece);
+  }
+  if (y2 < rect.y + rect.h) {
+    piece = (GstVideoRectangle) { rect.x, y2, rect.w, rect.y + rect.h - y2 };
+    g_array_append_val (out, piece);
+  }
+  if (x1 > rect.x) {
+    piece = (GstVideoRectangle) { rect.x, y1, x1 - rect.x, y2 - y1 };
+    g_array_append_val (out, piece);
+  }
+  if (x2 < rect.x + rect.w) {
+    piece = (GstVideoRectangle) { x2, y1, rect.x + rect.w - x2, y2 - y1 };
+    g_array_append_val (out, piece);
+  }
+}
+
+/* Upper bound on the pieces tracked while subtracting; past it the
+ * rectangle is assumed visible */
+#define MAX_VISIBLE_PIECES 64
+
+/* Whether the opaque pads in @pads (the pads above the rectangle's owner)
+ * cover @rect between them. Call this with the lock taken */
+gboolean
+gst_vf_metal_compositor_rectangle_is_obscured (GstVideoAggregator * vagg,
+    GList * pads, const GstVideoRectangle rect)
+{
+  GArray *visible, *next;
+  gboolean obscured = FALSE;
+  GList *l;
+
+  visible = g_array_new (FALSE, FALSE, sizeof (GstVideoRectangle));
+  next = g_array_new (FALSE, FALSE, sizeof (GstVideoRectangle));
+  g_array_append_val (visible, rect);
+
+  for (l = pads; l; l = l->next) {
+    GstVideoRectangle pad_rect;
+    GArray *tmp;
+
+    if (!gst_vf_metal_compositor_pad_get_opaque_rect (vagg, l->data,
+            &pad_rect))
+      continue;
+
+    g_array_set_size (next, 0);
+    for (guint i = 0; i < visible->len; i++)
+      subtract_rectangle (next, g_array_index (visible, GstVideoRectangle, i),
+          pad_rect);
+
+    tmp = visible;
+    visible = next;
+    next = tmp;
+
+    if (visible->len == 0) {
+      GST_DEBUG_OBJECT (vagg, "Rect %ix%i@(%i,%i) obscured (last by %s)",
+          rect.w, rect.h, rect.x, rect.y, GST_PAD_NAME (l->data));
+      obscured = TRUE;
+      break;
+    }
+    if (visible->len > MAX_VISIBLE_PIECES)
+      break;
+  }
+
+  g_array_unref (visible);
+  g_array_unref (next);
+  return obscured;
 }
 
 static gboolean
 _should_draw_background (GstVideoAggregator * vagg)
 {
   GstVideoRectangle bg_rect;
-  gboolean draw = TRUE;
+  GQueue pads = G_QUEUE_INIT;
+  gboolean draw;
   GList *l;
 
   bg_rect.x = bg_rect.y = 0;
@@ -374,13 +491,13 @@ _should_draw_background (GstVideoAggregator * vagg)
         || gst_video_aggregator_pad_get_prepared_frame (
                GST_VIDEO_AGGREGATOR_PAD (l->data)) == NULL)
       continue;
-
-    if (gst_vf_metal_compositor_pad_obscures_rectangle (vagg, l->data, bg_rect)) {
-      draw = FALSE;
-      break;
-    }
+    g_queue_push_tail (&pads, l->data);
   }
+  draw = !gst_vf_metal_compositor_rectangle_is_obscured (vagg, pads.head,
+      bg_rect);
   GST_OBJECT_UNLOCK (vagg);
+
+  g_queue_clear (&pads);
   return draw;
 }
 
@@ -434,16 +551,12 @@ _update_caps (GstVideoAggregator * vagg, GstCaps * caps)
    * internally to BGRA and converts to the negotiated output format via
    * compute shaders, so any supported output format is valid.  Format
    * preference (BGRA) is handled in _fixate_caps instead. */
-  ret = gst_caps_new_simple ("video/x-raw",
+  /* Set the size on every template structure so both the GPU memory and
+   * the system memory variants stay available to downstream. */
+  ret = gst_caps_make_writable (gst_static_pad_template_get_caps (&src_factory));
+  gst_caps_set_simple (ret,
       "width", G_TYPE_INT, best_width,
       "height", G_TYPE_INT, best_height, NULL);
-  {
-    GstCaps *template_caps = gst_static_pad_template_get_caps (&src_factory);
-    GstCaps *tmp = gst_caps_intersect (ret, template_caps);
-    gst_caps_unref (ret);
-    gst_caps_unref (template_caps);
-    ret = tmp;
-  }
 
   /* Intersect with downstream caps to ensure we're a valid subset */
   if (caps) {
@@ -539,6 +652,128 @@ _fixate_caps (GstAggregator * agg, GstCaps * caps)
   return ret;
 }
 
+/* --- Pipelined submission (in-flight > 1) --- */
+
+static GstFlowReturn
+gst_vf_metal_compositor_finish_job (GstVfMetalCompositor * self,
+    VfMetalInflightJob * job)
+{
+  GstBuffer *outbuf = vf_metal_inflight_job_finish (job);
+
+  if (!outbuf) {
+    GST_ERROR_OBJECT (self, "Metal compositing failed");
+    return GST_FLOW_ERROR;
+  }
+
+  return GST_AGGREGATOR_CLASS (parent_class)->finish_buffer (
+      GST_AGGREGATOR (self), outbuf);
+}
+
+/* Push every queued frame downstream, in order */
+static GstFlowReturn
+gst_vf_metal_compositor_drain (GstVfMetalCompositor * self)
+{
+  VfMetalInflightJob *job;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  while ((job = vf_metal_inflight_pop (&self->inflight, TRUE))) {
+    if (ret != GST_FLOW_OK) {
+      vf_metal_inflight_job_free (job);
+      continue;
+    }
+    ret = gst_vf_metal_compositor_finish_job (self, job);
+  }
+
+  return ret;
+}
+
+/* aggregate_frames already queued @buffer's job with its own ref: push
+ * the slot it had to wait for plus whatever else the GPU has finished */
+static GstFlowReturn
+gst_vf_metal_compositor_finish_buffer (GstAggregator * agg, GstBuffer * buffer)
+{
+  GstVfMetalCompositor *self = GST_VF_METAL_COMPOSITOR (agg);
+  VfMetalInflightJob *job, *ready = self->ready;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  self->ready = NULL;
+
+  if (ready)
+    ret = gst_vf_metal_compositor_finish_job (self, ready);
+
+  if (buffer != self->submitted) {
+    /* Not rendered by us (e.g. a gap buffer): keep it behind the queue */
+    if (ret == GST_FLOW_OK)
+      ret = gst_vf_metal_compositor_drain (self);
+    if (ret != GST_FLOW_OK) {
+      gst_buffer_unref (buffer);
+      return ret;
+    }
+    return GST_AGGREGATOR_CLASS (parent_class)->finish_buffer (agg, buffer);
+  }
+
+  self->submitted = NULL;
+  gst_buffer_unref (buffer);
+
+  while (ret == GST_FLOW_OK &&
+      (job = vf_metal_inflight_pop (&self->inflight, FALSE)))
+    ret = gst_vf_metal_compositor_finish_job (self, job);
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_vf_metal_compositor_aggregate (GstAggregator * agg, gboolean timeout)
+{
+  GstVfMetalCompositor *self = GST_VF_METAL_COMPOSITOR (agg);
+  GstFlowReturn ret;
+
+  ret = GST_AGGREGATOR_CLASS (parent_class)->aggregate (agg, timeout);
+
+  /* aggregate_frames waited for a slot but failed before finish_buffer */
+  if (self->ready) {
+    gst_vf_metal_compositor_finish_job (self, self->ready);
+    self->ready = NULL;
+  }
+  self->submitted = NULL;
+
+  /* Queued frames must go out ahead of EOS */
+  if (ret == GST_FLOW_EOS) {
+    GstFlowReturn drain_ret = gst_vf_metal_compositor_drain (self);
+    if (drain_ret != GST_FLOW_OK)
+      ret = drain_ret;
+  }
+
+  return ret;
+}
+
+static gboolean
+gst_vf_metal_compositor_start (GstAggregator * agg)
+{
+  GstVfMetalCompositor *self = GST_VF_METAL_COMPOSITOR (agg);
+  guint in_flight;
+
+  GST_OBJECT_LOCK (self);
+  in_flight = self->in_flight;
+  GST_OBJECT_UNLOCK (self);
+  vf_metal_inflight_start (&self->inflight, in_flight);
+  vf_metal_stats_reset (&self->stats);
+
+  return GST_AGGREGATOR_CLASS (parent_class)->start (agg);
+}
+
+static GstFlowReturn
+gst_vf_metal_compositor_flush (GstAggregator * agg)
+{
+  GstVfMetalCompositor *self = GST_VF_METAL_COMPOSITOR (agg);
+
+  vf_metal_inflight_stop (&self->inflight);
+  gst_vf_metal_compositor_release_last_buffers (self);
+  vf_metal_stats_reset (&self->stats);
+
+  return GST_AGGREGATOR_CLASS (parent_class)->flush (agg);
+}
+
 /* --- Negotiated caps --- */
 
 static gboolean
@@ -557,6 +792,10 @@ _negotiated_caps (GstAggregator * agg, GstCaps * caps)
     return FALSE;
   }
 
+  /* Frames still on the GPU were rendered for the old caps */
+  if (gst_vf_metal_compositor_drain (self) != GST_FLOW_OK)
+    GST_DEBUG_OBJECT (agg, "drain before renegotiation failed");
+
   MetalCompositorRenderer *renderer =
       (__bridge MetalCompositorRenderer *)self->renderer;
   if (![renderer configureWithWidth:GST_VIDEO_INFO_WIDTH (&v_info)
@@ -566,11 +805,61 @@ _negotiated_caps (GstAggregator * agg, GstCaps * caps)
     return FALSE;
   }
 
+  /* Each queued frame delays output by one frame duration */
+  if (vf_metal_inflight_is_pipelined (&self->inflight) &&
+      GST_VIDEO_INFO_FPS_N (&v_info) > 0 && GST_VIDEO_INFO_FPS_D (&v_info) > 0) {
+    GstClockTime latency = gst_util_uint64_scale_int (GST_SECOND *
+        (self->inflight.depth - 1), GST_VIDEO_INFO_FPS_D (&v_info),
+        GST_VIDEO_INFO_FPS_N (&v_info));
+    gst_aggregator_set_latency (agg, latency, latency);
+  } else {
+    gst_aggregator_set_latency (agg, 0, 0);
+  }
+
   return GST_AGGREGATOR_CLASS (parent_class)->negotiated_src_caps (agg, caps);
 }
 
 /* --- aggregate_frames --- */
 
+/* Whether @buffer carries the same content as the pad's last drawn buffer.
+ * The held reference keeps that buffer out of its pool and its memory
+ * read-only, so the same buffer, or a new one wrapping the same memory
+ * (imagefreeze, a repeated still), cannot have been rewritten since. */
+static gboolean
+gst_vf_metal_compositor_pad_buffer_unchanged (GstVfMetalCompositorPad * cpad,
+    GstBuffer * buffer)
+{
+  GstBuffer *last = cpad->last_buffer;
+  guint n;
+
+  if (!last)
+    return FALSE;
+  if (last == buffer)
+    return TRUE;
+
+  n = gst_buffer_n_memory (buffer);
+  if (n == 0 || n != gst_buffer_n_memory (last))
+    return FALSE;
+  for (guint i = 0; i < n; i++) {
+    if (gst_buffer_peek_memory (buffer, i) != gst_buffer_peek_memory (last, i))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+static void
+gst_vf_metal_compositor_release_last_buffers (GstVfMetalCompositor * self)
+{
+  GList *l;
+
+  GST_OBJECT_LOCK (self);
+  for (l = GST_ELEMENT (self)->sinkpads; l; l = l->next) {
+    GstVfMetalCompositorPad *cpad = GST_VF_METAL_COMPOSITOR_PAD (l->data);
+    gst_buffer_replace (&cpad->last_buffer, NULL);
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
 static GstFlowReturn
 gst_vf_metal_compositor_aggregate_frames (GstVideoAggregator * vagg,
     GstBuffer * outbuf)
@@ -578,8 +867,11 @@ gst_vf_metal_compositor_aggregate_frames (GstVideoAggregator * vagg,
   GstVfMetalCompositor *self = GST_VF_METAL_COMPOSITOR (vagg);
   GList *l;
   GstVideoFrame out_frame;
+  GstVideoFrame *out = &out_frame;
+  VfMetalInflightJob *job = NULL;
   gboolean draw_background;
   guint n_pads = 0;
+  guint stats_interval;
 
   if (!self->renderer) {
     GST_ERROR_OBJECT (vagg, "Metal renderer not available");
@@ -589,14 +881,29 @@ gst_vf_metal_compositor_aggregate_frames (GstVideoAggregator * vagg,
   MetalCompositorRenderer *renderer =
       (__bridge MetalCompositorRenderer *)self->renderer;
 
-  if (!gst_video_frame_map (&out_frame, &vagg->info, outbuf, GST_MAP_WRITE)) {
+  /* Pipelined: the job keeps the output mapped until the GPU is done */
+  if (vf_metal_inflight_is_pipelined (&self->inflight)) {
+    job = vf_metal_inflight_job_new (&self->inflight, &self->ready);
+    job->held = g_ptr_array_new_with_free_func (
+        (GDestroyNotify) gst_buffer_unref);
+    out = &job->out_frame;
+  }
+
+  if (!gst_video_frame_map (out, &vagg->info, outbuf,
+          GST_MAP_WRITE | GST_MAP_VF_METAL)) {
     GST_WARNING_OBJECT (vagg, "Could not map output buffer");
+    if (job)
+      vf_metal_inflight_job_free (job);
     return GST_FLOW_ERROR;
   }
+  if (job)
+    job->out_mapped = TRUE;
 
   draw_background = _should_draw_background (vagg);
 
   GST_OBJECT_LOCK (vagg);
+  renderer.uploadConcurrency = self->upload_threads;
+  stats_interval = self->stats_interval;
   for (l = GST_ELEMENT (vagg)->sinkpads; l; l = l->next) {
     GstVideoAggregatorPad *pad = l->data;
     if (gst_video_aggregator_pad_get_prepared_frame (pad))
@@ -615,6 +922,10 @@ gst_vf_metal_compositor_aggregate_frames (GstVideoAggregator * vagg,
     GstVideoFrame *prepared_frame =
         gst_video_aggregator_pad_get_prepared_frame (pad);
 
+    /* Obscured or not drawn: let go of the held buffer */
+    if (!prepared_frame)
+      gst_buffer_replace (&cpad->last_buffer, NULL);
+
     if (prepared_frame) {
       gint width, height, x_offset, y_offset;
 
@@ -624,11 +935,26 @@ gst_vf_metal_compositor_aggregate_frames (GstVideoAggregator * vagg,
           &width, &height, &x_offset, &y_offset);
 
       inputs[i].frame = prepared_frame;
+
+      /* GPU-resident and CoreVideo inputs are sampled in place: keep
+       * their memory alive until the job completes */
+      if (job && (vf_metal_frame_peek_texture (prepared_frame, 0,
+                  renderer.metalDevice.device) ||
+              vf_metal_frame_get_pixel_buffer (prepared_frame)))
+        g_ptr_array_add (job->held, gst_buffer_ref (prepared_frame->buffer));
       inputs[i].xpos = cpad->xpos + x_offset;
       inputs[i].ypos = cpad->ypos + y_offset;
       inputs[i].width = width;
       inputs[i].height = height;
       inputs[i].alpha = cpad->alpha;
+      inputs[i].key = cpad;
+      inputs[i].unchanged = gst_vf_metal_compositor_pad_buffer_unchanged (cpad,
+          prepared_frame->buffer);
+      if (!inputs[i].unchanged)
+        gst_buffer_replace (&cpad->last_buffer, prepared_frame->buffer);
+
+      /* Same numbering as MetalSizingQuality */
+      inputs[i].quality = (MetalSizingQuality) cpad->sizing_quality;
 
       switch (cpad->op) {
         case VF_METAL_COMPOSITOR_OPERATOR_SOURCE:
@@ -666,11 +992,45 @@ gst_vf_metal_compositor_aggregate_frames (GstVideoAggregator * vagg,
     }
   }
 
+  if (job) {
+    BOOL submitted;
+
+    @autoreleasepool {
+      submitted = [renderer submitWithInputs:inputs
+                                       count:i
+                                  background:bg
+                                    outFrame:out
+                                        slot:job->slot
+                                  completion:vf_metal_inflight_job_completion (
+                                      &self->inflight, job)];
+    }
+    g_free (inputs);
+
+    vf_metal_stats_add_frame (&self->stats, outbuf, !submitted);
+    vf_metal_stats_post (&self->stats, GST_ELEMENT (self), stats_interval);
+
+    if (!submitted) {
+      GST_ERROR_OBJECT (vagg, "Metal compositing failed");
+      vf_metal_inflight_job_free (job);
+      return GST_FLOW_ERROR;
+    }
+
+    job->outbuf = gst_buffer_ref (outbuf);
+    vf_metal_inflight_queue (&self->inflight, job);
+    self->submitted = outbuf;
+    return GST_FLOW_OK;
+  }
+
   @autoreleasepool {
-    if (![renderer compositeWithInputs:inputs
-                                 count:i
-                            background:bg
-                              outFrame:&out_frame]) {
+    BOOL ok = [renderer compositeWithInputs:inputs
+                                      count:i
+                                 background:bg
+                                   outFrame:&out_frame];
+
+    vf_metal_stats_add_frame (&self->stats, outbuf, !ok);
+    vf_metal_stats_post (&self->stats, GST_ELEMENT (self), stats_interval);
+
+    if (!ok) {
       GST_ERROR_OBJECT (vagg, "Metal compositing failed");
       gst_video_frame_unmap (&out_frame);
       g_free (inputs);
@@ -690,6 +1050,9 @@ gst_vf_metal_compositor_stop (GstAggregator * agg)
 {
   GstVfMetalCompositor *self = GST_VF_METAL_COMPOSITOR (agg);
 
+  vf_metal_inflight_stop (&self->inflight);
+  gst_vf_metal_compositor_release_last_buffers (self);
+
   if (self->renderer) {
     @autoreleasepool {
       MetalCompositorRenderer *renderer =
@@ -791,7 +1154,14 @@ _src_event (GstAggregator * agg, GstEvent * event)
 static gboolean
 _sink_query (GstAggregator * agg, GstAggregatorPad * bpad, GstQuery * query)
 {
+  GstVfMetalCompositor *self = GST_VF_METAL_COMPOSITOR (agg);
+
   switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CONTEXT:
+      if (vf_metal_device_selection_handle_query (GST_ELEMENT (agg),
+              &self->device, query))
+        return TRUE;
+      return GST_AGGREGATOR_CLASS (parent_class)->sink_query (agg, bpad, query);
     case GST_QUERY_CAPS:{
       GstCaps *filter, *sinkcaps;
 
@@ -820,6 +1190,11 @@ _sink_query (GstAggregator * agg, GstAggregatorPad * bpad, GstQuery * query)
       if (caps == NULL)
         return FALSE;
 
+      /* GPU memory pads: upstream renders straight into our textures */
+      if (gst_vf_metal_caps_has_memory_feature (caps))
+        return gst_vf_metal_memory_propose_allocation (query,
+            ((__bridge MetalCompositorRenderer *)self->renderer).metalDevice);
+
       if (!gst_video_info_from_caps (&info, caps))
         return FALSE;
 
@@ -845,6 +1220,37 @@ _sink_query (GstAggregator * agg, GstAggregatorPad * bpad, GstQuery * query)
   }
 }
 
+/* --- Source query (device context) --- */
+
+static gboolean
+_src_query (GstAggregator * agg, GstQuery * query)
+{
+  GstVfMetalCompositor *self = GST_VF_METAL_COMPOSITOR (agg);
+
+  if (GST_QUERY_TYPE (query) == GST_QUERY_CONTEXT &&
+      vf_metal_device_selection_handle_query (GST_ELEMENT (agg),
+          &self->device, query))
+    return TRUE;
+
+  return GST_AGGREGATOR_CLASS (parent_class)->src_query (agg, query);
+}
+
+/* --- Output allocation --- */
+
+static gboolean
+_decide_allocation (GstAggregator * agg, GstQuery * query)
+{
+  GstVfMetalCompositor *self = GST_VF_METAL_COMPOSITOR (agg);
+
+  if (!gst_vf_metal_memory_decide_allocation (query,
+          ((__bridge MetalCompositorRenderer *)self->renderer).metalDevice))
+    return FALSE;
+
+  vf_metal_inflight_adjust_allocation (&self->inflight, query);
+
+  return GST_AGGREGATOR_CLASS (parent_class)->decide_allocation (agg, query);
+}
+
 /* --- Pad management --- */
 
 static GstPad *
@@ -908,6 +1314,28 @@ gst_vf_metal_compositor_get_property (GObject * object, guint prop_id,
       g_value_set_boolean (value,
           gst_aggregator_get_ignore_inactive_pads (GST_AGGREGATOR (object)));
       break;
+    case PROP_IN_FLIGHT:
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint (value, self->in_flight);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_UPLOAD_THREADS:
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint (value, self->upload_threads);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, vf_metal_stats_get_structure (&self->stats));
+      break;
+    case PROP_STATS_INTERVAL:
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint (value, self->stats_interval);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_DEVICE:
+      vf_metal_device_selection_get_property (GST_ELEMENT (self),
+          &self->device, value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -931,12 +1359,106 @@ gst_vf_metal_compositor_set_property (GObject * object, guint prop_id,
       gst_aggregator_set_ignore_inactive_pads (GST_AGGREGATOR (object),
           g_value_get_boolean (value));
       break;
+    case PROP_IN_FLIGHT:
+      GST_OBJECT_LOCK (self);
+      self->in_flight = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_UPLOAD_THREADS:
+      GST_OBJECT_LOCK (self);
+      self->upload_threads = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_STATS_INTERVAL:
+      GST_OBJECT_LOCK (self);
+      self->stats_interval = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_DEVICE:
+      vf_metal_device_selection_set_property (GST_ELEMENT (self),
+          &self->device, value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
 }
 
+/* --- Device --- */
+
+static void
+gst_vf_metal_compositor_set_context (GstElement * element,
+    GstContext * context)
+{
+  GstVfMetalCompositor *self = GST_VF_METAL_COMPOSITOR (element);
+
+  vf_metal_device_selection_set_context (element, &self->device, context);
+
+  GST_ELEMENT_CLASS (parent_class)->set_context (element, context);
+}
+
+/* Renderer on the selected GPU, replaced when the selection moved */
+static gboolean
+gst_vf_metal_compositor_ensure_renderer (GstVfMetalCompositor * self)
+{
+  VfMetalDevice *device;
+
+  device = vf_metal_device_selection_ensure (GST_ELEMENT (self),
+      &self->device);
+  if (!device)
+    return FALSE;
+
+  @autoreleasepool {
+    if (self->renderer) {
+      MetalCompositorRenderer *renderer =
+          (__bridge MetalCompositorRenderer *)self->renderer;
+      if (renderer.metalDevice == device)
+        return TRUE;
+
+      renderer = (__bridge_transfer MetalCompositorRenderer *)self->renderer;
+      self->renderer = NULL;
+      [renderer cleanup];
+    }
+
+    MetalCompositorRenderer *renderer =
+        [[MetalCompositorRenderer alloc] initWithDevice:device];
+    if (!renderer) {
+      GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+          ("Failed to create Metal renderer on '%s'",
+              device.device.name.UTF8String), (NULL));
+      return FALSE;
+    }
+    renderer.stats = &self->stats;
+    renderer.traceOwner = GST_OBJECT (self);
+    self->renderer = (__bridge_retained void *)renderer;
+  }
+
+  return TRUE;
+}
+
+/* --- State change --- */
+
+static GstStateChangeReturn
+gst_vf_metal_compositor_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstVfMetalCompositor *self = GST_VF_METAL_COMPOSITOR (element);
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY &&
+      !gst_vf_metal_compositor_ensure_renderer (self))
+    return GST_STATE_CHANGE_FAILURE;
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    return ret;
+
+  if (transition == GST_STATE_CHANGE_READY_TO_NULL)
+    vf_metal_device_selection_reset (element, &self->device);
+
+  return ret;
+}
+
 /* --- Finalize --- */
 
 static void
@@ -954,6 +1476,10 @@ gst_vf_metal_compositor_finalize (GObject * object)
     }
   }
 
+  vf_metal_inflight_clear (&self->inflight);
+  vf_metal_stats_clear (&self->stats);
+  vf_metal_device_selection_clear (&self->device);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -1020,12 +1546,23 @@ gst_vf_metal_compositor_class_init (GstVfMetalCompositorClass * klass)
       GST_DEBUG_FUNCPTR (gst_vf_metal_compositor_request_new_pad);
   gstelement_class->release_pad =
       GST_DEBUG_FUNCPTR (gst_vf_metal_compositor_release_pad);
+  gstelement_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_compositor_change_state);
+  gstelement_class->set_context =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_compositor_set_context);
 
   agg_class->sink_query = GST_DEBUG_FUNCPTR (_sink_query);
+  agg_class->src_query = GST_DEBUG_FUNCPTR (_src_query);
   agg_class->src_event = GST_DEBUG_FUNCPTR (_src_event);
   agg_class->fixate_src_caps = GST_DEBUG_FUNCPTR (_fixate_caps);
   agg_class->negotiated_src_caps = GST_DEBUG_FUNCPTR (_negotiated_caps);
   agg_class->stop = GST_DEBUG_FUNCPTR (gst_vf_metal_compositor_stop);
+  agg_class->decide_allocation = GST_DEBUG_FUNCPTR (_decide_allocation);
+  agg_class->start = GST_DEBUG_FUNCPTR (gst_vf_metal_compositor_start);
+  agg_class->flush = GST_DEBUG_FUNCPTR (gst_vf_metal_compositor_flush);
+  agg_class->aggregate = GST_DEBUG_FUNCPTR (gst_vf_metal_compositor_aggregate);
+  agg_class->finish_buffer =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_compositor_finish_buffer);
 
   videoaggregator_class->update_caps =
       GST_DEBUG_FUNCPTR (_update_caps);
@@ -1050,6 +1587,42 @@ gst_vf_metal_compositor_class_init (GstVfMetalCompositorClass * klass)
           "Avoid timing out waiting for inactive pads", FALSE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_IN_FLIGHT,
+      g_param_spec_uint ("in-flight", "In-flight frames",
+          "Frames queued on the GPU before the oldest is pushed downstream "
+          "(1 = wait for every frame; each extra frame adds one frame of "
+          "latency)",
+          1, VF_METAL_MAX_IN_FLIGHT, VF_METAL_DEFAULT_IN_FLIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_UPLOAD_THREADS,
+      g_param_spec_uint ("upload-threads", "Upload threads",
+          "Maximum number of threads copying system-memory input planes to "
+          "the GPU concurrently (0 = one per CPU core, 1 = copy on the "
+          "aggregator thread)",
+          0, MAX_UPLOAD_THREADS, DEFAULT_UPLOAD_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Output frames and dropped frames since start or flush, and the "
+          "average and 99th percentile of the upload, encode, GPU and "
+          "readback times of recent frames, in milliseconds",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint ("stats-interval", "Statistics interval",
+          "Post the statistics as a \"vfmetal-stats\" element message at "
+          "most this often, in milliseconds (0 = never)",
+          0, VF_METAL_STATS_MAX_INTERVAL, VF_METAL_STATS_DEFAULT_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_DEVICE,
+      vf_metal_device_selection_param_spec ());
+
   gst_element_class_add_static_pad_template_with_gtype (gstelement_class,
       &src_factory, GST_TYPE_AGGREGATOR_PAD);
   gst_element_class_add_static_pad_template_with_gtype (gstelement_class,
@@ -1064,6 +1637,7 @@ gst_vf_metal_compositor_class_init (GstVfMetalCompositorClass * klass)
   gst_type_mark_as_plugin_api (GST_TYPE_VF_METAL_COMPOSITOR_PAD, 0);
   gst_type_mark_as_plugin_api (GST_TYPE_VF_METAL_COMPOSITOR_OPERATOR, 0);
   gst_type_mark_as_plugin_api (GST_TYPE_VF_METAL_COMPOSITOR_BACKGROUND, 0);
+  gst_type_mark_as_plugin_api (GST_TYPE_VF_METAL_COMPOSITOR_SIZING_QUALITY, 0);
 
   GST_DEBUG_CATEGORY_INIT (gst_vf_metal_compositor_debug,
       "vfmetalcompositor", 0, "Metal video compositor");
@@ -1076,14 +1650,13 @@ gst_vf_metal_compositor_init (GstVfMetalCompositor * self)
 {
   self->background = DEFAULT_BACKGROUND;
   self->zero_size_is_unscaled = DEFAULT_ZERO_SIZE_IS_UNSCALED;
+  self->upload_threads = DEFAULT_UPLOAD_THREADS;
+  self->stats_interval = VF_METAL_STATS_DEFAULT_INTERVAL;
 
-  @autoreleasepool {
-    MetalCompositorRenderer *renderer =
-        [[MetalCompositorRenderer alloc] init];
-    if (renderer) {
-      self->renderer = (__bridge_retained void *)renderer;
-    } else {
-      GST_ERROR_OBJECT (self, "Failed to create Metal renderer — no Metal device");
-    }
-  }
+  self->in_flight = VF_METAL_DEFAULT_IN_FLIGHT;
+  vf_metal_inflight_init (&self->inflight);
+  vf_metal_stats_init (&self->stats);
+
+  /* The renderer waits for NULL_TO_READY, when the GPU is known */
+  vf_metal_device_selection_init (&self->device);
 }
@@ -20,6 +20,7 @@
  */
 
 #include "gstvfmetalcompositor.h"
+#import "vfmetalmemory.h"
 
 GST_DEBUG_CATEGORY_EXTERN (gst_vf_metal_compositor_debug);
 #define GST_CAT_DEFAULT gst_vf_metal_compositor_debug
@@ -37,6 +38,7 @@ enum
   PROP_PAD_OPERATOR,
   PROP_PAD_SIZING_POLICY,
   PROP_PAD_ZORDER,
+  PROP_PAD_SIZING_QUALITY,
 };
 
 #define DEFAULT_PAD_XPOS   0
@@ -47,6 +49,7 @@ enum
 #define DEFAULT_PAD_OPERATOR VF_METAL_COMPOSITOR_OPERATOR_OVER
 #define DEFAULT_PAD_SIZING_POLICY VF_METAL_COMPOSITOR_SIZING_POLICY_NONE
 #define DEFAULT_PAD_ZORDER 0
+#define DEFAULT_PAD_SIZING_QUALITY VF_METAL_COMPOSITOR_SIZING_QUALITY_LINEAR
 
 /* --- Forward declarations for enum types defined in the element file --- */
 
@@ -56,6 +59,9 @@ GType gst_vf_metal_compositor_operator_get_type (void);
 #define GST_TYPE_VF_METAL_COMPOSITOR_SIZING_POLICY (gst_vf_metal_compositor_sizing_policy_get_type())
 GType gst_vf_metal_compositor_sizing_policy_get_type (void);
 
+#define GST_TYPE_VF_METAL_COMPOSITOR_SIZING_QUALITY (gst_vf_metal_compositor_sizing_quality_get_type())
+GType gst_vf_metal_compositor_sizing_quality_get_type (void);
+
 /* Re-declare gst_vf_metal_compositor_pad_get_output_size from the element file */
 extern void gst_vf_metal_compositor_pad_get_output_size (GstVfMetalCompositor * comp,
     GstVfMetalCompositorPad * comp_pad, gint out_par_n, gint out_par_d,
@@ -96,6 +102,9 @@ gst_vf_metal_compositor_pad_get_property (GObject * object, guint prop_id,
     case PROP_PAD_SIZING_POLICY:
       g_value_set_enum (value, pad->sizing_policy);
       break;
+    case PROP_PAD_SIZING_QUALITY:
+      g_value_set_enum (value, pad->sizing_quality);
+      break;
     case PROP_PAD_ZORDER:
       g_value_set_uint (value, pad->zorder);
       break;
@@ -135,6 +144,9 @@ gst_vf_metal_compositor_pad_set_property (GObject * object, guint prop_id,
     case PROP_PAD_SIZING_POLICY:
       pad->sizing_policy = g_value_get_enum (value);
       break;
+    case PROP_PAD_SIZING_QUALITY:
+      pad->sizing_quality = g_value_get_enum (value);
+      break;
     case PROP_PAD_ZORDER:
       pad->zorder = g_value_get_uint (value);
       {
@@ -172,9 +184,9 @@ pad_clamp_rectangle (gint x, gint y, gint w, gint h, gint outer_width,
   return clamped;
 }
 
-/* Re-declare gst_vf_metal_compositor_pad_obscures_rectangle from the element file */
-extern gboolean gst_vf_metal_compositor_pad_obscures_rectangle (GstVideoAggregator * vagg,
-    GstVideoAggregatorPad * pad, const GstVideoRectangle rect);
+/* Re-declare gst_vf_metal_compositor_rectangle_is_obscured from the element file */
+extern gboolean gst_vf_metal_compositor_rectangle_is_obscured (GstVideoAggregator *
+    vagg, GList * pads, const GstVideoRectangle rect);
 
 static void
 gst_vf_metal_compositor_pad_prepare_frame_start (GstVideoAggregatorPad * pad,
@@ -215,31 +227,12 @@ gst_vf_metal_compositor_pad_prepare_frame_start (GstVideoAggregatorPad * pad,
     return;
   }
 
-  /* Check if this frame is obscured by a higher-zorder frame */
+  /* Check if this frame is obscured by the higher-zorder frames */
   GST_OBJECT_LOCK (vagg);
   l = g_list_find (GST_ELEMENT (vagg)->sinkpads, pad);
   if (l)
-    l = l->next;
-  for (; l; l = l->next) {
-    GstBuffer *pad_buffer;
-
-    pad_buffer =
-        gst_video_aggregator_pad_get_current_buffer (GST_VIDEO_AGGREGATOR_PAD
-        (l->data));
-
-    if (pad_buffer == NULL)
-      continue;
-
-    if (gst_buffer_get_size (pad_buffer) == 0 &&
-        GST_BUFFER_FLAG_IS_SET (pad_buffer, GST_BUFFER_FLAG_GAP)) {
-      continue;
-    }
-
-    if (gst_vf_metal_compositor_pad_obscures_rectangle (vagg, l->data, frame_rect)) {
-      frame_obscured = TRUE;
-      break;
-    }
-  }
+    frame_obscured = gst_vf_metal_compositor_rectangle_is_obscured (vagg,
+        l->next, frame_rect);
   GST_OBJECT_UNLOCK (vagg);
 
   if (frame_obscured)
@@ -249,7 +242,8 @@ gst_vf_metal_compositor_pad_prepare_frame_start (GstVideoAggregatorPad * pad,
    * class because GstVideoAggregatorPad's prepare_frame_start is NULL —
    * only GstVideoAggregatorConvertPad provides a default implementation.
    * We handle the mapping directly. */
-  if (!gst_video_frame_map (prepared_frame, &pad->info, buffer, GST_MAP_READ)) {
+  if (!gst_video_frame_map (prepared_frame, &pad->info, buffer,
+          GST_MAP_READ | GST_MAP_VF_METAL)) {
     GST_WARNING_OBJECT (pad, "Could not map input buffer");
   }
 }
@@ -267,6 +261,18 @@ gst_vf_metal_compositor_pad_prepare_frame_finish (GstVideoAggregatorPad * pad,
    * so clean_frame would try to unmap again causing double-free. */
 }
 
+/* --- finalize --- */
+
+static void
+gst_vf_metal_compositor_pad_finalize (GObject * object)
+{
+  GstVfMetalCompositorPad *pad = GST_VF_METAL_COMPOSITOR_PAD (object);
+
+  gst_buffer_replace (&pad->last_buffer, NULL);
+
+  G_OBJECT_CLASS (gst_vf_metal_compositor_pad_parent_class)->finalize (object);
+}
+
 /* --- class_init --- */
 
 static void
@@ -278,6 +284,7 @@ gst_vf_metal_compositor_pad_class_init (GstVfMetalCompositorPadClass * klass)
 
   gobject_class->set_property = gst_vf_metal_compositor_pad_set_property;
   gobject_class->get_property = gst_vf_metal_compositor_pad_get_property;
+  gobject_class->finalize = gst_vf_metal_compositor_pad_finalize;
 
   g_object_class_install_property (gobject_class, PROP_PAD_XPOS,
       g_param_spec_int ("xpos", "X Position", "X Position of the picture",
@@ -309,6 +316,12 @@ gst_vf_metal_compositor_pad_class_init (GstVfMetalCompositorPadClass * klass)
           "Sizing policy to use for image scaling",
           GST_TYPE_VF_METAL_COMPOSITOR_SIZING_POLICY, DEFAULT_PAD_SIZING_POLICY,
           G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_SIZING_QUALITY,
+      g_param_spec_enum ("sizing-quality", "Sizing quality",
+          "Filter used to scale the picture to its output size",
+          GST_TYPE_VF_METAL_COMPOSITOR_SIZING_QUALITY,
+          DEFAULT_PAD_SIZING_QUALITY,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
   g_object_class_install_property (gobject_class, PROP_PAD_ZORDER,
       g_param_spec_uint ("zorder", "Z-Order", "Z Order of the picture",
           0, G_MAXUINT, DEFAULT_PAD_ZORDER,
@@ -334,5 +347,6 @@ gst_vf_metal_compositor_pad_init (GstVfMetalCompositorPad * pad)
   pad->width = DEFAULT_PAD_WIDTH;
   pad->height = DEFAULT_PAD_HEIGHT;
   pad->sizing_policy = DEFAULT_PAD_SIZING_POLICY;
+  pad->sizing_quality = DEFAULT_PAD_SIZING_QUALITY;
   pad->zorder = DEFAULT_PAD_ZORDER;
 }
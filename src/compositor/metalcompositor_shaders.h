@@ -0,0 +1,263 @@
+/* Metal compositor shader source
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __METAL_COMPOSITOR_SHADERS_H__
+#define __METAL_COMPOSITOR_SHADERS_H__
+
+#import <Foundation/Foundation.h>
+
+/* Pads drawn by one instanced draw; each plane is a texture array of this
+ * size, so I420 (3 planes) stays within the 31 texture slots of a stage */
+#define VF_METAL_COMPOSITOR_BATCH 8
+
+/* Per-instance data matching shader CompositorInstance */
+typedef struct {
+    float rect[4];          /* x, y (top-left), w, h in NDC */
+    float alpha;
+    int32_t colorMatrix;
+    float padding[2];
+} VfMetalCompositorInstance;
+
+/* Compositor shader source — concatenated after kVfMetalCommonShaderSource.
+ * Contains the positioned-quad vertex shader, per-format fragment shaders
+ * with pad alpha (sampler chosen by the host per pad), their instanced
+ * variants drawing up to VF_METAL_COMPOSITOR_BATCH pads per draw, the
+ * pre-scaled tile fragment and box-downscale kernel, and the checkerboard
+ * background. */
+
+static NSString *const kCompositorShaderSource = @R"(
+
+// Vertex shader: transform quad position
+vertex VertexOut compositorVertex(
+    uint vid [[vertex_id]],
+    constant float4 *vertexData [[buffer(0)]]
+) {
+    VertexOut out;
+    float4 vd = vertexData[vid];
+    out.position = float4(vd.xy, 0.0, 1.0);
+    out.texcoord = vd.zw;
+    return out;
+}
+
+// Fragment shader: sample BGRA/RGBA texture with alpha
+fragment float4 compositorFragment(
+    VertexOut in [[stage_in]],
+    constant Uniforms &uniforms [[buffer(0)]],
+    texture2d<float> tex [[texture(0)]],
+    sampler s [[sampler(0)]]
+) {
+    float4 color = tex.sample(s, in.texcoord);
+    color.a *= uniforms.alpha;
+    color.rgb *= color.a;
+    return color;
+}
+
+// Fragment shader: pre-scaled tile, already premultiplied
+fragment float4 compositorFragmentPremultiplied(
+    VertexOut in [[stage_in]],
+    constant Uniforms &uniforms [[buffer(0)]],
+    texture2d<float> tex [[texture(0)]],
+    sampler s [[sampler(0)]]
+) {
+    return tex.sample(s, in.texcoord) * uniforms.alpha;
+}
+
+// Area-weighted downscale: each destination pixel averages the source
+// pixels it covers, weighted by how much of each one it covers
+kernel void compositorBoxDownscale(
+    texture2d<float, access::read> src [[texture(0)]],
+    texture2d<float, access::write> dst [[texture(1)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= dst.get_width() || gid.y >= dst.get_height())
+        return;
+
+    float2 srcSize = float2(src.get_width(), src.get_height());
+    float2 scale = srcSize / float2(dst.get_width(), dst.get_height());
+    float2 p0 = float2(gid) * scale;
+    float2 p1 = p0 + scale;
+    int2 i0 = int2(floor(p0));
+    int2 i1 = min(int2(ceil(p1)), int2(srcSize));
+
+    float4 sum = float4(0.0);
+    float weight = 0.0;
+    for (int y = i0.y; y < i1.y; y++) {
+        float wy = min(p1.y, float(y + 1)) - max(p0.y, float(y));
+        for (int x = i0.x; x < i1.x; x++) {
+            float w = wy * (min(p1.x, float(x + 1)) - max(p0.x, float(x)));
+            sum += src.read(uint2(x, y)) * w;
+            weight += w;
+        }
+    }
+    dst.write(sum / max(weight, 1e-6), gid);
+}
+
+// Fragment shader: NV12 (Y + interleaved UV)
+fragment float4 compositorFragmentNV12(
+    VertexOut in [[stage_in]],
+    constant Uniforms &uniforms [[buffer(0)]],
+    texture2d<float> yTex [[texture(0)]],
+    texture2d<float> uvTex [[texture(1)]],
+    sampler s [[sampler(0)]]
+) {
+    float y  = yTex.sample(s, in.texcoord).r;
+    float2 uv = uvTex.sample(s, in.texcoord).rg;
+    float3 rgb = yuvToRGB(y, uv.r, uv.g, uniforms.colorMatrix);
+    float4 color = float4(rgb, 1.0);
+    color.a *= uniforms.alpha;
+    color.rgb *= color.a;
+    return color;
+}
+
+// Fragment shader: I420 (Y + separate U + separate V)
+fragment float4 compositorFragmentI420(
+    VertexOut in [[stage_in]],
+    constant Uniforms &uniforms [[buffer(0)]],
+    texture2d<float> yTex [[texture(0)]],
+    texture2d<float> uTex [[texture(1)]],
+    texture2d<float> vTex [[texture(2)]],
+    sampler s [[sampler(0)]]
+) {
+    float y  = yTex.sample(s, in.texcoord).r;
+    float cb = uTex.sample(s, in.texcoord).r;
+    float cr = vTex.sample(s, in.texcoord).r;
+    float3 rgb = yuvToRGB(y, cb, cr, uniforms.colorMatrix);
+    float4 color = float4(rgb, 1.0);
+    color.a *= uniforms.alpha;
+    color.rgb *= color.a;
+    return color;
+}
+
+// --- Instanced pads: one quad per instance, textures indexed by it ---
+
+constant uint kCompositorBatch = 8;   // VF_METAL_COMPOSITOR_BATCH
+
+struct CompositorInstance {
+    float4 rect;        // x, y (top-left), w, h in NDC
+    float alpha;
+    int colorMatrix;
+    float2 padding;
+};
+
+struct CompositorInstanceOut {
+    float4 position [[position]];
+    float2 texcoord;
+    uint instance [[flat]];
+};
+
+vertex CompositorInstanceOut compositorInstancedVertex(
+    uint vid [[vertex_id]],
+    uint iid [[instance_id]],
+    constant CompositorInstance *instances [[buffer(1)]]
+) {
+    float2 corner = float2(vid & 1, vid >> 1);
+    float4 rect = instances[iid].rect;
+    CompositorInstanceOut out;
+    out.position = float4(rect.xy + corner * float2(rect.z, -rect.w),
+                          0.0, 1.0);
+    out.texcoord = corner;
+    out.instance = iid;
+    return out;
+}
+
+static float4 compositorPremultiply(float4 color, float alpha) {
+    color.a *= alpha;
+    color.rgb *= color.a;
+    return color;
+}
+
+fragment float4 compositorInstancedFragment(
+    CompositorInstanceOut in [[stage_in]],
+    constant CompositorInstance *instances [[buffer(0)]],
+    array<texture2d<float>, kCompositorBatch> tex [[texture(0)]],
+    sampler s [[sampler(0)]]
+) {
+    float4 color = tex[in.instance].sample(s, in.texcoord);
+    return compositorPremultiply(color, instances[in.instance].alpha);
+}
+
+fragment float4 compositorInstancedFragmentNV12(
+    CompositorInstanceOut in [[stage_in]],
+    constant CompositorInstance *instances [[buffer(0)]],
+    array<texture2d<float>, kCompositorBatch> yTex [[texture(0)]],
+    array<texture2d<float>, kCompositorBatch> uvTex [[texture(8)]],
+    sampler s [[sampler(0)]]
+) {
+    constant CompositorInstance &inst = instances[in.instance];
+    float y  = yTex[in.instance].sample(s, in.texcoord).r;
+    float2 uv = uvTex[in.instance].sample(s, in.texcoord).rg;
+    float3 rgb = yuvToRGB(y, uv.r, uv.g, inst.colorMatrix);
+    return compositorPremultiply(float4(rgb, 1.0), inst.alpha);
+}
+
+fragment float4 compositorInstancedFragmentI420(
+    CompositorInstanceOut in [[stage_in]],
+    constant CompositorInstance *instances [[buffer(0)]],
+    array<texture2d<float>, kCompositorBatch> yTex [[texture(0)]],
+    array<texture2d<float>, kCompositorBatch> uTex [[texture(8)]],
+    array<texture2d<float>, kCompositorBatch> vTex [[texture(16)]],
+    sampler s [[sampler(0)]]
+) {
+    constant CompositorInstance &inst = instances[in.instance];
+    float y  = yTex[in.instance].sample(s, in.texcoord).r;
+    float cb = uTex[in.instance].sample(s, in.texcoord).r;
+    float cr = vTex[in.instance].sample(s, in.texcoord).r;
+    float3 rgb = yuvToRGB(y, cb, cr, inst.colorMatrix);
+    return compositorPremultiply(float4(rgb, 1.0), inst.alpha);
+}
+
+fragment float4 compositorInstancedFragmentPremultiplied(
+    CompositorInstanceOut in [[stage_in]],
+    constant CompositorInstance *instances [[buffer(0)]],
+    array<texture2d<float>, kCompositorBatch> tex [[texture(0)]],
+    sampler s [[sampler(0)]]
+) {
+    return tex[in.instance].sample(s, in.texcoord) *
+        instances[in.instance].alpha;
+}
+
+// Checker background
+vertex VertexOut checkerVertex(uint vid [[vertex_id]]) {
+    float2 positions[4] = {
+        float2(-1, -1),
+        float2( 1, -1),
+        float2(-1,  1),
+        float2( 1,  1)
+    };
+    VertexOut out;
+    out.position = float4(positions[vid], 0.0, 1.0);
+    out.texcoord = (positions[vid] + 1.0) * 0.5;
+    out.texcoord.y = 1.0 - out.texcoord.y;
+    return out;
+}
+
+fragment float4 checkerFragment(
+    VertexOut in [[stage_in]],
+    constant float2 &outputSize [[buffer(0)]]
+) {
+    int2 pos = int2(in.texcoord * outputSize);
+    int checker = ((pos.x / 8) + (pos.y / 8)) % 2;
+    float gray = checker ? 0.75 : 0.5;
+    return float4(gray, gray, gray, 1.0);
+}
+)";
+
+#endif /* __METAL_COMPOSITOR_SHADERS_H__ */
@@ -26,6 +26,10 @@
 #import <Metal/Metal.h>
 #import <gst/video/video.h>
 
+#import "vfmetaldevice.h"
+#import "vfmetalinflight.h"
+#import "vfmetalstats.h"
+
 typedef enum {
   METAL_BLEND_SOURCE = 0,
   METAL_BLEND_OVER = 1,
@@ -39,6 +43,13 @@ typedef enum {
   METAL_BG_TRANSPARENT = 3,
 } MetalBackgroundType;
 
+typedef enum {
+  METAL_QUALITY_NEAREST = 0,
+  METAL_QUALITY_LINEAR = 1,
+  METAL_QUALITY_MIPMAPPED = 2,
+  METAL_QUALITY_BOX = 3,
+} MetalSizingQuality;
+
 /* Input pad descriptor for rendering */
 typedef struct {
   GstVideoFrame *frame;
@@ -46,11 +57,35 @@ typedef struct {
   gint width, height;
   gdouble alpha;
   MetalBlendMode blend_mode;
+  /* Mipmapped and box downscale draw from a tile-sized copy of the input,
+   * kept per pad (@key) and reused while the input is @unchanged */
+  MetalSizingQuality quality;
+  /* Identifies the pad across frames; with @unchanged set (same buffer as
+   * the pad's previous frame) its textures are kept and not re-uploaded */
+  const void *key;
+  gboolean unchanged;
 } MetalPadInput;
 
 @interface MetalCompositorRenderer : NSObject
 
+/* Element this renderer's stages are traced for (see vfmetaltrace.h) */
+@property (nonatomic, assign) GstObject *traceOwner;
+
+/* Threads copying system-memory planes into textures, 0 = one per CPU
+ * core. The copies of a frame all finish before its command buffer is
+ * committed. */
+@property (nonatomic) NSUInteger uploadConcurrency;
+
+/* Receives upload, encode, GPU and readback times of every frame when
+ * set; must outlive the renderer's in-flight frames */
+@property (nonatomic) VfMetalStats *stats;
+
+/* GPU this renderer runs on, fixed at creation */
+@property (nonatomic, readonly) VfMetalDevice *metalDevice;
+
+/* -init uses the default device (+[VfMetalDevice sharedDevice]) */
 - (instancetype)init;
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice;
 - (BOOL)configureWithWidth:(int)width
                     height:(int)height
                     format:(GstVideoFormat)format;
@@ -58,6 +93,16 @@ typedef struct {
                       count:(int)count
                  background:(MetalBackgroundType)background
                    outFrame:(GstVideoFrame *)outFrame;
+/* Pipelined variant: encode into ring @slot, commit without waiting and
+ * call @completion once outFrame has been read back. The input frames
+ * must stay mapped until then. Returns NO (and never calls @completion)
+ * if nothing was committed. */
+- (BOOL)submitWithInputs:(MetalPadInput *)inputs
+                   count:(int)count
+              background:(MetalBackgroundType)background
+                outFrame:(GstVideoFrame *)outFrame
+                    slot:(NSUInteger)slot
+              completion:(VfMetalCompletionHandler)completion;
 - (void)cleanup;
 
 @end
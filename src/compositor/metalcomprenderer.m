@@ -23,104 +23,46 @@
 #import "vfmetaldevice.h"
 #import "vfmetaltextureutil.h"
 #import "vfmetalshaders.h"
+#import "metalcompositor_shaders.h"
 #import "vfmetalyuvoutput.h"
+#import "vfmetaltrace.h"
+#import "vfmetalmemory.h"
 #import <QuartzCore/QuartzCore.h>
+#include <stdatomic.h>
 
 #include <gst/gst.h>
 
 GST_DEBUG_CATEGORY_EXTERN (gst_vf_metal_compositor_debug);
 #define GST_CAT_DEFAULT gst_vf_metal_compositor_debug
 
-/* --- Compositor-specific Metal shader source --- */
-
-static NSString *const kCompositorShaderSource = @R"(
-
-// Vertex shader: transform quad position
-vertex VertexOut compositorVertex(
-    uint vid [[vertex_id]],
-    constant float4 *vertexData [[buffer(0)]]
-) {
-    VertexOut out;
-    float4 vd = vertexData[vid];
-    out.position = float4(vd.xy, 0.0, 1.0);
-    out.texcoord = vd.zw;
-    return out;
-}
-
-// Fragment shader: sample BGRA/RGBA texture with alpha
-fragment float4 compositorFragment(
-    VertexOut in [[stage_in]],
-    constant Uniforms &uniforms [[buffer(0)]],
-    texture2d<float> tex [[texture(0)]]
-) {
-    constexpr sampler s(filter::linear, address::clamp_to_edge);
-    float4 color = tex.sample(s, in.texcoord);
-    color.a *= uniforms.alpha;
-    color.rgb *= color.a;
-    return color;
-}
-
-// Fragment shader: NV12 (Y + interleaved UV)
-fragment float4 compositorFragmentNV12(
-    VertexOut in [[stage_in]],
-    constant Uniforms &uniforms [[buffer(0)]],
-    texture2d<float> yTex [[texture(0)]],
-    texture2d<float> uvTex [[texture(1)]]
-) {
-    constexpr sampler s(filter::linear, address::clamp_to_edge);
-    float y  = yTex.sample(s, in.texcoord).r;
-    float2 uv = uvTex.sample(s, in.texcoord).rg;
-    float3 rgb = yuvToRGB(y, uv.r, uv.g, uniforms.colorMatrix);
-    float4 color = float4(rgb, 1.0);
-    color.a *= uniforms.alpha;
-    color.rgb *= color.a;
-    return color;
-}
+/* A system-memory plane waiting to be copied into its texture; the
+ * texture is kept alive by the input's texture array */
+typedef struct {
+    __unsafe_unretained id<MTLTexture> texture;
+    GstVideoFrame *frame;
+    int plane;
+} CompPlaneUpload;
+
+/* Tile-sized copy of a downscaled input: @source holds the input
+ * converted to RGBA at full size (with a mip chain for mipmapped), @tile
+ * the result at the pad's output size. Both are only written by the GPU,
+ * so frames in flight can keep drawing the previous contents. */
+@interface CompPrescaledInput : NSObject
+@property (nonatomic) MetalSizingQuality quality;
+@property (nonatomic, strong) id<MTLTexture> source;
+@property (nonatomic, strong) id<MTLTexture> tile;
+@end
 
-// Fragment shader: I420 (Y + separate U + separate V)
-fragment float4 compositorFragmentI420(
-    VertexOut in [[stage_in]],
-    constant Uniforms &uniforms [[buffer(0)]],
-    texture2d<float> yTex [[texture(0)]],
-    texture2d<float> uTex [[texture(1)]],
-    texture2d<float> vTex [[texture(2)]]
-) {
-    constexpr sampler s(filter::linear, address::clamp_to_edge);
-    float y  = yTex.sample(s, in.texcoord).r;
-    float cb = uTex.sample(s, in.texcoord).r;
-    float cr = vTex.sample(s, in.texcoord).r;
-    float3 rgb = yuvToRGB(y, cb, cr, uniforms.colorMatrix);
-    float4 color = float4(rgb, 1.0);
-    color.a *= uniforms.alpha;
-    color.rgb *= color.a;
-    return color;
-}
+@implementation CompPrescaledInput
+@end
 
-// Checker background
-vertex VertexOut checkerVertex(uint vid [[vertex_id]]) {
-    float2 positions[4] = {
-        float2(-1, -1),
-        float2( 1, -1),
-        float2(-1,  1),
-        float2( 1,  1)
-    };
-    VertexOut out;
-    out.position = float4(positions[vid], 0.0, 1.0);
-    out.texcoord = (positions[vid] + 1.0) * 0.5;
-    out.texcoord.y = 1.0 - out.texcoord.y;
-    return out;
-}
+/* What an instanced draw samples: one of the input formats, or
+ * pre-scaled RGBA tiles */
+#define COMP_DRAW_KIND_TILE VF_METAL_INPUT_COUNT
+#define COMP_DRAW_KIND_COUNT (VF_METAL_INPUT_COUNT + 1)
 
-fragment float4 checkerFragment(
-    VertexOut in [[stage_in]],
-    constant float2 &outputSize [[buffer(0)]]
-) {
-    int2 pos = int2(in.texcoord * outputSize);
-    int checker = ((pos.x / 8) + (pos.y / 8)) % 2;
-    float gray = checker ? 0.75 : 0.5;
-    return float4(gray, gray, gray, 1.0);
-}
-)";
+/* Sampler and texture binding stride of the instanced fragment shaders */
+#define COMP_BATCH VF_METAL_COMPOSITOR_BATCH
 
 /* --- MetalCompositorRenderer implementation --- */
 
@@ -128,8 +70,19 @@ fragment float4 checkerFragment(
     id<MTLCommandQueue> _commandQueue;
     id<MTLLibrary> _library;
 
-    /* Render pipeline states [inputFormat][blendMode] */
-    id<MTLRenderPipelineState> _pipelines[VF_METAL_INPUT_COUNT][3];
+    /* Single-quad conversion of an input into its pre-scale source
+     * [inputFormat] */
+    id<MTLRenderPipelineState> _pipelines[VF_METAL_INPUT_COUNT];
+
+    /* Instanced pad draws [drawKind][blendMode] */
+    id<MTLRenderPipelineState> _instancedPipelines[COMP_DRAW_KIND_COUNT][3];
+
+    /* Pre-scaling: mip chain into the tile, box downscale kernel */
+    id<MTLRenderPipelineState> _tilePipeline;
+    id<MTLComputePipelineState> _boxDownscale;
+
+    /* Samplers by MetalSizingQuality (mipmapped samples trilinearly) */
+    id<MTLSamplerState> _samplers[4];
 
     /* Checker background pipeline */
     id<MTLRenderPipelineState> _pipelineChecker;
@@ -148,31 +101,48 @@ fragment float4 checkerFragment(
 
     /* Input texture cache */
     VfMetalTextureCache *_textureCache;
+
+    /* Textures of inputs repeating their buffer, keyed by pad; they are
+     * never written once filled, so in-flight frames can share them */
+    NSMutableDictionary<NSValue *, NSArray<id<MTLTexture>> *> *_heldTextures;
+
+    /* Pre-scaled tiles of mipmapped / box inputs, keyed by pad */
+    NSMutableDictionary<NSValue *, CompPrescaledInput *> *_prescaled;
+}
+
+- (void)setTraceOwner:(GstObject *)traceOwner
+{
+    _traceOwner = traceOwner;
+    _textureCache.traceOwner = traceOwner;
+    _yuvOutput.traceOwner = traceOwner;
 }
 
 - (instancetype)init
+{
+    return [self initWithDevice:[VfMetalDevice sharedDevice]];
+}
+
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice
 {
     self = [super init];
     if (!self) return nil;
 
-    VfMetalDevice *metalDevice = [VfMetalDevice sharedDevice];
     if (!metalDevice) {
         GST_ERROR ("MetalCompositorRenderer: No Metal device available");
         return nil;
     }
+    _metalDevice = metalDevice;
 
-    _commandQueue = [metalDevice.device newCommandQueue];
-    if (!_commandQueue) {
-        GST_ERROR ("MetalCompositorRenderer: Failed to create command queue");
-        return nil;
-    }
+    _commandQueue = metalDevice.commandQueue;
 
     /* Compile shaders: concatenate common + compositor-specific source */
     NSString *fullSource = [kVfMetalCommonShaderSource
         stringByAppendingString:kCompositorShaderSource];
 
     NSError *error = nil;
-    _library = [metalDevice compileShaderSource:fullSource error:&error];
+    _library = [metalDevice libraryNamed:@"compositor"
+                                  source:fullSource
+                                   error:&error];
     if (!_library) {
         GST_ERROR ("MetalCompositorRenderer: Failed to compile shaders: %s",
               error.localizedDescription.UTF8String);
@@ -183,6 +153,17 @@ fragment float4 checkerFragment(
         initWithDevice:metalDevice.device];
     _yuvOutput = [[VfMetalYUVOutput alloc] init];
 
+    for (int q = 0; q < 4; q++) {
+        MTLSamplerDescriptor *sd = [[MTLSamplerDescriptor alloc] init];
+        sd.minFilter = sd.magFilter = (q == METAL_QUALITY_NEAREST)
+            ? MTLSamplerMinMagFilterNearest : MTLSamplerMinMagFilterLinear;
+        sd.mipFilter = (q == METAL_QUALITY_MIPMAPPED)
+            ? MTLSamplerMipFilterLinear : MTLSamplerMipFilterNotMipmapped;
+        sd.sAddressMode = MTLSamplerAddressModeClampToEdge;
+        sd.tAddressMode = MTLSamplerAddressModeClampToEdge;
+        _samplers[q] = [metalDevice.device newSamplerStateWithDescriptor:sd];
+    }
+
     return self;
 }
 
@@ -190,11 +171,21 @@ fragment float4 checkerFragment(
                                              pixelFormat:(MTLPixelFormat)pixelFormat
                                         fragmentFunction:(NSString *)fragName
 {
-    id<MTLDevice> device = [VfMetalDevice sharedDevice].device;
+    return [self createPipelineWithBlendMode:mode pixelFormat:pixelFormat
+                              vertexFunction:@"compositorVertex"
+                            fragmentFunction:fragName];
+}
+
+- (id<MTLRenderPipelineState>)createPipelineWithBlendMode:(MetalBlendMode)mode
+                                             pixelFormat:(MTLPixelFormat)pixelFormat
+                                          vertexFunction:(NSString *)vertName
+                                        fragmentFunction:(NSString *)fragName
+{
+    VfMetalDevice *metalDevice = _metalDevice;
 
     MTLRenderPipelineDescriptor *desc =
         [[MTLRenderPipelineDescriptor alloc] init];
-    desc.vertexFunction = [_library newFunctionWithName:@"compositorVertex"];
+    desc.vertexFunction = [_library newFunctionWithName:vertName];
     desc.fragmentFunction = [_library newFunctionWithName:fragName];
     desc.colorAttachments[0].pixelFormat = pixelFormat;
     desc.colorAttachments[0].blendingEnabled = YES;
@@ -240,7 +231,8 @@ fragment float4 checkerFragment(
 
     NSError *error = nil;
     id<MTLRenderPipelineState> state =
-        [device newRenderPipelineStateWithDescriptor:desc error:&error];
+        [metalDevice renderPipelineWithDescriptor:desc library:_library
+                                            error:&error];
     if (!state) {
         GST_ERROR ("MetalCompositorRenderer: Pipeline creation failed for blend mode %d: %s",
               mode, error.localizedDescription.UTF8String);
@@ -250,7 +242,7 @@ fragment float4 checkerFragment(
 
 - (id<MTLRenderPipelineState>)createCheckerPipelineWithPixelFormat:(MTLPixelFormat)pixelFormat
 {
-    id<MTLDevice> device = [VfMetalDevice sharedDevice].device;
+    VfMetalDevice *metalDevice = _metalDevice;
 
     MTLRenderPipelineDescriptor *desc =
         [[MTLRenderPipelineDescriptor alloc] init];
@@ -261,7 +253,8 @@ fragment float4 checkerFragment(
 
     NSError *error = nil;
     id<MTLRenderPipelineState> state =
-        [device newRenderPipelineStateWithDescriptor:desc error:&error];
+        [metalDevice renderPipelineWithDescriptor:desc library:_library
+                                            error:&error];
     if (!state) {
         GST_ERROR ("MetalCompositorRenderer: Checker pipeline creation failed: %s",
               error.localizedDescription.UTF8String);
@@ -279,7 +272,7 @@ fragment float4 checkerFragment(
         return YES;
     }
 
-    id<MTLDevice> device = [VfMetalDevice sharedDevice].device;
+    id<MTLDevice> device = _metalDevice.device;
 
     _outputWidth = width;
     _outputHeight = height;
@@ -302,7 +295,7 @@ fragment float4 checkerFragment(
             return NO;
     }
 
-    /* Create render pipeline states for each input format × blend mode */
+    /* Create render pipeline states for each input format */
     NSString *fragNames[VF_METAL_INPUT_COUNT] = {
         @"compositorFragment",
         @"compositorFragmentNV12",
@@ -310,19 +303,61 @@ fragment float4 checkerFragment(
     };
 
     for (int fmt = 0; fmt < VF_METAL_INPUT_COUNT; fmt++) {
+        _pipelines[fmt] =
+            [self createPipelineWithBlendMode:METAL_BLEND_SOURCE
+                                  pixelFormat:_renderPixelFormat
+                             fragmentFunction:fragNames[fmt]];
+        if (!_pipelines[fmt]) {
+            GST_ERROR ("MetalCompositorRenderer: Failed to create pipeline fmt=%d",
+                  fmt);
+            return NO;
+        }
+    }
+
+    /* Instanced variants drawing the pads, plus pre-scaled tiles */
+    NSString *instancedNames[COMP_DRAW_KIND_COUNT] = {
+        @"compositorInstancedFragment",
+        @"compositorInstancedFragmentNV12",
+        @"compositorInstancedFragmentI420",
+        @"compositorInstancedFragmentPremultiplied"
+    };
+
+    for (int kind = 0; kind < COMP_DRAW_KIND_COUNT; kind++) {
         for (int blend = 0; blend < 3; blend++) {
-            _pipelines[fmt][blend] =
+            _instancedPipelines[kind][blend] =
                 [self createPipelineWithBlendMode:(MetalBlendMode)blend
                                       pixelFormat:_renderPixelFormat
-                                 fragmentFunction:fragNames[fmt]];
-            if (!_pipelines[fmt][blend]) {
-                GST_ERROR ("MetalCompositorRenderer: Failed to create pipeline fmt=%d blend=%d",
-                      fmt, blend);
+                                   vertexFunction:@"compositorInstancedVertex"
+                                 fragmentFunction:instancedNames[kind]];
+            if (!_instancedPipelines[kind][blend]) {
+                GST_ERROR ("MetalCompositorRenderer: Failed to create instanced pipeline kind=%d blend=%d",
+                      kind, blend);
                 return NO;
             }
         }
     }
 
+    _tilePipeline =
+        [self createPipelineWithBlendMode:METAL_BLEND_SOURCE
+                              pixelFormat:_renderPixelFormat
+                         fragmentFunction:@"compositorFragmentPremultiplied"];
+    if (!_tilePipeline) {
+        GST_ERROR ("MetalCompositorRenderer: Failed to create tile pipeline");
+        return NO;
+    }
+
+    NSError *error = nil;
+    _boxDownscale = [_metalDevice
+        computePipelineWithFunctionName:@"compositorBoxDownscale"
+                                library:_library
+                                  error:&error];
+    if (!_boxDownscale) {
+        GST_ERROR ("MetalCompositorRenderer: Failed to create box downscale pipeline: %s",
+              error.localizedDescription.UTF8String);
+        return NO;
+    }
+    _prescaled = nil;
+
     _pipelineChecker =
         [self createCheckerPipelineWithPixelFormat:_renderPixelFormat];
     if (!_pipelineChecker) {
@@ -337,7 +372,7 @@ fragment float4 checkerFragment(
                                     height:height
                                  mipmapped:NO];
     desc.usage = MTLTextureUsageRenderTarget | MTLTextureUsageShaderRead;
-    desc.storageMode = MTLStorageModeShared;
+    desc.storageMode = _metalDevice.hostStorageMode;
 
     _outputTexture = [device newTextureWithDescriptor:desc];
     if (!_outputTexture) {
@@ -346,20 +381,393 @@ fragment float4 checkerFragment(
         return NO;
     }
 
-    if (![_yuvOutput configureWithDevice:device library:_library
+    if (![_yuvOutput configureWithDevice:_metalDevice library:_library
                                    width:width height:height format:format])
         return NO;
 
     return YES;
 }
 
+/* Plane layout of an input frame, in the order the fragment shaders
+ * take the planes */
+static int
+comp_input_planes (GstVideoFrame *frame, VfMetalInputFormat fmtIdx,
+    MTLPixelFormat formats[3], int widths[3], int heights[3])
+{
+    int frameW = GST_VIDEO_FRAME_WIDTH (frame);
+    int frameH = GST_VIDEO_FRAME_HEIGHT (frame);
+
+    widths[0] = frameW;
+    heights[0] = frameH;
+    for (int p = 1; p < 3; p++) {
+        widths[p] = (frameW + 1) / 2;
+        heights[p] = (frameH + 1) / 2;
+    }
+
+    switch (fmtIdx) {
+        case VF_METAL_INPUT_NV12:
+            formats[0] = MTLPixelFormatR8Unorm;
+            formats[1] = MTLPixelFormatRG8Unorm;
+            return 2;
+        case VF_METAL_INPUT_I420:
+            formats[0] = formats[1] = formats[2] = MTLPixelFormatR8Unorm;
+            return 3;
+        default:
+            formats[0] = (GST_VIDEO_FRAME_FORMAT (frame) == GST_VIDEO_FORMAT_BGRA)
+                ? MTLPixelFormatBGRA8Unorm : MTLPixelFormatRGBA8Unorm;
+            return 1;
+    }
+}
+
+/* Textures to draw @input from. Copies from system memory are not done
+ * here but appended to @uploads, for -_runUploads:count:. */
+- (NSArray<id<MTLTexture>> *)_texturesForInput:(MetalPadInput *)input
+                                   formatIndex:(VfMetalInputFormat)fmtIdx
+                                          held:(NSMutableDictionary *)held
+                                       uploads:(CompPlaneUpload *)uploads
+                                      nUploads:(int *)nUploads
+{
+    MTLPixelFormat formats[3];
+    int widths[3], heights[3];
+    int planes = comp_input_planes (input->frame, fmtIdx, formats, widths,
+                                    heights);
+    NSValue *key = input->key ? [NSValue valueWithPointer:input->key] : nil;
+
+    /* Same buffer as last frame: draw from the textures it filled then */
+    if (key && input->unchanged) {
+        NSArray<id<MTLTexture>> *cached = _heldTextures[key];
+        BOOL match = (cached.count == (NSUInteger)planes);
+        for (int p = 0; match && p < planes; p++) {
+            match = cached[p].pixelFormat == formats[p] &&
+                (int)cached[p].width == widths[p] &&
+                (int)cached[p].height == heights[p];
+        }
+        if (match) {
+            held[key] = cached;
+            return cached;
+        }
+    }
+
+    /* A repeating system-memory buffer is uploaded once more, into
+     * textures of its own that later frames reuse. GPU-resident and
+     * CoreVideo input is sampled in place and gains nothing from this. */
+    BOOL keep = key && input->unchanged &&
+        !vf_metal_frame_peek_texture (input->frame, 0, _metalDevice.device) &&
+        !vf_metal_frame_get_pixel_buffer (input->frame);
+
+    NSMutableArray<id<MTLTexture>> *textures =
+        [NSMutableArray arrayWithCapacity:planes];
+    int firstUpload = *nUploads;
+    for (int p = 0; p < planes; p++) {
+        id<MTLTexture> tex = nil;
+        BOOL needsUpload = YES;
+
+        if (keep) {
+            MTLTextureDescriptor *desc = [MTLTextureDescriptor
+                texture2DDescriptorWithPixelFormat:formats[p]
+                                             width:widths[p]
+                                            height:heights[p]
+                                         mipmapped:NO];
+            desc.usage = MTLTextureUsageShaderRead;
+            desc.storageMode = _metalDevice.hostStorageMode;
+            tex = [_metalDevice.device
+                newTextureWithDescriptor:desc];
+        } else {
+            tex = [_textureCache texturePlane:input->frame plane:p
+                                       format:formats[p]
+                                        width:widths[p] height:heights[p]
+                                  needsUpload:&needsUpload];
+        }
+        if (!tex) {
+            *nUploads = firstUpload;
+            return nil;
+        }
+        [textures addObject:tex];
+
+        if (needsUpload) {
+            uploads[*nUploads] = (CompPlaneUpload) { tex, input->frame, p };
+            (*nUploads)++;
+        }
+    }
+
+    if (keep)
+        held[key] = textures;
+    return textures;
+}
+
+/* Copy the queued planes, spread over up to uploadConcurrency threads.
+ * Workers take the next plane as they finish one, so a few large luma
+ * planes do not leave the other threads idle. */
+- (void)_runUploads:(CompPlaneUpload *)uploads count:(int)count
+{
+    NSUInteger workers = _uploadConcurrency;
+    if (workers == 0)
+        workers = [NSProcessInfo processInfo].activeProcessorCount;
+    workers = MIN (workers, (NSUInteger)count);
+
+    if (workers <= 1) {
+        for (int i = 0; i < count; i++)
+            vf_metal_texture_upload_plane (uploads[i].texture,
+                                           uploads[i].frame, uploads[i].plane);
+        return;
+    }
+
+    atomic_int next = 0;
+    atomic_int *nextp = &next;
+    dispatch_apply (workers,
+        dispatch_get_global_queue (QOS_CLASS_USER_INTERACTIVE, 0),
+        ^(size_t worker) {
+            int i;
+            while ((i = atomic_fetch_add (nextp, 1)) < count)
+                vf_metal_texture_upload_plane (uploads[i].texture,
+                                               uploads[i].frame,
+                                               uploads[i].plane);
+        });
+}
+
+- (void)setStats:(VfMetalStats *)stats
+{
+    _stats = stats;
+    _yuvOutput.stats = stats;
+}
+
 - (BOOL)compositeWithInputs:(MetalPadInput *)inputs
                       count:(int)count
                  background:(MetalBackgroundType)background
                    outFrame:(GstVideoFrame *)outFrame
+{
+    return [self _compositeWithInputs:inputs count:count background:background
+                             outFrame:outFrame slot:0 completion:nil];
+}
+
+- (BOOL)submitWithInputs:(MetalPadInput *)inputs
+                   count:(int)count
+              background:(MetalBackgroundType)background
+                outFrame:(GstVideoFrame *)outFrame
+                    slot:(NSUInteger)slot
+              completion:(VfMetalCompletionHandler)completion
+{
+    return [self _compositeWithInputs:inputs count:count background:background
+                             outFrame:outFrame slot:slot
+                           completion:completion];
+}
+
+/* Mipmapped and box quality only change anything when downscaling */
+static BOOL
+comp_input_prescales (MetalPadInput *input)
+{
+    if (input->quality != METAL_QUALITY_MIPMAPPED &&
+        input->quality != METAL_QUALITY_BOX)
+        return NO;
+    if (input->width <= 0 || input->height <= 0)
+        return NO;
+    return input->width < GST_VIDEO_FRAME_WIDTH (input->frame) ||
+        input->height < GST_VIDEO_FRAME_HEIGHT (input->frame);
+}
+
+/* Tile textures for @input, reusing those of @previous where they fit */
+- (CompPrescaledInput *)_prescaledForInput:(MetalPadInput *)input
+                                  previous:(CompPrescaledInput *)previous
+{
+    id<MTLDevice> device = _metalDevice.device;
+    int frameW = GST_VIDEO_FRAME_WIDTH (input->frame);
+    int frameH = GST_VIDEO_FRAME_HEIGHT (input->frame);
+    BOOL mipmapped = (input->quality == METAL_QUALITY_MIPMAPPED);
+    CompPrescaledInput *entry = [[CompPrescaledInput alloc] init];
+
+    entry.quality = input->quality;
+
+    if (previous && (int)previous.source.width == frameW &&
+        (int)previous.source.height == frameH &&
+        (previous.source.mipmapLevelCount > 1) == mipmapped) {
+        entry.source = previous.source;
+    } else {
+        MTLTextureDescriptor *desc = [MTLTextureDescriptor
+            texture2DDescriptorWithPixelFormat:_renderPixelFormat
+                                         width:frameW
+                                        height:frameH
+                                     mipmapped:mipmapped];
+        desc.usage = MTLTextureUsageRenderTarget | MTLTextureUsageShaderRead;
+        desc.storageMode = MTLStorageModePrivate;
+        entry.source = [device newTextureWithDescriptor:desc];
+    }
+
+    MTLTextureUsage tileUsage = MTLTextureUsageShaderRead |
+        (mipmapped ? MTLTextureUsageRenderTarget : MTLTextureUsageShaderWrite);
+    if (previous && (int)previous.tile.width == input->width &&
+        (int)previous.tile.height == input->height &&
+        (previous.tile.usage & tileUsage) == tileUsage) {
+        entry.tile = previous.tile;
+    } else {
+        MTLTextureDescriptor *desc = [MTLTextureDescriptor
+            texture2DDescriptorWithPixelFormat:_renderPixelFormat
+                                         width:input->width
+                                        height:input->height
+                                     mipmapped:NO];
+        desc.usage = tileUsage;
+        desc.storageMode = MTLStorageModePrivate;
+        entry.tile = [device newTextureWithDescriptor:desc];
+    }
+
+    if (!entry.source || !entry.tile) {
+        GST_ERROR ("MetalCompositorRenderer: Failed to create %dx%d tile",
+              input->width, input->height);
+        return nil;
+    }
+    return entry;
+}
+
+/* Render @texture over the whole of @target with @pipeline */
+- (void)_encodeFullQuad:(id<MTLCommandBuffer>)commandBuffer
+                 target:(id<MTLTexture>)target
+               pipeline:(id<MTLRenderPipelineState>)pipeline
+               textures:(NSArray<id<MTLTexture>> *)textures
+                sampler:(id<MTLSamplerState>)sampler
+            colorMatrix:(int)colorMatrix
+{
+    static const float vertices[] = {
+        -1.0f,  1.0f, 0.0f, 0.0f,
+         1.0f,  1.0f, 1.0f, 0.0f,
+        -1.0f, -1.0f, 0.0f, 1.0f,
+         1.0f, -1.0f, 1.0f, 1.0f,
+    };
+    VfMetalUniforms uniforms = { 1.0f, colorMatrix, { 0, 0 } };
+
+    MTLRenderPassDescriptor *rpDesc =
+        [MTLRenderPassDescriptor renderPassDescriptor];
+    rpDesc.colorAttachments[0].texture = target;
+    rpDesc.colorAttachments[0].loadAction = MTLLoadActionDontCare;
+    rpDesc.colorAttachments[0].storeAction = MTLStoreActionStore;
+
+    id<MTLRenderCommandEncoder> encoder =
+        [commandBuffer renderCommandEncoderWithDescriptor:rpDesc];
+    [encoder setRenderPipelineState:pipeline];
+    for (NSUInteger p = 0; p < textures.count; p++)
+        [encoder setFragmentTexture:textures[p] atIndex:p];
+    [encoder setFragmentSamplerState:sampler atIndex:0];
+    [encoder setVertexBytes:vertices length:sizeof(vertices) atIndex:0];
+    [encoder setFragmentBytes:&uniforms length:sizeof(uniforms) atIndex:0];
+    [encoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                vertexStart:0
+                vertexCount:4];
+    [encoder endEncoding];
+}
+
+/* Convert @input to RGBA at full size, then reduce it into the tile:
+ * through the mip chain for mipmapped, by area averaging for box */
+- (void)_encodePrescale:(id<MTLCommandBuffer>)commandBuffer
+                  input:(MetalPadInput *)input
+            formatIndex:(VfMetalInputFormat)fmtIdx
+               textures:(NSArray<id<MTLTexture>> *)textures
+                  entry:(CompPrescaledInput *)entry
+{
+    [self _encodeFullQuad:commandBuffer target:entry.source
+                 pipeline:_pipelines[fmtIdx]
+                 textures:textures
+                  sampler:_samplers[METAL_QUALITY_NEAREST]
+              colorMatrix:vf_metal_color_matrix_for_frame (input->frame)];
+
+    if (entry.quality == METAL_QUALITY_MIPMAPPED) {
+        id<MTLBlitCommandEncoder> blit = [commandBuffer blitCommandEncoder];
+        [blit generateMipmapsForTexture:entry.source];
+        [blit endEncoding];
+
+        [self _encodeFullQuad:commandBuffer target:entry.tile
+                     pipeline:_tilePipeline
+                     textures:@[ entry.source ]
+                      sampler:_samplers[METAL_QUALITY_MIPMAPPED]
+                  colorMatrix:0];
+        return;
+    }
+
+    id<MTLComputeCommandEncoder> compute =
+        [commandBuffer computeCommandEncoder];
+    [compute setComputePipelineState:_boxDownscale];
+    [compute setTexture:entry.source atIndex:0];
+    [compute setTexture:entry.tile atIndex:1];
+    MTLSize tg = MTLSizeMake(16, 16, 1);
+    MTLSize groups = MTLSizeMake((entry.tile.width + 15) / 16,
+                                 (entry.tile.height + 15) / 16, 1);
+    [compute dispatchThreadgroups:groups threadsPerThreadgroup:tg];
+    [compute endEncoding];
+}
+
+- (BOOL)_compositeWithInputs:(MetalPadInput *)inputs
+                       count:(int)count
+                  background:(MetalBackgroundType)background
+                    outFrame:(GstVideoFrame *)outFrame
+                        slot:(NSUInteger)slot
+                  completion:(VfMetalCompletionHandler)completion
 {
     @autoreleasepool {
-        [_textureCache resetFrameIndex];
+        gint64 frameStart = _stats ? vf_metal_stats_now () : 0;
+
+        [_textureCache resetFrameIndexForSlot:slot];
+
+        /* Pick every input's textures first, then copy the system-memory
+         * planes of all inputs at once, before anything is encoded. Inputs
+         * that are not drawn this frame drop their held textures. */
+        NSMutableDictionary<NSValue *, NSArray<id<MTLTexture>> *> *held =
+            [NSMutableDictionary dictionaryWithCapacity:count];
+        NSMutableDictionary<NSValue *, CompPrescaledInput *> *prescaled =
+            [NSMutableDictionary dictionary];
+        NSMutableArray *inputTextures = [NSMutableArray arrayWithCapacity:count];
+        NSMutableArray *inputTiles = [NSMutableArray arrayWithCapacity:count];
+        BOOL renderTile[count > 0 ? count : 1];
+        CompPlaneUpload *uploads = g_new (CompPlaneUpload, MAX (count * 3, 1));
+        int nUploads = 0;
+
+        for (int i = 0; i < count; i++) {
+            MetalPadInput *input = &inputs[i];
+            VfMetalInputFormat fmtIdx = vf_metal_input_format_index (
+                GST_VIDEO_FRAME_FORMAT (input->frame));
+            NSValue *key = input->key
+                ? [NSValue valueWithPointer:input->key] : nil;
+            CompPrescaledInput *entry = nil;
+
+            renderTile[i] = NO;
+            if (comp_input_prescales (input)) {
+                CompPrescaledInput *previous = key ? _prescaled[key] : nil;
+
+                /* An unchanged input keeps its tile: no upload, no pass */
+                if (input->unchanged && previous &&
+                    previous.quality == input->quality &&
+                    (int)previous.tile.width == input->width &&
+                    (int)previous.tile.height == input->height) {
+                    prescaled[key] = previous;
+                    [inputTiles addObject:previous];
+                    [inputTextures addObject:[NSNull null]];
+                    continue;
+                }
+
+                entry = [self _prescaledForInput:input previous:previous];
+                if (entry && key)
+                    prescaled[key] = entry;
+                renderTile[i] = (entry != nil);
+            }
+            [inputTiles addObject:entry ?: (id)[NSNull null]];
+
+            NSArray<id<MTLTexture>> *textures =
+                [self _texturesForInput:input formatIndex:fmtIdx
+                                   held:held uploads:uploads
+                               nUploads:&nUploads];
+            if (!textures) {
+                renderTile[i] = NO;
+                inputTiles[i] = [NSNull null];
+                if (key)
+                    [prescaled removeObjectForKey:key];
+            }
+            [inputTextures addObject:textures ?: (id)[NSNull null]];
+        }
+        VfMetalTraceSpan uploadSpan;
+        vf_metal_trace_begin (&uploadSpan, _traceOwner, VF_METAL_STATS_UPLOAD);
+        gint64 uploadStart = _stats ? vf_metal_stats_now () : 0;
+        [self _runUploads:uploads count:nUploads];
+        gint64 uploadTime = _stats ? vf_metal_stats_now () - uploadStart : 0;
+        vf_metal_trace_end (&uploadSpan);
+        g_free (uploads);
+        _heldTextures = held;
+        _prescaled = prescaled;
 
         id<MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
         if (!commandBuffer) {
@@ -367,6 +775,20 @@ fragment float4 checkerFragment(
             return NO;
         }
 
+        VfMetalTraceSpan encodeSpan;
+        vf_metal_trace_begin (&encodeSpan, _traceOwner, VF_METAL_STATS_ENCODE);
+
+        /* Downscale into the tiles first, ahead of the composite pass */
+        for (int i = 0; i < count; i++) {
+            if (!renderTile[i])
+                continue;
+            [self _encodePrescale:commandBuffer input:&inputs[i]
+                      formatIndex:vf_metal_input_format_index (
+                                      GST_VIDEO_FRAME_FORMAT (inputs[i].frame))
+                         textures:inputTextures[i]
+                            entry:inputTiles[i]];
+        }
+
         /* Set up render pass */
         MTLRenderPassDescriptor *rpDesc =
             [MTLRenderPassDescriptor renderPassDescriptor];
@@ -424,93 +846,78 @@ fragment float4 checkerFragment(
                         vertexCount:4];
         }
 
-        /* Draw each input pad */
-        for (int i = 0; i < count; i++) {
-            MetalPadInput *input = &inputs[i];
-            GstVideoFormat fmt = GST_VIDEO_FRAME_FORMAT (input->frame);
-            VfMetalInputFormat fmtIdx = vf_metal_input_format_index(fmt);
-            int frameW = GST_VIDEO_FRAME_WIDTH (input->frame);
-            int frameH = GST_VIDEO_FRAME_HEIGHT (input->frame);
-
-            /* Select pipeline based on input format + blend mode */
-            id<MTLRenderPipelineState> pipeline =
-                _pipelines[fmtIdx][input->blend_mode];
-            [encoder setRenderPipelineState:pipeline];
-
-            /* Upload textures based on input format */
-            if (fmtIdx == VF_METAL_INPUT_NV12) {
-                id<MTLTexture> yTex =
-                    [_textureCache uploadPlane:input->frame plane:0
-                              format:MTLPixelFormatR8Unorm
-                               width:frameW height:frameH];
-                id<MTLTexture> uvTex =
-                    [_textureCache uploadPlane:input->frame plane:1
-                              format:MTLPixelFormatRG8Unorm
-                               width:(frameW + 1) / 2 height:(frameH + 1) / 2];
-                if (!yTex || !uvTex) continue;
-                [encoder setFragmentTexture:yTex atIndex:0];
-                [encoder setFragmentTexture:uvTex atIndex:1];
-            } else if (fmtIdx == VF_METAL_INPUT_I420) {
-                id<MTLTexture> yTex =
-                    [_textureCache uploadPlane:input->frame plane:0
-                              format:MTLPixelFormatR8Unorm
-                               width:frameW height:frameH];
-                id<MTLTexture> uTex =
-                    [_textureCache uploadPlane:input->frame plane:1
-                              format:MTLPixelFormatR8Unorm
-                               width:(frameW + 1) / 2 height:(frameH + 1) / 2];
-                id<MTLTexture> vTex =
-                    [_textureCache uploadPlane:input->frame plane:2
-                              format:MTLPixelFormatR8Unorm
-                               width:(frameW + 1) / 2 height:(frameH + 1) / 2];
-                if (!yTex || !uTex || !vTex) continue;
-                [encoder setFragmentTexture:yTex atIndex:0];
-                [encoder setFragmentTexture:uTex atIndex:1];
-                [encoder setFragmentTexture:vTex atIndex:2];
-            } else {
-                /* BGRA / RGBA: single plane */
-                MTLPixelFormat pixFmt = (fmt == GST_VIDEO_FORMAT_BGRA)
-                    ? MTLPixelFormatBGRA8Unorm : MTLPixelFormatRGBA8Unorm;
-                id<MTLTexture> tex =
-                    [_textureCache uploadPlane:input->frame plane:0
-                              format:pixFmt width:frameW height:frameH];
-                if (!tex) continue;
-                [encoder setFragmentTexture:tex atIndex:0];
+        /* Draw the pads in z-order. Consecutive pads sampled the same way
+         * (format or tile, blend mode, filter) share one instanced draw;
+         * instances blend in order, so the stacking is unchanged. */
+        VfMetalCompositorInstance batch[COMP_BATCH];
+        NSArray<id<MTLTexture>> *batchTextures[COMP_BATCH];
+        int batchCount = 0, batchKind = -1, batchBlend = -1, batchSampler = -1;
+
+        for (int i = 0; i <= count; i++) {
+            MetalPadInput *input = (i < count) ? &inputs[i] : NULL;
+            NSArray<id<MTLTexture>> *textures = nil;
+            int kind = -1, samplerIdx = METAL_QUALITY_NEAREST;
+
+            if (input && inputTiles[i] != [NSNull null]) {
+                /* Pre-scaled: the tile maps 1:1 onto the output */
+                textures = @[ ((CompPrescaledInput *)inputTiles[i]).tile ];
+                kind = COMP_DRAW_KIND_TILE;
+            } else if (input && inputTextures[i] != [NSNull null]) {
+                textures = inputTextures[i];
+                kind = vf_metal_input_format_index (
+                    GST_VIDEO_FRAME_FORMAT (input->frame));
+                if (input->quality != METAL_QUALITY_NEAREST)
+                    samplerIdx = METAL_QUALITY_LINEAR;
+            } else if (input) {
+                continue;
             }
 
-            /* Calculate NDC coordinates from pixel coordinates */
-            float x = (2.0f * input->xpos / _outputWidth) - 1.0f;
-            float y = 1.0f - (2.0f * input->ypos / _outputHeight);
-            float w = 2.0f * input->width / _outputWidth;
-            float h = 2.0f * input->height / _outputHeight;
-
-            float vertices[] = {
-                x,     y,       0.0f, 0.0f,
-                x + w, y,       1.0f, 0.0f,
-                x,     y - h,   0.0f, 1.0f,
-                x + w, y - h,   1.0f, 1.0f,
-            };
-
-            [encoder setVertexBytes:vertices
-                             length:sizeof(vertices)
-                            atIndex:0];
-
-            /* Set uniforms */
-            VfMetalUniforms uniforms;
-            uniforms.alpha = (float)input->alpha;
-            uniforms.colorMatrix =
-                vf_metal_color_matrix_for_frame(input->frame);
-            uniforms.padding[0] = 0;
-            uniforms.padding[1] = 0;
+            /* Flush the batch when this pad cannot join it */
+            if (batchCount > 0 && (!input || batchCount == COMP_BATCH ||
+                    kind != batchKind || (int)input->blend_mode != batchBlend ||
+                    samplerIdx != batchSampler)) {
+                [encoder setRenderPipelineState:
+                    _instancedPipelines[batchKind][batchBlend]];
+                [encoder setFragmentSamplerState:_samplers[batchSampler]
+                                         atIndex:0];
+                for (NSUInteger p = 0; p < batchTextures[0].count; p++) {
+                    for (int b = 0; b < batchCount; b++)
+                        [encoder setFragmentTexture:batchTextures[b][p]
+                                            atIndex:p * COMP_BATCH + b];
+                }
+                [encoder setVertexBytes:batch
+                                 length:sizeof(batch[0]) * batchCount
+                                atIndex:1];
+                [encoder setFragmentBytes:batch
+                                   length:sizeof(batch[0]) * batchCount
+                                  atIndex:0];
+                [encoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                            vertexStart:0
+                            vertexCount:4
+                          instanceCount:batchCount];
+                batchCount = 0;
+            }
+            if (!input)
+                break;
 
-            [encoder setFragmentBytes:&uniforms
-                               length:sizeof(uniforms)
-                              atIndex:0];
+            if (batchCount == 0) {
+                batchKind = kind;
+                batchBlend = input->blend_mode;
+                batchSampler = samplerIdx;
+            }
 
-            /* Draw quad */
-            [encoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
-                        vertexStart:0
-                        vertexCount:4];
+            /* Calculate NDC coordinates from pixel coordinates */
+            VfMetalCompositorInstance *inst = &batch[batchCount];
+            inst->rect[0] = (2.0f * input->xpos / _outputWidth) - 1.0f;
+            inst->rect[1] = 1.0f - (2.0f * input->ypos / _outputHeight);
+            inst->rect[2] = 2.0f * input->width / _outputWidth;
+            inst->rect[3] = 2.0f * input->height / _outputHeight;
+            inst->alpha = (float)input->alpha;
+            inst->colorMatrix = vf_metal_color_matrix_for_frame (input->frame);
+            inst->padding[0] = 0;
+            inst->padding[1] = 0;
+            batchTextures[batchCount] = textures;
+            batchCount++;
         }
 
         [encoder endEncoding];
@@ -519,11 +926,36 @@ fragment float4 checkerFragment(
         [_yuvOutput dispatchConversion:commandBuffer
                          sourceTexture:_outputTexture
                                  width:_outputWidth height:_outputHeight
-                              outFrame:outFrame];
+                              outFrame:outFrame
+                                  slot:slot];
+
+        /* Encoding is everything up to the commit but the plane copies */
+        if (_stats) {
+            vf_metal_stats_add (_stats, VF_METAL_STATS_UPLOAD,
+                                uploadTime / 1000.0);
+            vf_metal_stats_add_since (_stats, VF_METAL_STATS_ENCODE,
+                                      frameStart + uploadTime);
+            if (completion)
+                vf_metal_stats_track_command_buffer (_stats, commandBuffer);
+        }
+
+        if (completion) {
+            vf_metal_trace_end (&encodeSpan);
+            vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
+            [_yuvOutput commitPipelined:commandBuffer
+                          sourceTexture:_outputTexture
+                                  width:_outputWidth height:_outputHeight
+                               outFrame:outFrame
+                                   slot:slot
+                             completion:completion];
+            return YES;
+        }
 
-        /* No synchronizeResource needed — we use MTLStorageModeShared,
-         * so waitUntilCompleted alone guarantees CPU coherency. */
+        /* Shared storage needs only the wait for CPU coherency; on a
+         * discrete GPU the readback synchronises its managed textures */
 
+        vf_metal_trace_end (&encodeSpan);
+        vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
         [commandBuffer commit];
         [commandBuffer waitUntilCompleted];
 
@@ -532,6 +964,8 @@ fragment float4 checkerFragment(
                        commandBuffer.error.localizedDescription.UTF8String);
             return NO;
         }
+        if (_stats)
+            vf_metal_stats_add_gpu_time (_stats, commandBuffer);
 
         /* Read back to GstVideoFrame */
         [_yuvOutput readbackToFrame:outFrame sourceTexture:_outputTexture
@@ -544,11 +978,17 @@ fragment float4 checkerFragment(
 - (void)cleanup
 {
     [_textureCache clear];
+    _heldTextures = nil;
+    _prescaled = nil;
     _outputTexture = nil;
     [_yuvOutput cleanup];
     for (int f = 0; f < VF_METAL_INPUT_COUNT; f++)
+        _pipelines[f] = nil;
+    for (int k = 0; k < COMP_DRAW_KIND_COUNT; k++)
         for (int b = 0; b < 3; b++)
-            _pipelines[f][b] = nil;
+            _instancedPipelines[k][b] = nil;
+    _tilePipeline = nil;
+    _boxDownscale = nil;
     _pipelineChecker = nil;
     /* _library is created once in init and must survive across stop/start
      * state cycles. ARC releases it when the renderer object is deallocated. */
@@ -26,12 +26,26 @@
 #include <gst/video/video.h>
 #include <gst/base/gstbasetransform.h>
 
+#include "vfmetalcontext.h"
+#include "vfmetalinflight.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_VF_METAL_CONVERTSCALE (gst_vf_metal_convertscale_get_type())
 G_DECLARE_FINAL_TYPE (GstVfMetalConvertScale, gst_vf_metal_convertscale,
     GST, VF_METAL_CONVERTSCALE, GstBaseTransform)
 
+/* "method" enum, also used by vfmetalchain's scale-method */
+#define GST_TYPE_VF_METAL_SCALE_METHOD (gst_vf_metal_scale_method_get_type())
+GType gst_vf_metal_scale_method_get_type (void);
+
+/* Fixate @othercaps for an output converted and scaled from the fixed
+ * @caps: keep the input format when allowed and the display aspect ratio
+ * for unfixed dimensions. Takes ownership of @othercaps; shared with
+ * vfmetalscaleladder's src pads. */
+GstCaps *gst_vf_metal_convertscale_fixate_output (GstCaps * caps,
+    GstCaps * othercaps);
+
 /**
  * GstVfMetalConvertScale:
  *
@@ -45,7 +59,7 @@ struct _GstVfMetalConvertScale
   GstBaseTransform basetransform;
 
   /* Properties */
-  gint method;              /* 0=bilinear, 1=nearest */
+  gint method;              /* VfMetalScaleMethod */
   gboolean add_borders;     /* letterbox/pillarbox */
   guint32 border_color;     /* ARGB border color */
 
@@ -54,6 +68,13 @@ struct _GstVfMetalConvertScale
   GstVideoInfo out_info;
   gboolean negotiated;
 
+  /* Pipelined submission: in-flight property, latched into inflight */
+  guint in_flight;
+  VfMetalInflight inflight;
+
+  /* GPU selection; the renderer is created on it at NULL_TO_READY */
+  VfMetalDeviceSelection device;
+
   /* Metal rendering engine (opaque Obj-C object) */
   void *renderer;
 };
@@ -26,7 +26,8 @@
  * Metal-accelerated video format conversion and scaling element.
  * Combines the functionality of videoconvert + videoscale in a single
  * GPU pass. Supports BGRA, RGBA, NV12, I420, UYVY, and YUY2 with
- * bilinear or nearest-neighbor interpolation and optional letterboxing.
+ * bilinear, nearest-neighbor, bicubic or Lanczos interpolation and
+ * optional letterboxing.
  *
  * When input and output format and dimensions are identical, the element
  * operates in passthrough mode (zero-copy).
@@ -41,22 +42,24 @@
 #import <Foundation/Foundation.h>
 #include "gstvfmetalconvertscale.h"
 #include "metalconvertscalerenderer.h"
+#import "vfmetalmemory.h"
 
 GST_DEBUG_CATEGORY (gst_vf_metal_convertscale_debug);
 #define GST_CAT_DEFAULT gst_vf_metal_convertscale_debug
 
-#define VF_METAL_CONVERTSCALE_FORMATS "{ BGRA, RGBA, NV12, I420, UYVY, YUY2 }"
+#define VF_METAL_CONVERTSCALE_FORMATS \
+    "{ BGRA, RGBA, NV12, I420, UYVY, YUY2, P010_10LE, I420_10LE }"
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (VF_METAL_CONVERTSCALE_FORMATS))
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_CONVERTSCALE_FORMATS))
     );
 
 static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (VF_METAL_CONVERTSCALE_FORMATS))
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_CONVERTSCALE_FORMATS))
     );
 
 enum
@@ -65,6 +68,8 @@ enum
   PROP_METHOD,
   PROP_ADD_BORDERS,
   PROP_BORDER_COLOR,
+  PROP_IN_FLIGHT,
+  PROP_DEVICE,
 };
 
 #define DEFAULT_METHOD          0   /* bilinear */
@@ -72,8 +77,6 @@ enum
 #define DEFAULT_BORDER_COLOR    0xFF000000  /* opaque black */
 
 /* Scaling method enum type */
-#define GST_TYPE_VF_METAL_SCALE_METHOD (gst_vf_metal_scale_method_get_type())
-
 GType
 gst_vf_metal_scale_method_get_type (void)
 {
@@ -81,6 +84,8 @@ gst_vf_metal_scale_method_get_type (void)
   static const GEnumValue methods[] = {
     {0, "Bilinear interpolation", "bilinear"},
     {1, "Nearest-neighbor", "nearest"},
+    {2, "Bicubic (Catmull-Rom, separable)", "bicubic"},
+    {3, "Lanczos-3 (separable)", "lanczos"},
     {0, NULL, NULL}
   };
 
@@ -144,6 +149,10 @@ gst_vf_metal_convertscale_transform_caps (GstBaseTransform * trans,
         "height", GST_TYPE_INT_RANGE, 1, G_MAXINT,
         NULL);
 
+    /* Offer GPU memory first, then system memory: this element is where
+     * a Metal chain uploads or downloads at its edges */
+    gst_caps_append_structure_full (result, gst_structure_copy (s),
+        gst_caps_features_new (GST_CAPS_FEATURE_MEMORY_VF_METAL, NULL));
     gst_caps_append_structure (result, s);
   }
 
@@ -157,11 +166,9 @@ gst_vf_metal_convertscale_transform_caps (GstBaseTransform * trans,
   return result;
 }
 
-static GstCaps *
-gst_vf_metal_convertscale_fixate_caps (GstBaseTransform * trans,
-    GstPadDirection direction, GstCaps * caps, GstCaps * othercaps)
+GstCaps *
+gst_vf_metal_convertscale_fixate_output (GstCaps * caps, GstCaps * othercaps)
 {
-  GstVfMetalConvertScale *self = GST_VF_METAL_CONVERTSCALE (trans);
   GstStructure *ins, *outs;
   const GValue *from_par, *to_par;
   gint from_w, from_h, from_par_n, from_par_d;
@@ -172,9 +179,6 @@ gst_vf_metal_convertscale_fixate_caps (GstBaseTransform * trans,
   othercaps = gst_caps_truncate (othercaps);
   othercaps = gst_caps_make_writable (othercaps);
 
-  GST_DEBUG_OBJECT (self, "fixating othercaps %" GST_PTR_FORMAT
-      " based on caps %" GST_PTR_FORMAT, othercaps, caps);
-
   ins = gst_caps_get_structure (caps, 0);
   outs = gst_caps_get_structure (othercaps, 0);
 
@@ -187,6 +191,27 @@ gst_vf_metal_convertscale_fixate_caps (GstBaseTransform * trans,
     }
   }
 
+  /* YUV to YUV keeps the input colorimetry unless downstream asked for
+   * one: only the matrix, range and bit depth are converted, never the
+   * primaries or transfer, so a resolution-based default would be wrong */
+  {
+    const gchar *colorimetry = gst_structure_get_string (ins, "colorimetry");
+    const gchar *in_format = gst_structure_get_string (ins, "format");
+    const gchar *out_format = gst_structure_get_string (outs, "format");
+    GstVideoFormat ifmt = in_format ?
+        gst_video_format_from_string (in_format) : GST_VIDEO_FORMAT_UNKNOWN;
+    GstVideoFormat ofmt = out_format ?
+        gst_video_format_from_string (out_format) : GST_VIDEO_FORMAT_UNKNOWN;
+
+    if (colorimetry && ifmt != GST_VIDEO_FORMAT_UNKNOWN &&
+        ofmt != GST_VIDEO_FORMAT_UNKNOWN &&
+        GST_VIDEO_FORMAT_INFO_IS_YUV (gst_video_format_get_info (ifmt)) &&
+        GST_VIDEO_FORMAT_INFO_IS_YUV (gst_video_format_get_info (ofmt)) &&
+        !gst_structure_has_field (outs, "colorimetry"))
+      gst_structure_set (outs, "colorimetry", G_TYPE_STRING, colorimetry,
+          NULL);
+  }
+
   /* Get input dimensions */
   gst_structure_get_int (ins, "width", &from_w);
   gst_structure_get_int (ins, "height", &from_h);
@@ -247,6 +272,16 @@ gst_vf_metal_convertscale_fixate_caps (GstBaseTransform * trans,
   return othercaps;
 }
 
+static GstCaps *
+gst_vf_metal_convertscale_fixate_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * othercaps)
+{
+  GST_DEBUG_OBJECT (trans, "fixating othercaps %" GST_PTR_FORMAT
+      " based on caps %" GST_PTR_FORMAT, othercaps, caps);
+
+  return gst_vf_metal_convertscale_fixate_output (caps, othercaps);
+}
+
 static gboolean
 gst_vf_metal_convertscale_set_caps (GstBaseTransform * trans,
     GstCaps * incaps, GstCaps * outcaps)
@@ -317,6 +352,32 @@ gst_vf_metal_convertscale_get_unit_size (GstBaseTransform * trans,
   return TRUE;
 }
 
+/* --- Allocation --- */
+
+static gboolean
+gst_vf_metal_convertscale_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  GstVfMetalConvertScale *self = GST_VF_METAL_CONVERTSCALE (trans);
+
+  return vf_metal_propose_allocation (trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class),
+      ((__bridge MetalConvertScaleRenderer *)self->renderer).metalDevice,
+      decide_query, query);
+}
+
+static gboolean
+gst_vf_metal_convertscale_decide_allocation (GstBaseTransform * trans,
+    GstQuery * query)
+{
+  GstVfMetalConvertScale *self = GST_VF_METAL_CONVERTSCALE (trans);
+
+  return vf_metal_decide_allocation (trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class),
+      ((__bridge MetalConvertScaleRenderer *)self->renderer).metalDevice,
+      &self->inflight, query);
+}
+
 /* --- transform --- */
 
 static GstFlowReturn
@@ -336,13 +397,14 @@ gst_vf_metal_convertscale_transform (GstBaseTransform * trans,
     return GST_FLOW_ERROR;
   }
 
-  if (!gst_video_frame_map (&inframe, &self->in_info, inbuf, GST_MAP_READ)) {
+  if (!gst_video_frame_map (&inframe, &self->in_info, inbuf,
+          GST_MAP_READ | GST_MAP_VF_METAL)) {
     GST_ERROR_OBJECT (self, "Failed to map input buffer");
     return GST_FLOW_ERROR;
   }
 
   if (!gst_video_frame_map (&outframe, &self->out_info, outbuf,
-          GST_MAP_WRITE)) {
+          GST_MAP_WRITE | GST_MAP_VF_METAL)) {
     gst_video_frame_unmap (&inframe);
     GST_ERROR_OBJECT (self, "Failed to map output buffer");
     return GST_FLOW_ERROR;
@@ -366,6 +428,72 @@ gst_vf_metal_convertscale_transform (GstBaseTransform * trans,
   return GST_FLOW_OK;
 }
 
+/* --- Pipelined submission (in-flight > 1) --- */
+
+static gboolean
+gst_vf_metal_convertscale_submit (GstBaseTransform * trans,
+    VfMetalInflightJob * job, VfMetalCompletionHandler completion)
+{
+  GstVfMetalConvertScale *self = GST_VF_METAL_CONVERTSCALE (trans);
+
+  if (!self->negotiated || !self->renderer)
+    return FALSE;
+
+  MetalConvertScaleRenderer *renderer =
+      (__bridge MetalConvertScaleRenderer *)self->renderer;
+
+  @autoreleasepool {
+    return [renderer submitFrame:&job->in_frame output:&job->out_frame
+                            slot:job->slot completion:completion];
+  }
+}
+
+static GstFlowReturn
+gst_vf_metal_convertscale_generate_output (GstBaseTransform * trans,
+    GstBuffer ** outbuf)
+{
+  GstVfMetalConvertScale *self = GST_VF_METAL_CONVERTSCALE (trans);
+
+  return vf_metal_inflight_generate_output (&self->inflight, trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class), &self->in_info,
+      &self->out_info, gst_vf_metal_convertscale_submit, outbuf);
+}
+
+static gboolean
+gst_vf_metal_convertscale_sink_event (GstBaseTransform * trans,
+    GstEvent * event)
+{
+  GstVfMetalConvertScale *self = GST_VF_METAL_CONVERTSCALE (trans);
+
+  vf_metal_inflight_sink_event (&self->inflight, trans, event);
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event);
+}
+
+static gboolean
+gst_vf_metal_convertscale_query (GstBaseTransform * trans,
+    GstPadDirection direction, GstQuery * query)
+{
+  GstVfMetalConvertScale *self = GST_VF_METAL_CONVERTSCALE (trans);
+
+  if (vf_metal_device_selection_handle_query (GST_ELEMENT (trans),
+          &self->device, query))
+    return TRUE;
+
+  if (!GST_BASE_TRANSFORM_CLASS (parent_class)->query (trans, direction,
+          query))
+    return FALSE;
+
+  if (direction == GST_PAD_SRC && GST_QUERY_TYPE (query) == GST_QUERY_LATENCY
+      && self->negotiated && !gst_base_transform_is_passthrough (trans)) {
+    vf_metal_inflight_add_latency (&self->inflight, query,
+        GST_VIDEO_INFO_FPS_N (&self->out_info),
+        GST_VIDEO_INFO_FPS_D (&self->out_info));
+  }
+
+  return TRUE;
+}
+
 /* --- Properties --- */
 
 static void
@@ -384,6 +512,14 @@ gst_vf_metal_convertscale_set_property (GObject * object, guint prop_id,
     case PROP_BORDER_COLOR:
       self->border_color = g_value_get_uint (value);
       break;
+    case PROP_IN_FLIGHT:
+      /* Latched at READY_TO_PAUSED, nothing to reconfigure */
+      self->in_flight = g_value_get_uint (value);
+      return;
+    case PROP_DEVICE:
+      vf_metal_device_selection_set_property (GST_ELEMENT (self),
+          &self->device, value);
+      return;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       return;
@@ -419,12 +555,70 @@ gst_vf_metal_convertscale_get_property (GObject * object, guint prop_id,
     case PROP_BORDER_COLOR:
       g_value_set_uint (value, self->border_color);
       break;
+    case PROP_IN_FLIGHT:
+      g_value_set_uint (value, self->in_flight);
+      break;
+    case PROP_DEVICE:
+      vf_metal_device_selection_get_property (GST_ELEMENT (self),
+          &self->device, value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
 }
 
+/* --- Device --- */
+
+static void
+gst_vf_metal_convertscale_set_context (GstElement * element,
+    GstContext * context)
+{
+  GstVfMetalConvertScale *self = GST_VF_METAL_CONVERTSCALE (element);
+
+  vf_metal_device_selection_set_context (element, &self->device, context);
+
+  GST_ELEMENT_CLASS (parent_class)->set_context (element, context);
+}
+
+/* Renderer on the selected GPU, replaced when the selection moved */
+static gboolean
+gst_vf_metal_convertscale_ensure_renderer (GstVfMetalConvertScale * self)
+{
+  VfMetalDevice *device;
+
+  device = vf_metal_device_selection_ensure (GST_ELEMENT (self),
+      &self->device);
+  if (!device)
+    return FALSE;
+
+  @autoreleasepool {
+    if (self->renderer) {
+      MetalConvertScaleRenderer *renderer =
+          (__bridge MetalConvertScaleRenderer *)self->renderer;
+      if (renderer.metalDevice == device)
+        return TRUE;
+
+      renderer = (__bridge_transfer MetalConvertScaleRenderer *)self->renderer;
+      self->renderer = NULL;
+      [renderer cleanup];
+    }
+
+    MetalConvertScaleRenderer *renderer =
+        [[MetalConvertScaleRenderer alloc] initWithDevice:device];
+    if (!renderer) {
+      GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+          ("Failed to create Metal renderer on '%s'",
+              device.device.name.UTF8String), (NULL));
+      return FALSE;
+    }
+    renderer.traceOwner = GST_OBJECT (self);
+    self->renderer = (__bridge_retained void *)renderer;
+  }
+
+  return TRUE;
+}
+
 /* --- State change --- */
 
 static GstStateChangeReturn
@@ -434,10 +628,17 @@ gst_vf_metal_convertscale_change_state (GstElement * element,
   GstVfMetalConvertScale *self = GST_VF_METAL_CONVERTSCALE (element);
   GstStateChangeReturn ret;
 
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY &&
+      !gst_vf_metal_convertscale_ensure_renderer (self))
+    return GST_STATE_CHANGE_FAILURE;
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED)
+    vf_metal_inflight_start (&self->inflight, self->in_flight);
+
   ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
 
   switch (transition) {
     case GST_STATE_CHANGE_PAUSED_TO_READY:
+      vf_metal_inflight_stop (&self->inflight);
       if (self->renderer) {
         @autoreleasepool {
           MetalConvertScaleRenderer *renderer =
@@ -447,6 +648,9 @@ gst_vf_metal_convertscale_change_state (GstElement * element,
       }
       self->negotiated = FALSE;
       break;
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      vf_metal_device_selection_reset (element, &self->device);
+      break;
     default:
       break;
   }
@@ -471,6 +675,9 @@ gst_vf_metal_convertscale_finalize (GObject * object)
     }
   }
 
+  vf_metal_inflight_clear (&self->inflight);
+  vf_metal_device_selection_clear (&self->device);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -490,6 +697,8 @@ gst_vf_metal_convertscale_class_init (GstVfMetalConvertScaleClass * klass)
 
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_vf_metal_convertscale_change_state);
+  gstelement_class->set_context =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_convertscale_set_context);
 
   basetransform_class->transform_caps =
       GST_DEBUG_FUNCPTR (gst_vf_metal_convertscale_transform_caps);
@@ -501,6 +710,16 @@ gst_vf_metal_convertscale_class_init (GstVfMetalConvertScaleClass * klass)
       GST_DEBUG_FUNCPTR (gst_vf_metal_convertscale_get_unit_size);
   basetransform_class->transform =
       GST_DEBUG_FUNCPTR (gst_vf_metal_convertscale_transform);
+  basetransform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_convertscale_propose_allocation);
+  basetransform_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_convertscale_decide_allocation);
+  basetransform_class->generate_output =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_convertscale_generate_output);
+  basetransform_class->sink_event =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_convertscale_sink_event);
+  basetransform_class->query =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_convertscale_query);
 
   /* We handle passthrough ourselves */
   basetransform_class->passthrough_on_same_caps = FALSE;
@@ -525,6 +744,18 @@ gst_vf_metal_convertscale_class_init (GstVfMetalConvertScaleClass * klass)
           0, G_MAXUINT32, DEFAULT_BORDER_COLOR,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_IN_FLIGHT,
+      g_param_spec_uint ("in-flight", "In-flight frames",
+          "Frames queued on the GPU before the oldest is pushed downstream "
+          "(1 = wait for every frame; each extra frame adds one frame of "
+          "latency)",
+          1, VF_METAL_MAX_IN_FLIGHT, VF_METAL_DEFAULT_IN_FLIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_DEVICE,
+      vf_metal_device_selection_param_spec ());
+
   /* Pad templates */
   gst_element_class_add_static_pad_template (gstelement_class, &sink_template);
   gst_element_class_add_static_pad_template (gstelement_class, &src_template);
@@ -549,14 +780,9 @@ gst_vf_metal_convertscale_init (GstVfMetalConvertScale * self)
   self->border_color = DEFAULT_BORDER_COLOR;
   self->negotiated = FALSE;
 
-  @autoreleasepool {
-    MetalConvertScaleRenderer *renderer =
-        [[MetalConvertScaleRenderer alloc] init];
-    if (renderer) {
-      self->renderer = (__bridge_retained void *)renderer;
-    } else {
-      GST_ERROR_OBJECT (self,
-          "Failed to create Metal renderer — no Metal device");
-    }
-  }
+  self->in_flight = VF_METAL_DEFAULT_IN_FLIGHT;
+  vf_metal_inflight_init (&self->inflight);
+
+  /* The renderer waits for NULL_TO_READY, when the GPU is known */
+  vf_metal_device_selection_init (&self->device);
 }
@@ -26,14 +26,16 @@
 
 /* Convertscale shader source — concatenated after kVfMetalCommonShaderSource.
  * Contains vertex/fragment shaders for format conversion + scaling,
- * and compute kernels for UYVY/YUY2 output. */
+ * compute kernels for UYVY/YUY2 output, plane-native scaling kernels
+ * for conversions that stay within one YUV family, and the separable
+ * bicubic/Lanczos resampling passes. */
 
 static NSString *const kConvertScaleShaderSource = @R"(
 
 // --- Convertscale uniforms ---
 
 struct ConvertScaleUniforms {
-    int colorMatrix;        // 0=BT.601, 1=BT.709
+    int colorMatrix;        // colour word, VF_COLOR_*
     int padding1;
     float2 padding2;
 };
@@ -209,28 +211,20 @@ kernel void rgbaToUYVY(
     uint outWidth = uniforms.width / 2;
     if (gid.x >= outWidth || gid.y >= uniforms.height) return;
 
-    float3x3 mat = (uniforms.colorMatrix == 1) ? bt709_rgb_matrix : bt601_rgb_matrix;
-    float3 off = (uniforms.colorMatrix == 1) ? bt709_rgb_offset : bt601_rgb_offset;
-
     uint2 p0 = uint2(gid.x * 2, gid.y);
     uint2 p1 = uint2(min(gid.x * 2 + 1, uniforms.width - 1), gid.y);
 
     float3 rgb0 = rgbaTex.read(p0).rgb;
     float3 rgb1 = rgbaTex.read(p1).rgb;
 
-    float3 yuv0 = mat * rgb0 + off;
-    float3 yuv1 = mat * rgb1 + off;
+    float3 yuv0 = rgbToYUV(rgb0, uniforms.colorMatrix);
+    float3 yuv1 = rgbToYUV(rgb1, uniforms.colorMatrix);
 
     float u = (yuv0.g + yuv1.g) * 0.5;
     float v = (yuv0.b + yuv1.b) * 0.5;
 
     // UYVY: U Y0 V Y1
-    float4 packed = float4(
-        clamp(u, 0.0, 1.0),
-        clamp(yuv0.r, 0.0, 1.0),
-        clamp(v, 0.0, 1.0),
-        clamp(yuv1.r, 0.0, 1.0)
-    );
+    float4 packed = float4(u, yuv0.r, v, yuv1.r);
     outTex.write(packed, gid);
 }
 
@@ -243,31 +237,292 @@ kernel void rgbaToYUY2(
     uint outWidth = uniforms.width / 2;
     if (gid.x >= outWidth || gid.y >= uniforms.height) return;
 
-    float3x3 mat = (uniforms.colorMatrix == 1) ? bt709_rgb_matrix : bt601_rgb_matrix;
-    float3 off = (uniforms.colorMatrix == 1) ? bt709_rgb_offset : bt601_rgb_offset;
-
     uint2 p0 = uint2(gid.x * 2, gid.y);
     uint2 p1 = uint2(min(gid.x * 2 + 1, uniforms.width - 1), gid.y);
 
     float3 rgb0 = rgbaTex.read(p0).rgb;
     float3 rgb1 = rgbaTex.read(p1).rgb;
 
-    float3 yuv0 = mat * rgb0 + off;
-    float3 yuv1 = mat * rgb1 + off;
+    float3 yuv0 = rgbToYUV(rgb0, uniforms.colorMatrix);
+    float3 yuv1 = rgbToYUV(rgb1, uniforms.colorMatrix);
 
     float u = (yuv0.g + yuv1.g) * 0.5;
     float v = (yuv0.b + yuv1.b) * 0.5;
 
     // YUY2: Y0 U Y1 V
-    float4 packed = float4(
-        clamp(yuv0.r, 0.0, 1.0),
-        clamp(u, 0.0, 1.0),
-        clamp(yuv1.r, 0.0, 1.0),
-        clamp(v, 0.0, 1.0)
-    );
+    float4 packed = float4(yuv0.r, u, yuv1.r, v);
     outTex.write(packed, gid);
 }
 
+// --- Plane-native scaling (NV12/I420 <-> NV12/I420, UYVY/YUY2 <-> UYVY/YUY2) ---
+//
+// Each output plane is sampled straight from the matching input plane, so
+// same-family conversions never round-trip through RGBA. Sources are bound
+// at texture(0..1), destinations at texture(2..3).
+
+struct PlaneScaleUniforms {
+    float4 borderColor;     // letterbox colour, RGB
+    float2 contentOrigin;   // picture rectangle, as a fraction of the output
+    float2 contentSize;
+    int colorMatrix;        // colour word, input and output agree
+    int nearest;            // 1 = nearest-neighbour sampling
+    int inputYUY2;          // packed byte order: 0 = UYVY, 1 = YUY2
+    int outputYUY2;
+};
+
+// Output texel -> input uv; outside [0,1] is letterbox
+static inline float2 planeSourceCoord(uint2 gid, uint2 size,
+                                      constant PlaneScaleUniforms &u) {
+    float2 p = (float2(gid) + 0.5) / float2(size);
+    return (p - u.contentOrigin) / u.contentSize;
+}
+
+static inline bool planeOutside(float2 uv) {
+    return uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0;
+}
+
+static inline float3 planeBorderYUV(constant PlaneScaleUniforms &u) {
+    return rgbToYUV(u.borderColor.rgb, u.colorMatrix);
+}
+
+static inline float4 planeSample(texture2d<float> tex, float2 uv,
+                                 constant PlaneScaleUniforms &u) {
+    constexpr sampler linearSampler(filter::linear, address::clamp_to_edge);
+    constexpr sampler nearestSampler(filter::nearest, address::clamp_to_edge);
+    return u.nearest ? tex.sample(nearestSampler, uv)
+                     : tex.sample(linearSampler, uv);
+}
+
+kernel void scaleLumaPlane(
+    texture2d<float> srcTex [[texture(0)]],
+    texture2d<float, access::write> dstTex [[texture(2)]],
+    constant PlaneScaleUniforms &u [[buffer(0)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    uint2 size = uint2(dstTex.get_width(), dstTex.get_height());
+    if (gid.x >= size.x || gid.y >= size.y) return;
+
+    float2 uv = planeSourceCoord(gid, size, u);
+    float y = planeOutside(uv) ? planeBorderYUV(u).x
+                               : planeSample(srcTex, uv, u).r;
+    dstTex.write(float4(y, 0.0, 0.0, 1.0), gid);
+}
+
+// Chroma of one output texel as (Cb, Cr), from interleaved or split planes
+static inline float2 planeChromaNV12(texture2d<float> uvTex, uint2 gid,
+                                     uint2 size, constant PlaneScaleUniforms &u) {
+    float2 uv = planeSourceCoord(gid, size, u);
+    return planeOutside(uv) ? planeBorderYUV(u).yz
+                            : planeSample(uvTex, uv, u).rg;
+}
+
+static inline float2 planeChromaI420(texture2d<float> uTex,
+                                     texture2d<float> vTex, uint2 gid,
+                                     uint2 size, constant PlaneScaleUniforms &u) {
+    float2 uv = planeSourceCoord(gid, size, u);
+    if (planeOutside(uv))
+        return planeBorderYUV(u).yz;
+    return float2(planeSample(uTex, uv, u).r, planeSample(vTex, uv, u).r);
+}
+
+kernel void scaleChromaNV12ToNV12(
+    texture2d<float> uvTex [[texture(0)]],
+    texture2d<float, access::write> dstUV [[texture(2)]],
+    constant PlaneScaleUniforms &u [[buffer(0)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    uint2 size = uint2(dstUV.get_width(), dstUV.get_height());
+    if (gid.x >= size.x || gid.y >= size.y) return;
+
+    float2 c = planeChromaNV12(uvTex, gid, size, u);
+    dstUV.write(float4(c, 0.0, 1.0), gid);
+}
+
+kernel void scaleChromaNV12ToI420(
+    texture2d<float> uvTex [[texture(0)]],
+    texture2d<float, access::write> dstU [[texture(2)]],
+    texture2d<float, access::write> dstV [[texture(3)]],
+    constant PlaneScaleUniforms &u [[buffer(0)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    uint2 size = uint2(dstU.get_width(), dstU.get_height());
+    if (gid.x >= size.x || gid.y >= size.y) return;
+
+    float2 c = planeChromaNV12(uvTex, gid, size, u);
+    dstU.write(float4(c.x, 0.0, 0.0, 1.0), gid);
+    dstV.write(float4(c.y, 0.0, 0.0, 1.0), gid);
+}
+
+kernel void scaleChromaI420ToNV12(
+    texture2d<float> uTex [[texture(0)]],
+    texture2d<float> vTex [[texture(1)]],
+    texture2d<float, access::write> dstUV [[texture(2)]],
+    constant PlaneScaleUniforms &u [[buffer(0)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    uint2 size = uint2(dstUV.get_width(), dstUV.get_height());
+    if (gid.x >= size.x || gid.y >= size.y) return;
+
+    float2 c = planeChromaI420(uTex, vTex, gid, size, u);
+    dstUV.write(float4(c, 0.0, 1.0), gid);
+}
+
+kernel void scaleChromaI420ToI420(
+    texture2d<float> uTex [[texture(0)]],
+    texture2d<float> vTex [[texture(1)]],
+    texture2d<float, access::write> dstU [[texture(2)]],
+    texture2d<float, access::write> dstV [[texture(3)]],
+    constant PlaneScaleUniforms &u [[buffer(0)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    uint2 size = uint2(dstU.get_width(), dstU.get_height());
+    if (gid.x >= size.x || gid.y >= size.y) return;
+
+    float2 c = planeChromaI420(uTex, vTex, gid, size, u);
+    dstU.write(float4(c.x, 0.0, 0.0, 1.0), gid);
+    dstV.write(float4(c.y, 0.0, 0.0, 1.0), gid);
+}
+
+// Packed 4:2:2 stored as RGBA8 at half width: one texel per macro-pixel
+static inline float packedLumaAt(texture2d<float, access::read> tex,
+                                 int2 p, bool yuy2) {
+    int2 size = int2(tex.get_width() * 2, tex.get_height());
+    p = clamp(p, int2(0), size - 1);
+    float4 t = tex.read(uint2(p.x / 2, p.y));
+    bool odd = (p.x & 1) != 0;
+    return yuy2 ? (odd ? t.b : t.r) : (odd ? t.a : t.g);
+}
+
+static inline float2 packedChromaAt(texture2d<float, access::read> tex,
+                                    int2 m, bool yuy2) {
+    int2 size = int2(tex.get_width(), tex.get_height());
+    float4 t = tex.read(uint2(clamp(m, int2(0), size - 1)));
+    return yuy2 ? t.ga : t.rb;
+}
+
+// pos in input pixels (luma) or macro-pixels (chroma)
+static inline float packedLuma(texture2d<float, access::read> tex,
+                               float2 pos, constant PlaneScaleUniforms &u) {
+    bool yuy2 = u.inputYUY2 != 0;
+    if (u.nearest)
+        return packedLumaAt(tex, int2(floor(pos)), yuy2);
+
+    pos -= 0.5;
+    int2 p = int2(floor(pos));
+    float2 f = fract(pos);
+    float top = mix(packedLumaAt(tex, p, yuy2),
+                    packedLumaAt(tex, p + int2(1, 0), yuy2), f.x);
+    float bottom = mix(packedLumaAt(tex, p + int2(0, 1), yuy2),
+                       packedLumaAt(tex, p + int2(1, 1), yuy2), f.x);
+    return mix(top, bottom, f.y);
+}
+
+static inline float2 packedChroma(texture2d<float, access::read> tex,
+                                  float2 pos, constant PlaneScaleUniforms &u) {
+    bool yuy2 = u.inputYUY2 != 0;
+    if (u.nearest)
+        return packedChromaAt(tex, int2(floor(pos)), yuy2);
+
+    pos -= 0.5;
+    int2 m = int2(floor(pos));
+    float2 f = fract(pos);
+    float2 top = mix(packedChromaAt(tex, m, yuy2),
+                     packedChromaAt(tex, m + int2(1, 0), yuy2), f.x);
+    float2 bottom = mix(packedChromaAt(tex, m + int2(0, 1), yuy2),
+                        packedChromaAt(tex, m + int2(1, 1), yuy2), f.x);
+    return mix(top, bottom, f.y);
+}
+
+kernel void scalePacked(
+    texture2d<float, access::read> srcTex [[texture(0)]],
+    texture2d<float, access::write> dstTex [[texture(2)]],
+    constant PlaneScaleUniforms &u [[buffer(0)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    // Each thread writes one output macro-pixel (2 luma samples, 1 chroma)
+    uint2 macroSize = uint2(dstTex.get_width(), dstTex.get_height());
+    if (gid.x >= macroSize.x || gid.y >= macroSize.y) return;
+
+    uint2 lumaSize = uint2(macroSize.x * 2, macroSize.y);
+    float2 inLuma = float2(srcTex.get_width() * 2, srcTex.get_height());
+    float2 inMacro = float2(srcTex.get_width(), srcTex.get_height());
+    float3 border = planeBorderYUV(u);
+
+    float y[2];
+    for (uint i = 0; i < 2; i++) {
+        float2 uv = planeSourceCoord(uint2(gid.x * 2 + i, gid.y), lumaSize, u);
+        y[i] = planeOutside(uv) ? border.x : packedLuma(srcTex, uv * inLuma, u);
+    }
+
+    float2 uv = planeSourceCoord(gid, macroSize, u);
+    float2 c = planeOutside(uv) ? border.yz
+                                : packedChroma(srcTex, uv * inMacro, u);
+
+    float4 packed = u.outputYUY2 ? float4(y[0], c.x, y[1], c.y)   // Y0 U Y1 V
+                                 : float4(c.x, y[0], c.y, y[1]);  // U Y0 V Y1
+    dstTex.write(packed, gid);
+}
+
+// --- Separable resampling (bicubic / Lanczos) ---
+//
+// Two passes over host-computed weight tables: horizontal into a float
+// intermediate at (content width x source height), then vertical into the
+// output-sized render target. Each output column/row has its first tap and
+// tap count in bounds[] and its weights at weights[i * taps].
+
+struct ResampleUniforms {
+    float4 borderColor;     // letterbox colour, RGBA
+    int2 contentOrigin;     // vertical pass: picture rectangle in the output
+    int2 contentSize;
+    int taps;               // weight stride per output pixel
+    int padding1;
+    int2 padding2;
+};
+
+kernel void resampleHorizontal(
+    texture2d<float, access::read> srcTex [[texture(0)]],
+    texture2d<float, access::write> dstTex [[texture(1)]],
+    constant ResampleUniforms &u [[buffer(0)]],
+    device const int2 *bounds [[buffer(1)]],
+    device const float *weights [[buffer(2)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= dstTex.get_width() || gid.y >= dstTex.get_height()) return;
+
+    int2 b = bounds[gid.x];
+    device const float *w = weights + gid.x * u.taps;
+    float4 sum = float4(0.0);
+    for (int i = 0; i < b.y; i++)
+        sum += w[i] * srcTex.read(uint2(b.x + i, gid.y));
+    dstTex.write(sum, gid);
+}
+
+kernel void resampleVertical(
+    texture2d<float, access::read> srcTex [[texture(0)]],
+    texture2d<float, access::write> dstTex [[texture(1)]],
+    constant ResampleUniforms &u [[buffer(0)]],
+    device const int2 *bounds [[buffer(1)]],
+    device const float *weights [[buffer(2)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= dstTex.get_width() || gid.y >= dstTex.get_height()) return;
+
+    int2 p = int2(gid) - u.contentOrigin;
+    if (any(p < 0) || any(p >= u.contentSize)) {
+        dstTex.write(u.borderColor, gid);
+        return;
+    }
+
+    int2 b = bounds[p.y];
+    device const float *w = weights + p.y * u.taps;
+    float4 sum = float4(0.0);
+    for (int i = 0; i < b.y; i++)
+        sum += w[i] * srcTex.read(uint2(p.x, b.x + i));
+
+    // Lanczos and bicubic lobes can overshoot
+    dstTex.write(clamp(sum, 0.0, 1.0), gid);
+}
+
 )";
 
 #endif /* __METAL_CONVERTSCALE_SHADERS_H__ */
@@ -26,15 +26,28 @@
 #import <Metal/Metal.h>
 #include <gst/video/video.h>
 
+#import "vfmetaldevice.h"
+#import "vfmetalinflight.h"
+
 /* Scaling interpolation method */
 typedef enum {
     VF_METAL_SCALE_BILINEAR = 0,
     VF_METAL_SCALE_NEAREST  = 1,
+    VF_METAL_SCALE_BICUBIC  = 2,    /* separable Catmull-Rom */
+    VF_METAL_SCALE_LANCZOS  = 3,    /* separable Lanczos-3 */
 } VfMetalScaleMethod;
 
 @interface MetalConvertScaleRenderer : NSObject
 
+/* Element this renderer's stages are traced for (see vfmetaltrace.h) */
+@property (nonatomic, assign) GstObject *traceOwner;
+
+/* GPU this renderer runs on, fixed at creation */
+@property (nonatomic, readonly) VfMetalDevice *metalDevice;
+
+/* -init uses the default device (+[VfMetalDevice sharedDevice]) */
 - (instancetype)init;
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice;
 
 - (BOOL)configureWithInputInfo:(GstVideoInfo *)inInfo
                     outputInfo:(GstVideoInfo *)outInfo
@@ -45,6 +58,52 @@ typedef enum {
 - (BOOL)processFrame:(GstVideoFrame *)inFrame
               output:(GstVideoFrame *)outFrame;
 
+/* Pipelined variant: encode into ring @slot, commit without waiting and
+ * call @completion once outFrame has been read back. Returns NO (and
+ * never calls @completion) if nothing was committed. */
+- (BOOL)submitFrame:(GstVideoFrame *)inFrame
+             output:(GstVideoFrame *)outFrame
+               slot:(NSUInteger)slot
+         completion:(VfMetalCompletionHandler)completion;
+
+/* Keep the RGBA render target even where a plane-native path exists, so
+ * later passes in the same command buffer can read -renderTarget.
+ * Applies from the next configure. */
+@property (nonatomic) BOOL keepsRenderTarget;
+
+/* RGBA picture at output size written by the last encode; nil when the
+ * plane-native path is in use */
+@property (nonatomic, readonly) id<MTLTexture> renderTarget;
+
+/* Whether -configureWithInputInfo:... would rebuild anything for these
+ * arguments (and the current keepsRenderTarget). A rebuild drops the
+ * slot textures frames still in flight are read back from. */
+- (BOOL)needsConfigureWithInputInfo:(GstVideoInfo *)inInfo
+                         outputInfo:(GstVideoInfo *)outInfo
+                             method:(VfMetalScaleMethod)method
+                         addBorders:(BOOL)addBorders
+                        borderColor:(guint32)borderColor;
+
+/* Upload (or wrap, for VfMetalMemory) @inFrame's planes once for ring
+ * @slot, to be shared by every renderer on the same device through
+ * -encodeFrame:inputPlanes:... */
+- (NSArray<id<MTLTexture>> *)uploadInputPlanes:(GstVideoFrame *)inFrame
+                                          slot:(NSUInteger)slot;
+
+/* Encode @inFrame — from @planes when set, else uploaded here — or, when
+ * @source is set, an RGBA texture rendered earlier in @commandBuffer,
+ * into @outFrame's format in ring @slot without committing. Once
+ * @commandBuffer has completed, finish with -readbackFrame:slot:, which
+ * never waits on the GPU and may run from its completion handler. */
+- (BOOL)encodeFrame:(GstVideoFrame *)inFrame
+        inputPlanes:(NSArray<id<MTLTexture>> *)planes
+      sourceTexture:(id<MTLTexture>)source
+      commandBuffer:(id<MTLCommandBuffer>)commandBuffer
+             output:(GstVideoFrame *)outFrame
+               slot:(NSUInteger)slot;
+
+- (void)readbackFrame:(GstVideoFrame *)outFrame slot:(NSUInteger)slot;
+
 - (void)cleanup;
 
 @end
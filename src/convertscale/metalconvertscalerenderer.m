@@ -25,8 +25,11 @@
 #import "vfmetaltextureutil.h"
 #import "vfmetalshaders.h"
 #import "vfmetalyuvoutput.h"
+#import "vfmetaltrace.h"
+#import "vfmetalmemory.h"
 
 #include <gst/gst.h>
+#include <math.h>
 
 GST_DEBUG_CATEGORY_EXTERN (gst_vf_metal_convertscale_debug);
 #define GST_CAT_DEFAULT gst_vf_metal_convertscale_debug
@@ -45,8 +48,10 @@ static CsInputFormat
 cs_input_format_index (GstVideoFormat format)
 {
     switch (format) {
-        case GST_VIDEO_FORMAT_NV12: return CS_INPUT_NV12;
-        case GST_VIDEO_FORMAT_I420: return CS_INPUT_I420;
+        case GST_VIDEO_FORMAT_NV12:
+        case GST_VIDEO_FORMAT_P010_10LE: return CS_INPUT_NV12;
+        case GST_VIDEO_FORMAT_I420:
+        case GST_VIDEO_FORMAT_I420_10LE: return CS_INPUT_I420;
         case GST_VIDEO_FORMAT_UYVY: return CS_INPUT_UYVY;
         case GST_VIDEO_FORMAT_YUY2: return CS_INPUT_YUY2;
         default: return CS_INPUT_RGBA;
@@ -60,6 +65,88 @@ typedef struct {
     float padding2[2];
 } ConvertScaleUniformsGPU;
 
+/* Plane scaling uniforms — must match PlaneScaleUniforms in MSL */
+typedef struct {
+    float borderColor[4];
+    float contentOrigin[2];
+    float contentSize[2];
+    int32_t colorMatrix;
+    int32_t nearest;
+    int32_t inputYUY2;
+    int32_t outputYUY2;
+} PlaneScaleUniformsGPU;
+
+/* Separable resampling uniforms — must match ResampleUniforms in MSL */
+typedef struct {
+    float borderColor[4];
+    int32_t contentOrigin[2];
+    int32_t contentSize[2];
+    int32_t taps;
+    int32_t padding1;
+    int32_t padding2[2];
+} ResampleUniformsGPU;
+
+/* Full-output viewport for passes that render at source size */
+static const float kIdentityViewport[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+static BOOL
+cs_method_is_separable (VfMetalScaleMethod method)
+{
+    return method == VF_METAL_SCALE_BICUBIC || method == VF_METAL_SCALE_LANCZOS;
+}
+
+/* Catmull-Rom (Keys cubic, a = -0.5), support 2 */
+static double
+cs_filter_bicubic (double x)
+{
+    const double a = -0.5;
+    x = fabs (x);
+    if (x < 1.0) return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+    if (x < 2.0) return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+    return 0.0;
+}
+
+static double
+cs_sinc (double x)
+{
+    if (x == 0.0) return 1.0;
+    x *= M_PI;
+    return sin (x) / x;
+}
+
+/* Lanczos windowed sinc, support 3 */
+static double
+cs_filter_lanczos3 (double x)
+{
+    x = fabs (x);
+    return (x < 3.0) ? cs_sinc (x) * cs_sinc (x / 3.0) : 0.0;
+}
+
+static BOOL
+cs_format_is_packed_yuv (GstVideoFormat format)
+{
+    return format == GST_VIDEO_FORMAT_UYVY || format == GST_VIDEO_FORMAT_YUY2;
+}
+
+static void
+cs_dispatch_over (id<MTLComputeCommandEncoder> compute, id<MTLTexture> dst)
+{
+    MTLSize tg = MTLSizeMake(16, 16, 1);
+    MTLSize grid = MTLSizeMake((dst.width + 15) / 16, (dst.height + 15) / 16, 1);
+    [compute dispatchThreadgroups:grid threadsPerThreadgroup:tg];
+}
+
+/* One axis of the separable resampler: per output pixel the first source
+ * tap and tap count (int2), and @taps normalised weights */
+@interface CsResampleWeights : NSObject
+@property (nonatomic, strong) id<MTLBuffer> bounds;
+@property (nonatomic, strong) id<MTLBuffer> weights;
+@property (nonatomic) int taps;
+@end
+
+@implementation CsResampleWeights
+@end
+
 @implementation MetalConvertScaleRenderer {
     id<MTLCommandQueue> _commandQueue;
     id<MTLLibrary> _library;
@@ -74,11 +161,42 @@ typedef struct {
     id<MTLComputePipelineState> _computeUYVY;
     id<MTLComputePipelineState> _computeYUY2;
 
-    /* Intermediate RGBA render target (at output dimensions) */
+    /* Plane-native scaling, used instead of the RGBA render target when
+     * input and output are both NV12/I420 or both UYVY/YUY2 and share a
+     * colour matrix; the chroma pipeline is nil for packed formats */
+    BOOL _direct;
+    id<MTLComputePipelineState> _directLuma;
+    id<MTLComputePipelineState> _directChroma;
+
+    /* Separable bicubic/Lanczos: the input is converted to RGBA at source
+     * size (box-reduced down its mip chain for ratios above 2x), filtered
+     * horizontally into _resampleTemp, then vertically into _renderTarget */
+    id<MTLTexture> _resampleSource;
+    id<MTLTexture> _resampleLevel;      /* mip level the filter reads */
+    id<MTLTexture> _resampleTemp;       /* content width x level height */
+    id<MTLComputePipelineState> _resampleH;
+    id<MTLComputePipelineState> _resampleV;
+    CsResampleWeights *_weightsH;
+    CsResampleWeights *_weightsV;
+    int _contentRect[4];                /* x, y, width, height */
+
+    /* Weight tables by method and source/destination size */
+    NSMutableDictionary<NSString *, CsResampleWeights *> *_weightCache;
+
+    /* Intermediate RGBA render target (at output dimensions), only
+     * allocated when the colour family changes */
     id<MTLTexture> _renderTarget;
+    BOOL _configured;
+    BOOL _configuredKeepsRenderTarget;
+
+    /* Packed output of -encodeFrame:...slot: per slot, for
+     * -readbackFrame:slot: */
+    id<MTLTexture> _encodedPacked[VF_METAL_MAX_IN_FLIGHT];
+    BOOL _encodedPackedResident[VF_METAL_MAX_IN_FLIGHT];
 
-    /* Packed YUV output texture (UYVY/YUY2 only) */
-    id<MTLTexture> _outputPacked;
+    /* Packed YUV output textures (UYVY/YUY2 only), one per in-flight
+     * slot; slot 0 is created by configure, the rest on first use */
+    id<MTLTexture> _outputPacked[VF_METAL_MAX_IN_FLIGHT];
 
     /* Configuration */
     int _inWidth;
@@ -87,6 +205,8 @@ typedef struct {
     int _outHeight;
     GstVideoFormat _inputFormat;
     GstVideoFormat _outputFormat;
+    int _inputColor;            /* colour words, VfMetalColorFlags */
+    int _outputColor;
     VfMetalScaleMethod _method;
     BOOL _addBorders;
     guint32 _borderColor;
@@ -98,29 +218,39 @@ typedef struct {
     VfMetalTextureCache *_textureCache;
 }
 
+- (void)setTraceOwner:(GstObject *)traceOwner
+{
+    _traceOwner = traceOwner;
+    _textureCache.traceOwner = traceOwner;
+    _yuvOutput.traceOwner = traceOwner;
+}
+
 - (instancetype)init
+{
+    return [self initWithDevice:[VfMetalDevice sharedDevice]];
+}
+
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice
 {
     self = [super init];
     if (!self) return nil;
 
-    VfMetalDevice *metalDevice = [VfMetalDevice sharedDevice];
     if (!metalDevice) {
         GST_ERROR ("MetalConvertScaleRenderer: No Metal device available");
         return nil;
     }
+    _metalDevice = metalDevice;
 
-    _commandQueue = [metalDevice.device newCommandQueue];
-    if (!_commandQueue) {
-        GST_ERROR ("MetalConvertScaleRenderer: Failed to create command queue");
-        return nil;
-    }
+    _commandQueue = metalDevice.commandQueue;
 
     /* Compile shaders: common + convertscale-specific */
     NSString *fullSource = [kVfMetalCommonShaderSource
         stringByAppendingString:kConvertScaleShaderSource];
 
     NSError *error = nil;
-    _library = [metalDevice compileShaderSource:fullSource error:&error];
+    _library = [metalDevice libraryNamed:@"convertscale"
+                                  source:fullSource
+                                   error:&error];
     if (!_library) {
         GST_ERROR ("MetalConvertScaleRenderer: Failed to compile shaders: %s",
               error.localizedDescription.UTF8String);
@@ -130,6 +260,7 @@ typedef struct {
     _textureCache = [[VfMetalTextureCache alloc]
         initWithDevice:metalDevice.device];
     _yuvOutput = [[VfMetalYUVOutput alloc] init];
+    _weightCache = [NSMutableDictionary dictionary];
 
     return self;
 }
@@ -167,7 +298,7 @@ typedef struct {
 
 - (BOOL)_createPipelinesForFormat:(MTLPixelFormat)renderPixelFormat
 {
-    id<MTLDevice> device = [VfMetalDevice sharedDevice].device;
+    VfMetalDevice *metalDevice = _metalDevice;
 
     /* Fragment shader names: [inputFormat][method] */
     NSString *fragBilinear[CS_INPUT_COUNT] = {
@@ -211,7 +342,8 @@ typedef struct {
 
             NSError *error = nil;
             _pipelines[fmt][m] =
-                [device newRenderPipelineStateWithDescriptor:desc error:&error];
+                [metalDevice renderPipelineWithDescriptor:desc library:_library
+                                                    error:&error];
             if (!_pipelines[fmt][m]) {
                 GST_ERROR ("Failed to create pipeline fmt=%d method=%d: %s",
                            fmt, m, error.localizedDescription.UTF8String);
@@ -223,6 +355,26 @@ typedef struct {
     return YES;
 }
 
+- (BOOL)needsConfigureWithInputInfo:(GstVideoInfo *)inInfo
+                         outputInfo:(GstVideoInfo *)outInfo
+                             method:(VfMetalScaleMethod)method
+                         addBorders:(BOOL)addBorders
+                        borderColor:(guint32)borderColor
+{
+    return !(_configured &&
+        _inWidth == GST_VIDEO_INFO_WIDTH (inInfo) &&
+        _inHeight == GST_VIDEO_INFO_HEIGHT (inInfo) &&
+        _outWidth == GST_VIDEO_INFO_WIDTH (outInfo) &&
+        _outHeight == GST_VIDEO_INFO_HEIGHT (outInfo) &&
+        _inputFormat == GST_VIDEO_INFO_FORMAT (inInfo) &&
+        _outputFormat == GST_VIDEO_INFO_FORMAT (outInfo) &&
+        _inputColor == vf_metal_color_matrix_for_info (inInfo) &&
+        _outputColor == vf_metal_color_matrix_for_info (outInfo) &&
+        _method == method && _addBorders == addBorders &&
+        _borderColor == borderColor &&
+        _configuredKeepsRenderTarget == _keepsRenderTarget);
+}
+
 - (BOOL)configureWithInputInfo:(GstVideoInfo *)inInfo
                     outputInfo:(GstVideoInfo *)outInfo
                         method:(VfMetalScaleMethod)method
@@ -235,88 +387,114 @@ typedef struct {
     int outH = GST_VIDEO_INFO_HEIGHT (outInfo);
     GstVideoFormat inFmt = GST_VIDEO_INFO_FORMAT (inInfo);
     GstVideoFormat outFmt = GST_VIDEO_INFO_FORMAT (outInfo);
+    int inColor = vf_metal_color_matrix_for_info (inInfo);
+    int outColor = vf_metal_color_matrix_for_info (outInfo);
 
-    /* Check if reconfigure is needed */
-    if (_renderTarget && _inWidth == inW && _inHeight == inH &&
-        _outWidth == outW && _outHeight == outH &&
-        _inputFormat == inFmt && _outputFormat == outFmt &&
-        _method == method && _addBorders == addBorders &&
-        _borderColor == borderColor) {
+    if (![self needsConfigureWithInputInfo:inInfo outputInfo:outInfo
+                                    method:method addBorders:addBorders
+                               borderColor:borderColor])
         return YES;
-    }
 
-    id<MTLDevice> device = [VfMetalDevice sharedDevice].device;
+    id<MTLDevice> device = _metalDevice.device;
 
+    _configured = NO;
     _inWidth = inW;
     _inHeight = inH;
     _outWidth = outW;
     _outHeight = outH;
     _inputFormat = inFmt;
     _outputFormat = outFmt;
+    _inputColor = inColor;
+    _outputColor = outColor;
     _method = method;
     _addBorders = addBorders;
     _borderColor = borderColor;
+    _configuredKeepsRenderTarget = _keepsRenderTarget;
 
     [self _computeViewportWithAddBorders:addBorders];
 
-    /* Render target pixel format — always BGRA for intermediate */
-    MTLPixelFormat renderPixelFormat;
-    switch (outFmt) {
-        case GST_VIDEO_FORMAT_RGBA:
-            renderPixelFormat = MTLPixelFormatRGBA8Unorm;
-            break;
-        default:
-            renderPixelFormat = MTLPixelFormatBGRA8Unorm;
-            break;
-    }
+    /* Equal colour words also mean equal sample storage, so 10-bit
+     * planes are only scaled in place into the same 10-bit layout */
+    _direct = !_keepsRenderTarget && !cs_method_is_separable (method) &&
+        inColor == outColor &&
+        ((vf_metal_format_is_planar_yuv (inFmt) && vf_metal_format_is_planar_yuv (outFmt)) ||
+         (cs_format_is_packed_yuv (inFmt) && cs_format_is_packed_yuv (outFmt)));
+    _renderTarget = nil;
+    _directLuma = nil;
+    _directChroma = nil;
+    _resampleSource = nil;
+    _resampleLevel = nil;
+    _resampleTemp = nil;
+    _weightsH = nil;
+    _weightsV = nil;
+
+    if (_direct) {
+        if (![self _createDirectPipelinesFrom:inFmt to:outFmt])
+            return NO;
+    } else {
+        /* Render target pixel format — BGRA for 8-bit intermediates,
+         * half float so 10-bit output keeps its extra precision */
+        MTLPixelFormat renderPixelFormat;
+        switch (outFmt) {
+            case GST_VIDEO_FORMAT_RGBA:
+                renderPixelFormat = MTLPixelFormatRGBA8Unorm;
+                break;
+            case GST_VIDEO_FORMAT_P010_10LE:
+            case GST_VIDEO_FORMAT_I420_10LE:
+                renderPixelFormat = MTLPixelFormatRGBA16Float;
+                break;
+            default:
+                renderPixelFormat = MTLPixelFormatBGRA8Unorm;
+                break;
+        }
 
-    /* Create render pipelines */
-    if (![self _createPipelinesForFormat:renderPixelFormat]) {
-        return NO;
-    }
+        /* Create render pipelines */
+        if (![self _createPipelinesForFormat:renderPixelFormat]) {
+            return NO;
+        }
 
-    /* Create render target at output dimensions */
-    MTLTextureDescriptor *rtDesc = [MTLTextureDescriptor
-        texture2DDescriptorWithPixelFormat:renderPixelFormat
-                                     width:outW
-                                    height:outH
-                                 mipmapped:NO];
-    rtDesc.usage = MTLTextureUsageRenderTarget | MTLTextureUsageShaderRead |
-                   MTLTextureUsageShaderWrite;
-    rtDesc.storageMode = MTLStorageModeShared;
+        /* Create render target at output dimensions */
+        MTLTextureDescriptor *rtDesc = [MTLTextureDescriptor
+            texture2DDescriptorWithPixelFormat:renderPixelFormat
+                                         width:outW
+                                        height:outH
+                                     mipmapped:NO];
+        rtDesc.usage = MTLTextureUsageRenderTarget |
+                       MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite;
+        rtDesc.storageMode = _metalDevice.hostStorageMode;
 
-    _renderTarget = [device newTextureWithDescriptor:rtDesc];
-    if (!_renderTarget) return NO;
+        _renderTarget = [device newTextureWithDescriptor:rtDesc];
+        if (!_renderTarget) return NO;
+
+        if (cs_method_is_separable (method) &&
+            ![self _configureResamplerWithFormat:renderPixelFormat])
+            return NO;
+    }
 
     /* Clean up old packed output resources */
-    _outputPacked = nil;
+    for (int i = 0; i < VF_METAL_MAX_IN_FLIGHT; i++)
+        _outputPacked[i] = nil;
     _computeUYVY = nil;
     _computeYUY2 = nil;
 
     /* Configure NV12/I420 output via shared helper */
-    if (![_yuvOutput configureWithDevice:device library:_library
+    if (![_yuvOutput configureWithDevice:_metalDevice library:_library
                                    width:outW height:outH format:outFmt])
         return NO;
 
     /* Create packed YUV output resources if needed */
-    if (outFmt == GST_VIDEO_FORMAT_UYVY || outFmt == GST_VIDEO_FORMAT_YUY2) {
-        MTLTextureDescriptor *packedDesc = [MTLTextureDescriptor
-            texture2DDescriptorWithPixelFormat:MTLPixelFormatRGBA8Unorm
-                                         width:outW / 2
-                                        height:outH
-                                     mipmapped:NO];
-        packedDesc.usage =
-            MTLTextureUsageShaderWrite | MTLTextureUsageShaderRead;
-        packedDesc.storageMode = MTLStorageModeShared;
-        _outputPacked = [device newTextureWithDescriptor:packedDesc];
-        if (!_outputPacked) return NO;
+    if (cs_format_is_packed_yuv (outFmt)) {
+        if (![self _packedTextureForSlot:0]) return NO;
+    }
 
+    if (cs_format_is_packed_yuv (outFmt) && !_direct) {
         NSError *error = nil;
         NSString *funcName = (outFmt == GST_VIDEO_FORMAT_UYVY)
             ? @"rgbaToUYVY" : @"rgbaToYUY2";
-        id<MTLFunction> func = [_library newFunctionWithName:funcName];
-        id<MTLComputePipelineState> pipeline =
-            [device newComputePipelineStateWithFunction:func error:&error];
+        id<MTLComputePipelineState> pipeline = [_metalDevice
+            computePipelineWithFunctionName:funcName
+                                    library:_library
+                                      error:&error];
         if (!pipeline) return NO;
 
         if (outFmt == GST_VIDEO_FORMAT_UYVY) {
@@ -326,165 +504,607 @@ typedef struct {
         }
     }
 
+    _configured = YES;
     return YES;
 }
 
-- (BOOL)processFrame:(GstVideoFrame *)inFrame
-              output:(GstVideoFrame *)outFrame
+- (BOOL)_createDirectPipelinesFrom:(GstVideoFormat)inFmt
+                                to:(GstVideoFormat)outFmt
 {
-    @autoreleasepool {
-        [_textureCache resetFrameIndex];
+    VfMetalDevice *metalDevice = _metalDevice;
+    NSString *lumaName = @"scalePacked";
+    NSString *chromaName = nil;
+
+    if (vf_metal_format_is_planar_yuv (inFmt)) {
+        lumaName = @"scaleLumaPlane";
+        chromaName = [NSString stringWithFormat:@"scaleChroma%@To%@",
+            vf_metal_input_format_index (inFmt) == VF_METAL_INPUT_NV12
+                ? @"NV12" : @"I420",
+            vf_metal_input_format_index (outFmt) == VF_METAL_INPUT_NV12
+                ? @"NV12" : @"I420"];
+    }
 
-        id<MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
-        if (!commandBuffer) {
-            GST_ERROR ("Failed to create Metal command buffer");
+    NSError *error = nil;
+    _directLuma = [metalDevice computePipelineWithFunctionName:lumaName
+                                                       library:_library
+                                                         error:&error];
+    if (!_directLuma) {
+        GST_ERROR ("Failed to create %s pipeline: %s", lumaName.UTF8String,
+                   error.localizedDescription.UTF8String);
+        return NO;
+    }
+
+    if (chromaName) {
+        _directChroma = [metalDevice computePipelineWithFunctionName:chromaName
+                                                             library:_library
+                                                               error:&error];
+        if (!_directChroma) {
+            GST_ERROR ("Failed to create %s pipeline: %s",
+                       chromaName.UTF8String,
+                       error.localizedDescription.UTF8String);
             return NO;
         }
+    }
 
-        GstVideoFormat inFmt = GST_VIDEO_FRAME_FORMAT (inFrame);
-        CsInputFormat fmtIdx = cs_input_format_index (inFmt);
-        int frameW = GST_VIDEO_FRAME_WIDTH (inFrame);
-        int frameH = GST_VIDEO_FRAME_HEIGHT (inFrame);
-        int methodIdx = (_method == VF_METAL_SCALE_NEAREST) ? 1 : 0;
-
-        /* === Render pass: convert + scale to RGBA render target === */
-
-        /* Clear render target with border color if letterboxing */
-        MTLRenderPassDescriptor *rpDesc =
-            [MTLRenderPassDescriptor renderPassDescriptor];
-        rpDesc.colorAttachments[0].texture = _renderTarget;
-
-        if (_addBorders) {
-            float r = ((_borderColor >> 16) & 0xFF) / 255.0f;
-            float g = ((_borderColor >> 8) & 0xFF) / 255.0f;
-            float b = (_borderColor & 0xFF) / 255.0f;
-            float a = ((_borderColor >> 24) & 0xFF) / 255.0f;
-            rpDesc.colorAttachments[0].loadAction = MTLLoadActionClear;
-            rpDesc.colorAttachments[0].clearColor =
-                MTLClearColorMake(r, g, b, a);
-        } else {
-            rpDesc.colorAttachments[0].loadAction = MTLLoadActionDontCare;
+    GST_DEBUG ("Plane-native %s -> %s scaling",
+               gst_video_format_to_string (inFmt),
+               gst_video_format_to_string (outFmt));
+    return YES;
+}
+
+- (BOOL)_configureResamplerWithFormat:(MTLPixelFormat)pixelFormat
+{
+    VfMetalDevice *metalDevice = _metalDevice;
+    id<MTLDevice> device = metalDevice.device;
+
+    /* Picture rectangle inside the output (letterbox aware) */
+    int cw = MAX (1, (int)lroundf (_outWidth * _viewportParams[2]));
+    int ch = MAX (1, (int)lroundf (_outHeight * _viewportParams[3]));
+    _contentRect[0] = (_outWidth - cw) / 2;
+    _contentRect[1] = (_outHeight - ch) / 2;
+    _contentRect[2] = cw;
+    _contentRect[3] = ch;
+
+    /* Box pre-reduction: step down the mip chain while the filter would
+     * still reduce by at least 2x on both axes, so tap counts stay bounded */
+    NSUInteger levels = 1;
+    int srcW = _inWidth, srcH = _inHeight;
+    while (srcW / 2 >= cw * 2 && srcH / 2 >= ch * 2) {
+        srcW /= 2;
+        srcH /= 2;
+        levels++;
+    }
+
+    MTLTextureDescriptor *srcDesc = [MTLTextureDescriptor
+        texture2DDescriptorWithPixelFormat:pixelFormat
+                                     width:_inWidth
+                                    height:_inHeight
+                                 mipmapped:(levels > 1)];
+    srcDesc.mipmapLevelCount = levels;
+    srcDesc.usage = MTLTextureUsageRenderTarget | MTLTextureUsageShaderRead;
+    srcDesc.storageMode = MTLStorageModePrivate;
+    _resampleSource = [device newTextureWithDescriptor:srcDesc];
+    if (!_resampleSource) return NO;
+
+    _resampleLevel = (levels > 1)
+        ? [_resampleSource newTextureViewWithPixelFormat:pixelFormat
+                                             textureType:MTLTextureType2D
+                                                  levels:NSMakeRange(levels - 1, 1)
+                                                  slices:NSMakeRange(0, 1)]
+        : _resampleSource;
+    if (!_resampleLevel) return NO;
+
+    /* Float intermediate keeps the negative lobes of the first pass */
+    MTLTextureDescriptor *tmpDesc = [MTLTextureDescriptor
+        texture2DDescriptorWithPixelFormat:MTLPixelFormatRGBA16Float
+                                     width:cw
+                                    height:srcH
+                                 mipmapped:NO];
+    tmpDesc.usage = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite;
+    tmpDesc.storageMode = MTLStorageModePrivate;
+    _resampleTemp = [device newTextureWithDescriptor:tmpDesc];
+    if (!_resampleTemp) return NO;
+
+    NSError *error = nil;
+    _resampleH = [metalDevice computePipelineWithFunctionName:@"resampleHorizontal"
+                                                      library:_library
+                                                        error:&error];
+    _resampleV = [metalDevice computePipelineWithFunctionName:@"resampleVertical"
+                                                      library:_library
+                                                        error:&error];
+    if (!_resampleH || !_resampleV) {
+        GST_ERROR ("Failed to create resample pipelines: %s",
+                   error.localizedDescription.UTF8String);
+        return NO;
+    }
+
+    _weightsH = [self _weightsFrom:srcW to:cw];
+    _weightsV = [self _weightsFrom:srcH to:ch];
+    if (!_weightsH || !_weightsV) return NO;
+
+    GST_DEBUG ("%s resample %dx%d -> %dx%d (%lu mip levels, %d/%d taps)",
+               (_method == VF_METAL_SCALE_LANCZOS) ? "Lanczos" : "Bicubic",
+               _inWidth, _inHeight, cw, ch, (unsigned long)levels,
+               _weightsH.taps, _weightsV.taps);
+    return YES;
+}
+
+- (CsResampleWeights *)_weightsFrom:(int)src to:(int)dst
+{
+    NSString *key = [NSString stringWithFormat:@"%d:%d>%d", _method, src, dst];
+    CsResampleWeights *table = _weightCache[key];
+    if (table) return table;
+
+    BOOL lanczos = (_method == VF_METAL_SCALE_LANCZOS);
+    double (*filter) (double) = lanczos ? cs_filter_lanczos3 : cs_filter_bicubic;
+    double scale = (double)src / dst;
+    /* Widen the kernel when downscaling so it low-passes the source */
+    double filterScale = MAX (scale, 1.0);
+    double support = (lanczos ? 3.0 : 2.0) * filterScale;
+    int taps = (int)ceil (support) * 2 + 1;
+
+    id<MTLDevice> device = _metalDevice.device;
+    id<MTLBuffer> bounds =
+        [device newBufferWithLength:(NSUInteger)dst * 2 * sizeof(int32_t)
+                            options:MTLResourceStorageModeShared];
+    id<MTLBuffer> weights =
+        [device newBufferWithLength:(NSUInteger)dst * taps * sizeof(float)
+                            options:MTLResourceStorageModeShared];
+    if (!bounds || !weights) return nil;
+
+    int32_t *b = (int32_t *)bounds.contents;
+    float *w = (float *)weights.contents;
+    for (int i = 0; i < dst; i++) {
+        double center = (i + 0.5) * scale;
+        int first = MAX ((int)floor (center - support + 0.5), 0);
+        int last = MIN ((int)floor (center + support + 0.5), src);
+        int count = MIN (last - first, taps);
+        float *row = w + (size_t)i * taps;
+        double total = 0.0;
+
+        for (int j = 0; j < count; j++) {
+            double v = filter ((first + j + 0.5 - center) / filterScale);
+            row[j] = (float)v;
+            total += v;
+        }
+        if (total != 0.0) {
+            for (int j = 0; j < count; j++)
+                row[j] = (float)(row[j] / total);
         }
-        rpDesc.colorAttachments[0].storeAction = MTLStoreActionStore;
 
-        id<MTLRenderCommandEncoder> encoder =
-            [commandBuffer renderCommandEncoderWithDescriptor:rpDesc];
-        if (!encoder) return NO;
+        b[i * 2] = first;
+        b[i * 2 + 1] = count;
+    }
 
-        MTLViewport viewport = {
-            0, 0, (double)_outWidth, (double)_outHeight, 0.0, 1.0
-        };
-        [encoder setViewport:viewport];
-        [encoder setRenderPipelineState:_pipelines[fmtIdx][methodIdx]];
+    table = [[CsResampleWeights alloc] init];
+    table.bounds = bounds;
+    table.weights = weights;
+    table.taps = taps;
+
+    /* Sizes rarely change mid-stream; keep the cache from growing */
+    if (_weightCache.count >= 16)
+        [_weightCache removeAllObjects];
+    _weightCache[key] = table;
+    return table;
+}
+
+- (id<MTLTexture>)_packedTextureForSlot:(NSUInteger)slot
+{
+    if (_outputPacked[slot]) return _outputPacked[slot];
+
+    MTLTextureDescriptor *packedDesc = [MTLTextureDescriptor
+        texture2DDescriptorWithPixelFormat:MTLPixelFormatRGBA8Unorm
+                                     width:_outWidth / 2
+                                    height:_outHeight
+                                 mipmapped:NO];
+    packedDesc.usage =
+        MTLTextureUsageShaderWrite | MTLTextureUsageShaderRead;
+    packedDesc.storageMode = _metalDevice.hostStorageMode;
+    _outputPacked[slot] =
+        [_metalDevice.device newTextureWithDescriptor:packedDesc];
+    return _outputPacked[slot];
+}
+
+- (BOOL)processFrame:(GstVideoFrame *)inFrame
+              output:(GstVideoFrame *)outFrame
+{
+    return [self _renderFrame:inFrame output:outFrame slot:0 completion:nil];
+}
 
-        /* Viewport transform for letterboxing */
-        [encoder setVertexBytes:_viewportParams
-                         length:sizeof(_viewportParams)
-                        atIndex:0];
+- (BOOL)submitFrame:(GstVideoFrame *)inFrame
+             output:(GstVideoFrame *)outFrame
+               slot:(NSUInteger)slot
+         completion:(VfMetalCompletionHandler)completion
+{
+    return [self _renderFrame:inFrame output:outFrame slot:slot
+                   completion:completion];
+}
 
-        /* Upload input textures */
-        if (fmtIdx == CS_INPUT_NV12) {
+/* Input planes in plane order: Y+UV (NV12, P010), Y+U+V (I420,
+ * I420_10LE), packed 4:2:2 as RGBA8 at half width, or the single
+ * BGRA/RGBA plane */
+- (NSArray<id<MTLTexture>> *)_uploadInputPlanes:(GstVideoFrame *)inFrame
+{
+    GstVideoFormat inFmt = GST_VIDEO_FRAME_FORMAT (inFrame);
+    int frameW = GST_VIDEO_FRAME_WIDTH (inFrame);
+    int frameH = GST_VIDEO_FRAME_HEIGHT (inFrame);
+
+    switch (cs_input_format_index (inFmt)) {
+        case CS_INPUT_NV12: {
             id<MTLTexture> yTex =
                 [_textureCache uploadPlane:inFrame plane:0
-                          format:MTLPixelFormatR8Unorm
+                          format:vf_metal_plane_pixel_format (inFmt, 0)
                            width:frameW height:frameH];
             id<MTLTexture> uvTex =
                 [_textureCache uploadPlane:inFrame plane:1
-                          format:MTLPixelFormatRG8Unorm
+                          format:vf_metal_plane_pixel_format (inFmt, 1)
                            width:(frameW + 1) / 2 height:(frameH + 1) / 2];
-            if (!yTex || !uvTex) { [encoder endEncoding]; return NO; }
-            [encoder setFragmentTexture:yTex atIndex:0];
-            [encoder setFragmentTexture:uvTex atIndex:1];
-        } else if (fmtIdx == CS_INPUT_I420) {
+            if (!yTex || !uvTex) return nil;
+            return @[ yTex, uvTex ];
+        }
+        case CS_INPUT_I420: {
             id<MTLTexture> yTex =
                 [_textureCache uploadPlane:inFrame plane:0
-                          format:MTLPixelFormatR8Unorm
+                          format:vf_metal_plane_pixel_format (inFmt, 0)
                            width:frameW height:frameH];
             id<MTLTexture> uTex =
                 [_textureCache uploadPlane:inFrame plane:1
-                          format:MTLPixelFormatR8Unorm
+                          format:vf_metal_plane_pixel_format (inFmt, 1)
                            width:(frameW + 1) / 2 height:(frameH + 1) / 2];
             id<MTLTexture> vTex =
                 [_textureCache uploadPlane:inFrame plane:2
-                          format:MTLPixelFormatR8Unorm
+                          format:vf_metal_plane_pixel_format (inFmt, 2)
                            width:(frameW + 1) / 2 height:(frameH + 1) / 2];
-            if (!yTex || !uTex || !vTex) { [encoder endEncoding]; return NO; }
-            [encoder setFragmentTexture:yTex atIndex:0];
-            [encoder setFragmentTexture:uTex atIndex:1];
-            [encoder setFragmentTexture:vTex atIndex:2];
-        } else if (fmtIdx == CS_INPUT_UYVY || fmtIdx == CS_INPUT_YUY2) {
+            if (!yTex || !uTex || !vTex) return nil;
+            return @[ yTex, uTex, vTex ];
+        }
+        case CS_INPUT_UYVY:
+        case CS_INPUT_YUY2: {
             /* Packed YUV: upload as RGBA8 at half width */
             id<MTLTexture> tex =
                 [_textureCache uploadPlane:inFrame plane:0
                           format:MTLPixelFormatRGBA8Unorm
                            width:frameW / 2 height:frameH];
-            if (!tex) { [encoder endEncoding]; return NO; }
-            [encoder setFragmentTexture:tex atIndex:0];
-        } else {
+            return tex ? @[ tex ] : nil;
+        }
+        default: {
             /* BGRA/RGBA */
             MTLPixelFormat pixFmt = (inFmt == GST_VIDEO_FORMAT_BGRA)
                 ? MTLPixelFormatBGRA8Unorm : MTLPixelFormatRGBA8Unorm;
             id<MTLTexture> tex =
                 [_textureCache uploadPlane:inFrame plane:0
                           format:pixFmt width:frameW height:frameH];
-            if (!tex) { [encoder endEncoding]; return NO; }
-            [encoder setFragmentTexture:tex atIndex:0];
+            return tex ? @[ tex ] : nil;
         }
+    }
+}
+
+/* Packed output target: the frame's own GPU memory when it matches
+ * (@resident is set and no readback is needed), else the slot texture */
+- (id<MTLTexture>)_packedTargetForFrame:(GstVideoFrame *)outFrame
+                                   slot:(NSUInteger)slot
+                               resident:(BOOL *)resident
+{
+    *resident = NO;
+
+    id<MTLTexture> outputPacked = [self _packedTextureForSlot:slot];
+    if (!outputPacked) return nil;
+
+    id<MTLTexture> tex = vf_metal_frame_peek_texture (outFrame, 0,
+                                                      _metalDevice.device);
+    if (tex && tex.pixelFormat == outputPacked.pixelFormat &&
+        tex.width == outputPacked.width &&
+        tex.height == outputPacked.height) {
+        *resident = YES;
+        vf_metal_frame_mark_gpu_written (outFrame);
+        return tex;
+    }
+    return outputPacked;
+}
+
+/* Convert + scale @inFrame (or the RGBA @source texture) into the RGBA
+ * render target, then into the output format. @planes are @inFrame's
+ * planes when already uploaded. Sets @packedTarget for UYVY/YUY2 output. */
+- (BOOL)_encodeThroughRGBA:(id<MTLCommandBuffer>)commandBuffer
+                     input:(GstVideoFrame *)inFrame
+                    planes:(NSArray<id<MTLTexture>> *)planes
+                    source:(id<MTLTexture>)source
+                    output:(GstVideoFrame *)outFrame
+                      slot:(NSUInteger)slot
+              packedTarget:(id<MTLTexture> *)packedTarget
+                  resident:(BOOL *)resident
+{
+    CsInputFormat fmtIdx = source ? CS_INPUT_RGBA
+        : cs_input_format_index (GST_VIDEO_FRAME_FORMAT (inFrame));
+    int methodIdx = (_method == VF_METAL_SCALE_NEAREST) ? 1 : 0;
+    BOOL separable = cs_method_is_separable (_method);
+
+    NSArray<id<MTLTexture>> *inputs =
+        source ? @[ source ] : (planes ?: [self _uploadInputPlanes:inFrame]);
+    if (!inputs) return NO;
+
+    /* === Render pass: convert + scale to RGBA render target === */
+
+    /* Separable methods only convert here, at source size; the resample
+     * passes scale into _renderTarget and fill the letterbox */
+    id<MTLTexture> target = separable ? _resampleSource : _renderTarget;
+
+    /* Clear render target with border color if letterboxing */
+    MTLRenderPassDescriptor *rpDesc =
+        [MTLRenderPassDescriptor renderPassDescriptor];
+    rpDesc.colorAttachments[0].texture = target;
+
+    if (_addBorders && !separable) {
+        float r = ((_borderColor >> 16) & 0xFF) / 255.0f;
+        float g = ((_borderColor >> 8) & 0xFF) / 255.0f;
+        float b = (_borderColor & 0xFF) / 255.0f;
+        float a = ((_borderColor >> 24) & 0xFF) / 255.0f;
+        rpDesc.colorAttachments[0].loadAction = MTLLoadActionClear;
+        rpDesc.colorAttachments[0].clearColor =
+            MTLClearColorMake(r, g, b, a);
+    } else {
+        rpDesc.colorAttachments[0].loadAction = MTLLoadActionDontCare;
+    }
+    rpDesc.colorAttachments[0].storeAction = MTLStoreActionStore;
+
+    id<MTLRenderCommandEncoder> encoder =
+        [commandBuffer renderCommandEncoderWithDescriptor:rpDesc];
+    if (!encoder) return NO;
+
+    MTLViewport viewport = {
+        0, 0, (double)target.width, (double)target.height, 0.0, 1.0
+    };
+    [encoder setViewport:viewport];
+    [encoder setRenderPipelineState:_pipelines[fmtIdx][methodIdx]];
+
+    /* Viewport transform for letterboxing */
+    [encoder setVertexBytes:separable ? kIdentityViewport : _viewportParams
+                     length:sizeof(_viewportParams)
+                    atIndex:0];
+
+    for (NSUInteger i = 0; i < inputs.count; i++)
+        [encoder setFragmentTexture:inputs[i] atIndex:i];
+
+    /* Set uniforms */
+    ConvertScaleUniformsGPU uniforms = {
+        .colorMatrix = source ? 0 : vf_metal_color_matrix_for_frame (inFrame),
+        .padding1 = 0,
+        .padding2 = {0, 0}
+    };
+    [encoder setFragmentBytes:&uniforms
+                       length:sizeof(uniforms)
+                      atIndex:0];
 
-        /* Set uniforms */
-        ConvertScaleUniformsGPU uniforms = {
-            .colorMatrix = vf_metal_color_matrix_for_frame (inFrame),
-            .padding1 = 0,
-            .padding2 = {0, 0}
+    /* Draw full-screen quad */
+    [encoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                vertexStart:0
+                vertexCount:4];
+    [encoder endEncoding];
+
+    if (separable)
+        [self _encodeResample:commandBuffer];
+
+    /* === Output format conversion (if not BGRA/RGBA) === */
+
+    GstVideoFormat outFmt = GST_VIDEO_FRAME_FORMAT (outFrame);
+
+    /* NV12/I420 conversion via shared helper */
+    [_yuvOutput dispatchConversion:commandBuffer
+                     sourceTexture:_renderTarget
+                             width:_outWidth height:_outHeight
+                          outFrame:outFrame
+                              slot:slot];
+
+    /* Packed YUV conversion (UYVY/YUY2) — local */
+    if ((outFmt == GST_VIDEO_FORMAT_UYVY && _computeUYVY) ||
+        (outFmt == GST_VIDEO_FORMAT_YUY2 && _computeYUY2)) {
+        id<MTLComputePipelineState> pipeline =
+            (outFmt == GST_VIDEO_FORMAT_UYVY) ? _computeUYVY : _computeYUY2;
+
+        *packedTarget = [self _packedTargetForFrame:outFrame slot:slot
+                                           resident:resident];
+        if (!*packedTarget) return NO;
+
+        id<MTLComputeCommandEncoder> compute =
+            [commandBuffer computeCommandEncoder];
+        [compute setComputePipelineState:pipeline];
+        [compute setTexture:_renderTarget atIndex:0];
+        [compute setTexture:*packedTarget atIndex:1];
+
+        VfMetalComputeUniforms cu = {
+            .width = (uint32_t)_outWidth,
+            .height = (uint32_t)_outHeight,
+            .colorMatrix = vf_metal_color_matrix_for_frame (outFrame),
+            .padding = 0
         };
-        [encoder setFragmentBytes:&uniforms
-                           length:sizeof(uniforms)
-                          atIndex:0];
-
-        /* Draw full-screen quad */
-        [encoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
-                    vertexStart:0
-                    vertexCount:4];
-        [encoder endEncoding];
-
-        /* === Output format conversion (if not BGRA/RGBA) === */
-
-        GstVideoFormat outFmt = GST_VIDEO_FRAME_FORMAT (outFrame);
-
-        /* NV12/I420 conversion via shared helper */
-        [_yuvOutput dispatchConversion:commandBuffer
-                         sourceTexture:_renderTarget
-                                 width:_outWidth height:_outHeight
-                              outFrame:outFrame];
-
-        /* Packed YUV conversion (UYVY/YUY2) — local */
-        if ((outFmt == GST_VIDEO_FORMAT_UYVY && _computeUYVY) ||
-                   (outFmt == GST_VIDEO_FORMAT_YUY2 && _computeYUY2)) {
-            id<MTLComputePipelineState> pipeline =
-                (outFmt == GST_VIDEO_FORMAT_UYVY) ? _computeUYVY : _computeYUY2;
-
-            id<MTLComputeCommandEncoder> compute =
-                [commandBuffer computeCommandEncoder];
-            [compute setComputePipelineState:pipeline];
-            [compute setTexture:_renderTarget atIndex:0];
-            [compute setTexture:_outputPacked atIndex:1];
-
-            VfMetalComputeUniforms cu = {
-                .width = (uint32_t)_outWidth,
-                .height = (uint32_t)_outHeight,
-                .colorMatrix = vf_metal_color_matrix_for_frame (outFrame),
-                .padding = 0
-            };
-            [compute setBytes:&cu length:sizeof(cu) atIndex:0];
-
-            MTLSize tg = MTLSizeMake(16, 16, 1);
-            MTLSize grid = MTLSizeMake(
-                (_outWidth / 2 + 15) / 16, (_outHeight + 15) / 16, 1);
-            [compute dispatchThreadgroups:grid threadsPerThreadgroup:tg];
-            [compute endEncoding];
+        [compute setBytes:&cu length:sizeof(cu) atIndex:0];
+
+        cs_dispatch_over (compute, *packedTarget);
+        [compute endEncoding];
+    }
+
+    return YES;
+}
+
+/* Bicubic/Lanczos: box-reduce through the mip chain if configured, then
+ * the horizontal and vertical weight-table passes into _renderTarget */
+- (void)_encodeResample:(id<MTLCommandBuffer>)commandBuffer
+{
+    if (_resampleSource.mipmapLevelCount > 1) {
+        id<MTLBlitCommandEncoder> blit = [commandBuffer blitCommandEncoder];
+        [blit generateMipmapsForTexture:_resampleSource];
+        [blit endEncoding];
+    }
+
+    ResampleUniformsGPU uniforms = {
+        .borderColor = {
+            ((_borderColor >> 16) & 0xFF) / 255.0f,
+            ((_borderColor >> 8) & 0xFF) / 255.0f,
+            (_borderColor & 0xFF) / 255.0f,
+            ((_borderColor >> 24) & 0xFF) / 255.0f
+        },
+        .contentOrigin = { _contentRect[0], _contentRect[1] },
+        .contentSize = { _contentRect[2], _contentRect[3] },
+        .taps = _weightsH.taps,
+    };
+
+    id<MTLComputeCommandEncoder> compute =
+        [commandBuffer computeCommandEncoder];
+
+    [compute setComputePipelineState:_resampleH];
+    [compute setBytes:&uniforms length:sizeof(uniforms) atIndex:0];
+    [compute setBuffer:_weightsH.bounds offset:0 atIndex:1];
+    [compute setBuffer:_weightsH.weights offset:0 atIndex:2];
+    [compute setTexture:_resampleLevel atIndex:0];
+    [compute setTexture:_resampleTemp atIndex:1];
+    cs_dispatch_over (compute, _resampleTemp);
+
+    uniforms.taps = _weightsV.taps;
+    [compute setComputePipelineState:_resampleV];
+    [compute setBytes:&uniforms length:sizeof(uniforms) atIndex:0];
+    [compute setBuffer:_weightsV.bounds offset:0 atIndex:1];
+    [compute setBuffer:_weightsV.weights offset:0 atIndex:2];
+    [compute setTexture:_resampleTemp atIndex:0];
+    [compute setTexture:_renderTarget atIndex:1];
+    cs_dispatch_over (compute, _renderTarget);
+
+    [compute endEncoding];
+}
+
+/* Scale each input plane straight into the matching output plane(s).
+ * The letterbox is filled with the border colour converted to YUV. */
+- (BOOL)_encodePlaneNative:(id<MTLCommandBuffer>)commandBuffer
+                     input:(GstVideoFrame *)inFrame
+                    planes:(NSArray<id<MTLTexture>> *)planes
+                    output:(GstVideoFrame *)outFrame
+                      slot:(NSUInteger)slot
+              packedTarget:(id<MTLTexture> *)packedTarget
+                  resident:(BOOL *)resident
+{
+    NSArray<id<MTLTexture>> *inputs =
+        planes ?: [self _uploadInputPlanes:inFrame];
+    if (!inputs) return NO;
+
+    NSArray<id<MTLTexture>> *outputs;
+    if (_directChroma) {
+        outputs = [_yuvOutput outputPlanesForFrame:outFrame slot:slot];
+    } else {
+        *packedTarget = [self _packedTargetForFrame:outFrame slot:slot
+                                           resident:resident];
+        outputs = *packedTarget ? @[ *packedTarget ] : nil;
+    }
+    if (!outputs) return NO;
+
+    float scaleX = _viewportParams[2];
+    float scaleY = _viewportParams[3];
+    PlaneScaleUniformsGPU uniforms = {
+        .borderColor = {
+            ((_borderColor >> 16) & 0xFF) / 255.0f,
+            ((_borderColor >> 8) & 0xFF) / 255.0f,
+            (_borderColor & 0xFF) / 255.0f,
+            1.0f
+        },
+        .contentOrigin = { (1.0f - scaleX) * 0.5f, (1.0f - scaleY) * 0.5f },
+        .contentSize = { scaleX, scaleY },
+        .colorMatrix = vf_metal_color_matrix_for_frame (outFrame),
+        .nearest = (_method == VF_METAL_SCALE_NEAREST),
+        .inputYUY2 = (_inputFormat == GST_VIDEO_FORMAT_YUY2),
+        .outputYUY2 = (_outputFormat == GST_VIDEO_FORMAT_YUY2),
+    };
+
+    id<MTLComputeCommandEncoder> compute =
+        [commandBuffer computeCommandEncoder];
+    [compute setBytes:&uniforms length:sizeof(uniforms) atIndex:0];
+
+    /* Luma, or the whole packed plane */
+    [compute setComputePipelineState:_directLuma];
+    [compute setTexture:inputs[0] atIndex:0];
+    [compute setTexture:outputs[0] atIndex:2];
+    cs_dispatch_over (compute, outputs[0]);
+
+    /* Chroma: UV or U+V in, UV or U+V out */
+    if (_directChroma) {
+        [compute setComputePipelineState:_directChroma];
+        for (NSUInteger i = 1; i < inputs.count; i++)
+            [compute setTexture:inputs[i] atIndex:i - 1];
+        for (NSUInteger i = 1; i < outputs.count; i++)
+            [compute setTexture:outputs[i] atIndex:i + 1];
+        cs_dispatch_over (compute, outputs[1]);
+    }
+
+    [compute endEncoding];
+    return YES;
+}
+
+- (BOOL)_renderFrame:(GstVideoFrame *)inFrame
+              output:(GstVideoFrame *)outFrame
+                slot:(NSUInteger)slot
+          completion:(VfMetalCompletionHandler)completion
+{
+    @autoreleasepool {
+        [_textureCache resetFrameIndexForSlot:slot];
+
+        id<MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
+        if (!commandBuffer) {
+            GST_ERROR ("Failed to create Metal command buffer");
+            return NO;
+        }
+
+        VfMetalTraceSpan encodeSpan;
+        vf_metal_trace_begin (&encodeSpan, _traceOwner, VF_METAL_STATS_ENCODE);
+
+        /* Set for UYVY/YUY2 output; packedDirect when it is the output
+         * buffer's own GPU memory and needs no readback */
+        id<MTLTexture> outputPacked = nil;
+        BOOL packedDirect = NO;
+
+        if (![self _encode:commandBuffer input:inFrame planes:nil source:nil
+                    output:outFrame slot:slot
+              packedTarget:&outputPacked resident:&packedDirect])
+            return NO;
+
+        if (completion && outputPacked) {
+            /* Packed readback is local, so it gets its own handler */
+            int outW = _outWidth, outH = _outHeight;
+            GstObject *owner = _traceOwner;
+            [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> cb) {
+                BOOL ok = (cb.status != MTLCommandBufferStatusError);
+                if (!ok) {
+                    GST_ERROR ("Metal command buffer failed: %s",
+                               cb.error.localizedDescription.UTF8String);
+                } else if (!packedDirect) {
+                    VfMetalTraceSpan span;
+                    vf_metal_trace_begin (&span, owner, VF_METAL_STATS_READBACK);
+                    [outputPacked getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 0)
+                               bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 0)
+                                fromRegion:MTLRegionMake2D(0, 0, outW / 2, outH)
+                               mipmapLevel:0];
+                    vf_metal_trace_end (&span);
+                }
+                completion (ok);
+            }];
+            if (!packedDirect)
+                [_metalDevice encodeSynchronizeTextures:@[outputPacked]
+                                          commandBuffer:commandBuffer];
+            vf_metal_trace_end (&encodeSpan);
+            vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
+            [commandBuffer commit];
+            return YES;
+        } else if (completion) {
+            vf_metal_trace_end (&encodeSpan);
+            vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
+            [_yuvOutput commitPipelined:commandBuffer
+                          sourceTexture:_renderTarget
+                                  width:_outWidth height:_outHeight
+                               outFrame:outFrame
+                                   slot:slot
+                             completion:completion];
+            return YES;
         }
 
         /* Commit and wait */
+        vf_metal_trace_end (&encodeSpan);
+        vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
         [commandBuffer commit];
         [commandBuffer waitUntilCompleted];
 
@@ -494,29 +1114,153 @@ typedef struct {
             return NO;
         }
 
-        /* Read back to GstVideoFrame */
-        if (outFmt == GST_VIDEO_FORMAT_UYVY ||
-            outFmt == GST_VIDEO_FORMAT_YUY2) {
-            [_outputPacked getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 0)
-                        bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 0)
-                         fromRegion:MTLRegionMake2D(0, 0, _outWidth / 2,
-                                                    _outHeight)
-                        mipmapLevel:0];
-        } else {
-            [_yuvOutput readbackToFrame:outFrame sourceTexture:_renderTarget
-                                  width:_outWidth height:_outHeight];
-        }
-
+        [self _readbackFrame:outFrame packedTarget:outputPacked
+                    resident:packedDirect slot:slot];
         return YES;
     }
 }
 
+- (BOOL)_encode:(id<MTLCommandBuffer>)commandBuffer
+          input:(GstVideoFrame *)inFrame
+         planes:(NSArray<id<MTLTexture>> *)planes
+         source:(id<MTLTexture>)source
+         output:(GstVideoFrame *)outFrame
+           slot:(NSUInteger)slot
+   packedTarget:(id<MTLTexture> *)packedTarget
+       resident:(BOOL *)resident
+{
+    if (_direct && !source)
+        return [self _encodePlaneNative:commandBuffer input:inFrame
+                                 planes:planes output:outFrame slot:slot
+                           packedTarget:packedTarget resident:resident];
+
+    return [self _encodeThroughRGBA:commandBuffer input:inFrame
+                             planes:planes source:source
+                             output:outFrame slot:slot
+                       packedTarget:packedTarget resident:resident];
+}
+
+/* Read back to GstVideoFrame */
+- (void)_readbackFrame:(GstVideoFrame *)outFrame
+          packedTarget:(id<MTLTexture>)outputPacked
+              resident:(BOOL)packedDirect
+                  slot:(NSUInteger)slot
+{
+    if (packedDirect) {
+        /* Already written into the output buffer's GPU memory */
+    } else if (outputPacked) {
+        VfMetalTraceSpan span;
+        vf_metal_trace_begin (&span, _traceOwner, VF_METAL_STATS_READBACK);
+        [_metalDevice synchronizeTextures:@[outputPacked]];
+        [outputPacked getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 0)
+                   bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 0)
+                    fromRegion:MTLRegionMake2D(0, 0, _outWidth / 2,
+                                               _outHeight)
+                   mipmapLevel:0];
+        vf_metal_trace_end (&span);
+    } else {
+        [_yuvOutput readbackToFrame:outFrame sourceTexture:_renderTarget
+                              width:_outWidth height:_outHeight
+                               slot:slot];
+    }
+}
+
+- (id<MTLTexture>)renderTarget
+{
+    return _renderTarget;
+}
+
+- (NSArray<id<MTLTexture>> *)uploadInputPlanes:(GstVideoFrame *)inFrame
+                                          slot:(NSUInteger)slot
+{
+    [_textureCache resetFrameIndexForSlot:slot];
+    return [self _uploadInputPlanes:inFrame];
+}
+
+- (BOOL)encodeFrame:(GstVideoFrame *)inFrame
+        inputPlanes:(NSArray<id<MTLTexture>> *)planes
+      sourceTexture:(id<MTLTexture>)source
+      commandBuffer:(id<MTLCommandBuffer>)commandBuffer
+             output:(GstVideoFrame *)outFrame
+               slot:(NSUInteger)slot
+{
+    if (!source && !planes)
+        [_textureCache resetFrameIndexForSlot:slot];
+
+    _encodedPacked[slot] = nil;
+    _encodedPackedResident[slot] = NO;
+
+    id<MTLTexture> packed = nil;
+    BOOL resident = NO;
+    if (![self _encode:commandBuffer input:inFrame planes:planes
+                source:source output:outFrame slot:slot
+          packedTarget:&packed resident:&resident])
+        return NO;
+
+    /* The readback may run in a completion handler, which must not wait
+     * on the GPU: synchronise managed textures in this command buffer */
+    if (packed) {
+        if (!resident)
+            [_metalDevice encodeSynchronizeTextures:@[packed]
+                                      commandBuffer:commandBuffer];
+    } else if (![_yuvOutput encodePipelinedReadback:commandBuffer
+                                      sourceTexture:_renderTarget
+                                              width:_outWidth
+                                             height:_outHeight
+                                           outFrame:outFrame
+                                               slot:slot]) {
+        return NO;
+    }
+
+    _encodedPacked[slot] = packed;
+    _encodedPackedResident[slot] = resident;
+    return YES;
+}
+
+- (void)readbackFrame:(GstVideoFrame *)outFrame slot:(NSUInteger)slot
+{
+    id<MTLTexture> packed = _encodedPacked[slot];
+    int outW = GST_VIDEO_FRAME_WIDTH (outFrame);
+    int outH = GST_VIDEO_FRAME_HEIGHT (outFrame);
+
+    if (_encodedPackedResident[slot]) {
+        /* Already written into the output buffer's GPU memory */
+    } else if (packed) {
+        VfMetalTraceSpan span;
+        vf_metal_trace_begin (&span, _traceOwner, VF_METAL_STATS_READBACK);
+        [packed getBytes:GST_VIDEO_FRAME_PLANE_DATA (outFrame, 0)
+             bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (outFrame, 0)
+              fromRegion:MTLRegionMake2D(0, 0, outW / 2, outH)
+             mipmapLevel:0];
+        vf_metal_trace_end (&span);
+    } else {
+        [_yuvOutput finishPipelinedReadback:outFrame
+                                      width:outW height:outH slot:slot];
+    }
+}
+
 - (void)cleanup
 {
     [_textureCache clear];
     _renderTarget = nil;
+    _configured = NO;
+    _direct = NO;
+    _directLuma = nil;
+    _directChroma = nil;
+    _resampleSource = nil;
+    _resampleLevel = nil;
+    _resampleTemp = nil;
+    _resampleH = nil;
+    _resampleV = nil;
+    _weightsH = nil;
+    _weightsV = nil;
+    [_weightCache removeAllObjects];
     [_yuvOutput cleanup];
-    _outputPacked = nil;
+    for (int i = 0; i < VF_METAL_MAX_IN_FLIGHT; i++) {
+        _outputPacked[i] = nil;
+        _encodedPacked[i] = nil;
+        _encodedPackedResident[i] = NO;
+    }
     for (int f = 0; f < CS_INPUT_COUNT; f++) {
         _pipelines[f][0] = nil;
         _pipelines[f][1] = nil;
@@ -26,8 +26,22 @@
 #include <gst/video/video.h>
 #include <gst/video/gstvideofilter.h>
 
+#include "vfmetalcontext.h"
+#include "vfmetalinflight.h"
+
 G_BEGIN_DECLS
 
+/**
+ * GstVfMetalDeinterlaceMode:
+ * @VF_METAL_DEINTERLACE_MODE_SINGLE: one output frame per input frame
+ * @VF_METAL_DEINTERLACE_MODE_DOUBLE: one output frame per field
+ */
+typedef enum
+{
+  VF_METAL_DEINTERLACE_MODE_SINGLE = 0,
+  VF_METAL_DEINTERLACE_MODE_DOUBLE = 1,
+} GstVfMetalDeinterlaceMode;
+
 #define GST_TYPE_VF_METAL_DEINTERLACE (gst_vf_metal_deinterlace_get_type())
 G_DECLARE_FINAL_TYPE (GstVfMetalDeinterlace, gst_vf_metal_deinterlace,
     GST, VF_METAL_DEINTERLACE, GstVideoFilter)
@@ -40,6 +54,17 @@ struct _GstVfMetalDeinterlace
   gint method;              /* 0=bob, 1=weave, 2=linear, 3=greedyh */
   gint field_layout;        /* 0=auto, 1=top-first, 2=bottom-first */
   gdouble motion_threshold; /* for greedyh, [0, 1] */
+  gint mode;                /* 0=single, 1=double (field rate) */
+
+  /* mode latched at set_info, matching the negotiated framerate */
+  gboolean double_rate;
+
+  /* Pipelined submission: in-flight property, latched into inflight */
+  guint in_flight;
+  VfMetalInflight inflight;
+
+  /* GPU selection; the renderer is created on it at NULL_TO_READY */
+  VfMetalDeviceSelection device;
 
   /* Metal rendering engine */
   void *renderer;
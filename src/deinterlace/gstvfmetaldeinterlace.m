@@ -31,11 +31,19 @@
  * gst-launch-1.0 videotestsrc ! video/x-raw,format=BGRA,width=640,height=480,interlace-mode=interleaved ! \
  *   vfmetaldeinterlace method=bob ! autovideosink
  * ]|
+ *
+ * With mode=double every field becomes its own output frame, so 1080i50
+ * is deinterlaced to 1080p50:
+ * |[
+ * gst-launch-1.0 videotestsrc ! video/x-raw,format=NV12,width=1920,height=1080,framerate=25/1,interlace-mode=interleaved ! \
+ *   vfmetaldeinterlace method=greedyh mode=double ! autovideosink
+ * ]|
  */
 
 #import <Foundation/Foundation.h>
 #include "gstvfmetaldeinterlace.h"
 #include "metaldeinterlacerenderer.h"
+#import "vfmetalmemory.h"
 
 GST_DEBUG_CATEGORY (gst_vf_metal_deinterlace_debug);
 #define GST_CAT_DEFAULT gst_vf_metal_deinterlace_debug
@@ -45,13 +53,13 @@ GST_DEBUG_CATEGORY (gst_vf_metal_deinterlace_debug);
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (VF_METAL_DEINTERLACE_FORMATS))
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_DEINTERLACE_FORMATS))
     );
 
 static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (VF_METAL_DEINTERLACE_FORMATS))
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_DEINTERLACE_FORMATS))
     );
 
 enum
@@ -60,11 +68,15 @@ enum
   PROP_METHOD,
   PROP_FIELD_LAYOUT,
   PROP_MOTION_THRESHOLD,
+  PROP_MODE,
+  PROP_IN_FLIGHT,
+  PROP_DEVICE,
 };
 
 #define DEFAULT_METHOD          0   /* bob */
 #define DEFAULT_FIELD_LAYOUT    0   /* auto */
 #define DEFAULT_MOTION_THRESHOLD 0.1
+#define DEFAULT_MODE            0   /* single */
 
 /* Deinterlace method enum */
 #define GST_TYPE_VF_METAL_DEINTERLACE_METHOD \
@@ -111,6 +123,27 @@ gst_vf_metal_deinterlace_field_layout_get_type (void)
   return (GType) layout_type;
 }
 
+/* Output rate enum */
+#define GST_TYPE_VF_METAL_DEINTERLACE_MODE \
+    (gst_vf_metal_deinterlace_mode_get_type())
+
+GType
+gst_vf_metal_deinterlace_mode_get_type (void)
+{
+  static gsize mode_type = 0;
+  static const GEnumValue modes[] = {
+    {0, "One output frame per input frame", "single"},
+    {1, "One output frame per field (doubles the frame rate)", "double"},
+    {0, NULL, NULL}
+  };
+
+  if (g_once_init_enter (&mode_type)) {
+    GType t = g_enum_register_static ("GstVfMetalDeinterlaceMode", modes);
+    g_once_init_leave (&mode_type, t);
+  }
+  return (GType) mode_type;
+}
+
 /* --- GType boilerplate --- */
 
 #define gst_vf_metal_deinterlace_parent_class parent_class
@@ -120,6 +153,102 @@ G_DEFINE_TYPE (GstVfMetalDeinterlace, gst_vf_metal_deinterlace,
 GST_ELEMENT_REGISTER_DEFINE (vfmetaldeinterlace, "vfmetaldeinterlace",
     GST_RANK_NONE, GST_TYPE_VF_METAL_DEINTERLACE);
 
+/* --- Caps --- */
+
+/* Multiply (or divide) a framerate value by two; 0/1 stays variable */
+static gboolean
+gst_vf_metal_deinterlace_scale_framerate (const GValue * src, GValue * dst,
+    gboolean double_rate)
+{
+  if (GST_VALUE_HOLDS_FRACTION (src)) {
+    gint n = gst_value_get_fraction_numerator (src);
+    gint d = gst_value_get_fraction_denominator (src);
+
+    if (n != 0 && !gst_util_fraction_multiply (n, d, double_rate ? 2 : 1,
+            double_rate ? 1 : 2, &n, &d))
+      return FALSE;
+
+    g_value_init (dst, GST_TYPE_FRACTION);
+    gst_value_set_fraction (dst, n, d);
+    return TRUE;
+  }
+
+  if (GST_VALUE_HOLDS_FRACTION_RANGE (src)) {
+    GValue min = G_VALUE_INIT, max = G_VALUE_INIT;
+
+    if (!gst_vf_metal_deinterlace_scale_framerate (
+            gst_value_get_fraction_range_min (src), &min, double_rate))
+      return FALSE;
+    if (!gst_vf_metal_deinterlace_scale_framerate (
+            gst_value_get_fraction_range_max (src), &max, double_rate)) {
+      g_value_unset (&min);
+      return FALSE;
+    }
+
+    g_value_init (dst, GST_TYPE_FRACTION_RANGE);
+    gst_value_set_fraction_range (dst, &min, &max);
+    g_value_unset (&min);
+    g_value_unset (&max);
+    return TRUE;
+  }
+
+  if (GST_VALUE_HOLDS_LIST (src)) {
+    guint i, n = gst_value_list_get_size (src);
+
+    g_value_init (dst, GST_TYPE_LIST);
+    for (i = 0; i < n; i++) {
+      GValue v = G_VALUE_INIT;
+      if (gst_vf_metal_deinterlace_scale_framerate (
+              gst_value_list_get_value (src, i), &v, double_rate))
+        gst_value_list_append_and_take_value (dst, &v);
+    }
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static GstCaps *
+gst_vf_metal_deinterlace_transform_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * filter)
+{
+  GstVfMetalDeinterlace *self = GST_VF_METAL_DEINTERLACE (trans);
+  GstCaps *ret, *tmp;
+  gint mode;
+  guint i;
+
+  GST_OBJECT_LOCK (self);
+  mode = self->mode;
+  GST_OBJECT_UNLOCK (self);
+
+  tmp = gst_caps_copy (caps);
+
+  /* Field-rate output: src runs at twice the sink framerate */
+  if (mode == VF_METAL_DEINTERLACE_MODE_DOUBLE) {
+    for (i = 0; i < gst_caps_get_size (tmp); i++) {
+      GstStructure *st = gst_caps_get_structure (tmp, i);
+      const GValue *fr = gst_structure_get_value (st, "framerate");
+      GValue scaled = G_VALUE_INIT;
+
+      if (fr && gst_vf_metal_deinterlace_scale_framerate (fr, &scaled,
+              direction == GST_PAD_SINK))
+        gst_structure_take_value (st, "framerate", &scaled);
+    }
+  }
+
+  if (filter) {
+    ret = gst_caps_intersect_full (filter, tmp, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (tmp);
+  } else {
+    ret = tmp;
+  }
+
+  GST_DEBUG_OBJECT (trans, "transformed %" GST_PTR_FORMAT " into %"
+      GST_PTR_FORMAT, caps, ret);
+
+  return ret;
+}
+
 /* --- set_info --- */
 
 static gboolean
@@ -131,6 +260,26 @@ gst_vf_metal_deinterlace_set_info (GstVideoFilter * filter,
 
   if (!self->renderer) return FALSE;
 
+  /* Caps were negotiated for this mode; keep it until the next set_info */
+  GST_OBJECT_LOCK (self);
+  self->double_rate = (self->mode == VF_METAL_DEINTERLACE_MODE_DOUBLE);
+  GST_OBJECT_UNLOCK (self);
+
+  /* Progressive input has nothing to deinterlace. Field-rate output
+   * still sends every frame twice, so it stays active. */
+  gboolean passthrough = !self->double_rate &&
+      GST_VIDEO_INFO_INTERLACE_MODE (in_info) ==
+      GST_VIDEO_INTERLACE_MODE_PROGRESSIVE;
+  gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (filter),
+      passthrough);
+  GST_DEBUG_OBJECT (self, "interlace-mode %s, passthrough = %s",
+      gst_video_interlace_mode_to_string (
+          GST_VIDEO_INFO_INTERLACE_MODE (in_info)),
+      passthrough ? "TRUE" : "FALSE");
+
+  if (passthrough)
+    return TRUE;
+
   @autoreleasepool {
     MetalDeinterlaceRenderer *renderer =
         (__bridge MetalDeinterlaceRenderer *)self->renderer;
@@ -143,23 +292,39 @@ gst_vf_metal_deinterlace_set_info (GstVideoFilter * filter,
   return TRUE;
 }
 
-/* --- transform_frame --- */
+/* --- Allocation --- */
 
-static GstFlowReturn
-gst_vf_metal_deinterlace_transform_frame (GstVideoFilter * filter,
-    GstVideoFrame * inframe, GstVideoFrame * outframe)
+static gboolean
+gst_vf_metal_deinterlace_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
 {
-  GstVfMetalDeinterlace *self = GST_VF_METAL_DEINTERLACE (filter);
+  GstVfMetalDeinterlace *self = GST_VF_METAL_DEINTERLACE (trans);
 
-  if (!self->renderer) {
-    GST_WARNING_OBJECT (self, "No Metal renderer");
-    return GST_FLOW_ERROR;
-  }
+  return vf_metal_propose_allocation (trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class),
+      ((__bridge MetalDeinterlaceRenderer *)self->renderer).metalDevice,
+      decide_query, query);
+}
 
-  MetalDeinterlaceRenderer *renderer =
-      (__bridge MetalDeinterlaceRenderer *)self->renderer;
+static gboolean
+gst_vf_metal_deinterlace_decide_allocation (GstBaseTransform * trans,
+    GstQuery * query)
+{
+  GstVfMetalDeinterlace *self = GST_VF_METAL_DEINTERLACE (trans);
+
+  return vf_metal_decide_allocation (trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class),
+      ((__bridge MetalDeinterlaceRenderer *)self->renderer).metalDevice,
+      &self->inflight, query);
+}
+
+/* --- transform_frame --- */
 
-  /* Snapshot properties under lock */
+/* Snapshot properties under lock */
+static void
+gst_vf_metal_deinterlace_snapshot_params (GstVfMetalDeinterlace * self,
+    GstVideoFrame * inframe, DeinterlaceParams * params)
+{
   GST_OBJECT_LOCK (self);
   int fieldLayout = self->field_layout;
   int method = self->method;
@@ -184,10 +349,27 @@ gst_vf_metal_deinterlace_transform_frame (GstVideoFilter * filter,
     }
   }
 
+  params->method = (VfMetalDeinterlaceMethod)method;
+  params->topFieldFirst = topFieldFirst;
+  params->motionThreshold = motionThreshold;
+}
+
+static GstFlowReturn
+gst_vf_metal_deinterlace_transform_frame (GstVideoFilter * filter,
+    GstVideoFrame * inframe, GstVideoFrame * outframe)
+{
+  GstVfMetalDeinterlace *self = GST_VF_METAL_DEINTERLACE (filter);
   DeinterlaceParams params;
-  params.method = (VfMetalDeinterlaceMethod)method;
-  params.topFieldFirst = topFieldFirst;
-  params.motionThreshold = motionThreshold;
+
+  if (!self->renderer) {
+    GST_WARNING_OBJECT (self, "No Metal renderer");
+    return GST_FLOW_ERROR;
+  }
+
+  MetalDeinterlaceRenderer *renderer =
+      (__bridge MetalDeinterlaceRenderer *)self->renderer;
+
+  gst_vf_metal_deinterlace_snapshot_params (self, inframe, &params);
 
   @autoreleasepool {
     if (![renderer processFrame:inframe output:outframe params:&params]) {
@@ -199,6 +381,270 @@ gst_vf_metal_deinterlace_transform_frame (GstVideoFilter * filter,
   return GST_FLOW_OK;
 }
 
+/* --- Pipelined submission (in-flight > 1) --- */
+
+static gboolean
+gst_vf_metal_deinterlace_submit (GstBaseTransform * trans,
+    VfMetalInflightJob * job, VfMetalCompletionHandler completion)
+{
+  GstVfMetalDeinterlace *self = GST_VF_METAL_DEINTERLACE (trans);
+  DeinterlaceParams params;
+
+  if (!self->renderer)
+    return FALSE;
+
+  MetalDeinterlaceRenderer *renderer =
+      (__bridge MetalDeinterlaceRenderer *)self->renderer;
+
+  gst_vf_metal_deinterlace_snapshot_params (self, &job->in_frame, &params);
+
+  @autoreleasepool {
+    return [renderer submitFrame:&job->in_frame output:&job->out_frame
+                          params:&params slot:job->slot
+                      completion:completion];
+  }
+}
+
+/* --- Field-rate output (mode=double) --- */
+
+static void
+gst_vf_metal_deinterlace_mark_progressive (GstBuffer * buf)
+{
+  GST_BUFFER_FLAG_UNSET (buf, GST_VIDEO_BUFFER_FLAG_INTERLACED |
+      GST_VIDEO_BUFFER_FLAG_TFF | GST_VIDEO_BUFFER_FLAG_RFF |
+      GST_VIDEO_BUFFER_FLAG_ONEFIELD);
+}
+
+/* Split @inbuf's time span between the two frames made from its fields */
+static void
+gst_vf_metal_deinterlace_split_timestamps (GstVfMetalDeinterlace * self,
+    GstBuffer * inbuf, GstBuffer * first, GstBuffer * second)
+{
+  GstVideoInfo *in_info = &GST_VIDEO_FILTER (self)->in_info;
+  GstClockTime pts = GST_BUFFER_PTS (inbuf);
+  GstClockTime duration = GST_BUFFER_DURATION (inbuf);
+  GstClockTime half;
+
+  if (!GST_CLOCK_TIME_IS_VALID (duration) &&
+      GST_VIDEO_INFO_FPS_N (in_info) > 0) {
+    duration = gst_util_uint64_scale_int (GST_SECOND,
+        GST_VIDEO_INFO_FPS_D (in_info), GST_VIDEO_INFO_FPS_N (in_info));
+  }
+  half = GST_CLOCK_TIME_IS_VALID (duration) ? duration / 2 :
+      GST_CLOCK_TIME_NONE;
+
+  GST_BUFFER_PTS (first) = pts;
+  GST_BUFFER_DURATION (first) = half;
+  GST_BUFFER_PTS (second) =
+      (GST_CLOCK_TIME_IS_VALID (pts) && GST_CLOCK_TIME_IS_VALID (half)) ?
+      pts + half : GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DTS (second) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DURATION (second) = GST_CLOCK_TIME_IS_VALID (duration) ?
+      duration - half : GST_CLOCK_TIME_NONE;
+  GST_BUFFER_FLAG_UNSET (second, GST_BUFFER_FLAG_DISCONT);
+  gst_vf_metal_deinterlace_mark_progressive (first);
+  gst_vf_metal_deinterlace_mark_progressive (second);
+}
+
+/* A progressive buffer: forward it untouched, or twice with split
+ * timestamps in field-rate mode, sharing the same memory */
+static GstFlowReturn
+gst_vf_metal_deinterlace_forward_progressive (GstVfMetalDeinterlace * self,
+    GstBuffer ** outbuf)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM (self);
+  GstBuffer *inbuf = trans->queued_buf;
+  GstBuffer *first;
+  GstFlowReturn ret;
+
+  trans->queued_buf = NULL;
+
+  if (!self->double_rate) {
+    *outbuf = inbuf;
+    return GST_FLOW_OK;
+  }
+
+  first = gst_buffer_copy (inbuf);
+  inbuf = gst_buffer_make_writable (inbuf);
+  gst_vf_metal_deinterlace_split_timestamps (self, inbuf, first, inbuf);
+
+  ret = gst_pad_push (GST_BASE_TRANSFORM_SRC_PAD (trans), first);
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (inbuf);
+    return ret;
+  }
+
+  *outbuf = inbuf;
+  return GST_FLOW_OK;
+}
+
+/* Render both fields of the queued input in one GPU pass, push the
+ * earlier one and hand the later one back to GstBaseTransform */
+static GstFlowReturn
+gst_vf_metal_deinterlace_generate_fields (GstVfMetalDeinterlace * self,
+    GstBuffer ** outbuf)
+{
+  GstBaseTransform *trans = GST_BASE_TRANSFORM (self);
+  GstBaseTransformClass *klass = GST_BASE_TRANSFORM_GET_CLASS (trans);
+  GstVideoFilter *filter = GST_VIDEO_FILTER (self);
+  GstBuffer *inbuf = trans->queued_buf;
+  GstBuffer *first = NULL, *second = NULL;
+  GstVideoFrame inframe, first_frame, second_frame;
+  DeinterlaceParams params;
+  GstFlowReturn ret;
+  BOOL ok;
+
+  *outbuf = NULL;
+  if (!inbuf)
+    return GST_FLOW_OK;
+  trans->queued_buf = NULL;
+
+  if (!self->renderer) {
+    GST_WARNING_OBJECT (self, "No Metal renderer");
+    ret = GST_FLOW_ERROR;
+    goto done;
+  }
+
+  if (klass->before_transform)
+    klass->before_transform (trans, inbuf);
+
+  ret = klass->prepare_output_buffer (trans, inbuf, &first);
+  if (ret != GST_FLOW_OK)
+    goto done;
+  ret = klass->prepare_output_buffer (trans, inbuf, &second);
+  if (ret != GST_FLOW_OK)
+    goto done;
+
+  if (!gst_video_frame_map (&inframe, &filter->in_info, inbuf,
+          GST_MAP_READ | GST_MAP_VF_METAL)) {
+    GST_ERROR_OBJECT (self, "Failed to map input buffer");
+    ret = GST_FLOW_ERROR;
+    goto done;
+  }
+  if (!gst_video_frame_map (&first_frame, &filter->out_info, first,
+          GST_MAP_WRITE | GST_MAP_VF_METAL)) {
+    gst_video_frame_unmap (&inframe);
+    GST_ERROR_OBJECT (self, "Failed to map output buffer");
+    ret = GST_FLOW_ERROR;
+    goto done;
+  }
+  if (!gst_video_frame_map (&second_frame, &filter->out_info, second,
+          GST_MAP_WRITE | GST_MAP_VF_METAL)) {
+    gst_video_frame_unmap (&first_frame);
+    gst_video_frame_unmap (&inframe);
+    GST_ERROR_OBJECT (self, "Failed to map output buffer");
+    ret = GST_FLOW_ERROR;
+    goto done;
+  }
+
+  gst_vf_metal_deinterlace_snapshot_params (self, &inframe, &params);
+
+  MetalDeinterlaceRenderer *renderer =
+      (__bridge MetalDeinterlaceRenderer *)self->renderer;
+
+  @autoreleasepool {
+    ok = [renderer processFields:&inframe firstOutput:&first_frame
+                    secondOutput:&second_frame params:&params];
+  }
+
+  gst_video_frame_unmap (&second_frame);
+  gst_video_frame_unmap (&first_frame);
+  gst_video_frame_unmap (&inframe);
+
+  if (!ok) {
+    GST_WARNING_OBJECT (self, "Metal rendering failed");
+    ret = GST_FLOW_ERROR;
+    goto done;
+  }
+
+  gst_vf_metal_deinterlace_split_timestamps (self, inbuf, first, second);
+
+  ret = gst_pad_push (GST_BASE_TRANSFORM_SRC_PAD (trans), first);
+  first = NULL;
+  if (ret == GST_FLOW_OK) {
+    *outbuf = second;
+    second = NULL;
+  }
+
+done:
+  gst_clear_buffer (&second);
+  gst_clear_buffer (&first);
+  gst_buffer_unref (inbuf);
+  return ret;
+}
+
+static GstFlowReturn
+gst_vf_metal_deinterlace_generate_output (GstBaseTransform * trans,
+    GstBuffer ** outbuf)
+{
+  GstVfMetalDeinterlace *self = GST_VF_METAL_DEINTERLACE (trans);
+  GstVideoFilter *filter = GST_VIDEO_FILTER (trans);
+  GstBuffer *inbuf = trans->queued_buf;
+
+  /* Only interlaced pictures need work: with interlace-mode=mixed those
+   * flagged so, and none of a progressive stream (which can only get
+   * here in field-rate mode) */
+  if (inbuf && !gst_base_transform_is_passthrough (trans) &&
+      (GST_VIDEO_INFO_INTERLACE_MODE (&filter->in_info) ==
+          GST_VIDEO_INTERLACE_MODE_PROGRESSIVE ||
+          (GST_VIDEO_INFO_INTERLACE_MODE (&filter->in_info) ==
+              GST_VIDEO_INTERLACE_MODE_MIXED &&
+              !GST_BUFFER_FLAG_IS_SET (inbuf,
+                  GST_VIDEO_BUFFER_FLAG_INTERLACED)))) {
+    GstFlowReturn ret = vf_metal_inflight_drain (&self->inflight, trans);
+    if (ret != GST_FLOW_OK)
+      return ret;
+    return gst_vf_metal_deinterlace_forward_progressive (self, outbuf);
+  }
+
+  /* Field-rate output is always synchronous: both fields share one pass */
+  if (self->double_rate && !gst_base_transform_is_passthrough (trans)) {
+    GstFlowReturn ret = vf_metal_inflight_drain (&self->inflight, trans);
+    if (ret != GST_FLOW_OK)
+      return ret;
+    return gst_vf_metal_deinterlace_generate_fields (self, outbuf);
+  }
+
+  return vf_metal_inflight_generate_output (&self->inflight, trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class), &filter->in_info,
+      &filter->out_info, gst_vf_metal_deinterlace_submit, outbuf);
+}
+
+static gboolean
+gst_vf_metal_deinterlace_sink_event (GstBaseTransform * trans,
+    GstEvent * event)
+{
+  GstVfMetalDeinterlace *self = GST_VF_METAL_DEINTERLACE (trans);
+
+  vf_metal_inflight_sink_event (&self->inflight, trans, event);
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event);
+}
+
+static gboolean
+gst_vf_metal_deinterlace_query (GstBaseTransform * trans,
+    GstPadDirection direction, GstQuery * query)
+{
+  GstVfMetalDeinterlace *self = GST_VF_METAL_DEINTERLACE (trans);
+  GstVideoInfo *info = &GST_VIDEO_FILTER (trans)->out_info;
+
+  if (vf_metal_device_selection_handle_query (GST_ELEMENT (trans),
+          &self->device, query))
+    return TRUE;
+
+  if (!GST_BASE_TRANSFORM_CLASS (parent_class)->query (trans, direction,
+          query))
+    return FALSE;
+
+  if (direction == GST_PAD_SRC && GST_QUERY_TYPE (query) == GST_QUERY_LATENCY
+      && !gst_base_transform_is_passthrough (trans) && !self->double_rate) {
+    vf_metal_inflight_add_latency (&self->inflight, query,
+        GST_VIDEO_INFO_FPS_N (info), GST_VIDEO_INFO_FPS_D (info));
+  }
+
+  return TRUE;
+}
+
 /* --- Properties --- */
 
 static void
@@ -207,6 +653,13 @@ gst_vf_metal_deinterlace_set_property (GObject * object, guint prop_id,
 {
   GstVfMetalDeinterlace *self = GST_VF_METAL_DEINTERLACE (object);
 
+  /* Takes the object lock itself */
+  if (prop_id == PROP_DEVICE) {
+    vf_metal_device_selection_set_property (GST_ELEMENT (self),
+        &self->device, value);
+    return;
+  }
+
   GST_OBJECT_LOCK (self);
   switch (prop_id) {
     case PROP_METHOD:
@@ -218,6 +671,12 @@ gst_vf_metal_deinterlace_set_property (GObject * object, guint prop_id,
     case PROP_MOTION_THRESHOLD:
       self->motion_threshold = g_value_get_double (value);
       break;
+    case PROP_MODE:
+      self->mode = g_value_get_enum (value);
+      break;
+    case PROP_IN_FLIGHT:
+      self->in_flight = g_value_get_uint (value);
+      break;
     default:
       GST_OBJECT_UNLOCK (self);
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -232,6 +691,12 @@ gst_vf_metal_deinterlace_get_property (GObject * object, guint prop_id,
 {
   GstVfMetalDeinterlace *self = GST_VF_METAL_DEINTERLACE (object);
 
+  if (prop_id == PROP_DEVICE) {
+    vf_metal_device_selection_get_property (GST_ELEMENT (self),
+        &self->device, value);
+    return;
+  }
+
   GST_OBJECT_LOCK (self);
   switch (prop_id) {
     case PROP_METHOD:
@@ -243,6 +708,12 @@ gst_vf_metal_deinterlace_get_property (GObject * object, guint prop_id,
     case PROP_MOTION_THRESHOLD:
       g_value_set_double (value, self->motion_threshold);
       break;
+    case PROP_MODE:
+      g_value_set_enum (value, self->mode);
+      break;
+    case PROP_IN_FLIGHT:
+      g_value_set_uint (value, self->in_flight);
+      break;
     default:
       GST_OBJECT_UNLOCK (self);
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -251,6 +722,57 @@ gst_vf_metal_deinterlace_get_property (GObject * object, guint prop_id,
   GST_OBJECT_UNLOCK (self);
 }
 
+/* --- Device --- */
+
+static void
+gst_vf_metal_deinterlace_set_context (GstElement * element,
+    GstContext * context)
+{
+  GstVfMetalDeinterlace *self = GST_VF_METAL_DEINTERLACE (element);
+
+  vf_metal_device_selection_set_context (element, &self->device, context);
+
+  GST_ELEMENT_CLASS (parent_class)->set_context (element, context);
+}
+
+/* Renderer on the selected GPU, replaced when the selection moved */
+static gboolean
+gst_vf_metal_deinterlace_ensure_renderer (GstVfMetalDeinterlace * self)
+{
+  VfMetalDevice *device;
+
+  device = vf_metal_device_selection_ensure (GST_ELEMENT (self),
+      &self->device);
+  if (!device)
+    return FALSE;
+
+  @autoreleasepool {
+    if (self->renderer) {
+      MetalDeinterlaceRenderer *renderer =
+          (__bridge MetalDeinterlaceRenderer *)self->renderer;
+      if (renderer.metalDevice == device)
+        return TRUE;
+
+      renderer = (__bridge_transfer MetalDeinterlaceRenderer *)self->renderer;
+      self->renderer = NULL;
+      [renderer cleanup];
+    }
+
+    MetalDeinterlaceRenderer *renderer =
+        [[MetalDeinterlaceRenderer alloc] initWithDevice:device];
+    if (!renderer) {
+      GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+          ("Failed to create Metal renderer on '%s'",
+              device.device.name.UTF8String), (NULL));
+      return FALSE;
+    }
+    renderer.traceOwner = GST_OBJECT (self);
+    self->renderer = (__bridge_retained void *)renderer;
+  }
+
+  return TRUE;
+}
+
 /* --- State change --- */
 
 static GstStateChangeReturn
@@ -259,11 +781,23 @@ gst_vf_metal_deinterlace_change_state (GstElement * element,
 {
   GstVfMetalDeinterlace *self = GST_VF_METAL_DEINTERLACE (element);
   GstStateChangeReturn ret;
+  guint in_flight;
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY &&
+      !gst_vf_metal_deinterlace_ensure_renderer (self))
+    return GST_STATE_CHANGE_FAILURE;
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+    GST_OBJECT_LOCK (self);
+    in_flight = self->in_flight;
+    GST_OBJECT_UNLOCK (self);
+    vf_metal_inflight_start (&self->inflight, in_flight);
+  }
 
   ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
 
   switch (transition) {
     case GST_STATE_CHANGE_PAUSED_TO_READY:
+      vf_metal_inflight_stop (&self->inflight);
       if (self->renderer) {
         @autoreleasepool {
           MetalDeinterlaceRenderer *renderer =
@@ -272,6 +806,9 @@ gst_vf_metal_deinterlace_change_state (GstElement * element,
         }
       }
       break;
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      vf_metal_device_selection_reset (element, &self->device);
+      break;
     default:
       break;
   }
@@ -296,6 +833,9 @@ gst_vf_metal_deinterlace_finalize (GObject * object)
     }
   }
 
+  vf_metal_inflight_clear (&self->inflight);
+  vf_metal_device_selection_clear (&self->device);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -306,6 +846,7 @@ gst_vf_metal_deinterlace_class_init (GstVfMetalDeinterlaceClass * klass)
 {
   GObjectClass *gobject_class = (GObjectClass *) klass;
   GstElementClass *gstelement_class = (GstElementClass *) klass;
+  GstBaseTransformClass *basetransform_class = (GstBaseTransformClass *) klass;
   GstVideoFilterClass *gstvideofilter_class = (GstVideoFilterClass *) klass;
 
   gobject_class->set_property = gst_vf_metal_deinterlace_set_property;
@@ -314,11 +855,25 @@ gst_vf_metal_deinterlace_class_init (GstVfMetalDeinterlaceClass * klass)
 
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_vf_metal_deinterlace_change_state);
+  gstelement_class->set_context =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_deinterlace_set_context);
 
+  basetransform_class->transform_caps =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_deinterlace_transform_caps);
   gstvideofilter_class->set_info =
       GST_DEBUG_FUNCPTR (gst_vf_metal_deinterlace_set_info);
   gstvideofilter_class->transform_frame =
       GST_DEBUG_FUNCPTR (gst_vf_metal_deinterlace_transform_frame);
+  basetransform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_deinterlace_propose_allocation);
+  basetransform_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_deinterlace_decide_allocation);
+  basetransform_class->generate_output =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_deinterlace_generate_output);
+  basetransform_class->sink_event =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_deinterlace_sink_event);
+  basetransform_class->query =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_deinterlace_query);
 
   g_object_class_install_property (gobject_class, PROP_METHOD,
       g_param_spec_enum ("method", "Method",
@@ -338,6 +893,26 @@ gst_vf_metal_deinterlace_class_init (GstVfMetalDeinterlaceClass * klass)
           0.0, 1.0, DEFAULT_MOTION_THRESHOLD,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_MODE,
+      g_param_spec_enum ("mode", "Mode",
+          "Output one frame per input frame, or one per field at double "
+          "the frame rate",
+          GST_TYPE_VF_METAL_DEINTERLACE_MODE, DEFAULT_MODE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_IN_FLIGHT,
+      g_param_spec_uint ("in-flight", "In-flight frames",
+          "Frames queued on the GPU before the oldest is pushed downstream "
+          "(1 = wait for every frame; each extra frame adds one frame of "
+          "latency)",
+          1, VF_METAL_MAX_IN_FLIGHT, VF_METAL_DEFAULT_IN_FLIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_DEVICE,
+      vf_metal_device_selection_param_spec ());
+
   gst_element_class_add_static_pad_template (gstelement_class, &sink_template);
   gst_element_class_add_static_pad_template (gstelement_class, &src_template);
 
@@ -358,14 +933,11 @@ gst_vf_metal_deinterlace_init (GstVfMetalDeinterlace * self)
   self->method = DEFAULT_METHOD;
   self->field_layout = DEFAULT_FIELD_LAYOUT;
   self->motion_threshold = DEFAULT_MOTION_THRESHOLD;
+  self->mode = DEFAULT_MODE;
 
-  @autoreleasepool {
-    MetalDeinterlaceRenderer *renderer =
-        [[MetalDeinterlaceRenderer alloc] init];
-    if (renderer) {
-      self->renderer = (__bridge_retained void *)renderer;
-    } else {
-      GST_ERROR_OBJECT (self, "Failed to create Metal renderer");
-    }
-  }
+  self->in_flight = VF_METAL_DEFAULT_IN_FLIGHT;
+  vf_metal_inflight_init (&self->inflight);
+
+  /* The renderer waits for NULL_TO_READY, when the GPU is known */
+  vf_metal_device_selection_init (&self->device);
 }
@@ -26,49 +26,10 @@
 
 static NSString *const kDeinterlaceShaderSource = @R"(
 
-// --- YUV-to-RGBA render pass (GPU-side input conversion) ---
-
-vertex VertexOut deinterlacePassVertex(uint vid [[vertex_id]]) {
-    float2 positions[4] = {
-        float2(-1, -1),
-        float2( 1, -1),
-        float2(-1,  1),
-        float2( 1,  1)
-    };
-    VertexOut out;
-    out.position = float4(positions[vid], 0.0, 1.0);
-    out.texcoord = (positions[vid] + 1.0) * 0.5;
-    out.texcoord.y = 1.0 - out.texcoord.y;
-    return out;
-}
-
-fragment float4 deinterlaceNV12ToRGBA(
-    VertexOut in [[stage_in]],
-    constant Uniforms &u [[buffer(0)]],
-    texture2d<float> yTex [[texture(0)]],
-    texture2d<float> uvTex [[texture(1)]]
-) {
-    constexpr sampler s(filter::nearest, address::clamp_to_edge);
-    float y  = yTex.sample(s, in.texcoord).r;
-    float2 uv = uvTex.sample(s, in.texcoord).rg;
-    float3 rgb = yuvToRGB(y, uv.r, uv.g, u.colorMatrix);
-    return float4(rgb, 1.0);
-}
-
-fragment float4 deinterlaceI420ToRGBA(
-    VertexOut in [[stage_in]],
-    constant Uniforms &u [[buffer(0)]],
-    texture2d<float> yTex [[texture(0)]],
-    texture2d<float> uTex [[texture(1)]],
-    texture2d<float> vTex [[texture(2)]]
-) {
-    constexpr sampler s(filter::nearest, address::clamp_to_edge);
-    float y  = yTex.sample(s, in.texcoord).r;
-    float cb = uTex.sample(s, in.texcoord).r;
-    float cr = vTex.sample(s, in.texcoord).r;
-    float3 rgb = yuvToRGB(y, cb, cr, u.colorMatrix);
-    return float4(rgb, 1.0);
-}
+// Every kernel below is channel-agnostic: it runs on a BGRA frame, or
+// once per plane (R8 luma, RG8/R8 chroma) for NV12 and I420. Interlaced
+// 4:2:0 subsamples each field separately, so chroma rows alternate
+// fields exactly like luma rows do.
 
 // --- Deinterlace uniforms ---
 
@@ -217,6 +178,50 @@ kernel void deinterlaceGreedyH(
     }
 }
 
+// --- GreedyH on a 4:2:0 chroma plane: motion is judged on luma ---
+
+kernel void deinterlaceGreedyHChroma(
+    texture2d<float, access::read> curTex [[texture(0)]],
+    texture2d<float, access::read> prevTex [[texture(1)]],
+    texture2d<float, access::write> outTex [[texture(2)]],
+    texture2d<float, access::read> curLuma [[texture(3)]],
+    texture2d<float, access::read> prevLuma [[texture(4)]],
+    constant DeinterlaceUniforms &u [[buffer(0)]],
+    uint2 gid [[thread_position_in_grid]]
+) {
+    if (gid.x >= u.width || gid.y >= u.height) return;
+
+    uint y = gid.y;
+    bool isTopField = (y % 2 == 0);
+    bool keepFromCurrent = (u.topFieldFirst != 0) ? isTopField : !isTopField;
+
+    if (keepFromCurrent) {
+        outTex.write(curTex.read(gid), gid);
+        return;
+    }
+
+    // Chroma row y carries field line y/2 of field y%2, which spans the
+    // luma rows 4*(y/2) + y%2 and two below it, both in the same field
+    uint lw = curLuma.get_width();
+    uint lh = curLuma.get_height();
+    uint lx = min(gid.x * 2, lw - 1);
+    uint ly0 = min(4 * (y / 2) + (y % 2), lh - 1);
+    uint ly1 = min(ly0 + 2, lh - 1);
+    float motion = max(
+        abs(curLuma.read(uint2(lx, ly0)).r - prevLuma.read(uint2(lx, ly0)).r),
+        abs(curLuma.read(uint2(lx, ly1)).r - prevLuma.read(uint2(lx, ly1)).r));
+
+    if (motion < u.motionThreshold) {
+        outTex.write(prevTex.read(gid), gid);
+    } else {
+        uint above = (y > 0) ? y - 1 : 0;
+        uint below = (y < u.height - 1) ? y + 1 : u.height - 1;
+        float4 a = curTex.read(uint2(gid.x, above));
+        float4 b = curTex.read(uint2(gid.x, below));
+        outTex.write((a + b) * 0.5, gid);
+    }
+}
+
 )";
 
 #endif /* __METAL_DEINTERLACE_SHADERS_H__ */
@@ -26,6 +26,9 @@
 #import <Metal/Metal.h>
 #include <gst/video/video.h>
 
+#import "vfmetaldevice.h"
+#import "vfmetalinflight.h"
+
 typedef enum {
     VF_METAL_DEINTERLACE_BOB     = 0,
     VF_METAL_DEINTERLACE_WEAVE   = 1,
@@ -41,7 +44,15 @@ typedef struct {
 
 @interface MetalDeinterlaceRenderer : NSObject
 
+/* Element this renderer's stages are traced for (see vfmetaltrace.h) */
+@property (nonatomic, assign) GstObject *traceOwner;
+
+/* GPU this renderer runs on, fixed at creation */
+@property (nonatomic, readonly) VfMetalDevice *metalDevice;
+
+/* -init uses the default device (+[VfMetalDevice sharedDevice]) */
 - (instancetype)init;
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice;
 
 - (BOOL)configureWithInfo:(GstVideoInfo *)info;
 
@@ -49,6 +60,23 @@ typedef struct {
               output:(GstVideoFrame *)outFrame
               params:(const DeinterlaceParams *)params;
 
+/* Pipelined variant: encode into ring @slot, commit without waiting and
+ * call @completion once outFrame has been read back. Returns NO (and
+ * never calls @completion) if nothing was committed. */
+- (BOOL)submitFrame:(GstVideoFrame *)inFrame
+             output:(GstVideoFrame *)outFrame
+             params:(const DeinterlaceParams *)params
+               slot:(NSUInteger)slot
+         completion:(VfMetalCompletionHandler)completion;
+
+/* Field-rate output: upload @inFrame once and reconstruct each of its
+ * fields, in temporal order, into @firstFrame and @secondFrame within a
+ * single command buffer. */
+- (BOOL)processFields:(GstVideoFrame *)inFrame
+          firstOutput:(GstVideoFrame *)firstFrame
+         secondOutput:(GstVideoFrame *)secondFrame
+               params:(const DeinterlaceParams *)params;
+
 - (void)cleanup;
 
 @end
@@ -23,8 +23,10 @@
 #import "metaldeinterlace_shaders.h"
 #import "vfmetaldevice.h"
 #import "vfmetaltextureutil.h"
+#import "vfmetalmemory.h"
 #import "vfmetalshaders.h"
 #import "vfmetalyuvoutput.h"
+#import "vfmetaltrace.h"
 
 #include <gst/gst.h>
 
@@ -43,6 +45,12 @@ typedef struct {
     int32_t padding3;
 } DeinterlaceUniformsGPU;
 
+/* Input frames kept for temporal methods (current + two previous) */
+#define VF_DEINTERLACE_HISTORY_DEPTH 3
+
+/* BGRA/RGBA use one texture per frame, NV12 two and I420 three */
+#define VF_DEINTERLACE_MAX_PLANES 3
+
 @implementation MetalDeinterlaceRenderer {
     id<MTLCommandQueue> _commandQueue;
     id<MTLLibrary> _library;
@@ -52,18 +60,23 @@ typedef struct {
     id<MTLComputePipelineState> _computeLinear;
     id<MTLComputePipelineState> _computeWeave;
     id<MTLComputePipelineState> _computeGreedyH;
+    id<MTLComputePipelineState> _computeGreedyHChroma;
 
     /* Shared YUV output helper */
     VfMetalYUVOutput *_yuvOutput;
 
-    /* Render pipelines for YUV→RGBA input conversion (GPU-side) */
-    id<MTLRenderPipelineState> _yuvToRgbaNV12;
-    id<MTLRenderPipelineState> _yuvToRgbaI420;
+    /* Input history ring, one texture per plane in the input's own
+     * layout. Each frame is uploaded into the oldest entry and the roles
+     * rotate, so history never needs a copy. */
+    id<MTLTexture> _history[VF_DEINTERLACE_HISTORY_DEPTH][VF_DEINTERLACE_MAX_PLANES];
+    NSUInteger _historyHead;        /* entry holding the current frame */
+    NSUInteger _historyCount;       /* valid entries, including current */
+    NSUInteger _nPlanes;
 
-    /* Intermediate textures */
-    id<MTLTexture> _inputRGBA;      /* Input uploaded/converted to RGBA */
-    id<MTLTexture> _outputRGBA;     /* Deinterlaced output in RGBA */
-    id<MTLTexture> _prevFrameRGBA;  /* Previous frame for weave/greedyh */
+    /* BGRA/RGBA only: deinterlaced output before the copy out. NV12 and
+     * I420 are written straight into VfMetalYUVOutput's planes. */
+    id<MTLTexture> _outputRGBA;
+    id<MTLTexture> _outputSecondRGBA; /* Later field in field-rate mode */
 
     /* Configuration */
     int _width;
@@ -71,25 +84,37 @@ typedef struct {
     GstVideoFormat _format;
 
     VfMetalTextureCache *_textureCache;
-    BOOL _hasPrevFrame;
+}
+
+- (void)setTraceOwner:(GstObject *)traceOwner
+{
+    _traceOwner = traceOwner;
+    _textureCache.traceOwner = traceOwner;
+    _yuvOutput.traceOwner = traceOwner;
 }
 
 - (instancetype)init
+{
+    return [self initWithDevice:[VfMetalDevice sharedDevice]];
+}
+
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice
 {
     self = [super init];
     if (!self) return nil;
 
-    VfMetalDevice *metalDevice = [VfMetalDevice sharedDevice];
     if (!metalDevice) return nil;
+    _metalDevice = metalDevice;
 
-    _commandQueue = [metalDevice.device newCommandQueue];
-    if (!_commandQueue) return nil;
+    _commandQueue = metalDevice.commandQueue;
 
     NSString *fullSource = [kVfMetalCommonShaderSource
         stringByAppendingString:kDeinterlaceShaderSource];
 
     NSError *error = nil;
-    _library = [metalDevice compileShaderSource:fullSource error:&error];
+    _library = [metalDevice libraryNamed:@"deinterlace"
+                                  source:fullSource
+                                   error:&error];
     if (!_library) {
         GST_ERROR ("MetalDeinterlaceRenderer: Failed to compile shaders: %s",
               error.localizedDescription.UTF8String);
@@ -99,202 +124,312 @@ typedef struct {
     _textureCache = [[VfMetalTextureCache alloc]
         initWithDevice:metalDevice.device];
 
-    id<MTLDevice> device = metalDevice.device;
-
     /* Create compute pipelines */
-    id<MTLFunction> bobFunc = [_library newFunctionWithName:@"deinterlaceBob"];
-    id<MTLFunction> linearFunc = [_library newFunctionWithName:@"deinterlaceLinear"];
-    id<MTLFunction> weaveFunc = [_library newFunctionWithName:@"deinterlaceWeave"];
-    id<MTLFunction> greedyHFunc = [_library newFunctionWithName:@"deinterlaceGreedyH"];
-
-    _computeBob = [device newComputePipelineStateWithFunction:bobFunc error:&error];
-    _computeLinear = [device newComputePipelineStateWithFunction:linearFunc error:&error];
-    _computeWeave = [device newComputePipelineStateWithFunction:weaveFunc error:&error];
-    _computeGreedyH = [device newComputePipelineStateWithFunction:greedyHFunc error:&error];
-
-    if (!_computeBob || !_computeLinear || !_computeWeave || !_computeGreedyH) {
+    _computeBob = [metalDevice computePipelineWithFunctionName:@"deinterlaceBob"
+                                                       library:_library
+                                                         error:&error];
+    _computeLinear =
+        [metalDevice computePipelineWithFunctionName:@"deinterlaceLinear"
+                                             library:_library error:&error];
+    _computeWeave =
+        [metalDevice computePipelineWithFunctionName:@"deinterlaceWeave"
+                                             library:_library error:&error];
+    _computeGreedyH =
+        [metalDevice computePipelineWithFunctionName:@"deinterlaceGreedyH"
+                                             library:_library error:&error];
+    _computeGreedyHChroma =
+        [metalDevice computePipelineWithFunctionName:@"deinterlaceGreedyHChroma"
+                                             library:_library error:&error];
+
+    if (!_computeBob || !_computeLinear || !_computeWeave || !_computeGreedyH ||
+        !_computeGreedyHChroma) {
         GST_ERROR ("MetalDeinterlaceRenderer: Failed to create compute pipelines: %s",
               error.localizedDescription.UTF8String);
         return nil;
     }
 
-    /* Create render pipelines for YUV→RGBA GPU conversion */
-    id<MTLFunction> vertFunc =
-        [_library newFunctionWithName:@"deinterlacePassVertex"];
-
-    {
-        MTLRenderPipelineDescriptor *desc =
-            [[MTLRenderPipelineDescriptor alloc] init];
-        desc.vertexFunction = vertFunc;
-        desc.fragmentFunction =
-            [_library newFunctionWithName:@"deinterlaceNV12ToRGBA"];
-        desc.colorAttachments[0].pixelFormat = MTLPixelFormatBGRA8Unorm;
-        NSError *err = nil;
-        _yuvToRgbaNV12 =
-            [device newRenderPipelineStateWithDescriptor:desc error:&err];
-        if (!_yuvToRgbaNV12) {
-            GST_ERROR ("MetalDeinterlaceRenderer: Failed to create NV12 pipeline: %s",
-                  err.localizedDescription.UTF8String);
-            return nil;
-        }
-    }
-
-    {
-        MTLRenderPipelineDescriptor *desc =
-            [[MTLRenderPipelineDescriptor alloc] init];
-        desc.vertexFunction = vertFunc;
-        desc.fragmentFunction =
-            [_library newFunctionWithName:@"deinterlaceI420ToRGBA"];
-        desc.colorAttachments[0].pixelFormat = MTLPixelFormatBGRA8Unorm;
-        NSError *err = nil;
-        _yuvToRgbaI420 =
-            [device newRenderPipelineStateWithDescriptor:desc error:&err];
-        if (!_yuvToRgbaI420) {
-            GST_ERROR ("MetalDeinterlaceRenderer: Failed to create I420 pipeline: %s",
-                  err.localizedDescription.UTF8String);
-            return nil;
-        }
-    }
-
     _yuvOutput = [[VfMetalYUVOutput alloc] init];
-    _hasPrevFrame = NO;
+    _historyHead = 0;
+    _historyCount = 0;
 
     return self;
 }
 
+- (MTLTextureDescriptor *)_rgbaDescriptor
+{
+    MTLTextureDescriptor *rgbaDesc = [MTLTextureDescriptor
+        texture2DDescriptorWithPixelFormat:MTLPixelFormatBGRA8Unorm
+                                     width:_width
+                                    height:_height
+                                 mipmapped:NO];
+    rgbaDesc.usage = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite;
+    rgbaDesc.storageMode = _metalDevice.hostStorageMode;
+    return rgbaDesc;
+}
+
+/* Texture layout of input plane @plane for the configured format */
+- (MTLTextureDescriptor *)_planeDescriptor:(NSUInteger)plane
+{
+    MTLPixelFormat pixelFormat = MTLPixelFormatR8Unorm;
+    NSUInteger w = _width;
+    NSUInteger h = _height;
+
+    if (_format != GST_VIDEO_FORMAT_NV12 && _format != GST_VIDEO_FORMAT_I420) {
+        return [self _rgbaDescriptor];
+    } else if (plane > 0) {
+        w = (_width + 1) / 2;
+        h = (_height + 1) / 2;
+        if (_format == GST_VIDEO_FORMAT_NV12)
+            pixelFormat = MTLPixelFormatRG8Unorm;
+    }
+
+    MTLTextureDescriptor *desc = [MTLTextureDescriptor
+        texture2DDescriptorWithPixelFormat:pixelFormat
+                                     width:w
+                                    height:h
+                                 mipmapped:NO];
+    desc.usage = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite;
+    desc.storageMode = _metalDevice.hostStorageMode;
+    return desc;
+}
+
 - (BOOL)configureWithInfo:(GstVideoInfo *)info
 {
     int w = GST_VIDEO_INFO_WIDTH (info);
     int h = GST_VIDEO_INFO_HEIGHT (info);
     GstVideoFormat fmt = GST_VIDEO_INFO_FORMAT (info);
 
-    if (_inputRGBA && _width == w && _height == h && _format == fmt) {
+    if (_history[0][0] && _width == w && _height == h && _format == fmt) {
         return YES;
     }
 
-    id<MTLDevice> device = [VfMetalDevice sharedDevice].device;
+    id<MTLDevice> device = _metalDevice.device;
 
     _width = w;
     _height = h;
     _format = fmt;
-    _hasPrevFrame = NO;
-
-    /* Create RGBA intermediate textures (always process in RGBA space) */
-    MTLTextureDescriptor *rgbaDesc = [MTLTextureDescriptor
-        texture2DDescriptorWithPixelFormat:MTLPixelFormatBGRA8Unorm
-                                     width:w
-                                    height:h
-                                 mipmapped:NO];
-    rgbaDesc.usage = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite |
-                     MTLTextureUsageRenderTarget;
-    rgbaDesc.storageMode = MTLStorageModeShared;
+    _historyHead = 0;
+    _historyCount = 0;
+    _nPlanes = (fmt == GST_VIDEO_FORMAT_NV12) ? 2 :
+               (fmt == GST_VIDEO_FORMAT_I420) ? 3 : 1;
+
+    /* History keeps the input layout: YUV is deinterlaced plane by plane */
+    for (int i = 0; i < VF_DEINTERLACE_HISTORY_DEPTH; i++) {
+        for (NSUInteger p = 0; p < VF_DEINTERLACE_MAX_PLANES; p++) {
+            _history[i][p] = nil;
+            if (p >= _nPlanes) continue;
+            _history[i][p] = [device newTextureWithDescriptor:
+                [self _planeDescriptor:p]];
+            if (!_history[i][p]) return NO;
+        }
+    }
 
-    _inputRGBA = [device newTextureWithDescriptor:rgbaDesc];
-    _outputRGBA = [device newTextureWithDescriptor:rgbaDesc];
-    _prevFrameRGBA = [device newTextureWithDescriptor:rgbaDesc];
-    if (!_inputRGBA || !_outputRGBA || !_prevFrameRGBA) return NO;
+    _outputRGBA = nil;
+    _outputSecondRGBA = nil;
+    if (_nPlanes == 1) {
+        _outputRGBA = [device newTextureWithDescriptor:[self _rgbaDescriptor]];
+        if (!_outputRGBA) return NO;
+    }
 
-    if (![_yuvOutput configureWithDevice:device library:_library
+    if (![_yuvOutput configureWithDevice:_metalDevice library:_library
                                    width:w height:h format:fmt])
         return NO;
 
     return YES;
 }
 
-- (void)_uploadInputToRGBA:(GstVideoFrame *)inFrame
-             commandBuffer:(id<MTLCommandBuffer>)commandBuffer
+/* Planes of the history entry @age frames back; 0 is the current frame.
+ * nil when that frame has not been seen yet. */
+- (NSArray<id<MTLTexture>> *)_historyFrame:(NSUInteger)age
+{
+    if (age >= _historyCount) return nil;
+
+    NSUInteger entry = (_historyHead + VF_DEINTERLACE_HISTORY_DEPTH - age) %
+                       VF_DEINTERLACE_HISTORY_DEPTH;
+    return [NSArray arrayWithObjects:_history[entry] count:_nPlanes];
+}
+
+/* Rotate the ring so the oldest entry receives the next upload */
+- (void)_advanceHistory
 {
-    [_textureCache resetFrameIndex];
-
-    GstVideoFormat fmt = GST_VIDEO_FRAME_FORMAT (inFrame);
-    int w = GST_VIDEO_FRAME_WIDTH (inFrame);
-    int h = GST_VIDEO_FRAME_HEIGHT (inFrame);
-
-    if (fmt == GST_VIDEO_FORMAT_BGRA || fmt == GST_VIDEO_FORMAT_RGBA) {
-        /* Direct copy to RGBA texture */
-        [_inputRGBA replaceRegion:MTLRegionMake2D(0, 0, w, h)
-                      mipmapLevel:0
-                        withBytes:GST_VIDEO_FRAME_PLANE_DATA (inFrame, 0)
-                      bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (inFrame, 0)];
-    } else if (fmt == GST_VIDEO_FORMAT_NV12) {
-        /* Upload Y and UV planes as textures, convert via GPU render pass */
-        id<MTLTexture> yTex =
-            [_textureCache uploadPlane:inFrame plane:0
-                        format:MTLPixelFormatR8Unorm
-                         width:w height:h];
-        id<MTLTexture> uvTex =
-            [_textureCache uploadPlane:inFrame plane:1
-                        format:MTLPixelFormatRG8Unorm
-                         width:(w + 1) / 2 height:(h + 1) / 2];
-        if (!yTex || !uvTex) return;
-
-        MTLRenderPassDescriptor *rpDesc =
-            [MTLRenderPassDescriptor renderPassDescriptor];
-        rpDesc.colorAttachments[0].texture = _inputRGBA;
-        rpDesc.colorAttachments[0].loadAction = MTLLoadActionDontCare;
-        rpDesc.colorAttachments[0].storeAction = MTLStoreActionStore;
-
-        id<MTLRenderCommandEncoder> encoder =
-            [commandBuffer renderCommandEncoderWithDescriptor:rpDesc];
-        [encoder setRenderPipelineState:_yuvToRgbaNV12];
-        MTLViewport viewport = {0, 0, (double)w, (double)h, 0.0, 1.0};
-        [encoder setViewport:viewport];
-
-        VfMetalUniforms uniforms = {
-            .alpha = 1.0f,
-            .colorMatrix = vf_metal_color_matrix_for_frame(inFrame),
-        };
-        [encoder setFragmentBytes:&uniforms length:sizeof(uniforms) atIndex:0];
-        [encoder setFragmentTexture:yTex atIndex:0];
-        [encoder setFragmentTexture:uvTex atIndex:1];
-        [encoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
-                    vertexStart:0 vertexCount:4];
-        [encoder endEncoding];
-    } else if (fmt == GST_VIDEO_FORMAT_I420) {
-        /* Upload Y, U, V planes as textures, convert via GPU render pass */
-        id<MTLTexture> yTex =
-            [_textureCache uploadPlane:inFrame plane:0
-                        format:MTLPixelFormatR8Unorm
-                         width:w height:h];
-        id<MTLTexture> uTex =
-            [_textureCache uploadPlane:inFrame plane:1
-                        format:MTLPixelFormatR8Unorm
-                         width:(w + 1) / 2 height:(h + 1) / 2];
-        id<MTLTexture> vTex =
-            [_textureCache uploadPlane:inFrame plane:2
-                        format:MTLPixelFormatR8Unorm
-                         width:(w + 1) / 2 height:(h + 1) / 2];
-        if (!yTex || !uTex || !vTex) return;
-
-        MTLRenderPassDescriptor *rpDesc =
-            [MTLRenderPassDescriptor renderPassDescriptor];
-        rpDesc.colorAttachments[0].texture = _inputRGBA;
-        rpDesc.colorAttachments[0].loadAction = MTLLoadActionDontCare;
-        rpDesc.colorAttachments[0].storeAction = MTLStoreActionStore;
-
-        id<MTLRenderCommandEncoder> encoder =
-            [commandBuffer renderCommandEncoderWithDescriptor:rpDesc];
-        [encoder setRenderPipelineState:_yuvToRgbaI420];
-        MTLViewport viewport = {0, 0, (double)w, (double)h, 0.0, 1.0};
-        [encoder setViewport:viewport];
-
-        VfMetalUniforms uniforms = {
-            .alpha = 1.0f,
-            .colorMatrix = vf_metal_color_matrix_for_frame(inFrame),
-        };
-        [encoder setFragmentBytes:&uniforms length:sizeof(uniforms) atIndex:0];
-        [encoder setFragmentTexture:yTex atIndex:0];
-        [encoder setFragmentTexture:uTex atIndex:1];
-        [encoder setFragmentTexture:vTex atIndex:2];
-        [encoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
-                    vertexStart:0 vertexCount:4];
-        [encoder endEncoding];
+    _historyHead = (_historyHead + 1) % VF_DEINTERLACE_HISTORY_DEPTH;
+    _historyCount = MIN (_historyCount + 1, VF_DEINTERLACE_HISTORY_DEPTH);
+}
+
+- (BOOL)_uploadInput:(GstVideoFrame *)inFrame
+       commandBuffer:(id<MTLCommandBuffer>)commandBuffer
+                slot:(NSUInteger)slot
+           pipelined:(BOOL)pipelined
+{
+    [_textureCache resetFrameIndexForSlot:slot];
+
+    /* Queued frames may still be reading the entry being replaced, and
+     * CoreVideo input is already on the GPU: both go through the texture
+     * cache and a copy on the GPU timeline. */
+    BOOL staged = pipelined || vf_metal_frame_get_pixel_buffer (inFrame);
+    id<MTLBlitCommandEncoder> blit = nil;
+    BOOL ok = YES;
+
+    for (NSUInteger p = 0; p < _nPlanes; p++) {
+        id<MTLTexture> dst = _history[_historyHead][p];
+
+        if (!staged && !vf_metal_frame_peek_texture (inFrame, (guint)p,
+                                                       _metalDevice.device)) {
+            /* Plain system memory: copy straight into the history entry */
+            [dst replaceRegion:MTLRegionMake2D(0, 0, dst.width, dst.height)
+                   mipmapLevel:0
+                     withBytes:GST_VIDEO_FRAME_PLANE_DATA (inFrame, p)
+                   bytesPerRow:GST_VIDEO_FRAME_PLANE_STRIDE (inFrame, p)];
+            continue;
+        }
+
+        id<MTLTexture> srcTex =
+            [_textureCache uploadPlane:inFrame plane:(int)p
+                                format:dst.pixelFormat
+                                 width:(int)dst.width
+                                height:(int)dst.height];
+        if (!srcTex) {
+            ok = NO;
+            break;
+        }
+
+        if (!blit)
+            blit = [commandBuffer blitCommandEncoder];
+        [blit copyFromTexture:srcTex toTexture:dst];
     }
+
+    [blit endEncoding];
+    return ok;
 }
 
 - (BOOL)processFrame:(GstVideoFrame *)inFrame
               output:(GstVideoFrame *)outFrame
               params:(const DeinterlaceParams *)params
+{
+    return [self _renderFrame:inFrame output:outFrame params:params
+                         slot:0 completion:nil];
+}
+
+- (BOOL)submitFrame:(GstVideoFrame *)inFrame
+             output:(GstVideoFrame *)outFrame
+             params:(const DeinterlaceParams *)params
+               slot:(NSUInteger)slot
+         completion:(VfMetalCompletionHandler)completion
+{
+    return [self _renderFrame:inFrame output:outFrame params:params
+                         slot:slot completion:completion];
+}
+
+/* Encode one deinterlace pass over a single plane, keeping the field
+ * selected by @keepTopField from @current and rebuilding the other one
+ * into @output. @lumaCurrent/@lumaPrevious are set for 4:2:0 chroma so
+ * greedyH can judge motion on luma. */
+- (void)_encodeMethod:(VfMetalDeinterlaceMethod)method
+         keepTopField:(int)keepTopField
+      motionThreshold:(float)motionThreshold
+              current:(id<MTLTexture>)current
+             previous:(id<MTLTexture>)previous
+          lumaCurrent:(id<MTLTexture>)lumaCurrent
+         lumaPrevious:(id<MTLTexture>)lumaPrevious
+               output:(id<MTLTexture>)output
+        commandBuffer:(id<MTLCommandBuffer>)commandBuffer
+{
+    NSUInteger w = output.width;
+    NSUInteger h = output.height;
+
+    DeinterlaceUniformsGPU uniforms = {
+        .width = (uint32_t)w,
+        .height = (uint32_t)h,
+        .topFieldFirst = keepTopField,
+        .method = (int32_t)method,
+        .motionThreshold = motionThreshold,
+        .padding1 = 0,
+        .padding2 = 0,
+        .padding3 = 0,
+    };
+
+    MTLSize tg = MTLSizeMake(16, 16, 1);
+    MTLSize grid = MTLSizeMake((w + 15) / 16, (h + 15) / 16, 1);
+
+    BOOL needsPrevFrame = (method == VF_METAL_DEINTERLACE_WEAVE ||
+                           method == VF_METAL_DEINTERLACE_GREEDYH);
+    BOOL lumaMotion = NO;
+
+    id<MTLComputePipelineState> pipeline;
+    if (needsPrevFrame && !previous) {
+        /* No previous frame yet — fall back to bob */
+        pipeline = _computeBob;
+        needsPrevFrame = NO;
+    } else if (method == VF_METAL_DEINTERLACE_LINEAR) {
+        pipeline = _computeLinear;
+    } else if (method == VF_METAL_DEINTERLACE_WEAVE) {
+        pipeline = _computeWeave;
+    } else if (method == VF_METAL_DEINTERLACE_GREEDYH && lumaCurrent) {
+        pipeline = _computeGreedyHChroma;
+        lumaMotion = YES;
+    } else if (method == VF_METAL_DEINTERLACE_GREEDYH) {
+        pipeline = _computeGreedyH;
+    } else {
+        pipeline = _computeBob;
+    }
+
+    id<MTLComputeCommandEncoder> compute =
+        [commandBuffer computeCommandEncoder];
+    [compute setComputePipelineState:pipeline];
+    [compute setTexture:current atIndex:0];
+    if (needsPrevFrame) {
+        [compute setTexture:previous atIndex:1];
+        [compute setTexture:output atIndex:2];
+    } else {
+        [compute setTexture:output atIndex:1];
+    }
+    if (lumaMotion) {
+        [compute setTexture:lumaCurrent atIndex:3];
+        [compute setTexture:lumaPrevious atIndex:4];
+    }
+    [compute setBytes:&uniforms length:sizeof(uniforms) atIndex:0];
+    [compute dispatchThreadgroups:grid threadsPerThreadgroup:tg];
+    [compute endEncoding];
+}
+
+/* Rebuild one output frame from every plane of @current */
+- (void)_encodeField:(const DeinterlaceParams *)params
+        keepTopField:(int)keepTopField
+             current:(NSArray<id<MTLTexture>> *)current
+            previous:(NSArray<id<MTLTexture>> *)previous
+             outputs:(NSArray<id<MTLTexture>> *)outputs
+       commandBuffer:(id<MTLCommandBuffer>)commandBuffer
+{
+    for (NSUInteger p = 0; p < outputs.count; p++) {
+        BOOL chroma = (p > 0 && previous);
+        [self _encodeMethod:params->method
+               keepTopField:keepTopField
+            motionThreshold:params->motionThreshold
+                    current:current[p]
+                   previous:previous[p]
+                lumaCurrent:chroma ? current[0] : nil
+               lumaPrevious:chroma ? previous[0] : nil
+                     output:outputs[p]
+              commandBuffer:commandBuffer];
+    }
+}
+
+/* Destination planes for @outFrame: the YUV output's own planes for
+ * NV12/I420, else @rgbaTarget which is then copied out */
+- (NSArray<id<MTLTexture>> *)_outputsForFrame:(GstVideoFrame *)outFrame
+                                   rgbaTarget:(id<MTLTexture>)rgbaTarget
+                                         slot:(NSUInteger)slot
+{
+    if (_nPlanes == 1)
+        return @[ rgbaTarget ];
+    return [_yuvOutput outputPlanesForFrame:outFrame slot:slot];
+}
+
+- (BOOL)_renderFrame:(GstVideoFrame *)inFrame
+              output:(GstVideoFrame *)outFrame
+              params:(const DeinterlaceParams *)params
+                slot:(NSUInteger)slot
+          completion:(VfMetalCompletionHandler)completion
 {
     @autoreleasepool {
         id<MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
@@ -303,85 +438,50 @@ typedef struct {
             return NO;
         }
 
-        /* Upload input to RGBA texture (GPU-side for YUV) */
-        [self _uploadInputToRGBA:inFrame commandBuffer:commandBuffer];
-
-        /* Build uniforms */
-        DeinterlaceUniformsGPU uniforms = {
-            .width = (uint32_t)_width,
-            .height = (uint32_t)_height,
-            .topFieldFirst = params->topFieldFirst,
-            .method = (int32_t)params->method,
-            .motionThreshold = params->motionThreshold,
-            .padding1 = 0,
-            .padding2 = 0,
-            .padding3 = 0,
-        };
-
-        MTLSize tg = MTLSizeMake(16, 16, 1);
-        MTLSize grid = MTLSizeMake(
-            (_width + 15) / 16, (_height + 15) / 16, 1);
-
-        /* Run deinterlace compute kernel */
-        BOOL needsPrevFrame = (params->method == VF_METAL_DEINTERLACE_WEAVE ||
-                               params->method == VF_METAL_DEINTERLACE_GREEDYH);
-
-        if (needsPrevFrame && !_hasPrevFrame) {
-            /* No previous frame yet — fall back to bob */
-            id<MTLComputeCommandEncoder> compute =
-                [commandBuffer computeCommandEncoder];
-            [compute setComputePipelineState:_computeBob];
-            [compute setTexture:_inputRGBA atIndex:0];
-            [compute setTexture:_outputRGBA atIndex:1];
-            [compute setBytes:&uniforms length:sizeof(uniforms) atIndex:0];
-            [compute dispatchThreadgroups:grid threadsPerThreadgroup:tg];
-            [compute endEncoding];
-        } else if (params->method == VF_METAL_DEINTERLACE_BOB) {
-            id<MTLComputeCommandEncoder> compute =
-                [commandBuffer computeCommandEncoder];
-            [compute setComputePipelineState:_computeBob];
-            [compute setTexture:_inputRGBA atIndex:0];
-            [compute setTexture:_outputRGBA atIndex:1];
-            [compute setBytes:&uniforms length:sizeof(uniforms) atIndex:0];
-            [compute dispatchThreadgroups:grid threadsPerThreadgroup:tg];
-            [compute endEncoding];
-        } else if (params->method == VF_METAL_DEINTERLACE_LINEAR) {
-            id<MTLComputeCommandEncoder> compute =
-                [commandBuffer computeCommandEncoder];
-            [compute setComputePipelineState:_computeLinear];
-            [compute setTexture:_inputRGBA atIndex:0];
-            [compute setTexture:_outputRGBA atIndex:1];
-            [compute setBytes:&uniforms length:sizeof(uniforms) atIndex:0];
-            [compute dispatchThreadgroups:grid threadsPerThreadgroup:tg];
-            [compute endEncoding];
-        } else if (params->method == VF_METAL_DEINTERLACE_WEAVE) {
-            id<MTLComputeCommandEncoder> compute =
-                [commandBuffer computeCommandEncoder];
-            [compute setComputePipelineState:_computeWeave];
-            [compute setTexture:_inputRGBA atIndex:0];
-            [compute setTexture:_prevFrameRGBA atIndex:1];
-            [compute setTexture:_outputRGBA atIndex:2];
-            [compute setBytes:&uniforms length:sizeof(uniforms) atIndex:0];
-            [compute dispatchThreadgroups:grid threadsPerThreadgroup:tg];
-            [compute endEncoding];
-        } else if (params->method == VF_METAL_DEINTERLACE_GREEDYH) {
-            id<MTLComputeCommandEncoder> compute =
-                [commandBuffer computeCommandEncoder];
-            [compute setComputePipelineState:_computeGreedyH];
-            [compute setTexture:_inputRGBA atIndex:0];
-            [compute setTexture:_prevFrameRGBA atIndex:1];
-            [compute setTexture:_outputRGBA atIndex:2];
-            [compute setBytes:&uniforms length:sizeof(uniforms) atIndex:0];
-            [compute dispatchThreadgroups:grid threadsPerThreadgroup:tg];
-            [compute endEncoding];
+        VfMetalTraceSpan encodeSpan;
+        vf_metal_trace_begin (&encodeSpan, _traceOwner, VF_METAL_STATS_ENCODE);
+
+        /* Upload input planes into the next history entry */
+        [self _advanceHistory];
+        if (![self _uploadInput:inFrame commandBuffer:commandBuffer
+                           slot:slot pipelined:(completion != nil)])
+            return NO;
+
+        NSArray<id<MTLTexture>> *outputs =
+            [self _outputsForFrame:outFrame rgbaTarget:_outputRGBA slot:slot];
+        if (!outputs) return NO;
+
+        /* Run deinterlace compute kernels, one pass per plane */
+        [self _encodeField:params
+              keepTopField:params->topFieldFirst
+                   current:[self _historyFrame:0]
+                  previous:[self _historyFrame:1]
+                   outputs:outputs
+             commandBuffer:commandBuffer];
+
+        /* BGRA/RGBA results still have to reach the frame's GPU memory */
+        if (_nPlanes == 1) {
+            [_yuvOutput dispatchConversion:commandBuffer
+                             sourceTexture:_outputRGBA
+                                     width:_width height:_height
+                                  outFrame:outFrame
+                                      slot:slot];
         }
 
-        /* Convert RGBA output to YUV if needed */
-        [_yuvOutput dispatchConversion:commandBuffer
-                         sourceTexture:_outputRGBA
-                                 width:_width height:_height
-                              outFrame:outFrame];
+        if (completion) {
+            vf_metal_trace_end (&encodeSpan);
+            vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
+            [_yuvOutput commitPipelined:commandBuffer
+                          sourceTexture:_outputRGBA
+                                  width:_width height:_height
+                               outFrame:outFrame
+                                   slot:slot
+                             completion:completion];
+            return YES;
+        }
 
+        vf_metal_trace_end (&encodeSpan);
+        vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
         [commandBuffer commit];
         [commandBuffer waitUntilCompleted];
 
@@ -391,19 +491,6 @@ typedef struct {
             return NO;
         }
 
-        /* Save current as previous for next frame */
-        id<MTLCommandBuffer> copyCmd = [_commandQueue commandBuffer];
-        if (!copyCmd) {
-            GST_ERROR ("Failed to create Metal command buffer for frame copy");
-            return NO;
-        }
-        id<MTLBlitCommandEncoder> blit = [copyCmd blitCommandEncoder];
-        [blit copyFromTexture:_inputRGBA toTexture:_prevFrameRGBA];
-        [blit endEncoding];
-        [copyCmd commit];
-        [copyCmd waitUntilCompleted];
-        _hasPrevFrame = YES;
-
         /* Read back */
         [_yuvOutput readbackToFrame:outFrame sourceTexture:_outputRGBA
                               width:_width height:_height];
@@ -412,14 +499,109 @@ typedef struct {
     }
 }
 
+- (BOOL)processFields:(GstVideoFrame *)inFrame
+          firstOutput:(GstVideoFrame *)firstFrame
+         secondOutput:(GstVideoFrame *)secondFrame
+               params:(const DeinterlaceParams *)params
+{
+    @autoreleasepool {
+        if (_nPlanes == 1 && !_outputSecondRGBA) {
+            _outputSecondRGBA = [_outputRGBA.device
+                newTextureWithDescriptor:[self _rgbaDescriptor]];
+            if (!_outputSecondRGBA) return NO;
+        }
+
+        id<MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
+        if (!commandBuffer) {
+            GST_ERROR ("Failed to create Metal command buffer");
+            return NO;
+        }
+
+        VfMetalTraceSpan encodeSpan;
+        vf_metal_trace_begin (&encodeSpan, _traceOwner, VF_METAL_STATS_ENCODE);
+
+        /* One upload feeds both fields */
+        [self _advanceHistory];
+        if (![self _uploadInput:inFrame commandBuffer:commandBuffer
+                           slot:0 pipelined:NO])
+            return NO;
+
+        /* Each field goes to its own output slot */
+        NSArray<id<MTLTexture>> *firstOutputs =
+            [self _outputsForFrame:firstFrame rgbaTarget:_outputRGBA slot:0];
+        NSArray<id<MTLTexture>> *secondOutputs =
+            [self _outputsForFrame:secondFrame rgbaTarget:_outputSecondRGBA
+                              slot:1];
+        if (!firstOutputs || !secondOutputs) return NO;
+
+        NSArray<id<MTLTexture>> *current = [self _historyFrame:0];
+        NSArray<id<MTLTexture>> *previous = [self _historyFrame:1];
+        int firstIsTop = params->topFieldFirst;
+
+        /* Earlier field: missing lines come from the previous frame */
+        [self _encodeField:params
+              keepTopField:firstIsTop
+                   current:current
+                  previous:previous
+                   outputs:firstOutputs
+             commandBuffer:commandBuffer];
+
+        /* Later field: its neighbour in time is the earlier field of the
+         * same frame, so weave straight from the current frame */
+        [self _encodeField:params
+              keepTopField:!firstIsTop
+                   current:current
+                  previous:(params->method == VF_METAL_DEINTERLACE_WEAVE)
+                               ? current : previous
+                   outputs:secondOutputs
+             commandBuffer:commandBuffer];
+
+        if (_nPlanes == 1) {
+            [_yuvOutput dispatchConversion:commandBuffer
+                             sourceTexture:_outputRGBA
+                                     width:_width height:_height
+                                  outFrame:firstFrame
+                                      slot:0];
+            [_yuvOutput dispatchConversion:commandBuffer
+                             sourceTexture:_outputSecondRGBA
+                                     width:_width height:_height
+                                  outFrame:secondFrame
+                                      slot:1];
+        }
+
+        vf_metal_trace_end (&encodeSpan);
+        vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
+        [commandBuffer commit];
+        [commandBuffer waitUntilCompleted];
+
+        if (commandBuffer.status == MTLCommandBufferStatusError) {
+            GST_ERROR ("Metal command buffer failed: %s",
+                       commandBuffer.error.localizedDescription.UTF8String);
+            return NO;
+        }
+
+        [_yuvOutput readbackToFrame:firstFrame sourceTexture:_outputRGBA
+                              width:_width height:_height slot:0];
+        [_yuvOutput readbackToFrame:secondFrame sourceTexture:_outputSecondRGBA
+                              width:_width height:_height slot:1];
+
+        return YES;
+    }
+}
+
 - (void)cleanup
 {
     [_textureCache clear];
-    _inputRGBA = nil;
+    for (int i = 0; i < VF_DEINTERLACE_HISTORY_DEPTH; i++) {
+        for (int p = 0; p < VF_DEINTERLACE_MAX_PLANES; p++)
+            _history[i][p] = nil;
+    }
+    _historyHead = 0;
+    _historyCount = 0;
+    _nPlanes = 0;
     _outputRGBA = nil;
-    _prevFrameRGBA = nil;
+    _outputSecondRGBA = nil;
     [_yuvOutput cleanup];
-    _hasPrevFrame = NO;
 }
 
 @end
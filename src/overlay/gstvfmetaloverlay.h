@@ -26,6 +26,9 @@
 #include <gst/video/video.h>
 #include <gst/video/gstvideofilter.h>
 
+#include "vfmetalcontext.h"
+#include "vfmetalinflight.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_VF_METAL_OVERLAY (gst_vf_metal_overlay_get_type())
@@ -45,9 +48,27 @@ struct _GstVfMetalOverlay
   gdouble alpha;
   gdouble relative_x;
   gdouble relative_y;
+  gdouble frame_rate;
+  gboolean loop;
+  gboolean in_place;
+  gchar *overlays;
+
+  /* Last "image" sample, uploaded again to a renderer created later */
+  GstSample *image;
 
   /* State */
   gboolean image_loaded;
+  guint n_images;               /* configured overlays that loaded */
+
+  /* Streaming thread only: composition meta of the frame being submitted */
+  GstVideoOverlayComposition *composition;
+
+  /* Pipelined submission: in-flight property, latched into inflight */
+  guint in_flight;
+  VfMetalInflight inflight;
+
+  /* GPU selection; the renderer is created on it at NULL_TO_READY */
+  VfMetalDeviceSelection device;
 
   /* Metal rendering engine */
   void *renderer;
@@ -27,6 +27,20 @@
  * image onto video frames on the GPU. When no overlay image is loaded,
  * operates in passthrough mode (zero-copy).
  *
+ * GIF, APNG and numbered image sequences play back by running time.
+ * Applications can instead set #GstVfMetalOverlay:image to RGBA/BGRA
+ * samples, which are copied into persistent textures.
+ *
+ * #GstVfMetalOverlay:overlays adds any number of further images, and a
+ * #GstVideoOverlayCompositionMeta from upstream (textoverlay, subtitle
+ * renderers) is blended too instead of each renderer drawing its own
+ * pass. All of them are drawn from one texture atlas in a single
+ * instanced draw; unchanged rectangles are never uploaded again.
+ *
+ * With #GstVfMetalOverlay:in-place the overlay is blended into the
+ * incoming buffer and only its rectangle is touched: one quad for
+ * BGRA/RGBA, a sub-rectangle per plane for NV12/I420.
+ *
  * ## Sample pipelines
  * |[
  * gst-launch-1.0 videotestsrc ! video/x-raw,format=BGRA,width=640,height=480 ! \
@@ -36,27 +50,47 @@
  * gst-launch-1.0 videotestsrc ! video/x-raw,format=NV12,width=1920,height=1080 ! \
  *   vfmetaloverlay location=/path/to/watermark.png relative-x=0.9 relative-y=0.05 ! autovideosink
  * ]|
+ * |[
+ * gst-launch-1.0 videotestsrc ! video/x-raw,format=BGRA,width=1280,height=720 ! \
+ *   vfmetaloverlay location=/path/to/clock_%03d.png frame-rate=1 ! autovideosink
+ * ]|
+ * |[
+ * gst-launch-1.0 videotestsrc ! textoverlay text="Live" ! \
+ *   vfmetaloverlay overlays="logo, location=/path/to/logo.png, x=10, y=10; \
+ *   bug, location=/path/to/bug.png, relative-x=0.9, relative-y=0.05" ! autovideosink
+ * ]|
  */
 
 #import <Foundation/Foundation.h>
 #include "gstvfmetaloverlay.h"
 #include "metaloverlayrenderer.h"
+#import "vfmetalmemory.h"
 
 GST_DEBUG_CATEGORY (gst_vf_metal_overlay_debug);
 #define GST_CAT_DEFAULT gst_vf_metal_overlay_debug
 
 #define VF_METAL_OVERLAY_FORMATS "{ BGRA, RGBA, NV12, I420 }"
 
+/* Upstream may leave overlay rectangles to us as a composition meta */
+#define VF_METAL_OVERLAY_META_CAPS                                          \
+    GST_VIDEO_CAPS_MAKE_WITH_FEATURES (GST_CAPS_FEATURE_MEMORY_VF_METAL ","  \
+        GST_CAPS_FEATURE_META_GST_VIDEO_OVERLAY_COMPOSITION,                \
+        VF_METAL_OVERLAY_FORMATS) "; "                                      \
+    GST_VIDEO_CAPS_MAKE_WITH_FEATURES (                                     \
+        GST_CAPS_FEATURE_META_GST_VIDEO_OVERLAY_COMPOSITION,                \
+        VF_METAL_OVERLAY_FORMATS)
+
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (VF_METAL_OVERLAY_FORMATS))
+    GST_STATIC_CAPS (VF_METAL_OVERLAY_META_CAPS "; "
+        VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_OVERLAY_FORMATS))
     );
 
 static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (VF_METAL_OVERLAY_FORMATS))
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_OVERLAY_FORMATS))
     );
 
 enum
@@ -70,6 +104,13 @@ enum
   PROP_ALPHA,
   PROP_RELATIVE_X,
   PROP_RELATIVE_Y,
+  PROP_IN_FLIGHT,
+  PROP_IMAGE,
+  PROP_FRAME_RATE,
+  PROP_LOOP,
+  PROP_IN_PLACE,
+  PROP_OVERLAYS,
+  PROP_DEVICE,
 };
 
 #define DEFAULT_X           0
@@ -78,6 +119,9 @@ enum
 #define DEFAULT_HEIGHT      0
 #define DEFAULT_ALPHA       1.0
 #define DEFAULT_RELATIVE    -1.0
+#define DEFAULT_FRAME_RATE  0.0
+#define DEFAULT_LOOP        TRUE
+#define DEFAULT_IN_PLACE    FALSE
 
 /* --- GType boilerplate --- */
 
@@ -93,7 +137,8 @@ GST_ELEMENT_REGISTER_DEFINE (vfmetaloverlay, "vfmetaloverlay",
 static void
 gst_vf_metal_overlay_update_passthrough (GstVfMetalOverlay * self)
 {
-  gboolean passthrough = !self->image_loaded;
+  gboolean passthrough = !self->image_loaded && self->n_images == 0 &&
+      !self->composition;
 
   gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (self), passthrough);
   GST_DEBUG_OBJECT (self, "passthrough = %s", passthrough ? "TRUE" : "FALSE");
@@ -129,6 +174,155 @@ gst_vf_metal_overlay_load_image (GstVfMetalOverlay * self)
   gst_vf_metal_overlay_update_passthrough (self);
 }
 
+/* Copy an application-supplied RGBA/BGRA sample into the renderer;
+ * NULL clears it */
+static void
+gst_vf_metal_overlay_push_image (GstVfMetalOverlay * self, GstSample * sample)
+{
+  GstVideoInfo info;
+  GstVideoFrame frame;
+  GstCaps *caps;
+  GstBuffer *buffer;
+
+  if (!self->renderer)
+    return;
+
+  MetalOverlayRenderer *renderer =
+      (__bridge MetalOverlayRenderer *)self->renderer;
+
+  if (!sample) {
+    @autoreleasepool {
+      [renderer clearImage];
+    }
+    self->image_loaded = FALSE;
+    gst_vf_metal_overlay_update_passthrough (self);
+    return;
+  }
+
+  caps = gst_sample_get_caps (sample);
+  buffer = gst_sample_get_buffer (sample);
+  if (!caps || !buffer || !gst_video_info_from_caps (&info, caps) ||
+      (GST_VIDEO_INFO_FORMAT (&info) != GST_VIDEO_FORMAT_RGBA &&
+          GST_VIDEO_INFO_FORMAT (&info) != GST_VIDEO_FORMAT_BGRA)) {
+    GST_WARNING_OBJECT (self, "Overlay image must be an RGBA or BGRA "
+        "video/x-raw sample, got %" GST_PTR_FORMAT, caps);
+    return;
+  }
+
+  if (!gst_video_frame_map (&frame, &info, buffer, GST_MAP_READ)) {
+    GST_WARNING_OBJECT (self, "Failed to map overlay image");
+    return;
+  }
+
+  @autoreleasepool {
+    if ([renderer pushImage:GST_VIDEO_FRAME_PLANE_DATA (&frame, 0)
+                      width:GST_VIDEO_FRAME_WIDTH (&frame)
+                     height:GST_VIDEO_FRAME_HEIGHT (&frame)
+                     stride:GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0)
+                     format:GST_VIDEO_FRAME_FORMAT (&frame)]) {
+      self->image_loaded = TRUE;
+    } else {
+      GST_WARNING_OBJECT (self, "Failed to upload overlay image");
+    }
+  }
+
+  gst_video_frame_unmap (&frame);
+  gst_vf_metal_overlay_update_passthrough (self);
+}
+
+/* Read a numeric field that may have been written as an int or a double */
+static gboolean
+gst_vf_metal_overlay_structure_get_number (const GstStructure * st,
+    const gchar * field, gdouble * value)
+{
+  const GValue *v = gst_structure_get_value (st, field);
+
+  if (v && G_VALUE_HOLDS_INT (v)) {
+    *value = g_value_get_int (v);
+    return TRUE;
+  }
+  if (v && G_VALUE_HOLDS_DOUBLE (v)) {
+    *value = g_value_get_double (v);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+/* Parse #GstVfMetalOverlay:overlays — ';'-separated structures, each
+ * with a location and the main overlay's placement fields — and hand
+ * the images to the renderer */
+static void
+gst_vf_metal_overlay_load_overlays (GstVfMetalOverlay * self)
+{
+  GArray *specs;
+  GPtrArray *structures;
+  const gchar *p = self->overlays;
+
+  if (!self->renderer)
+    return;
+
+  specs = g_array_new (FALSE, TRUE, sizeof (OverlayImageSpec));
+  structures = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gst_structure_free);
+
+  while (p && *p) {
+    GstStructure *st;
+    gchar *end = NULL;
+    gdouble number;
+
+    while (*p == ';' || g_ascii_isspace (*p))
+      p++;
+    if (*p == '\0')
+      break;
+
+    st = gst_structure_from_string (p, &end);
+    if (!st) {
+      GST_WARNING_OBJECT (self, "Invalid overlay description: %s", p);
+      break;
+    }
+    g_ptr_array_add (structures, st);
+    p = end;
+
+    OverlayImageSpec spec = {
+      .location = gst_structure_get_string (st, "location"),
+      .alpha = DEFAULT_ALPHA,
+      .relativeX = DEFAULT_RELATIVE,
+      .relativeY = DEFAULT_RELATIVE,
+    };
+    if (!spec.location) {
+      GST_WARNING_OBJECT (self, "Overlay %s has no location",
+          gst_structure_get_name (st));
+      continue;
+    }
+    gst_structure_get_int (st, "x", &spec.x);
+    gst_structure_get_int (st, "y", &spec.y);
+    gst_structure_get_int (st, "width", &spec.width);
+    gst_structure_get_int (st, "height", &spec.height);
+    if (gst_vf_metal_overlay_structure_get_number (st, "alpha", &number))
+      spec.alpha = CLAMP (number, 0.0, 1.0);
+    if (gst_vf_metal_overlay_structure_get_number (st, "relative-x", &number))
+      spec.relativeX = number;
+    if (gst_vf_metal_overlay_structure_get_number (st, "relative-y", &number))
+      spec.relativeY = number;
+
+    g_array_append_val (specs, spec);
+  }
+
+  @autoreleasepool {
+    MetalOverlayRenderer *renderer =
+        (__bridge MetalOverlayRenderer *)self->renderer;
+    self->n_images = [renderer setImages:(OverlayImageSpec *) specs->data
+                                   count:specs->len];
+  }
+  GST_INFO_OBJECT (self, "Loaded %u of %u configured overlays",
+      self->n_images, specs->len);
+
+  g_ptr_array_unref (structures);
+  g_array_unref (specs);
+
+  gst_vf_metal_overlay_update_passthrough (self);
+}
+
 /* --- set_info --- */
 
 static gboolean
@@ -155,31 +349,115 @@ gst_vf_metal_overlay_set_info (GstVideoFilter * filter,
   return TRUE;
 }
 
-/* --- transform_frame --- */
+/* --- Caps --- */
 
-static GstFlowReturn
-gst_vf_metal_overlay_transform_frame (GstVideoFilter * filter,
-    GstVideoFrame * inframe, GstVideoFrame * outframe)
+/* The composition feature only exists on the sink side: rectangles are
+ * blended here and never passed on */
+static GstCaps *
+gst_vf_metal_overlay_transform_caps (GstBaseTransform * trans,
+    GstPadDirection direction, GstCaps * caps, GstCaps * filter)
 {
-  GstVfMetalOverlay *self = GST_VF_METAL_OVERLAY (filter);
+  GstCaps *result = gst_caps_new_empty ();
+  guint i, n = gst_caps_get_size (caps);
+
+  for (i = 0; i < n; i++) {
+    GstStructure *s = gst_caps_get_structure (caps, i);
+    GstCapsFeatures *f = gst_caps_get_features (caps, i);
+    GstCapsFeatures *plain = gst_caps_features_copy (f);
+
+    gst_caps_features_remove (plain,
+        GST_CAPS_FEATURE_META_GST_VIDEO_OVERLAY_COMPOSITION);
+
+    if (direction == GST_PAD_SRC && !gst_caps_features_is_any (f)) {
+      GstCapsFeatures *meta = gst_caps_features_copy (plain);
+      gst_caps_features_add (meta,
+          GST_CAPS_FEATURE_META_GST_VIDEO_OVERLAY_COMPOSITION);
+      result = gst_caps_merge_structure_full (result,
+          gst_structure_copy (s), meta);
+    }
+    result = gst_caps_merge_structure_full (result, gst_structure_copy (s),
+        plain);
+  }
 
-  if (!self->renderer) {
-    GST_WARNING_OBJECT (self, "No Metal renderer");
-    return GST_FLOW_ERROR;
+  if (filter) {
+    GstCaps *intersection =
+        gst_caps_intersect_full (filter, result, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (result);
+    result = intersection;
   }
 
-  MetalOverlayRenderer *renderer =
-      (__bridge MetalOverlayRenderer *)self->renderer;
+  return result;
+}
+
+/* --- Allocation --- */
+
+static gboolean
+gst_vf_metal_overlay_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  GstVfMetalOverlay *self = GST_VF_METAL_OVERLAY (trans);
+  gboolean ret;
+
+  ret = vf_metal_propose_allocation (trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class),
+      ((__bridge MetalOverlayRenderer *)self->renderer).metalDevice,
+      decide_query, query);
+
+  /* Let textoverlay and friends attach rectangles instead of blending */
+  if (ret)
+    gst_query_add_allocation_meta (query,
+        GST_VIDEO_OVERLAY_COMPOSITION_META_API_TYPE, NULL);
+
+  return ret;
+}
+
+static gboolean
+gst_vf_metal_overlay_decide_allocation (GstBaseTransform * trans,
+    GstQuery * query)
+{
+  GstVfMetalOverlay *self = GST_VF_METAL_OVERLAY (trans);
+
+  return vf_metal_decide_allocation (trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class),
+      ((__bridge MetalOverlayRenderer *)self->renderer).metalDevice,
+      &self->inflight, query);
+}
+
+/* Blended here, so never copied onto the output */
+static gboolean
+gst_vf_metal_overlay_transform_meta (GstBaseTransform * trans,
+    GstBuffer * outbuf, GstMeta * meta, GstBuffer * inbuf)
+{
+  if (meta->info->api == GST_VIDEO_OVERLAY_COMPOSITION_META_API_TYPE)
+    return FALSE;
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->transform_meta (trans,
+      outbuf, meta, inbuf);
+}
+
+/* --- transform_frame --- */
 
+/* Snapshot properties under lock */
+static void
+gst_vf_metal_overlay_snapshot_params (GstVfMetalOverlay * self,
+    GstVideoFrame * inframe, OverlayParams * params)
+{
   int frameW = GST_VIDEO_FRAME_WIDTH (inframe);
   int frameH = GST_VIDEO_FRAME_HEIGHT (inframe);
 
-  /* Snapshot properties under lock */
-  OverlayParams params;
+  GstSegment *segment = &GST_BASE_TRANSFORM (self)->segment;
+
+  params->runningTime = (segment->format == GST_FORMAT_TIME)
+      ? gst_segment_to_running_time (segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (inframe->buffer)) : GST_CLOCK_TIME_NONE;
+
   GST_OBJECT_LOCK (self);
-  params.alpha = self->alpha;
-  params.width = (float)self->width;
-  params.height = (float)self->height;
+  params->alpha = self->alpha;
+  params->width = (float)self->width;
+  params->height = (float)self->height;
+  params->frameRate = self->frame_rate;
+  params->loop = self->loop;
+  params->composition = self->composition;
   gdouble rel_x = self->relative_x;
   gdouble rel_y = self->relative_y;
   int abs_x = self->x;
@@ -188,16 +466,34 @@ gst_vf_metal_overlay_transform_frame (GstVideoFilter * filter,
 
   /* Resolve position: relative overrides absolute */
   if (rel_x >= 0.0) {
-    params.x = (float)(rel_x * frameW);
+    params->x = (float)(rel_x * frameW);
   } else {
-    params.x = (float)abs_x;
+    params->x = (float)abs_x;
   }
 
   if (rel_y >= 0.0) {
-    params.y = (float)(rel_y * frameH);
+    params->y = (float)(rel_y * frameH);
   } else {
-    params.y = (float)abs_y;
+    params->y = (float)abs_y;
   }
+}
+
+static GstFlowReturn
+gst_vf_metal_overlay_transform_frame (GstVideoFilter * filter,
+    GstVideoFrame * inframe, GstVideoFrame * outframe)
+{
+  GstVfMetalOverlay *self = GST_VF_METAL_OVERLAY (filter);
+  OverlayParams params;
+
+  if (!self->renderer) {
+    GST_WARNING_OBJECT (self, "No Metal renderer");
+    return GST_FLOW_ERROR;
+  }
+
+  MetalOverlayRenderer *renderer =
+      (__bridge MetalOverlayRenderer *)self->renderer;
+
+  gst_vf_metal_overlay_snapshot_params (self, inframe, &params);
 
   @autoreleasepool {
     if (![renderer processFrame:inframe output:outframe params:&params]) {
@@ -209,6 +505,147 @@ gst_vf_metal_overlay_transform_frame (GstVideoFilter * filter,
   return GST_FLOW_OK;
 }
 
+static GstFlowReturn
+gst_vf_metal_overlay_transform_frame_ip (GstVideoFilter * filter,
+    GstVideoFrame * frame)
+{
+  GstVfMetalOverlay *self = GST_VF_METAL_OVERLAY (filter);
+  OverlayParams params;
+
+  if (!self->renderer) {
+    GST_WARNING_OBJECT (self, "No Metal renderer");
+    return GST_FLOW_ERROR;
+  }
+
+  MetalOverlayRenderer *renderer =
+      (__bridge MetalOverlayRenderer *)self->renderer;
+
+  gst_vf_metal_overlay_snapshot_params (self, frame, &params);
+
+  @autoreleasepool {
+    if (![renderer blendInPlace:frame params:&params slot:0
+                     completion:nil]) {
+      GST_WARNING_OBJECT (self, "Metal rendering failed");
+      return GST_FLOW_ERROR;
+    }
+  }
+
+  return GST_FLOW_OK;
+}
+
+/* --- Pipelined submission (in-flight > 1) --- */
+
+static gboolean
+gst_vf_metal_overlay_submit (GstBaseTransform * trans,
+    VfMetalInflightJob * job, VfMetalCompletionHandler completion)
+{
+  GstVfMetalOverlay *self = GST_VF_METAL_OVERLAY (trans);
+  OverlayParams params;
+
+  if (!self->renderer)
+    return FALSE;
+
+  MetalOverlayRenderer *renderer =
+      (__bridge MetalOverlayRenderer *)self->renderer;
+
+  if (gst_base_transform_is_in_place (trans)) {
+    gst_vf_metal_overlay_snapshot_params (self, &job->out_frame, &params);
+
+    @autoreleasepool {
+      return [renderer blendInPlace:&job->out_frame params:&params
+                               slot:job->slot completion:completion];
+    }
+  }
+
+  gst_vf_metal_overlay_snapshot_params (self, &job->in_frame, &params);
+
+  @autoreleasepool {
+    return [renderer submitFrame:&job->in_frame output:&job->out_frame
+                          params:&params slot:job->slot
+                      completion:completion];
+  }
+}
+
+/* Take the composition off the next input buffer: it decides whether
+ * this frame needs rendering at all, and in place it must not stay on
+ * the buffer that is pushed on */
+static void
+gst_vf_metal_overlay_take_composition (GstVfMetalOverlay * self,
+    GstBaseTransform * trans)
+{
+  GstVideoOverlayCompositionMeta *meta;
+  gboolean had_composition = self->composition != NULL;
+
+  if (!trans->queued_buf)
+    return;
+
+  gst_clear_mini_object ((GstMiniObject **) & self->composition);
+
+  meta = gst_buffer_get_video_overlay_composition_meta (trans->queued_buf);
+  if (meta) {
+    self->composition = gst_video_overlay_composition_ref (meta->overlay);
+
+    if (gst_base_transform_is_in_place (trans)) {
+      trans->queued_buf = gst_buffer_make_writable (trans->queued_buf);
+      meta = gst_buffer_get_video_overlay_composition_meta (trans->queued_buf);
+      gst_buffer_remove_video_overlay_composition_meta (trans->queued_buf,
+          meta);
+    }
+  }
+
+  if (had_composition != (self->composition != NULL))
+    gst_vf_metal_overlay_update_passthrough (self);
+}
+
+static GstFlowReturn
+gst_vf_metal_overlay_generate_output (GstBaseTransform * trans,
+    GstBuffer ** outbuf)
+{
+  GstVfMetalOverlay *self = GST_VF_METAL_OVERLAY (trans);
+  GstVideoFilter *filter = GST_VIDEO_FILTER (trans);
+
+  gst_vf_metal_overlay_take_composition (self, trans);
+
+  return vf_metal_inflight_generate_output (&self->inflight, trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class), &filter->in_info,
+      &filter->out_info, gst_vf_metal_overlay_submit, outbuf);
+}
+
+static gboolean
+gst_vf_metal_overlay_sink_event (GstBaseTransform * trans,
+    GstEvent * event)
+{
+  GstVfMetalOverlay *self = GST_VF_METAL_OVERLAY (trans);
+
+  vf_metal_inflight_sink_event (&self->inflight, trans, event);
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event);
+}
+
+static gboolean
+gst_vf_metal_overlay_query (GstBaseTransform * trans,
+    GstPadDirection direction, GstQuery * query)
+{
+  GstVfMetalOverlay *self = GST_VF_METAL_OVERLAY (trans);
+  GstVideoInfo *info = &GST_VIDEO_FILTER (trans)->out_info;
+
+  if (vf_metal_device_selection_handle_query (GST_ELEMENT (trans),
+          &self->device, query))
+    return TRUE;
+
+  if (!GST_BASE_TRANSFORM_CLASS (parent_class)->query (trans, direction,
+          query))
+    return FALSE;
+
+  if (direction == GST_PAD_SRC && GST_QUERY_TYPE (query) == GST_QUERY_LATENCY
+      && !gst_base_transform_is_passthrough (trans)) {
+    vf_metal_inflight_add_latency (&self->inflight, query,
+        GST_VIDEO_INFO_FPS_N (info), GST_VIDEO_INFO_FPS_D (info));
+  }
+
+  return TRUE;
+}
+
 /* --- Properties --- */
 
 static void
@@ -217,11 +654,19 @@ gst_vf_metal_overlay_set_property (GObject * object, guint prop_id,
 {
   GstVfMetalOverlay *self = GST_VF_METAL_OVERLAY (object);
 
+  /* Takes the object lock itself */
+  if (prop_id == PROP_DEVICE) {
+    vf_metal_device_selection_set_property (GST_ELEMENT (self),
+        &self->device, value);
+    return;
+  }
+
   GST_OBJECT_LOCK (self);
   switch (prop_id) {
     case PROP_LOCATION:
       g_free (self->location);
       self->location = g_value_dup_string (value);
+      gst_clear_mini_object ((GstMiniObject **) & self->image);
       break;
     case PROP_X:
       self->x = g_value_get_int (value);
@@ -244,6 +689,27 @@ gst_vf_metal_overlay_set_property (GObject * object, guint prop_id,
     case PROP_RELATIVE_Y:
       self->relative_y = g_value_get_double (value);
       break;
+    case PROP_IN_FLIGHT:
+      self->in_flight = g_value_get_uint (value);
+      break;
+    case PROP_IMAGE:
+      /* Uploaded below, outside the lock */
+      gst_mini_object_replace ((GstMiniObject **) & self->image,
+          g_value_get_boxed (value));
+      break;
+    case PROP_FRAME_RATE:
+      self->frame_rate = g_value_get_double (value);
+      break;
+    case PROP_LOOP:
+      self->loop = g_value_get_boolean (value);
+      break;
+    case PROP_IN_PLACE:
+      self->in_place = g_value_get_boolean (value);
+      break;
+    case PROP_OVERLAYS:
+      g_free (self->overlays);
+      self->overlays = g_value_dup_string (value);
+      break;
     default:
       GST_OBJECT_UNLOCK (self);
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -254,6 +720,13 @@ gst_vf_metal_overlay_set_property (GObject * object, guint prop_id,
   /* Image loading outside lock (involves Metal GPU operations) */
   if (prop_id == PROP_LOCATION) {
     gst_vf_metal_overlay_load_image (self);
+  } else if (prop_id == PROP_IMAGE) {
+    gst_vf_metal_overlay_push_image (self, g_value_get_boxed (value));
+  } else if (prop_id == PROP_OVERLAYS) {
+    gst_vf_metal_overlay_load_overlays (self);
+  } else if (prop_id == PROP_IN_PLACE) {
+    gst_base_transform_set_in_place (GST_BASE_TRANSFORM (self),
+        g_value_get_boolean (value));
   }
 }
 
@@ -263,6 +736,12 @@ gst_vf_metal_overlay_get_property (GObject * object, guint prop_id,
 {
   GstVfMetalOverlay *self = GST_VF_METAL_OVERLAY (object);
 
+  if (prop_id == PROP_DEVICE) {
+    vf_metal_device_selection_get_property (GST_ELEMENT (self),
+        &self->device, value);
+    return;
+  }
+
   GST_OBJECT_LOCK (self);
   switch (prop_id) {
     case PROP_LOCATION:
@@ -289,6 +768,21 @@ gst_vf_metal_overlay_get_property (GObject * object, guint prop_id,
     case PROP_RELATIVE_Y:
       g_value_set_double (value, self->relative_y);
       break;
+    case PROP_IN_FLIGHT:
+      g_value_set_uint (value, self->in_flight);
+      break;
+    case PROP_FRAME_RATE:
+      g_value_set_double (value, self->frame_rate);
+      break;
+    case PROP_LOOP:
+      g_value_set_boolean (value, self->loop);
+      break;
+    case PROP_IN_PLACE:
+      g_value_set_boolean (value, self->in_place);
+      break;
+    case PROP_OVERLAYS:
+      g_value_set_string (value, self->overlays);
+      break;
     default:
       GST_OBJECT_UNLOCK (self);
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -297,6 +791,63 @@ gst_vf_metal_overlay_get_property (GObject * object, guint prop_id,
   GST_OBJECT_UNLOCK (self);
 }
 
+/* --- Device --- */
+
+static void
+gst_vf_metal_overlay_set_context (GstElement * element, GstContext * context)
+{
+  GstVfMetalOverlay *self = GST_VF_METAL_OVERLAY (element);
+
+  vf_metal_device_selection_set_context (element, &self->device, context);
+
+  GST_ELEMENT_CLASS (parent_class)->set_context (element, context);
+}
+
+/* Renderer on the selected GPU, replaced when the selection moved. A new
+ * renderer gets the images set before it existed. */
+static gboolean
+gst_vf_metal_overlay_ensure_renderer (GstVfMetalOverlay * self)
+{
+  VfMetalDevice *device;
+
+  device = vf_metal_device_selection_ensure (GST_ELEMENT (self),
+      &self->device);
+  if (!device)
+    return FALSE;
+
+  @autoreleasepool {
+    if (self->renderer) {
+      MetalOverlayRenderer *renderer =
+          (__bridge MetalOverlayRenderer *)self->renderer;
+      if (renderer.metalDevice == device)
+        return TRUE;
+
+      renderer = (__bridge_transfer MetalOverlayRenderer *)self->renderer;
+      self->renderer = NULL;
+      [renderer cleanup];
+    }
+
+    MetalOverlayRenderer *renderer =
+        [[MetalOverlayRenderer alloc] initWithDevice:device];
+    if (!renderer) {
+      GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+          ("Failed to create Metal renderer on '%s'",
+              device.device.name.UTF8String), (NULL));
+      return FALSE;
+    }
+    renderer.traceOwner = GST_OBJECT (self);
+    self->renderer = (__bridge_retained void *)renderer;
+  }
+
+  if (self->image)
+    gst_vf_metal_overlay_push_image (self, self->image);
+  else
+    gst_vf_metal_overlay_load_image (self);
+  gst_vf_metal_overlay_load_overlays (self);
+
+  return TRUE;
+}
+
 /* --- State change --- */
 
 static GstStateChangeReturn
@@ -305,11 +856,24 @@ gst_vf_metal_overlay_change_state (GstElement * element,
 {
   GstVfMetalOverlay *self = GST_VF_METAL_OVERLAY (element);
   GstStateChangeReturn ret;
+  guint in_flight;
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY &&
+      !gst_vf_metal_overlay_ensure_renderer (self))
+    return GST_STATE_CHANGE_FAILURE;
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+    GST_OBJECT_LOCK (self);
+    in_flight = self->in_flight;
+    GST_OBJECT_UNLOCK (self);
+    vf_metal_inflight_start (&self->inflight, in_flight);
+  }
 
   ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
 
   switch (transition) {
     case GST_STATE_CHANGE_PAUSED_TO_READY:
+      vf_metal_inflight_stop (&self->inflight);
+      gst_clear_mini_object ((GstMiniObject **) & self->composition);
       if (self->renderer) {
         @autoreleasepool {
           MetalOverlayRenderer *renderer =
@@ -318,6 +882,9 @@ gst_vf_metal_overlay_change_state (GstElement * element,
         }
       }
       break;
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      vf_metal_device_selection_reset (element, &self->device);
+      break;
     default:
       break;
   }
@@ -334,6 +901,10 @@ gst_vf_metal_overlay_finalize (GObject * object)
 
   g_free (self->location);
   self->location = NULL;
+  g_free (self->overlays);
+  self->overlays = NULL;
+  gst_clear_mini_object ((GstMiniObject **) & self->composition);
+  gst_clear_mini_object ((GstMiniObject **) & self->image);
 
   if (self->renderer) {
     @autoreleasepool {
@@ -345,6 +916,9 @@ gst_vf_metal_overlay_finalize (GObject * object)
     }
   }
 
+  vf_metal_inflight_clear (&self->inflight);
+  vf_metal_device_selection_clear (&self->device);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -355,6 +929,7 @@ gst_vf_metal_overlay_class_init (GstVfMetalOverlayClass * klass)
 {
   GObjectClass *gobject_class = (GObjectClass *) klass;
   GstElementClass *gstelement_class = (GstElementClass *) klass;
+  GstBaseTransformClass *basetransform_class = (GstBaseTransformClass *) klass;
   GstVideoFilterClass *gstvideofilter_class = (GstVideoFilterClass *) klass;
 
   gobject_class->set_property = gst_vf_metal_overlay_set_property;
@@ -363,17 +938,36 @@ gst_vf_metal_overlay_class_init (GstVfMetalOverlayClass * klass)
 
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_vf_metal_overlay_change_state);
+  gstelement_class->set_context =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_overlay_set_context);
 
   gstvideofilter_class->set_info =
       GST_DEBUG_FUNCPTR (gst_vf_metal_overlay_set_info);
   gstvideofilter_class->transform_frame =
       GST_DEBUG_FUNCPTR (gst_vf_metal_overlay_transform_frame);
+  gstvideofilter_class->transform_frame_ip =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_overlay_transform_frame_ip);
+  basetransform_class->transform_caps =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_overlay_transform_caps);
+  basetransform_class->transform_meta =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_overlay_transform_meta);
+  basetransform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_overlay_propose_allocation);
+  basetransform_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_overlay_decide_allocation);
+  basetransform_class->generate_output =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_overlay_generate_output);
+  basetransform_class->sink_event =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_overlay_sink_event);
+  basetransform_class->query =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_overlay_query);
 
   /* --- Install properties --- */
 
   g_object_class_install_property (gobject_class, PROP_LOCATION,
       g_param_spec_string ("location", "Location",
-          "Path to overlay image file (PNG or JPEG)",
+          "Path to overlay image file (PNG, JPEG, animated GIF/APNG, or a "
+          "printf-style pattern such as clock_%03d.png for a sequence)",
           NULL,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
@@ -419,6 +1013,76 @@ gst_vf_metal_overlay_class_init (GstVfMetalOverlayClass * klass)
           -1.0, 1.0, DEFAULT_RELATIVE,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_IN_FLIGHT,
+      g_param_spec_uint ("in-flight", "In-flight frames",
+          "Frames queued on the GPU before the oldest is pushed downstream "
+          "(1 = wait for every frame; each extra frame adds one frame of "
+          "latency)",
+          1, VF_METAL_MAX_IN_FLIGHT, VF_METAL_DEFAULT_IN_FLIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  /**
+   * GstVfMetalOverlay:image:
+   *
+   * An RGBA or BGRA sample (straight alpha) to overlay instead of
+   * #GstVfMetalOverlay:location. Each set is copied into one of two
+   * persistent textures and shown from the next frame; textures are only
+   * reallocated when the size changes. Setting NULL clears the overlay.
+   */
+  g_object_class_install_property (gobject_class, PROP_IMAGE,
+      g_param_spec_boxed ("image", "Image",
+          "RGBA/BGRA sample to overlay instead of location (NULL clears)",
+          GST_TYPE_SAMPLE,
+          G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FRAME_RATE,
+      g_param_spec_double ("frame-rate", "Frame rate",
+          "Playback rate of animated overlays in frames per second "
+          "(0 = GIF/APNG frame delays, 25 for image sequences)",
+          0.0, 1000.0, DEFAULT_FRAME_RATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LOOP,
+      g_param_spec_boolean ("loop", "Loop",
+          "Restart animated overlays after the last frame (else hold it)",
+          DEFAULT_LOOP,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstVfMetalOverlay:overlays:
+   *
+   * Further images drawn on top of #GstVfMetalOverlay:location, as
+   * ';'-separated structures with the same placement fields:
+   * "logo, location=a.png, x=10, y=10; bug, location=b.png,
+   * relative-x=0.9, alpha=0.5". They share a texture atlas with the
+   * buffer's composition rectangles and are drawn in one pass.
+   */
+  g_object_class_install_property (gobject_class, PROP_OVERLAYS,
+      g_param_spec_string ("overlays", "Overlays",
+          "Further images as ';'-separated structures "
+          "(name, location=, x=, y=, width=, height=, alpha=, relative-x=, "
+          "relative-y=)",
+          NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstVfMetalOverlay:in-place:
+   *
+   * Blend into the incoming buffer instead of rendering a new frame. Only
+   * the overlay rectangle is drawn (and, for system memory, uploaded and
+   * read back), so the cost scales with the logo rather than the frame.
+   */
+  g_object_class_install_property (gobject_class, PROP_IN_PLACE,
+      g_param_spec_boolean ("in-place", "In place",
+          "Blend only the overlay rectangle into the incoming buffer",
+          DEFAULT_IN_PLACE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_DEVICE,
+      vf_metal_device_selection_param_spec ());
+
   /* Pad templates */
   gst_element_class_add_static_pad_template (gstelement_class, &sink_template);
   gst_element_class_add_static_pad_template (gstelement_class, &src_template);
@@ -446,17 +1110,20 @@ gst_vf_metal_overlay_init (GstVfMetalOverlay * self)
   self->alpha = DEFAULT_ALPHA;
   self->relative_x = DEFAULT_RELATIVE;
   self->relative_y = DEFAULT_RELATIVE;
+  self->frame_rate = DEFAULT_FRAME_RATE;
+  self->loop = DEFAULT_LOOP;
+  self->in_place = DEFAULT_IN_PLACE;
+  self->overlays = NULL;
+  self->image = NULL;
+  self->n_images = 0;
+  self->composition = NULL;
   self->image_loaded = FALSE;
 
-  @autoreleasepool {
-    MetalOverlayRenderer *renderer =
-        [[MetalOverlayRenderer alloc] init];
-    if (renderer) {
-      self->renderer = (__bridge_retained void *)renderer;
-    } else {
-      GST_ERROR_OBJECT (self, "Failed to create Metal renderer");
-    }
-  }
+  self->in_flight = VF_METAL_DEFAULT_IN_FLIGHT;
+  vf_metal_inflight_init (&self->inflight);
+
+  /* The renderer waits for NULL_TO_READY, when the GPU is known */
+  vf_metal_device_selection_init (&self->device);
 
   gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (self), TRUE);
 }
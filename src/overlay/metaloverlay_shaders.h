@@ -24,6 +24,15 @@
 
 #import <Foundation/Foundation.h>
 
+/* overlayRectFragment plane selectors, matching OVERLAY_PLANE_* */
+typedef enum {
+    VF_METAL_OVERLAY_PLANE_RGB = 0,
+    VF_METAL_OVERLAY_PLANE_Y,
+    VF_METAL_OVERLAY_PLANE_CBCR,
+    VF_METAL_OVERLAY_PLANE_CB,
+    VF_METAL_OVERLAY_PLANE_CR,
+} VfMetalOverlayPlane;
+
 static NSString *const kOverlayShaderSource = @R"(
 
 // --- Overlay uniforms ---
@@ -36,7 +45,7 @@ struct OverlayUniforms {
     float frameWidth;      // frame dimensions
     float frameHeight;
     float alpha;           // overlay opacity [0, 1]
-    int colorMatrix;       // 0=BT.601, 1=BT.709
+    int colorMatrix;       // colour word, VF_COLOR_*
 };
 
 // --- Pass-through vertex shader ---
@@ -146,6 +155,141 @@ fragment float4 overlayFragmentI420(
     return video;
 }
 
+// --- In-place: blend only the overlay rectangle into one plane ---
+//
+// Draws a quad over the clipped overlay rectangle of a frame plane (or a
+// staging copy of just that rectangle) with source-over blending. YUV
+// planes get the overlay converted to the frame's matrix; the blend is
+// linear, so this matches blending in RGB.
+
+struct OverlayRectUniforms {
+    float4 rect;           // quad to draw, target pixels (x, y, w, h)
+    float4 overlayRect;    // overlay placement, target pixels
+    float2 targetSize;     // target plane texture size
+    float alpha;           // overlay opacity [0, 1]
+    int plane;             // OVERLAY_PLANE_*
+    int colorMatrix;       // colour word, VF_COLOR_*
+};
+
+constant int OVERLAY_PLANE_RGB  = 0;
+constant int OVERLAY_PLANE_Y    = 1;
+constant int OVERLAY_PLANE_CBCR = 2;
+constant int OVERLAY_PLANE_CB   = 3;
+
+struct OverlayRectOut {
+    float4 position [[position]];
+    float2 overlayUV;
+};
+
+vertex OverlayRectOut overlayRectVertex(
+    uint vid [[vertex_id]],
+    constant OverlayRectUniforms &u [[buffer(0)]]
+) {
+    float2 corner = float2(float(vid & 1), float(vid >> 1));
+    float2 px = u.rect.xy + corner * u.rect.zw;
+
+    OverlayRectOut out;
+    out.position = float4(px.x / u.targetSize.x * 2.0 - 1.0,
+                          1.0 - px.y / u.targetSize.y * 2.0, 0.0, 1.0);
+    out.overlayUV = (px - u.overlayRect.xy) / u.overlayRect.zw;
+    return out;
+}
+
+// Overlay colour for one plane of the frame, blended with alpha @a
+static inline float4 overlayPlaneColor(float3 rgb, float a, int plane,
+                                      int colorMatrix)
+{
+    if (plane == OVERLAY_PLANE_RGB)
+        return float4(rgb, a);
+
+    float3 yuv = rgbToYUV(rgb, colorMatrix);
+
+    if (plane == OVERLAY_PLANE_Y)
+        return float4(yuv.x, 0.0, 0.0, a);
+    if (plane == OVERLAY_PLANE_CBCR)
+        return float4(yuv.y, yuv.z, 0.0, a);
+    if (plane == OVERLAY_PLANE_CB)
+        return float4(yuv.y, 0.0, 0.0, a);
+    return float4(yuv.z, 0.0, 0.0, a);
+}
+
+fragment float4 overlayRectFragment(
+    OverlayRectOut in [[stage_in]],
+    constant OverlayRectUniforms &u [[buffer(0)]],
+    texture2d<float> overlayTex [[texture(0)]]
+) {
+    // Chroma quads are widened to whole 2x2 blocks
+    if (any(in.overlayUV < 0.0) || any(in.overlayUV >= 1.0))
+        discard_fragment();
+
+    constexpr sampler s(filter::linear, address::clamp_to_edge);
+    float4 overlay = overlayTex.sample(s, in.overlayUV);
+    return overlayPlaneColor(overlay.rgb, overlay.a * u.alpha, u.plane,
+                             u.colorMatrix);
+}
+
+// --- Batched rectangles: every extra overlay in one instanced draw ---
+//
+// Each instance is one rectangle (a configured image or a rectangle of
+// the buffer's GstVideoOverlayComposition) sampled from a shared atlas.
+
+struct OverlayInstance {
+    float4 rect;           // destination, frame pixels (x, y, w, h)
+    float4 atlasRect;      // source, normalised atlas coords (u, v, w, h)
+    float alpha;           // global alpha of the rectangle
+    int swizzle;           // 1 = uploaded as BGRA (composition pixels)
+    float2 padding;
+};
+
+struct OverlayBatchUniforms {
+    float2 targetOrigin;   // target pixel the frame origin maps from
+    float2 targetSize;     // target texture size
+    float scale;           // target pixels per frame pixel
+    int plane;             // OVERLAY_PLANE_*
+    int colorMatrix;       // colour word, VF_COLOR_*
+    int padding;
+};
+
+struct OverlayBatchOut {
+    float4 position [[position]];
+    float2 atlasUV;
+    float alpha [[flat]];
+    int swizzle [[flat]];
+};
+
+vertex OverlayBatchOut overlayBatchVertex(
+    uint vid [[vertex_id]],
+    uint iid [[instance_id]],
+    constant OverlayBatchUniforms &u [[buffer(0)]],
+    constant OverlayInstance *instances [[buffer(1)]]
+) {
+    OverlayInstance inst = instances[iid];
+    float2 corner = float2(float(vid & 1), float(vid >> 1));
+    float2 px = (inst.rect.xy + corner * inst.rect.zw) * u.scale
+                - u.targetOrigin;
+
+    OverlayBatchOut out;
+    out.position = float4(px.x / u.targetSize.x * 2.0 - 1.0,
+                          1.0 - px.y / u.targetSize.y * 2.0, 0.0, 1.0);
+    out.atlasUV = inst.atlasRect.xy + corner * inst.atlasRect.zw;
+    out.alpha = inst.alpha;
+    out.swizzle = inst.swizzle;
+    return out;
+}
+
+fragment float4 overlayBatchFragment(
+    OverlayBatchOut in [[stage_in]],
+    constant OverlayBatchUniforms &u [[buffer(0)]],
+    texture2d<float> atlas [[texture(0)]]
+) {
+    constexpr sampler s(filter::linear, address::clamp_to_edge);
+    float4 overlay = atlas.sample(s, in.atlasUV);
+    if (in.swizzle)
+        overlay = overlay.bgra;
+    return overlayPlaneColor(overlay.rgb, overlay.a * in.alpha, u.plane,
+                             u.colorMatrix);
+}
+
 )";
 
 #endif /* __METAL_OVERLAY_SHADERS_H__ */
@@ -26,28 +26,103 @@
 #import <Metal/Metal.h>
 #include <gst/video/video.h>
 
+#import "vfmetaldevice.h"
+#import "vfmetalinflight.h"
+
 typedef struct {
     float x;
     float y;
     float width;
     float height;
     float alpha;
+
+    /* Animated overlays: frame selection by the buffer's running time,
+     * at @frameRate fps or (0) the delays stored in the file */
+    GstClockTime runningTime;
+    double frameRate;
+    BOOL loop;
+
+    /* Upstream's GstVideoOverlayCompositionMeta for this frame, or NULL;
+     * borrowed for the duration of the call */
+    GstVideoOverlayComposition *composition;
 } OverlayParams;
 
+/* One configured image, placed like the element's main overlay */
+typedef struct {
+    const char *location;
+    int x;
+    int y;
+    int width;                  /* 0 = image size */
+    int height;
+    double alpha;
+    double relativeX;           /* >= 0 overrides x */
+    double relativeY;
+} OverlayImageSpec;
+
+/* Decode a PNG/JPEG file into an RGBA8 texture (premultiplied by
+ * CoreGraphics). Returns nil on error. */
+id<MTLTexture> vf_metal_load_overlay_image (const char *path,
+                                            id<MTLDevice> device);
+
 @interface MetalOverlayRenderer : NSObject
 
+/* Element this renderer's stages are traced for (see vfmetaltrace.h) */
+@property (nonatomic, assign) GstObject *traceOwner;
+
+/* GPU this renderer runs on, fixed at creation */
+@property (nonatomic, readonly) VfMetalDevice *metalDevice;
+
+/* -init uses the default device (+[VfMetalDevice sharedDevice]) */
 - (instancetype)init;
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice;
 
 - (BOOL)configureWithInputInfo:(GstVideoInfo *)inInfo
                     outputInfo:(GstVideoInfo *)outInfo;
 
+/* PNG/JPEG stills; GIF, APNG and printf-style numbered sequences
+ * ("clock_%03d.png") are decoded up front into an array texture */
 - (BOOL)loadImageFromFile:(const char *)path;
+
+/* Replace the overlay with an RGBA or BGRA bitmap (straight alpha),
+ * copied into one of two persistent textures while frames keep sampling
+ * the other; the new bitmap shows from the next frame. May block for
+ * the GPU to release the buffer it refills. */
+- (BOOL)pushImage:(const guint8 *)pixels
+            width:(int)width
+           height:(int)height
+           stride:(int)stride
+           format:(GstVideoFormat)format;
+
 - (void)clearImage;
 
+/* Replace the configured images drawn on top of the main overlay. They
+ * and the frame's composition rectangles share one texture atlas and
+ * are drawn in a single instanced pass. Returns how many loaded. */
+- (guint)setImages:(const OverlayImageSpec *)specs count:(guint)count;
+
 - (BOOL)processFrame:(GstVideoFrame *)inFrame
               output:(GstVideoFrame *)outFrame
               params:(const OverlayParams *)params;
 
+/* Pipelined variant: encode into ring @slot, commit without waiting and
+ * call @completion once outFrame has been read back. Returns NO (and
+ * never calls @completion) if nothing was committed. */
+- (BOOL)submitFrame:(GstVideoFrame *)inFrame
+             output:(GstVideoFrame *)outFrame
+             params:(const OverlayParams *)params
+               slot:(NSUInteger)slot
+         completion:(VfMetalCompletionHandler)completion;
+
+/* In-place mode: blend the overlay into @frame itself, touching only the
+ * overlay rectangle — one scissored quad for BGRA/RGBA, a sub-rect per
+ * plane for NV12/I420. GPU-resident frames are drawn into directly;
+ * otherwise just the rectangle is staged and copied back. With a
+ * @completion the call is pipelined as in submitFrame:. */
+- (BOOL)blendInPlace:(GstVideoFrame *)frame
+              params:(const OverlayParams *)params
+                slot:(NSUInteger)slot
+          completion:(VfMetalCompletionHandler)completion;
+
 - (void)cleanup;
 
 @end
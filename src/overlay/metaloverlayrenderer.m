@@ -22,13 +22,18 @@
 #import "metaloverlayrenderer.h"
 #import "metaloverlay_shaders.h"
 #import "vfmetaldevice.h"
+#import "vfmetalmemory.h"
 #import "vfmetaltextureutil.h"
 #import "vfmetalshaders.h"
 #import "vfmetalyuvoutput.h"
+#import "vfmetaltrace.h"
 #import <CoreGraphics/CoreGraphics.h>
 #import <ImageIO/ImageIO.h>
 
 #include <gst/gst.h>
+#include <math.h>
+#include <os/lock.h>
+#include <string.h>
 
 GST_DEBUG_CATEGORY_EXTERN (gst_vf_metal_overlay_debug);
 #define GST_CAT_DEFAULT gst_vf_metal_overlay_debug
@@ -45,6 +50,637 @@ typedef struct {
     int32_t colorMatrix;
 } OverlayUniformsGPU;
 
+/* Draw @image scaled to @width x @height into @pixels (RGBA8,
+ * premultiplied, tightly packed), clearing what was there before */
+static BOOL
+overlay_draw_image (CGImageRef image, uint8_t *pixels, int width, int height)
+{
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB ();
+    CGContextRef ctx = CGBitmapContextCreate (pixels, width, height, 8,
+        width * 4, colorSpace,
+        kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big);
+    CGColorSpaceRelease (colorSpace);
+    if (!ctx)
+        return NO;
+
+    CGContextClearRect (ctx, CGRectMake (0, 0, width, height));
+    CGContextDrawImage (ctx, CGRectMake (0, 0, width, height), image);
+    CGContextRelease (ctx);
+    return YES;
+}
+
+static CGImageSourceRef
+overlay_image_source_new (const char *path)
+{
+    NSString *nsPath = [NSString stringWithUTF8String:path];
+    NSData *fileData = [NSData dataWithContentsOfFile:nsPath];
+    if (!fileData) {
+        GST_WARNING ("Failed to read overlay file: %s", path);
+        return NULL;
+    }
+
+    CGImageSourceRef source = CGImageSourceCreateWithData (
+        (__bridge CFDataRef)fileData, NULL);
+    if (!source)
+        GST_WARNING ("Failed to create image source: %s", path);
+    return source;
+}
+
+id<MTLTexture>
+vf_metal_load_overlay_image (const char *path, id<MTLDevice> device)
+{
+    @autoreleasepool {
+        CGImageSourceRef source = overlay_image_source_new (path);
+        if (!source)
+            return nil;
+
+        CGImageRef cgImage = CGImageSourceCreateImageAtIndex (source, 0, NULL);
+        CFRelease (source);
+        if (!cgImage) {
+            GST_WARNING ("Failed to decode image: %s", path);
+            return nil;
+        }
+
+        int imgW = (int) CGImageGetWidth (cgImage);
+        int imgH = (int) CGImageGetHeight (cgImage);
+
+        /* Decode into RGBA8 */
+        int bytesPerRow = imgW * 4;
+        uint8_t *pixels = (uint8_t *) malloc (bytesPerRow * imgH);
+        if (!pixels) {
+            CGImageRelease (cgImage);
+            return nil;
+        }
+
+        BOOL drawn = overlay_draw_image (cgImage, pixels, imgW, imgH);
+        CGImageRelease (cgImage);
+        if (!drawn) {
+            free (pixels);
+            return nil;
+        }
+
+        /* Create Metal texture */
+        MTLTextureDescriptor *desc = [MTLTextureDescriptor
+            texture2DDescriptorWithPixelFormat:MTLPixelFormatRGBA8Unorm
+                                         width:imgW height:imgH
+                                     mipmapped:NO];
+        desc.usage = MTLTextureUsageShaderRead;
+        desc.storageMode = vf_metal_host_storage_mode (device);
+
+        id<MTLTexture> texture = [device newTextureWithDescriptor:desc];
+        if (!texture) {
+            free (pixels);
+            return nil;
+        }
+
+        [texture replaceRegion:MTLRegionMake2D(0, 0, imgW, imgH)
+                   mipmapLevel:0
+                     withBytes:pixels
+                   bytesPerRow:bytesPerRow];
+        free (pixels);
+
+        GST_DEBUG ("Loaded overlay image: %dx%d from %s", imgW, imgH, path);
+        return texture;
+    }
+}
+
+/* Shader uniform — must match OverlayRectUniforms in MSL */
+typedef struct {
+    float rect[4];
+    float overlayRect[4];
+    float targetSize[2];
+    float alpha;
+    int32_t plane;
+    int32_t colorMatrix;
+    int32_t padding[3];
+} OverlayRectUniformsGPU;
+
+/* How the in-place path writes one plane: texture format, shader plane
+ * selector, log2 chroma subsampling and bytes per pixel */
+typedef struct {
+    MTLPixelFormat format;
+    VfMetalOverlayPlane plane;
+    int shift;
+    int bpp;
+} OverlayPlaneLayout;
+
+static guint
+overlay_plane_layouts (GstVideoFormat format, OverlayPlaneLayout *planes)
+{
+    switch (format) {
+        case GST_VIDEO_FORMAT_BGRA:
+            planes[0] = (OverlayPlaneLayout) { MTLPixelFormatBGRA8Unorm,
+                VF_METAL_OVERLAY_PLANE_RGB, 0, 4 };
+            return 1;
+        case GST_VIDEO_FORMAT_RGBA:
+            planes[0] = (OverlayPlaneLayout) { MTLPixelFormatRGBA8Unorm,
+                VF_METAL_OVERLAY_PLANE_RGB, 0, 4 };
+            return 1;
+        case GST_VIDEO_FORMAT_NV12:
+            planes[0] = (OverlayPlaneLayout) { MTLPixelFormatR8Unorm,
+                VF_METAL_OVERLAY_PLANE_Y, 0, 1 };
+            planes[1] = (OverlayPlaneLayout) { MTLPixelFormatRG8Unorm,
+                VF_METAL_OVERLAY_PLANE_CBCR, 1, 2 };
+            return 2;
+        case GST_VIDEO_FORMAT_I420:
+            planes[0] = (OverlayPlaneLayout) { MTLPixelFormatR8Unorm,
+                VF_METAL_OVERLAY_PLANE_Y, 0, 1 };
+            planes[1] = (OverlayPlaneLayout) { MTLPixelFormatR8Unorm,
+                VF_METAL_OVERLAY_PLANE_CB, 1, 1 };
+            planes[2] = (OverlayPlaneLayout) { MTLPixelFormatR8Unorm,
+                VF_METAL_OVERLAY_PLANE_CR, 1, 1 };
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+/* Shader instance — must match OverlayInstance in MSL */
+typedef struct {
+    float rect[4];
+    float atlasRect[4];
+    float alpha;
+    int32_t swizzle;
+    float padding[2];
+} OverlayInstanceGPU;
+
+/* Shader uniform — must match OverlayBatchUniforms in MSL */
+typedef struct {
+    float targetOrigin[2];
+    float targetSize[2];
+    float scale;
+    int32_t plane;
+    int32_t colorMatrix;
+    int32_t padding;
+} OverlayBatchUniformsGPU;
+
+/* Atlas keys: composition rectangles by seqnum, configured images by
+ * generation and index in the upper half of the key space */
+#define OVERLAY_ATLAS_IMAGE_KEY(generation, index) \
+    ((G_GUINT64_CONSTANT (1) << 63) | ((guint64) (generation) << 16) | (index))
+
+#define OVERLAY_ATLAS_SIZE      2048
+#define OVERLAY_ATLAS_MAX_SIZE  8192
+#define OVERLAY_ATLAS_GUTTER    1       /* keeps linear filtering in */
+
+/* Staged planes of a system-memory frame, copied back once the
+ * in-place blend has completed */
+typedef struct {
+    guint n;
+    struct {
+        guint8 *dst;
+        gint stride;
+        gint width;
+        gint height;
+    } planes[3];
+} OverlayReadback;
+
+/* --- Animated overlays --- */
+
+/* Frames kept: Metal's array texture limit, and at most 512 MiB */
+#define VF_METAL_OVERLAY_MAX_FRAMES       2048
+#define VF_METAL_OVERLAY_MAX_BYTES        (512u << 20)
+/* Rate of numbered image sequences, which carry no timing */
+#define VF_METAL_OVERLAY_SEQUENCE_FPS     25
+/* Browsers treat GIF delays of 10 ms or less as 100 ms; so do we */
+#define VF_METAL_OVERLAY_MIN_DELAY        (10 * GST_MSECOND)
+#define VF_METAL_OVERLAY_DEFAULT_DELAY    (100 * GST_MSECOND)
+
+static GstClockTime
+overlay_frame_delay (CGImageSourceRef source, size_t index)
+{
+    CFDictionaryRef props =
+        CGImageSourceCopyPropertiesAtIndex (source, index, NULL);
+    if (!props)
+        return VF_METAL_OVERLAY_DEFAULT_DELAY;
+
+    double seconds = 0.0;
+    const CFStringRef keys[][3] = {
+        { kCGImagePropertyGIFDictionary,
+          kCGImagePropertyGIFUnclampedDelayTime,
+          kCGImagePropertyGIFDelayTime },
+        { kCGImagePropertyPNGDictionary,
+          kCGImagePropertyAPNGUnclampedDelayTime,
+          kCGImagePropertyAPNGDelayTime },
+    };
+
+    for (size_t i = 0; i < G_N_ELEMENTS (keys) && seconds <= 0.0; i++) {
+        CFDictionaryRef dict = CFDictionaryGetValue (props, keys[i][0]);
+        if (!dict)
+            continue;
+        for (int k = 1; k < 3 && seconds <= 0.0; k++) {
+            CFNumberRef value = CFDictionaryGetValue (dict, keys[i][k]);
+            if (value)
+                CFNumberGetValue (value, kCFNumberDoubleType, &seconds);
+        }
+    }
+    CFRelease (props);
+
+    GstClockTime delay = (GstClockTime) (seconds * GST_SECOND);
+    return delay <= VF_METAL_OVERLAY_MIN_DELAY
+        ? VF_METAL_OVERLAY_DEFAULT_DELAY : delay;
+}
+
+/* A numbered sequence pattern: the text around its one %d conversion,
+ * with %% already turned into % */
+typedef struct {
+    GString *prefix;
+    GString *suffix;
+    int width;
+    gboolean zero_pad;
+} VfMetalOverlaySequence;
+
+/* Splits @path into @seq if it holds exactly one "%[0]*[0-9]*d"
+ * conversion and no other '%' than "%%". Anything else, "50%s.png"
+ * included, is a literal file name; the path is never used as a
+ * format string. */
+static gboolean
+overlay_sequence_parse (const char *path, VfMetalOverlaySequence *seq)
+{
+    GString *prefix = g_string_new (NULL);
+    GString *suffix = g_string_new (NULL);
+    GString *out = prefix;
+    gboolean found = FALSE;
+    int width = 0;
+    gboolean zero_pad = FALSE;
+
+    for (const char *p = path; *p; p++) {
+        if (*p != '%') {
+            g_string_append_c (out, *p);
+            continue;
+        }
+        if (p[1] == '%') {
+            g_string_append_c (out, '%');
+            p++;
+            continue;
+        }
+        if (found)
+            goto literal;
+
+        const char *q = p + 1;
+        while (*q == '0') {
+            zero_pad = TRUE;
+            q++;
+        }
+        while (g_ascii_isdigit (*q)) {
+            width = width * 10 + (*q - '0');
+            if (width > 32)
+                goto literal;
+            q++;
+        }
+        if (*q != 'd')
+            goto literal;
+
+        found = TRUE;
+        out = suffix;
+        p = q;
+    }
+    if (!found)
+        goto literal;
+
+    seq->prefix = prefix;
+    seq->suffix = suffix;
+    seq->width = width;
+    seq->zero_pad = zero_pad;
+    return TRUE;
+
+literal:
+    g_string_free (prefix, TRUE);
+    g_string_free (suffix, TRUE);
+    return FALSE;
+}
+
+/* CGImages to decode and how long each is shown: the frames of one file,
+ * or with a printf-style pattern ("logo_%03d.png") the files it names,
+ * from index 0 or 1 up to the first one missing */
+static GPtrArray *
+overlay_collect_frames (const char *path, GArray *delays)
+{
+    GPtrArray *frames = g_ptr_array_new ();
+    VfMetalOverlaySequence seq;
+
+    if (!overlay_sequence_parse (path, &seq)) {
+        CGImageSourceRef source = overlay_image_source_new (path);
+        if (!source)
+            return frames;
+        size_t count = CGImageSourceGetCount (source);
+        for (size_t i = 0; i < count; i++) {
+            CGImageRef image = CGImageSourceCreateImageAtIndex (source, i, NULL);
+            if (!image)
+                break;
+            GstClockTime delay = overlay_frame_delay (source, i);
+            g_ptr_array_add (frames, (gpointer) image);
+            g_array_append_val (delays, delay);
+        }
+        CFRelease (source);
+        return frames;
+    }
+
+    for (int index = 0; frames->len < VF_METAL_OVERLAY_MAX_FRAMES; index++) {
+        gchar *file = seq.zero_pad
+            ? g_strdup_printf ("%s%0*d%s", seq.prefix->str, seq.width,
+                  index, seq.suffix->str)
+            : g_strdup_printf ("%s%*d%s", seq.prefix->str, seq.width,
+                  index, seq.suffix->str);
+        gboolean exists = g_file_test (file, G_FILE_TEST_IS_REGULAR);
+        CGImageSourceRef source = exists ? overlay_image_source_new (file) : NULL;
+        g_free (file);
+
+        if (!source) {
+            /* Sequences may start at 1 */
+            if (index == 0)
+                continue;
+            break;
+        }
+        CGImageRef image = CGImageSourceCreateImageAtIndex (source, 0, NULL);
+        CFRelease (source);
+        if (!image)
+            break;
+        GstClockTime delay = GST_SECOND / VF_METAL_OVERLAY_SEQUENCE_FPS;
+        g_ptr_array_add (frames, (gpointer) image);
+        g_array_append_val (delays, delay);
+    }
+    g_string_free (seq.prefix, TRUE);
+    g_string_free (seq.suffix, TRUE);
+    return frames;
+}
+
+/* All frames of a GIF, APNG or numbered image sequence, decoded once
+ * into the layers of one RGBA8 array texture. Frames are looked up by
+ * running time, so nothing is decoded or allocated while streaming. */
+@interface VfMetalOverlayAnimation : NSObject
+@property (nonatomic, readonly) NSUInteger count;
+@property (nonatomic, readonly) int width;
+@property (nonatomic, readonly) int height;
+- (instancetype)initWithPath:(const char *)path device:(id<MTLDevice>)device;
+- (id<MTLTexture>)frameAtTime:(GstClockTime)time
+                    frameRate:(double)frameRate
+                         loop:(BOOL)loop;
+@end
+
+@implementation VfMetalOverlayAnimation {
+    id<MTLTexture> _frames;             /* 2D array, one layer per frame */
+    NSArray<id<MTLTexture>> *_views;    /* 2D view of each layer */
+    GstClockTime *_starts;              /* running time each frame starts */
+    GstClockTime _duration;
+}
+
+- (void)dealloc
+{
+    g_free (_starts);
+}
+
+- (instancetype)initWithPath:(const char *)path device:(id<MTLDevice>)device
+{
+    self = [super init];
+    if (!self) return nil;
+
+    GArray *delays = g_array_new (FALSE, FALSE, sizeof (GstClockTime));
+    GPtrArray *images = overlay_collect_frames (path, delays);
+    if (images->len < 2) {
+        for (guint i = 0; i < images->len; i++)
+            CGImageRelease ((CGImageRef) g_ptr_array_index (images, i));
+        g_ptr_array_free (images, TRUE);
+        g_array_free (delays, TRUE);
+        return nil;
+    }
+
+    /* Every frame is drawn at the size of the first */
+    CGImageRef first = (CGImageRef) g_ptr_array_index (images, 0);
+    _width = (int) CGImageGetWidth (first);
+    _height = (int) CGImageGetHeight (first);
+
+    size_t frameBytes = (size_t) _width * _height * 4;
+    NSUInteger count = MIN (images->len, VF_METAL_OVERLAY_MAX_FRAMES);
+    count = MIN (count, MAX (VF_METAL_OVERLAY_MAX_BYTES / frameBytes, 2));
+    if (count < images->len)
+        GST_WARNING ("Overlay %s: keeping %lu of %u frames", path,
+                     (unsigned long) count, images->len);
+
+    MTLTextureDescriptor *desc = [MTLTextureDescriptor
+        texture2DDescriptorWithPixelFormat:MTLPixelFormatRGBA8Unorm
+                                     width:_width height:_height
+                                 mipmapped:NO];
+    desc.textureType = MTLTextureType2DArray;
+    desc.arrayLength = count;
+    desc.usage = MTLTextureUsageShaderRead;
+    desc.storageMode = vf_metal_host_storage_mode (device);
+    _frames = [device newTextureWithDescriptor:desc];
+
+    uint8_t *pixels = _frames ? (uint8_t *) malloc (frameBytes) : NULL;
+    NSMutableArray<id<MTLTexture>> *views =
+        [NSMutableArray arrayWithCapacity:count];
+    _starts = g_new (GstClockTime, count);
+    _duration = 0;
+
+    for (NSUInteger i = 0; pixels && i < count; i++) {
+        CGImageRef image = (CGImageRef) g_ptr_array_index (images, i);
+        if (!overlay_draw_image (image, pixels, _width, _height))
+            break;
+        [_frames replaceRegion:MTLRegionMake2D(0, 0, _width, _height)
+                   mipmapLevel:0 slice:i withBytes:pixels
+                   bytesPerRow:_width * 4 bytesPerImage:frameBytes];
+
+        id<MTLTexture> view = [_frames
+            newTextureViewWithPixelFormat:MTLPixelFormatRGBA8Unorm
+                              textureType:MTLTextureType2D
+                                   levels:NSMakeRange(0, 1)
+                                   slices:NSMakeRange(i, 1)];
+        if (!view)
+            break;
+        [views addObject:view];
+
+        _starts[i] = _duration;
+        _duration += g_array_index (delays, GstClockTime, i);
+    }
+    free (pixels);
+
+    for (guint i = 0; i < images->len; i++)
+        CGImageRelease ((CGImageRef) g_ptr_array_index (images, i));
+    g_ptr_array_free (images, TRUE);
+    g_array_free (delays, TRUE);
+
+    if (views.count != count) {
+        GST_WARNING ("Failed to upload animated overlay: %s", path);
+        return nil;
+    }
+
+    _views = views;
+    _count = count;
+    GST_DEBUG ("Loaded animated overlay: %lu frames of %dx%d, %.2f s from %s",
+               (unsigned long) count, _width, _height,
+               (double) _duration / GST_SECOND, path);
+    return self;
+}
+
+- (id<MTLTexture>)frameAtTime:(GstClockTime)time
+                    frameRate:(double)frameRate
+                         loop:(BOOL)loop
+{
+    NSUInteger index = 0;
+
+    if (GST_CLOCK_TIME_IS_VALID (time) && frameRate > 0.0) {
+        guint64 n = (guint64) ((double) time * frameRate / GST_SECOND);
+        index = loop ? n % _count : MIN (n, _count - 1);
+    } else if (GST_CLOCK_TIME_IS_VALID (time)) {
+        GstClockTime t = loop ? time % _duration : MIN (time, _duration - 1);
+        /* Last frame starting at or before t */
+        NSUInteger lo = 0, hi = _count - 1;
+        while (lo < hi) {
+            NSUInteger mid = (lo + hi + 1) / 2;
+            if (_starts[mid] <= t)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        index = lo;
+    }
+
+    return _views[index];
+}
+
+@end
+
+/* Every rectangle drawn in the batched pass lives in one RGBA8 atlas,
+ * packed into shelves and keyed so that unchanged rectangles are never
+ * uploaded twice. When it fills up it is cleared (and grown if a single
+ * rectangle does not fit) and refilled with the current frame's. */
+@interface VfMetalOverlayAtlas : NSObject
+@property (nonatomic, readonly) id<MTLTexture> texture;
+/* Last committed command buffer sampling the atlas */
+@property (nonatomic, strong) id<MTLCommandBuffer> lastUse;
+- (instancetype)initWithDevice:(id<MTLDevice>)device;
+- (BOOL)lookupKey:(guint64)key region:(MTLRegion *)region;
+- (BOOL)insertKey:(guint64)key
+            width:(NSUInteger)width
+           height:(NSUInteger)height
+           region:(MTLRegion *)region;
+- (BOOL)resetToFitWidth:(NSUInteger)width height:(NSUInteger)height;
+@end
+
+typedef struct {
+    NSUInteger y;
+    NSUInteger height;
+    NSUInteger x;               /* next free column */
+} OverlayAtlasShelf;
+
+@implementation VfMetalOverlayAtlas {
+    id<MTLDevice> _device;
+    NSMutableDictionary<NSNumber *, NSValue *> *_entries;
+    GArray *_shelves;
+}
+
+- (void)dealloc
+{
+    g_array_unref (_shelves);
+}
+
+- (instancetype)initWithDevice:(id<MTLDevice>)device
+{
+    self = [super init];
+    if (!self) return nil;
+
+    _device = device;
+    _entries = [NSMutableDictionary dictionary];
+    _shelves = g_array_new (FALSE, FALSE, sizeof (OverlayAtlasShelf));
+    return self;
+}
+
+- (BOOL)lookupKey:(guint64)key region:(MTLRegion *)region
+{
+    NSValue *value = _entries[@(key)];
+    if (!value)
+        return NO;
+    [value getValue:region size:sizeof (*region)];
+    return YES;
+}
+
+- (BOOL)insertKey:(guint64)key
+            width:(NSUInteger)width
+           height:(NSUInteger)height
+           region:(MTLRegion *)region
+{
+    if (!_texture && ![self resetToFitWidth:width height:height])
+        return NO;
+
+    NSUInteger w = width + OVERLAY_ATLAS_GUTTER;
+    NSUInteger h = height + OVERLAY_ATLAS_GUTTER;
+    NSUInteger size = _texture.width;
+    OverlayAtlasShelf *shelf = NULL;
+
+    /* Lowest shelf that is tall enough and has room, else a new one */
+    for (guint i = 0; i < _shelves->len; i++) {
+        OverlayAtlasShelf *s = &g_array_index (_shelves, OverlayAtlasShelf, i);
+        if (s->height >= h && s->x + w <= size &&
+            (!shelf || s->height < shelf->height))
+            shelf = s;
+    }
+    if (!shelf) {
+        NSUInteger y = 0;
+        if (_shelves->len > 0) {
+            OverlayAtlasShelf *last = &g_array_index (_shelves,
+                OverlayAtlasShelf, _shelves->len - 1);
+            y = last->y + last->height;
+        }
+        if (y + h > size || w > size)
+            return NO;
+        OverlayAtlasShelf s = { y, h, 0 };
+        g_array_append_val (_shelves, s);
+        shelf = &g_array_index (_shelves, OverlayAtlasShelf, _shelves->len - 1);
+    }
+
+    *region = MTLRegionMake2D (shelf->x, shelf->y, width, height);
+    shelf->x += w;
+    _entries[@(key)] = [NSValue valueWithBytes:region
+                                      objCType:@encode (MTLRegion)];
+    return YES;
+}
+
+- (BOOL)resetToFitWidth:(NSUInteger)width height:(NSUInteger)height
+{
+    NSUInteger size = _texture ? _texture.width : OVERLAY_ATLAS_SIZE;
+    NSUInteger need = MAX (width, height) + OVERLAY_ATLAS_GUTTER;
+
+    while (size < need && size < OVERLAY_ATLAS_MAX_SIZE)
+        size *= 2;
+    if (size < need)
+        return NO;
+
+    /* Frames still in flight may sample what is about to be overwritten */
+    [_lastUse waitUntilCompleted];
+    _lastUse = nil;
+
+    if (!_texture || _texture.width != size) {
+        MTLTextureDescriptor *desc = [MTLTextureDescriptor
+            texture2DDescriptorWithPixelFormat:MTLPixelFormatRGBA8Unorm
+                                         width:size
+                                        height:size
+                                     mipmapped:NO];
+        desc.usage = MTLTextureUsageShaderRead;
+        desc.storageMode = vf_metal_host_storage_mode (_device);
+        _texture = [_device newTextureWithDescriptor:desc];
+        if (!_texture)
+            return NO;
+        GST_DEBUG ("Overlay atlas is %lux%lu", (unsigned long) size,
+                   (unsigned long) size);
+    }
+
+    [_entries removeAllObjects];
+    g_array_set_size (_shelves, 0);
+    return YES;
+}
+
+@end
+
+/* A configured image: decoded texture plus its placement spec */
+@interface VfMetalOverlayImage : NSObject
+@property (nonatomic, strong) id<MTLTexture> texture;
+@property (nonatomic, assign) OverlayImageSpec spec;
+@end
+
+@implementation VfMetalOverlayImage
+@end
+
 @implementation MetalOverlayRenderer {
     id<MTLCommandQueue> _commandQueue;
     id<MTLLibrary> _library;
@@ -58,10 +694,22 @@ typedef struct {
     /* Shared YUV output helper */
     VfMetalYUVOutput *_yuvOutput;
 
-    /* Overlay image texture */
+    /* Overlay source: a still image, an animation or pushed bitmaps,
+     * whichever was set last. Guarded by _sourceLock, as they are set
+     * from the application thread. */
+    os_unfair_lock _sourceLock;
     id<MTLTexture> _overlayTexture;
-    int _overlayWidth;
-    int _overlayHeight;
+    VfMetalOverlayAnimation *_animation;
+
+    /* Pushed bitmaps, double-buffered: frames sample _pushed[_pushedFront]
+     * while -pushImage: fills the other one, which is only reallocated
+     * when the bitmap size or format changes */
+    BOOL _pushMode;
+    id<MTLTexture> _pushed[2];
+    id<MTLCommandBuffer> _pushedLastUse[2];
+    int _pushedFront;                   /* -1 = none yet */
+    int _pushedReady;                   /* filled, not yet shown; -1 = none */
+    NSLock *_pushWriteLock;             /* one -pushImage: at a time */
 
     /* Configuration */
     int _width;
@@ -71,24 +719,50 @@ typedef struct {
     MTLPixelFormat _renderPixelFormat;
 
     VfMetalTextureCache *_textureCache;
+
+    /* Blending pipelines (in-place rectangle, batched rectangles) per
+     * target pixel format, and per ring slot and plane a staging texture
+     * for in-place frames in system memory */
+    NSMutableDictionary<NSNumber *, id<MTLRenderPipelineState>> *_blendPipelines;
+    id<MTLTexture> _staging[VF_METAL_MAX_IN_FLIGHT][3];
+
+    /* Batched rectangles: configured images (under _sourceLock, the spec
+     * location is not kept), the atlas and per-slot instance buffers */
+    NSArray<VfMetalOverlayImage *> *_images;
+    guint _imagesGeneration;
+    VfMetalOverlayAtlas *_atlas;
+    id<MTLBuffer> _instances[VF_METAL_MAX_IN_FLIGHT];
+}
+
+- (void)setTraceOwner:(GstObject *)traceOwner
+{
+    _traceOwner = traceOwner;
+    _textureCache.traceOwner = traceOwner;
+    _yuvOutput.traceOwner = traceOwner;
 }
 
 - (instancetype)init
+{
+    return [self initWithDevice:[VfMetalDevice sharedDevice]];
+}
+
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice
 {
     self = [super init];
     if (!self) return nil;
 
-    VfMetalDevice *metalDevice = [VfMetalDevice sharedDevice];
     if (!metalDevice) return nil;
+    _metalDevice = metalDevice;
 
-    _commandQueue = [metalDevice.device newCommandQueue];
-    if (!_commandQueue) return nil;
+    _commandQueue = metalDevice.commandQueue;
 
     NSString *fullSource = [kVfMetalCommonShaderSource
         stringByAppendingString:kOverlayShaderSource];
 
     NSError *error = nil;
-    _library = [metalDevice compileShaderSource:fullSource error:&error];
+    _library = [metalDevice libraryNamed:@"overlay"
+                                  source:fullSource
+                                   error:&error];
     if (!_library) {
         GST_ERROR ("MetalOverlayRenderer: Failed to compile shaders: %s",
               error.localizedDescription.UTF8String);
@@ -99,6 +773,12 @@ typedef struct {
         initWithDevice:metalDevice.device];
     _yuvOutput = [[VfMetalYUVOutput alloc] init];
 
+    _blendPipelines = [NSMutableDictionary dictionary];
+    _sourceLock = OS_UNFAIR_LOCK_INIT;
+    _pushedFront = -1;
+    _pushedReady = -1;
+    _pushWriteLock = [[NSLock alloc] init];
+
     return self;
 }
 
@@ -115,7 +795,8 @@ typedef struct {
         return YES;
     }
 
-    id<MTLDevice> device = [VfMetalDevice sharedDevice].device;
+    VfMetalDevice *metalDevice = _metalDevice;
+    id<MTLDevice> device = metalDevice.device;
 
     _width = w;
     _height = h;
@@ -151,7 +832,8 @@ typedef struct {
 
         NSError *error = nil;
         _pipelines[fmt] =
-            [device newRenderPipelineStateWithDescriptor:desc error:&error];
+            [metalDevice renderPipelineWithDescriptor:desc library:_library
+                                                error:&error];
         if (!_pipelines[fmt]) {
             GST_ERROR ("Failed to create overlay pipeline for format %d: %s",
                        fmt, error.localizedDescription.UTF8String);
@@ -165,12 +847,12 @@ typedef struct {
                                      width:w height:h mipmapped:NO];
     rtDesc.usage = MTLTextureUsageRenderTarget | MTLTextureUsageShaderRead |
                    MTLTextureUsageShaderWrite;
-    rtDesc.storageMode = MTLStorageModeShared;
+    rtDesc.storageMode = _metalDevice.hostStorageMode;
 
     _renderTarget = [device newTextureWithDescriptor:rtDesc];
     if (!_renderTarget) return NO;
 
-    if (![_yuvOutput configureWithDevice:device library:_library
+    if (![_yuvOutput configureWithDevice:_metalDevice library:_library
                                    width:w height:h format:outFmt])
         return NO;
 
@@ -179,103 +861,170 @@ typedef struct {
 
 - (BOOL)loadImageFromFile:(const char *)path
 {
-    @autoreleasepool {
-        if (!path || *path == '\0') {
-            [self clearImage];
-            return YES;
-        }
-
-        NSString *nsPath = [NSString stringWithUTF8String:path];
-        NSData *fileData = [NSData dataWithContentsOfFile:nsPath];
-        if (!fileData) {
-            GST_WARNING ("Failed to read overlay file: %s", path);
-            return NO;
-        }
-
-        CGImageSourceRef source = CGImageSourceCreateWithData (
-            (__bridge CFDataRef)fileData, NULL);
-        if (!source) {
-            GST_WARNING ("Failed to create image source: %s", path);
-            return NO;
-        }
-
-        CGImageRef cgImage = CGImageSourceCreateImageAtIndex (source, 0, NULL);
-        CFRelease (source);
-        if (!cgImage) {
-            GST_WARNING ("Failed to decode image: %s", path);
-            return NO;
-        }
-
-        int imgW = (int) CGImageGetWidth (cgImage);
-        int imgH = (int) CGImageGetHeight (cgImage);
-
-        /* Decode into RGBA8 */
-        int bytesPerRow = imgW * 4;
-        uint8_t *pixels = (uint8_t *) malloc (bytesPerRow * imgH);
-        if (!pixels) {
-            CGImageRelease (cgImage);
-            return NO;
-        }
-
-        CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB ();
-        CGContextRef ctx = CGBitmapContextCreate (pixels, imgW, imgH, 8,
-            bytesPerRow, colorSpace,
-            kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big);
-        CGColorSpaceRelease (colorSpace);
-
-        if (!ctx) {
-            free (pixels);
-            CGImageRelease (cgImage);
-            return NO;
-        }
-
-        CGContextDrawImage (ctx, CGRectMake (0, 0, imgW, imgH), cgImage);
-        CGContextRelease (ctx);
-        CGImageRelease (cgImage);
+    if (!path || *path == '\0') {
+        [self clearImage];
+        return YES;
+    }
 
-        /* Create Metal texture */
-        id<MTLDevice> device = [VfMetalDevice sharedDevice].device;
+    id<MTLDevice> device = _metalDevice.device;
+    VfMetalOverlayAnimation *animation =
+        [[VfMetalOverlayAnimation alloc] initWithPath:path device:device];
+    id<MTLTexture> tex = animation ? nil
+        : vf_metal_load_overlay_image (path, device);
+    if (!animation && !tex) return NO;
+
+    os_unfair_lock_lock (&_sourceLock);
+    _overlayTexture = tex;
+    _animation = animation;
+    _pushMode = NO;
+    os_unfair_lock_unlock (&_sourceLock);
+    return YES;
+}
 
+- (BOOL)pushImage:(const guint8 *)pixels
+            width:(int)width
+           height:(int)height
+           stride:(int)stride
+           format:(GstVideoFormat)format
+{
+    MTLPixelFormat pixelFormat = (format == GST_VIDEO_FORMAT_BGRA)
+        ? MTLPixelFormatBGRA8Unorm : MTLPixelFormatRGBA8Unorm;
+
+    [_pushWriteLock lock];
+
+    /* Refill a bitmap not shown yet, else the one frames are not using */
+    os_unfair_lock_lock (&_sourceLock);
+    int back = _pushedReady;
+    if (back < 0)
+        back = (_pushedFront == 0) ? 1 : 0;
+    _pushedReady = -1;
+    id<MTLCommandBuffer> lastUse = _pushedLastUse[back];
+    id<MTLTexture> texture = _pushed[back];
+    os_unfair_lock_unlock (&_sourceLock);
+
+    /* Frames that sampled it before it became the back buffer */
+    [lastUse waitUntilCompleted];
+
+    if (!texture || (int) texture.width != width ||
+        (int) texture.height != height || texture.pixelFormat != pixelFormat) {
         MTLTextureDescriptor *desc = [MTLTextureDescriptor
-            texture2DDescriptorWithPixelFormat:MTLPixelFormatRGBA8Unorm
-                                         width:imgW height:imgH
+            texture2DDescriptorWithPixelFormat:pixelFormat
+                                         width:width height:height
                                      mipmapped:NO];
         desc.usage = MTLTextureUsageShaderRead;
-        desc.storageMode = MTLStorageModeShared;
-
-        _overlayTexture = [device newTextureWithDescriptor:desc];
-        if (!_overlayTexture) {
-            free (pixels);
+        desc.storageMode = _metalDevice.hostStorageMode;
+        texture = [_metalDevice.device
+            newTextureWithDescriptor:desc];
+        if (!texture) {
+            [_pushWriteLock unlock];
             return NO;
         }
+        GST_DEBUG ("Allocated %dx%d pushed overlay bitmap %d",
+                   width, height, back);
+    }
 
-        [_overlayTexture replaceRegion:MTLRegionMake2D(0, 0, imgW, imgH)
-                           mipmapLevel:0
-                             withBytes:pixels
-                           bytesPerRow:bytesPerRow];
-        free (pixels);
+    [texture replaceRegion:MTLRegionMake2D(0, 0, width, height)
+               mipmapLevel:0
+                 withBytes:pixels
+               bytesPerRow:stride];
 
-        _overlayWidth = imgW;
-        _overlayHeight = imgH;
+    os_unfair_lock_lock (&_sourceLock);
+    _pushed[back] = texture;
+    _pushedLastUse[back] = nil;
+    _pushedReady = back;
+    _pushMode = YES;
+    _overlayTexture = nil;
+    _animation = nil;
+    os_unfair_lock_unlock (&_sourceLock);
 
-        GST_DEBUG ("Loaded overlay image: %dx%d from %s", imgW, imgH, path);
-        return YES;
-    }
+    [_pushWriteLock unlock];
+    return YES;
 }
 
 - (void)clearImage
 {
+    [_pushWriteLock lock];
+    os_unfair_lock_lock (&_sourceLock);
     _overlayTexture = nil;
-    _overlayWidth = 0;
-    _overlayHeight = 0;
+    _animation = nil;
+    _pushMode = NO;
+    _pushed[0] = _pushed[1] = nil;
+    _pushedLastUse[0] = _pushedLastUse[1] = nil;
+    _pushedFront = -1;
+    _pushedReady = -1;
+    os_unfair_lock_unlock (&_sourceLock);
+    [_pushWriteLock unlock];
+}
+
+/* The overlay texture for this frame; a pushed bitmap that is ready is
+ * switched to here, between frames. @pushedIndex returns the pushed
+ * buffer sampled, or -1. */
+- (id<MTLTexture>)_acquireOverlay:(const OverlayParams *)params
+                      pushedIndex:(int *)pushedIndex
+{
+    id<MTLTexture> texture;
+    VfMetalOverlayAnimation *animation;
+
+    *pushedIndex = -1;
+
+    os_unfair_lock_lock (&_sourceLock);
+    if (_pushMode && _pushedReady >= 0) {
+        _pushedFront = _pushedReady;
+        _pushedReady = -1;
+    }
+    if (_pushMode && _pushedFront >= 0) {
+        *pushedIndex = _pushedFront;
+        texture = _pushed[_pushedFront];
+    } else {
+        texture = _overlayTexture;
+    }
+    animation = _pushMode ? nil : _animation;
+    os_unfair_lock_unlock (&_sourceLock);
+
+    if (animation)
+        texture = [animation frameAtTime:params->runningTime
+                               frameRate:params->frameRate
+                                    loop:params->loop];
+    return texture;
+}
+
+/* Record @commandBuffer, once committed, as the last reader of pushed
+ * buffer @index so -pushImage: waits for it before refilling */
+- (void)_releaseOverlay:(int)index commandBuffer:(id<MTLCommandBuffer>)commandBuffer
+{
+    if (index < 0)
+        return;
+    os_unfair_lock_lock (&_sourceLock);
+    _pushedLastUse[index] = commandBuffer;
+    os_unfair_lock_unlock (&_sourceLock);
 }
 
 - (BOOL)processFrame:(GstVideoFrame *)inFrame
               output:(GstVideoFrame *)outFrame
               params:(const OverlayParams *)params
+{
+    return [self _renderFrame:inFrame output:outFrame params:params
+                         slot:0 completion:nil];
+}
+
+- (BOOL)submitFrame:(GstVideoFrame *)inFrame
+             output:(GstVideoFrame *)outFrame
+             params:(const OverlayParams *)params
+               slot:(NSUInteger)slot
+         completion:(VfMetalCompletionHandler)completion
+{
+    return [self _renderFrame:inFrame output:outFrame params:params
+                         slot:slot completion:completion];
+}
+
+- (BOOL)_renderFrame:(GstVideoFrame *)inFrame
+              output:(GstVideoFrame *)outFrame
+              params:(const OverlayParams *)params
+                slot:(NSUInteger)slot
+          completion:(VfMetalCompletionHandler)completion
 {
     @autoreleasepool {
-        [_textureCache resetFrameIndex];
+        [_textureCache resetFrameIndexForSlot:slot];
 
         id<MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
         if (!commandBuffer) {
@@ -283,14 +1032,31 @@ typedef struct {
             return NO;
         }
 
+        VfMetalTraceSpan encodeSpan;
+        vf_metal_trace_begin (&encodeSpan, _traceOwner, VF_METAL_STATS_ENCODE);
+
         GstVideoFormat inFmt = GST_VIDEO_FRAME_FORMAT (inFrame);
         VfMetalInputFormat fmtIdx = vf_metal_input_format_index (inFmt);
         int frameW = GST_VIDEO_FRAME_WIDTH (inFrame);
         int frameH = GST_VIDEO_FRAME_HEIGHT (inFrame);
 
+        int pushedIndex;
+        id<MTLTexture> overlayTex = [self _acquireOverlay:params
+                                              pushedIndex:&pushedIndex];
+
         /* Build uniforms */
-        float overlayW = (params->width > 0) ? params->width : _overlayWidth;
-        float overlayH = (params->height > 0) ? params->height : _overlayHeight;
+        float overlayW = (params->width > 0)
+            ? params->width : (float) overlayTex.width;
+        float overlayH = (params->height > 0)
+            ? params->height : (float) overlayTex.height;
+
+        float bounds[4] = { G_MAXFLOAT, G_MAXFLOAT, -G_MAXFLOAT, -G_MAXFLOAT };
+        NSUInteger batchCount = [self _prepareBatch:params
+                                         frameWidth:frameW
+                                        frameHeight:frameH
+                                      commandBuffer:commandBuffer
+                                               slot:slot
+                                             bounds:bounds];
 
         OverlayUniformsGPU uniforms = {
             .overlayX = params->x,
@@ -334,8 +1100,8 @@ typedef struct {
             if (!yTex || !uvTex) { [encoder endEncoding]; return NO; }
             [encoder setFragmentTexture:yTex atIndex:0];
             [encoder setFragmentTexture:uvTex atIndex:1];
-            if (_overlayTexture) {
-                [encoder setFragmentTexture:_overlayTexture atIndex:2];
+            if (overlayTex) {
+                [encoder setFragmentTexture:overlayTex atIndex:2];
             }
         } else if (fmtIdx == VF_METAL_INPUT_I420) {
             id<MTLTexture> yTex =
@@ -354,8 +1120,8 @@ typedef struct {
             [encoder setFragmentTexture:yTex atIndex:0];
             [encoder setFragmentTexture:uTex atIndex:1];
             [encoder setFragmentTexture:vTex atIndex:2];
-            if (_overlayTexture) {
-                [encoder setFragmentTexture:_overlayTexture atIndex:3];
+            if (overlayTex) {
+                [encoder setFragmentTexture:overlayTex atIndex:3];
             }
         } else {
             MTLPixelFormat pixFmt = (inFmt == GST_VIDEO_FORMAT_BGRA)
@@ -365,8 +1131,8 @@ typedef struct {
                           format:pixFmt width:frameW height:frameH];
             if (!tex) { [encoder endEncoding]; return NO; }
             [encoder setFragmentTexture:tex atIndex:0];
-            if (_overlayTexture) {
-                [encoder setFragmentTexture:_overlayTexture atIndex:1];
+            if (overlayTex) {
+                [encoder setFragmentTexture:overlayTex atIndex:1];
             }
         }
 
@@ -377,6 +1143,18 @@ typedef struct {
         [encoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
                     vertexStart:0
                     vertexCount:4];
+
+        /* Configured images and composition rectangles, one instanced draw */
+        if (batchCount > 0) {
+            const float origin[2] = { 0.0f, 0.0f };
+            if (![self _encodeBatch:batchCount encoder:encoder slot:slot
+                             target:_renderTarget origin:origin scale:1.0f
+                              plane:VF_METAL_OVERLAY_PLANE_RGB
+                        colorMatrix:0]) {
+                [encoder endEncoding];
+                return NO;
+            }
+        }
         [encoder endEncoding];
 
         /* === Output format conversion === */
@@ -384,9 +1162,26 @@ typedef struct {
         [_yuvOutput dispatchConversion:commandBuffer
                          sourceTexture:_renderTarget
                                  width:_width height:_height
-                              outFrame:outFrame];
+                              outFrame:outFrame slot:slot];
+
+        if (completion) {
+            vf_metal_trace_end (&encodeSpan);
+            vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
+            [_yuvOutput commitPipelined:commandBuffer
+                          sourceTexture:_renderTarget
+                                  width:_width height:_height
+                               outFrame:outFrame slot:slot
+                             completion:completion];
+            [self _releaseOverlay:pushedIndex commandBuffer:commandBuffer];
+            [self _releaseBatch:batchCount commandBuffer:commandBuffer];
+            return YES;
+        }
 
+        vf_metal_trace_end (&encodeSpan);
+        vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
         [commandBuffer commit];
+        [self _releaseOverlay:pushedIndex commandBuffer:commandBuffer];
+        [self _releaseBatch:batchCount commandBuffer:commandBuffer];
         [commandBuffer waitUntilCompleted];
 
         if (commandBuffer.status == MTLCommandBufferStatusError) {
@@ -403,12 +1198,556 @@ typedef struct {
     }
 }
 
+- (guint)setImages:(const OverlayImageSpec *)specs count:(guint)count
+{
+    id<MTLDevice> device = _metalDevice.device;
+    NSMutableArray<VfMetalOverlayImage *> *images = [NSMutableArray array];
+
+    for (guint i = 0; i < count; i++) {
+        id<MTLTexture> texture =
+            vf_metal_load_overlay_image (specs[i].location, device);
+        if (!texture) {
+            GST_WARNING ("Failed to load overlay image: %s", specs[i].location);
+            continue;
+        }
+        VfMetalOverlayImage *image = [[VfMetalOverlayImage alloc] init];
+        OverlayImageSpec spec = specs[i];
+        spec.location = NULL;
+        image.texture = texture;
+        image.spec = spec;
+        [images addObject:image];
+    }
+
+    os_unfair_lock_lock (&_sourceLock);
+    _images = images.count > 0 ? images : nil;
+    _imagesGeneration++;
+    os_unfair_lock_unlock (&_sourceLock);
+
+    return (guint) images.count;
+}
+
+/* Make every configured image and composition rectangle of this frame
+ * resident in the atlas, uploading only new ones (images by a blit in
+ * @commandBuffer, composition pixels straight from the CPU), and write
+ * their instances into the slot's buffer. @bounds (x0, y0, x1, y1, in
+ * frame pixels) is grown to cover them. Returns the instance count. */
+- (NSUInteger)_prepareBatch:(const OverlayParams *)params
+                 frameWidth:(int)frameW
+                frameHeight:(int)frameH
+              commandBuffer:(id<MTLCommandBuffer>)commandBuffer
+                       slot:(NSUInteger)slot
+                     bounds:(float *)bounds
+{
+    NSArray<VfMetalOverlayImage *> *images;
+    guint generation;
+
+    os_unfair_lock_lock (&_sourceLock);
+    images = _images;
+    generation = _imagesGeneration;
+    os_unfair_lock_unlock (&_sourceLock);
+
+    NSUInteger nImages = images.count;
+    guint nRects = params->composition
+        ? gst_video_overlay_composition_n_rectangles (params->composition) : 0;
+    NSUInteger total = nImages + nRects;
+    if (total == 0)
+        return 0;
+
+    if (!_atlas)
+        _atlas = [[VfMetalOverlayAtlas alloc]
+            initWithDevice:_metalDevice.device];
+
+    MTLRegion *regions = g_new0 (MTLRegion, total);
+    gboolean *upload = g_new0 (gboolean, total);
+    BOOL reset = NO;
+
+    /* Place everything first: a full atlas is cleared once and refilled
+     * before any upload is issued */
+    for (NSUInteger i = 0; i < total; i++) {
+        guint64 key;
+        NSUInteger w, h;
+
+        if (i < nImages) {
+            key = OVERLAY_ATLAS_IMAGE_KEY (generation, i);
+            w = images[i].texture.width;
+            h = images[i].texture.height;
+        } else {
+            GstVideoOverlayRectangle *rect =
+                gst_video_overlay_composition_get_rectangle (
+                    params->composition, (guint) (i - nImages));
+            GstVideoMeta *vmeta = gst_buffer_get_video_meta (
+                gst_video_overlay_rectangle_get_pixels_unscaled_argb (rect,
+                    GST_VIDEO_OVERLAY_FORMAT_FLAG_NONE));
+            key = gst_video_overlay_rectangle_get_seqnum (rect);
+            w = vmeta ? vmeta->width : 0;
+            h = vmeta ? vmeta->height : 0;
+        }
+
+        upload[i] = FALSE;
+        regions[i].size.width = 0;
+        if (w == 0 || h == 0 || [_atlas lookupKey:key region:&regions[i]])
+            continue;
+        if ([_atlas insertKey:key width:w height:h region:&regions[i]]) {
+            upload[i] = TRUE;
+            continue;
+        }
+        if (!reset && [_atlas resetToFitWidth:w height:h]) {
+            reset = YES;
+            i = (NSUInteger) -1;    /* restart with an empty atlas */
+            continue;
+        }
+        GST_WARNING ("Overlay rectangle %lux%lu does not fit the atlas",
+                     (unsigned long) w, (unsigned long) h);
+        regions[i].size.width = 0;
+    }
+
+    id<MTLBlitCommandEncoder> blit = nil;
+    NSUInteger bytes = total * sizeof (OverlayInstanceGPU);
+    if (_instances[slot].length < bytes)
+        _instances[slot] = [_metalDevice.device
+            newBufferWithLength:bytes options:MTLResourceStorageModeShared];
+    OverlayInstanceGPU *instances = _instances[slot].contents;
+    float atlasSize = (float) _atlas.texture.width;
+    NSUInteger count = 0;
+
+    for (NSUInteger i = 0; instances && i < total; i++) {
+        MTLRegion region = regions[i];
+        OverlayInstanceGPU *inst = &instances[count];
+        float x, y, w, h;
+
+        if (region.size.width == 0)
+            continue;
+
+        if (i < nImages) {
+            VfMetalOverlayImage *image = images[i];
+            OverlayImageSpec spec = image.spec;
+
+            if (upload[i]) {
+                if (!blit)
+                    blit = [commandBuffer blitCommandEncoder];
+                [blit copyFromTexture:image.texture
+                          sourceSlice:0
+                          sourceLevel:0
+                         sourceOrigin:MTLOriginMake (0, 0, 0)
+                           sourceSize:region.size
+                            toTexture:_atlas.texture
+                     destinationSlice:0
+                     destinationLevel:0
+                    destinationOrigin:region.origin];
+            }
+
+            w = spec.width > 0 ? spec.width : (float) image.texture.width;
+            h = spec.height > 0 ? spec.height : (float) image.texture.height;
+            x = spec.relativeX >= 0.0 ? (float) (spec.relativeX * frameW)
+                                      : (float) spec.x;
+            y = spec.relativeY >= 0.0 ? (float) (spec.relativeY * frameH)
+                                      : (float) spec.y;
+            inst->alpha = (float) spec.alpha;
+            inst->swizzle = 0;
+        } else {
+            GstVideoOverlayRectangle *rect =
+                gst_video_overlay_composition_get_rectangle (
+                    params->composition, (guint) (i - nImages));
+
+            if (upload[i]) {
+                GstBuffer *pixels =
+                    gst_video_overlay_rectangle_get_pixels_unscaled_argb (rect,
+                        GST_VIDEO_OVERLAY_FORMAT_FLAG_NONE);
+                GstVideoMeta *vmeta = gst_buffer_get_video_meta (pixels);
+                GstMapInfo map;
+
+                if (gst_buffer_map (pixels, &map, GST_MAP_READ)) {
+                    [_atlas.texture replaceRegion:region
+                                      mipmapLevel:0
+                                        withBytes:map.data + vmeta->offset[0]
+                                      bytesPerRow:vmeta->stride[0]];
+                    gst_buffer_unmap (pixels, &map);
+                }
+            }
+
+            gint rx, ry;
+            guint rw, rh;
+            gst_video_overlay_rectangle_get_render_rectangle (rect,
+                &rx, &ry, &rw, &rh);
+            x = rx;
+            y = ry;
+            w = rw;
+            h = rh;
+            inst->alpha = gst_video_overlay_rectangle_get_global_alpha (rect);
+            /* GStreamer's ARGB is B, G, R, A in memory on little-endian */
+            inst->swizzle = 1;
+        }
+
+        inst->rect[0] = x;
+        inst->rect[1] = y;
+        inst->rect[2] = w;
+        inst->rect[3] = h;
+        inst->atlasRect[0] = region.origin.x / atlasSize;
+        inst->atlasRect[1] = region.origin.y / atlasSize;
+        inst->atlasRect[2] = region.size.width / atlasSize;
+        inst->atlasRect[3] = region.size.height / atlasSize;
+
+        bounds[0] = MIN (bounds[0], x);
+        bounds[1] = MIN (bounds[1], y);
+        bounds[2] = MAX (bounds[2], x + w);
+        bounds[3] = MAX (bounds[3], y + h);
+        count++;
+    }
+
+    [blit endEncoding];
+    g_free (regions);
+    g_free (upload);
+    return count;
+}
+
+/* Draw the @count prepared instances of @slot into the current pass.
+ * Frame pixel p lands on target pixel p * @scale - @origin. */
+- (BOOL)_encodeBatch:(NSUInteger)count
+             encoder:(id<MTLRenderCommandEncoder>)encoder
+                slot:(NSUInteger)slot
+              target:(id<MTLTexture>)target
+              origin:(const float *)origin
+               scale:(float)scale
+               plane:(VfMetalOverlayPlane)plane
+         colorMatrix:(int)colorMatrix
+{
+    id<MTLRenderPipelineState> pipeline =
+        [self _blendPipelineForFormat:target.pixelFormat batch:YES];
+    if (!pipeline)
+        return NO;
+
+    OverlayBatchUniformsGPU uniforms = {
+        .targetOrigin = { origin[0], origin[1] },
+        .targetSize = { (float) target.width, (float) target.height },
+        .scale = scale,
+        .plane = plane,
+        .colorMatrix = colorMatrix,
+    };
+
+    [encoder setRenderPipelineState:pipeline];
+    [encoder setVertexBytes:&uniforms length:sizeof(uniforms) atIndex:0];
+    [encoder setVertexBuffer:_instances[slot] offset:0 atIndex:1];
+    [encoder setFragmentBytes:&uniforms length:sizeof(uniforms) atIndex:0];
+    [encoder setFragmentTexture:_atlas.texture atIndex:0];
+    [encoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                vertexStart:0
+                vertexCount:4
+              instanceCount:count];
+    return YES;
+}
+
+/* Record @commandBuffer, once committed, as the last reader of the atlas
+ * so that clearing it waits for the frame */
+- (void)_releaseBatch:(NSUInteger)count commandBuffer:(id<MTLCommandBuffer>)commandBuffer
+{
+    if (count > 0)
+        _atlas.lastUse = commandBuffer;
+}
+
+/* Source-over pipeline drawing into @format: the in-place overlay
+ * rectangle, or (@batch) the instanced atlas rectangles */
+- (id<MTLRenderPipelineState>)_blendPipelineForFormat:(MTLPixelFormat)format
+                                               batch:(BOOL)batch
+{
+    NSNumber *key = @(format * 2 + (batch ? 1 : 0));
+    id<MTLRenderPipelineState> pipeline = _blendPipelines[key];
+    if (pipeline)
+        return pipeline;
+
+    MTLRenderPipelineDescriptor *desc =
+        [[MTLRenderPipelineDescriptor alloc] init];
+    desc.vertexFunction = [_library newFunctionWithName:
+        batch ? @"overlayBatchVertex" : @"overlayRectVertex"];
+    desc.fragmentFunction = [_library newFunctionWithName:
+        batch ? @"overlayBatchFragment" : @"overlayRectFragment"];
+
+    MTLRenderPipelineColorAttachmentDescriptor *ca = desc.colorAttachments[0];
+    ca.pixelFormat = format;
+    ca.blendingEnabled = YES;
+    ca.rgbBlendOperation = MTLBlendOperationAdd;
+    ca.sourceRGBBlendFactor = MTLBlendFactorSourceAlpha;
+    ca.destinationRGBBlendFactor = MTLBlendFactorOneMinusSourceAlpha;
+    /* The frame's own alpha is kept, as in the full-frame path */
+    ca.writeMask = MTLColorWriteMaskRed | MTLColorWriteMaskGreen |
+                   MTLColorWriteMaskBlue;
+
+    NSError *error = nil;
+    pipeline = [_metalDevice renderPipelineWithDescriptor:desc
+                                                                  library:_library
+                                                                    error:&error];
+    if (!pipeline) {
+        GST_ERROR ("Failed to create overlay blend pipeline: %s",
+                   error.localizedDescription.UTF8String);
+        return nil;
+    }
+    _blendPipelines[key] = pipeline;
+    return pipeline;
+}
+
+/* Staging texture of at least @width x @height; only grows, so a moving
+ * overlay does not reallocate it every frame */
+- (id<MTLTexture>)_stagingForSlot:(NSUInteger)slot
+                            plane:(guint)plane
+                           format:(MTLPixelFormat)format
+                            width:(int)width
+                           height:(int)height
+{
+    id<MTLTexture> texture = _staging[slot][plane];
+    if (texture && texture.pixelFormat == format &&
+        (int) texture.width >= width && (int) texture.height >= height)
+        return texture;
+
+    MTLTextureDescriptor *desc = [MTLTextureDescriptor
+        texture2DDescriptorWithPixelFormat:format
+            width:MAX (width, texture ? (int) texture.width : 0)
+            height:MAX (height, texture ? (int) texture.height : 0)
+            mipmapped:NO];
+    desc.usage = MTLTextureUsageShaderRead | MTLTextureUsageRenderTarget;
+    desc.storageMode = _metalDevice.hostStorageMode;
+
+    texture = [_metalDevice.device newTextureWithDescriptor:desc];
+    _staging[slot][plane] = texture;
+    return texture;
+}
+
+static void
+overlay_readback (const OverlayReadback *readback,
+    NSArray<id<MTLTexture>> *staging)
+{
+    for (guint p = 0; p < readback->n; p++) {
+        [staging[p] getBytes:readback->planes[p].dst
+                 bytesPerRow:readback->planes[p].stride
+                  fromRegion:MTLRegionMake2D(0, 0, readback->planes[p].width,
+                                             readback->planes[p].height)
+                 mipmapLevel:0];
+    }
+}
+
+- (BOOL)blendInPlace:(GstVideoFrame *)frame
+              params:(const OverlayParams *)params
+                slot:(NSUInteger)slot
+          completion:(VfMetalCompletionHandler)completion
+{
+    @autoreleasepool {
+        id<MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
+        if (!commandBuffer) {
+            GST_ERROR ("Failed to create Metal command buffer");
+            return NO;
+        }
+
+        VfMetalTraceSpan encodeSpan;
+        vf_metal_trace_begin (&encodeSpan, _traceOwner, VF_METAL_STATS_ENCODE);
+
+        int pushedIndex;
+        id<MTLTexture> overlayTex = [self _acquireOverlay:params
+                                              pushedIndex:&pushedIndex];
+
+        OverlayPlaneLayout layouts[3];
+        guint nPlanes = overlay_plane_layouts (GST_VIDEO_FRAME_FORMAT (frame),
+                                               layouts);
+        int frameW = GST_VIDEO_FRAME_WIDTH (frame);
+        int frameH = GST_VIDEO_FRAME_HEIGHT (frame);
+        float overlayW = (params->width > 0)
+            ? params->width : (float) overlayTex.width;
+        float overlayH = (params->height > 0)
+            ? params->height : (float) overlayTex.height;
+
+        BOOL drawMain = overlayTex && params->alpha > 0.0f;
+        float bounds[4] = { G_MAXFLOAT, G_MAXFLOAT, -G_MAXFLOAT, -G_MAXFLOAT };
+        if (drawMain) {
+            bounds[0] = params->x;
+            bounds[1] = params->y;
+            bounds[2] = params->x + overlayW;
+            bounds[3] = params->y + overlayH;
+        }
+
+        VfMetalTraceSpan uploadSpan;
+        vf_metal_trace_begin (&uploadSpan, _traceOwner, VF_METAL_STATS_UPLOAD);
+        NSUInteger batchCount = [self _prepareBatch:params
+                                         frameWidth:frameW
+                                        frameHeight:frameH
+                                      commandBuffer:commandBuffer
+                                               slot:slot
+                                             bounds:bounds];
+
+        /* Every overlay rectangle together, clipped to the frame, in whole
+         * 2x2 blocks when chroma is subsampled */
+        BOOL empty = bounds[2] <= bounds[0] || bounds[3] <= bounds[1];
+        int x0 = empty ? 0 : MAX ((int) floorf (bounds[0]), 0);
+        int y0 = empty ? 0 : MAX ((int) floorf (bounds[1]), 0);
+        int x1 = empty ? 0 : MIN ((int) ceilf (bounds[2]), frameW);
+        int y1 = empty ? 0 : MIN ((int) ceilf (bounds[3]), frameH);
+        if (nPlanes > 1) {
+            x0 &= ~1;
+            y0 &= ~1;
+            x1 = MIN ((x1 + 1) & ~1, frameW);
+            y1 = MIN ((y1 + 1) & ~1, frameH);
+        }
+        empty = x1 <= x0 || y1 <= y0;
+
+        OverlayReadback readback = { 0 };
+        NSMutableArray<id<MTLTexture>> *staging = [NSMutableArray array];
+
+        for (guint p = 0; !empty && p < nPlanes; p++) {
+            const OverlayPlaneLayout *layout = &layouts[p];
+            int scale = 1 << layout->shift;
+            int px0 = x0 / scale;
+            int py0 = y0 / scale;
+            int pw = (x1 + scale - 1) / scale - px0;
+            int ph = (y1 + scale - 1) / scale - py0;
+
+            /* GPU frames are drawn into directly; system memory only has
+             * the rectangle copied through a staging texture */
+            id<MTLTexture> target =
+                vf_metal_frame_peek_texture (frame, p, _metalDevice.device);
+            float originX = 0.0f, originY = 0.0f;
+            float rectX = px0, rectY = py0;
+
+            if (!target) {
+                target = [self _stagingForSlot:slot plane:p
+                                        format:layout->format
+                                         width:pw height:ph];
+                if (!target) {
+                    vf_metal_trace_end (&uploadSpan);
+                    vf_metal_trace_end (&encodeSpan);
+                    return NO;
+                }
+
+                guint8 *data = (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (frame, p);
+                gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, p);
+                guint8 *rect = data + (gsize) py0 * stride +
+                    (gsize) px0 * layout->bpp;
+                [target replaceRegion:MTLRegionMake2D(0, 0, pw, ph)
+                          mipmapLevel:0
+                            withBytes:rect
+                          bytesPerRow:stride];
+
+                readback.planes[readback.n].dst = rect;
+                readback.planes[readback.n].stride = stride;
+                readback.planes[readback.n].width = pw;
+                readback.planes[readback.n].height = ph;
+                readback.n++;
+                [staging addObject:target];
+
+                originX = px0;
+                originY = py0;
+                rectX = 0.0f;
+                rectY = 0.0f;
+            } else {
+                vf_metal_frame_mark_gpu_written (frame);
+            }
+
+            OverlayRectUniformsGPU uniforms = {
+                .rect = { rectX, rectY, (float) pw, (float) ph },
+                .overlayRect = { params->x / scale - originX,
+                                 params->y / scale - originY,
+                                 overlayW / scale, overlayH / scale },
+                .targetSize = { (float) target.width, (float) target.height },
+                .alpha = params->alpha,
+                .plane = layout->plane,
+                .colorMatrix = vf_metal_color_matrix_for_frame (frame),
+            };
+
+            MTLRenderPassDescriptor *rpDesc =
+                [MTLRenderPassDescriptor renderPassDescriptor];
+            rpDesc.colorAttachments[0].texture = target;
+            rpDesc.colorAttachments[0].loadAction = MTLLoadActionLoad;
+            rpDesc.colorAttachments[0].storeAction = MTLStoreActionStore;
+
+            id<MTLRenderPipelineState> pipeline =
+                [self _blendPipelineForFormat:target.pixelFormat batch:NO];
+            id<MTLRenderCommandEncoder> encoder = pipeline ?
+                [commandBuffer renderCommandEncoderWithDescriptor:rpDesc] : nil;
+            if (!encoder) {
+                vf_metal_trace_end (&uploadSpan);
+                vf_metal_trace_end (&encodeSpan);
+                return NO;
+            }
+
+            if (drawMain) {
+                [encoder setRenderPipelineState:pipeline];
+                [encoder setVertexBytes:&uniforms length:sizeof(uniforms)
+                                atIndex:0];
+                [encoder setFragmentBytes:&uniforms length:sizeof(uniforms)
+                                  atIndex:0];
+                [encoder setFragmentTexture:overlayTex atIndex:0];
+                [encoder drawPrimitives:MTLPrimitiveTypeTriangleStrip
+                            vertexStart:0
+                            vertexCount:4];
+            }
+
+            const float origin[2] = { originX, originY };
+            if (batchCount > 0 &&
+                ![self _encodeBatch:batchCount encoder:encoder slot:slot
+                             target:target origin:origin
+                              scale:1.0f / scale plane:layout->plane
+                        colorMatrix:uniforms.colorMatrix]) {
+                [encoder endEncoding];
+                vf_metal_trace_end (&uploadSpan);
+                vf_metal_trace_end (&encodeSpan);
+                return NO;
+            }
+            [encoder endEncoding];
+        }
+        vf_metal_trace_end (&uploadSpan);
+
+        /* Both readback paths follow this buffer, so encode it once */
+        [_metalDevice encodeSynchronizeTextures:staging
+                                  commandBuffer:commandBuffer];
+        vf_metal_trace_end (&encodeSpan);
+        vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
+
+        if (completion) {
+            GstObject *traceOwner = _traceOwner;
+            [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> cb) {
+                BOOL ok = (cb.status != MTLCommandBufferStatusError);
+                if (ok) {
+                    VfMetalTraceSpan span;
+                    vf_metal_trace_begin (&span, traceOwner,
+                                          VF_METAL_STATS_READBACK);
+                    overlay_readback (&readback, staging);
+                    vf_metal_trace_end (&span);
+                }
+                completion (ok);
+            }];
+            [commandBuffer commit];
+            [self _releaseOverlay:pushedIndex commandBuffer:commandBuffer];
+            [self _releaseBatch:batchCount commandBuffer:commandBuffer];
+            return YES;
+        }
+
+        [commandBuffer commit];
+        [self _releaseOverlay:pushedIndex commandBuffer:commandBuffer];
+        [self _releaseBatch:batchCount commandBuffer:commandBuffer];
+        [commandBuffer waitUntilCompleted];
+
+        if (commandBuffer.status == MTLCommandBufferStatusError) {
+            GST_ERROR ("Metal command buffer failed: %s",
+                       commandBuffer.error.localizedDescription.UTF8String);
+            return NO;
+        }
+
+        VfMetalTraceSpan readbackSpan;
+        vf_metal_trace_begin (&readbackSpan, _traceOwner,
+                              VF_METAL_STATS_READBACK);
+        overlay_readback (&readback, staging);
+        vf_metal_trace_end (&readbackSpan);
+        return YES;
+    }
+}
+
 - (void)cleanup
 {
     [_textureCache clear];
     _renderTarget = nil;
     [_yuvOutput cleanup];
-    _overlayTexture = nil;
+    for (int i = 0; i < VF_METAL_MAX_IN_FLIGHT; i++)
+        for (int p = 0; p < 3; p++)
+            _staging[i][p] = nil;
+    for (int i = 0; i < VF_METAL_MAX_IN_FLIGHT; i++)
+        _instances[i] = nil;
+    _atlas = nil;
+    /* The overlay source stays: properties are not re-applied on restart */
     for (int f = 0; f < VF_METAL_INPUT_COUNT; f++)
         _pipelines[f] = nil;
 }
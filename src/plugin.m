@@ -32,12 +32,18 @@
 #include "transform/gstvfmetaltransform.h"
 #include "deinterlace/gstvfmetaldeinterlace.h"
 #include "overlay/gstvfmetaloverlay.h"
+#include "chain/gstvfmetalchain.h"
+#include "scaleladder/gstvfmetalscaleladder.h"
+#import "common/vfmetalmemory.h"
+#import "common/vfmetaltrace.h"
 
 static gboolean
 plugin_init (GstPlugin * plugin)
 {
   gboolean ret = TRUE;
 
+  gst_vf_metal_memory_init_once ();
+
   ret &= GST_ELEMENT_REGISTER (vfmetalcompositor, plugin);
 #ifndef DISABLE_VIDEOSINK
   ret &= GST_ELEMENT_REGISTER (vfmetalvideosink, plugin);
@@ -47,6 +53,10 @@ plugin_init (GstPlugin * plugin)
   ret &= GST_ELEMENT_REGISTER (vfmetaltransform, plugin);
   ret &= GST_ELEMENT_REGISTER (vfmetaldeinterlace, plugin);
   ret &= GST_ELEMENT_REGISTER (vfmetaloverlay, plugin);
+  ret &= GST_ELEMENT_REGISTER (vfmetalchain, plugin);
+  ret &= GST_ELEMENT_REGISTER (vfmetalscaleladder, plugin);
+
+  ret &= vf_metal_trace_register (plugin);
 
   return ret;
 }
@@ -0,0 +1,106 @@
+/* GStreamer Metal multi-rendition scale ladder element
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_VF_METAL_SCALE_LADDER_H__
+#define __GST_VF_METAL_SCALE_LADDER_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/base/gstflowcombiner.h>
+
+#include "vfmetalcontext.h"
+#include "vfmetalinflight.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_VF_METAL_SCALE_LADDER_PAD \
+    (gst_vf_metal_scale_ladder_pad_get_type())
+G_DECLARE_FINAL_TYPE (GstVfMetalScaleLadderPad,
+    gst_vf_metal_scale_ladder_pad, GST, VF_METAL_SCALE_LADDER_PAD, GstPad)
+
+#define GST_TYPE_VF_METAL_SCALE_LADDER (gst_vf_metal_scale_ladder_get_type())
+G_DECLARE_FINAL_TYPE (GstVfMetalScaleLadder, gst_vf_metal_scale_ladder,
+    GST, VF_METAL_SCALE_LADDER, GstElement)
+
+/**
+ * GstVfMetalScaleLadderPad:
+ *
+ * One rendition. Its size and format come from downstream caps.
+ */
+struct _GstVfMetalScaleLadderPad
+{
+  GstPad pad;
+
+  /* Negotiated rendition; only touched from the streaming thread */
+  GstVideoInfo info;
+  gboolean negotiated;
+  GstBufferPool *pool;
+
+  /* MetalConvertScaleRenderer (opaque Obj-C object), created on the
+   * element's device from READY on */
+  void *renderer;
+};
+
+/**
+ * GstVfMetalScaleLadder:
+ *
+ * One sink pad and any number of src_%u request pads. Each input frame is
+ * uploaded once and every rendition is encoded into a single command
+ * buffer, each one scaled from the next larger rendition when cascading.
+ * Up to in-flight frames are on the GPU at once; each is pushed to every
+ * pad once read back.
+ */
+struct _GstVfMetalScaleLadder
+{
+  GstElement element;
+
+  GstPad *sinkpad;
+
+  /* Properties, shared by every rendition */
+  gint method;              /* VfMetalScaleMethod */
+  gboolean add_borders;
+  guint32 border_color;     /* ARGB */
+  gboolean cascade;
+  guint in_flight;          /* under the object lock */
+
+  /* GPU every rendition runs on; metal_device is the VfMetalDevice chosen
+   * at NULL_TO_READY (registry-owned), under the object lock */
+  VfMetalDeviceSelection device;
+  void *metal_device;
+
+  /* Negotiated input */
+  GstVideoInfo in_info;
+  GstCaps *in_caps;
+  gboolean negotiated;
+
+  /* Submitted frames, oldest first; each job holds its renditions */
+  VfMetalInflight inflight;
+
+  /* Protected by the object lock */
+  GstFlowCombiner *flow_combiner;
+  guint next_pad_id;
+};
+
+GST_ELEMENT_REGISTER_DECLARE (vfmetalscaleladder);
+
+G_END_DECLS
+
+#endif /* __GST_VF_METAL_SCALE_LADDER_H__ */
@@ -0,0 +1,1209 @@
+/* GStreamer Metal multi-rendition scale ladder element
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-vfmetalscaleladder
+ * @title: vfmetalscaleladder
+ *
+ * Produces several scaled (and optionally format-converted) renditions of
+ * one video stream, one per src_%u request pad, for ABR ladders and
+ * thumbnails. Each frame is uploaded once and all renditions are encoded
+ * into one Metal command buffer; with cascade enabled each rendition is
+ * scaled from the next larger one instead of the full-size input. The
+ * renditions are read back concurrently once the GPU has finished; with
+ * in-flight above 1 the streaming thread pushes them as frames complete
+ * instead of waiting for each one.
+ *
+ * The size and format of each rendition come from its downstream caps.
+ *
+ * ## Sample pipelines
+ * |[
+ * gst-launch-1.0 videotestsrc ! video/x-raw,format=NV12,width=1920,height=1080 ! \
+ *   vfmetalscaleladder name=l \
+ *   l. ! queue ! video/x-raw,width=1280,height=720 ! fakesink \
+ *   l. ! queue ! video/x-raw,width=640,height=360 ! fakesink
+ * ]|
+ */
+
+#import <Foundation/Foundation.h>
+#import <Metal/Metal.h>
+#include "gstvfmetalscaleladder.h"
+#include "gstvfmetalconvertscale.h"
+#include "metalconvertscalerenderer.h"
+#import "vfmetaldevice.h"
+#import "vfmetalmemory.h"
+#import "vfmetaltrace.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_vf_metal_scale_ladder_debug);
+#define GST_CAT_DEFAULT gst_vf_metal_scale_ladder_debug
+
+#define VF_METAL_SCALE_LADDER_FORMATS \
+    "{ BGRA, RGBA, NV12, I420, UYVY, YUY2, P010_10LE, I420_10LE }"
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_SCALE_LADDER_FORMATS))
+    );
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_SCALE_LADDER_FORMATS))
+    );
+
+enum
+{
+  PROP_0,
+  PROP_METHOD,
+  PROP_ADD_BORDERS,
+  PROP_BORDER_COLOR,
+  PROP_CASCADE,
+  PROP_DEVICE,
+  PROP_IN_FLIGHT,
+};
+
+#define DEFAULT_METHOD          0   /* bilinear */
+#define DEFAULT_ADD_BORDERS     FALSE
+#define DEFAULT_BORDER_COLOR    0xFF000000  /* opaque black */
+#define DEFAULT_CASCADE         TRUE
+#define DEFAULT_IN_FLIGHT       2   /* encode the next frame meanwhile */
+
+/* --- GType boilerplate --- */
+
+G_DEFINE_TYPE (GstVfMetalScaleLadderPad, gst_vf_metal_scale_ladder_pad,
+    GST_TYPE_PAD);
+
+#define gst_vf_metal_scale_ladder_parent_class parent_class
+G_DEFINE_TYPE (GstVfMetalScaleLadder, gst_vf_metal_scale_ladder,
+    GST_TYPE_ELEMENT);
+
+GST_ELEMENT_REGISTER_DEFINE (vfmetalscaleladder, "vfmetalscaleladder",
+    GST_RANK_NONE, GST_TYPE_VF_METAL_SCALE_LADDER);
+
+/* --- Rendition pad --- */
+
+static void
+gst_vf_metal_scale_ladder_pad_reset (GstVfMetalScaleLadderPad * lpad)
+{
+  if (lpad->pool) {
+    gst_buffer_pool_set_active (lpad->pool, FALSE);
+    gst_object_unref (lpad->pool);
+    lpad->pool = NULL;
+  }
+  lpad->negotiated = FALSE;
+
+  if (lpad->renderer) {
+    @autoreleasepool {
+      MetalConvertScaleRenderer *renderer =
+          (__bridge MetalConvertScaleRenderer *)lpad->renderer;
+      [renderer cleanup];
+    }
+  }
+}
+
+static void
+gst_vf_metal_scale_ladder_pad_finalize (GObject * object)
+{
+  GstVfMetalScaleLadderPad *lpad = GST_VF_METAL_SCALE_LADDER_PAD (object);
+
+  gst_vf_metal_scale_ladder_pad_reset (lpad);
+
+  if (lpad->renderer) {
+    @autoreleasepool {
+      MetalConvertScaleRenderer *renderer =
+          (__bridge_transfer MetalConvertScaleRenderer *)lpad->renderer;
+      lpad->renderer = NULL;
+      (void)renderer;
+    }
+  }
+
+  G_OBJECT_CLASS (gst_vf_metal_scale_ladder_pad_parent_class)->finalize
+      (object);
+}
+
+static void
+gst_vf_metal_scale_ladder_pad_class_init (GstVfMetalScaleLadderPadClass *
+    klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+
+  gobject_class->finalize = gst_vf_metal_scale_ladder_pad_finalize;
+}
+
+static void
+gst_vf_metal_scale_ladder_pad_init (GstVfMetalScaleLadderPad * lpad)
+{
+  gst_video_info_init (&lpad->info);
+}
+
+/* (Re)create the rendition's renderer when it is not on @device yet */
+static gboolean
+gst_vf_metal_scale_ladder_pad_ensure_renderer (GstVfMetalScaleLadderPad *
+    lpad, VfMetalDevice * device)
+{
+  @autoreleasepool {
+    if (lpad->renderer) {
+      MetalConvertScaleRenderer *renderer =
+          (__bridge MetalConvertScaleRenderer *)lpad->renderer;
+      if (renderer.metalDevice == device)
+        return TRUE;
+
+      renderer = (__bridge_transfer MetalConvertScaleRenderer *)lpad->renderer;
+      lpad->renderer = NULL;
+      [renderer cleanup];
+    }
+
+    MetalConvertScaleRenderer *renderer =
+        [[MetalConvertScaleRenderer alloc] initWithDevice:device];
+    if (!renderer) {
+      GST_ERROR_OBJECT (lpad, "Failed to create Metal renderer on '%s'",
+          device.device.name.UTF8String);
+      return FALSE;
+    }
+    lpad->renderer = (__bridge_retained void *)renderer;
+  }
+
+  return TRUE;
+}
+
+/* --- Per-rendition negotiation --- */
+
+static gboolean
+gst_vf_metal_scale_ladder_decide_allocation (GstVfMetalScaleLadder * self,
+    GstVfMetalScaleLadderPad * lpad, GstCaps * caps)
+{
+  GstQuery *query;
+  GstBufferPool *pool = NULL;
+  GstStructure *config;
+  guint size = 0, min_buffers = 0, max_buffers = 0;
+
+  query = gst_query_new_allocation (caps, TRUE);
+  if (!gst_pad_peer_query (GST_PAD (lpad), query))
+    GST_DEBUG_OBJECT (lpad, "Peer ALLOCATION query failed");
+
+  if (!gst_vf_metal_memory_decide_allocation (query,
+          ((__bridge MetalConvertScaleRenderer *)lpad->renderer).metalDevice)) {
+    gst_query_unref (query);
+    return FALSE;
+  }
+  vf_metal_inflight_adjust_allocation (&self->inflight, query);
+
+  if (gst_query_get_n_allocation_pools (query) > 0)
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size,
+        &min_buffers, &max_buffers);
+  if (!pool)
+    pool = gst_video_buffer_pool_new ();
+  size = MAX (size, (guint) GST_VIDEO_INFO_SIZE (&lpad->info));
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size, min_buffers,
+      max_buffers);
+  if (gst_query_find_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL))
+    gst_buffer_pool_config_add_option (config,
+        GST_BUFFER_POOL_OPTION_VIDEO_META);
+  gst_query_unref (query);
+
+  if (!gst_buffer_pool_set_config (pool, config) ||
+      !gst_buffer_pool_set_active (pool, TRUE)) {
+    GST_ERROR_OBJECT (lpad, "Failed to configure output buffer pool");
+    gst_object_unref (pool);
+    return FALSE;
+  }
+
+  if (lpad->pool) {
+    gst_buffer_pool_set_active (lpad->pool, FALSE);
+    gst_object_unref (lpad->pool);
+  }
+  lpad->pool = pool;
+
+  return TRUE;
+}
+
+static gboolean
+gst_vf_metal_scale_ladder_negotiate_pad (GstVfMetalScaleLadder * self,
+    GstVfMetalScaleLadderPad * lpad)
+{
+  GstPad *pad = GST_PAD (lpad);
+  GstCaps *templ, *peercaps, *caps;
+  gboolean ret;
+
+  lpad->negotiated = FALSE;
+  if (!self->in_caps || !lpad->renderer)
+    return FALSE;
+
+  templ = gst_pad_get_pad_template_caps (pad);
+  peercaps = gst_pad_peer_query_caps (pad, templ);
+  gst_caps_unref (templ);
+
+  if (gst_caps_is_empty (peercaps)) {
+    GST_WARNING_OBJECT (lpad, "No caps in common with downstream");
+    gst_caps_unref (peercaps);
+    return FALSE;
+  }
+
+  caps = gst_vf_metal_convertscale_fixate_output (self->in_caps, peercaps);
+  if (!gst_video_info_from_caps (&lpad->info, caps)) {
+    GST_ERROR_OBJECT (lpad, "Failed to parse rendition caps %" GST_PTR_FORMAT,
+        caps);
+    gst_caps_unref (caps);
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (lpad, "Rendition caps %" GST_PTR_FORMAT, caps);
+
+  /* Sticky: stored even while the pad is not linked yet */
+  gst_pad_push_event (pad, gst_event_new_caps (caps));
+  ret = gst_vf_metal_scale_ladder_decide_allocation (self, lpad, caps);
+  gst_caps_unref (caps);
+
+  lpad->negotiated = ret;
+  return ret;
+}
+
+/* Src pads, referenced, under the object lock */
+static GPtrArray *
+gst_vf_metal_scale_ladder_get_src_pads (GstVfMetalScaleLadder * self)
+{
+  GPtrArray *pads = g_ptr_array_new_with_free_func (gst_object_unref);
+  GList *l;
+
+  GST_OBJECT_LOCK (self);
+  for (l = GST_ELEMENT (self)->srcpads; l; l = l->next)
+    g_ptr_array_add (pads, gst_object_ref (l->data));
+  GST_OBJECT_UNLOCK (self);
+
+  return pads;
+}
+
+static gboolean
+gst_vf_metal_scale_ladder_set_caps (GstVfMetalScaleLadder * self,
+    GstCaps * caps)
+{
+  GPtrArray *pads;
+
+  GST_DEBUG_OBJECT (self, "set_caps: %" GST_PTR_FORMAT, caps);
+
+  if (!gst_video_info_from_caps (&self->in_info, caps)) {
+    GST_ERROR_OBJECT (self, "Failed to parse input caps");
+    return FALSE;
+  }
+
+  gst_caps_replace (&self->in_caps, caps);
+  self->negotiated = TRUE;
+
+  /* Renditions that fail now are retried on the next buffer */
+  pads = gst_vf_metal_scale_ladder_get_src_pads (self);
+  for (guint i = 0; i < pads->len; i++) {
+    GstVfMetalScaleLadderPad *lpad = g_ptr_array_index (pads, i);
+    if (!gst_vf_metal_scale_ladder_negotiate_pad (self, lpad))
+      gst_pad_mark_reconfigure (GST_PAD (lpad));
+  }
+  g_ptr_array_unref (pads);
+
+  return TRUE;
+}
+
+/* --- Rendering --- */
+
+/* One rendition of a submitted frame, owned by the job's held array */
+typedef struct
+{
+  GstVfMetalScaleLadderPad *pad;
+  GstBuffer *outbuf;
+  GstVideoFrame frame;
+  gboolean mapped;
+  gint source;                  /* rung scaled from, -1 for the input */
+} VfLadderRung;
+
+static void
+gst_vf_metal_scale_ladder_rung_free (VfLadderRung * rung)
+{
+  if (rung->mapped)
+    gst_video_frame_unmap (&rung->frame);
+  gst_clear_buffer (&rung->outbuf);
+  gst_object_unref (rung->pad);
+  g_free (rung);
+}
+
+/* Largest rendition first, so each one can be scaled from the previous */
+static gint
+gst_vf_metal_scale_ladder_compare_rungs (gconstpointer a, gconstpointer b)
+{
+  const VfLadderRung *ra = *(VfLadderRung * const *) a;
+  const VfLadderRung *rb = *(VfLadderRung * const *) b;
+  guint64 area_a = (guint64) GST_VIDEO_INFO_WIDTH (&ra->pad->info) *
+      GST_VIDEO_INFO_HEIGHT (&ra->pad->info);
+  guint64 area_b = (guint64) GST_VIDEO_INFO_WIDTH (&rb->pad->info) *
+      GST_VIDEO_INFO_HEIGHT (&rb->pad->info);
+
+  return (area_a < area_b) - (area_a > area_b);
+}
+
+/* A rendition can feed the next one when it holds the whole picture:
+ * no letterbox, or an aspect ratio equal to the input's */
+static gboolean
+gst_vf_metal_scale_ladder_covers_picture (GstVfMetalScaleLadder * self,
+    GstVideoInfo * info)
+{
+  gint64 a, b;
+
+  if (!self->add_borders)
+    return TRUE;
+
+  a = (gint64) GST_VIDEO_INFO_WIDTH (info) *
+      GST_VIDEO_INFO_HEIGHT (&self->in_info);
+  b = (gint64) GST_VIDEO_INFO_HEIGHT (info) *
+      GST_VIDEO_INFO_WIDTH (&self->in_info);
+  return ABS (a - b) <= MAX (a, b) / 100;
+}
+
+/* Unmap @job's renditions and push each one to its pad */
+static GstFlowReturn
+gst_vf_metal_scale_ladder_finish_job (GstVfMetalScaleLadder * self,
+    VfMetalInflightJob * job)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  if (!job->ok) {
+    GST_WARNING_OBJECT (self, "Metal rendering failed");
+    vf_metal_inflight_job_free (job);
+    return GST_FLOW_ERROR;
+  }
+
+  for (guint i = 0; i < job->held->len; i++) {
+    VfLadderRung *rung = g_ptr_array_index (job->held, i);
+    GstBuffer *outbuf = rung->outbuf;
+    GstFlowReturn pad_ret;
+
+    gst_video_frame_unmap (&rung->frame);
+    rung->mapped = FALSE;
+    rung->outbuf = NULL;
+
+    pad_ret = gst_pad_push (GST_PAD (rung->pad), outbuf);
+    GST_OBJECT_LOCK (self);
+    ret = gst_flow_combiner_update_pad_flow (self->flow_combiner,
+        GST_PAD (rung->pad), pad_ret);
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  vf_metal_inflight_job_free (job);
+  return ret;
+}
+
+/* Push every queued frame downstream, in order */
+static GstFlowReturn
+gst_vf_metal_scale_ladder_drain (GstVfMetalScaleLadder * self)
+{
+  VfMetalInflightJob *job;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  while ((job = vf_metal_inflight_pop (&self->inflight, TRUE))) {
+    if (ret != GST_FLOW_OK) {
+      vf_metal_inflight_job_free (job);
+      continue;
+    }
+    ret = gst_vf_metal_scale_ladder_finish_job (self, job);
+  }
+
+  return ret;
+}
+
+/* Set every rendition up for this frame and pick what it is scaled from.
+ * Rebuilding a renderer drops the slot textures queued frames are still
+ * read back from, so those go out first. */
+static gboolean
+gst_vf_metal_scale_ladder_configure (GstVfMetalScaleLadder * self,
+    GPtrArray * rungs)
+{
+  @autoreleasepool {
+    gboolean drained = FALSE;
+    gint source = -1;
+    GstVideoInfo source_info;
+
+    for (guint i = 0; i < rungs->len; i++) {
+      VfLadderRung *rung = g_ptr_array_index (rungs, i);
+      MetalConvertScaleRenderer *renderer =
+          (__bridge MetalConvertScaleRenderer *)rung->pad->renderer;
+      GstVideoInfo *in_info = source >= 0 ? &source_info : &self->in_info;
+      GstVideoInfo *out_info = &rung->pad->info;
+      gboolean feeds_next = self->cascade && i + 1 < rungs->len &&
+          gst_vf_metal_scale_ladder_covers_picture (self, out_info);
+
+      rung->source = source;
+      renderer.keepsRenderTarget = feeds_next;
+      renderer.traceOwner = GST_OBJECT (self);
+
+      if (!drained &&
+          [renderer needsConfigureWithInputInfo:in_info
+                                     outputInfo:out_info
+                                         method:(VfMetalScaleMethod)self->method
+                                     addBorders:self->add_borders
+                                    borderColor:self->border_color]) {
+        GstFlowReturn ret = gst_vf_metal_scale_ladder_drain (self);
+        if (ret != GST_FLOW_OK)
+          GST_DEBUG_OBJECT (self, "drain before reconfigure returned %s",
+              gst_flow_get_name (ret));
+        drained = TRUE;
+      }
+
+      if (![renderer configureWithInputInfo:in_info
+                                 outputInfo:out_info
+                                     method:(VfMetalScaleMethod)self->method
+                                 addBorders:self->add_borders
+                                borderColor:self->border_color]) {
+        GST_ERROR_OBJECT (rung->pad, "Failed to configure rendition");
+        return FALSE;
+      }
+
+      /* The next rendition reads this one's RGBA picture instead of the
+       * input: cheaper to sample, and already converted */
+      if (feeds_next && renderer.renderTarget) {
+        source = (gint) i;
+        gst_video_info_set_format (&source_info,
+            (renderer.renderTarget.pixelFormat == MTLPixelFormatRGBA8Unorm)
+                ? GST_VIDEO_FORMAT_RGBA : GST_VIDEO_FORMAT_BGRA,
+            GST_VIDEO_INFO_WIDTH (out_info), GST_VIDEO_INFO_HEIGHT (out_info));
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+/* Encode every rendition of @job into one command buffer and commit it.
+ * The completion handler reads them all back concurrently; the streaming
+ * thread pushes them once the job is popped. */
+static gboolean
+gst_vf_metal_scale_ladder_submit (GstVfMetalScaleLadder * self,
+    VfMetalInflightJob * job)
+{
+  @autoreleasepool {
+    GPtrArray *rungs = job->held;
+    guint n_rungs = rungs->len;
+    NSUInteger slot = job->slot;
+
+    /* Every rendition's renderer is on the element's device */
+    VfLadderRung *largest = g_ptr_array_index (rungs, 0);
+    MetalConvertScaleRenderer *first =
+        (__bridge MetalConvertScaleRenderer *)largest->pad->renderer;
+    id<MTLCommandBuffer> commandBuffer =
+        [first.metalDevice.commandQueue commandBuffer];
+    if (!commandBuffer) {
+      GST_ERROR_OBJECT (self, "Failed to create Metal command buffer");
+      return FALSE;
+    }
+
+    VfMetalTraceSpan encode_span;
+    vf_metal_trace_begin (&encode_span, GST_OBJECT (self),
+        VF_METAL_STATS_ENCODE);
+
+    /* The input is uploaded once; renditions not scaled from a larger
+     * one all sample these planes */
+    NSArray<id<MTLTexture>> *planes =
+        [first uploadInputPlanes:&job->in_frame slot:slot];
+    if (!planes) {
+      GST_ERROR_OBJECT (self, "Failed to upload input frame");
+      vf_metal_trace_end (&encode_span);
+      return FALSE;
+    }
+
+    NSMutableArray<MetalConvertScaleRenderer *> *renderers =
+        [NSMutableArray arrayWithCapacity:n_rungs];
+
+    for (guint i = 0; i < n_rungs; i++) {
+      VfLadderRung *rung = g_ptr_array_index (rungs, i);
+      MetalConvertScaleRenderer *renderer =
+          (__bridge MetalConvertScaleRenderer *)rung->pad->renderer;
+      id<MTLTexture> source = nil;
+
+      if (rung->source >= 0) {
+        VfLadderRung *from = g_ptr_array_index (rungs, rung->source);
+        source = ((__bridge MetalConvertScaleRenderer *)
+            from->pad->renderer).renderTarget;
+      }
+
+      if (![renderer encodeFrame:source ? NULL : &job->in_frame
+                     inputPlanes:source ? nil : planes
+                   sourceTexture:source
+                   commandBuffer:commandBuffer
+                          output:&rung->frame
+                            slot:slot]) {
+        GST_ERROR_OBJECT (rung->pad, "Failed to encode rendition");
+        vf_metal_trace_end (&encode_span);
+        return FALSE;
+      }
+      [renderers addObject:renderer];
+    }
+
+    VfMetalCompletionHandler completion =
+        vf_metal_inflight_job_completion (&self->inflight, job);
+    [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> cb) {
+        BOOL ok = (cb.status != MTLCommandBufferStatusError);
+        if (!ok) {
+          GST_ERROR ("Metal command buffer failed: %s",
+              cb.error.localizedDescription.UTF8String);
+        } else {
+          dispatch_apply (n_rungs,
+              dispatch_get_global_queue (QOS_CLASS_USER_INITIATED, 0),
+              ^(size_t i) {
+                @autoreleasepool {
+                  VfLadderRung *rung = g_ptr_array_index (rungs, i);
+                  [renderers[i] readbackFrame:&rung->frame slot:slot];
+                }
+              });
+        }
+        completion (ok);
+    }];
+    vf_metal_trace_end (&encode_span);
+    vf_metal_trace_command_buffer (GST_OBJECT (self), commandBuffer);
+    [commandBuffer commit];
+
+    return TRUE;
+  }
+}
+
+static GstFlowReturn
+gst_vf_metal_scale_ladder_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * inbuf)
+{
+  GstVfMetalScaleLadder *self = GST_VF_METAL_SCALE_LADDER (parent);
+  GstFlowReturn ret = GST_FLOW_OK;
+  GPtrArray *pads, *rungs;
+  VfMetalInflightJob *job = NULL, *ready = NULL;
+  gboolean drained = FALSE;
+
+  if (!self->negotiated) {
+    GST_ERROR_OBJECT (self, "Not yet negotiated");
+    gst_buffer_unref (inbuf);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  pads = gst_vf_metal_scale_ladder_get_src_pads (self);
+  rungs = g_ptr_array_new_with_free_func ((GDestroyNotify)
+      gst_vf_metal_scale_ladder_rung_free);
+
+  /* Renegotiate where downstream asked; skip unlinked renditions */
+  for (guint i = 0; i < pads->len; i++) {
+    GstVfMetalScaleLadderPad *lpad = g_ptr_array_index (pads, i);
+    VfLadderRung *rung;
+
+    if (gst_pad_check_reconfigure (GST_PAD (lpad)) || !lpad->negotiated) {
+      /* Queued frames go out under the caps they were rendered for */
+      if (lpad->negotiated && !drained) {
+        gst_vf_metal_scale_ladder_drain (self);
+        drained = TRUE;
+      }
+      if (!gst_vf_metal_scale_ladder_negotiate_pad (self, lpad))
+        gst_pad_mark_reconfigure (GST_PAD (lpad));
+    }
+
+    if (!lpad->negotiated || !gst_pad_is_linked (GST_PAD (lpad))) {
+      GST_OBJECT_LOCK (self);
+      ret = gst_flow_combiner_update_pad_flow (self->flow_combiner,
+          GST_PAD (lpad), lpad->negotiated ? GST_FLOW_NOT_LINKED
+                                           : GST_FLOW_NOT_NEGOTIATED);
+      GST_OBJECT_UNLOCK (self);
+      continue;
+    }
+
+    rung = g_new0 (VfLadderRung, 1);
+    rung->pad = gst_object_ref (lpad);
+    g_ptr_array_add (rungs, rung);
+  }
+  g_ptr_array_unref (pads);
+
+  if (rungs->len == 0) {
+    g_ptr_array_unref (rungs);
+    gst_buffer_unref (inbuf);
+    return ret;
+  }
+
+  g_ptr_array_sort (rungs, gst_vf_metal_scale_ladder_compare_rungs);
+
+  if (!gst_vf_metal_scale_ladder_configure (self, rungs)) {
+    g_ptr_array_unref (rungs);
+    gst_buffer_unref (inbuf);
+    return GST_FLOW_ERROR;
+  }
+
+  /* With the ring full this waits for the oldest frame to free its slot */
+  job = vf_metal_inflight_job_new (&self->inflight, &ready);
+  job->inbuf = inbuf;
+  job->held = rungs;
+  if (ready)
+    ret = gst_vf_metal_scale_ladder_finish_job (self, ready);
+
+  if (!gst_video_frame_map (&job->in_frame, &self->in_info, inbuf,
+          GST_MAP_READ | GST_MAP_VF_METAL)) {
+    GST_ERROR_OBJECT (self, "Failed to map input buffer");
+    ret = GST_FLOW_ERROR;
+    goto failed;
+  }
+  job->in_mapped = TRUE;
+
+  for (guint i = 0; i < rungs->len; i++) {
+    VfLadderRung *rung = g_ptr_array_index (rungs, i);
+    GstFlowReturn acquire_ret;
+
+    acquire_ret = gst_buffer_pool_acquire_buffer (rung->pad->pool,
+        &rung->outbuf, NULL);
+    if (acquire_ret != GST_FLOW_OK) {
+      GST_WARNING_OBJECT (rung->pad, "Failed to acquire output buffer: %s",
+          gst_flow_get_name (acquire_ret));
+      ret = acquire_ret;
+      goto failed;
+    }
+    gst_buffer_copy_into (rung->outbuf, inbuf, GST_BUFFER_COPY_METADATA, 0,
+        -1);
+
+    if (!gst_video_frame_map (&rung->frame, &rung->pad->info, rung->outbuf,
+            GST_MAP_WRITE | GST_MAP_VF_METAL)) {
+      GST_ERROR_OBJECT (rung->pad, "Failed to map output buffer");
+      ret = GST_FLOW_ERROR;
+      goto failed;
+    }
+    rung->mapped = TRUE;
+  }
+
+  if (!gst_vf_metal_scale_ladder_submit (self, job)) {
+    GST_WARNING_OBJECT (self, "Metal rendering failed");
+    ret = GST_FLOW_ERROR;
+    goto failed;
+  }
+  vf_metal_inflight_queue (&self->inflight, job);
+
+  /* Push whatever the GPU has finished; in-flight=1 waits for this frame */
+  while ((job = vf_metal_inflight_pop (&self->inflight,
+              !vf_metal_inflight_is_pipelined (&self->inflight)))) {
+    ret = gst_vf_metal_scale_ladder_finish_job (self, job);
+    if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED)
+      break;
+  }
+
+  return ret;
+
+failed:
+  vf_metal_inflight_job_free (job);
+  return ret;
+}
+
+/* --- Pad functions --- */
+
+static gboolean
+gst_vf_metal_scale_ladder_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstVfMetalScaleLadder *self = GST_VF_METAL_SCALE_LADDER (parent);
+
+  /* Keep frames ahead of CAPS/SEGMENT/EOS they were produced under */
+  if (GST_EVENT_IS_SERIALIZED (event) &&
+      GST_EVENT_TYPE (event) != GST_EVENT_FLUSH_STOP) {
+    GstFlowReturn ret = gst_vf_metal_scale_ladder_drain (self);
+    if (ret != GST_FLOW_OK) {
+      GST_DEBUG_OBJECT (self, "drain before %s returned %s",
+          GST_EVENT_TYPE_NAME (event), gst_flow_get_name (ret));
+    }
+  }
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:{
+      GstCaps *caps;
+      gboolean ret;
+
+      /* Each rendition sends its own caps */
+      gst_event_parse_caps (event, &caps);
+      ret = gst_vf_metal_scale_ladder_set_caps (self, caps);
+      gst_event_unref (event);
+      return ret;
+    }
+    case GST_EVENT_FLUSH_STOP:
+      vf_metal_inflight_stop (&self->inflight);
+      GST_OBJECT_LOCK (self);
+      gst_flow_combiner_reset (self->flow_combiner);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      break;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static gboolean
+gst_vf_metal_scale_ladder_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  GstVfMetalScaleLadder *self = GST_VF_METAL_SCALE_LADDER (parent);
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:{
+      GstCaps *filter, *caps;
+
+      /* Any size and format in, whatever the renditions are */
+      gst_query_parse_caps (query, &filter);
+      caps = gst_pad_get_pad_template_caps (pad);
+      if (filter) {
+        GstCaps *intersection =
+            gst_caps_intersect_full (filter, caps, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref (caps);
+        caps = intersection;
+      }
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+      return TRUE;
+    }
+    case GST_QUERY_ALLOCATION:{
+      GstCaps *caps;
+
+      gst_query_parse_allocation (query, &caps, NULL);
+      if (caps && gst_vf_metal_caps_has_memory_feature (caps)) {
+        VfMetalDevice *device;
+
+        GST_OBJECT_LOCK (self);
+        device = (__bridge VfMetalDevice *)self->metal_device;
+        GST_OBJECT_UNLOCK (self);
+        return gst_vf_metal_memory_propose_allocation (query, device);
+      }
+
+      gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+      return TRUE;
+    }
+    case GST_QUERY_CONTEXT:
+      if (vf_metal_device_selection_handle_query (GST_ELEMENT (self),
+              &self->device, query))
+        return TRUE;
+      return gst_pad_query_default (pad, parent, query);
+    default:
+      return gst_pad_query_default (pad, parent, query);
+  }
+}
+
+static gboolean
+gst_vf_metal_scale_ladder_src_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  GstVfMetalScaleLadder *self = GST_VF_METAL_SCALE_LADDER (parent);
+
+  /* Each queued frame delays output by one frame duration */
+  if (GST_QUERY_TYPE (query) == GST_QUERY_LATENCY) {
+    if (!gst_pad_query_default (pad, parent, query))
+      return FALSE;
+    vf_metal_inflight_add_latency (&self->inflight, query,
+        GST_VIDEO_INFO_FPS_N (&self->in_info),
+        GST_VIDEO_INFO_FPS_D (&self->in_info));
+    return TRUE;
+  }
+
+  if (GST_QUERY_TYPE (query) == GST_QUERY_CAPS) {
+    GstCaps *filter, *caps;
+
+    gst_query_parse_caps (query, &filter);
+    caps = gst_pad_get_pad_template_caps (pad);
+    if (filter) {
+      GstCaps *intersection =
+          gst_caps_intersect_full (filter, caps, GST_CAPS_INTERSECT_FIRST);
+      gst_caps_unref (caps);
+      caps = intersection;
+    }
+    gst_query_set_caps_result (query, caps);
+    gst_caps_unref (caps);
+    return TRUE;
+  }
+
+  if (vf_metal_device_selection_handle_query (GST_ELEMENT (parent),
+          &self->device, query))
+    return TRUE;
+
+  return gst_pad_query_default (pad, parent, query);
+}
+
+/* --- Request pads --- */
+
+/* Mid-stream: replay the input's sticky events, with the rendition's own
+ * caps in place of the input caps */
+static gboolean
+gst_vf_metal_scale_ladder_copy_sticky (GstPad * sinkpad, GstEvent ** event,
+    gpointer user_data)
+{
+  GstVfMetalScaleLadderPad *lpad = user_data;
+  GstVfMetalScaleLadder *self =
+      GST_VF_METAL_SCALE_LADDER (GST_PAD_PARENT (sinkpad));
+
+  if (GST_EVENT_TYPE (*event) == GST_EVENT_CAPS) {
+    if (!gst_vf_metal_scale_ladder_negotiate_pad (self, lpad))
+      gst_pad_mark_reconfigure (GST_PAD (lpad));
+  } else {
+    gst_pad_store_sticky_event (GST_PAD (lpad), *event);
+  }
+
+  return TRUE;
+}
+
+static GstPad *
+gst_vf_metal_scale_ladder_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  GstVfMetalScaleLadder *self = GST_VF_METAL_SCALE_LADDER (element);
+  GstVfMetalScaleLadderPad *lpad;
+  VfMetalDevice *device;
+  gchar *pad_name;
+  guint id;
+
+  GST_OBJECT_LOCK (self);
+  if (name && sscanf (name, "src_%u", &id) == 1) {
+    self->next_pad_id = MAX (self->next_pad_id, id + 1);
+    pad_name = g_strdup (name);
+  } else {
+    pad_name = g_strdup_printf ("src_%u", self->next_pad_id++);
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  lpad = g_object_new (GST_TYPE_VF_METAL_SCALE_LADDER_PAD,
+      "name", pad_name, "direction", GST_PAD_SRC, "template", templ, NULL);
+  g_free (pad_name);
+
+  /* Before READY the device is not chosen yet; NULL_TO_READY adds the
+   * renderer then */
+  GST_OBJECT_LOCK (self);
+  device = (__bridge VfMetalDevice *)self->metal_device;
+  GST_OBJECT_UNLOCK (self);
+  if (device && !gst_vf_metal_scale_ladder_pad_ensure_renderer (lpad, device)) {
+    gst_object_unref (lpad);
+    return NULL;
+  }
+
+  gst_pad_set_query_function (GST_PAD (lpad),
+      GST_DEBUG_FUNCPTR (gst_vf_metal_scale_ladder_src_query));
+
+  GST_OBJECT_LOCK (self);
+  gst_flow_combiner_add_pad (self->flow_combiner, GST_PAD (lpad));
+  GST_OBJECT_UNLOCK (self);
+
+  if (!gst_element_add_pad (element, GST_PAD (lpad))) {
+    GST_OBJECT_LOCK (self);
+    gst_flow_combiner_remove_pad (self->flow_combiner, GST_PAD (lpad));
+    GST_OBJECT_UNLOCK (self);
+    return NULL;
+  }
+
+  if (self->negotiated)
+    gst_pad_sticky_events_foreach (self->sinkpad,
+        gst_vf_metal_scale_ladder_copy_sticky, lpad);
+
+  return GST_PAD (lpad);
+}
+
+static void
+gst_vf_metal_scale_ladder_release_pad (GstElement * element, GstPad * pad)
+{
+  GstVfMetalScaleLadder *self = GST_VF_METAL_SCALE_LADDER (element);
+
+  GST_OBJECT_LOCK (self);
+  gst_flow_combiner_remove_pad (self->flow_combiner, pad);
+  GST_OBJECT_UNLOCK (self);
+
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+}
+
+/* --- Properties --- */
+
+static void
+gst_vf_metal_scale_ladder_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstVfMetalScaleLadder *self = GST_VF_METAL_SCALE_LADDER (object);
+
+  /* Renderers reconfigure on the next frame */
+  switch (prop_id) {
+    case PROP_METHOD:
+      self->method = g_value_get_enum (value);
+      break;
+    case PROP_ADD_BORDERS:
+      self->add_borders = g_value_get_boolean (value);
+      break;
+    case PROP_BORDER_COLOR:
+      self->border_color = g_value_get_uint (value);
+      break;
+    case PROP_CASCADE:
+      self->cascade = g_value_get_boolean (value);
+      break;
+    case PROP_DEVICE:
+      vf_metal_device_selection_set_property (GST_ELEMENT (self),
+          &self->device, value);
+      break;
+    case PROP_IN_FLIGHT:
+      GST_OBJECT_LOCK (self);
+      self->in_flight = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_vf_metal_scale_ladder_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstVfMetalScaleLadder *self = GST_VF_METAL_SCALE_LADDER (object);
+
+  switch (prop_id) {
+    case PROP_METHOD:
+      g_value_set_enum (value, self->method);
+      break;
+    case PROP_ADD_BORDERS:
+      g_value_set_boolean (value, self->add_borders);
+      break;
+    case PROP_BORDER_COLOR:
+      g_value_set_uint (value, self->border_color);
+      break;
+    case PROP_CASCADE:
+      g_value_set_boolean (value, self->cascade);
+      break;
+    case PROP_DEVICE:
+      vf_metal_device_selection_get_property (GST_ELEMENT (self),
+          &self->device, value);
+      break;
+    case PROP_IN_FLIGHT:
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint (value, self->in_flight);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* --- Device --- */
+
+static void
+gst_vf_metal_scale_ladder_set_context (GstElement * element,
+    GstContext * context)
+{
+  GstVfMetalScaleLadder *self = GST_VF_METAL_SCALE_LADDER (element);
+
+  vf_metal_device_selection_set_context (element, &self->device, context);
+
+  GST_ELEMENT_CLASS (parent_class)->set_context (element, context);
+}
+
+/* Choose the GPU and put every rendition's renderer on it */
+static gboolean
+gst_vf_metal_scale_ladder_ensure_device (GstVfMetalScaleLadder * self)
+{
+  VfMetalDevice *device;
+  GPtrArray *pads;
+  gboolean ok = TRUE;
+
+  device = vf_metal_device_selection_ensure (GST_ELEMENT (self),
+      &self->device);
+  if (!device)
+    return FALSE;
+
+  GST_OBJECT_LOCK (self);
+  self->metal_device = (__bridge void *)device;
+  GST_OBJECT_UNLOCK (self);
+
+  pads = gst_vf_metal_scale_ladder_get_src_pads (self);
+  for (guint i = 0; i < pads->len; i++)
+    ok &= gst_vf_metal_scale_ladder_pad_ensure_renderer
+        (g_ptr_array_index (pads, i), device);
+  g_ptr_array_unref (pads);
+
+  return ok;
+}
+
+/* --- State change --- */
+
+static GstStateChangeReturn
+gst_vf_metal_scale_ladder_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstVfMetalScaleLadder *self = GST_VF_METAL_SCALE_LADDER (element);
+  GstStateChangeReturn ret;
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY &&
+      !gst_vf_metal_scale_ladder_ensure_device (self))
+    return GST_STATE_CHANGE_FAILURE;
+
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+    guint in_flight;
+
+    GST_OBJECT_LOCK (self);
+    in_flight = self->in_flight;
+    GST_OBJECT_UNLOCK (self);
+    vf_metal_inflight_start (&self->inflight, in_flight);
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:{
+      GPtrArray *pads;
+
+      /* Streaming has stopped; the GPU may still hold queued frames */
+      vf_metal_inflight_stop (&self->inflight);
+
+      pads = gst_vf_metal_scale_ladder_get_src_pads (self);
+      for (guint i = 0; i < pads->len; i++)
+        gst_vf_metal_scale_ladder_pad_reset (g_ptr_array_index (pads, i));
+      g_ptr_array_unref (pads);
+
+      GST_OBJECT_LOCK (self);
+      gst_flow_combiner_reset (self->flow_combiner);
+      GST_OBJECT_UNLOCK (self);
+
+      gst_caps_replace (&self->in_caps, NULL);
+      self->negotiated = FALSE;
+      break;
+    }
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      GST_OBJECT_LOCK (self);
+      self->metal_device = NULL;
+      GST_OBJECT_UNLOCK (self);
+      vf_metal_device_selection_reset (element, &self->device);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+/* --- Finalize --- */
+
+static void
+gst_vf_metal_scale_ladder_finalize (GObject * object)
+{
+  GstVfMetalScaleLadder *self = GST_VF_METAL_SCALE_LADDER (object);
+
+  gst_caps_replace (&self->in_caps, NULL);
+  gst_flow_combiner_free (self->flow_combiner);
+  vf_metal_inflight_clear (&self->inflight);
+  vf_metal_device_selection_clear (&self->device);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+/* --- class_init --- */
+
+static void
+gst_vf_metal_scale_ladder_class_init (GstVfMetalScaleLadderClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *gstelement_class = (GstElementClass *) klass;
+
+  gobject_class->set_property = gst_vf_metal_scale_ladder_set_property;
+  gobject_class->get_property = gst_vf_metal_scale_ladder_get_property;
+  gobject_class->finalize = gst_vf_metal_scale_ladder_finalize;
+
+  gstelement_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_scale_ladder_change_state);
+  gstelement_class->set_context =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_scale_ladder_set_context);
+  gstelement_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_scale_ladder_request_new_pad);
+  gstelement_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_scale_ladder_release_pad);
+
+  /* --- Install properties --- */
+
+  g_object_class_install_property (gobject_class, PROP_METHOD,
+      g_param_spec_enum ("method", "Method",
+          "Scaling interpolation method for every rendition",
+          GST_TYPE_VF_METAL_SCALE_METHOD, DEFAULT_METHOD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADD_BORDERS,
+      g_param_spec_boolean ("add-borders", "Add Borders",
+          "Add letterbox/pillarbox borders to preserve aspect ratio",
+          DEFAULT_ADD_BORDERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BORDER_COLOR,
+      g_param_spec_uint ("border-color", "Border Color",
+          "Border color in ARGB format (default: opaque black 0xFF000000)",
+          0, G_MAXUINT32, DEFAULT_BORDER_COLOR,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CASCADE,
+      g_param_spec_boolean ("cascade", "Cascade",
+          "Scale each rendition from the next larger one instead of the "
+          "full-size input",
+          DEFAULT_CASCADE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DEVICE,
+      vf_metal_device_selection_param_spec ());
+
+  g_object_class_install_property (gobject_class, PROP_IN_FLIGHT,
+      g_param_spec_uint ("in-flight", "In-flight frames",
+          "Frames queued on the GPU before the oldest is pushed downstream "
+          "(1 = wait for every frame; each extra frame adds one frame of "
+          "latency)",
+          1, VF_METAL_MAX_IN_FLIGHT, DEFAULT_IN_FLIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  /* Pad templates */
+  gst_element_class_add_static_pad_template (gstelement_class, &sink_template);
+  gst_element_class_add_static_pad_template_with_gtype (gstelement_class,
+      &src_template, GST_TYPE_VF_METAL_SCALE_LADDER_PAD);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "Metal Video Scale Ladder",
+      "Filter/Converter/Video/Scaler",
+      "Metal-accelerated multi-rendition scaling from a single upload",
+      "VisioForge <support@visioforge.com>");
+
+  GST_DEBUG_CATEGORY_INIT (gst_vf_metal_scale_ladder_debug,
+      "vfmetalscaleladder", 0, "Metal video scale ladder");
+}
+
+/* --- init --- */
+
+static void
+gst_vf_metal_scale_ladder_init (GstVfMetalScaleLadder * self)
+{
+  self->method = DEFAULT_METHOD;
+  self->add_borders = DEFAULT_ADD_BORDERS;
+  self->border_color = DEFAULT_BORDER_COLOR;
+  self->cascade = DEFAULT_CASCADE;
+  self->in_flight = DEFAULT_IN_FLIGHT;
+  self->negotiated = FALSE;
+  self->flow_combiner = gst_flow_combiner_new ();
+  vf_metal_inflight_init (&self->inflight);
+  vf_metal_device_selection_init (&self->device);
+  gst_video_info_init (&self->in_info);
+
+  self->sinkpad = gst_pad_new_from_static_template (&sink_template, "sink");
+  gst_pad_set_chain_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_vf_metal_scale_ladder_chain));
+  gst_pad_set_event_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_vf_metal_scale_ladder_sink_event));
+  gst_pad_set_query_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_vf_metal_scale_ladder_sink_query));
+  gst_element_add_pad (GST_ELEMENT (self), self->sinkpad);
+}
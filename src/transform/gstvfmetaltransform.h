@@ -26,12 +26,20 @@
 #include <gst/video/video.h>
 #include <gst/video/gstvideofilter.h>
 
+#include "vfmetalcontext.h"
+#include "vfmetalinflight.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_VF_METAL_TRANSFORM (gst_vf_metal_transform_get_type())
 G_DECLARE_FINAL_TYPE (GstVfMetalTransform, gst_vf_metal_transform,
     GST, VF_METAL_TRANSFORM, GstVideoFilter)
 
+/* "method" enum, also used by vfmetalchain's transform property */
+#define GST_TYPE_VF_METAL_TRANSFORM_METHOD \
+    (gst_vf_metal_transform_method_get_type())
+GType gst_vf_metal_transform_method_get_type (void);
+
 /**
  * GstVfMetalTransform:
  *
@@ -49,6 +57,13 @@ struct _GstVfMetalTransform
   gint crop_left;
   gint crop_right;
 
+  /* Pipelined submission: in-flight property, latched into inflight */
+  guint in_flight;
+  VfMetalInflight inflight;
+
+  /* GPU selection; the renderer is created on it at NULL_TO_READY */
+  VfMetalDeviceSelection device;
+
   /* Metal rendering engine */
   void *renderer;
 };
@@ -41,6 +41,7 @@
 #import <Foundation/Foundation.h>
 #include "gstvfmetaltransform.h"
 #include "metaltransformrenderer.h"
+#import "vfmetalmemory.h"
 
 GST_DEBUG_CATEGORY (gst_vf_metal_transform_debug);
 #define GST_CAT_DEFAULT gst_vf_metal_transform_debug
@@ -50,13 +51,13 @@ GST_DEBUG_CATEGORY (gst_vf_metal_transform_debug);
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (VF_METAL_TRANSFORM_FORMATS))
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_TRANSFORM_FORMATS))
     );
 
 static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (VF_METAL_TRANSFORM_FORMATS))
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_TRANSFORM_FORMATS))
     );
 
 enum
@@ -67,15 +68,14 @@ enum
   PROP_CROP_BOTTOM,
   PROP_CROP_LEFT,
   PROP_CROP_RIGHT,
+  PROP_IN_FLIGHT,
+  PROP_DEVICE,
 };
 
 #define DEFAULT_METHOD      0   /* identity */
 #define DEFAULT_CROP        0
 
 /* Transform method enum type */
-#define GST_TYPE_VF_METAL_TRANSFORM_METHOD \
-    (gst_vf_metal_transform_method_get_type())
-
 GType
 gst_vf_metal_transform_method_get_type (void)
 {
@@ -152,13 +152,54 @@ gst_vf_metal_transform_set_info (GstVideoFilter * filter,
   return TRUE;
 }
 
+/* --- Allocation --- */
+
+static gboolean
+gst_vf_metal_transform_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  GstVfMetalTransform *self = GST_VF_METAL_TRANSFORM (trans);
+
+  return vf_metal_propose_allocation (trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class),
+      ((__bridge MetalTransformRenderer *)self->renderer).metalDevice,
+      decide_query, query);
+}
+
+static gboolean
+gst_vf_metal_transform_decide_allocation (GstBaseTransform * trans,
+    GstQuery * query)
+{
+  GstVfMetalTransform *self = GST_VF_METAL_TRANSFORM (trans);
+
+  return vf_metal_decide_allocation (trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class),
+      ((__bridge MetalTransformRenderer *)self->renderer).metalDevice,
+      &self->inflight, query);
+}
+
 /* --- transform_frame --- */
 
+/* Snapshot properties under lock */
+static void
+gst_vf_metal_transform_snapshot_params (GstVfMetalTransform * self,
+    TransformParams * params)
+{
+  GST_OBJECT_LOCK (self);
+  params->method = (VfMetalTransformMethod)self->method;
+  params->cropTop = self->crop_top;
+  params->cropBottom = self->crop_bottom;
+  params->cropLeft = self->crop_left;
+  params->cropRight = self->crop_right;
+  GST_OBJECT_UNLOCK (self);
+}
+
 static GstFlowReturn
 gst_vf_metal_transform_transform_frame (GstVideoFilter * filter,
     GstVideoFrame * inframe, GstVideoFrame * outframe)
 {
   GstVfMetalTransform *self = GST_VF_METAL_TRANSFORM (filter);
+  TransformParams params;
 
   if (!self->renderer) {
     GST_WARNING_OBJECT (self, "No Metal renderer");
@@ -168,15 +209,7 @@ gst_vf_metal_transform_transform_frame (GstVideoFilter * filter,
   MetalTransformRenderer *renderer =
       (__bridge MetalTransformRenderer *)self->renderer;
 
-  /* Snapshot properties under lock */
-  TransformParams params;
-  GST_OBJECT_LOCK (self);
-  params.method = (VfMetalTransformMethod)self->method;
-  params.cropTop = self->crop_top;
-  params.cropBottom = self->crop_bottom;
-  params.cropLeft = self->crop_left;
-  params.cropRight = self->crop_right;
-  GST_OBJECT_UNLOCK (self);
+  gst_vf_metal_transform_snapshot_params (self, &params);
 
   @autoreleasepool {
     if (![renderer processFrame:inframe output:outframe params:&params]) {
@@ -188,6 +221,77 @@ gst_vf_metal_transform_transform_frame (GstVideoFilter * filter,
   return GST_FLOW_OK;
 }
 
+/* --- Pipelined submission (in-flight > 1) --- */
+
+static gboolean
+gst_vf_metal_transform_submit (GstBaseTransform * trans,
+    VfMetalInflightJob * job, VfMetalCompletionHandler completion)
+{
+  GstVfMetalTransform *self = GST_VF_METAL_TRANSFORM (trans);
+  TransformParams params;
+
+  if (!self->renderer)
+    return FALSE;
+
+  MetalTransformRenderer *renderer =
+      (__bridge MetalTransformRenderer *)self->renderer;
+
+  gst_vf_metal_transform_snapshot_params (self, &params);
+
+  @autoreleasepool {
+    return [renderer submitFrame:&job->in_frame output:&job->out_frame
+                          params:&params slot:job->slot
+                      completion:completion];
+  }
+}
+
+static GstFlowReturn
+gst_vf_metal_transform_generate_output (GstBaseTransform * trans,
+    GstBuffer ** outbuf)
+{
+  GstVfMetalTransform *self = GST_VF_METAL_TRANSFORM (trans);
+  GstVideoFilter *filter = GST_VIDEO_FILTER (trans);
+
+  return vf_metal_inflight_generate_output (&self->inflight, trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class), &filter->in_info,
+      &filter->out_info, gst_vf_metal_transform_submit, outbuf);
+}
+
+static gboolean
+gst_vf_metal_transform_sink_event (GstBaseTransform * trans,
+    GstEvent * event)
+{
+  GstVfMetalTransform *self = GST_VF_METAL_TRANSFORM (trans);
+
+  vf_metal_inflight_sink_event (&self->inflight, trans, event);
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event);
+}
+
+static gboolean
+gst_vf_metal_transform_query (GstBaseTransform * trans,
+    GstPadDirection direction, GstQuery * query)
+{
+  GstVfMetalTransform *self = GST_VF_METAL_TRANSFORM (trans);
+  GstVideoInfo *info = &GST_VIDEO_FILTER (trans)->out_info;
+
+  if (vf_metal_device_selection_handle_query (GST_ELEMENT (trans),
+          &self->device, query))
+    return TRUE;
+
+  if (!GST_BASE_TRANSFORM_CLASS (parent_class)->query (trans, direction,
+          query))
+    return FALSE;
+
+  if (direction == GST_PAD_SRC && GST_QUERY_TYPE (query) == GST_QUERY_LATENCY
+      && !gst_base_transform_is_passthrough (trans)) {
+    vf_metal_inflight_add_latency (&self->inflight, query,
+        GST_VIDEO_INFO_FPS_N (info), GST_VIDEO_INFO_FPS_D (info));
+  }
+
+  return TRUE;
+}
+
 /* --- Properties --- */
 
 static void
@@ -196,6 +300,13 @@ gst_vf_metal_transform_set_property (GObject * object, guint prop_id,
 {
   GstVfMetalTransform *self = GST_VF_METAL_TRANSFORM (object);
 
+  /* Takes the object lock itself */
+  if (prop_id == PROP_DEVICE) {
+    vf_metal_device_selection_set_property (GST_ELEMENT (self),
+        &self->device, value);
+    return;
+  }
+
   GST_OBJECT_LOCK (self);
   switch (prop_id) {
     case PROP_METHOD:
@@ -213,6 +324,9 @@ gst_vf_metal_transform_set_property (GObject * object, guint prop_id,
     case PROP_CROP_RIGHT:
       self->crop_right = g_value_get_int (value);
       break;
+    case PROP_IN_FLIGHT:
+      self->in_flight = g_value_get_uint (value);
+      break;
     default:
       GST_OBJECT_UNLOCK (self);
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -229,6 +343,12 @@ gst_vf_metal_transform_get_property (GObject * object, guint prop_id,
 {
   GstVfMetalTransform *self = GST_VF_METAL_TRANSFORM (object);
 
+  if (prop_id == PROP_DEVICE) {
+    vf_metal_device_selection_get_property (GST_ELEMENT (self),
+        &self->device, value);
+    return;
+  }
+
   GST_OBJECT_LOCK (self);
   switch (prop_id) {
     case PROP_METHOD:
@@ -246,6 +366,9 @@ gst_vf_metal_transform_get_property (GObject * object, guint prop_id,
     case PROP_CROP_RIGHT:
       g_value_set_int (value, self->crop_right);
       break;
+    case PROP_IN_FLIGHT:
+      g_value_set_uint (value, self->in_flight);
+      break;
     default:
       GST_OBJECT_UNLOCK (self);
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -254,6 +377,56 @@ gst_vf_metal_transform_get_property (GObject * object, guint prop_id,
   GST_OBJECT_UNLOCK (self);
 }
 
+/* --- Device --- */
+
+static void
+gst_vf_metal_transform_set_context (GstElement * element, GstContext * context)
+{
+  GstVfMetalTransform *self = GST_VF_METAL_TRANSFORM (element);
+
+  vf_metal_device_selection_set_context (element, &self->device, context);
+
+  GST_ELEMENT_CLASS (parent_class)->set_context (element, context);
+}
+
+/* Renderer on the selected GPU, replaced when the selection moved */
+static gboolean
+gst_vf_metal_transform_ensure_renderer (GstVfMetalTransform * self)
+{
+  VfMetalDevice *device;
+
+  device = vf_metal_device_selection_ensure (GST_ELEMENT (self),
+      &self->device);
+  if (!device)
+    return FALSE;
+
+  @autoreleasepool {
+    if (self->renderer) {
+      MetalTransformRenderer *renderer =
+          (__bridge MetalTransformRenderer *)self->renderer;
+      if (renderer.metalDevice == device)
+        return TRUE;
+
+      renderer = (__bridge_transfer MetalTransformRenderer *)self->renderer;
+      self->renderer = NULL;
+      [renderer cleanup];
+    }
+
+    MetalTransformRenderer *renderer =
+        [[MetalTransformRenderer alloc] initWithDevice:device];
+    if (!renderer) {
+      GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+          ("Failed to create Metal renderer on '%s'",
+              device.device.name.UTF8String), (NULL));
+      return FALSE;
+    }
+    renderer.traceOwner = GST_OBJECT (self);
+    self->renderer = (__bridge_retained void *)renderer;
+  }
+
+  return TRUE;
+}
+
 /* --- State change --- */
 
 static GstStateChangeReturn
@@ -262,11 +435,23 @@ gst_vf_metal_transform_change_state (GstElement * element,
 {
   GstVfMetalTransform *self = GST_VF_METAL_TRANSFORM (element);
   GstStateChangeReturn ret;
+  guint in_flight;
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY &&
+      !gst_vf_metal_transform_ensure_renderer (self))
+    return GST_STATE_CHANGE_FAILURE;
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+    GST_OBJECT_LOCK (self);
+    in_flight = self->in_flight;
+    GST_OBJECT_UNLOCK (self);
+    vf_metal_inflight_start (&self->inflight, in_flight);
+  }
 
   ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
 
   switch (transition) {
     case GST_STATE_CHANGE_PAUSED_TO_READY:
+      vf_metal_inflight_stop (&self->inflight);
       if (self->renderer) {
         @autoreleasepool {
           MetalTransformRenderer *renderer =
@@ -275,6 +460,9 @@ gst_vf_metal_transform_change_state (GstElement * element,
         }
       }
       break;
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      vf_metal_device_selection_reset (element, &self->device);
+      break;
     default:
       break;
   }
@@ -299,6 +487,9 @@ gst_vf_metal_transform_finalize (GObject * object)
     }
   }
 
+  vf_metal_inflight_clear (&self->inflight);
+  vf_metal_device_selection_clear (&self->device);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -309,6 +500,7 @@ gst_vf_metal_transform_class_init (GstVfMetalTransformClass * klass)
 {
   GObjectClass *gobject_class = (GObjectClass *) klass;
   GstElementClass *gstelement_class = (GstElementClass *) klass;
+  GstBaseTransformClass *basetransform_class = (GstBaseTransformClass *) klass;
   GstVideoFilterClass *gstvideofilter_class = (GstVideoFilterClass *) klass;
 
   gobject_class->set_property = gst_vf_metal_transform_set_property;
@@ -317,11 +509,23 @@ gst_vf_metal_transform_class_init (GstVfMetalTransformClass * klass)
 
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_vf_metal_transform_change_state);
+  gstelement_class->set_context =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_transform_set_context);
 
   gstvideofilter_class->set_info =
       GST_DEBUG_FUNCPTR (gst_vf_metal_transform_set_info);
   gstvideofilter_class->transform_frame =
       GST_DEBUG_FUNCPTR (gst_vf_metal_transform_transform_frame);
+  basetransform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_transform_propose_allocation);
+  basetransform_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_transform_decide_allocation);
+  basetransform_class->generate_output =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_transform_generate_output);
+  basetransform_class->sink_event =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_transform_sink_event);
+  basetransform_class->query =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_transform_query);
 
   /* --- Install properties --- */
 
@@ -355,6 +559,18 @@ gst_vf_metal_transform_class_init (GstVfMetalTransformClass * klass)
           0, G_MAXINT, DEFAULT_CROP,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_IN_FLIGHT,
+      g_param_spec_uint ("in-flight", "In-flight frames",
+          "Frames queued on the GPU before the oldest is pushed downstream "
+          "(1 = wait for every frame; each extra frame adds one frame of "
+          "latency)",
+          1, VF_METAL_MAX_IN_FLIGHT, VF_METAL_DEFAULT_IN_FLIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_DEVICE,
+      vf_metal_device_selection_param_spec ());
+
   /* Pad templates */
   gst_element_class_add_static_pad_template (gstelement_class, &sink_template);
   gst_element_class_add_static_pad_template (gstelement_class, &src_template);
@@ -380,15 +596,11 @@ gst_vf_metal_transform_init (GstVfMetalTransform * self)
   self->crop_left = DEFAULT_CROP;
   self->crop_right = DEFAULT_CROP;
 
-  @autoreleasepool {
-    MetalTransformRenderer *renderer =
-        [[MetalTransformRenderer alloc] init];
-    if (renderer) {
-      self->renderer = (__bridge_retained void *)renderer;
-    } else {
-      GST_ERROR_OBJECT (self, "Failed to create Metal renderer");
-    }
-  }
+  self->in_flight = VF_METAL_DEFAULT_IN_FLIGHT;
+  vf_metal_inflight_init (&self->inflight);
+
+  /* The renderer waits for NULL_TO_READY, when the GPU is known */
+  vf_metal_device_selection_init (&self->device);
 
   gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (self), TRUE);
 }
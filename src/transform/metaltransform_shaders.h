@@ -31,7 +31,7 @@ static NSString *const kTransformShaderSource = @R"(
 struct TransformUniforms {
     float2x2 uvTransform;   // 2x2 UV coordinate transform matrix
     float2 uvOffset;        // UV offset after transform
-    int colorMatrix;        // 0=BT.601, 1=BT.709
+    int colorMatrix;        // colour word, VF_COLOR_*
     int padding;
 };
 
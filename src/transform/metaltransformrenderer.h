@@ -26,6 +26,9 @@
 #import <Metal/Metal.h>
 #include <gst/video/video.h>
 
+#import "vfmetaldevice.h"
+#import "vfmetalinflight.h"
+
 /* Transform method — matches GstVideoOrientationMethod values */
 typedef enum {
     VF_METAL_TRANSFORM_IDENTITY = 0,
@@ -47,9 +50,24 @@ typedef struct {
     int cropRight;
 } TransformParams;
 
+/* Crop + flip/rotate as a centred UV mapping for a frameW x frameH input:
+ * src = uvTransform * (dst - 0.5) + 0.5 + uvOffset, uvTransform being a
+ * column-major 2x2. Shared with vfmetalchain. */
+void vf_metal_transform_build_uv (const TransformParams *params,
+                                  int frameW, int frameH,
+                                  float uvTransform[4], float uvOffset[2]);
+
 @interface MetalTransformRenderer : NSObject
 
+/* Element this renderer's stages are traced for (see vfmetaltrace.h) */
+@property (nonatomic, assign) GstObject *traceOwner;
+
+/* GPU this renderer runs on, fixed at creation */
+@property (nonatomic, readonly) VfMetalDevice *metalDevice;
+
+/* -init uses the default device (+[VfMetalDevice sharedDevice]) */
 - (instancetype)init;
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice;
 
 - (BOOL)configureWithInputInfo:(GstVideoInfo *)inInfo
                     outputInfo:(GstVideoInfo *)outInfo;
@@ -58,6 +76,15 @@ typedef struct {
               output:(GstVideoFrame *)outFrame
               params:(const TransformParams *)params;
 
+/* Pipelined variant: encode into ring @slot, commit without waiting and
+ * call @completion once outFrame has been read back. Returns NO (and
+ * never calls @completion) if nothing was committed. */
+- (BOOL)submitFrame:(GstVideoFrame *)inFrame
+             output:(GstVideoFrame *)outFrame
+             params:(const TransformParams *)params
+               slot:(NSUInteger)slot
+         completion:(VfMetalCompletionHandler)completion;
+
 - (void)cleanup;
 
 @end
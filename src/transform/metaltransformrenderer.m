@@ -25,6 +25,7 @@
 #import "vfmetaltextureutil.h"
 #import "vfmetalshaders.h"
 #import "vfmetalyuvoutput.h"
+#import "vfmetaltrace.h"
 
 #include <gst/gst.h>
 #include <math.h>
@@ -103,6 +104,42 @@ build_uv_transform (VfMetalTransformMethod method, float *mat, float *offset)
     }
 }
 
+void
+vf_metal_transform_build_uv (const TransformParams *params,
+                             int frameW, int frameH,
+                             float uvTransform[4], float uvOffset[2])
+{
+    /* Compute crop UV offset and scale */
+    float cropL = (float)params->cropLeft / (float)frameW;
+    float cropR = (float)params->cropRight / (float)frameW;
+    float cropT = (float)params->cropTop / (float)frameH;
+    float cropB = (float)params->cropBottom / (float)frameH;
+
+    float cropScaleX = 1.0f - cropL - cropR;
+    float cropScaleY = 1.0f - cropT - cropB;
+    float cropOffsetX = (cropL - cropR) * 0.5f;
+    float cropOffsetY = (cropT - cropB) * 0.5f;
+
+    /* Get transform matrix */
+    float transMat[4], transOff[2];
+    build_uv_transform (params->method, transMat, transOff);
+
+    /* Combine: first apply crop scale, then transform rotation
+     * UV = transform * (crop_scale * centered_uv) + offsets
+     * Combined matrix = transform * diag(cropScale)
+     */
+    uvTransform[0] = transMat[0] * cropScaleX;
+    uvTransform[1] = transMat[1] * cropScaleX;
+    uvTransform[2] = transMat[2] * cropScaleY;
+    uvTransform[3] = transMat[3] * cropScaleY;
+
+    /* Offset: transform the crop offset, then add transform offset */
+    uvOffset[0] = transMat[0] * cropOffsetX +
+                  transMat[2] * cropOffsetY + transOff[0];
+    uvOffset[1] = transMat[1] * cropOffsetX +
+                  transMat[3] * cropOffsetY + transOff[1];
+}
+
 @implementation MetalTransformRenderer {
     id<MTLCommandQueue> _commandQueue;
     id<MTLLibrary> _library;
@@ -128,22 +165,35 @@ build_uv_transform (VfMetalTransformMethod method, float *mat, float *offset)
     VfMetalTextureCache *_textureCache;
 }
 
+- (void)setTraceOwner:(GstObject *)traceOwner
+{
+    _traceOwner = traceOwner;
+    _textureCache.traceOwner = traceOwner;
+    _yuvOutput.traceOwner = traceOwner;
+}
+
 - (instancetype)init
+{
+    return [self initWithDevice:[VfMetalDevice sharedDevice]];
+}
+
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice
 {
     self = [super init];
     if (!self) return nil;
 
-    VfMetalDevice *metalDevice = [VfMetalDevice sharedDevice];
     if (!metalDevice) return nil;
+    _metalDevice = metalDevice;
 
-    _commandQueue = [metalDevice.device newCommandQueue];
-    if (!_commandQueue) return nil;
+    _commandQueue = metalDevice.commandQueue;
 
     NSString *fullSource = [kVfMetalCommonShaderSource
         stringByAppendingString:kTransformShaderSource];
 
     NSError *error = nil;
-    _library = [metalDevice compileShaderSource:fullSource error:&error];
+    _library = [metalDevice libraryNamed:@"transform"
+                                  source:fullSource
+                                   error:&error];
     if (!_library) {
         GST_ERROR ("MetalTransformRenderer: Failed to compile shaders: %s",
               error.localizedDescription.UTF8String);
@@ -173,7 +223,8 @@ build_uv_transform (VfMetalTransformMethod method, float *mat, float *offset)
         return YES;
     }
 
-    id<MTLDevice> device = [VfMetalDevice sharedDevice].device;
+    VfMetalDevice *metalDevice = _metalDevice;
+    id<MTLDevice> device = metalDevice.device;
 
     _inWidth = inW;
     _inHeight = inH;
@@ -212,7 +263,8 @@ build_uv_transform (VfMetalTransformMethod method, float *mat, float *offset)
 
         NSError *error = nil;
         _pipelines[fmt] =
-            [device newRenderPipelineStateWithDescriptor:desc error:&error];
+            [metalDevice renderPipelineWithDescriptor:desc library:_library
+                                                error:&error];
         if (!_pipelines[fmt]) {
             GST_ERROR ("Failed to create transform pipeline for format %d: %s",
                        fmt, error.localizedDescription.UTF8String);
@@ -228,12 +280,12 @@ build_uv_transform (VfMetalTransformMethod method, float *mat, float *offset)
                                  mipmapped:NO];
     rtDesc.usage = MTLTextureUsageRenderTarget | MTLTextureUsageShaderRead |
                    MTLTextureUsageShaderWrite;
-    rtDesc.storageMode = MTLStorageModeShared;
+    rtDesc.storageMode = _metalDevice.hostStorageMode;
 
     _renderTarget = [device newTextureWithDescriptor:rtDesc];
     if (!_renderTarget) return NO;
 
-    if (![_yuvOutput configureWithDevice:device library:_library
+    if (![_yuvOutput configureWithDevice:_metalDevice library:_library
                                    width:outW height:outH format:outFmt])
         return NO;
 
@@ -243,9 +295,29 @@ build_uv_transform (VfMetalTransformMethod method, float *mat, float *offset)
 - (BOOL)processFrame:(GstVideoFrame *)inFrame
               output:(GstVideoFrame *)outFrame
               params:(const TransformParams *)params
+{
+    return [self _renderFrame:inFrame output:outFrame params:params
+                         slot:0 completion:nil];
+}
+
+- (BOOL)submitFrame:(GstVideoFrame *)inFrame
+             output:(GstVideoFrame *)outFrame
+             params:(const TransformParams *)params
+               slot:(NSUInteger)slot
+         completion:(VfMetalCompletionHandler)completion
+{
+    return [self _renderFrame:inFrame output:outFrame params:params
+                         slot:slot completion:completion];
+}
+
+- (BOOL)_renderFrame:(GstVideoFrame *)inFrame
+              output:(GstVideoFrame *)outFrame
+              params:(const TransformParams *)params
+                slot:(NSUInteger)slot
+          completion:(VfMetalCompletionHandler)completion
 {
     @autoreleasepool {
-        [_textureCache resetFrameIndex];
+        [_textureCache resetFrameIndexForSlot:slot];
 
         id<MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
         if (!commandBuffer) {
@@ -253,44 +325,19 @@ build_uv_transform (VfMetalTransformMethod method, float *mat, float *offset)
             return NO;
         }
 
+        VfMetalTraceSpan encodeSpan;
+        vf_metal_trace_begin (&encodeSpan, _traceOwner, VF_METAL_STATS_ENCODE);
+
         GstVideoFormat inFmt = GST_VIDEO_FRAME_FORMAT (inFrame);
         VfMetalInputFormat fmtIdx = vf_metal_input_format_index (inFmt);
         int frameW = GST_VIDEO_FRAME_WIDTH (inFrame);
         int frameH = GST_VIDEO_FRAME_HEIGHT (inFrame);
 
-        /* Build UV transform */
         TransformUniformsGPU uniforms;
         memset (&uniforms, 0, sizeof (uniforms));
 
-        /* Compute crop UV offset and scale */
-        float cropL = (float)params->cropLeft / (float)frameW;
-        float cropR = (float)params->cropRight / (float)frameW;
-        float cropT = (float)params->cropTop / (float)frameH;
-        float cropB = (float)params->cropBottom / (float)frameH;
-
-        float cropScaleX = 1.0f - cropL - cropR;
-        float cropScaleY = 1.0f - cropT - cropB;
-        float cropOffsetX = (cropL - cropR) * 0.5f;
-        float cropOffsetY = (cropT - cropB) * 0.5f;
-
-        /* Get transform matrix */
-        float transMat[4], transOff[2];
-        build_uv_transform (params->method, transMat, transOff);
-
-        /* Combine: first apply crop scale, then transform rotation
-         * UV = transform * (crop_scale * centered_uv) + offsets
-         * Combined matrix = transform * diag(cropScale)
-         */
-        uniforms.uvTransform[0] = transMat[0] * cropScaleX;
-        uniforms.uvTransform[1] = transMat[1] * cropScaleX;
-        uniforms.uvTransform[2] = transMat[2] * cropScaleY;
-        uniforms.uvTransform[3] = transMat[3] * cropScaleY;
-
-        /* Offset: transform the crop offset, then add transform offset */
-        uniforms.uvOffset[0] = transMat[0] * cropOffsetX +
-                               transMat[2] * cropOffsetY + transOff[0];
-        uniforms.uvOffset[1] = transMat[1] * cropOffsetX +
-                               transMat[3] * cropOffsetY + transOff[1];
+        vf_metal_transform_build_uv (params, frameW, frameH,
+                                     uniforms.uvTransform, uniforms.uvOffset);
 
         uniforms.colorMatrix = vf_metal_color_matrix_for_frame (inFrame);
         uniforms.padding = 0;
@@ -367,9 +414,22 @@ build_uv_transform (VfMetalTransformMethod method, float *mat, float *offset)
         [_yuvOutput dispatchConversion:commandBuffer
                          sourceTexture:_renderTarget
                                  width:_outWidth height:_outHeight
-                              outFrame:outFrame];
+                              outFrame:outFrame slot:slot];
+
+        if (completion) {
+            vf_metal_trace_end (&encodeSpan);
+            vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
+            [_yuvOutput commitPipelined:commandBuffer
+                          sourceTexture:_renderTarget
+                                  width:_outWidth height:_outHeight
+                               outFrame:outFrame slot:slot
+                             completion:completion];
+            return YES;
+        }
 
         /* Commit and wait */
+        vf_metal_trace_end (&encodeSpan);
+        vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
         [commandBuffer commit];
         [commandBuffer waitUntilCompleted];
 
@@ -26,6 +26,9 @@
 #include <gst/video/video.h>
 #include <gst/video/gstvideofilter.h>
 
+#include "vfmetalcontext.h"
+#include "vfmetalinflight.h"
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_VF_METAL_VIDEO_FILTER (gst_vf_metal_video_filter_get_type())
@@ -71,6 +74,13 @@ struct _GstVfMetalVideoFilter
   /* Frame counter for noise randomization */
   guint64 frame_count;
 
+  /* Pipelined submission: in-flight property, latched into inflight */
+  guint in_flight;
+  VfMetalInflight inflight;
+
+  /* GPU selection; the renderer is created on it at NULL_TO_READY */
+  VfMetalDeviceSelection device;
+
   /* Metal rendering engine (opaque Obj-C object, cast to MetalVideoFilterRenderer* in .m) */
   void *renderer;
 };
@@ -44,6 +44,7 @@
 #import <Foundation/Foundation.h>
 #include "gstvfmetalvideofilter.h"
 #include "metalvideofilterrenderer.h"
+#import "vfmetalmemory.h"
 
 #include <math.h>
 
@@ -55,13 +56,13 @@ GST_DEBUG_CATEGORY (gst_vf_metal_video_filter_debug);
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (VF_METAL_VIDEO_FILTER_FORMATS))
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_VIDEO_FILTER_FORMATS))
     );
 
 static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (VF_METAL_VIDEO_FILTER_FORMATS))
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_VIDEO_FILTER_FORMATS))
     );
 
 enum
@@ -82,6 +83,8 @@ enum
   PROP_CHROMA_KEY_TOLERANCE,
   PROP_CHROMA_KEY_SMOOTHNESS,
   PROP_LUT_FILE,
+  PROP_IN_FLIGHT,
+  PROP_DEVICE,
 };
 
 /* Defaults */
@@ -164,13 +167,68 @@ gst_vf_metal_video_filter_set_info (GstVideoFilter * filter,
   return TRUE;
 }
 
+/* --- Allocation --- */
+
+static gboolean
+gst_vf_metal_video_filter_propose_allocation (GstBaseTransform * trans,
+    GstQuery * decide_query, GstQuery * query)
+{
+  GstVfMetalVideoFilter *self = GST_VF_METAL_VIDEO_FILTER (trans);
+
+  return vf_metal_propose_allocation (trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class),
+      ((__bridge MetalVideoFilterRenderer *)self->renderer).metalDevice,
+      decide_query, query);
+}
+
+static gboolean
+gst_vf_metal_video_filter_decide_allocation (GstBaseTransform * trans,
+    GstQuery * query)
+{
+  GstVfMetalVideoFilter *self = GST_VF_METAL_VIDEO_FILTER (trans);
+
+  return vf_metal_decide_allocation (trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class),
+      ((__bridge MetalVideoFilterRenderer *)self->renderer).metalDevice,
+      &self->inflight, query);
+}
+
 /* --- transform_frame --- */
 
+/* Build params struct — snapshot properties under lock */
+static void
+gst_vf_metal_video_filter_snapshot_params (GstVfMetalVideoFilter * self,
+    VideoFilterParams * params)
+{
+  GST_OBJECT_LOCK (self);
+  params->brightness = (float)self->brightness;
+  params->contrast = (float)self->contrast;
+  params->saturation = (float)self->saturation;
+  params->hue = (float)(self->hue * M_PI);  /* map [-1,1] to [-pi,pi] */
+  params->gamma = (float)self->gamma;
+  params->sharpness = (float)self->sharpness;
+  params->sepia = (float)self->sepia;
+  params->noise = (float)self->noise;
+  params->vignette = (float)self->vignette;
+  params->invert = self->invert ? 1 : 0;
+  params->chromaKeyEnabled = self->chroma_key_enabled ? 1 : 0;
+
+  /* Extract RGB from ARGB color */
+  params->chromaKeyR = ((self->chroma_key_color >> 16) & 0xFF) / 255.0f;
+  params->chromaKeyG = ((self->chroma_key_color >> 8) & 0xFF) / 255.0f;
+  params->chromaKeyB = (self->chroma_key_color & 0xFF) / 255.0f;
+  params->chromaKeyTolerance = (float)self->chroma_key_tolerance;
+  params->chromaKeySmoothness = (float)self->chroma_key_smoothness;
+  GST_OBJECT_UNLOCK (self);
+  params->frameIndex = (uint32_t)(self->frame_count++);
+}
+
 static GstFlowReturn
 gst_vf_metal_video_filter_transform_frame (GstVideoFilter * filter,
     GstVideoFrame * inframe, GstVideoFrame * outframe)
 {
   GstVfMetalVideoFilter *self = GST_VF_METAL_VIDEO_FILTER (filter);
+  VideoFilterParams params;
 
   if (!self->renderer) {
     GST_WARNING_OBJECT (self, "No Metal renderer available");
@@ -180,29 +238,7 @@ gst_vf_metal_video_filter_transform_frame (GstVideoFilter * filter,
   MetalVideoFilterRenderer *renderer =
       (__bridge MetalVideoFilterRenderer *)self->renderer;
 
-  /* Build params struct — snapshot properties under lock */
-  VideoFilterParams params;
-  GST_OBJECT_LOCK (self);
-  params.brightness = (float)self->brightness;
-  params.contrast = (float)self->contrast;
-  params.saturation = (float)self->saturation;
-  params.hue = (float)(self->hue * M_PI);  /* map [-1,1] to [-pi,pi] */
-  params.gamma = (float)self->gamma;
-  params.sharpness = (float)self->sharpness;
-  params.sepia = (float)self->sepia;
-  params.noise = (float)self->noise;
-  params.vignette = (float)self->vignette;
-  params.invert = self->invert ? 1 : 0;
-  params.chromaKeyEnabled = self->chroma_key_enabled ? 1 : 0;
-
-  /* Extract RGB from ARGB color */
-  params.chromaKeyR = ((self->chroma_key_color >> 16) & 0xFF) / 255.0f;
-  params.chromaKeyG = ((self->chroma_key_color >> 8) & 0xFF) / 255.0f;
-  params.chromaKeyB = (self->chroma_key_color & 0xFF) / 255.0f;
-  params.chromaKeyTolerance = (float)self->chroma_key_tolerance;
-  params.chromaKeySmoothness = (float)self->chroma_key_smoothness;
-  GST_OBJECT_UNLOCK (self);
-  params.frameIndex = (uint32_t)(self->frame_count++);
+  gst_vf_metal_video_filter_snapshot_params (self, &params);
 
   @autoreleasepool {
     if (![renderer processFrame:inframe output:outframe params:&params]) {
@@ -214,14 +250,119 @@ gst_vf_metal_video_filter_transform_frame (GstVideoFilter * filter,
   return GST_FLOW_OK;
 }
 
+/* --- Pipelined submission (in-flight > 1) --- */
+
+static gboolean
+gst_vf_metal_video_filter_submit (GstBaseTransform * trans,
+    VfMetalInflightJob * job, VfMetalCompletionHandler completion)
+{
+  GstVfMetalVideoFilter *self = GST_VF_METAL_VIDEO_FILTER (trans);
+  VideoFilterParams params;
+
+  if (!self->renderer)
+    return FALSE;
+
+  MetalVideoFilterRenderer *renderer =
+      (__bridge MetalVideoFilterRenderer *)self->renderer;
+
+  gst_vf_metal_video_filter_snapshot_params (self, &params);
+
+  @autoreleasepool {
+    return [renderer submitFrame:&job->in_frame output:&job->out_frame
+                          params:&params slot:job->slot
+                      completion:completion];
+  }
+}
+
+static GstFlowReturn
+gst_vf_metal_video_filter_generate_output (GstBaseTransform * trans,
+    GstBuffer ** outbuf)
+{
+  GstVfMetalVideoFilter *self = GST_VF_METAL_VIDEO_FILTER (trans);
+  GstVideoFilter *filter = GST_VIDEO_FILTER (trans);
+
+  return vf_metal_inflight_generate_output (&self->inflight, trans,
+      GST_BASE_TRANSFORM_CLASS (parent_class), &filter->in_info,
+      &filter->out_info, gst_vf_metal_video_filter_submit, outbuf);
+}
+
+static gboolean
+gst_vf_metal_video_filter_sink_event (GstBaseTransform * trans,
+    GstEvent * event)
+{
+  GstVfMetalVideoFilter *self = GST_VF_METAL_VIDEO_FILTER (trans);
+
+  vf_metal_inflight_sink_event (&self->inflight, trans, event);
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event);
+}
+
+static gboolean
+gst_vf_metal_video_filter_query (GstBaseTransform * trans,
+    GstPadDirection direction, GstQuery * query)
+{
+  GstVfMetalVideoFilter *self = GST_VF_METAL_VIDEO_FILTER (trans);
+  GstVideoInfo *info = &GST_VIDEO_FILTER (trans)->out_info;
+
+  if (vf_metal_device_selection_handle_query (GST_ELEMENT (trans),
+          &self->device, query))
+    return TRUE;
+
+  if (!GST_BASE_TRANSFORM_CLASS (parent_class)->query (trans, direction,
+          query))
+    return FALSE;
+
+  if (direction == GST_PAD_SRC && GST_QUERY_TYPE (query) == GST_QUERY_LATENCY
+      && !gst_base_transform_is_passthrough (trans)) {
+    vf_metal_inflight_add_latency (&self->inflight, query,
+        GST_VIDEO_INFO_FPS_N (info), GST_VIDEO_INFO_FPS_D (info));
+  }
+
+  return TRUE;
+}
+
 /* --- Properties --- */
 
+/* The LUT is decoded on a background queue and swapped in between
+ * frames, so a new look never stalls streaming */
+static void
+gst_vf_metal_video_filter_load_lut (GstVfMetalVideoFilter * self)
+{
+  if (!self->renderer)
+    return;
+
+  @autoreleasepool {
+    MetalVideoFilterRenderer *renderer =
+        (__bridge MetalVideoFilterRenderer *)self->renderer;
+    GstObject *ref = gst_object_ref (self);
+    gchar *path;
+
+    GST_OBJECT_LOCK (self);
+    path = g_strdup (self->lut_file);
+    GST_OBJECT_UNLOCK (self);
+
+    [renderer requestLUTFromFile:path completion:^(BOOL loaded) {
+      if (!loaded)
+        GST_WARNING_OBJECT (ref, "Failed to load LUT: %s", path);
+      g_free (path);
+      gst_object_unref (ref);
+    }];
+  }
+}
+
 static void
 gst_vf_metal_video_filter_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
 {
   GstVfMetalVideoFilter *self = GST_VF_METAL_VIDEO_FILTER (object);
 
+  /* Takes the object lock itself */
+  if (prop_id == PROP_DEVICE) {
+    vf_metal_device_selection_set_property (GST_ELEMENT (self),
+        &self->device, value);
+    return;
+  }
+
   GST_OBJECT_LOCK (self);
   switch (prop_id) {
     case PROP_BRIGHTNESS:
@@ -270,6 +411,9 @@ gst_vf_metal_video_filter_set_property (GObject * object, guint prop_id,
       g_free (self->lut_file);
       self->lut_file = g_value_dup_string (value);
       break;
+    case PROP_IN_FLIGHT:
+      self->in_flight = g_value_get_uint (value);
+      break;
     default:
       GST_OBJECT_UNLOCK (self);
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -277,21 +421,8 @@ gst_vf_metal_video_filter_set_property (GObject * object, guint prop_id,
   }
   GST_OBJECT_UNLOCK (self);
 
-  /* LUT loading outside lock (involves Metal GPU operations) */
-  if (prop_id == PROP_LUT_FILE && self->renderer) {
-    @autoreleasepool {
-      MetalVideoFilterRenderer *renderer =
-          (__bridge MetalVideoFilterRenderer *)self->renderer;
-      if (self->lut_file && self->lut_file[0] != '\0') {
-        if (![renderer loadLUTFromFile:self->lut_file]) {
-          GST_WARNING_OBJECT (self, "Failed to load LUT: %s",
-                             self->lut_file);
-        }
-      } else {
-        [renderer clearLUT];
-      }
-    }
-  }
+  if (prop_id == PROP_LUT_FILE)
+    gst_vf_metal_video_filter_load_lut (self);
 
   gst_vf_metal_video_filter_update_passthrough (self);
 }
@@ -302,6 +433,12 @@ gst_vf_metal_video_filter_get_property (GObject * object, guint prop_id,
 {
   GstVfMetalVideoFilter *self = GST_VF_METAL_VIDEO_FILTER (object);
 
+  if (prop_id == PROP_DEVICE) {
+    vf_metal_device_selection_get_property (GST_ELEMENT (self),
+        &self->device, value);
+    return;
+  }
+
   GST_OBJECT_LOCK (self);
   switch (prop_id) {
     case PROP_BRIGHTNESS:
@@ -349,6 +486,9 @@ gst_vf_metal_video_filter_get_property (GObject * object, guint prop_id,
     case PROP_LUT_FILE:
       g_value_set_string (value, self->lut_file);
       break;
+    case PROP_IN_FLIGHT:
+      g_value_set_uint (value, self->in_flight);
+      break;
     default:
       GST_OBJECT_UNLOCK (self);
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -357,6 +497,60 @@ gst_vf_metal_video_filter_get_property (GObject * object, guint prop_id,
   GST_OBJECT_UNLOCK (self);
 }
 
+/* --- Device --- */
+
+static void
+gst_vf_metal_video_filter_set_context (GstElement * element,
+    GstContext * context)
+{
+  GstVfMetalVideoFilter *self = GST_VF_METAL_VIDEO_FILTER (element);
+
+  vf_metal_device_selection_set_context (element, &self->device, context);
+
+  GST_ELEMENT_CLASS (parent_class)->set_context (element, context);
+}
+
+/* Renderer on the selected GPU, replaced when the selection moved. A new
+ * renderer gets the LUT set before it existed. */
+static gboolean
+gst_vf_metal_video_filter_ensure_renderer (GstVfMetalVideoFilter * self)
+{
+  VfMetalDevice *device;
+
+  device = vf_metal_device_selection_ensure (GST_ELEMENT (self),
+      &self->device);
+  if (!device)
+    return FALSE;
+
+  @autoreleasepool {
+    if (self->renderer) {
+      MetalVideoFilterRenderer *renderer =
+          (__bridge MetalVideoFilterRenderer *)self->renderer;
+      if (renderer.metalDevice == device)
+        return TRUE;
+
+      renderer = (__bridge_transfer MetalVideoFilterRenderer *)self->renderer;
+      self->renderer = NULL;
+      [renderer cleanup];
+    }
+
+    MetalVideoFilterRenderer *renderer =
+        [[MetalVideoFilterRenderer alloc] initWithDevice:device];
+    if (!renderer) {
+      GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+          ("Failed to create Metal renderer on '%s'",
+              device.device.name.UTF8String), (NULL));
+      return FALSE;
+    }
+    renderer.traceOwner = GST_OBJECT (self);
+    self->renderer = (__bridge_retained void *)renderer;
+  }
+
+  gst_vf_metal_video_filter_load_lut (self);
+
+  return TRUE;
+}
+
 /* --- State change --- */
 
 static GstStateChangeReturn
@@ -365,11 +559,23 @@ gst_vf_metal_video_filter_change_state (GstElement * element,
 {
   GstVfMetalVideoFilter *self = GST_VF_METAL_VIDEO_FILTER (element);
   GstStateChangeReturn ret;
+  guint in_flight;
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY &&
+      !gst_vf_metal_video_filter_ensure_renderer (self))
+    return GST_STATE_CHANGE_FAILURE;
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+    GST_OBJECT_LOCK (self);
+    in_flight = self->in_flight;
+    GST_OBJECT_UNLOCK (self);
+    vf_metal_inflight_start (&self->inflight, in_flight);
+  }
 
   ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
 
   switch (transition) {
     case GST_STATE_CHANGE_PAUSED_TO_READY:
+      vf_metal_inflight_stop (&self->inflight);
       if (self->renderer) {
         @autoreleasepool {
           MetalVideoFilterRenderer *renderer =
@@ -379,6 +585,9 @@ gst_vf_metal_video_filter_change_state (GstElement * element,
       }
       self->frame_count = 0;
       break;
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      vf_metal_device_selection_reset (element, &self->device);
+      break;
     default:
       break;
   }
@@ -406,6 +615,9 @@ gst_vf_metal_video_filter_finalize (GObject * object)
   g_free (self->lut_file);
   self->lut_file = NULL;
 
+  vf_metal_inflight_clear (&self->inflight);
+  vf_metal_device_selection_clear (&self->device);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -416,6 +628,7 @@ gst_vf_metal_video_filter_class_init (GstVfMetalVideoFilterClass * klass)
 {
   GObjectClass *gobject_class = (GObjectClass *) klass;
   GstElementClass *gstelement_class = (GstElementClass *) klass;
+  GstBaseTransformClass *basetransform_class = (GstBaseTransformClass *) klass;
   GstVideoFilterClass *gstvideofilter_class = (GstVideoFilterClass *) klass;
 
   gobject_class->set_property = gst_vf_metal_video_filter_set_property;
@@ -424,11 +637,23 @@ gst_vf_metal_video_filter_class_init (GstVfMetalVideoFilterClass * klass)
 
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_vf_metal_video_filter_change_state);
+  gstelement_class->set_context =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_video_filter_set_context);
 
   gstvideofilter_class->set_info =
       GST_DEBUG_FUNCPTR (gst_vf_metal_video_filter_set_info);
   gstvideofilter_class->transform_frame =
       GST_DEBUG_FUNCPTR (gst_vf_metal_video_filter_transform_frame);
+  basetransform_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_video_filter_propose_allocation);
+  basetransform_class->decide_allocation =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_video_filter_decide_allocation);
+  basetransform_class->generate_output =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_video_filter_generate_output);
+  basetransform_class->sink_event =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_video_filter_sink_event);
+  basetransform_class->query =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_video_filter_query);
 
   /* --- Install properties --- */
 
@@ -532,6 +757,18 @@ gst_vf_metal_video_filter_class_init (GstVfMetalVideoFilterClass * klass)
           NULL,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_IN_FLIGHT,
+      g_param_spec_uint ("in-flight", "In-flight frames",
+          "Frames queued on the GPU before the oldest is pushed downstream "
+          "(1 = wait for every frame; each extra frame adds one frame of "
+          "latency)",
+          1, VF_METAL_MAX_IN_FLIGHT, VF_METAL_DEFAULT_IN_FLIGHT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_DEVICE,
+      vf_metal_device_selection_param_spec ());
+
   /* Pad templates */
   gst_element_class_add_static_pad_template (gstelement_class, &sink_template);
   gst_element_class_add_static_pad_template (gstelement_class, &src_template);
@@ -568,17 +805,11 @@ gst_vf_metal_video_filter_init (GstVfMetalVideoFilter * self)
   self->chroma_key_smoothness = DEFAULT_CHROMA_KEY_SMOOTHNESS;
   self->lut_file = NULL;
   self->frame_count = 0;
+  self->in_flight = VF_METAL_DEFAULT_IN_FLIGHT;
+  vf_metal_inflight_init (&self->inflight);
 
-  @autoreleasepool {
-    MetalVideoFilterRenderer *renderer =
-        [[MetalVideoFilterRenderer alloc] init];
-    if (renderer) {
-      self->renderer = (__bridge_retained void *)renderer;
-    } else {
-      GST_ERROR_OBJECT (self,
-          "Failed to create Metal renderer — no Metal device");
-    }
-  }
+  /* The renderer waits for NULL_TO_READY, when the GPU is known */
+  vf_metal_device_selection_init (&self->device);
 
   /* Start in passthrough mode (all defaults) */
   gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (self), TRUE);
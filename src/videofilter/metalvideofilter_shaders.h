@@ -24,9 +24,32 @@
 
 #import <Foundation/Foundation.h>
 
+/* sharpenTiled works on square tiles of this edge (the threadgroup size)
+ * and sizes its threadgroup buffers for radii up to the maximum */
+#define VF_METAL_SHARPEN_TILE 16
+#define VF_METAL_SHARPEN_MAX_RADIUS 8
+
+/* Radius the renderers specialise it with: 9 taps, sigma 2 */
+#define VF_METAL_SHARPEN_RADIUS 4
+
+/* Effect bits of the filterFeatures function constant; filterFragment*
+ * variants compile out every stage whose bit is clear */
+#define VF_METAL_FILTER_BRIGHTNESS  (1u << 0)
+#define VF_METAL_FILTER_CONTRAST    (1u << 1)
+#define VF_METAL_FILTER_SATURATION  (1u << 2)
+#define VF_METAL_FILTER_HUE         (1u << 3)
+#define VF_METAL_FILTER_GAMMA       (1u << 4)
+#define VF_METAL_FILTER_SEPIA       (1u << 5)
+#define VF_METAL_FILTER_INVERT      (1u << 6)
+#define VF_METAL_FILTER_CHROMA_KEY  (1u << 7)
+#define VF_METAL_FILTER_VIGNETTE    (1u << 8)
+#define VF_METAL_FILTER_NOISE       (1u << 9)
+#define VF_METAL_FILTER_LUT         (1u << 10)
+#define VF_METAL_FILTER_ALL         ((1u << 11) - 1)
+
 /* Video filter shader source — concatenated after kVfMetalCommonShaderSource.
  * Contains compute kernels for color adjustment, blur/sharpen, chroma key,
- * LUT application, and output format conversion. */
+ * LUT application and baking, and output format conversion. */
 
 static NSString *const kVideoFilterShaderSource = @R"(
 
@@ -51,13 +74,38 @@ struct FilterUniforms {
     float chromaKeySmoothness;  // [0, 1]
     uint width;
     uint height;
-    int colorMatrix;        // 0=BT.601, 1=BT.709
+    int colorMatrix;        // colour word, VF_COLOR_*
     uint frameIndex;        // for noise randomization
     int hasLUT;             // 0 or 1
     int lutSize;            // LUT dimension (e.g. 33 or 64)
     float padding;
 };
 
+// --- Effect selection ---
+//
+// Pipelines specialised with filterFeatures drop the stages whose bit is
+// clear at compile time; without it (chain, LUT bake, generic variant)
+// every stage stays behind its runtime check. Bits match
+// VF_METAL_FILTER_*.
+
+constant uint filterFeatures [[function_constant(1)]];
+constant uint FILTER_FEATURES = is_function_constant_defined(filterFeatures)
+    ? filterFeatures : 0xFFFFFFFFu;
+
+constant uint FILTER_BRIGHTNESS = 1u << 0;
+constant uint FILTER_CONTRAST   = 1u << 1;
+constant uint FILTER_SATURATION = 1u << 2;
+constant uint FILTER_HUE        = 1u << 3;
+constant uint FILTER_GAMMA      = 1u << 4;
+constant uint FILTER_SEPIA      = 1u << 5;
+constant uint FILTER_INVERT     = 1u << 6;
+constant uint FILTER_CHROMA_KEY = 1u << 7;
+constant uint FILTER_VIGNETTE   = 1u << 8;
+constant uint FILTER_NOISE      = 1u << 9;
+constant uint FILTER_LUT        = 1u << 10;
+
+#define FILTER_HAS(bit) ((FILTER_FEATURES & (bit)) != 0)
+
 // --- Hash function for noise ---
 
 static inline float hash12(float2 p, uint frame) {
@@ -92,27 +140,33 @@ static inline float4 applyColorAdjustments(float4 color,
     float alpha = color.a;
 
     // Brightness
-    rgb += u.brightness;
+    if (FILTER_HAS(FILTER_BRIGHTNESS))
+        rgb += u.brightness;
 
     // Contrast
-    rgb = (rgb - 0.5) * u.contrast + 0.5;
+    if (FILTER_HAS(FILTER_CONTRAST))
+        rgb = (rgb - 0.5) * u.contrast + 0.5;
 
     // Saturation
-    float lum = dot(rgb, float3(0.2126, 0.7152, 0.0722));
-    rgb = mix(float3(lum), rgb, u.saturation);
+    if (FILTER_HAS(FILTER_SATURATION)) {
+        float lum = dot(rgb, float3(0.2126, 0.7152, 0.0722));
+        rgb = mix(float3(lum), rgb, u.saturation);
+    }
 
     // Hue rotation (only if hue != 0)
-    if (abs(u.hue) > 0.001) {
+    if (FILTER_HAS(FILTER_HUE) && abs(u.hue) > 0.001) {
         float3 hsv = rgbToHsv(clamp(rgb, 0.0, 1.0));
         hsv.x = fract(hsv.x + u.hue / (2.0 * M_PI_F));
         rgb = hsvToRgb(hsv);
     }
 
-    // Gamma
-    rgb = pow(clamp(rgb, 0.0001, 1.0), float3(1.0 / u.gamma));
+    // Gamma; the clamp also applies at gamma 1, where the pow is dropped
+    rgb = clamp(rgb, 0.0001, 1.0);
+    if (FILTER_HAS(FILTER_GAMMA))
+        rgb = pow(rgb, float3(1.0 / u.gamma));
 
     // Sepia
-    if (u.sepia > 0.001) {
+    if (FILTER_HAS(FILTER_SEPIA) && u.sepia > 0.001) {
         float3 sepiaColor = float3(
             dot(rgb, float3(0.393, 0.769, 0.189)),
             dot(rgb, float3(0.349, 0.686, 0.168)),
@@ -122,12 +176,12 @@ static inline float4 applyColorAdjustments(float4 color,
     }
 
     // Invert
-    if (u.invert) {
+    if (FILTER_HAS(FILTER_INVERT) && u.invert) {
         rgb = 1.0 - rgb;
     }
 
     // Chroma key
-    if (u.chromaKeyEnabled) {
+    if (FILTER_HAS(FILTER_CHROMA_KEY) && u.chromaKeyEnabled) {
         float3 keyColor = float3(u.chromaKeyR, u.chromaKeyG, u.chromaKeyB);
         float dist = distance(rgb, keyColor);
         float mask = smoothstep(u.chromaKeyTolerance,
@@ -137,7 +191,7 @@ static inline float4 applyColorAdjustments(float4 color,
     }
 
     // Vignette
-    if (u.vignette > 0.001) {
+    if (FILTER_HAS(FILTER_VIGNETTE) && u.vignette > 0.001) {
         float2 center = texcoord - 0.5;
         float dist = length(center) * 1.414;  // normalize to [0,1] at corners
         float vig = 1.0 - smoothstep(0.5, 1.0, dist) * u.vignette;
@@ -145,7 +199,7 @@ static inline float4 applyColorAdjustments(float4 color,
     }
 
     // Noise (film grain)
-    if (u.noise > 0.001) {
+    if (FILTER_HAS(FILTER_NOISE) && u.noise > 0.001) {
         float n = hash12(texcoord * float2(u.width, u.height), u.frameIndex);
         n = (n - 0.5) * u.noise * 0.5;
         rgb += n;
@@ -185,7 +239,7 @@ fragment float4 filterFragmentRGBA(
     color = applyColorAdjustments(color, uniforms, in.texcoord);
 
     // LUT
-    if (uniforms.hasLUT) {
+    if (FILTER_HAS(FILTER_LUT) && uniforms.hasLUT) {
         constexpr sampler lutSampler(filter::linear, address::clamp_to_edge);
         float scale = float(uniforms.lutSize - 1) / float(uniforms.lutSize);
         float offset = 0.5 / float(uniforms.lutSize);
@@ -212,7 +266,7 @@ fragment float4 filterFragmentNV12(
 
     color = applyColorAdjustments(color, uniforms, in.texcoord);
 
-    if (uniforms.hasLUT) {
+    if (FILTER_HAS(FILTER_LUT) && uniforms.hasLUT) {
         constexpr sampler lutSampler(filter::linear, address::clamp_to_edge);
         float scale = float(uniforms.lutSize - 1) / float(uniforms.lutSize);
         float offset = 0.5 / float(uniforms.lutSize);
@@ -241,7 +295,7 @@ fragment float4 filterFragmentI420(
 
     color = applyColorAdjustments(color, uniforms, in.texcoord);
 
-    if (uniforms.hasLUT) {
+    if (FILTER_HAS(FILTER_LUT) && uniforms.hasLUT) {
         constexpr sampler lutSampler(filter::linear, address::clamp_to_edge);
         float scale = float(uniforms.lutSize - 1) / float(uniforms.lutSize);
         float offset = 0.5 / float(uniforms.lutSize);
@@ -252,79 +306,169 @@ fragment float4 filterFragmentI420(
     return color;
 }
 
-// --- Gaussian blur compute kernels (separable, for sharpness) ---
-
-constant int BLUR_KERNEL_SIZE = 9;
-constant float blurWeights[9] = {
-    0.028532, 0.067234, 0.124009, 0.179044, 0.20236,
-    0.179044, 0.124009, 0.067234, 0.028532
-};
+// --- Baked colour LUT ---
+//
+// With noise and vignette off the adjustments above, the loaded LUT and
+// the chroma key mask are a pure function of the input colour. They are
+// evaluated once per lattice point into lutSize^3 RGBA (rgb = result,
+// a = key mask), and the baked fragments do one lookup per pixel.
 
-kernel void blurHorizontal(
-    texture2d<float, access::read> inputTex [[texture(0)]],
-    texture2d<float, access::write> outputTex [[texture(1)]],
-    uint2 gid [[thread_position_in_grid]]
+kernel void bakeColorLUT(
+    constant FilterUniforms &uniforms [[buffer(0)]],
+    texture3d<float> lutTex [[texture(0)]],
+    texture3d<float, access::write> bakedTex [[texture(1)]],
+    uint3 gid [[thread_position_in_grid]]
 ) {
-    uint w = inputTex.get_width();
-    uint h = inputTex.get_height();
-    if (gid.x >= w || gid.y >= h) return;
-
-    float4 sum = float4(0);
-    int halfKernel = BLUR_KERNEL_SIZE / 2;
-    for (int i = 0; i < BLUR_KERNEL_SIZE; i++) {
-        int x = int(gid.x) + i - halfKernel;
-        x = clamp(x, 0, int(w) - 1);
-        sum += inputTex.read(uint2(x, gid.y)) * blurWeights[i];
+    uint size = bakedTex.get_width();
+    if (gid.x >= size || gid.y >= size || gid.z >= size) return;
+
+    float4 color = float4(float3(gid) / float(size - 1), 1.0);
+    color = applyColorAdjustments(color, uniforms, float2(0.5));
+
+    if (uniforms.hasLUT) {
+        constexpr sampler lutSampler(filter::linear, address::clamp_to_edge);
+        float scale = float(uniforms.lutSize - 1) / float(uniforms.lutSize);
+        float offset = 0.5 / float(uniforms.lutSize);
+        color.rgb = lutTex.sample(lutSampler, color.rgb * scale + offset).rgb;
     }
-    outputTex.write(sum, gid);
+
+    bakedTex.write(color, gid);
 }
 
-kernel void blurVertical(
-    texture2d<float, access::read> inputTex [[texture(0)]],
-    texture2d<float, access::write> outputTex [[texture(1)]],
-    uint2 gid [[thread_position_in_grid]]
+static inline float4 sampleBakedLUT(float4 color, texture3d<float> bakedTex) {
+    constexpr sampler lutSampler(filter::linear, address::clamp_to_edge);
+    float size = float(bakedTex.get_width());
+    float3 coord = clamp(color.rgb, 0.0, 1.0) * ((size - 1.0) / size) +
+                   0.5 / size;
+    float4 baked = bakedTex.sample(lutSampler, coord);
+    return float4(baked.rgb, color.a * baked.a);
+}
+
+fragment float4 filterFragmentBakedRGBA(
+    VertexOut in [[stage_in]],
+    constant FilterUniforms &uniforms [[buffer(0)]],
+    texture2d<float> tex [[texture(0)]],
+    texture3d<float> bakedTex [[texture(1)]]
 ) {
-    uint w = inputTex.get_width();
-    uint h = inputTex.get_height();
-    if (gid.x >= w || gid.y >= h) return;
-
-    float4 sum = float4(0);
-    int halfKernel = BLUR_KERNEL_SIZE / 2;
-    for (int i = 0; i < BLUR_KERNEL_SIZE; i++) {
-        int y = int(gid.y) + i - halfKernel;
-        y = clamp(y, 0, int(h) - 1);
-        sum += inputTex.read(uint2(gid.x, y)) * blurWeights[i];
-    }
-    outputTex.write(sum, gid);
+    constexpr sampler s(filter::linear, address::clamp_to_edge);
+    return sampleBakedLUT(tex.sample(s, in.texcoord), bakedTex);
+}
+
+fragment float4 filterFragmentBakedNV12(
+    VertexOut in [[stage_in]],
+    constant FilterUniforms &uniforms [[buffer(0)]],
+    texture2d<float> yTex [[texture(0)]],
+    texture2d<float> uvTex [[texture(1)]],
+    texture3d<float> bakedTex [[texture(2)]]
+) {
+    constexpr sampler s(filter::linear, address::clamp_to_edge);
+    float y  = yTex.sample(s, in.texcoord).r;
+    float2 uv = uvTex.sample(s, in.texcoord).rg;
+    float3 rgb = yuvToRGB(y, uv.r, uv.g, uniforms.colorMatrix);
+    return sampleBakedLUT(float4(rgb, 1.0), bakedTex);
 }
 
-// Unsharp mask: sharp = original + (original - blurred) * amount
-kernel void unsharpMask(
-    texture2d<float, access::read> originalTex [[texture(0)]],
-    texture2d<float, access::read> blurredTex [[texture(1)]],
-    texture2d<float, access::write> outputTex [[texture(2)]],
+fragment float4 filterFragmentBakedI420(
+    VertexOut in [[stage_in]],
+    constant FilterUniforms &uniforms [[buffer(0)]],
+    texture2d<float> yTex [[texture(0)]],
+    texture2d<float> uTex [[texture(1)]],
+    texture2d<float> vTex [[texture(2)]],
+    texture3d<float> bakedTex [[texture(3)]]
+) {
+    constexpr sampler s(filter::linear, address::clamp_to_edge);
+    float y  = yTex.sample(s, in.texcoord).r;
+    float cb = uTex.sample(s, in.texcoord).r;
+    float cr = vTex.sample(s, in.texcoord).r;
+    float3 rgb = yuvToRGB(y, cb, cr, uniforms.colorMatrix);
+    return sampleBakedLUT(float4(rgb, 1.0), bakedTex);
+}
+
+// --- Tiled Gaussian blur / unsharp mask (separable, for sharpness) ---
+//
+// Each 16x16 threadgroup stages its tile plus a radius-wide apron in
+// threadgroup memory, blurs the rows into a second buffer, then blurs the
+// columns and applies the unsharp mix in place: one dispatch, and every
+// source texel is read from device memory once per tile. The radius is a
+// function constant so the tap loops unroll; sigma = radius / 2.
+
+constant int sharpenRadiusConstant [[function_constant(0)]];
+constant int SHARPEN_RADIUS = is_function_constant_defined(sharpenRadiusConstant)
+    ? sharpenRadiusConstant : 4;
+
+constant int SHARPEN_TILE = 16;         // VF_METAL_SHARPEN_TILE
+constant int SHARPEN_MAX_RADIUS = 8;    // VF_METAL_SHARPEN_MAX_RADIUS
+constant int SHARPEN_MAX_APRON = SHARPEN_TILE + 2 * SHARPEN_MAX_RADIUS;
+
+kernel void sharpenTiled(
+    texture2d<float, access::read> inputTex [[texture(0)]],
+    texture2d<float, access::write> outputTex [[texture(1)]],
     constant float &amount [[buffer(0)]],
-    uint2 gid [[thread_position_in_grid]]
+    uint2 gid [[thread_position_in_grid]],
+    uint2 lid [[thread_position_in_threadgroup]],
+    uint2 groupId [[threadgroup_position_in_grid]]
 ) {
-    uint w = originalTex.get_width();
-    uint h = originalTex.get_height();
-    if (gid.x >= w || gid.y >= h) return;
+    threadgroup half4 tile[SHARPEN_MAX_APRON][SHARPEN_MAX_APRON];
+    threadgroup half4 rows[SHARPEN_MAX_APRON][SHARPEN_TILE];
+
+    const int radius = min(SHARPEN_RADIUS, SHARPEN_MAX_RADIUS);
+    const int span = SHARPEN_TILE + 2 * radius;
+    const uint local = lid.y * SHARPEN_TILE + lid.x;
+    int w = int(inputTex.get_width());
+    int h = int(inputTex.get_height());
+    int2 origin = int2(groupId) * SHARPEN_TILE - radius;
+
+    // Stage tile + apron, clamping at the frame edges
+    for (uint i = local; i < uint(span * span); i += SHARPEN_TILE * SHARPEN_TILE) {
+        int ty = int(i) / span;
+        int tx = int(i) % span;
+        int2 p = clamp(origin + int2(tx, ty), int2(0), int2(w - 1, h - 1));
+        tile[ty][tx] = half4(inputTex.read(uint2(p)));
+    }
+
+    float weights[SHARPEN_MAX_RADIUS + 1];
+    float twoSigma2 = max(float(radius) * float(radius) * 0.5, 0.5);
+    float norm = 0.0;
+    for (int k = 0; k <= radius; k++) {
+        weights[k] = exp(-float(k * k) / twoSigma2);
+        norm += (k == 0) ? weights[k] : 2.0 * weights[k];
+    }
+    for (int k = 0; k <= radius; k++)
+        weights[k] /= norm;
+
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    // Horizontal pass over every staged row
+    for (uint i = local; i < uint(span * SHARPEN_TILE); i += SHARPEN_TILE * SHARPEN_TILE) {
+        int ty = int(i) / SHARPEN_TILE;
+        int tx = int(i) % SHARPEN_TILE + radius;
+        float4 sum = float4(tile[ty][tx]) * weights[0];
+        for (int k = 1; k <= radius; k++)
+            sum += (float4(tile[ty][tx - k]) + float4(tile[ty][tx + k])) * weights[k];
+        rows[ty][tx - radius] = half4(sum);
+    }
+
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    if (gid.x >= uint(w) || gid.y >= uint(h)) return;
 
-    float4 original = originalTex.read(gid);
-    float4 blurred = blurredTex.read(gid);
+    // Vertical pass, then the unsharp mix against the full-precision source
+    int cy = int(lid.y) + radius;
+    float4 blurred = float4(rows[cy][lid.x]) * weights[0];
+    for (int k = 1; k <= radius; k++)
+        blurred += (float4(rows[cy - k][lid.x]) + float4(rows[cy + k][lid.x])) * weights[k];
 
+    float4 original = inputTex.read(gid);
+    float4 result;
     if (amount > 0) {
         // Sharpen: original + (original - blurred) * amount
-        float4 result = original + (original - blurred) * amount;
-        result = clamp(result, 0.0, 1.0);
-        result.a = original.a;
-        outputTex.write(result, gid);
+        result = clamp(original + (original - blurred) * amount, 0.0, 1.0);
     } else {
         // Blur: mix original with blurred based on |amount|
-        float4 result = mix(original, blurred, abs(amount));
-        result.a = original.a;
-        outputTex.write(result, gid);
+        result = mix(original, blurred, abs(amount));
     }
+    result.a = original.a;
+    outputTex.write(result, gid);
 }
 
 )";
@@ -26,6 +26,9 @@
 #import <Metal/Metal.h>
 #import <gst/video/video.h>
 
+#import "vfmetaldevice.h"
+#import "vfmetalinflight.h"
+
 /* All filter parameters passed to the renderer per frame */
 typedef struct {
     float brightness;
@@ -45,9 +48,55 @@ typedef struct {
     uint32_t frameIndex;
 } VideoFilterParams;
 
+/* Decode a .cube or .png 3D LUT into an RGBA16Float 3D texture, picking
+ * the parser by extension. Results are cached per process by path,
+ * modification time and size, so switching back to a look is free.
+ * Returns nil on error. */
+id<MTLTexture> vf_metal_load_lut_file (const char *path,
+                                       id<MTLDevice> device, int *outSize);
+
+/* The LUT a renderer samples, replaced only between frames. Requested
+ * files are decoded on a background queue; the previous LUT stays in use
+ * until the new one is ready, so switching looks never stalls a frame. */
+@interface VfMetalLUTSlot : NSObject
+
+/* LUT textures are created on @metalDevice, the renderer's own GPU */
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice;
+
+/* Current LUT; only valid on the streaming thread after -acquire */
+@property (nonatomic, readonly) id<MTLTexture> texture;
+@property (nonatomic, readonly) int size;
+
+/* Decode @path (NULL or empty clears) in the background. @completion, if
+ * set, runs on the loading queue with the result. A newer request
+ * supersedes an older one that has not finished. */
+- (void)requestFile:(const char *)path
+         completion:(void (^)(BOOL loaded))completion;
+
+/* Same, decoded on the calling thread */
+- (BOOL)loadFile:(const char *)path;
+
+/* Call at the start of every frame to take the newest finished request.
+ * The first frame waits for outstanding requests, so a LUT set before
+ * streaming is applied from the first frame on. */
+- (void)acquire;
+
+/* Treat the next frame as the first one again (after stopping) */
+- (void)rewind;
+
+@end
+
 @interface MetalVideoFilterRenderer : NSObject
 
+/* Element this renderer's stages are traced for (see vfmetaltrace.h) */
+@property (nonatomic, assign) GstObject *traceOwner;
+
+/* GPU this renderer runs on, fixed at creation */
+@property (nonatomic, readonly) VfMetalDevice *metalDevice;
+
+/* -init uses the default device (+[VfMetalDevice sharedDevice]) */
 - (instancetype)init;
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice;
 
 /* Configure for new video format; called from set_info */
 - (BOOL)configureWithInputInfo:(GstVideoInfo *)inInfo
@@ -58,10 +107,25 @@ typedef struct {
               output:(GstVideoFrame *)outFrame
               params:(const VideoFilterParams *)params;
 
-/* Load a 3D LUT from a .cube or .png file */
+/* Pipelined variant: encode into ring @slot, commit without waiting and
+ * call @completion once outFrame has been read back. Returns NO (and
+ * never calls @completion) if nothing was committed. */
+- (BOOL)submitFrame:(GstVideoFrame *)inFrame
+             output:(GstVideoFrame *)outFrame
+             params:(const VideoFilterParams *)params
+               slot:(NSUInteger)slot
+         completion:(VfMetalCompletionHandler)completion;
+
+/* Load a 3D LUT from a .cube or .png file on the calling thread; it is
+ * used from the next frame on */
 - (BOOL)loadLUTFromFile:(const char *)path;
 
-/* Clear the loaded LUT */
+/* Load it in the background instead (see VfMetalLUTSlot); safe to call
+ * while streaming */
+- (void)requestLUTFromFile:(const char *)path
+                completion:(void (^)(BOOL loaded))completion;
+
+/* Clear the loaded LUT from the next frame on */
 - (void)clearLUT;
 
 /* Lifecycle */
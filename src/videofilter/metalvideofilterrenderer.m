@@ -25,6 +25,7 @@
 #import "vfmetaltextureutil.h"
 #import "vfmetalshaders.h"
 #import "vfmetalyuvoutput.h"
+#import "vfmetaltrace.h"
 #import <CoreGraphics/CoreGraphics.h>
 #import <ImageIO/ImageIO.h>
 
@@ -32,6 +33,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <os/lock.h>
 
 GST_DEBUG_CATEGORY_EXTERN (gst_vf_metal_video_filter_debug);
 #define GST_CAT_DEFAULT gst_vf_metal_video_filter_debug
@@ -63,102 +67,254 @@ typedef struct {
     float padding;
 } FilterUniformsGPU;
 
-/* --- .cube LUT parser --- */
+/* Lattice of the baked colour LUT. The finer one is used for chroma key,
+ * whose mask edge is steep, and for loaded LUTs larger than 33^3. */
+#define VF_METAL_BAKED_LUT_SIZE       33
+#define VF_METAL_BAKED_LUT_SIZE_FINE  65
 
-static id<MTLTexture>
-parse_cube_lut (const char *path, id<MTLDevice> device, int *outSize)
-{
-    FILE *fp = fopen (path, "r");
-    if (!fp) {
-        GST_WARNING ("Failed to open .cube file: %s", path);
-        return nil;
-    }
+static NSString *const kFilterFragmentNames[VF_METAL_INPUT_COUNT] = {
+    @"filterFragmentRGBA",
+    @"filterFragmentNV12",
+    @"filterFragmentI420"
+};
 
-    int size = 0;
-    float *data = NULL;
-    int count = 0;
-    char line[512];
-
-    while (fgets (line, sizeof (line), fp)) {
-        /* Skip comments and empty lines */
-        char *p = line;
-        while (*p && isspace (*p)) p++;
-        if (*p == '#' || *p == '\0' || *p == '\n') continue;
-
-        /* Parse LUT_3D_SIZE */
-        if (strncmp (p, "LUT_3D_SIZE", 11) == 0) {
-            sscanf (p + 11, "%d", &size);
-            if (size < 2 || size > 64) {
-                GST_WARNING ("Invalid LUT size %d in %s", size, path);
-                fclose (fp);
-                return nil;
-            }
-            data = (float *) malloc (size * size * size * 4 * sizeof (float));
-            if (!data) {
-                fclose (fp);
-                return nil;
-            }
-            continue;
-        }
+static FilterUniformsGPU
+filter_uniforms_make (const VideoFilterParams *params, int width, int height,
+    int colorMatrix, int hasLUT, int lutSize)
+{
+    FilterUniformsGPU uniforms = {
+        .brightness = (float)params->brightness,
+        .contrast = (float)params->contrast,
+        .saturation = (float)params->saturation,
+        .hue = (float)params->hue,
+        .gamma = (float)params->gamma,
+        .sharpness = (float)params->sharpness,
+        .sepia = (float)params->sepia,
+        .noise = (float)params->noise,
+        .vignette = (float)params->vignette,
+        .invert = params->invert,
+        .chromaKeyEnabled = params->chromaKeyEnabled,
+        .chromaKeyR = (float)params->chromaKeyR,
+        .chromaKeyG = (float)params->chromaKeyG,
+        .chromaKeyB = (float)params->chromaKeyB,
+        .chromaKeyTolerance = (float)params->chromaKeyTolerance,
+        .chromaKeySmoothness = (float)params->chromaKeySmoothness,
+        .width = (uint32_t)width,
+        .height = (uint32_t)height,
+        .colorMatrix = colorMatrix,
+        .frameIndex = params->frameIndex,
+        .hasLUT = hasLUT,
+        .lutSize = lutSize,
+        .padding = 0,
+    };
+    return uniforms;
+}
 
-        /* Skip other keywords */
-        if (strncmp (p, "TITLE", 5) == 0 ||
-            strncmp (p, "DOMAIN_MIN", 10) == 0 ||
-            strncmp (p, "DOMAIN_MAX", 10) == 0 ||
-            strncmp (p, "LUT_1D_SIZE", 11) == 0) {
-            continue;
-        }
+/* Noise and vignette depend on the pixel position; everything else in
+ * applyColorAdjustments only on its colour */
+static BOOL
+filter_params_bakeable (const VideoFilterParams *params)
+{
+    return params->noise <= 0.001f && params->vignette <= 0.001f;
+}
 
-        /* Parse RGB triplet */
-        if (size > 0 && data && count < size * size * size) {
-            float r, g, b;
-            if (sscanf (p, "%f %f %f", &r, &g, &b) == 3) {
-                data[count * 4 + 0] = r;
-                data[count * 4 + 1] = g;
-                data[count * 4 + 2] = b;
-                data[count * 4 + 3] = 1.0f;
-                count++;
-            }
-        }
-    }
+/* VF_METAL_FILTER_* stages that change the output for @params. Identity
+ * values are compared exactly so a specialised variant renders the same
+ * pixels as the generic pipeline; the rest mirror the shader thresholds. */
+static guint32
+filter_params_features (const VideoFilterParams *params, BOOL hasLUT)
+{
+    guint32 features = 0;
+
+    if (params->brightness != 0.0f) features |= VF_METAL_FILTER_BRIGHTNESS;
+    if (params->contrast != 1.0f)   features |= VF_METAL_FILTER_CONTRAST;
+    if (params->saturation != 1.0f) features |= VF_METAL_FILTER_SATURATION;
+    if (fabsf (params->hue) > 0.001f) features |= VF_METAL_FILTER_HUE;
+    if (params->gamma != 1.0f)      features |= VF_METAL_FILTER_GAMMA;
+    if (params->sepia > 0.001f)     features |= VF_METAL_FILTER_SEPIA;
+    if (params->invert)             features |= VF_METAL_FILTER_INVERT;
+    if (params->chromaKeyEnabled)   features |= VF_METAL_FILTER_CHROMA_KEY;
+    if (params->vignette > 0.001f)  features |= VF_METAL_FILTER_VIGNETTE;
+    if (params->noise > 0.001f)     features |= VF_METAL_FILTER_NOISE;
+    if (hasLUT)                     features |= VF_METAL_FILTER_LUT;
+
+    return features;
+}
 
-    fclose (fp);
+/* Whether two parameter sets bake to the same LUT */
+static BOOL
+filter_params_bake_equal (const VideoFilterParams *a,
+    const VideoFilterParams *b)
+{
+    return a->brightness == b->brightness && a->contrast == b->contrast &&
+        a->saturation == b->saturation && a->hue == b->hue &&
+        a->gamma == b->gamma && a->sepia == b->sepia &&
+        a->invert == b->invert && a->chromaKeyEnabled == b->chromaKeyEnabled &&
+        (!a->chromaKeyEnabled ||
+            (a->chromaKeyR == b->chromaKeyR && a->chromaKeyG == b->chromaKeyG &&
+             a->chromaKeyB == b->chromaKeyB &&
+             a->chromaKeyTolerance == b->chromaKeyTolerance &&
+             a->chromaKeySmoothness == b->chromaKeySmoothness));
+}
 
-    if (size == 0 || count != size * size * size) {
-        GST_WARNING ("Incomplete .cube LUT: expected %d entries, got %d",
-                     size * size * size, count);
-        free (data);
-        return nil;
-    }
+/* --- 3D LUT textures --- */
 
-    /* Create 3D texture */
+/* RGBA16Float: half the memory of RGBA32Float and exact for 8-bit sources;
+ * 10-bit packed formats would band on smooth grades */
+static id<MTLTexture>
+lut_texture_new (id<MTLDevice> device, int size, const __fp16 *rgba)
+{
     MTLTextureDescriptor *desc = [[MTLTextureDescriptor alloc] init];
     desc.textureType = MTLTextureType3D;
-    desc.pixelFormat = MTLPixelFormatRGBA32Float;
+    desc.pixelFormat = MTLPixelFormatRGBA16Float;
     desc.width = size;
     desc.height = size;
     desc.depth = size;
     desc.usage = MTLTextureUsageShaderRead;
-    desc.storageMode = MTLStorageModeShared;
+    desc.storageMode = vf_metal_host_storage_mode (device);
 
     id<MTLTexture> texture = [device newTextureWithDescriptor:desc];
-    if (!texture) {
-        free (data);
+    if (!texture)
         return nil;
-    }
 
     [texture replaceRegion:MTLRegionMake3D (0, 0, 0, size, size, size)
                mipmapLevel:0
                      slice:0
-                 withBytes:data
-               bytesPerRow:size * 4 * sizeof (float)
-             bytesPerImage:size * size * 4 * sizeof (float)];
+                 withBytes:rgba
+               bytesPerRow:size * 4 * sizeof (__fp16)
+             bytesPerImage:size * size * 4 * sizeof (__fp16)];
+    return texture;
+}
 
-    free (data);
-    *outSize = size;
+/* --- .cube LUT parser --- */
 
-    GST_DEBUG ("Loaded .cube LUT: %dx%dx%d from %s", size, size, size, path);
-    return texture;
+/* Locale-independent decimal parser bounded by @end (the file is mapped,
+ * not NUL-terminated). Returns NO if no digits were found. */
+static BOOL
+cube_parse_float (const char **pos, const char *end, float *out)
+{
+    const char *p = *pos;
+    double value = 0.0, scale = 1.0;
+    BOOL negative = NO, digits = NO;
+
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10.0 + (*p++ - '0');
+        digits = YES;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            scale *= 0.1;
+            value += (*p++ - '0') * scale;
+            digits = YES;
+        }
+    }
+    if (!digits)
+        return NO;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int exponent = 0;
+        BOOL negExp = NO;
+
+        p++;
+        if (p < end && (*p == '-' || *p == '+'))
+            negExp = (*p++ == '-');
+        while (p < end && *p >= '0' && *p <= '9')
+            exponent = MIN (exponent * 10 + (*p++ - '0'), 64);
+        while (exponent-- > 0)
+            value = negExp ? value * 0.1 : value * 10.0;
+    }
+
+    *out = (float) (negative ? -value : value);
+    *pos = p;
+    return YES;
+}
+
+static BOOL
+cube_keyword (const char *p, const char *eol, const char *keyword)
+{
+    size_t len = strlen (keyword);
+    return (size_t) (eol - p) >= len && memcmp (p, keyword, len) == 0;
+}
+
+static id<MTLTexture>
+parse_cube_lut (const char *path, id<MTLDevice> device, int *outSize)
+{
+    @autoreleasepool {
+        NSData *file = [NSData
+            dataWithContentsOfFile:[NSString stringWithUTF8String:path]
+                           options:NSDataReadingMappedIfSafe
+                             error:nil];
+        if (!file) {
+            GST_WARNING ("Failed to open .cube file: %s", path);
+            return nil;
+        }
+
+        const char *p = file.bytes;
+        const char *end = p + file.length;
+        int size = 0;
+        int count = 0;
+        __fp16 *data = NULL;
+
+        while (p < end) {
+            const char *eol = memchr (p, '\n', end - p);
+            if (!eol)
+                eol = end;
+
+            while (p < eol && isspace ((unsigned char) *p))
+                p++;
+
+            if (p == eol || *p == '#') {
+                /* Comment or empty line */
+            } else if (cube_keyword (p, eol, "LUT_3D_SIZE")) {
+                size = (int) strtol (p + 11, NULL, 10);
+                if (size < 2 || size > 64 || data) {
+                    GST_WARNING ("Invalid LUT size %d in %s", size, path);
+                    g_free (data);
+                    return nil;
+                }
+                data = g_new (__fp16, size * size * size * 4);
+            } else if (data && count < size * size * size) {
+                /* RGB triplet. TITLE, DOMAIN_MIN/MAX, LUT_1D_SIZE and other
+                 * keywords fail to parse and are skipped. */
+                float rgb[3];
+                const char *q = p;
+
+                if (cube_parse_float (&q, eol, &rgb[0]) &&
+                    cube_parse_float (&q, eol, &rgb[1]) &&
+                    cube_parse_float (&q, eol, &rgb[2])) {
+                    data[count * 4 + 0] = (__fp16) rgb[0];
+                    data[count * 4 + 1] = (__fp16) rgb[1];
+                    data[count * 4 + 2] = (__fp16) rgb[2];
+                    data[count * 4 + 3] = (__fp16) 1.0f;
+                    count++;
+                }
+            }
+
+            p = eol + 1;
+        }
+
+        if (size == 0 || count != size * size * size) {
+            GST_WARNING ("Incomplete .cube LUT: expected %d entries, got %d",
+                         size * size * size, count);
+            g_free (data);
+            return nil;
+        }
+
+        id<MTLTexture> texture = lut_texture_new (device, size, data);
+        g_free (data);
+        if (!texture)
+            return nil;
+
+        *outSize = size;
+        GST_DEBUG ("Loaded .cube LUT: %dx%dx%d from %s", size, size, size, path);
+        return texture;
+    }
 }
 
 /* --- PNG LUT loader --- */
@@ -238,18 +394,14 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
         CGContextRelease (ctx);
         CGImageRelease (cgImage);
 
-        /* Convert to float RGBA and rearrange into 3D */
-        float *lutData = (float *) malloc (
-            lutSize * lutSize * lutSize * 4 * sizeof (float));
-        if (!lutData) {
-            free (pixels);
-            return nil;
-        }
+        /* Convert to half-float RGBA and rearrange into 3D */
+        __fp16 *lutData = g_new (__fp16, lutSize * lutSize * lutSize * 4);
 
         int slicesPerRow = imgWidth / lutSize;
         if (slicesPerRow == 0) {
             GST_WARNING ("LUT PNG too narrow (%d < %d)", imgWidth, lutSize);
             free (pixels);
+            g_free (lutData);
             return nil;
         }
 
@@ -262,40 +414,21 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
                     int srcY = sliceY + g;
                     int srcIdx = (srcY * imgWidth + srcX) * 4;
                     int dstIdx = (b * lutSize * lutSize + g * lutSize + r) * 4;
-                    lutData[dstIdx + 0] = pixels[srcIdx + 0] / 255.0f;
-                    lutData[dstIdx + 1] = pixels[srcIdx + 1] / 255.0f;
-                    lutData[dstIdx + 2] = pixels[srcIdx + 2] / 255.0f;
-                    lutData[dstIdx + 3] = 1.0f;
+                    lutData[dstIdx + 0] = (__fp16) (pixels[srcIdx + 0] / 255.0f);
+                    lutData[dstIdx + 1] = (__fp16) (pixels[srcIdx + 1] / 255.0f);
+                    lutData[dstIdx + 2] = (__fp16) (pixels[srcIdx + 2] / 255.0f);
+                    lutData[dstIdx + 3] = (__fp16) 1.0f;
                 }
             }
         }
 
         free (pixels);
 
-        /* Create 3D texture */
-        MTLTextureDescriptor *desc = [[MTLTextureDescriptor alloc] init];
-        desc.textureType = MTLTextureType3D;
-        desc.pixelFormat = MTLPixelFormatRGBA32Float;
-        desc.width = lutSize;
-        desc.height = lutSize;
-        desc.depth = lutSize;
-        desc.usage = MTLTextureUsageShaderRead;
-        desc.storageMode = MTLStorageModeShared;
-
-        id<MTLTexture> texture = [device newTextureWithDescriptor:desc];
-        if (!texture) {
-            free (lutData);
+        id<MTLTexture> texture = lut_texture_new (device, lutSize, lutData);
+        g_free (lutData);
+        if (!texture)
             return nil;
-        }
 
-        [texture replaceRegion:MTLRegionMake3D (0, 0, 0, lutSize, lutSize, lutSize)
-                   mipmapLevel:0
-                         slice:0
-                     withBytes:lutData
-                   bytesPerRow:lutSize * 4 * sizeof (float)
-                 bytesPerImage:lutSize * lutSize * 4 * sizeof (float)];
-
-        free (lutData);
         *outSize = lutSize;
 
         GST_DEBUG ("Loaded PNG LUT: %dx%dx%d from %s",
@@ -304,32 +437,252 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
     }
 }
 
+static id<MTLTexture>
+lut_decode_file (const char *path, id<MTLDevice> device, int *outSize)
+{
+    /* Determine format by extension */
+    const char *dot = strrchr (path, '.');
+    if (dot && strcasecmp (dot, ".cube") == 0)
+        return parse_cube_lut (path, device, outSize);
+    if (dot && strcasecmp (dot, ".png") == 0)
+        return parse_png_lut (path, device, outSize);
+
+    GST_WARNING ("Unknown LUT file format: %s", path);
+    return nil;
+}
+
+/* --- Process-wide LUT cache --- */
+
+/* Decoded LUTs kept for switching back and forth between looks */
+#define VF_METAL_LUT_CACHE_ENTRIES  8
+
+@interface VfMetalLUTCacheEntry : NSObject
+@property (nonatomic, strong) id<MTLTexture> texture;
+@property (nonatomic, assign) int size;
+@end
+
+@implementation VfMetalLUTCacheEntry
+@end
+
+id<MTLTexture>
+vf_metal_load_lut_file (const char *path, id<MTLDevice> device, int *outSize)
+{
+    static NSMutableDictionary<NSString *, VfMetalLUTCacheEntry *> *cache;
+    static NSMutableArray<NSString *> *order;     /* least recently used first */
+    static dispatch_once_t once;
+    struct stat st;
+
+    dispatch_once (&once, ^{
+        cache = [NSMutableDictionary dictionary];
+        order = [NSMutableArray array];
+    });
+
+    /* Keyed by modification time and size too, so an edited file is
+     * decoded again */
+    if (stat (path, &st) != 0) {
+        GST_WARNING ("Cannot stat LUT file: %s", path);
+        return nil;
+    }
+    NSString *key = [NSString stringWithFormat:@"%s|%p|%ld.%09ld|%lld", path,
+        (__bridge void *) device, (long) st.st_mtimespec.tv_sec,
+        (long) st.st_mtimespec.tv_nsec, (long long) st.st_size];
+
+    @synchronized (cache) {
+        VfMetalLUTCacheEntry *entry = cache[key];
+        if (entry) {
+            [order removeObject:key];
+            [order addObject:key];
+            *outSize = entry.size;
+            GST_DEBUG ("LUT cache hit: %s", path);
+            return entry.texture;
+        }
+    }
+
+    /* Decode outside the lock; two threads racing on the same file both
+     * decode it and the second insert wins */
+    int size = 0;
+    id<MTLTexture> texture = lut_decode_file (path, device, &size);
+    if (!texture)
+        return nil;
+
+    @synchronized (cache) {
+        VfMetalLUTCacheEntry *entry = [[VfMetalLUTCacheEntry alloc] init];
+        entry.texture = texture;
+        entry.size = size;
+        if (!cache[key])
+            [order addObject:key];
+        cache[key] = entry;
+        while (order.count > VF_METAL_LUT_CACHE_ENTRIES) {
+            [cache removeObjectForKey:order[0]];
+            [order removeObjectAtIndex:0];
+        }
+    }
+
+    *outSize = size;
+    return texture;
+}
+
+/* --- VfMetalLUTSlot --- */
+
+static dispatch_queue_t
+lut_load_queue (void)
+{
+    static dispatch_queue_t queue;
+    static dispatch_once_t once;
+
+    dispatch_once (&once, ^{
+        queue = dispatch_queue_create ("com.visioforge.vfmetal.lut",
+            dispatch_queue_attr_make_with_qos_class (DISPATCH_QUEUE_SERIAL,
+                QOS_CLASS_USER_INITIATED, 0));
+    });
+    return queue;
+}
+
+@implementation VfMetalLUTSlot {
+    VfMetalDevice *_metalDevice;
+    os_unfair_lock _lock;
+    /* Protected by _lock */
+    guint64 _requested;             /* id of the newest request */
+    guint64 _published;             /* id of the newest finished one */
+    BOOL _hasPending;
+    id<MTLTexture> _pendingTexture;
+    int _pendingSize;
+
+    dispatch_group_t _loads;
+    BOOL _acquired;                 /* a frame has been rendered */
+}
+
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice
+{
+    self = [super init];
+    if (!self) return nil;
+
+    _metalDevice = metalDevice;
+    _lock = OS_UNFAIR_LOCK_INIT;
+    _loads = dispatch_group_create ();
+    return self;
+}
+
+- (guint64)_nextRequest
+{
+    os_unfair_lock_lock (&_lock);
+    guint64 request = ++_requested;
+    os_unfair_lock_unlock (&_lock);
+    return request;
+}
+
+- (BOOL)_load:(const char *)path request:(guint64)request
+{
+    id<MTLTexture> texture = nil;
+    int size = 0;
+
+    if (path && *path) {
+        os_unfair_lock_lock (&_lock);
+        BOOL superseded = request < _requested;
+        os_unfair_lock_unlock (&_lock);
+        if (superseded)
+            return YES;
+
+        /* On failure the current LUT stays */
+        texture = vf_metal_load_lut_file (path,
+            _metalDevice.device, &size);
+        if (!texture)
+            return NO;
+    }
+
+    os_unfair_lock_lock (&_lock);
+    if (request > _published) {
+        _published = request;
+        _pendingTexture = texture;
+        _pendingSize = size;
+        _hasPending = YES;
+    }
+    os_unfair_lock_unlock (&_lock);
+    return YES;
+}
+
+- (void)requestFile:(const char *)path
+         completion:(void (^)(BOOL loaded))completion
+{
+    guint64 request = [self _nextRequest];
+    gchar *copy = g_strdup (path);
+
+    dispatch_group_async (_loads, lut_load_queue (), ^{
+        BOOL loaded = [self _load:copy request:request];
+        g_free (copy);
+        if (completion)
+            completion (loaded);
+    });
+}
+
+- (BOOL)loadFile:(const char *)path
+{
+    return [self _load:path request:[self _nextRequest]];
+}
+
+- (void)acquire
+{
+    if (!_acquired) {
+        dispatch_group_wait (_loads, DISPATCH_TIME_FOREVER);
+        _acquired = YES;
+    }
+
+    os_unfair_lock_lock (&_lock);
+    if (_hasPending) {
+        _texture = _pendingTexture;
+        _size = _pendingSize;
+        _pendingTexture = nil;
+        _hasPending = NO;
+    }
+    os_unfair_lock_unlock (&_lock);
+}
+
+- (void)rewind
+{
+    _acquired = NO;
+}
+
+@end
+
 /* --- MetalVideoFilterRenderer implementation --- */
 
 @implementation MetalVideoFilterRenderer {
     id<MTLCommandQueue> _commandQueue;
     id<MTLLibrary> _library;
 
-    /* Render pipeline states per input format */
+    /* Render pipeline states per input format: full per-pixel evaluation,
+     * and a single lookup into the baked LUT */
     id<MTLRenderPipelineState> _pipelines[VF_METAL_INPUT_COUNT];
+    id<MTLRenderPipelineState> _bakedPipelines[VF_METAL_INPUT_COUNT];
+
+    /* _pipelines specialised per input format, render pixel format and
+     * feature mask; NSNull while building or after a failed build */
+    NSMutableDictionary<NSString *, id> *_variants;
+    os_unfair_lock _variantLock;
 
     /* Shared YUV output helper */
     VfMetalYUVOutput *_yuvOutput;
 
-    /* Compute pipelines for blur/sharpen */
-    id<MTLComputePipelineState> _computeBlurH;
-    id<MTLComputePipelineState> _computeBlurV;
-    id<MTLComputePipelineState> _computeUnsharp;
+    /* Compute pipelines: tiled blur/sharpen, LUT bake */
+    id<MTLComputePipelineState> _computeSharpen;
+    id<MTLComputePipelineState> _computeBake;
 
     /* Intermediate textures */
     id<MTLTexture> _renderTarget;       /* RGBA render target for color adjustments */
-    id<MTLTexture> _blurTemp;           /* Temporary for horizontal blur pass */
-    id<MTLTexture> _blurResult;         /* Result of vertical blur pass */
+    id<MTLTexture> _blurTemp;           /* Sharpened / blurred frame */
 
-    /* 3D LUT texture */
+    /* 3D LUT, and its texture as of the frame being encoded */
+    VfMetalLUTSlot *_lut;
     id<MTLTexture> _lutTexture;
     int _lutSize;
 
+    /* Colour adjustments, _lutTexture and chroma key baked together;
+     * re-baked on the first frame whose parameters differ */
+    id<MTLTexture> _bakedLUT;
+    int _bakedSize;
+    VideoFilterParams _bakedParams;
+    id<MTLTexture> _bakedSource;        /* _lutTexture it was baked with */
+
     /* Current configuration */
     int _width;
     int _height;
@@ -341,29 +694,39 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
     VfMetalTextureCache *_textureCache;
 }
 
+- (void)setTraceOwner:(GstObject *)traceOwner
+{
+    _traceOwner = traceOwner;
+    _textureCache.traceOwner = traceOwner;
+    _yuvOutput.traceOwner = traceOwner;
+}
+
 - (instancetype)init
+{
+    return [self initWithDevice:[VfMetalDevice sharedDevice]];
+}
+
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice
 {
     self = [super init];
     if (!self) return nil;
 
-    VfMetalDevice *metalDevice = [VfMetalDevice sharedDevice];
     if (!metalDevice) {
         GST_ERROR ("MetalVideoFilterRenderer: No Metal device available");
         return nil;
     }
+    _metalDevice = metalDevice;
 
-    _commandQueue = [metalDevice.device newCommandQueue];
-    if (!_commandQueue) {
-        GST_ERROR ("MetalVideoFilterRenderer: Failed to create command queue");
-        return nil;
-    }
+    _commandQueue = metalDevice.commandQueue;
 
     /* Compile shaders: common + filter-specific */
     NSString *fullSource = [kVfMetalCommonShaderSource
         stringByAppendingString:kVideoFilterShaderSource];
 
     NSError *error = nil;
-    _library = [metalDevice compileShaderSource:fullSource error:&error];
+    _library = [metalDevice libraryNamed:@"videofilter"
+                                  source:fullSource
+                                   error:&error];
     if (!_library) {
         GST_ERROR ("MetalVideoFilterRenderer: Failed to compile shaders: %s",
               error.localizedDescription.UTF8String);
@@ -374,32 +737,28 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
         initWithDevice:metalDevice.device];
 
     /* Create blur/sharpen compute pipelines */
-    id<MTLDevice> device = metalDevice.device;
-
-    id<MTLFunction> blurHFunc = [_library newFunctionWithName:@"blurHorizontal"];
-    id<MTLFunction> blurVFunc = [_library newFunctionWithName:@"blurVertical"];
-    id<MTLFunction> unsharpFunc = [_library newFunctionWithName:@"unsharpMask"];
-
-    if (blurHFunc) {
-        _computeBlurH = [device newComputePipelineStateWithFunction:blurHFunc
-                                                              error:&error];
-    }
-    if (blurVFunc) {
-        _computeBlurV = [device newComputePipelineStateWithFunction:blurVFunc
-                                                              error:&error];
-    }
-    if (unsharpFunc) {
-        _computeUnsharp = [device newComputePipelineStateWithFunction:unsharpFunc
-                                                                error:&error];
-    }
-
-    if (!_computeBlurH || !_computeBlurV || !_computeUnsharp) {
+    MTLFunctionConstantValues *sharpenConstants =
+        [[MTLFunctionConstantValues alloc] init];
+    int sharpenRadius = VF_METAL_SHARPEN_RADIUS;
+    [sharpenConstants setConstantValue:&sharpenRadius type:MTLDataTypeInt
+                               atIndex:0];
+    _computeSharpen = [metalDevice computePipelineWithFunctionName:@"sharpenTiled"
+        library:_library constants:sharpenConstants
+        variant:[NSString stringWithFormat:@"r%d", sharpenRadius] error:&error];
+    _computeBake = [metalDevice computePipelineWithFunctionName:@"bakeColorLUT"
+                                                        library:_library
+                                                          error:&error];
+
+    if (!_computeSharpen || !_computeBake) {
         GST_ERROR ("MetalVideoFilterRenderer: Failed to create blur pipelines: %s",
               error.localizedDescription.UTF8String);
         return nil;
     }
 
     _yuvOutput = [[VfMetalYUVOutput alloc] init];
+    _variants = [NSMutableDictionary dictionary];
+    _variantLock = OS_UNFAIR_LOCK_INIT;
+    _lut = [[VfMetalLUTSlot alloc] initWithDevice:_metalDevice];
     _lutSize = 0;
 
     return self;
@@ -419,7 +778,8 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
         return YES;
     }
 
-    id<MTLDevice> device = [VfMetalDevice sharedDevice].device;
+    VfMetalDevice *metalDevice = _metalDevice;
+    id<MTLDevice> device = metalDevice.device;
 
     _width = width;
     _height = height;
@@ -445,28 +805,41 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
     }
 
     /* Create render pipeline states for each input format */
-    NSString *fragNames[VF_METAL_INPUT_COUNT] = {
-        @"filterFragmentRGBA",
-        @"filterFragmentNV12",
-        @"filterFragmentI420"
+    NSString *bakedFragNames[VF_METAL_INPUT_COUNT] = {
+        @"filterFragmentBakedRGBA",
+        @"filterFragmentBakedNV12",
+        @"filterFragmentBakedI420"
     };
 
     for (int fmt = 0; fmt < VF_METAL_INPUT_COUNT; fmt++) {
         MTLRenderPipelineDescriptor *desc =
             [[MTLRenderPipelineDescriptor alloc] init];
         desc.vertexFunction = [_library newFunctionWithName:@"filterVertex"];
-        desc.fragmentFunction = [_library newFunctionWithName:fragNames[fmt]];
+        desc.fragmentFunction =
+            [_library newFunctionWithName:kFilterFragmentNames[fmt]];
         desc.colorAttachments[0].pixelFormat = _renderPixelFormat;
         desc.colorAttachments[0].blendingEnabled = NO;
 
         NSError *error = nil;
         _pipelines[fmt] =
-            [device newRenderPipelineStateWithDescriptor:desc error:&error];
+            [metalDevice renderPipelineWithDescriptor:desc library:_library
+                                                error:&error];
         if (!_pipelines[fmt]) {
             GST_ERROR ("Failed to create filter pipeline for format %d: %s",
                        fmt, error.localizedDescription.UTF8String);
             return NO;
         }
+
+        desc.fragmentFunction =
+            [_library newFunctionWithName:bakedFragNames[fmt]];
+        _bakedPipelines[fmt] =
+            [metalDevice renderPipelineWithDescriptor:desc library:_library
+                                                error:&error];
+        if (!_bakedPipelines[fmt]) {
+            GST_ERROR ("Failed to create baked filter pipeline for format %d: %s",
+                       fmt, error.localizedDescription.UTF8String);
+            return NO;
+        }
     }
 
     /* Create render target texture */
@@ -477,37 +850,165 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
                                  mipmapped:NO];
     rtDesc.usage = MTLTextureUsageRenderTarget | MTLTextureUsageShaderRead |
                    MTLTextureUsageShaderWrite;
-    rtDesc.storageMode = MTLStorageModeShared;
+    rtDesc.storageMode = _metalDevice.hostStorageMode;
 
     _renderTarget = [device newTextureWithDescriptor:rtDesc];
     if (!_renderTarget) return NO;
 
-    /* Create blur intermediate textures */
+    /* Create blur/sharpen output texture */
     MTLTextureDescriptor *blurDesc = [MTLTextureDescriptor
         texture2DDescriptorWithPixelFormat:_renderPixelFormat
                                      width:width
                                     height:height
                                  mipmapped:NO];
     blurDesc.usage = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite;
-    blurDesc.storageMode = MTLStorageModeShared;
+    blurDesc.storageMode = _metalDevice.hostStorageMode;
 
     _blurTemp = [device newTextureWithDescriptor:blurDesc];
-    _blurResult = [device newTextureWithDescriptor:blurDesc];
-    if (!_blurTemp || !_blurResult) return NO;
+    if (!_blurTemp) return NO;
 
-    if (![_yuvOutput configureWithDevice:device library:_library
+    if (![_yuvOutput configureWithDevice:_metalDevice library:_library
                                    width:width height:height format:outFmt])
         return NO;
 
     return YES;
 }
 
+/* The variant of _pipelines[@fmt] compiled for @features only. The first
+ * request builds it in the background and the generic pipeline renders
+ * meanwhile, so a property change switches variants at a later frame
+ * boundary instead of stalling on the compile. */
+- (id<MTLRenderPipelineState>)_pipelineForFormat:(VfMetalInputFormat)fmt
+                                        features:(guint32)features
+{
+    NSString *key = [NSString stringWithFormat:@"%d|%lu|%x", (int) fmt,
+        (unsigned long) _renderPixelFormat, features];
+
+    os_unfair_lock_lock (&_variantLock);
+    id variant = _variants[key];
+    if (!variant)
+        _variants[key] = [NSNull null];
+    os_unfair_lock_unlock (&_variantLock);
+
+    if (variant)
+        return variant == [NSNull null] ? _pipelines[fmt] : variant;
+
+    MTLRenderPipelineDescriptor *desc =
+        [[MTLRenderPipelineDescriptor alloc] init];
+    desc.vertexFunction = [_library newFunctionWithName:@"filterVertex"];
+    desc.fragmentFunction =
+        [_library newFunctionWithName:kFilterFragmentNames[fmt]];
+    desc.colorAttachments[0].pixelFormat = _renderPixelFormat;
+    desc.colorAttachments[0].blendingEnabled = NO;
+
+    MTLFunctionConstantValues *constants =
+        [[MTLFunctionConstantValues alloc] init];
+    [constants setConstantValue:&features type:MTLDataTypeUInt atIndex:1];
+
+    id<MTLLibrary> library = _library;
+    dispatch_async (dispatch_get_global_queue (QOS_CLASS_UTILITY, 0), ^{
+        NSError *error = nil;
+        id<MTLRenderPipelineState> state = [_metalDevice
+            renderPipelineWithDescriptor:desc library:library
+                       fragmentConstants:constants
+                                 variant:[NSString stringWithFormat:@"features=%x", features]
+                                   error:&error];
+        if (!state)
+            GST_WARNING ("Filter variant %s unavailable, keeping the generic "
+                         "pipeline: %s", key.UTF8String,
+                         error.localizedDescription.UTF8String);
+
+        os_unfair_lock_lock (&self->_variantLock);
+        self->_variants[key] = state ? (id) state : [NSNull null];
+        os_unfair_lock_unlock (&self->_variantLock);
+    });
+
+    return _pipelines[fmt];
+}
+
+/* Encode the bake into @commandBuffer unless _bakedLUT already matches
+ * @params. Later command buffers on the queue see the new contents, and
+ * Metal orders the write after in-flight frames still sampling it. */
+- (BOOL)_bakeLUTIfNeeded:(id<MTLCommandBuffer>)commandBuffer
+                  params:(const VideoFilterParams *)params
+{
+    int size = (params->chromaKeyEnabled || _lutSize > VF_METAL_BAKED_LUT_SIZE)
+        ? VF_METAL_BAKED_LUT_SIZE_FINE : VF_METAL_BAKED_LUT_SIZE;
+
+    if (_bakedLUT && _bakedSize == size && _bakedSource == _lutTexture &&
+        filter_params_bake_equal (&_bakedParams, params))
+        return YES;
+
+    if (!_bakedLUT || _bakedSize != size) {
+        MTLTextureDescriptor *desc = [[MTLTextureDescriptor alloc] init];
+        desc.textureType = MTLTextureType3D;
+        desc.pixelFormat = MTLPixelFormatRGBA16Float;
+        desc.width = size;
+        desc.height = size;
+        desc.depth = size;
+        desc.usage = MTLTextureUsageShaderRead | MTLTextureUsageShaderWrite;
+        desc.storageMode = MTLStorageModePrivate;
+
+        _bakedLUT = [_metalDevice.device
+            newTextureWithDescriptor:desc];
+        if (!_bakedLUT) {
+            _bakedSize = 0;
+            return NO;
+        }
+        _bakedSize = size;
+    }
+
+    FilterUniformsGPU uniforms = filter_uniforms_make (params, _width, _height,
+        0, _lutTexture != nil, _lutSize);
+
+    id<MTLComputeCommandEncoder> compute = [commandBuffer computeCommandEncoder];
+    [compute setComputePipelineState:_computeBake];
+    [compute setBytes:&uniforms length:sizeof(uniforms) atIndex:0];
+    [compute setTexture:_lutTexture atIndex:0];
+    [compute setTexture:_bakedLUT atIndex:1];
+    [compute dispatchThreadgroups:MTLSizeMake((size + 3) / 4, (size + 3) / 4,
+                                              (size + 3) / 4)
+            threadsPerThreadgroup:MTLSizeMake(4, 4, 4)];
+    [compute endEncoding];
+
+    _bakedParams = *params;
+    _bakedSource = _lutTexture;
+
+    GST_DEBUG ("Baked %d^3 colour LUT", size);
+    return YES;
+}
+
 - (BOOL)processFrame:(GstVideoFrame *)inFrame
               output:(GstVideoFrame *)outFrame
               params:(const VideoFilterParams *)params
+{
+    return [self _renderFrame:inFrame output:outFrame params:params
+                         slot:0 completion:nil];
+}
+
+- (BOOL)submitFrame:(GstVideoFrame *)inFrame
+             output:(GstVideoFrame *)outFrame
+             params:(const VideoFilterParams *)params
+               slot:(NSUInteger)slot
+         completion:(VfMetalCompletionHandler)completion
+{
+    return [self _renderFrame:inFrame output:outFrame params:params
+                         slot:slot completion:completion];
+}
+
+- (BOOL)_renderFrame:(GstVideoFrame *)inFrame
+              output:(GstVideoFrame *)outFrame
+              params:(const VideoFilterParams *)params
+                slot:(NSUInteger)slot
+          completion:(VfMetalCompletionHandler)completion
 {
     @autoreleasepool {
-        [_textureCache resetFrameIndex];
+        [_textureCache resetFrameIndexForSlot:slot];
+
+        /* A LUT switched meanwhile takes effect here, between frames */
+        [_lut acquire];
+        _lutTexture = _lut.texture;
+        _lutSize = _lut.size;
 
         id<MTLCommandBuffer> commandBuffer = [_commandQueue commandBuffer];
         if (!commandBuffer) {
@@ -515,11 +1016,20 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
             return NO;
         }
 
+        VfMetalTraceSpan encodeSpan;
+        vf_metal_trace_begin (&encodeSpan, _traceOwner, VF_METAL_STATS_ENCODE);
+
         GstVideoFormat inFmt = GST_VIDEO_FRAME_FORMAT (inFrame);
         VfMetalInputFormat fmtIdx = vf_metal_input_format_index (inFmt);
         int frameW = GST_VIDEO_FRAME_WIDTH (inFrame);
         int frameH = GST_VIDEO_FRAME_HEIGHT (inFrame);
 
+        /* === Pass 0: Bake static colour parameters into one LUT === */
+
+        BOOL baked = filter_params_bakeable (params) &&
+            [self _bakeLUTIfNeeded:commandBuffer params:params];
+        id<MTLTexture> lutTexture = baked ? _bakedLUT : _lutTexture;
+
         /* === Pass 1: Color adjustment render pass === */
 
         MTLRenderPassDescriptor *rpDesc =
@@ -536,7 +1046,10 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
             0, 0, (double)_width, (double)_height, 0.0, 1.0
         };
         [encoder setViewport:viewport];
-        [encoder setRenderPipelineState:_pipelines[fmtIdx]];
+        id<MTLRenderPipelineState> pipeline = baked ? _bakedPipelines[fmtIdx] :
+            [self _pipelineForFormat:fmtIdx
+                features:filter_params_features (params, _lutTexture != nil)];
+        [encoder setRenderPipelineState:pipeline];
 
         /* Upload input textures */
         if (fmtIdx == VF_METAL_INPUT_NV12) {
@@ -551,8 +1064,8 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
             if (!yTex || !uvTex) { [encoder endEncoding]; return NO; }
             [encoder setFragmentTexture:yTex atIndex:0];
             [encoder setFragmentTexture:uvTex atIndex:1];
-            if (_lutTexture) {
-                [encoder setFragmentTexture:_lutTexture atIndex:2];
+            if (lutTexture) {
+                [encoder setFragmentTexture:lutTexture atIndex:2];
             }
         } else if (fmtIdx == VF_METAL_INPUT_I420) {
             id<MTLTexture> yTex =
@@ -571,8 +1084,8 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
             [encoder setFragmentTexture:yTex atIndex:0];
             [encoder setFragmentTexture:uTex atIndex:1];
             [encoder setFragmentTexture:vTex atIndex:2];
-            if (_lutTexture) {
-                [encoder setFragmentTexture:_lutTexture atIndex:3];
+            if (lutTexture) {
+                [encoder setFragmentTexture:lutTexture atIndex:3];
             }
         } else {
             MTLPixelFormat pixFmt = (inFmt == GST_VIDEO_FORMAT_BGRA)
@@ -582,37 +1095,15 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
                           format:pixFmt width:frameW height:frameH];
             if (!tex) { [encoder endEncoding]; return NO; }
             [encoder setFragmentTexture:tex atIndex:0];
-            if (_lutTexture) {
-                [encoder setFragmentTexture:_lutTexture atIndex:1];
+            if (lutTexture) {
+                [encoder setFragmentTexture:lutTexture atIndex:1];
             }
         }
 
         /* Set filter uniforms */
-        FilterUniformsGPU uniforms = {
-            .brightness = (float)params->brightness,
-            .contrast = (float)params->contrast,
-            .saturation = (float)params->saturation,
-            .hue = (float)params->hue,
-            .gamma = (float)params->gamma,
-            .sharpness = (float)params->sharpness,
-            .sepia = (float)params->sepia,
-            .noise = (float)params->noise,
-            .vignette = (float)params->vignette,
-            .invert = params->invert,
-            .chromaKeyEnabled = params->chromaKeyEnabled,
-            .chromaKeyR = (float)params->chromaKeyR,
-            .chromaKeyG = (float)params->chromaKeyG,
-            .chromaKeyB = (float)params->chromaKeyB,
-            .chromaKeyTolerance = (float)params->chromaKeyTolerance,
-            .chromaKeySmoothness = (float)params->chromaKeySmoothness,
-            .width = (uint32_t)_width,
-            .height = (uint32_t)_height,
-            .colorMatrix = vf_metal_color_matrix_for_frame (inFrame),
-            .frameIndex = params->frameIndex,
-            .hasLUT = (_lutTexture != nil) ? 1 : 0,
-            .lutSize = _lutSize,
-            .padding = 0,
-        };
+        FilterUniformsGPU uniforms = filter_uniforms_make (params,
+            _width, _height, vf_metal_color_matrix_for_frame (inFrame),
+            _lutTexture != nil, _lutSize);
 
         [encoder setFragmentBytes:&uniforms
                            length:sizeof(uniforms)
@@ -631,44 +1122,24 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
         id<MTLTexture> finalTexture = _renderTarget;
 
         if (needsSharpness) {
-            MTLSize threadGroupSize = MTLSizeMake(16, 16, 1);
+            /* One dispatch: each threadgroup blurs its tile in
+             * threadgroup memory and writes the unsharp / blur mix */
+            MTLSize threadGroupSize = MTLSizeMake(VF_METAL_SHARPEN_TILE,
+                                                  VF_METAL_SHARPEN_TILE, 1);
             MTLSize gridSize = MTLSizeMake(
-                (_width + 15) / 16, (_height + 15) / 16, 1);
+                (_width + VF_METAL_SHARPEN_TILE - 1) / VF_METAL_SHARPEN_TILE,
+                (_height + VF_METAL_SHARPEN_TILE - 1) / VF_METAL_SHARPEN_TILE, 1);
 
-            /* Horizontal blur: renderTarget -> blurTemp */
-            id<MTLComputeCommandEncoder> computeH =
-                [commandBuffer computeCommandEncoder];
-            [computeH setComputePipelineState:_computeBlurH];
-            [computeH setTexture:_renderTarget atIndex:0];
-            [computeH setTexture:_blurTemp atIndex:1];
-            [computeH dispatchThreadgroups:gridSize
-                     threadsPerThreadgroup:threadGroupSize];
-            [computeH endEncoding];
-
-            /* Vertical blur: blurTemp -> blurResult */
-            id<MTLComputeCommandEncoder> computeV =
-                [commandBuffer computeCommandEncoder];
-            [computeV setComputePipelineState:_computeBlurV];
-            [computeV setTexture:_blurTemp atIndex:0];
-            [computeV setTexture:_blurResult atIndex:1];
-            [computeV dispatchThreadgroups:gridSize
-                     threadsPerThreadgroup:threadGroupSize];
-            [computeV endEncoding];
-
-            /* Unsharp mask or blur mix: renderTarget + blurResult -> renderTarget
-             * We write back to a temp that becomes our final texture.
-             * Actually we can reuse blurTemp as output since we're done with it. */
-            id<MTLComputeCommandEncoder> computeU =
+            id<MTLComputeCommandEncoder> compute =
                 [commandBuffer computeCommandEncoder];
-            [computeU setComputePipelineState:_computeUnsharp];
-            [computeU setTexture:_renderTarget atIndex:0];
-            [computeU setTexture:_blurResult atIndex:1];
-            [computeU setTexture:_blurTemp atIndex:2];
+            [compute setComputePipelineState:_computeSharpen];
+            [compute setTexture:_renderTarget atIndex:0];
+            [compute setTexture:_blurTemp atIndex:1];
             float amount = (float)params->sharpness;
-            [computeU setBytes:&amount length:sizeof(float) atIndex:0];
-            [computeU dispatchThreadgroups:gridSize
-                     threadsPerThreadgroup:threadGroupSize];
-            [computeU endEncoding];
+            [compute setBytes:&amount length:sizeof(float) atIndex:0];
+            [compute dispatchThreadgroups:gridSize
+                    threadsPerThreadgroup:threadGroupSize];
+            [compute endEncoding];
 
             finalTexture = _blurTemp;
         }
@@ -678,9 +1149,22 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
         [_yuvOutput dispatchConversion:commandBuffer
                          sourceTexture:finalTexture
                                  width:_width height:_height
-                              outFrame:outFrame];
+                              outFrame:outFrame slot:slot];
+
+        if (completion) {
+            vf_metal_trace_end (&encodeSpan);
+            vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
+            [_yuvOutput commitPipelined:commandBuffer
+                          sourceTexture:finalTexture
+                                  width:_width height:_height
+                               outFrame:outFrame slot:slot
+                             completion:completion];
+            return YES;
+        }
 
         /* Commit and wait */
+        vf_metal_trace_end (&encodeSpan);
+        vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
         [commandBuffer commit];
         [commandBuffer waitUntilCompleted];
 
@@ -700,37 +1184,18 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
 
 - (BOOL)loadLUTFromFile:(const char *)path
 {
-    if (!path || *path == '\0') {
-        [self clearLUT];
-        return YES;
-    }
-
-    id<MTLDevice> device = [VfMetalDevice sharedDevice].device;
-    int lutSize = 0;
-    id<MTLTexture> tex = nil;
-
-    /* Determine format by extension */
-    const char *dot = strrchr (path, '.');
-    if (dot && strcasecmp (dot, ".cube") == 0) {
-        tex = parse_cube_lut (path, device, &lutSize);
-    } else if (dot && (strcasecmp (dot, ".png") == 0)) {
-        tex = parse_png_lut (path, device, &lutSize);
-    } else {
-        GST_WARNING ("Unknown LUT file format: %s", path);
-        return NO;
-    }
-
-    if (!tex) return NO;
+    return [_lut loadFile:path];
+}
 
-    _lutTexture = tex;
-    _lutSize = lutSize;
-    return YES;
+- (void)requestLUTFromFile:(const char *)path
+                completion:(void (^)(BOOL loaded))completion
+{
+    [_lut requestFile:path completion:completion];
 }
 
 - (void)clearLUT
 {
-    _lutTexture = nil;
-    _lutSize = 0;
+    [_lut loadFile:NULL];
 }
 
 - (void)cleanup
@@ -738,12 +1203,18 @@ parse_png_lut (const char *path, id<MTLDevice> device, int *outSize)
     [_textureCache clear];
     _renderTarget = nil;
     _blurTemp = nil;
-    _blurResult = nil;
     [_yuvOutput cleanup];
+    /* The LUT itself stays loaded for the next start */
+    [_lut rewind];
     _lutTexture = nil;
     _lutSize = 0;
-    for (int f = 0; f < VF_METAL_INPUT_COUNT; f++)
+    _bakedLUT = nil;
+    _bakedSize = 0;
+    _bakedSource = nil;
+    for (int f = 0; f < VF_METAL_INPUT_COUNT; f++) {
         _pipelines[f] = nil;
+        _bakedPipelines[f] = nil;
+    }
 }
 
 @end
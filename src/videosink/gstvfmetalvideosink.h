@@ -28,8 +28,26 @@
 #include <gst/video/videooverlay.h>
 #include <gst/video/navigation.h>
 
+#include "vfmetalcontext.h"
+
 G_BEGIN_DECLS
 
+/**
+ * GstVfMetalVideoSinkPresentMode:
+ * @VF_METAL_VIDEO_SINK_PRESENT_IMMEDIATE: Render and present on the
+ *   streaming thread as soon as the buffer arrives
+ * @VF_METAL_VIDEO_SINK_PRESENT_SCHEDULED: Render on the sink's own
+ *   thread and present at the buffer's display time
+ * @VF_METAL_VIDEO_SINK_PRESENT_DISPLAY_LINK: Present from a display
+ *   link, each vsync showing the newest frame that is due
+ */
+typedef enum
+{
+  VF_METAL_VIDEO_SINK_PRESENT_IMMEDIATE,
+  VF_METAL_VIDEO_SINK_PRESENT_SCHEDULED,
+  VF_METAL_VIDEO_SINK_PRESENT_DISPLAY_LINK,
+} GstVfMetalVideoSinkPresentMode;
+
 #define GST_TYPE_VF_METAL_VIDEO_SINK (gst_vf_metal_video_sink_get_type())
 G_DECLARE_FINAL_TYPE (GstVfMetalVideoSink, gst_vf_metal_video_sink,
     GST, VF_METAL_VIDEO_SINK, GstVideoSink)
@@ -45,6 +63,8 @@ struct _GstVfMetalVideoSink
 
   /* Properties */
   gboolean force_aspect_ratio;
+  guint max_drawables;
+  GstVfMetalVideoSinkPresentMode present_mode;
 
   /* Video info from set_caps */
   GstVideoInfo info;
@@ -60,6 +80,9 @@ struct _GstVfMetalVideoSink
   /* Whether to forward navigation events */
   gboolean handle_events;
 
+  /* GPU selection; the renderer is created on it at NULL_TO_READY */
+  VfMetalDeviceSelection device;
+
   /* Metal rendering engine (opaque Obj-C object, cast to MetalVideoSinkRenderer* in .m) */
   void *renderer;
 };
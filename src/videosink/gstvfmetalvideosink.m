@@ -37,6 +37,7 @@
 #import <Foundation/Foundation.h>
 #include "gstvfmetalvideosink.h"
 #include "metalvideosinkrenderer.h"
+#import "vfmetalmemory.h"
 
 #include <gst/video/videooverlay.h>
 #include <gst/video/navigation.h>
@@ -44,12 +45,13 @@
 GST_DEBUG_CATEGORY (gst_vf_metal_video_sink_debug);
 #define GST_CAT_DEFAULT gst_vf_metal_video_sink_debug
 
-#define VF_METAL_VIDEO_SINK_FORMATS "{ BGRA, RGBA, NV12, I420 }"
+#define VF_METAL_VIDEO_SINK_FORMATS \
+    "{ BGRA, RGBA, NV12, I420, P010_10LE, I420_10LE }"
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (VF_METAL_VIDEO_SINK_FORMATS))
+    GST_STATIC_CAPS (VF_METAL_VIDEO_CAPS_MAKE (VF_METAL_VIDEO_SINK_FORMATS))
     );
 
 enum
@@ -57,10 +59,40 @@ enum
   PROP_0,
   PROP_FORCE_ASPECT_RATIO,
   PROP_ENABLE_NAVIGATION_EVENTS,
+  PROP_MAX_DRAWABLES,
+  PROP_PRESENT_MODE,
+  PROP_DROPPED_FRAMES,
+  PROP_DEVICE,
 };
 
 #define DEFAULT_FORCE_ASPECT_RATIO TRUE
 #define DEFAULT_ENABLE_NAVIGATION_EVENTS TRUE
+#define DEFAULT_MAX_DRAWABLES 3
+#define DEFAULT_PRESENT_MODE VF_METAL_VIDEO_SINK_PRESENT_SCHEDULED
+
+/* --- Enum GType registration --- */
+
+#define GST_TYPE_VF_METAL_VIDEO_SINK_PRESENT_MODE (gst_vf_metal_video_sink_present_mode_get_type())
+static GType
+gst_vf_metal_video_sink_present_mode_get_type (void)
+{
+  static gsize type_value = 0;
+  static const GEnumValue values[] = {
+    {VF_METAL_VIDEO_SINK_PRESENT_IMMEDIATE,
+        "Render on the streaming thread, present at once", "immediate"},
+    {VF_METAL_VIDEO_SINK_PRESENT_SCHEDULED,
+        "Render ahead, present at the buffer's display time", "scheduled"},
+    {VF_METAL_VIDEO_SINK_PRESENT_DISPLAY_LINK,
+        "Present the newest due frame on each vsync", "display-link"},
+    {0, NULL, NULL},
+  };
+  if (g_once_init_enter (&type_value)) {
+    GType t = g_enum_register_static ("GstVfMetalVideoSinkPresentMode",
+        values);
+    g_once_init_leave (&type_value, t);
+  }
+  return type_value;
+}
 
 /* --- Forward declarations --- */
 
@@ -117,6 +149,42 @@ gst_vf_metal_video_sink_set_caps (GstBaseSink * bsink, GstCaps * caps)
 
 /* --- show_frame --- */
 
+/* Nanoseconds from now until @buf is due on screen, or
+ * GST_CLOCK_STIME_NONE when there is nothing to sync against. With
+ * render-delay set, basesink hands buffers over that much early and the
+ * renderer holds them back until this time. */
+static GstClockTimeDiff
+gst_vf_metal_video_sink_display_delay (GstVfMetalVideoSink * self,
+    GstBuffer * buf)
+{
+  GstBaseSink *bsink = GST_BASE_SINK (self);
+  GstClockTimeDiff delay;
+  GstClockTime running, target;
+  GstClock *clock;
+
+  if (!gst_base_sink_get_sync (bsink) || !GST_BUFFER_PTS_IS_VALID (buf) ||
+      bsink->segment.format != GST_FORMAT_TIME)
+    return GST_CLOCK_STIME_NONE;
+
+  running = gst_segment_to_running_time (&bsink->segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buf));
+  if (!GST_CLOCK_TIME_IS_VALID (running))
+    return GST_CLOCK_STIME_NONE;
+
+  clock = gst_element_get_clock (GST_ELEMENT (self));
+  if (!clock)
+    return GST_CLOCK_STIME_NONE;
+
+  target = running + gst_element_get_base_time (GST_ELEMENT (self)) +
+      gst_base_sink_get_latency (bsink);
+  target = MAX ((GstClockTimeDiff) target +
+      gst_base_sink_get_ts_offset (bsink), 0);
+  delay = GST_CLOCK_DIFF (gst_clock_get_time (clock), target);
+  gst_object_unref (clock);
+
+  return delay;
+}
+
 static GstFlowReturn
 gst_vf_metal_video_sink_show_frame (GstVideoSink * vsink, GstBuffer * buf)
 {
@@ -143,8 +211,28 @@ gst_vf_metal_video_sink_show_frame (GstVideoSink * vsink, GstBuffer * buf)
     [renderer updateDrawableSize];
   }
 
+  /* Scheduled / display-link: the render thread draws and presents */
+  if (self->present_mode != VF_METAL_VIDEO_SINK_PRESENT_IMMEDIATE) {
+    GstClockTime duration = GST_BUFFER_DURATION (buf);
+
+    if (!GST_CLOCK_TIME_IS_VALID (duration) &&
+        GST_VIDEO_INFO_FPS_N (&self->info) > 0)
+      duration = gst_util_uint64_scale_int (GST_SECOND,
+          GST_VIDEO_INFO_FPS_D (&self->info),
+          GST_VIDEO_INFO_FPS_N (&self->info));
+
+    @autoreleasepool {
+      [renderer queueBuffer:buf
+                       info:&self->info
+                      delay:gst_vf_metal_video_sink_display_delay (self, buf)
+                   duration:duration];
+    }
+    return GST_FLOW_OK;
+  }
+
   /* Map the buffer */
-  if (!gst_video_frame_map (&frame, &self->info, buf, GST_MAP_READ)) {
+  if (!gst_video_frame_map (&frame, &self->info, buf,
+          GST_MAP_READ | GST_MAP_VF_METAL)) {
     GST_WARNING_OBJECT (self, "Could not map video frame");
     return GST_FLOW_ERROR;
   }
@@ -166,6 +254,7 @@ static gboolean
 gst_vf_metal_video_sink_propose_allocation (GstBaseSink * bsink,
     GstQuery * query)
 {
+  GstVfMetalVideoSink *self = GST_VF_METAL_VIDEO_SINK (bsink);
   GstCaps *caps;
   GstVideoInfo info;
   GstBufferPool *pool;
@@ -177,6 +266,11 @@ gst_vf_metal_video_sink_propose_allocation (GstBaseSink * bsink,
   if (caps == NULL)
     return FALSE;
 
+  /* GPU memory: upstream renders into textures we draw from directly */
+  if (gst_vf_metal_caps_has_memory_feature (caps))
+    return gst_vf_metal_memory_propose_allocation (query,
+        ((__bridge MetalVideoSinkRenderer *)self->renderer).metalDevice);
+
   if (!gst_video_info_from_caps (&info, caps))
     return FALSE;
 
@@ -198,6 +292,111 @@ gst_vf_metal_video_sink_propose_allocation (GstBaseSink * bsink,
   return TRUE;
 }
 
+/* --- Queries --- */
+
+static gboolean
+gst_vf_metal_video_sink_query (GstBaseSink * bsink, GstQuery * query)
+{
+  GstVfMetalVideoSink *self = GST_VF_METAL_VIDEO_SINK (bsink);
+
+  if (vf_metal_device_selection_handle_query (GST_ELEMENT (bsink),
+          &self->device, query))
+    return TRUE;
+
+  return GST_BASE_SINK_CLASS (parent_class)->query (bsink, query);
+}
+
+/* --- Events --- */
+
+static gboolean
+gst_vf_metal_video_sink_event (GstBaseSink * bsink, GstEvent * event)
+{
+  GstVfMetalVideoSink *self = GST_VF_METAL_VIDEO_SINK (bsink);
+
+  if (self->renderer) {
+    @autoreleasepool {
+      MetalVideoSinkRenderer *renderer =
+          (__bridge MetalVideoSinkRenderer *)self->renderer;
+      switch (GST_EVENT_TYPE (event)) {
+        case GST_EVENT_FLUSH_START:
+          /* Frames queued before the flush must not show up after it */
+          [renderer flushQueuedFrames];
+          break;
+        case GST_EVENT_EOS:
+          /* Let the last frames reach the screen before EOS is posted */
+          [renderer waitQueuedFrames];
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  return GST_BASE_SINK_CLASS (parent_class)->event (bsink, event);
+}
+
+/* --- Device --- */
+
+static void
+gst_vf_metal_video_sink_set_context (GstElement * element,
+    GstContext * context)
+{
+  GstVfMetalVideoSink *self = GST_VF_METAL_VIDEO_SINK (element);
+
+  vf_metal_device_selection_set_context (element, &self->device, context);
+
+  GST_ELEMENT_CLASS (parent_class)->set_context (element, context);
+}
+
+/* Renderer on the selected GPU, replaced when the selection moved. The
+ * window is attached lazily by show_frame, so only the view settings
+ * made while in NULL are carried over. */
+static gboolean
+gst_vf_metal_video_sink_ensure_renderer (GstVfMetalVideoSink * self)
+{
+  VfMetalDevice *device;
+
+  device = vf_metal_device_selection_ensure (GST_ELEMENT (self),
+      &self->device);
+  if (!device)
+    return FALSE;
+
+  @autoreleasepool {
+    if (self->renderer) {
+      MetalVideoSinkRenderer *renderer =
+          (__bridge MetalVideoSinkRenderer *)self->renderer;
+      if (renderer.metalDevice == device)
+        return TRUE;
+
+      renderer = (__bridge_transfer MetalVideoSinkRenderer *)self->renderer;
+      self->renderer = NULL;
+      [renderer cleanup];
+    }
+
+    MetalVideoSinkRenderer *renderer =
+        [[MetalVideoSinkRenderer alloc] initWithDevice:device];
+    if (!renderer) {
+      GST_ELEMENT_ERROR (self, RESOURCE, FAILED,
+          ("Failed to create Metal renderer on '%s'",
+              device.device.name.UTF8String), (NULL));
+      return FALSE;
+    }
+    renderer.traceOwner = GST_OBJECT (self);
+    [renderer setPresentMode:self->present_mode];
+    [renderer setMaximumDrawableCount:self->max_drawables];
+    [renderer setForceAspectRatio:self->force_aspect_ratio];
+    [renderer setHandleEvents:self->handle_events];
+    if (self->have_render_rect)
+      [renderer setRenderRectangleX:self->render_rect.x
+                                  y:self->render_rect.y
+                              width:self->render_rect.w
+                             height:self->render_rect.h];
+    self->renderer = (__bridge_retained void *)renderer;
+  }
+
+  return TRUE;
+}
+
 /* --- State change --- */
 
 static GstStateChangeReturn
@@ -213,8 +412,8 @@ gst_vf_metal_video_sink_change_state (GstElement * element,
 
   switch (transition) {
     case GST_STATE_CHANGE_NULL_TO_READY:
-      break;
-    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      if (!gst_vf_metal_video_sink_ensure_renderer (self))
+        return GST_STATE_CHANGE_FAILURE;
       break;
     default:
       break;
@@ -234,6 +433,7 @@ gst_vf_metal_video_sink_change_state (GstElement * element,
       self->have_info = FALSE;
       break;
     case GST_STATE_CHANGE_READY_TO_NULL:
+      vf_metal_device_selection_reset (element, &self->device);
       break;
     default:
       break;
@@ -271,6 +471,30 @@ gst_vf_metal_video_sink_set_property (GObject * object, guint prop_id,
         }
       }
       break;
+    case PROP_MAX_DRAWABLES:
+      self->max_drawables = g_value_get_uint (value);
+      if (self->renderer) {
+        @autoreleasepool {
+          MetalVideoSinkRenderer *renderer =
+              (__bridge MetalVideoSinkRenderer *)self->renderer;
+          [renderer setMaximumDrawableCount:self->max_drawables];
+        }
+      }
+      break;
+    case PROP_PRESENT_MODE:
+      self->present_mode = g_value_get_enum (value);
+      if (self->renderer) {
+        @autoreleasepool {
+          MetalVideoSinkRenderer *renderer =
+              (__bridge MetalVideoSinkRenderer *)self->renderer;
+          [renderer setPresentMode:self->present_mode];
+        }
+      }
+      break;
+    case PROP_DEVICE:
+      vf_metal_device_selection_set_property (GST_ELEMENT (self),
+          &self->device, value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -290,6 +514,27 @@ gst_vf_metal_video_sink_get_property (GObject * object, guint prop_id,
     case PROP_ENABLE_NAVIGATION_EVENTS:
       g_value_set_boolean (value, self->handle_events);
       break;
+    case PROP_MAX_DRAWABLES:
+      g_value_set_uint (value, self->max_drawables);
+      break;
+    case PROP_PRESENT_MODE:
+      g_value_set_enum (value, self->present_mode);
+      break;
+    case PROP_DROPPED_FRAMES:
+      if (self->renderer) {
+        @autoreleasepool {
+          MetalVideoSinkRenderer *renderer =
+              (__bridge MetalVideoSinkRenderer *)self->renderer;
+          g_value_set_uint64 (value, renderer.droppedFrames);
+        }
+      } else {
+        g_value_set_uint64 (value, 0);
+      }
+      break;
+    case PROP_DEVICE:
+      vf_metal_device_selection_get_property (GST_ELEMENT (self),
+          &self->device, value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -313,6 +558,8 @@ gst_vf_metal_video_sink_finalize (GObject * object)
     }
   }
 
+  vf_metal_device_selection_clear (&self->device);
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
@@ -463,11 +710,15 @@ gst_vf_metal_video_sink_class_init (GstVfMetalVideoSinkClass * klass)
 
   gstelement_class->change_state =
       GST_DEBUG_FUNCPTR (gst_vf_metal_video_sink_change_state);
+  gstelement_class->set_context =
+      GST_DEBUG_FUNCPTR (gst_vf_metal_video_sink_set_context);
 
   gstbasesink_class->set_caps =
       GST_DEBUG_FUNCPTR (gst_vf_metal_video_sink_set_caps);
   gstbasesink_class->propose_allocation =
       GST_DEBUG_FUNCPTR (gst_vf_metal_video_sink_propose_allocation);
+  gstbasesink_class->query = GST_DEBUG_FUNCPTR (gst_vf_metal_video_sink_query);
+  gstbasesink_class->event = GST_DEBUG_FUNCPTR (gst_vf_metal_video_sink_event);
 
   gstvideosink_class->show_frame =
       GST_DEBUG_FUNCPTR (gst_vf_metal_video_sink_show_frame);
@@ -485,9 +736,33 @@ gst_vf_metal_video_sink_class_init (GstVfMetalVideoSinkClass * klass)
           DEFAULT_ENABLE_NAVIGATION_EVENTS,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_MAX_DRAWABLES,
+      g_param_spec_uint ("max-drawables", "Max drawables",
+          "Drawables the layer may have in flight (2 = double, "
+          "3 = triple buffering)", 2, 3, DEFAULT_MAX_DRAWABLES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_PRESENT_MODE,
+      g_param_spec_enum ("present-mode", "Present mode",
+          "How and when rendered frames reach the screen",
+          GST_TYPE_VF_METAL_VIDEO_SINK_PRESENT_MODE, DEFAULT_PRESENT_MODE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_DROPPED_FRAMES,
+      g_param_spec_uint64 ("dropped-frames", "Dropped frames",
+          "Queued frames replaced by newer ones before being presented",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DEVICE,
+      vf_metal_device_selection_param_spec ());
+
   gst_element_class_add_static_pad_template (gstelement_class,
       &sink_template);
 
+  gst_type_mark_as_plugin_api (GST_TYPE_VF_METAL_VIDEO_SINK_PRESENT_MODE, 0);
+
   gst_element_class_set_static_metadata (gstelement_class,
       "Metal Video Sink",
       "Sink/Video",
@@ -502,19 +777,13 @@ static void
 gst_vf_metal_video_sink_init (GstVfMetalVideoSink * self)
 {
   self->force_aspect_ratio = DEFAULT_FORCE_ASPECT_RATIO;
+  self->max_drawables = DEFAULT_MAX_DRAWABLES;
+  self->present_mode = DEFAULT_PRESENT_MODE;
   self->window_handle = 0;
   self->have_info = FALSE;
   self->have_render_rect = FALSE;
   self->handle_events = TRUE;
 
-  @autoreleasepool {
-    MetalVideoSinkRenderer *renderer =
-        [[MetalVideoSinkRenderer alloc] init];
-    if (renderer) {
-      self->renderer = (__bridge_retained void *)renderer;
-    } else {
-      GST_ERROR_OBJECT (self,
-          "Failed to create Metal renderer — no Metal device");
-    }
-  }
+  /* The renderer waits for NULL_TO_READY, when the GPU is known */
+  vf_metal_device_selection_init (&self->device);
 }
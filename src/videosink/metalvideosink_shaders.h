@@ -0,0 +1,85 @@
+/* Metal video sink shader source
+ *
+ * Copyright (C) 2026 Roman Miniailov
+ * Author: Roman Miniailov <miniailovr@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __METAL_VIDEO_SINK_SHADERS_H__
+#define __METAL_VIDEO_SINK_SHADERS_H__
+
+#import <Foundation/Foundation.h>
+
+/* Video sink shader source — concatenated after kVfMetalCommonShaderSource.
+ * Contains the fullscreen quad vertex shader and per-format fragment
+ * shaders that draw into the drawable. */
+
+static NSString *const kVideoSinkShaderSource = @R"(
+
+// Fullscreen quad vertex shader for video sink
+vertex VertexOut videosinkVertex(
+    uint vid [[vertex_id]],
+    constant float4 *vertexData [[buffer(0)]]
+) {
+    VertexOut out;
+    float4 vd = vertexData[vid];
+    out.position = float4(vd.xy, 0.0, 1.0);
+    out.texcoord = vd.zw;
+    return out;
+}
+
+// Fragment shader: BGRA/RGBA texture (single plane)
+fragment float4 videosinkFragment(
+    VertexOut in [[stage_in]],
+    texture2d<float> tex [[texture(0)]]
+) {
+    constexpr sampler s(filter::linear, address::clamp_to_edge);
+    return tex.sample(s, in.texcoord);
+}
+
+// Fragment shader: NV12 input (Y + interleaved UV)
+fragment float4 videosinkFragmentNV12(
+    VertexOut in [[stage_in]],
+    constant Uniforms &uniforms [[buffer(0)]],
+    texture2d<float> yTex [[texture(0)]],
+    texture2d<float> uvTex [[texture(1)]]
+) {
+    constexpr sampler s(filter::linear, address::clamp_to_edge);
+    float y  = yTex.sample(s, in.texcoord).r;
+    float2 uv = uvTex.sample(s, in.texcoord).rg;
+    float3 rgb = yuvToRGB(y, uv.r, uv.g, uniforms.colorMatrix);
+    return float4(rgb, 1.0);
+}
+
+// Fragment shader: I420 input (Y + separate U + separate V)
+fragment float4 videosinkFragmentI420(
+    VertexOut in [[stage_in]],
+    constant Uniforms &uniforms [[buffer(0)]],
+    texture2d<float> yTex [[texture(0)]],
+    texture2d<float> uTex [[texture(1)]],
+    texture2d<float> vTex [[texture(2)]]
+) {
+    constexpr sampler s(filter::linear, address::clamp_to_edge);
+    float y  = yTex.sample(s, in.texcoord).r;
+    float cb = uTex.sample(s, in.texcoord).r;
+    float cr = vTex.sample(s, in.texcoord).r;
+    float3 rgb = yuvToRGB(y, cb, cr, uniforms.colorMatrix);
+    return float4(rgb, 1.0);
+}
+)";
+
+#endif /* __METAL_VIDEO_SINK_SHADERS_H__ */
@@ -27,9 +27,20 @@
 #import <QuartzCore/QuartzCore.h>
 #import <gst/video/video.h>
 
+#import "gstvfmetalvideosink.h"
+#import "vfmetaldevice.h"
+
 @interface MetalVideoSinkRenderer : NSObject
 
+/* Element this renderer's stages are traced for (see vfmetaltrace.h) */
+@property (nonatomic, assign) GstObject *traceOwner;
+
+/* GPU this renderer runs on, fixed at creation */
+@property (nonatomic, readonly) VfMetalDevice *metalDevice;
+
+/* -init uses the default device (+[VfMetalDevice sharedDevice]) */
 - (instancetype)init;
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice;
 
 /* Configure for new video format; called from set_caps */
 - (BOOL)configureWithVideoInfo:(GstVideoInfo *)info;
@@ -42,6 +53,28 @@
 
 /* Rendering */
 - (BOOL)renderFrame:(GstVideoFrame *)frame;
+
+/* Hand @buffer to the sink's render thread and return at once; it is
+ * presented @delay ns from now (GST_CLOCK_STIME_NONE = as soon as
+ * possible, spaced by @duration). Frames still waiting when newer ones
+ * pile up are dropped rather than blocking the caller. */
+- (void)queueBuffer:(GstBuffer *)buffer
+               info:(const GstVideoInfo *)info
+              delay:(GstClockTimeDiff)delay
+           duration:(GstClockTime)duration;
+
+/* Drop frames not yet presented (flush, stop) */
+- (void)flushQueuedFrames;
+
+/* Block until the render thread has drawn what it was handed (EOS) */
+- (void)waitQueuedFrames;
+
+/* Frames replaced by newer ones before they reached the screen */
+@property (nonatomic, readonly) guint64 droppedFrames;
+
+/* Presentation: set before the window is created (READY) */
+- (void)setPresentMode:(GstVfMetalVideoSinkPresentMode)mode;
+- (void)setMaximumDrawableCount:(NSUInteger)count;
 - (void)updateDrawableSize;
 - (void)expose;
 
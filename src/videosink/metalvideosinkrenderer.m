@@ -22,74 +22,38 @@
 #import "metalvideosinkrenderer.h"
 #import "vfmetaldevice.h"
 #import "vfmetaltextureutil.h"
+#import "vfmetaltrace.h"
 #import "vfmetalshaders.h"
+#import "metalvideosink_shaders.h"
+#import "vfmetalmemory.h"
 
 #include <gst/gst.h>
 #include <gst/video/video.h>
+#include <mach/mach_time.h>
 
 #if !TARGET_OS_IPHONE
 #import <AppKit/AppKit.h>
+#import <CoreVideo/CoreVideo.h>
 #endif
 
+/* Frames waiting for the render thread or the display link; beyond this
+ * the oldest is dropped instead of holding up the streaming thread */
+#define VF_METAL_SINK_MAX_PENDING 3
+
+/* mach_absolute_time() units to seconds, the CACurrentMediaTime() base
+ * that presentDrawable:atTime: expects */
+static CFTimeInterval
+vf_metal_host_time_to_seconds (uint64_t host)
+{
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0)
+        mach_timebase_info (&timebase);
+    return (CFTimeInterval) host * timebase.numer / timebase.denom / 1e9;
+}
+
 GST_DEBUG_CATEGORY_EXTERN (gst_vf_metal_video_sink_debug);
 #define GST_CAT_DEFAULT gst_vf_metal_video_sink_debug
 
-/* --- Videosink-specific Metal shader source --- */
-
-static NSString *const kVideoSinkShaderSource = @R"(
-
-// Fullscreen quad vertex shader for video sink
-vertex VertexOut videosinkVertex(
-    uint vid [[vertex_id]],
-    constant float4 *vertexData [[buffer(0)]]
-) {
-    VertexOut out;
-    float4 vd = vertexData[vid];
-    out.position = float4(vd.xy, 0.0, 1.0);
-    out.texcoord = vd.zw;
-    return out;
-}
-
-// Fragment shader: BGRA/RGBA texture (single plane)
-fragment float4 videosinkFragment(
-    VertexOut in [[stage_in]],
-    texture2d<float> tex [[texture(0)]]
-) {
-    constexpr sampler s(filter::linear, address::clamp_to_edge);
-    return tex.sample(s, in.texcoord);
-}
-
-// Fragment shader: NV12 input (Y + interleaved UV)
-fragment float4 videosinkFragmentNV12(
-    VertexOut in [[stage_in]],
-    constant Uniforms &uniforms [[buffer(0)]],
-    texture2d<float> yTex [[texture(0)]],
-    texture2d<float> uvTex [[texture(1)]]
-) {
-    constexpr sampler s(filter::linear, address::clamp_to_edge);
-    float y  = yTex.sample(s, in.texcoord).r;
-    float2 uv = uvTex.sample(s, in.texcoord).rg;
-    float3 rgb = yuvToRGB(y, uv.r, uv.g, uniforms.colorMatrix);
-    return float4(rgb, 1.0);
-}
-
-// Fragment shader: I420 input (Y + separate U + separate V)
-fragment float4 videosinkFragmentI420(
-    VertexOut in [[stage_in]],
-    constant Uniforms &uniforms [[buffer(0)]],
-    texture2d<float> yTex [[texture(0)]],
-    texture2d<float> uTex [[texture(1)]],
-    texture2d<float> vTex [[texture(2)]]
-) {
-    constexpr sampler s(filter::linear, address::clamp_to_edge);
-    float y  = yTex.sample(s, in.texcoord).r;
-    float cb = uTex.sample(s, in.texcoord).r;
-    float cr = vTex.sample(s, in.texcoord).r;
-    float3 rgb = yuvToRGB(y, cb, cr, uniforms.colorMatrix);
-    return float4(rgb, 1.0);
-}
-)";
-
 /* ============================================================= */
 /*                      VfMetalView (macOS)                       */
 /* ============================================================= */
@@ -106,8 +70,8 @@ fragment float4 videosinkFragmentI420(
 
 - (CALayer *)makeBackingLayer
 {
+    /* The renderer attaches its device once it owns the view */
     CAMetalLayer *layer = [CAMetalLayer layer];
-    layer.device = [VfMetalDevice sharedDevice].device;
     layer.pixelFormat = MTLPixelFormatBGRA8Unorm;
     layer.framebufferOnly = YES;
     return layer;
@@ -138,6 +102,30 @@ fragment float4 videosinkFragmentI420(
 
 #endif /* !TARGET_OS_IPHONE */
 
+/* ============================================================= */
+/*                        Queued frames                           */
+/* ============================================================= */
+
+/* A buffer waiting to be presented, with its target host time
+ * (CACurrentMediaTime() base, 0 = as soon as possible) */
+@interface VfMetalSinkPendingFrame : NSObject {
+@public
+    GstBuffer *buffer;
+    GstVideoInfo info;
+    CFTimeInterval presentTime;
+    CFTimeInterval duration;
+}
+@end
+
+@implementation VfMetalSinkPendingFrame
+
+- (void)dealloc
+{
+    gst_buffer_unref (buffer);
+}
+
+@end
+
 /* ============================================================= */
 /*               MetalVideoSinkRenderer implementation            */
 /* ============================================================= */
@@ -181,31 +169,54 @@ fragment float4 videosinkFragmentI420(
     /* State */
     BOOL _windowReady;
     BOOL _configured;
+
+    /* Presentation. Scheduled and display-link frames are rendered on
+     * _renderQueue; _pending is guarded by _pendingLock. */
+    GstVfMetalVideoSinkPresentMode _presentMode;
+    NSUInteger _maxDrawables;
+    dispatch_queue_t _renderQueue;
+    NSLock *_pendingLock;
+    NSMutableArray<VfMetalSinkPendingFrame *> *_pending;
+    BOOL _drainScheduled;       /* scheduled: a drain is queued */
+    BOOL _linkRenderBusy;       /* display link: a frame is being drawn */
+    guint64 _droppedFrames;
+#if !TARGET_OS_IPHONE
+    CVDisplayLinkRef _displayLink;
+#endif
+}
+
+- (void)setTraceOwner:(GstObject *)traceOwner
+{
+    _traceOwner = traceOwner;
+    _textureCache.traceOwner = traceOwner;
 }
 
 - (instancetype)init
+{
+    return [self initWithDevice:[VfMetalDevice sharedDevice]];
+}
+
+- (instancetype)initWithDevice:(VfMetalDevice *)metalDevice
 {
     self = [super init];
     if (!self) return nil;
 
-    VfMetalDevice *metalDevice = [VfMetalDevice sharedDevice];
     if (!metalDevice) {
         GST_ERROR ("MetalVideoSinkRenderer: No Metal device available");
         return nil;
     }
+    _metalDevice = metalDevice;
 
-    _commandQueue = [metalDevice.device newCommandQueue];
-    if (!_commandQueue) {
-        GST_ERROR ("MetalVideoSinkRenderer: Failed to create command queue");
-        return nil;
-    }
+    _commandQueue = metalDevice.commandQueue;
 
     /* Compile shaders: concatenate common + videosink-specific source */
     NSString *fullSource = [kVfMetalCommonShaderSource
         stringByAppendingString:kVideoSinkShaderSource];
 
     NSError *error = nil;
-    _library = [metalDevice compileShaderSource:fullSource error:&error];
+    _library = [metalDevice libraryNamed:@"videosink"
+                                  source:fullSource
+                                   error:&error];
     if (!_library) {
         GST_ERROR ("MetalVideoSinkRenderer: Failed to compile shaders: %s",
                    error.localizedDescription.UTF8String);
@@ -222,14 +233,27 @@ fragment float4 videosinkFragmentI420(
     _cachedDrawableSize = CGSizeZero;
     _cachedContentsScale = 1.0;
 
+    _presentMode = VF_METAL_VIDEO_SINK_PRESENT_IMMEDIATE;
+    _maxDrawables = 3;
+    _renderQueue = dispatch_queue_create ("vfmetalvideosink.render",
+        dispatch_queue_attr_make_with_qos_class (DISPATCH_QUEUE_SERIAL,
+            QOS_CLASS_USER_INTERACTIVE, 0));
+    _pendingLock = [[NSLock alloc] init];
+    _pending = [NSMutableArray array];
+
     return self;
 }
 
+- (void)dealloc
+{
+    [self _stopDisplayLink];
+}
+
 /* --- Pipeline creation --- */
 
 - (id<MTLRenderPipelineState>)createPipelineWithFragmentFunction:(NSString *)fragName
 {
-    id<MTLDevice> device = [VfMetalDevice sharedDevice].device;
+    VfMetalDevice *metalDevice = _metalDevice;
 
     MTLRenderPipelineDescriptor *desc =
         [[MTLRenderPipelineDescriptor alloc] init];
@@ -240,7 +264,8 @@ fragment float4 videosinkFragmentI420(
 
     NSError *error = nil;
     id<MTLRenderPipelineState> state =
-        [device newRenderPipelineStateWithDescriptor:desc error:&error];
+        [metalDevice renderPipelineWithDescriptor:desc library:_library
+                                            error:&error];
     if (!state) {
         GST_ERROR ("MetalVideoSinkRenderer: Pipeline creation failed for %s: %s",
                    fragName.UTF8String, error.localizedDescription.UTF8String);
@@ -343,6 +368,7 @@ fragment float4 videosinkFragmentI420(
         }
 
         self->_metalLayer = (CAMetalLayer *)self->_renderView.layer;
+        self->_metalLayer.device = self->_metalDevice.device;
 
         /* Cache view properties for thread-safe access from renderFrame.
          * These must only be read/written from the main thread. */
@@ -355,6 +381,7 @@ fragment float4 videosinkFragmentI420(
         self->_cachedDrawableSize = CGSizeMake(
             boundsSize.width * scale, boundsSize.height * scale);
         self->_metalLayer.drawableSize = self->_cachedDrawableSize;
+        self->_metalLayer.maximumDrawableCount = self->_maxDrawables;
     };
 
     if ([NSThread isMainThread]) {
@@ -369,10 +396,18 @@ fragment float4 videosinkFragmentI420(
     [_renderLock lock];
     _windowReady = YES;
     [_renderLock unlock];
+
+    if (_presentMode == VF_METAL_VIDEO_SINK_PRESENT_DISPLAY_LINK)
+        [self _startDisplayLink];
 }
 
 - (void)closeWindow
 {
+    /* Nothing may still be drawing into the layer torn down below */
+    [self _stopDisplayLink];
+    [self flushQueuedFrames];
+    dispatch_sync (_renderQueue, ^{ });
+
     /* Mark as not ready first (under lock) to prevent new renders */
     [_renderLock lock];
     if (!_windowReady) {
@@ -464,6 +499,16 @@ fragment float4 videosinkFragmentI420(
 /* --- Rendering --- */
 
 - (BOOL)renderFrame:(GstVideoFrame *)frame
+{
+    return [self _presentFrame:frame atTime:0 minimumDuration:0];
+}
+
+/* Draw @frame into the next drawable and present it at host time
+ * @presentTime, or (0) after at least @duration on screen for the
+ * previous one, or (both 0) as soon as possible */
+- (BOOL)_presentFrame:(GstVideoFrame *)frame
+               atTime:(CFTimeInterval)presentTime
+      minimumDuration:(CFTimeInterval)duration
 {
     [_renderLock lock];
     if (!_windowReady || !_metalLayer || !_configured) {
@@ -487,30 +532,36 @@ fragment float4 videosinkFragmentI420(
         int frameW = GST_VIDEO_FRAME_WIDTH (frame);
         int frameH = GST_VIDEO_FRAME_HEIGHT (frame);
 
-        /* Upload textures based on input format */
+        /* Upload textures based on input format (16-bit planes for
+         * P010_10LE / I420_10LE) */
         id<MTLTexture> textures[3] = { nil, nil, nil };
+        MTLPixelFormat planeFormats[3] = {
+            vf_metal_plane_pixel_format (fmt, 0),
+            vf_metal_plane_pixel_format (fmt, 1),
+            vf_metal_plane_pixel_format (fmt, 2),
+        };
         int textureCount = 0;
 
         if (fmtIdx == VF_METAL_INPUT_NV12) {
             textures[0] = [_textureCache uploadPlane:frame plane:0
-                                              format:MTLPixelFormatR8Unorm
+                                              format:planeFormats[0]
                                                width:frameW height:frameH];
             textures[1] = [_textureCache uploadPlane:frame plane:1
-                                              format:MTLPixelFormatRG8Unorm
+                                              format:planeFormats[1]
                                                width:(frameW + 1) / 2
                                               height:(frameH + 1) / 2];
             textureCount = 2;
             if (!textures[0] || !textures[1]) return NO;
         } else if (fmtIdx == VF_METAL_INPUT_I420) {
             textures[0] = [_textureCache uploadPlane:frame plane:0
-                                              format:MTLPixelFormatR8Unorm
+                                              format:planeFormats[0]
                                                width:frameW height:frameH];
             textures[1] = [_textureCache uploadPlane:frame plane:1
-                                              format:MTLPixelFormatR8Unorm
+                                              format:planeFormats[1]
                                                width:(frameW + 1) / 2
                                               height:(frameH + 1) / 2];
             textures[2] = [_textureCache uploadPlane:frame plane:2
-                                              format:MTLPixelFormatR8Unorm
+                                              format:planeFormats[2]
                                                width:(frameW + 1) / 2
                                               height:(frameH + 1) / 2];
             textureCount = 3;
@@ -560,6 +611,9 @@ fragment float4 videosinkFragmentI420(
             return NO;
         }
 
+        VfMetalTraceSpan encodeSpan;
+        vf_metal_trace_begin (&encodeSpan, _traceOwner, VF_METAL_STATS_ENCODE);
+
         /* Set up render pass with black clear (letterboxing) */
         MTLRenderPassDescriptor *rpDesc =
             [MTLRenderPassDescriptor renderPassDescriptor];
@@ -613,15 +667,288 @@ fragment float4 videosinkFragmentI420(
 
         [encoder endEncoding];
 
+        /* Textures borrowed from VfMetalMemory or aliasing a CoreVideo
+         * surface belong to the upstream pool; keep the buffer alive until
+         * the GPU has finished sampling it. */
+        if (vf_metal_frame_peek_texture (frame, 0, _metalDevice.device) ||
+            vf_metal_frame_get_pixel_buffer (frame)) {
+            GstBuffer *held = gst_buffer_ref (frame->buffer);
+            [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> cb) {
+                gst_buffer_unref (held);
+            }];
+        }
+
         /* Present drawable and commit — no waitUntilCompleted needed.
-         * GPU runs async; CAMetalLayer handles presentation timing. */
-        [commandBuffer presentDrawable:drawable];
+         * GPU runs async; CAMetalLayer holds the drawable until its time. */
+        if (presentTime > 0)
+            [commandBuffer presentDrawable:drawable atTime:presentTime];
+        else if (duration > 0)
+            [commandBuffer presentDrawable:drawable
+                      afterMinimumDuration:duration];
+        else
+            [commandBuffer presentDrawable:drawable];
+        vf_metal_trace_end (&encodeSpan);
+        vf_metal_trace_command_buffer (_traceOwner, commandBuffer);
         [commandBuffer commit];
 
         return YES;
     }
 }
 
+/* --- Queued presentation --- */
+
+- (void)queueBuffer:(GstBuffer *)buffer
+               info:(const GstVideoInfo *)info
+              delay:(GstClockTimeDiff)delay
+           duration:(GstClockTime)duration
+{
+    VfMetalSinkPendingFrame *pf = [[VfMetalSinkPendingFrame alloc] init];
+    pf->buffer = gst_buffer_ref (buffer);
+    pf->info = *info;
+    pf->presentTime = GST_CLOCK_STIME_IS_VALID (delay)
+        ? CACurrentMediaTime () + (CFTimeInterval) MAX (delay, 0) / GST_SECOND
+        : 0;
+    pf->duration = GST_CLOCK_TIME_IS_VALID (duration)
+        ? (CFTimeInterval) duration / GST_SECOND : 0;
+
+    BOOL kick = NO;
+    [_pendingLock lock];
+    [_pending addObject:pf];
+    while (_pending.count > VF_METAL_SINK_MAX_PENDING) {
+        [_pending removeObjectAtIndex:0];
+        _droppedFrames++;
+        GST_DEBUG ("MetalVideoSinkRenderer: render thread behind, "
+                   "dropped a frame");
+    }
+    if (_presentMode == VF_METAL_VIDEO_SINK_PRESENT_SCHEDULED &&
+        !_drainScheduled) {
+        _drainScheduled = YES;
+        kick = YES;
+    }
+    [_pendingLock unlock];
+
+    if (kick)
+        dispatch_async (_renderQueue, ^{ [self _drainPending]; });
+}
+
+- (void)flushQueuedFrames
+{
+    [_pendingLock lock];
+    [_pending removeAllObjects];
+    [_pendingLock unlock];
+}
+
+- (void)waitQueuedFrames
+{
+    /* A scheduled drain presents everything queued before it returns. In
+     * display-link mode frames still waiting for their vsync stay queued. */
+    dispatch_sync (_renderQueue, ^{ });
+}
+
+- (guint64)droppedFrames
+{
+    [_pendingLock lock];
+    guint64 dropped = _droppedFrames;
+    [_pendingLock unlock];
+    return dropped;
+}
+
+/* Render thread: map and draw one queued frame */
+- (void)_renderPending:(VfMetalSinkPendingFrame *)pf
+                atTime:(CFTimeInterval)presentTime
+       minimumDuration:(CFTimeInterval)duration
+{
+    GstVideoFrame frame;
+
+    if (!gst_video_frame_map (&frame, &pf->info, pf->buffer,
+                              GST_MAP_READ | GST_MAP_VF_METAL)) {
+        GST_WARNING ("MetalVideoSinkRenderer: could not map queued frame");
+        return;
+    }
+
+    @autoreleasepool {
+        if (![self _presentFrame:&frame atTime:presentTime
+                 minimumDuration:duration])
+            GST_DEBUG ("MetalVideoSinkRenderer: queued frame not rendered");
+    }
+
+    gst_video_frame_unmap (&frame);
+}
+
+/* Scheduled mode: present everything queued in order. nextDrawable may
+ * block here once maximumDrawableCount frames wait for their time, which
+ * only holds up this thread. */
+- (void)_drainPending
+{
+    for (;;) {
+        VfMetalSinkPendingFrame *pf = nil;
+
+        [_pendingLock lock];
+        if (_pending.count > 0) {
+            pf = _pending[0];
+            [_pending removeObjectAtIndex:0];
+        } else {
+            _drainScheduled = NO;
+        }
+        [_pendingLock unlock];
+
+        if (!pf)
+            break;
+        [self _renderPending:pf atTime:pf->presentTime
+             minimumDuration:pf->presentTime > 0 ? 0 : pf->duration];
+    }
+}
+
+/* Display link: the vsync at host time @vsync is coming up; show the
+ * newest frame due by then. Frames overtaken by a newer due one count
+ * as dropped. */
+- (void)_displayLinkFiredForVsync:(CFTimeInterval)vsync
+                           period:(CFTimeInterval)period
+{
+    VfMetalSinkPendingFrame *due = nil;
+
+    [_pendingLock lock];
+    if (!_linkRenderBusy) {
+        while (_pending.count > 0 &&
+               _pending[0]->presentTime <= vsync + period / 2) {
+            if (due)
+                _droppedFrames++;
+            due = _pending[0];
+            [_pending removeObjectAtIndex:0];
+        }
+        if (due)
+            _linkRenderBusy = YES;
+    }
+    [_pendingLock unlock];
+
+    if (!due)
+        return;
+
+    dispatch_async (_renderQueue, ^{
+        [self _renderPending:due atTime:vsync minimumDuration:0];
+        [self->_pendingLock lock];
+        self->_linkRenderBusy = NO;
+        [self->_pendingLock unlock];
+    });
+}
+
+#if !TARGET_OS_IPHONE
+static CVReturn
+vf_metal_display_link_callback (CVDisplayLinkRef link, const CVTimeStamp *now,
+    const CVTimeStamp *outputTime, CVOptionFlags flagsIn,
+    CVOptionFlags *flagsOut, void *user_data)
+{
+    MetalVideoSinkRenderer *renderer =
+        (__bridge MetalVideoSinkRenderer *) user_data;
+    CFTimeInterval period = (outputTime->videoTimeScale > 0 &&
+                             outputTime->videoRefreshPeriod > 0)
+        ? (CFTimeInterval) outputTime->videoRefreshPeriod /
+              outputTime->videoTimeScale
+        : 1.0 / 60.0;
+
+    @autoreleasepool {
+        [renderer _displayLinkFiredForVsync:
+                      vf_metal_host_time_to_seconds (outputTime->hostTime)
+                                     period:period];
+    }
+    return kCVReturnSuccess;
+}
+#endif
+
+- (void)_startDisplayLink
+{
+#if !TARGET_OS_IPHONE
+    if (_displayLink)
+        return;
+
+    if (CVDisplayLinkCreateWithActiveCGDisplays (&_displayLink) !=
+        kCVReturnSuccess) {
+        GST_WARNING ("MetalVideoSinkRenderer: no display link, presenting "
+                     "frames on schedule instead");
+        _displayLink = NULL;
+        _presentMode = VF_METAL_VIDEO_SINK_PRESENT_SCHEDULED;
+        return;
+    }
+    /* Unretained: the link is stopped before the renderer goes away */
+    CVDisplayLinkSetOutputCallback (_displayLink,
+        vf_metal_display_link_callback, (__bridge void *) self);
+    CVDisplayLinkStart (_displayLink);
+    GST_DEBUG ("MetalVideoSinkRenderer: display link started");
+#else
+    /* No internal view to attach a CADisplayLink to */
+    _presentMode = VF_METAL_VIDEO_SINK_PRESENT_SCHEDULED;
+#endif
+}
+
+- (void)_stopDisplayLink
+{
+#if !TARGET_OS_IPHONE
+    if (!_displayLink)
+        return;
+
+    CVDisplayLinkStop (_displayLink);
+    CVDisplayLinkRelease (_displayLink);
+    _displayLink = NULL;
+#endif
+}
+
+/* Both settings may change after the window exists (an application
+ * window handle attaches it before PAUSED), so they also update the live
+ * display link and layer */
+- (void)setPresentMode:(GstVfMetalVideoSinkPresentMode)mode
+{
+    BOOL kick = NO;
+
+    [_pendingLock lock];
+    _presentMode = mode;
+    [_pendingLock unlock];
+
+    [_renderLock lock];
+    BOOL windowReady = _windowReady;
+    [_renderLock unlock];
+    if (!windowReady)
+        return;
+
+    if (mode == VF_METAL_VIDEO_SINK_PRESENT_DISPLAY_LINK) {
+        [self _startDisplayLink];
+        return;
+    }
+
+    [self _stopDisplayLink];
+
+    /* Frames left waiting for a vsync are presented in order instead */
+    [_pendingLock lock];
+    if (_pending.count > 0 && !_drainScheduled) {
+        _drainScheduled = YES;
+        kick = YES;
+    }
+    [_pendingLock unlock];
+
+    if (kick)
+        dispatch_async (_renderQueue, ^{ [self _drainPending]; });
+}
+
+- (void)setMaximumDrawableCount:(NSUInteger)count
+{
+    _maxDrawables = CLAMP (count, 2, 3);
+
+#if !TARGET_OS_IPHONE
+    if (!_renderView)
+        return;
+
+    NSUInteger drawables = _maxDrawables;
+    void (^updateBlock)(void) = ^{
+        self->_metalLayer.maximumDrawableCount = drawables;
+    };
+
+    if ([NSThread isMainThread]) {
+        updateBlock();
+    } else {
+        dispatch_async (dispatch_get_main_queue (), updateBlock);
+    }
+#endif
+}
+
 - (void)updateDrawableSize
 {
 #if !TARGET_OS_IPHONE
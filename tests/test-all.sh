@@ -74,6 +74,24 @@ else
     TOTAL_PASS=$((TOTAL_PASS + 1))
 fi
 
+# Run chain tests
+"${SCRIPT_DIR}/test-chain.sh"
+RESULT=$?
+if [ ${RESULT} -ne 0 ]; then
+    TOTAL_FAIL=$((TOTAL_FAIL + 1))
+else
+    TOTAL_PASS=$((TOTAL_PASS + 1))
+fi
+
+# Run scale ladder tests
+"${SCRIPT_DIR}/test-scaleladder.sh"
+RESULT=$?
+if [ ${RESULT} -ne 0 ]; then
+    TOTAL_FAIL=$((TOTAL_FAIL + 1))
+else
+    TOTAL_PASS=$((TOTAL_PASS + 1))
+fi
+
 # Run multi-element pipeline tests
 "${SCRIPT_DIR}/test-multi-element.sh"
 RESULT=$?
@@ -0,0 +1,204 @@
+#!/bin/bash
+# Test suite for vfmetalchain element
+# Usage: ./test-chain.sh [path-to-plugin-dir]
+
+set -u
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+BUILD_DIR="${SCRIPT_DIR}/../build"
+PLUGIN="${BUILD_DIR}/gstvfmetal.dylib"
+
+# Find GStreamer commands
+if [ -d "/Library/Frameworks/GStreamer.framework/Commands" ]; then
+    GST_CMD="/Library/Frameworks/GStreamer.framework/Commands"
+else
+    GST_CMD=""
+fi
+
+GST_INSPECT="${GST_CMD:+${GST_CMD}/}gst-inspect-1.0"
+GST_LAUNCH="${GST_CMD:+${GST_CMD}/}gst-launch-1.0"
+
+export GST_PLUGIN_PATH="${BUILD_DIR}"
+
+PASSED=0
+FAILED=0
+TOTAL=0
+
+# Create a small test PNG via GStreamer (32x32 red square)
+TEST_IMG="/tmp/vfmetal_test_chain_overlay.png"
+$GST_LAUNCH videotestsrc num-buffers=1 pattern=red ! \
+    "video/x-raw,format=BGRA,width=32,height=32" ! \
+    videoconvert ! pngenc ! filesink location="$TEST_IMG" > /dev/null 2>&1 || true
+
+run_test() {
+    local name="$1"
+    shift
+    TOTAL=$((TOTAL + 1))
+    printf "  [%02d] %-60s " "$TOTAL" "$name"
+    if "$@" > /dev/null 2>&1; then
+        echo "PASS"
+        PASSED=$((PASSED + 1))
+    else
+        echo "FAIL"
+        FAILED=$((FAILED + 1))
+    fi
+}
+
+echo "=== vfmetalchain test suite ==="
+echo ""
+
+# --- Element inspection ---
+echo "--- Element inspection ---"
+run_test "Element loads" \
+    $GST_INSPECT vfmetalchain
+
+# --- Identity passthrough ---
+echo "--- Passthrough (all stages identity) ---"
+for fmt in BGRA RGBA NV12 I420; do
+    run_test "Passthrough $fmt" \
+        $GST_LAUNCH videotestsrc num-buffers=10 ! \
+            "video/x-raw,format=$fmt,width=640,height=480" ! \
+            vfmetalchain ! \
+            fakesink
+done
+
+# --- Convert + scale stage ---
+echo "--- Format conversion and scaling ---"
+for in_fmt in BGRA NV12 I420; do
+    for out_fmt in BGRA RGBA NV12 I420; do
+        run_test "$in_fmt 640x480 -> $out_fmt 320x240" \
+            $GST_LAUNCH videotestsrc num-buffers=5 ! \
+                "video/x-raw,format=$in_fmt,width=640,height=480" ! \
+                vfmetalchain ! \
+                "video/x-raw,format=$out_fmt,width=320,height=240" ! \
+                fakesink
+    done
+done
+
+run_test "Letterbox with border color" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=BGRA,width=640,height=480" ! \
+        vfmetalchain add-borders=true border-color=0xFF0000FF ! \
+        "video/x-raw,width=1280,height=720" ! \
+        fakesink
+
+run_test "Nearest scale method" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=BGRA,width=640,height=480" ! \
+        vfmetalchain scale-method=nearest ! \
+        "video/x-raw,width=1280,height=960" ! \
+        fakesink
+
+# --- Filter stage ---
+echo "--- Filter stage ---"
+run_test "Color adjustments" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=NV12,width=640,height=480" ! \
+        vfmetalchain brightness=0.2 contrast=1.3 saturation=0.5 hue=0.1 gamma=1.2 ! \
+        fakesink
+
+run_test "Sepia, invert, noise, vignette" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=BGRA,width=640,height=480" ! \
+        vfmetalchain sepia=0.8 invert=true noise=0.3 vignette=0.5 ! \
+        fakesink
+
+run_test "Sharpen (compute passes)" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=I420,width=640,height=480" ! \
+        vfmetalchain sharpness=0.7 ! \
+        fakesink
+
+run_test "Blur + scale" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=BGRA,width=1280,height=720" ! \
+        vfmetalchain sharpness=-0.5 ! \
+        "video/x-raw,format=NV12,width=640,height=360" ! \
+        fakesink
+
+# --- Transform stage ---
+echo "--- Transform stage ---"
+for method in clockwise rotate-180 horizontal-flip upper-right-diagonal; do
+    run_test "Transform $method" \
+        $GST_LAUNCH videotestsrc num-buffers=5 ! \
+            "video/x-raw,format=BGRA,width=640,height=480" ! \
+            vfmetalchain transform=$method ! \
+            fakesink
+done
+
+run_test "Crop + rotate + scale" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=NV12,width=1920,height=1080" ! \
+        vfmetalchain transform=clockwise crop-left=40 crop-right=40 ! \
+        "video/x-raw,width=1280,height=720" ! \
+        fakesink
+
+# --- Overlay stage ---
+echo "--- Overlay stage ---"
+if [ -f "$TEST_IMG" ]; then
+    run_test "Overlay at position" \
+        $GST_LAUNCH videotestsrc num-buffers=5 ! \
+            "video/x-raw,format=BGRA,width=640,height=480" ! \
+            vfmetalchain overlay-location="$TEST_IMG" overlay-x=10 overlay-y=20 ! \
+            fakesink
+
+    run_test "Overlay resized with alpha" \
+        $GST_LAUNCH videotestsrc num-buffers=5 ! \
+            "video/x-raw,format=I420,width=640,height=480" ! \
+            vfmetalchain overlay-location="$TEST_IMG" \
+                overlay-width=64 overlay-height=64 overlay-alpha=0.5 ! \
+            fakesink
+
+    run_test "Overlay after sharpen" \
+        $GST_LAUNCH videotestsrc num-buffers=5 ! \
+            "video/x-raw,format=NV12,width=640,height=480" ! \
+            vfmetalchain sharpness=0.5 overlay-location="$TEST_IMG" ! \
+            fakesink
+
+    run_test "All stages" \
+        $GST_LAUNCH videotestsrc num-buffers=5 ! \
+            "video/x-raw,format=NV12,width=1920,height=1080" ! \
+            vfmetalchain brightness=0.1 saturation=1.2 transform=horizontal-flip \
+                overlay-location="$TEST_IMG" overlay-x=20 overlay-y=20 ! \
+            "video/x-raw,format=BGRA,width=1280,height=720" ! \
+            fakesink
+else
+    echo "  (skipping overlay tests: failed to create $TEST_IMG)"
+fi
+
+run_test "Missing overlay file (graceful)" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=BGRA,width=640,height=480" ! \
+        vfmetalchain overlay-location=/nonexistent/path.png ! \
+        fakesink
+
+# --- GPU memory ---
+echo "--- GPU memory ---"
+run_test "MetalTexture caps between chains" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=NV12,width=1280,height=720" ! \
+        vfmetalchain brightness=0.1 ! \
+        "video/x-raw(memory:MetalTexture),format=BGRA,width=640,height=360" ! \
+        vfmetalchain transform=rotate-180 ! \
+        "video/x-raw,format=BGRA" ! \
+        fakesink
+
+# --- Pipelined submission ---
+echo "--- Pipelined submission ---"
+run_test "in-flight=3 all stages" \
+    $GST_LAUNCH videotestsrc num-buffers=30 ! \
+        "video/x-raw,format=NV12,width=1280,height=720" ! \
+        vfmetalchain in-flight=3 contrast=1.2 transform=vertical-flip ! \
+        "video/x-raw,format=I420,width=640,height=360" ! \
+        fakesink
+
+# Cleanup
+rm -f "$TEST_IMG"
+
+# --- Summary ---
+echo ""
+echo "=== Results: $PASSED/$TOTAL passed, $FAILED failed ==="
+
+if [ $FAILED -gt 0 ]; then
+    exit 1
+fi
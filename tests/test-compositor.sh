@@ -182,6 +182,121 @@ run_pipeline "I420 output" \
     videotestsrc num-buffers=30 ! \
     vfmetalcompositor ! "video/x-raw,format=I420,width=320,height=240" ! fakesink
 
+# --- 14. Occlusion and repeated buffers ---
+echo "[Occlusion and repeated buffers]"
+run_pipeline "Full-frame source pad over BGRA input" \
+    vfmetalcompositor name=comp sink_1::operator=source ! \
+    "video/x-raw,width=320,height=240" ! fakesink \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=BGRA,width=320,height=240" ! comp. \
+    videotestsrc num-buffers=30 pattern=ball ! "video/x-raw,format=BGRA,width=320,height=240" ! comp.
+
+run_pipeline "Four tiles covering a lower pad" \
+    vfmetalcompositor name=comp \
+        sink_1::xpos=0 sink_1::ypos=0 sink_2::xpos=160 sink_2::ypos=0 \
+        sink_3::xpos=0 sink_3::ypos=120 sink_4::xpos=160 sink_4::ypos=120 ! \
+    "video/x-raw,width=320,height=240" ! fakesink \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=NV12,width=320,height=240" ! comp. \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=NV12,width=160,height=120" ! comp. \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=I420,width=160,height=120" ! comp. \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=NV12,width=160,height=120" ! comp. \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=I420,width=160,height=120" ! comp.
+
+run_pipeline "Still image layer repeated over live input" \
+    vfmetalcompositor name=comp sink_1::xpos=20 sink_1::ypos=20 ! \
+    "video/x-raw,width=320,height=240" ! fakesink \
+    videotestsrc num-buffers=60 ! "video/x-raw,format=NV12,width=320,height=240,framerate=30/1" ! comp. \
+    videotestsrc num-buffers=1 pattern=smpte ! "video/x-raw,format=BGRA,width=80,height=60" ! \
+        imagefreeze num-buffers=60 ! "video/x-raw,framerate=30/1" ! comp.
+
+run_pipeline "Slow pad repeated with in-flight=3" \
+    vfmetalcompositor name=comp in-flight=3 sink_1::xpos=160 ! \
+    "video/x-raw,format=NV12,width=320,height=240,framerate=30/1" ! fakesink \
+    videotestsrc num-buffers=60 ! "video/x-raw,format=I420,width=320,height=240,framerate=30/1" ! comp. \
+    videotestsrc num-buffers=2 ! "video/x-raw,format=I420,width=160,height=120,framerate=1/1" ! comp.
+
+# --- 15. Concurrent uploads ---
+echo "[Concurrent uploads]"
+for threads in 0 1 4; do
+    run_pipeline "Four 720p inputs, upload-threads=${threads}" \
+        vfmetalcompositor name=comp upload-threads=${threads} \
+            sink_1::xpos=640 sink_2::ypos=360 sink_3::xpos=640 sink_3::ypos=360 ! \
+        "video/x-raw,format=NV12,width=1280,height=720" ! fakesink \
+        videotestsrc num-buffers=30 ! "video/x-raw,format=NV12,width=640,height=360" ! comp. \
+        videotestsrc num-buffers=30 pattern=ball ! "video/x-raw,format=I420,width=640,height=360" ! comp. \
+        videotestsrc num-buffers=30 pattern=snow ! "video/x-raw,format=BGRA,width=640,height=360" ! comp. \
+        videotestsrc num-buffers=30 pattern=smpte ! "video/x-raw,format=NV12,width=640,height=360" ! comp.
+done
+
+# --- 16. Sizing quality ---
+echo "[Sizing quality]"
+for quality in nearest linear mipmapped box; do
+    run_pipeline "1080p into a 480x270 tile, sizing-quality=${quality}" \
+        vfmetalcompositor name=comp \
+            sink_0::width=480 sink_0::height=270 sink_0::sizing-quality=${quality} ! \
+        "video/x-raw,format=BGRA,width=960,height=540" ! fakesink \
+        videotestsrc num-buffers=30 ! "video/x-raw,format=NV12,width=1920,height=1080" ! comp.
+done
+
+run_pipeline "Box tile of a repeated still next to live input" \
+    vfmetalcompositor name=comp in-flight=2 \
+        sink_1::xpos=320 sink_1::width=160 sink_1::height=120 sink_1::sizing-quality=box ! \
+    "video/x-raw,width=480,height=240" ! fakesink \
+    videotestsrc num-buffers=60 ! "video/x-raw,format=I420,width=320,height=240,framerate=30/1" ! comp. \
+    videotestsrc num-buffers=1 pattern=smpte ! "video/x-raw,format=BGRA,width=1280,height=720" ! \
+        imagefreeze num-buffers=60 ! "video/x-raw,framerate=30/1" ! comp.
+
+# --- 17. Batched pad draws ---
+echo "[Batched pad draws]"
+GRID_PADS=""
+GRID_SRCS=""
+for i in $(seq 0 11); do
+    GRID_PADS="${GRID_PADS} sink_${i}::xpos=$(( (i % 4) * 80 )) sink_${i}::ypos=$(( (i / 4) * 80 ))"
+    GRID_SRCS="${GRID_SRCS} videotestsrc num-buffers=30 pattern=$(( i % 8 )) ! video/x-raw,format=NV12,width=80,height=80 ! comp."
+done
+run_pipeline "Twelve NV12 tiles, more than one batch" \
+    vfmetalcompositor name=comp ${GRID_PADS} ! \
+    "video/x-raw,width=320,height=240" ! fakesink ${GRID_SRCS}
+
+run_pipeline "Mixed formats and operators interleaved" \
+    vfmetalcompositor name=comp \
+        sink_1::xpos=40 sink_1::alpha=0.5 sink_2::xpos=80 sink_2::operator=add \
+        sink_3::xpos=120 sink_4::xpos=160 sink_4::alpha=0.7 sink_5::xpos=200 ! \
+    "video/x-raw,width=320,height=240" ! fakesink \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=BGRA,width=320,height=240" ! comp. \
+    videotestsrc num-buffers=30 pattern=ball ! "video/x-raw,format=BGRA,width=80,height=80" ! comp. \
+    videotestsrc num-buffers=30 pattern=smpte ! "video/x-raw,format=BGRA,width=80,height=80" ! comp. \
+    videotestsrc num-buffers=30 pattern=snow ! "video/x-raw,format=I420,width=80,height=80" ! comp. \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=I420,width=80,height=80" ! comp. \
+    videotestsrc num-buffers=30 pattern=ball ! "video/x-raw,format=NV12,width=80,height=80" ! comp.
+
+# --- 18. Statistics ---
+echo "[Statistics]"
+check_inspect "has stats property" "stats"
+check_inspect "has stats-interval property" "stats-interval"
+check_inspect "has device property" "device"
+
+run_pipeline "Stats messages every 100ms" \
+    -m vfmetalcompositor name=comp stats-interval=100 ! \
+    "video/x-raw,format=NV12,width=320,height=240" ! fakesink \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=I420,width=320,height=240" ! comp.
+
+run_pipeline "Stats with in-flight=3" \
+    vfmetalcompositor name=comp in-flight=3 stats-interval=50 ! \
+    "video/x-raw,width=320,height=240" ! fakesink \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=BGRA,width=320,height=240" ! comp.
+
+# --- 19. Tracing ---
+echo "[Tracing]"
+GST_TRACERS="vfmetal" run_pipeline "Composite with the vfmetal tracer" \
+    vfmetalcompositor name=comp sink_1::xpos=160 ! \
+    "video/x-raw,format=NV12,width=320,height=240" ! fakesink \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=I420,width=320,height=240" ! comp. \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=BGRA,width=160,height=120" ! comp.
+GST_TRACERS="vfmetal" run_pipeline "Pipelined composite with the vfmetal tracer" \
+    vfmetalcompositor name=comp in-flight=3 ! \
+    "video/x-raw,width=320,height=240" ! fakesink \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=NV12,width=320,height=240" ! comp.
+
 # --- Summary ---
 echo ""
 echo "=== Compositor results: ${PASS}/${TOTAL} passed, ${FAIL} failed ==="
@@ -135,6 +135,22 @@ run_test "Scale I420 1280x720 -> 320x240" \
         "video/x-raw,format=I420,width=320,height=240" ! \
         fakesink
 
+for method in bicubic lanczos; do
+    run_test "Scale NV12 3840x2160 -> 640x360 ($method)" \
+        $GST_LAUNCH videotestsrc num-buffers=5 ! \
+            "video/x-raw,format=NV12,width=3840,height=2160" ! \
+            vfmetalconvertscale method=$method ! \
+            "video/x-raw,format=NV12,width=640,height=360" ! \
+            fakesink
+
+    run_test "Scale BGRA 640x480 -> 1920x1080 ($method, add-borders)" \
+        $GST_LAUNCH videotestsrc num-buffers=5 ! \
+            "video/x-raw,format=BGRA,width=640,height=480" ! \
+            vfmetalconvertscale method=$method add-borders=true ! \
+            "video/x-raw,format=BGRA,width=1920,height=1080" ! \
+            fakesink
+done
+
 # --- Combined convert + scale ---
 echo "--- Combined convert + scale ---"
 run_test "NV12 1920x1080 -> BGRA 640x480" \
@@ -165,6 +181,73 @@ run_test "BGRA 320x240 -> I420 1920x1080" \
         "video/x-raw,format=I420,width=1920,height=1080" ! \
         fakesink
 
+# --- 10-bit and colorimetry ---
+echo "--- 10-bit / colorimetry ---"
+for deep_fmt in P010_10LE I420_10LE; do
+    for other_fmt in BGRA NV12 I420; do
+        run_test "Convert $deep_fmt -> $other_fmt" \
+            $GST_LAUNCH videotestsrc num-buffers=5 ! \
+                "video/x-raw,format=$deep_fmt,width=320,height=240" ! \
+                vfmetalconvertscale ! \
+                "video/x-raw,format=$other_fmt,width=320,height=240" ! \
+                fakesink
+
+        run_test "Convert $other_fmt -> $deep_fmt" \
+            $GST_LAUNCH videotestsrc num-buffers=5 ! \
+                "video/x-raw,format=$other_fmt,width=320,height=240" ! \
+                vfmetalconvertscale ! \
+                "video/x-raw,format=$deep_fmt,width=320,height=240" ! \
+                fakesink
+    done
+done
+
+run_test "Scale P010_10LE 3840x2160 -> P010_10LE 1920x1080 (BT.2020)" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=P010_10LE,width=3840,height=2160,colorimetry=bt2020" ! \
+        vfmetalconvertscale ! \
+        "video/x-raw,format=P010_10LE,width=1920,height=1080" ! \
+        fakesink
+
+run_test "Scale P010_10LE -> I420_10LE (lanczos)" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=P010_10LE,width=1920,height=1080" ! \
+        vfmetalconvertscale method=lanczos ! \
+        "video/x-raw,format=I420_10LE,width=1280,height=720" ! \
+        fakesink
+
+run_test "Full-range NV12 -> limited-range I420" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=NV12,width=640,height=480,colorimetry=1:4:0:0" ! \
+        vfmetalconvertscale ! \
+        "video/x-raw,format=I420,width=640,height=480,colorimetry=bt601" ! \
+        fakesink
+
+# --- Same-family YUV (plane-native, no RGBA hop) ---
+echo "--- Same-family YUV ---"
+for pair in "NV12 I420" "I420 NV12" "UYVY YUY2" "YUY2 UYVY"; do
+    set -- $pair
+    run_test "Scale $1 1280x720 -> $2 640x360" \
+        $GST_LAUNCH videotestsrc num-buffers=5 ! \
+            "video/x-raw,format=$1,width=1280,height=720" ! \
+            vfmetalconvertscale ! \
+            "video/x-raw,format=$2,width=640,height=360" ! \
+            fakesink
+done
+
+run_test "Scale UYVY 1280x720 -> 640x360 (nearest)" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=UYVY,width=1280,height=720" ! \
+        vfmetalconvertscale method=nearest ! \
+        "video/x-raw,format=UYVY,width=640,height=360" ! \
+        fakesink
+
+run_test "Letterbox NV12 16:9 -> I420 4:3" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=NV12,width=1920,height=1080" ! \
+        vfmetalconvertscale add-borders=true border-color=0xFF0000FF ! \
+        "video/x-raw,format=I420,width=640,height=480" ! \
+        fakesink
+
 # --- Letterboxing ---
 echo "--- Letterboxing ---"
 run_test "Letterbox 16:9 -> 4:3 (add-borders=true)" \
@@ -18,6 +18,10 @@ GST_LAUNCH="${GST_CMD:+${GST_CMD}/}gst-launch-1.0"
 
 export GST_PLUGIN_PATH="${BUILD_DIR}"
 
+# videotestsrc only produces progressive caps, which vfmetaldeinterlace
+# passes through untouched; relabel them so the kernels actually run
+INTERLACED="capssetter caps=video/x-raw,interlace-mode=interleaved"
+
 PASSED=0
 FAILED=0
 TOTAL=0
@@ -36,6 +40,40 @@ run_test() {
     fi
 }
 
+# mode=double on progressive pictures: 10 frames at 25/1 must come out
+# as 20 buffers 20 ms apart, each input frame twice and unchanged. The
+# 1-pixel checkerboard would not survive being bobbed. $1 is an optional
+# element relabelling the caps.
+DOUBLE_SRC="videotestsrc num-buffers=10 pattern=checkers-1 ! video/x-raw,format=BGRA,width=64,height=48,framerate=25/1"
+
+check_double_timestamps() {
+    local pts expected="" i
+    pts=$($GST_LAUNCH -v $DOUBLE_SRC ! ${1:-identity} ! \
+        vfmetaldeinterlace mode=double ! fakesink silent=false 2>&1 | \
+        sed -n 's/.*chain.*pts: \([0-9:.]*\).*/\1/p' | tr '\n' ' ')
+    for i in $(seq 0 19); do
+        expected="${expected}$(printf '0:00:00.%03d000000 ' $((i * 20)))"
+    done
+    [ "$pts" = "$expected" ]
+}
+
+check_double_content() {
+    local dir frame=$((64 * 48 * 4)) i ret
+    dir=$(mktemp -d)
+    $GST_LAUNCH $DOUBLE_SRC ! filesink location="$dir/in.raw" && \
+    $GST_LAUNCH $DOUBLE_SRC ! ${1:-identity} ! \
+        vfmetaldeinterlace mode=double ! "video/x-raw,format=BGRA" ! \
+        filesink location="$dir/out.raw" || { rm -rf "$dir"; return 1; }
+    for i in $(seq 0 9); do
+        dd if="$dir/in.raw" bs=$frame skip=$i count=1 2> /dev/null
+        dd if="$dir/in.raw" bs=$frame skip=$i count=1 2> /dev/null
+    done > "$dir/expected.raw"
+    cmp -s "$dir/expected.raw" "$dir/out.raw"
+    ret=$?
+    rm -rf "$dir"
+    return $ret
+}
+
 echo "=== vfmetaldeinterlace test suite ==="
 echo ""
 
@@ -50,7 +88,7 @@ for fmt in BGRA RGBA NV12 I420; do
     run_test "Bob $fmt 640x480" \
         $GST_LAUNCH videotestsrc num-buffers=10 ! \
             "video/x-raw,format=$fmt,width=640,height=480" ! \
-            vfmetaldeinterlace method=bob ! \
+            $INTERLACED ! vfmetaldeinterlace method=bob ! \
             fakesink
 done
 
@@ -60,17 +98,17 @@ for fmt in BGRA NV12 I420; do
     run_test "Linear $fmt 640x480" \
         $GST_LAUNCH videotestsrc num-buffers=10 ! \
             "video/x-raw,format=$fmt,width=640,height=480" ! \
-            vfmetaldeinterlace method=linear ! \
+            $INTERLACED ! vfmetaldeinterlace method=linear ! \
             fakesink
 done
 
 # --- Weave method (needs history) ---
 echo "--- Weave method ---"
-for fmt in BGRA NV12; do
+for fmt in BGRA NV12 I420; do
     run_test "Weave $fmt 640x480 (30 frames)" \
         $GST_LAUNCH videotestsrc num-buffers=30 ! \
             "video/x-raw,format=$fmt,width=640,height=480" ! \
-            vfmetaldeinterlace method=weave ! \
+            $INTERLACED ! vfmetaldeinterlace method=weave ! \
             fakesink
 done
 
@@ -79,19 +117,31 @@ echo "--- GreedyH method ---"
 run_test "GreedyH BGRA 640x480" \
     $GST_LAUNCH videotestsrc num-buffers=30 ! \
         "video/x-raw,format=BGRA,width=640,height=480" ! \
-        vfmetaldeinterlace method=greedyh ! \
+        $INTERLACED ! vfmetaldeinterlace method=greedyh ! \
         fakesink
 
 run_test "GreedyH NV12 640x480" \
     $GST_LAUNCH videotestsrc num-buffers=30 ! \
         "video/x-raw,format=NV12,width=640,height=480" ! \
-        vfmetaldeinterlace method=greedyh ! \
+        $INTERLACED ! vfmetaldeinterlace method=greedyh ! \
+        fakesink
+
+run_test "GreedyH I420 640x480" \
+    $GST_LAUNCH videotestsrc num-buffers=30 ! \
+        "video/x-raw,format=I420,width=640,height=480" ! \
+        $INTERLACED ! vfmetaldeinterlace method=greedyh ! \
+        fakesink
+
+run_test "GreedyH NV12 odd size 721x481" \
+    $GST_LAUNCH videotestsrc num-buffers=30 pattern=ball ! \
+        "video/x-raw,format=NV12,width=721,height=481" ! \
+        $INTERLACED ! vfmetaldeinterlace method=greedyh ! \
         fakesink
 
 run_test "GreedyH custom threshold" \
     $GST_LAUNCH videotestsrc num-buffers=30 ! \
         "video/x-raw,format=BGRA,width=640,height=480" ! \
-        vfmetaldeinterlace method=greedyh motion-threshold=0.3 ! \
+        $INTERLACED ! vfmetaldeinterlace method=greedyh motion-threshold=0.3 ! \
         fakesink
 
 # --- Field layout ---
@@ -99,13 +149,13 @@ echo "--- Field layout ---"
 run_test "Top-field-first" \
     $GST_LAUNCH videotestsrc num-buffers=10 ! \
         "video/x-raw,format=BGRA,width=640,height=480" ! \
-        vfmetaldeinterlace method=bob field-layout=top-field-first ! \
+        $INTERLACED ! vfmetaldeinterlace method=bob field-layout=top-field-first ! \
         fakesink
 
 run_test "Bottom-field-first" \
     $GST_LAUNCH videotestsrc num-buffers=10 ! \
         "video/x-raw,format=BGRA,width=640,height=480" ! \
-        vfmetaldeinterlace method=bob field-layout=bottom-field-first ! \
+        $INTERLACED ! vfmetaldeinterlace method=bob field-layout=bottom-field-first ! \
         fakesink
 
 # --- HD content ---
@@ -113,15 +163,71 @@ echo "--- HD content ---"
 run_test "Bob 1080p BGRA" \
     $GST_LAUNCH videotestsrc num-buffers=5 ! \
         "video/x-raw,format=BGRA,width=1920,height=1080" ! \
-        vfmetaldeinterlace method=bob ! \
+        $INTERLACED ! vfmetaldeinterlace method=bob ! \
         fakesink
 
 run_test "Linear 1080p NV12" \
     $GST_LAUNCH videotestsrc num-buffers=5 ! \
         "video/x-raw,format=NV12,width=1920,height=1080" ! \
+        $INTERLACED ! vfmetaldeinterlace method=linear ! \
+        fakesink
+
+# --- Field-rate output ---
+echo "--- Field-rate output ---"
+for method in bob linear weave greedyh; do
+    run_test "mode=double ${method} doubles 25/1 to 50/1" \
+        $GST_LAUNCH videotestsrc num-buffers=10 ! \
+            "video/x-raw,format=NV12,width=720,height=576,framerate=25/1" ! \
+            $INTERLACED ! vfmetaldeinterlace method=$method mode=double ! \
+            "video/x-raw,framerate=50/1" ! \
+            fakesink
+done
+
+run_test "mode=double BGRA" \
+    $GST_LAUNCH videotestsrc num-buffers=10 ! \
+        "video/x-raw,format=BGRA,width=640,height=480,framerate=30000/1001" ! \
+        $INTERLACED ! vfmetaldeinterlace mode=double ! \
+        "video/x-raw,framerate=60000/1001" ! \
+        fakesink
+
+# --- Progressive input ---
+echo "--- Progressive input ---"
+run_test "Progressive caps pass through (BGRA)" \
+    $GST_LAUNCH videotestsrc num-buffers=10 ! \
+        "video/x-raw,format=BGRA,width=640,height=480" ! \
+        vfmetaldeinterlace method=greedyh ! \
+        fakesink
+
+run_test "Progressive caps pass through (NV12, in-flight=3)" \
+    $GST_LAUNCH videotestsrc num-buffers=10 ! \
+        "video/x-raw,format=NV12,width=640,height=480" ! \
+        vfmetaldeinterlace method=weave in-flight=3 ! \
+        fakesink
+
+run_test "Mixed caps, unflagged buffers forwarded" \
+    $GST_LAUNCH videotestsrc num-buffers=10 ! \
+        "video/x-raw,format=NV12,width=640,height=480" ! \
+        capssetter caps=video/x-raw,interlace-mode=mixed ! \
         vfmetaldeinterlace method=linear ! \
         fakesink
 
+run_test "Mixed caps, mode=double repeats unflagged buffers" \
+    $GST_LAUNCH videotestsrc num-buffers=10 ! \
+        "video/x-raw,format=BGRA,width=640,height=480,framerate=25/1" ! \
+        capssetter caps=video/x-raw,interlace-mode=mixed ! \
+        vfmetaldeinterlace mode=double ! \
+        "video/x-raw,framerate=50/1" ! \
+        fakesink
+
+run_test "Progressive caps, mode=double: 20 buffers at field times" \
+    check_double_timestamps
+run_test "Progressive caps, mode=double: frames repeated unchanged" \
+    check_double_content
+run_test "Mixed caps, mode=double: 20 buffers at field times" \
+    check_double_timestamps "capssetter caps=video/x-raw,interlace-mode=mixed"
+run_test "Mixed caps, mode=double: unflagged frames repeated unchanged" \
+    check_double_content "capssetter caps=video/x-raw,interlace-mode=mixed"
+
 # --- Summary ---
 echo ""
 echo "=== Results: $PASSED/$TOTAL passed, $FAILED failed ==="
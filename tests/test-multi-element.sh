@@ -182,6 +182,48 @@ run_test "deinterlace ! convertscale (NV12 scale)" \
         "video/x-raw,format=NV12,width=320,height=240" ! \
         fakesink
 
+# --- GPU memory (memory:MetalTexture) chains ---
+echo "--- GPU memory chains ---"
+
+for fmt in BGRA NV12 I420 UYVY; do
+    run_test "convertscale ! MetalTexture ! convertscale ($fmt)" \
+        $GST_LAUNCH videotestsrc num-buffers=10 ! \
+            "video/x-raw,format=$fmt,width=640,height=480" ! \
+            vfmetalconvertscale ! \
+            "video/x-raw(memory:MetalTexture),format=$fmt,width=320,height=240" ! \
+            vfmetalconvertscale ! \
+            "video/x-raw,format=BGRA,width=320,height=240" ! \
+            fakesink
+done
+
+run_test "convertscale ! MetalTexture ! videofilter ! transform ! convertscale" \
+    $GST_LAUNCH videotestsrc num-buffers=10 ! \
+        "video/x-raw,format=NV12,width=640,height=480" ! \
+        vfmetalconvertscale ! \
+        "video/x-raw(memory:MetalTexture),format=NV12,width=320,height=240" ! \
+        vfmetalvideofilter brightness=0.1 ! \
+        vfmetaltransform method=horizontal-flip ! \
+        vfmetalconvertscale ! \
+        "video/x-raw,format=BGRA,width=320,height=240" ! \
+        fakesink
+
+run_test "MetalTexture inputs ! compositor" \
+    $GST_LAUNCH \
+        videotestsrc num-buffers=10 ! \
+            "video/x-raw,format=BGRA,width=320,height=240" ! \
+            vfmetalconvertscale ! \
+            "video/x-raw(memory:MetalTexture),format=BGRA,width=320,height=240" ! \
+            comp.sink_0 \
+        videotestsrc num-buffers=10 pattern=snow ! \
+            "video/x-raw,format=NV12,width=320,height=240" ! \
+            vfmetalconvertscale ! \
+            "video/x-raw(memory:MetalTexture),format=NV12,width=320,height=240" ! \
+            comp.sink_1 \
+        vfmetalcompositor name=comp sink_1::xpos=320 ! \
+        vfmetalconvertscale ! \
+        "video/x-raw,format=BGRA,width=640,height=240" ! \
+        fakesink
+
 # --- Four-element chain (stress test) ---
 echo "--- Four-element chain ---"
 
@@ -195,6 +237,62 @@ run_test "deinterlace ! videofilter ! transform ! convertscale" \
         "video/x-raw,format=BGRA,width=320,height=240" ! \
         fakesink
 
+# --- Pipelined submission (in-flight > 1) ---
+echo "--- Pipelined submission ---"
+
+for fmt in BGRA NV12 I420; do
+    run_test "in-flight=3 deinterlace ! videofilter ! transform ! overlay ($fmt)" \
+        $GST_LAUNCH videotestsrc num-buffers=30 ! \
+            "video/x-raw,format=$fmt,width=640,height=480" ! \
+            vfmetaldeinterlace method=greedyh in-flight=3 ! \
+            vfmetalvideofilter brightness=0.1 in-flight=3 ! \
+            vfmetaltransform method=clockwise in-flight=3 ! \
+            vfmetaloverlay alpha=0.5 in-flight=3 ! \
+            fakesink
+done
+
+run_test "in-flight=4 convertscale (UYVY out)" \
+    $GST_LAUNCH videotestsrc num-buffers=30 ! \
+        "video/x-raw,format=NV12,width=640,height=480" ! \
+        vfmetalconvertscale in-flight=4 ! \
+        "video/x-raw,format=UYVY,width=320,height=240" ! \
+        fakesink
+
+run_test "in-flight=2 compositor (MetalTexture + NV12)" \
+    $GST_LAUNCH \
+        videotestsrc num-buffers=30 ! \
+            "video/x-raw,format=BGRA,width=320,height=240" ! \
+            vfmetalconvertscale ! \
+            "video/x-raw(memory:MetalTexture),format=BGRA,width=320,height=240" ! \
+            comp.sink_0 \
+        videotestsrc num-buffers=30 pattern=snow ! \
+            "video/x-raw,format=NV12,width=320,height=240" ! \
+            comp.sink_1 \
+        vfmetalcompositor name=comp in-flight=2 sink_1::xpos=320 ! \
+        "video/x-raw,format=BGRA,width=640,height=240" ! \
+        fakesink
+
+# --- Device selection ---
+echo "--- Device selection ---"
+
+run_test "device=0 on every element (MetalTexture between)" \
+    $GST_LAUNCH videotestsrc num-buffers=10 ! \
+        "video/x-raw,format=NV12,width=640,height=480" ! \
+        vfmetalconvertscale device=0 ! \
+        "video/x-raw(memory:MetalTexture),format=BGRA,width=640,height=480" ! \
+        vfmetalvideofilter brightness=0.1 device=0 ! \
+        vfmetaltransform method=clockwise device=0 ! \
+        fakesink
+
+run_test "device=0 on the first element, neighbours follow its context" \
+    $GST_LAUNCH videotestsrc num-buffers=10 ! \
+        "video/x-raw,format=BGRA,width=640,height=480" ! \
+        vfmetaldeinterlace method=bob device=0 ! \
+        vfmetalvideofilter sepia=0.5 ! \
+        vfmetalconvertscale ! \
+        "video/x-raw,format=I420,width=320,height=240" ! \
+        fakesink
+
 # --- Summary ---
 echo ""
 echo "=== Multi-element results: ${PASSED}/${TOTAL} passed, ${FAILED} failed ==="
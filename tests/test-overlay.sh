@@ -30,6 +30,12 @@ $GST_LAUNCH videotestsrc num-buffers=1 pattern=red ! \
     "video/x-raw,format=BGRA,width=32,height=32" ! \
     videoconvert ! pngenc ! filesink location="$TEST_IMG" > /dev/null 2>&1 || true
 
+# Numbered PNG sequence for animated overlays (8 frames, 48x48)
+TEST_SEQ="/tmp/vfmetal_test_overlay_seq_%02d.png"
+$GST_LAUNCH videotestsrc num-buffers=8 pattern=ball ! \
+    "video/x-raw,format=BGRA,width=48,height=48" ! \
+    videoconvert ! pngenc ! multifilesink location="$TEST_SEQ" > /dev/null 2>&1 || true
+
 run_test() {
     local name="$1"
     shift
@@ -81,6 +87,16 @@ if [ -f "$TEST_IMG" ]; then
                 fakesink
     done
 
+    # A '%' that is not a single %d is part of the file name
+    TEST_IMG_PCT="/tmp/vfmetal_test_overlay_50%s%n.png"
+    cp "$TEST_IMG" "$TEST_IMG_PCT"
+    run_test "Overlay with literal % in location" \
+        $GST_LAUNCH videotestsrc num-buffers=5 ! \
+            "video/x-raw,format=BGRA,width=640,height=480" ! \
+            vfmetaloverlay location="$TEST_IMG_PCT" ! \
+            fakesink
+    rm -f "$TEST_IMG_PCT"
+
     echo "--- Position and size ---"
     run_test "Overlay at x=100 y=50" \
         $GST_LAUNCH videotestsrc num-buffers=5 ! \
@@ -125,12 +141,88 @@ if [ -f "$TEST_IMG" ]; then
             "video/x-raw,format=NV12,width=1920,height=1080" ! \
             vfmetaloverlay location="$TEST_IMG" relative-x=0.9 relative-y=0.05 ! \
             fakesink
+
+    echo "--- In-place (overlay rectangle only) ---"
+    for fmt in BGRA RGBA NV12 I420; do
+        run_test "In-place $fmt odd position" \
+            $GST_LAUNCH videotestsrc num-buffers=5 ! \
+                "video/x-raw,format=$fmt,width=640,height=480" ! \
+                vfmetaloverlay location="$TEST_IMG" x=101 y=33 in-place=true ! \
+                fakesink
+    done
+
+    run_test "In-place clipped at frame edge" \
+        $GST_LAUNCH videotestsrc num-buffers=5 ! \
+            "video/x-raw,format=NV12,width=640,height=480" ! \
+            vfmetaloverlay location="$TEST_IMG" x=600 y=460 in-place=true ! \
+            fakesink
+
+    run_test "In-place in-flight=3" \
+        $GST_LAUNCH videotestsrc num-buffers=10 ! \
+            "video/x-raw,format=I420,width=1920,height=1080" ! \
+            vfmetaloverlay location="$TEST_IMG" in-place=true in-flight=3 ! \
+            fakesink
+
+    echo "--- Configured overlays (one batched pass) ---"
+    run_test "Three configured overlays" \
+        $GST_LAUNCH videotestsrc num-buffers=10 ! \
+            "video/x-raw,format=BGRA,width=640,height=480" ! \
+            vfmetaloverlay overlays="a, location=$TEST_IMG, x=10, y=10; b, location=$TEST_IMG, relative-x=0.5, relative-y=0.5, alpha=0.5; c, location=$TEST_IMG, x=600, y=440, width=64, height=64" ! \
+            fakesink
+
+    for fmt in NV12 I420; do
+        run_test "Main image plus overlays in-place $fmt" \
+            $GST_LAUNCH videotestsrc num-buffers=5 ! \
+                "video/x-raw,format=$fmt,width=640,height=480" ! \
+                vfmetaloverlay location="$TEST_IMG" in-place=true overlays="a, location=$TEST_IMG, x=300, y=201" ! \
+                fakesink
+    done
 else
     echo "--- Skipping overlay tests (could not generate test image) ---"
 fi
 
+# --- Animated overlays ---
+if [ -f "/tmp/vfmetal_test_overlay_seq_00.png" ]; then
+    echo "--- Animated overlays ---"
+    for fmt in BGRA NV12; do
+        run_test "Image sequence $fmt" \
+            $GST_LAUNCH videotestsrc num-buffers=30 ! \
+                "video/x-raw,format=$fmt,width=640,height=480" ! \
+                vfmetaloverlay location="$TEST_SEQ" x=20 y=20 ! \
+                fakesink
+    done
+
+    run_test "Image sequence frame-rate=10 loop=false" \
+        $GST_LAUNCH videotestsrc num-buffers=30 ! \
+            "video/x-raw,format=BGRA,width=640,height=480" ! \
+            vfmetaloverlay location="$TEST_SEQ" frame-rate=10 loop=false ! \
+            fakesink
+else
+    echo "--- Skipping animated overlay tests (could not generate sequence) ---"
+fi
+
+# --- Upstream overlay compositions ---
+if $GST_INSPECT textoverlay > /dev/null 2>&1; then
+    echo "--- Overlay composition meta ---"
+    for fmt in BGRA NV12; do
+        run_test "textoverlay composition $fmt" \
+            $GST_LAUNCH videotestsrc num-buffers=10 ! \
+                "video/x-raw,format=$fmt,width=640,height=480" ! \
+                textoverlay text="vfmetal" ! vfmetaloverlay ! \
+                fakesink
+    done
+
+    run_test "textoverlay composition in-place in-flight=3" \
+        $GST_LAUNCH videotestsrc num-buffers=10 ! \
+            "video/x-raw,format=I420,width=640,height=480" ! \
+            timeoverlay ! vfmetaloverlay in-place=true in-flight=3 ! \
+            fakesink
+else
+    echo "--- Skipping overlay composition tests (textoverlay not available) ---"
+fi
+
 # Cleanup
-rm -f "$TEST_IMG"
+rm -f "$TEST_IMG" /tmp/vfmetal_test_overlay_seq_*.png
 
 # --- Summary ---
 echo ""
@@ -0,0 +1,154 @@
+#!/bin/bash
+# Test suite for vfmetalscaleladder element
+# Usage: ./test-scaleladder.sh [path-to-plugin-dir]
+
+set -u
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+BUILD_DIR="${SCRIPT_DIR}/../build"
+PLUGIN="${BUILD_DIR}/gstvfmetal.dylib"
+
+# Find GStreamer commands
+if [ -d "/Library/Frameworks/GStreamer.framework/Commands" ]; then
+    GST_CMD="/Library/Frameworks/GStreamer.framework/Commands"
+else
+    GST_CMD=""
+fi
+
+GST_INSPECT="${GST_CMD:+${GST_CMD}/}gst-inspect-1.0"
+GST_LAUNCH="${GST_CMD:+${GST_CMD}/}gst-launch-1.0"
+
+export GST_PLUGIN_PATH="${BUILD_DIR}"
+
+PASSED=0
+FAILED=0
+TOTAL=0
+
+run_test() {
+    local name="$1"
+    shift
+    TOTAL=$((TOTAL + 1))
+    printf "  [%02d] %-60s " "$TOTAL" "$name"
+    if "$@" > /dev/null 2>&1; then
+        echo "PASS"
+        PASSED=$((PASSED + 1))
+    else
+        echo "FAIL"
+        FAILED=$((FAILED + 1))
+    fi
+}
+
+# Renditions of 10 frames with in-flight=$1 and extra properties $2 must
+# match, byte for byte, a run that waits for every frame
+check_in_flight() {
+    local dir depth ret=0
+    dir=$(mktemp -d)
+    for depth in 1 "$1"; do
+        $GST_LAUNCH videotestsrc num-buffers=10 pattern=ball ! \
+            "video/x-raw,format=NV12,width=640,height=360" ! \
+            vfmetalscaleladder name=l in-flight=$depth ${2:-} \
+            l. ! queue ! "video/x-raw,format=UYVY,width=480,height=270" ! \
+                filesink location="$dir/a$depth.raw" \
+            l. ! queue ! "video/x-raw,format=BGRA,width=320,height=180" ! \
+                filesink location="$dir/b$depth.raw" \
+            l. ! queue ! "video/x-raw,format=NV12,width=160,height=90" ! \
+                filesink location="$dir/c$depth.raw" || ret=1
+    done
+    [ $ret -eq 0 ] && \
+        [ "$(wc -c < "$dir/b1.raw")" -eq $((320 * 180 * 4 * 10)) ] && \
+        cmp -s "$dir/a1.raw" "$dir/a$1.raw" && \
+        cmp -s "$dir/b1.raw" "$dir/b$1.raw" && \
+        cmp -s "$dir/c1.raw" "$dir/c$1.raw"
+    ret=$?
+    rm -rf "$dir"
+    return $ret
+}
+
+echo "=== vfmetalscaleladder test suite ==="
+echo ""
+
+# --- Element inspection ---
+echo "--- Element inspection ---"
+run_test "Element loads" \
+    $GST_INSPECT vfmetalscaleladder
+
+# --- Ladders ---
+echo "--- Ladders ---"
+for fmt in BGRA RGBA NV12 I420 UYVY YUY2; do
+    run_test "Three renditions from $fmt" \
+        $GST_LAUNCH videotestsrc num-buffers=10 ! \
+            "video/x-raw,format=$fmt,width=1280,height=720" ! \
+            vfmetalscaleladder name=l \
+            l. ! queue ! "video/x-raw,width=960,height=540" ! fakesink \
+            l. ! queue ! "video/x-raw,width=640,height=360" ! fakesink \
+            l. ! queue ! "video/x-raw,width=320,height=180" ! fakesink
+done
+
+run_test "Mixed output formats" \
+    $GST_LAUNCH videotestsrc num-buffers=10 ! \
+        "video/x-raw,format=NV12,width=1280,height=720" ! \
+        vfmetalscaleladder name=l \
+        l. ! queue ! "video/x-raw,format=I420,width=640,height=360" ! fakesink \
+        l. ! queue ! "video/x-raw,format=BGRA,width=160,height=90" ! fakesink
+
+run_test "Single rendition" \
+    $GST_LAUNCH videotestsrc num-buffers=10 ! \
+        "video/x-raw,format=BGRA,width=640,height=480" ! \
+        vfmetalscaleladder name=l \
+        l. ! queue ! "video/x-raw,width=320,height=240" ! fakesink
+
+# --- Methods and cascade ---
+echo "--- Methods and cascade ---"
+for method in bilinear nearest bicubic lanczos; do
+    run_test "method=$method" \
+        $GST_LAUNCH videotestsrc num-buffers=5 ! \
+            "video/x-raw,format=NV12,width=1920,height=1080" ! \
+            vfmetalscaleladder name=l method=$method \
+            l. ! queue ! "video/x-raw,width=1280,height=720" ! fakesink \
+            l. ! queue ! "video/x-raw,width=640,height=360" ! fakesink
+done
+
+run_test "cascade=false" \
+    $GST_LAUNCH videotestsrc num-buffers=10 ! \
+        "video/x-raw,format=I420,width=1280,height=720" ! \
+        vfmetalscaleladder name=l cascade=false \
+        l. ! queue ! "video/x-raw,width=640,height=360" ! fakesink \
+        l. ! queue ! "video/x-raw,width=320,height=180" ! fakesink
+
+run_test "Letterboxed rendition next to full-picture ones" \
+    $GST_LAUNCH videotestsrc num-buffers=10 ! \
+        "video/x-raw,format=BGRA,width=1280,height=720" ! \
+        vfmetalscaleladder name=l add-borders=true \
+        l. ! queue ! "video/x-raw,width=640,height=480" ! fakesink \
+        l. ! queue ! "video/x-raw,width=640,height=360" ! fakesink \
+        l. ! queue ! "video/x-raw,width=320,height=180" ! fakesink
+
+# --- In-flight frames ---
+echo "--- In-flight frames ---"
+for depth in 2 4; do
+    run_test "in-flight=$depth matches in-flight=1" \
+        check_in_flight $depth
+    run_test "in-flight=$depth, cascade=false matches in-flight=1" \
+        check_in_flight $depth cascade=false
+done
+
+run_test "in-flight=3, method=lanczos matches in-flight=1" \
+    check_in_flight 3 method=lanczos
+
+# --- GPU memory ---
+echo "--- GPU memory ---"
+run_test "MetalTexture renditions" \
+    $GST_LAUNCH videotestsrc num-buffers=5 ! \
+        "video/x-raw,format=NV12,width=1280,height=720" ! \
+        vfmetalscaleladder name=l \
+        l. ! queue ! "video/x-raw(memory:MetalTexture),format=BGRA,width=640,height=360" ! \
+            vfmetalconvertscale ! "video/x-raw,format=BGRA" ! fakesink \
+        l. ! queue ! "video/x-raw,format=NV12,width=320,height=180" ! fakesink
+
+# --- Summary ---
+echo ""
+echo "=== Results: $PASSED/$TOTAL passed, $FAILED failed ==="
+
+if [ $FAILED -gt 0 ]; then
+    exit 1
+fi
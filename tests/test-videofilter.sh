@@ -94,6 +94,7 @@ check_inspect "has vignette property" "vignette"
 check_inspect "has chroma-key-enabled property" "chroma-key-enabled"
 check_inspect "has chroma-key-color property" "chroma-key-color"
 check_inspect "has lut-file property" "lut-file"
+check_inspect "has device property" "device"
 check_inspect "is GstVideoFilter subclass" "GstVideoFilter"
 
 # --- 3. Passthrough mode (default properties) ---
@@ -178,6 +179,10 @@ run_pipeline "blur=-0.8" \
     videotestsrc num-buffers=30 ! "video/x-raw,format=BGRA,width=320,height=240" ! \
     vfmetalvideofilter sharpness=-0.8 ! fakesink
 
+run_pipeline "sharpen, partial edge tiles (333x187)" \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=BGRA,width=333,height=187" ! \
+    vfmetalvideofilter sharpness=0.8 ! fakesink
+
 # --- 8. Chroma key ---
 echo "[Chroma key]"
 run_pipeline "chroma key green" \
@@ -224,6 +229,50 @@ run_pipeline "NV12 with sharpness" \
     videotestsrc num-buffers=30 ! "video/x-raw,format=NV12,width=320,height=240" ! \
     vfmetalvideofilter sharpness=0.5 ! fakesink
 
+# --- 12. Baked colour LUT ---
+echo "[Baked colour LUT]"
+run_pipeline "NV12 chroma key (fine lattice)" \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=NV12,width=320,height=240" ! \
+    vfmetalvideofilter chroma-key-enabled=true contrast=1.1 ! fakesink
+
+run_pipeline "I420 baked colour + sharpen" \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=I420,width=320,height=240" ! \
+    vfmetalvideofilter hue=0.2 gamma=1.3 sharpness=0.6 ! fakesink
+
+# --- 13. LUT files ---
+echo "[LUT files]"
+# 2x2x2 .cube that swaps red and blue
+TEST_LUT="/tmp/vfmetal_test_swap.cube"
+cat > "$TEST_LUT" <<'CUBE'
+# Red/blue swap
+TITLE "swap"
+LUT_3D_SIZE 2
+DOMAIN_MIN 0.0 0.0 0.0
+DOMAIN_MAX 1.0 1.0 1.0
+0.0 0.0 0.0
+0.0 0.0 1.0
+0.0 1.0 0.0
+0.0 1.0 1.0
+1.0 0.0 0.0
+1.0 0.0 1.0
+1.0 1.0 0.0
+1.0 1.0 1.0
+CUBE
+
+run_pipeline "BGRA with .cube LUT" \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=BGRA,width=320,height=240" ! \
+    vfmetalvideofilter lut-file="$TEST_LUT" ! fakesink
+
+run_pipeline "NV12 with .cube LUT + contrast" \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=NV12,width=320,height=240" ! \
+    vfmetalvideofilter lut-file="$TEST_LUT" contrast=1.2 ! fakesink
+
+run_pipeline "Missing LUT file keeps streaming" \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=BGRA,width=320,height=240" ! \
+    vfmetalvideofilter lut-file=/nonexistent/grade.cube ! fakesink
+
+rm -f "$TEST_LUT"
+
 # --- Summary ---
 echo ""
 echo "=== Video filter results: ${PASS}/${TOTAL} passed, ${FAIL} failed ==="
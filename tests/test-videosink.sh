@@ -81,6 +81,10 @@ check_inspect() {
 
 check_inspect "has sink pad template" "SINK template"
 check_inspect "has force-aspect-ratio property" "force-aspect-ratio"
+check_inspect "has present-mode property" "present-mode"
+check_inspect "has max-drawables property" "max-drawables"
+check_inspect "has dropped-frames property" "dropped-frames"
+check_inspect "has device property" "device"
 check_inspect "implements GstVideoOverlay" "GstVideoOverlay"
 check_inspect "implements GstNavigation" "GstNavigation"
 
@@ -105,6 +109,15 @@ run_pipeline "I420 rendering" \
     videotestsrc num-buffers=30 ! "video/x-raw,format=I420,width=320,height=240" ! \
     vfmetalvideosink
 
+# --- 6b. 10-bit input ---
+run_pipeline "P010_10LE rendering (BT.2020)" \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=P010_10LE,width=320,height=240,colorimetry=bt2020" ! \
+    vfmetalvideosink
+
+run_pipeline "I420_10LE rendering" \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=I420_10LE,width=320,height=240" ! \
+    vfmetalvideosink
+
 # --- 7. Resolution tests ---
 echo "[Resolution tests]"
 run_pipeline "1920x1080 rendering" \
@@ -121,6 +134,51 @@ run_pipeline "force-aspect-ratio=false" \
     videotestsrc num-buffers=30 ! "video/x-raw,format=BGRA,width=320,height=240" ! \
     vfmetalvideosink force-aspect-ratio=false
 
+# --- 9. Presentation modes ---
+echo "[Presentation]"
+run_pipeline "present-mode=immediate" \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=BGRA,width=320,height=240" ! \
+    vfmetalvideosink present-mode=immediate
+
+run_pipeline "present-mode=scheduled render-delay" \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=NV12,width=320,height=240,framerate=30/1" ! \
+    vfmetalvideosink present-mode=scheduled render-delay=33333333
+
+run_pipeline "present-mode=scheduled sync=false" \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=BGRA,width=320,height=240" ! \
+    vfmetalvideosink present-mode=scheduled sync=false
+
+run_pipeline "present-mode=display-link max-drawables=2" \
+    videotestsrc num-buffers=30 ! "video/x-raw,format=I420,width=320,height=240,framerate=60/1" ! \
+    vfmetalvideosink present-mode=display-link max-drawables=2
+
+# --- 10. Application window handle ---
+# The handle is set in READY, before PLAYING, like an embedding player;
+# needs a compiler to build the small AppKit host program
+echo "[Window handle]"
+HOST="${BUILD_DIR}/videosink-window-handle"
+if command -v clang > /dev/null 2>&1 && \
+    pkg-config --exists gstreamer-video-1.0 2> /dev/null; then
+    clang -fobjc-arc -framework AppKit \
+        "${SCRIPT_DIR}/videosink-window-handle.m" -o "${HOST}" \
+        $(pkg-config --cflags --libs gstreamer-1.0 gstreamer-video-1.0) \
+        > /dev/null 2>&1 || rm -f "${HOST}"
+fi
+if [ -x "${HOST}" ]; then
+    for mode in display-link scheduled immediate; do
+        TOTAL=$((TOTAL + 1))
+        if "${HOST}" "${mode}" > /dev/null 2>&1; then
+            echo "  PASS  window handle before PLAYING, present-mode=${mode}"
+            PASS=$((PASS + 1))
+        else
+            echo "  FAIL  window handle before PLAYING, present-mode=${mode}"
+            FAIL=$((FAIL + 1))
+        fi
+    done
+else
+    echo "  (skipping: could not build ${HOST})"
+fi
+
 # --- Summary ---
 echo ""
 echo "=== Video sink results: ${PASS}/${TOTAL} passed, ${FAIL} failed ==="
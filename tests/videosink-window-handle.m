@@ -0,0 +1,91 @@
+/*
+ * Embeds vfmetalvideosink in an application view the way players do:
+ * the window handle is set in READY, before PLAYING. Exits 0 when the
+ * stream reaches EOS with (almost) every queued frame presented, i.e.
+ * the present mode and drawable count already applied to that window.
+ *
+ * Usage: videosink-window-handle [present-mode]
+ * Built and run by test-videosink.sh.
+ */
+
+#import <AppKit/AppKit.h>
+
+#include <gst/gst.h>
+#include <gst/video/videooverlay.h>
+
+#define NUM_BUFFERS 60
+
+int
+main (int argc, char **argv)
+{
+  @autoreleasepool {
+    const char *mode;
+    gchar *desc;
+    GError *error = NULL;
+    GstElement *pipeline, *sink;
+    GstBus *bus;
+    gboolean eos = FALSE, failed = FALSE;
+    guint64 dropped = 0;
+
+    gst_init (&argc, &argv);
+    mode = argc > 1 ? argv[1] : "display-link";
+
+    [NSApplication sharedApplication];
+    NSWindow *window = [[NSWindow alloc]
+        initWithContentRect:NSMakeRect (100, 100, 320, 240)
+                  styleMask:NSWindowStyleMaskTitled
+                    backing:NSBackingStoreBuffered
+                      defer:NO];
+    [window makeKeyAndOrderFront:nil];
+
+    desc = g_strdup_printf ("videotestsrc num-buffers=%d ! "
+        "video/x-raw,format=BGRA,width=320,height=240,framerate=60/1 ! "
+        "vfmetalvideosink name=sink present-mode=%s max-drawables=2",
+        NUM_BUFFERS, mode);
+    pipeline = gst_parse_launch (desc, &error);
+    g_free (desc);
+    if (!pipeline) {
+      g_printerr ("%s\n", error->message);
+      g_clear_error (&error);
+      return 1;
+    }
+    sink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+
+    gst_element_set_state (pipeline, GST_STATE_READY);
+    gst_video_overlay_set_window_handle (GST_VIDEO_OVERLAY (sink),
+        (guintptr) (__bridge void *) window.contentView);
+    gst_element_set_state (pipeline, GST_STATE_PLAYING);
+
+    /* The sink creates its view on the main thread: keep the run loop
+     * going while waiting for the end of the stream */
+    bus = gst_element_get_bus (pipeline);
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:10];
+    while (!eos && !failed && deadline.timeIntervalSinceNow > 0) {
+      GstMessage *msg;
+
+      [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+          beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+      while ((msg = gst_bus_pop_filtered (bus,
+                  GST_MESSAGE_EOS | GST_MESSAGE_ERROR))) {
+        if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS)
+          eos = TRUE;
+        else
+          failed = TRUE;
+        gst_message_unref (msg);
+      }
+    }
+
+    g_object_get (sink, "dropped-frames", &dropped, NULL);
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+    gst_object_unref (bus);
+    gst_object_unref (sink);
+    gst_object_unref (pipeline);
+
+    g_print ("eos=%d error=%d dropped=%" G_GUINT64_FORMAT "/%d\n",
+        eos, failed, dropped, NUM_BUFFERS);
+
+    /* Frames nobody presents pile up in the sink's queue and are
+     * dropped, so most of the stream would be lost */
+    return (eos && !failed && dropped < NUM_BUFFERS / 2) ? 0 : 1;
+  }
+}